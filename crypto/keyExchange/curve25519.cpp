@@ -53,6 +53,16 @@
 #define inline __inline
 #endif
 
+/* Use the 64-bit, radix 2^51 field arithmetic when the compiler has a
+ * 128-bit integer type for limb products, and the original 10-limb code
+ * otherwise.  Define CURVE25519_FORCE_32BIT to always use the 10-limb code.
+ */
+#if defined(__SIZEOF_INT128__) && !defined(CURVE25519_FORCE_32BIT)
+#define CURVE25519_64BIT
+#endif
+
+#ifndef CURVE25519_64BIT
+
 typedef uint8_t u8;
 typedef int32_t s32;
 typedef int64_t limb;
@@ -711,11 +721,467 @@ crecip(limb *out, const limb *z) {
   /* 2^255 - 21 */ fmul(out,t1,z11);
 }
 
+/* Output = x * zinverse, fully reduced and contracted into 32 bytes. */
+static void
+fmul_contract(u8 *output, const limb *x, const limb *zinverse) {
+  limb t[11];
+  fmul(t, x, zinverse);
+  freduce_coefficients(t);
+  fcontract(output, t);
+}
+
+/* Contract a reduced-form number into 32 bytes without destroying it. */
+static void
+fcontract_copy(u8 *output, const limb *input) {
+  limb t[11];
+  memcpy(t, input, sizeof(limb) * 10);
+  freduce_coefficients(t);
+  fcontract(output, t);
+}
+
+#define FELEM_LIMBS 10
+
+#else  /* CURVE25519_64BIT */
+
+/* 64-bit field arithmetic, after curve25519-donna-c64.
+ *
+ * Field elements are written as an array of five unsigned, 64-bit limbs,
+ * least significant first, each holding 51 bits:
+ *   x[0] + 2^51*x[1] + 2^102*x[2] + 2^153*x[3] + 2^204*x[4]
+ *
+ * Products of two limbs are accumulated in 128-bit integers, so a
+ * multiplication is 25 word multiplies instead of 100.
+ */
+
+typedef uint8_t u8;
+typedef uint64_t limb;
+typedef limb felem[5];
+typedef unsigned __int128 uint128_t;
+
+static const limb mask51 = 0x7ffffffffffffULL;
+
+/* Sum two numbers: output += in */
+static inline void fsum(limb *output, const limb *in) {
+  output[0] += in[0];
+  output[1] += in[1];
+  output[2] += in[2];
+  output[3] += in[3];
+  output[4] += in[4];
+}
+
+/* Find the difference of two numbers: output = in - output
+ * (note the order of the arguments!)
+ *
+ * Assumes that out[i] < 2^52.  Adds 8*p before subtracting so that no
+ * limb goes negative.
+ */
+static inline void fdifference_backwards(limb *out, const limb *in) {
+  /* 152 is 19 << 3 */
+  static const limb two54m152 = (((limb)1) << 54) - 152;
+  static const limb two54m8 = (((limb)1) << 54) - 8;
+
+  out[0] = in[0] + two54m152 - out[0];
+  out[1] = in[1] + two54m8 - out[1];
+  out[2] = in[2] + two54m8 - out[2];
+  out[3] = in[3] + two54m8 - out[3];
+  out[4] = in[4] + two54m8 - out[4];
+}
+
+/* Multiply a number by a scalar: output = in * scalar */
+static inline void fscalar_product(limb *output, const limb *in,
+                                   const limb scalar) {
+  uint128_t a;
+
+  a = ((uint128_t) in[0]) * scalar;
+  output[0] = ((limb)a) & mask51;
+
+  a = ((uint128_t) in[1]) * scalar + ((limb) (a >> 51));
+  output[1] = ((limb)a) & mask51;
+
+  a = ((uint128_t) in[2]) * scalar + ((limb) (a >> 51));
+  output[2] = ((limb)a) & mask51;
+
+  a = ((uint128_t) in[3]) * scalar + ((limb) (a >> 51));
+  output[3] = ((limb)a) & mask51;
+
+  a = ((uint128_t) in[4]) * scalar + ((limb) (a >> 51));
+  output[4] = ((limb)a) & mask51;
+
+  output[0] += (limb)(a >> 51) * 19;
+}
+
+/* Multiply two numbers: output = in2 * in
+ *
+ * output may alias either input.  Inputs must have limbs below 2^54,
+ * the output is reduced (limbs below 2^52).
+ */
+static inline void fmul(limb *output, const limb *in2, const limb *in) {
+  uint128_t t[5];
+  limb r0, r1, r2, r3, r4, s0, s1, s2, s3, s4, c;
+
+  r0 = in[0];
+  r1 = in[1];
+  r2 = in[2];
+  r3 = in[3];
+  r4 = in[4];
+
+  s0 = in2[0];
+  s1 = in2[1];
+  s2 = in2[2];
+  s3 = in2[3];
+  s4 = in2[4];
+
+  t[0] = ((uint128_t) r0) * s0;
+  t[1] = ((uint128_t) r0) * s1 + ((uint128_t) r1) * s0;
+  t[2] = ((uint128_t) r0) * s2 + ((uint128_t) r2) * s0 +
+         ((uint128_t) r1) * s1;
+  t[3] = ((uint128_t) r0) * s3 + ((uint128_t) r3) * s0 +
+         ((uint128_t) r1) * s2 + ((uint128_t) r2) * s1;
+  t[4] = ((uint128_t) r0) * s4 + ((uint128_t) r4) * s0 +
+         ((uint128_t) r3) * s1 + ((uint128_t) r1) * s3 +
+         ((uint128_t) r2) * s2;
+
+  r4 *= 19;
+  r1 *= 19;
+  r2 *= 19;
+  r3 *= 19;
+
+  t[0] += ((uint128_t) r4) * s1 + ((uint128_t) r1) * s4 +
+          ((uint128_t) r2) * s3 + ((uint128_t) r3) * s2;
+  t[1] += ((uint128_t) r4) * s2 + ((uint128_t) r2) * s4 +
+          ((uint128_t) r3) * s3;
+  t[2] += ((uint128_t) r4) * s3 + ((uint128_t) r3) * s4;
+  t[3] += ((uint128_t) r4) * s4;
+
+              r0 = (limb)t[0] & mask51; c = (limb)(t[0] >> 51);
+  t[1] += c;  r1 = (limb)t[1] & mask51; c = (limb)(t[1] >> 51);
+  t[2] += c;  r2 = (limb)t[2] & mask51; c = (limb)(t[2] >> 51);
+  t[3] += c;  r3 = (limb)t[3] & mask51; c = (limb)(t[3] >> 51);
+  t[4] += c;  r4 = (limb)t[4] & mask51; c = (limb)(t[4] >> 51);
+  r0 +=   c * 19; c = r0 >> 51; r0 = r0 & mask51;
+  r1 +=   c;      c = r1 >> 51; r1 = r1 & mask51;
+  r2 +=   c;
+
+  output[0] = r0;
+  output[1] = r1;
+  output[2] = r2;
+  output[3] = r3;
+  output[4] = r4;
+}
+
+/* Square a number count times: output = in^(2^count)
+ *
+ * output may alias in, count must be at least 1.
+ */
+static inline void fsquare_times(limb *output, const limb *in, limb count) {
+  uint128_t t[5];
+  limb r0, r1, r2, r3, r4, c;
+  limb d0, d1, d2, d4, d419;
+
+  r0 = in[0];
+  r1 = in[1];
+  r2 = in[2];
+  r3 = in[3];
+  r4 = in[4];
+
+  do {
+    d0 = r0 * 2;
+    d1 = r1 * 2;
+    d2 = r2 * 2 * 19;
+    d419 = r4 * 19;
+    d4 = d419 * 2;
+
+    t[0] = ((uint128_t) r0) * r0 + ((uint128_t) d4) * r1 +
+           (((uint128_t) d2) * (r3     ));
+    t[1] = ((uint128_t) d0) * r1 + ((uint128_t) d4) * r2 +
+           (((uint128_t) r3) * (r3 * 19));
+    t[2] = ((uint128_t) d0) * r2 + ((uint128_t) r1) * r1 +
+           (((uint128_t) d4) * (r3     ));
+    t[3] = ((uint128_t) d0) * r3 + ((uint128_t) d1) * r2 +
+           (((uint128_t) r4) * (d419   ));
+    t[4] = ((uint128_t) d0) * r4 + ((uint128_t) d1) * r3 +
+           (((uint128_t) r2) * (r2     ));
+
+                r0 = (limb)t[0] & mask51; c = (limb)(t[0] >> 51);
+    t[1] += c;  r1 = (limb)t[1] & mask51; c = (limb)(t[1] >> 51);
+    t[2] += c;  r2 = (limb)t[2] & mask51; c = (limb)(t[2] >> 51);
+    t[3] += c;  r3 = (limb)t[3] & mask51; c = (limb)(t[3] >> 51);
+    t[4] += c;  r4 = (limb)t[4] & mask51; c = (limb)(t[4] >> 51);
+    r0 +=   c * 19; c = r0 >> 51; r0 = r0 & mask51;
+    r1 +=   c;      c = r1 >> 51; r1 = r1 & mask51;
+    r2 +=   c;
+  } while (--count);
+
+  output[0] = r0;
+  output[1] = r1;
+  output[2] = r2;
+  output[3] = r3;
+  output[4] = r4;
+}
+
+/* Load a little-endian 64-bit number */
+static limb
+load_limb(const u8 *in) {
+  return
+    ((limb)in[0]) |
+    (((limb)in[1]) << 8) |
+    (((limb)in[2]) << 16) |
+    (((limb)in[3]) << 24) |
+    (((limb)in[4]) << 32) |
+    (((limb)in[5]) << 40) |
+    (((limb)in[6]) << 48) |
+    (((limb)in[7]) << 56);
+}
+
+static void
+store_limb(u8 *out, limb in) {
+  out[0] = in & 0xff;
+  out[1] = (in >> 8) & 0xff;
+  out[2] = (in >> 16) & 0xff;
+  out[3] = (in >> 24) & 0xff;
+  out[4] = (in >> 32) & 0xff;
+  out[5] = (in >> 40) & 0xff;
+  out[6] = (in >> 48) & 0xff;
+  out[7] = (in >> 56) & 0xff;
+}
+
+/* Take a little-endian, 32-byte number and expand it into polynomial form */
+static void
+fexpand(limb *output, const u8 *in) {
+  output[0] = load_limb(in) & mask51;
+  output[1] = (load_limb(in+6) >> 3) & mask51;
+  output[2] = (load_limb(in+12) >> 6) & mask51;
+  output[3] = (load_limb(in+19) >> 1) & mask51;
+  output[4] = (load_limb(in+24) >> 12) & mask51;
+}
+
+/* Carry every limb of t down to 51 bits, folding the top carry back into
+ * t[0] (2^255 = 19 mod p).
+ */
+static inline void
+fcarry_wide(uint128_t *t) {
+  t[1] += t[0] >> 51; t[0] &= mask51;
+  t[2] += t[1] >> 51; t[1] &= mask51;
+  t[3] += t[2] >> 51; t[2] &= mask51;
+  t[4] += t[3] >> 51; t[3] &= mask51;
+  t[0] += 19 * (t[4] >> 51); t[4] &= mask51;
+}
+
+/* Take a reduced polynomial form number and contract it into a
+ * little-endian, 32-byte array, fully reduced mod 2^255 - 19.
+ */
+static void
+fcontract(u8 *output, const limb *input) {
+  uint128_t t[5];
+
+  t[0] = input[0];
+  t[1] = input[1];
+  t[2] = input[2];
+  t[3] = input[3];
+  t[4] = input[4];
+
+  fcarry_wide(t);
+  fcarry_wide(t);
+
+  /* now t is between 0 and 2^255-1, properly carried.
+     case 1: between 0 and 2^255-20.
+     case 2: between 2^255-19 and 2^255-1. */
+
+  t[0] += 19;
+
+  fcarry_wide(t);
+
+  /* now between 19 and 2^255-1 in both cases, and offset by 19. */
+
+  t[0] += 0x8000000000000ULL - 19;
+  t[1] += 0x8000000000000ULL - 1;
+  t[2] += 0x8000000000000ULL - 1;
+  t[3] += 0x8000000000000ULL - 1;
+  t[4] += 0x8000000000000ULL - 1;
+
+  /* now between 2^255 and 2^256-20, and offset by 2^255. */
+
+  t[1] += t[0] >> 51; t[0] &= mask51;
+  t[2] += t[1] >> 51; t[1] &= mask51;
+  t[3] += t[2] >> 51; t[2] &= mask51;
+  t[4] += t[3] >> 51; t[3] &= mask51;
+  t[4] &= mask51;
+
+  store_limb(output,    (limb)( t[0] | (t[1] << 51) ));
+  store_limb(output+8,  (limb)( (t[1] >> 13) | (t[2] << 38) ));
+  store_limb(output+16, (limb)( (t[2] >> 26) | (t[3] << 25) ));
+  store_limb(output+24, (limb)( (t[3] >> 39) | (t[4] << 12) ));
+}
+
+/* Input: Q, Q', Q-Q'
+ * Output: 2Q, Q+Q'
+ *
+ *   x2 z2: reduced output 2Q
+ *   x3 z3: reduced output Q + Q'
+ *   x z: reduced, destroyed
+ *   xprime zprime: reduced, destroyed
+ *   qmqp: reduced, preserved
+ */
+static void fmonty(limb *x2, limb *z2,  /* output 2Q */
+                   limb *x3, limb *z3,  /* output Q + Q' */
+                   limb *x, limb *z,    /* input Q */
+                   limb *xprime, limb *zprime,  /* input Q' */
+                   const limb *qmqp /* input Q - Q' */) {
+  limb origx[5], origxprime[5], zzz[5], xx[5], zz[5], xxprime[5],
+        zzprime[5], zzzprime[5];
+
+  memcpy(origx, x, 5 * sizeof(limb));
+  fsum(x, z);
+  fdifference_backwards(z, origx);  // does x - z
+
+  memcpy(origxprime, xprime, sizeof(limb) * 5);
+  fsum(xprime, zprime);
+  fdifference_backwards(zprime, origxprime);
+  fmul(xxprime, xprime, z);
+  fmul(zzprime, x, zprime);
+  memcpy(origxprime, xxprime, sizeof(limb) * 5);
+  fsum(xxprime, zzprime);
+  fdifference_backwards(zzprime, origxprime);
+  fsquare_times(x3, xxprime, 1);
+  fsquare_times(zzzprime, zzprime, 1);
+  fmul(z3, zzzprime, qmqp);
+
+  fsquare_times(xx, x, 1);
+  fsquare_times(zz, z, 1);
+  fmul(x2, xx, zz);
+  fdifference_backwards(zz, xx);  // does zz = xx - zz
+  fscalar_product(zzz, zz, 121665);
+  fsum(zzz, xx);
+  fmul(z2, zz, zzz);
+}
+
+/* Conditionally swap two reduced-form limb arrays if 'iswap' is 1, but leave
+ * them unchanged if 'iswap' is 0.  Runs in data-invariant time to avoid
+ * side-channel attacks.
+ *
+ * NOTE that this function requires that 'iswap' be 1 or 0; other values give
+ * wrong results.
+ */
+static void
+swap_conditional(limb *a, limb *b, limb iswap) {
+  unsigned i;
+  const limb swap = -iswap;
+
+  for (i = 0; i < 5; ++i) {
+    const limb x = swap & (a[i] ^ b[i]);
+    a[i] ^= x;
+    b[i] ^= x;
+  }
+}
+
+/* Calculates nQ where Q is the x-coordinate of a point on the curve
+ *
+ *   resultx/resultz: the x coordinate of the resulting curve point
+ *   n: a little endian, 32-byte number
+ *   q: a point of the curve
+ */
+static void
+cmult(limb *resultx, limb *resultz, const u8 *n, const limb *q) {
+  limb a[5] = {0}, b[5] = {1}, c[5] = {1}, d[5] = {0};
+  limb *nqpqx = a, *nqpqz = b, *nqx = c, *nqz = d, *t;
+  limb e[5] = {0}, f[5] = {1}, g[5] = {0}, h[5] = {1};
+  limb *nqpqx2 = e, *nqpqz2 = f, *nqx2 = g, *nqz2 = h;
+
+  unsigned i, j;
+
+  memcpy(nqpqx, q, sizeof(limb) * 5);
+
+  for (i = 0; i < 32; ++i) {
+    u8 byte = n[31 - i];
+    for (j = 0; j < 8; ++j) {
+      const limb bit = byte >> 7;
+
+      swap_conditional(nqx, nqpqx, bit);
+      swap_conditional(nqz, nqpqz, bit);
+      fmonty(nqx2, nqz2,
+             nqpqx2, nqpqz2,
+             nqx, nqz,
+             nqpqx, nqpqz,
+             q);
+      swap_conditional(nqx2, nqpqx2, bit);
+      swap_conditional(nqz2, nqpqz2, bit);
+
+      t = nqx;
+      nqx = nqx2;
+      nqx2 = t;
+      t = nqz;
+      nqz = nqz2;
+      nqz2 = t;
+      t = nqpqx;
+      nqpqx = nqpqx2;
+      nqpqx2 = t;
+      t = nqpqz;
+      nqpqz = nqpqz2;
+      nqpqz2 = t;
+
+      byte <<= 1;
+    }
+  }
+
+  memcpy(resultx, nqx, sizeof(limb) * 5);
+  memcpy(resultz, nqz, sizeof(limb) * 5);
+}
+
+/* Same addition chain as the 32-bit crecip, but with runs of squarings
+ * collapsed into fsquare_times.
+ */
+static void
+crecip(limb *out, const limb *z) {
+  felem a, t0, b, c;
+
+  /* 2 */ fsquare_times(a, z, 1); // a = 2
+  /* 8 */ fsquare_times(t0, a, 2);
+  /* 9 */ fmul(b, t0, z); // b = 9
+  /* 11 */ fmul(a, b, a); // a = 11
+  /* 22 */ fsquare_times(t0, a, 1);
+  /* 2^5 - 2^0 = 31 */ fmul(b, t0, b);
+  /* 2^10 - 2^5 */ fsquare_times(t0, b, 5);
+  /* 2^10 - 2^0 */ fmul(b, t0, b);
+  /* 2^20 - 2^10 */ fsquare_times(t0, b, 10);
+  /* 2^20 - 2^0 */ fmul(c, t0, b);
+  /* 2^40 - 2^20 */ fsquare_times(t0, c, 20);
+  /* 2^40 - 2^0 */ fmul(t0, t0, c);
+  /* 2^50 - 2^10 */ fsquare_times(t0, t0, 10);
+  /* 2^50 - 2^0 */ fmul(b, t0, b);
+  /* 2^100 - 2^50 */ fsquare_times(t0, b, 50);
+  /* 2^100 - 2^0 */ fmul(c, t0, b);
+  /* 2^200 - 2^100 */ fsquare_times(t0, c, 100);
+  /* 2^200 - 2^0 */ fmul(t0, t0, c);
+  /* 2^250 - 2^50 */ fsquare_times(t0, t0, 50);
+  /* 2^250 - 2^0 */ fmul(t0, t0, b);
+  /* 2^255 - 2^5 */ fsquare_times(t0, t0, 5);
+  /* 2^255 - 21 */ fmul(out, t0, a);
+}
+
+/* Output = x * zinverse, fully reduced and contracted into 32 bytes. */
+static void
+fmul_contract(u8 *output, const limb *x, const limb *zinverse) {
+  felem t;
+  fmul(t, x, zinverse);
+  fcontract(output, t);
+}
+
+/* Contract a reduced-form number into 32 bytes without destroying it. */
+static void
+fcontract_copy(u8 *output, const limb *input) {
+  fcontract(output, input);
+}
+
+#define FELEM_LIMBS 5
+
+#endif  /* CURVE25519_64BIT */
+
+
 int curve25519_donna(u8 *, const u8 *, const u8 *);
 
 int
 curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
-  limb bp[10], x[10], z[11], zmone[10];
+  limb bp[FELEM_LIMBS], x[FELEM_LIMBS], z[FELEM_LIMBS], zmone[FELEM_LIMBS];
   uint8_t e[32];
   int i;
 
@@ -727,9 +1193,7 @@ curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
   fexpand(bp, basepoint);
   cmult(x, z, e, bp);
   crecip(zmone, z);
-  fmul(z, x, zmone);
-  freduce_coefficients(z);
-  fcontract(mypublic, z);
+  fmul_contract(mypublic, x, zmone);
   return 0;
 }
 
@@ -795,3 +1259,131 @@ void curve25519_genSharedSecretKey(
 
 
 
+
+
+
+
+// Batch versions of the above.
+//
+// The Montgomery ladder leaves each result as a projective X/Z pair, and
+// converting to the affine X/Z costs one field inversion per key (about
+// 250 squarings).  With many keys at once, Montgomery's trick replaces
+// the N inversions with one inversion and 3(N-1) multiplications.
+
+
+// Returns 1 if the reduced field element is zero mod p, 0 otherwise,
+// without branching on its value.
+static limb fIsZero( const limb *inElement ) {
+    u8 bytes[32];
+    
+    fcontract_copy( bytes, inElement );
+    
+    unsigned int accum = 0;
+    for( int i=0; i<32; i++ ) {
+        accum |= bytes[i];
+        }
+    
+    return ( accum - 1 ) >> 31;
+    }
+
+
+
+// inPoints has inPointStride bytes between consecutive points
+// (0 to use the same point for every key)
+static void batchDonna( int inNumKeys, u8 *outKeys,
+                        const u8 *inSecretKeys,
+                        const u8 *inPoints, int inPointStride ) {
+    
+    if( inNumKeys <= 0 ) {
+        return;
+        }
+    
+    limb *x = new limb[ inNumKeys * FELEM_LIMBS ];
+    limb *z = new limb[ inNumKeys * FELEM_LIMBS ];
+    
+    // prefix[i] = z[0] * z[1] * ... * z[i]
+    limb *prefix = new limb[ inNumKeys * FELEM_LIMBS ];
+    
+
+    for( int i=0; i<inNumKeys; i++ ) {
+        u8 e[32];
+        memcpy( e, &( inSecretKeys[ i * 32 ] ), 32 );
+        modifySecretKey( e );
+
+        limb bp[FELEM_LIMBS];
+        fexpand( bp, &( inPoints[ i * inPointStride ] ) );
+
+        limb *thisX = &( x[ i * FELEM_LIMBS ] );
+        limb *thisZ = &( z[ i * FELEM_LIMBS ] );
+        
+        cmult( thisX, thisZ, e, bp );
+
+        // a zero Z (low-order peer point) would zero the whole product
+        // and ruin every other key in the batch
+        // Replace it with 1 and its X with 0, which gives the same all-zero
+        // output that the single-key path produces for it.
+        limb one[FELEM_LIMBS] = { 1 };
+        limb zero[FELEM_LIMBS] = { 0 };
+        
+        limb zIsZero = fIsZero( thisZ );
+        swap_conditional( thisZ, one, zIsZero );
+        swap_conditional( thisX, zero, zIsZero );
+        
+        if( i == 0 ) {
+            memcpy( prefix, thisZ, sizeof( limb ) * FELEM_LIMBS );
+            }
+        else {
+            fmul( &( prefix[ i * FELEM_LIMBS ] ),
+                  &( prefix[ ( i - 1 ) * FELEM_LIMBS ] ), thisZ );
+            }
+        }
+    
+
+    // inverse of the product of all Z values
+    limb inverse[FELEM_LIMBS];
+    crecip( inverse, &( prefix[ ( inNumKeys - 1 ) * FELEM_LIMBS ] ) );
+    
+    for( int i=inNumKeys - 1; i>0; i-- ) {
+        // inverse is currently 1 / ( z[0] * ... * z[i] )
+        limb zInverse[FELEM_LIMBS];
+        fmul( zInverse, inverse, &( prefix[ ( i - 1 ) * FELEM_LIMBS ] ) );
+        
+        // peel z[i] off for the next key
+        fmul( inverse, inverse, &( z[ i * FELEM_LIMBS ] ) );
+
+        fmul_contract( &( outKeys[ i * 32 ] ), 
+                       &( x[ i * FELEM_LIMBS ] ), zInverse );
+        }
+    fmul_contract( outKeys, x, inverse );
+    
+    
+    delete [] x;
+    delete [] z;
+    delete [] prefix;
+    }
+
+
+
+void curve25519_genPublicKeys( int inNumKeys,
+                               unsigned char *outPublicKeys,
+                               unsigned char *inSecretKeys ) {
+    
+    unsigned char basepoint[32];
+
+    memset( basepoint, 0, 32 );
+    basepoint[0] = 9;
+    
+    batchDonna( inNumKeys, outPublicKeys, inSecretKeys, basepoint, 0 );
+    }
+
+
+
+void curve25519_genSharedSecretKeys( 
+    int inNumKeys,
+    unsigned char *outSharedSecretKeys,
+    unsigned char *inSecretKeys,
+    unsigned char *inOtherPublicKeys ) {
+    
+    batchDonna( inNumKeys, outSharedSecretKeys, inSecretKeys, 
+                inOtherPublicKeys, 32 );
+    }
@@ -19,3 +19,24 @@ void curve25519_genSharedSecretKey(
 
 
 
+
+
+
+// Batch versions of the above, for servers that handle many key exchanges
+// at once.
+//
+// Keys are packed back-to-back, 32 bytes each, so each array holds
+// inNumKeys * 32 bytes.  Results are identical to calling the single-key
+// functions once per key, but the batch shares a single field inversion
+// across all keys.
+void curve25519_genPublicKeys( int inNumKeys,
+                               unsigned char *outPublicKeys,
+                               unsigned char *inSecretKeys );
+
+
+// inOtherPublicKeys[i] is paired with inSecretKeys[i]
+void curve25519_genSharedSecretKeys( 
+    int inNumKeys,
+    unsigned char *outSharedSecretKeys,
+    unsigned char *inSecretKeys,
+    unsigned char *inOtherPublicKeys );
@@ -0,0 +1,103 @@
+// Measures curve25519 key generation and key exchange throughput,
+// one key at a time and through the batch interface.
+//
+// Build with -DCURVE25519_FORCE_32BIT to measure the 10-limb field code.
+
+
+#include "curve25519.h"
+#include "../cryptoRandom.h"
+
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+static void reportRate( const char *inLabel, int inNumKeys, 
+                        double inStartTime ) {
+    double seconds = Time::getCurrentTime() - inStartTime;
+    
+    printf( "%-32s %10.0f keys/sec\n", inLabel, inNumKeys / seconds );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+    
+    int numKeys = 2000;
+    int batchSize = 64;
+    
+    if( inNumArgs > 1 ) {
+        numKeys = atoi( inArgs[1] );
+        }
+    if( inNumArgs > 2 ) {
+        batchSize = atoi( inArgs[2] );
+        }
+    if( numKeys < batchSize ) {
+        batchSize = numKeys;
+        }
+    if( numKeys <= 0 || batchSize <= 0 ) {
+        printf( "Usage:  curveBenchmark [num_keys] [batch_size]\n" );
+        return 1;
+        }
+    
+    
+    unsigned char *secrets = new unsigned char[ numKeys * 32 ];
+    unsigned char *otherPublics = new unsigned char[ numKeys * 32 ];
+    unsigned char *results = new unsigned char[ numKeys * 32 ];
+
+    getCryptoRandomBytes( secrets, numKeys * 32 );
+    getCryptoRandomBytes( otherPublics, numKeys * 32 );
+    
+    printf( "%d keys, batch size %d\n\n", numKeys, batchSize );
+    
+
+    double startTime = Time::getCurrentTime();
+    for( int i=0; i<numKeys; i++ ) {
+        curve25519_genPublicKey( &( results[ i * 32 ] ), 
+                                 &( secrets[ i * 32 ] ) );
+        }
+    reportRate( "genPublicKey", numKeys, startTime );
+
+    
+    startTime = Time::getCurrentTime();
+    for( int i=0; i<numKeys; i+=batchSize ) {
+        int thisBatch = batchSize;
+        if( i + thisBatch > numKeys ) {
+            thisBatch = numKeys - i;
+            }
+        curve25519_genPublicKeys( thisBatch, &( results[ i * 32 ] ), 
+                                  &( secrets[ i * 32 ] ) );
+        }
+    reportRate( "genPublicKeys (batch)", numKeys, startTime );
+    
+
+    startTime = Time::getCurrentTime();
+    for( int i=0; i<numKeys; i++ ) {
+        curve25519_genSharedSecretKey( &( results[ i * 32 ] ), 
+                                       &( secrets[ i * 32 ] ),
+                                       &( otherPublics[ i * 32 ] ) );
+        }
+    reportRate( "genSharedSecretKey", numKeys, startTime );
+
+    
+    startTime = Time::getCurrentTime();
+    for( int i=0; i<numKeys; i+=batchSize ) {
+        int thisBatch = batchSize;
+        if( i + thisBatch > numKeys ) {
+            thisBatch = numKeys - i;
+            }
+        curve25519_genSharedSecretKeys( thisBatch, &( results[ i * 32 ] ), 
+                                        &( secrets[ i * 32 ] ),
+                                        &( otherPublics[ i * 32 ] ) );
+        }
+    reportRate( "genSharedSecretKeys (batch)", numKeys, startTime );
+    
+    
+    delete [] secrets;
+    delete [] otherPublics;
+    delete [] results;
+    
+    return 0;
+    }
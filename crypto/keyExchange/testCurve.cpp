@@ -3,7 +3,10 @@
 #include "curve25519.h"
 #include "../cryptoRandom.h"
 
+#include "minorGems/util/development/testCheck.h"
+
 #include "stdio.h"
+#include "string.h"
 
 static void printKey( unsigned char inKey[32] ) {
     for( int i = 0; i < 32; i++ ) {
@@ -12,10 +15,134 @@ static void printKey( unsigned char inKey[32] ) {
     printf("\n");
     }
 
+
+
+static void hexToKey( const char *inHex, unsigned char outKey[32] ) {
+    for( int i = 0; i < 32; i++ ) {
+        unsigned int byte;
+        sscanf( &( inHex[ i * 2 ] ), "%02x", &byte );
+        outKey[i] = (unsigned char)byte;
+        }
+    }
+
+
+
+static void checkKey( const char *inLabel, unsigned char inKey[32],
+                      unsigned char inExpected[32] ) {
+    check( memcmp( inKey, inExpected, 32 ) == 0, inLabel );
+    }
+
+
+
+// Alice and Bob test vectors from RFC 7748, section 6.1
+static const char *aliceSecretHex = 
+    "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a";
+static const char *alicePublicHex = 
+    "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a";
+static const char *bobSecretHex = 
+    "5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb";
+static const char *bobPublicHex = 
+    "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f";
+static const char *sharedHex = 
+    "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742";
+
+
+
+static void testVectors() {
+    unsigned char aliceSecret[32], alicePublic[32];
+    unsigned char bobSecret[32], bobPublic[32];
+    unsigned char shared[32];
+    
+    hexToKey( aliceSecretHex, aliceSecret );
+    hexToKey( alicePublicHex, alicePublic );
+    hexToKey( bobSecretHex, bobSecret );
+    hexToKey( bobPublicHex, bobPublic );
+    hexToKey( sharedHex, shared );
+    
+    unsigned char result[32];
+    
+    curve25519_genPublicKey( result, aliceSecret );
+    checkKey( "Alice public", result, alicePublic );
+
+    curve25519_genPublicKey( result, bobSecret );
+    checkKey( "Bob public", result, bobPublic );
+    
+    curve25519_genSharedSecretKey( result, aliceSecret, bobPublic );
+    checkKey( "Alice shared", result, shared );
+
+    curve25519_genSharedSecretKey( result, bobSecret, alicePublic );
+    checkKey( "Bob shared", result, shared );
+    
+    
+    // same vectors through the batch interface, along with a zero
+    // public key, which must not disturb the other keys in its batch
+    unsigned char secrets[ 3 * 32 ];
+    unsigned char publics[ 3 * 32 ];
+    unsigned char results[ 3 * 32 ];
+    unsigned char zeroKey[32];
+    
+    memset( zeroKey, 0, 32 );
+    
+    memcpy( &( secrets[0] ), aliceSecret, 32 );
+    memcpy( &( secrets[32] ), bobSecret, 32 );
+    memcpy( &( secrets[64] ), aliceSecret, 32 );
+    
+    curve25519_genPublicKeys( 3, results, secrets );
+    checkKey( "Batch Alice public", &( results[0] ), alicePublic );
+    checkKey( "Batch Bob public", &( results[32] ), bobPublic );
+    
+    memcpy( &( publics[0] ), bobPublic, 32 );
+    memcpy( &( publics[32] ), zeroKey, 32 );
+    memcpy( &( publics[64] ), bobPublic, 32 );
+    
+    curve25519_genSharedSecretKeys( 3, results, secrets, publics );
+    checkKey( "Batch Alice shared", &( results[0] ), shared );
+    checkKey( "Batch zero shared", &( results[32] ), zeroKey );
+    checkKey( "Batch Alice shared again", &( results[64] ), shared );
+    }
+
+
+
+// batch results must match single-key results for random keys
+static void testRandomBatch() {
+    int numKeys = 50;
+    
+    unsigned char *secrets = new unsigned char[ numKeys * 32 ];
+    unsigned char *publics = new unsigned char[ numKeys * 32 ];
+    
+    getCryptoRandomBytes( secrets, numKeys * 32 );
+    
+    curve25519_genPublicKeys( numKeys, publics, secrets );
+    
+    int numMismatched = 0;
+    
+    for( int i=0; i<numKeys; i++ ) {
+        unsigned char single[32];
+        curve25519_genPublicKey( single, &( secrets[ i * 32 ] ) );
+        
+        if( memcmp( single, &( publics[ i * 32 ] ), 32 ) != 0 ) {
+            numMismatched ++;
+            }
+        }
+    
+    if( numMismatched > 0 ) {
+        printf( "%d of %d batch keys differ from single keys\n",
+                numMismatched, numKeys );
+        }
+    check( numMismatched == 0, "Random batch" );
+    
+    delete [] secrets;
+    delete [] publics;
+    }
+
  
 
 int main() {
 
+    testVectors();
+    testRandomBatch();
+    
+
     unsigned char mySecret[32];
     unsigned char otherSecret[32];
     
@@ -57,5 +184,5 @@ int main() {
     printf( "Other shared = \n" );
     printKey( otherShared );
 
-    return 0;
+    return reportChecks();
     }
@@ -459,15 +459,15 @@ unsigned char *zipCompress( unsigned char *inData, int inDataLength,
     
     int maxCompLength = compressBound( inDataLength );
     
-    unsigned char *compressBuffer = new unsigned char[ maxCompLength ];
+    // worst-case scratch space comes from the pool
+    ByteBuffer compressBuffer( maxCompLength );
     
     mz_ulong compLength = maxCompLength;
     
-    int cmp_status = compress( compressBuffer, &compLength, 
+    int cmp_status = compress( compressBuffer.getData(), &compLength, 
                                inData, inDataLength );
     if( cmp_status != Z_OK ) {
         printf( "zipCompress failed\n" );
-        delete [] compressBuffer;
         return NULL;
         }
     
@@ -476,8 +476,7 @@ unsigned char *zipCompress( unsigned char *inData, int inDataLength,
     
     unsigned char *shortBuffer = new unsigned char[ compLength ];
     
-    memcpy( shortBuffer, compressBuffer, compLength );
-    delete [] compressBuffer;
+    memcpy( shortBuffer, compressBuffer.getData(), compLength );
     
     *outCompressedDataLength = compLength;
     
@@ -516,5 +515,112 @@ unsigned char *zipDecompress( unsigned char *inCompressedData,
 
 
 
+ByteBuffer zipCompress( ByteBuffer inData ) {
+    
+    mz_ulong compLength = compressBound( inData.getLength() );
+    
+    ByteBuffer compressed( compLength );
+    
+    int cmp_status = compress( compressed.getData(), &compLength, 
+                               inData.getData(), inData.getLength() );
+    if( cmp_status != Z_OK ) {
+        printf( "zipCompress failed\n" );
+        return ByteBuffer();
+        }
+    
+    // keep the slack, the block goes back to the pool whole anyway
+    compressed.setLength( compLength );
+    
+    return compressed;
+    }
+
+
+
+ByteBuffer zipDecompress( ByteBuffer inCompressedData,
+                          int inExpectedResultDataLength ) {
+
+    ByteBuffer data( inExpectedResultDataLength );
+    
+    mz_ulong actualDataLength = inExpectedResultDataLength;
+
+    int cmp_status = uncompress( data.getData(), &actualDataLength, 
+                                 inCompressedData.getData(),
+                                 inCompressedData.getLength() );
+
+    if( cmp_status != Z_OK ) {
+        printf( "zipDecompress failed\n" );
+        return ByteBuffer();
+        }
+    if( (int)actualDataLength != inExpectedResultDataLength ) {
+        printf( "zipDecompress expecting %d result bytes, got %d\n",
+                inExpectedResultDataLength, (int)actualDataLength );
+        return ByteBuffer();
+        }
+
+    return data;
+    }
+
+
+
+
+void *startZipDecompressStream() {
+    mz_stream *stream = new mz_stream;
+    
+    memset( stream, 0, sizeof( mz_stream ) );
+    
+    if( mz_inflateInit( stream ) != MZ_OK ) {
+        printf( "startZipDecompressStream failed\n" );
+        delete stream;
+        return NULL;
+        }
+    
+    return stream;
+    }
+
+
+
+int stepZipDecompressStream( void *inStream,
+                             unsigned char *inCompressedData,
+                             int inCompressedDataLength,
+                             int *outNumConsumed,
+                             unsigned char *outBuffer, int inBufferLength,
+                             char *outDone ) {
+    
+    mz_stream *stream = (mz_stream *)inStream;
+    
+    stream->next_in = inCompressedData;
+    stream->avail_in = inCompressedDataLength;
+    stream->next_out = outBuffer;
+    stream->avail_out = inBufferLength;
+    
+    int status = mz_inflate( stream, MZ_SYNC_FLUSH );
+    
+    *outNumConsumed = inCompressedDataLength - stream->avail_in;
+    *outDone = ( status == MZ_STREAM_END );
+    
+    // MZ_BUF_ERROR only means no progress was possible with what we have
+    if( status != MZ_OK && status != MZ_STREAM_END && 
+        status != MZ_BUF_ERROR ) {
+        printf( "stepZipDecompressStream failed with status %d\n", 
+                status );
+        return -1;
+        }
+    
+    return inBufferLength - stream->avail_out;
+    }
+
+
+
+void endZipDecompressStream( void *inStream ) {
+    mz_stream *stream = (mz_stream *)inStream;
+    
+    mz_inflateEnd( stream );
+    
+    delete stream;
+    }
+
+
+
+
 
  
@@ -14,6 +14,9 @@
 #define ENCODING_UTILS_INCLUDED
 
 
+#include "minorGems/util/ByteBuffer.h"
+
+
 
 /**
  * A collection of functions for representing data in various encoding formats.
@@ -109,6 +112,48 @@ unsigned char *zipDecompress( unsigned char *inCompressedData,
 
 
 
+// pooled-buffer versions of the above
+// compress straight into a pooled buffer with no trimming copy
+// return a null buffer on failure
+
+ByteBuffer zipCompress( ByteBuffer inData );
+
+ByteBuffer zipDecompress( ByteBuffer inCompressedData,
+                          int inExpectedResultDataLength );
+
+
+
+// incremental version of zipDecompress, for compressed data that arrives
+// in pieces and whose result is too large to hold all at once
+
+// returns a stream handle, or NULL on failure
+// destroyed with endZipDecompressStream
+void *startZipDecompressStream();
+
+
+// inflates as much of inCompressedData as fits into outBuffer
+//
+// outNumConsumed is set to the number of compressed bytes used up.
+// Bytes that are not used up must be passed in again on the next call.
+// Call again with no compressed data to drain output that did not fit
+// in outBuffer.
+//
+// outDone is set to true once the end of the compressed stream has been
+// reached.
+//
+// returns the number of bytes written to outBuffer, or -1 on failure
+int stepZipDecompressStream( void *inStream,
+                             unsigned char *inCompressedData,
+                             int inCompressedDataLength,
+                             int *outNumConsumed,
+                             unsigned char *outBuffer, int inBufferLength,
+                             char *outDone );
+
+
+void endZipDecompressStream( void *inStream );
+
+
+
 
  
 #endif
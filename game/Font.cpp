@@ -5,6 +5,8 @@
 #include <string.h>
 #include <iostream>
 #include "minorGems/util/SettingsManager.h"
+#include "minorGems/util/Arena.h"
+#include "minorGems/util/stringUtils.h"
 
 
 typedef union rgbaColor {
@@ -96,6 +98,15 @@ size_t strlen(const unicode *u)
     return i;
 }
 
+// converts into scratch memory in inArena, room for the terminator included
+static unicode *utf8ToUnicode(const char *utf8String, Arena *inArena)
+{
+    unicode *output =
+        inArena->allocateArray<unicode>( strlen( utf8String ) + 1 );
+    utf8ToUnicode( utf8String, output );
+    return output;
+}
+
 static int unicodeWide = 22;
 static double unicodeScale = 1.4;
 static int unicodeOffset = -5;
@@ -190,6 +201,195 @@ void init(int size)
     g_FreeTypeLib.load("graphics/font.ttf", size, size);  
 }  
   
+GlyphRunCache::GlyphRunCache( int inMaxRuns )
+        : mMaxRuns( inMaxRuns ), mNumRuns( 0 ),
+          mRuns( new GlyphRun[ inMaxRuns ] ),
+          mNumBuckets( 1 ),
+          mNewest( -1 ), mOldest( -1 ) {
+    
+    while( mNumBuckets < 2 * inMaxRuns ) {
+        mNumBuckets *= 2;
+        }
+    
+    mBuckets = new int[ mNumBuckets ];
+    
+    for( int b=0; b<mNumBuckets; b++ ) {
+        mBuckets[b] = -1;
+        }
+    }
+
+
+
+GlyphRunCache::~GlyphRunCache() {
+    clear();
+    
+    delete [] mRuns;
+    delete [] mBuckets;
+    }
+
+
+
+void GlyphRunCache::clear() {
+    for( int i=0; i<mNumRuns; i++ ) {
+        delete [] mRuns[i].string;
+        delete [] mRuns[i].chars;
+        delete [] mRuns[i].offsets;
+        }
+    mNumRuns = 0;
+    
+    for( int b=0; b<mNumBuckets; b++ ) {
+        mBuckets[b] = -1;
+        }
+    
+    mNewest = -1;
+    mOldest = -1;
+    }
+
+
+
+// FNV-1a
+unsigned int GlyphRunCache::hashString( const char *inString, 
+                                        char inKerning ) {
+    unsigned int hash = 2166136261u;
+    
+    const unsigned char *p = (const unsigned char *)inString;
+    
+    while( *p != '\0' ) {
+        hash ^= *p;
+        hash *= 16777619u;
+        p++;
+        }
+    
+    hash ^= ( inKerning ? 1 : 0 );
+    hash *= 16777619u;
+
+    return hash;
+    }
+
+
+
+void GlyphRunCache::unlinkFromLRU( int inIndex ) {
+    GlyphRun *run = &( mRuns[ inIndex ] );
+    
+    if( run->newer != -1 ) {
+        mRuns[ run->newer ].older = run->older;
+        }
+    else {
+        mNewest = run->older;
+        }
+    
+    if( run->older != -1 ) {
+        mRuns[ run->older ].newer = run->newer;
+        }
+    else {
+        mOldest = run->newer;
+        }
+    }
+
+
+
+void GlyphRunCache::linkAsNewest( int inIndex ) {
+    GlyphRun *run = &( mRuns[ inIndex ] );
+    
+    run->newer = -1;
+    run->older = mNewest;
+    
+    if( mNewest != -1 ) {
+        mRuns[ mNewest ].newer = inIndex;
+        }
+    else {
+        mOldest = inIndex;
+        }
+    mNewest = inIndex;
+    }
+
+
+
+void GlyphRunCache::removeFromBucket( int inIndex ) {
+    int *link = &( mBuckets[ mRuns[ inIndex ].hash & ( mNumBuckets - 1 ) ] );
+    
+    while( *link != inIndex ) {
+        link = &( mRuns[ *link ].nextInBucket );
+        }
+    
+    *link = mRuns[ inIndex ].nextInBucket;
+    }
+
+
+
+GlyphRun *GlyphRunCache::find( const char *inString, char inKerning ) {
+    inKerning = ( inKerning != 0 );
+    
+    unsigned int hash = hashString( inString, inKerning );
+    
+    int i = mBuckets[ hash & ( mNumBuckets - 1 ) ];
+    
+    while( i != -1 ) {
+        GlyphRun *run = &( mRuns[i] );
+        
+        if( run->hash == hash && run->kerning == inKerning &&
+            strcmp( run->string, inString ) == 0 ) {
+            
+            if( mNewest != i ) {
+                unlinkFromLRU( i );
+                linkAsNewest( i );
+                }
+            return run;
+            }
+        i = run->nextInBucket;
+        }
+    
+    return NULL;
+    }
+
+
+
+GlyphRun *GlyphRunCache::add( const char *inString, char inKerning,
+                              int inNumChars, unicode *inChars, 
+                              double *inOffsets,
+                              double inEnd, double inWidth ) {
+    inKerning = ( inKerning != 0 );
+    
+    int i;
+    
+    if( mNumRuns < mMaxRuns ) {
+        i = mNumRuns;
+        mNumRuns++;
+        }
+    else {
+        // evict
+        i = mOldest;
+        
+        removeFromBucket( i );
+        unlinkFromLRU( i );
+        
+        delete [] mRuns[i].string;
+        delete [] mRuns[i].chars;
+        delete [] mRuns[i].offsets;
+        }
+    
+    GlyphRun *run = &( mRuns[i] );
+    
+    run->string = stringDuplicate( inString );
+    run->kerning = inKerning;
+    run->hash = hashString( inString, inKerning );
+    run->numChars = inNumChars;
+    run->chars = inChars;
+    run->offsets = inOffsets;
+    run->end = inEnd;
+    run->width = inWidth;
+    
+    int *bucket = &( mBuckets[ run->hash & ( mNumBuckets - 1 ) ] );
+    run->nextInBucket = *bucket;
+    *bucket = i;
+    
+    linkAsNewest( i );
+    
+    return run;
+    }
+
+
+
 static int fontCount = 0;
 
 Font::Font( const char *inFileName, int inCharSpacing, int inSpaceWidth,
@@ -197,7 +397,8 @@ Font::Font( const char *inFileName, int inCharSpacing, int inSpaceWidth,
         : mScaleFactor( inScaleFactor ),
           mCharSpacing( inCharSpacing ), mSpaceWidth( inSpaceWidth ),
           mFixedWidth( inFixedWidth ), mEnableKerning( true ),
-          mMinimumPositionPrecision( 0 ) {
+          mMinimumPositionPrecision( 0 ),
+          mRunCache( new GlyphRunCache( 256 ) ) {
 
     if(strcmp(inFileName, "font_pencil_erased_32_32.tga") == 0)
         isErased = true;
@@ -541,6 +742,10 @@ Font::~Font() {
             delete mKerningTable[i];
             }
         }
+    
+    if( mRunCache != NULL ) {
+        delete mRunCache;
+        }
 
     fontCount--;
     if(fontCount == 0) {
@@ -593,6 +798,11 @@ void Font::copySpacing( Font *inOtherFont ) {
         
 
     mCharBlockWidth = inOtherFont->mCharBlockWidth;
+    
+    // layouts depend on spacing
+    if( mRunCache != NULL ) {
+        mRunCache->clear();
+        }
     }
 
 
@@ -617,6 +827,9 @@ void Font::drawChar(unicode c, doublePair inCenter) {
     if(isErased)
         setDrawFade(alpha * 0.1);
     
+    // drawn directly, so queued sprites must go first
+    flushSpriteBatch();
+    
     pCharTex->mTex->enable();
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);  
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);  
@@ -645,31 +858,97 @@ double Font::getCharSpacing() {
     }
 
 
+GlyphRun *Font::getGlyphRun( const char *inString ) {
+    if( mRunCache == NULL ) {
+        return NULL;
+        }
+    
+    GlyphRun *run = mRunCache->find( inString, mEnableKerning );
+    
+    if( run != NULL ) {
+        return run;
+        }
+    
+    unicode *chars = new unicode[ strlen( inString ) + 1 ];
+    utf8ToUnicode( inString, chars );
+    
+    unsigned int numChars = strlen( chars );
+    
+    Arena *arena = Arena::getFrameArena();
+    ArenaScope scope( arena );
+    
+    doublePair *pos = arena->allocateArray<doublePair>( numChars );
+    
+    double end = layoutChars( pos, chars, numChars, 0, 0 );
+    
+    double *offsets = new double[ numChars ];
+    
+    for( unsigned int i=0; i<numChars; i++ ) {
+        offsets[i] = pos[i].x;
+        }
+    
+    return mRunCache->add( inString, mEnableKerning, numChars, chars,
+                           offsets, end, measureString( chars ) );
+    }
+
+
+
+void Font::setGlyphRunCacheSize( int inMaxRuns ) {
+    if( mRunCache != NULL ) {
+        delete mRunCache;
+        mRunCache = NULL;
+        }
+    
+    if( inMaxRuns > 0 ) {
+        mRunCache = new GlyphRunCache( inMaxRuns );
+        }
+    }
+
+
+
 double Font::getCharPos( SimpleVector<doublePair> *outPositions,
                          const char *inString, doublePair inPosition,
                          TextAlignment inAlign ) {
-    unicode unicodeString[strlen(inString)];
-    utf8ToUnicode(inString, unicodeString);
+    GlyphRun *run = getGlyphRun( inString );
+    
+    if( run != NULL ) {
+        doublePair start = getStringStart( inPosition, run->width, inAlign );
+        
+        for( int i=0; i<run->numChars; i++ ) {
+            doublePair pos = { start.x + run->offsets[i], start.y };
+            outPositions->push_back( pos );
+            }
+        
+        return start.x + run->end;
+        }
+    
+    ArenaScope scope( Arena::getFrameArena() );
+
+    unicode *unicodeString = 
+        utf8ToUnicode( inString, Arena::getFrameArena() );
     return getCharPos(outPositions, unicodeString, inPosition, inAlign);
 }
 double Font::getCharPos( SimpleVector<doublePair> *outPositions,
                          const unicode *inString, doublePair inPosition,
                          TextAlignment inAlign ) {
+    ArenaScope scope( Arena::getFrameArena() );
 
-    double scale = scaleFactor * mScaleFactor;
-    
     unsigned int numChars = strlen( inString );
+
+    doublePair *positions = 
+        Arena::getFrameArena()->allocateArray<doublePair>( numChars );
     
-    double x = inPosition.x;
+    double returnVal = getCharPos( positions, inString, inPosition, inAlign );
     
+    outPositions->appendArray( positions, numChars );
     
-    double y = inPosition.y;
-
-    // compensate for extra headspace in accent-equipped font files
-    if( mAccentsPresent ) { 
-        y += scale * mSpriteHeight / 4;
-        }
+    return returnVal;
+    }
+double Font::getCharPos( doublePair *outPositions,
+                         const unicode *inString, doublePair inPosition,
+                         TextAlignment inAlign ) {
 
+    unsigned int numChars = strlen( inString );
     
     double stringWidth = 0;
     
@@ -677,12 +956,33 @@ double Font::getCharPos( SimpleVector<doublePair> *outPositions,
         stringWidth = measureString( inString );
         }
     
+    doublePair start = getStringStart( inPosition, stringWidth, inAlign );
+    
+    return layoutChars( outPositions, inString, numChars, start.x, start.y );
+    }
+
+
+
+doublePair Font::getStringStart( doublePair inPosition, 
+                                 double inStringWidth,
+                                 TextAlignment inAlign ) {
+    double scale = scaleFactor * mScaleFactor;
+    
+    double x = inPosition.x;
+    
+    double y = inPosition.y;
+
+    // compensate for extra headspace in accent-equipped font files
+    if( mAccentsPresent ) { 
+        y += scale * mSpriteHeight / 4;
+        }
+    
     switch( inAlign ) {
         case alignCenter:
-            x -= stringWidth / 2;
+            x -= inStringWidth / 2;
             break;
         case alignRight:
-            x -= stringWidth;
+            x -= inStringWidth;
             break;
         default:
             // left?  do nothing
@@ -702,20 +1002,32 @@ double Font::getCharPos( SimpleVector<doublePair> *outPositions,
         x *= mMinimumPositionPrecision;
         }
     
+    doublePair start = { x, y };
+    return start;
+    }
 
-    for( unsigned int i=0; i<numChars; i++ ) {
-        doublePair charPos = { x, y };
+
+
+double Font::layoutChars( doublePair *outPositions,
+                          const unicode *inString, unsigned int inNumChars,
+                          double inX, double inY ) {
+    double scale = scaleFactor * mScaleFactor;
+    
+    double x = inX;
+
+    for( unsigned int i=0; i<inNumChars; i++ ) {
+        doublePair charPos = { x, inY };
         
         doublePair drawPos;
         
         double charWidth = positionCharacter( inString[i], 
                                               charPos, &drawPos );
-        outPositions->push_back( drawPos );
+        outPositions[i] = drawPos;
         
         x += charWidth + mCharSpacing * scale;
         
         if( !mFixedWidth && mEnableKerning 
-            && i < numChars - 1 
+            && i < inNumChars - 1 
             && inString[i] < 128
             && inString[i+1] < 128
             && mKerningTable[ inString[i] ] != NULL ) {
@@ -733,18 +1045,73 @@ double Font::getCharPos( SimpleVector<doublePair> *outPositions,
     }
 
 
+
+void Font::drawChars( const unicode *inString, unsigned int inNumChars,
+                      doublePair *inPositions ) {
+    Arena *arena = Arena::getFrameArena();
+    ArenaScope scope( arena );
+    
+    double scale = scaleFactor * mScaleFactor;
+    
+    SpriteHandle *sprites = 
+        arena->allocateArray<SpriteHandle>( inNumChars );
+    
+    // runs of sprite characters are drawn together, broken only by
+    // unicode characters, which are drawn directly
+    unsigned int runStart = 0;
+    
+    for( unsigned int i=0; i<inNumChars; i++ ) {
+        unicode c = inString[i];
+        
+        if( c < 128 ) {
+            sprites[i] = mSpriteMap[c];
+            }
+        else {
+            drawSpriteRun( i - runStart, &( sprites[ runStart ] ),
+                           &( inPositions[ runStart ] ), scale );
+            drawChar( c, inPositions[i] );
+            
+            runStart = i + 1;
+            }
+        }
+    
+    drawSpriteRun( inNumChars - runStart, &( sprites[ runStart ] ),
+                   &( inPositions[ runStart ] ), scale );
+    }
+
+
+
 double Font::drawString( const char *inString, doublePair inPosition,
                          TextAlignment inAlign ) {
-    unicode unicodeString[strlen(inString)];
-    utf8ToUnicode(inString, unicodeString);
-    SimpleVector<doublePair> pos( strlen( unicodeString ) );
-
-    double returnVal = getCharPos( &pos, unicodeString, inPosition, inAlign );
+    Arena *arena = Arena::getFrameArena();
+    ArenaScope scope( arena );
     
-    for( int i=0; i<pos.size(); i++ ) {
-        drawChar(unicodeString[i], pos.getElementDirect(i));
+    GlyphRun *run = getGlyphRun( inString );
+    
+    if( run != NULL ) {
+        doublePair start = getStringStart( inPosition, run->width, inAlign );
+        
+        doublePair *pos = arena->allocateArray<doublePair>( run->numChars );
+        
+        for( int i=0; i<run->numChars; i++ ) {
+            pos[i].x = start.x + run->offsets[i];
+            pos[i].y = start.y;
+            }
+        
+        drawChars( run->chars, run->numChars, pos );
+        
+        return start.x + run->end;
         }
     
+    unicode *unicodeString = utf8ToUnicode( inString, arena );
+    unsigned int numChars = strlen( unicodeString );
+    
+    doublePair *pos = arena->allocateArray<doublePair>( numChars );
+
+    double returnVal = getCharPos( pos, unicodeString, inPosition, inAlign );
+    
+    drawChars( unicodeString, numChars, pos );
+    
     return returnVal;
     }
 
@@ -797,8 +1164,18 @@ void Font::drawCharacterSprite( unicode inC, doublePair inPosition ) {
     }
 
 double Font::measureString( const char *inString, int inCharLimit ) {
-    unicode unicodeString[strlen(inString)];
-    utf8ToUnicode(inString, unicodeString);
+    if( inCharLimit == -1 ) {
+        GlyphRun *run = getGlyphRun( inString );
+        
+        if( run != NULL ) {
+            return run->width;
+            }
+        }
+    
+    ArenaScope scope( Arena::getFrameArena() );
+
+    unicode *unicodeString = 
+        utf8ToUnicode( inString, Arena::getFrameArena() );
     return measureString(unicodeString, inCharLimit);
 }
 double Font::measureString( const unicode *inString, int inCharLimit ) {
@@ -52,6 +52,88 @@ public:
     char loadChar(unicode ch);  
 };  
 
+// layout of a drawn string, relative to where its first character starts
+typedef struct GlyphRun {
+        // key
+        char *string;
+        char kerning;
+        
+        unsigned int hash;
+        
+        int numChars;
+        unicode *chars;
+        
+        // x offset of each character's sprite center
+        double *offsets;
+        
+        // offset of string end (return value of drawString)
+        double end;
+        
+        // result of measureString
+        double width;
+        
+        // index of next run in same hash bucket
+        int nextInBucket;
+        
+        // neighbors in least-recently-used order
+        int newer, older;
+    } GlyphRun;
+
+
+
+// Maps strings to their glyph runs, evicting the least recently used
+// run when full.
+class GlyphRunCache {
+    
+    public:
+        
+        GlyphRunCache( int inMaxRuns );
+        
+        ~GlyphRunCache();
+        
+        
+        // returns NULL if not present
+        // a found run becomes the most recently used one
+        GlyphRun *find( const char *inString, char inKerning );
+        
+        // takes ownership of inChars and inOffsets (allocated with new[])
+        // returned run is valid until the next add or clear
+        GlyphRun *add( const char *inString, char inKerning,
+                       int inNumChars, unicode *inChars, double *inOffsets,
+                       double inEnd, double inWidth );
+        
+        void clear();
+        
+        int getNumRuns() {
+            return mNumRuns;
+            }
+        
+        
+    private:
+        
+        int mMaxRuns;
+        int mNumRuns;
+        
+        GlyphRun *mRuns;
+        
+        // power of two, at least twice mMaxRuns
+        int mNumBuckets;
+        int *mBuckets;
+        
+        int mNewest, mOldest;
+        
+        
+        static unsigned int hashString( const char *inString, 
+                                        char inKerning );
+        
+        void unlinkFromLRU( int inIndex );
+        void linkAsNewest( int inIndex );
+        
+        void removeFromBucket( int inIndex );
+    };
+
+
+
 class Font {
         
     public:
@@ -89,6 +171,11 @@ class Font {
         double getCharPos( SimpleVector<doublePair> *outPositions,
             const unicode *inString, doublePair inPosition,
             TextAlignment inAlign = alignCenter );
+        // fills outPositions, which must have room for one position per
+        // character, without any heap allocation
+        double getCharPos( doublePair *outPositions,
+            const unicode *inString, doublePair inPosition,
+            TextAlignment inAlign = alignCenter );
         
 
         // height of basic, non-accented characters
@@ -99,6 +186,17 @@ class Font {
         void enableKerning( char inKerningOn );
 
 
+        // strings passed as UTF-8 to drawString, getCharPos, and
+        // measureString are laid out once and then cached, keeping up to
+        // inMaxRuns of the most recently used ones
+        // 0 disables caching
+        // defaults to 256
+        // (characters are drawn in batched runs either way; turn on
+        //  toggleSpriteAtlas before constructing the font to make each
+        //  run a single GL call)
+        void setGlyphRunCacheSize( int inMaxRuns );
+        
+
         // sets minimum floating point precision for positioning
         // the start of a string (to avoid round-off errors on graphics
         // cards that don't handle sub-pixel polygon positioning consistently)
@@ -128,6 +226,23 @@ class Font {
         // returns x coordinate to right of drawn character
         double positionCharacter( unicode inC, doublePair inTargetPos,
                                   doublePair *outActualPos );
+        
+        // position of first character's sprite center for an aligned 
+        // string, before left edge offsets
+        doublePair getStringStart( doublePair inPosition, 
+                                   double inStringWidth,
+                                   TextAlignment inAlign );
+        
+        // lays out characters starting at inX, returns x of string end
+        double layoutChars( doublePair *outPositions,
+                            const unicode *inString, unsigned int inNumChars,
+                            double inX, double inY );
+        
+        // NULL if caching is off
+        GlyphRun *getGlyphRun( const char *inString );
+        
+        void drawChars( const unicode *inString, unsigned int inNumChars,
+                        doublePair *inPositions );
 
         
         double mScaleFactor;
@@ -164,6 +279,9 @@ class Font {
 
         double mMinimumPositionPrecision;
 
+        // NULL if caching is off
+        GlyphRunCache *mRunCache;
+
         char isErased = false;
     };
 
@@ -0,0 +1,486 @@
+#include "SpriteLayer.h"
+
+#include "minorGems/game/game.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+
+
+// instances covering more cells than this are kept in a separate list
+// that every draw checks, rather than in every cell they cover
+#define MAX_INSTANCE_CELLS 64
+
+
+
+SpriteLayer::SpriteLayer( doublePair inLowerLeft, doublePair inUpperRight,
+                          double inCellSize )
+        : mCellSize( inCellSize ), mLowerLeft( inLowerLeft ),
+          mNumLive( 0 ), mNextSequence( 0 ), mQueryStamp( 0 ) {
+
+    mNumCellsX = (int)ceil( ( inUpperRight.x - inLowerLeft.x ) / inCellSize );
+    mNumCellsY = (int)ceil( ( inUpperRight.y - inLowerLeft.y ) / inCellSize );
+
+    if( mNumCellsX < 1 ) {
+        mNumCellsX = 1;
+        }
+    if( mNumCellsY < 1 ) {
+        mNumCellsY = 1;
+        }
+
+    mCells = new SimpleVector<int>[ mNumCellsX * mNumCellsY ];
+    }
+
+
+
+SpriteLayer::~SpriteLayer() {
+    delete [] mCells;
+    }
+
+
+
+SpriteInstance *SpriteLayer::getLiveInstance( int inID ) {
+    if( inID < 0 || inID >= mInstances.size() ) {
+        return NULL;
+        }
+
+    SpriteInstance *instance = mInstances.getElement( inID );
+
+    if( ! instance->live ) {
+        return NULL;
+        }
+    return instance;
+    }
+
+
+
+int SpriteLayer::addInstance( SpriteHandle inSprite, doublePair inPos,
+                              double inZoom, double inRotation,
+                              char inFlipH, double inDepth ) {
+    SpriteInstance instance;
+
+    instance.sprite = inSprite;
+    instance.pos = inPos;
+    instance.zoom = inZoom;
+    instance.rotation = inRotation;
+    instance.flipH = inFlipH;
+
+    instance.color.r = 1;
+    instance.color.g = 1;
+    instance.color.b = 1;
+    instance.color.a = 1;
+
+    instance.depth = inDepth;
+    instance.sequence = mNextSequence;
+    mNextSequence++;
+
+    instance.live = true;
+    instance.dirty = false;
+    instance.oversize = false;
+
+    instance.queryStamp = mQueryStamp;
+
+    int id;
+
+    if( mFreeIDs.size() > 0 ) {
+        id = mFreeIDs.getLastElementDirect();
+        mFreeIDs.deleteLastElement();
+
+        *( mInstances.getElement( id ) ) = instance;
+        }
+    else {
+        id = mInstances.size();
+        mInstances.push_back( instance );
+        }
+
+    mNumLive++;
+
+    bin( id );
+
+    return id;
+    }
+
+
+
+void SpriteLayer::removeInstance( int inID ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance == NULL ) {
+        return;
+        }
+
+    if( instance->dirty ) {
+        mDirtyIDs.deleteElementEqualTo( inID );
+        }
+
+    unbin( inID );
+
+    instance->live = false;
+    mNumLive--;
+
+    mFreeIDs.push_back( inID );
+    }
+
+
+
+void SpriteLayer::removeAllInstances() {
+    for( int i=0; i<mNumCellsX * mNumCellsY; i++ ) {
+        mCells[i].deleteAll();
+        }
+    mOversize.deleteAll();
+
+    mInstances.deleteAll();
+    mFreeIDs.deleteAll();
+    mDirtyIDs.deleteAll();
+
+    mNumLive = 0;
+    }
+
+
+
+void SpriteLayer::markDirty( int inID ) {
+    SpriteInstance *instance = mInstances.getElement( inID );
+
+    if( ! instance->dirty ) {
+        instance->dirty = true;
+        mDirtyIDs.push_back( inID );
+        }
+    }
+
+
+
+void SpriteLayer::setInstancePosition( int inID, doublePair inPos ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->pos = inPos;
+        markDirty( inID );
+        }
+    }
+
+
+
+void SpriteLayer::setInstanceSprite( int inID, SpriteHandle inSprite ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->sprite = inSprite;
+        markDirty( inID );
+        }
+    }
+
+
+
+void SpriteLayer::setInstanceZoom( int inID, double inZoom ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->zoom = inZoom;
+        markDirty( inID );
+        }
+    }
+
+
+
+// bounds are the same for any rotation or flip, so these don't re-bin
+
+void SpriteLayer::setInstanceRotation( int inID, double inRotation ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->rotation = inRotation;
+        }
+    }
+
+
+
+void SpriteLayer::setInstanceFlipH( int inID, char inFlipH ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->flipH = inFlipH;
+        }
+    }
+
+
+
+void SpriteLayer::setInstanceColor( int inID, FloatColor inColor ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->color = inColor;
+        }
+    }
+
+
+
+void SpriteLayer::setInstanceDepth( int inID, double inDepth ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance != NULL ) {
+        instance->depth = inDepth;
+        }
+    }
+
+
+
+doublePair SpriteLayer::getInstancePosition( int inID ) {
+    SpriteInstance *instance = getLiveInstance( inID );
+
+    if( instance == NULL ) {
+        doublePair zero = { 0, 0 };
+        return zero;
+        }
+    return instance->pos;
+    }
+
+
+
+void SpriteLayer::markAllDirty() {
+    for( int i=0; i<mInstances.size(); i++ ) {
+        if( mInstances.getElement( i )->live ) {
+            markDirty( i );
+            }
+        }
+    }
+
+
+
+int SpriteLayer::getCellX( double inX ) {
+    int x = (int)floor( ( inX - mLowerLeft.x ) / mCellSize );
+
+    if( x < 0 ) {
+        return 0;
+        }
+    if( x >= mNumCellsX ) {
+        return mNumCellsX - 1;
+        }
+    return x;
+    }
+
+
+
+int SpriteLayer::getCellY( double inY ) {
+    int y = (int)floor( ( inY - mLowerLeft.y ) / mCellSize );
+
+    if( y < 0 ) {
+        return 0;
+        }
+    if( y >= mNumCellsY ) {
+        return mNumCellsY - 1;
+        }
+    return y;
+    }
+
+
+
+void SpriteLayer::bin( int inID ) {
+    SpriteInstance *instance = mInstances.getElement( inID );
+
+    double radius = 0;
+
+    if( instance->sprite != NULL ) {
+        radius = getSpriteBoundingRadius( instance->sprite ) *
+            fabs( instance->zoom );
+        }
+
+    instance->left = instance->pos.x - radius;
+    instance->right = instance->pos.x + radius;
+    instance->bottom = instance->pos.y - radius;
+    instance->top = instance->pos.y + radius;
+
+    instance->cellX0 = getCellX( instance->left );
+    instance->cellX1 = getCellX( instance->right );
+    instance->cellY0 = getCellY( instance->bottom );
+    instance->cellY1 = getCellY( instance->top );
+
+    int numCells =
+        ( instance->cellX1 - instance->cellX0 + 1 ) *
+        ( instance->cellY1 - instance->cellY0 + 1 );
+
+    if( numCells > MAX_INSTANCE_CELLS ) {
+        instance->oversize = true;
+        mOversize.push_back( inID );
+        return;
+        }
+
+    instance->oversize = false;
+
+    for( int y=instance->cellY0; y<=instance->cellY1; y++ ) {
+        for( int x=instance->cellX0; x<=instance->cellX1; x++ ) {
+            mCells[ y * mNumCellsX + x ].push_back( inID );
+            }
+        }
+    }
+
+
+
+// removes from a vector where order doesn't matter
+static void swapDelete( SimpleVector<int> *inVector, int inValue ) {
+    int last = inVector->size() - 1;
+
+    for( int i=last; i>=0; i-- ) {
+        if( inVector->getElementDirect( i ) == inValue ) {
+            *( inVector->getElement( i ) ) = inVector->getElementDirect( last );
+            inVector->deleteLastElement();
+            return;
+            }
+        }
+    }
+
+
+
+void SpriteLayer::unbin( int inID ) {
+    SpriteInstance *instance = mInstances.getElement( inID );
+
+    if( instance->oversize ) {
+        swapDelete( &mOversize, inID );
+        return;
+        }
+
+    for( int y=instance->cellY0; y<=instance->cellY1; y++ ) {
+        for( int x=instance->cellX0; x<=instance->cellX1; x++ ) {
+            swapDelete( &( mCells[ y * mNumCellsX + x ] ), inID );
+            }
+        }
+    }
+
+
+
+void SpriteLayer::considerInstance( int inID,
+                                    doublePair inLowerLeft,
+                                    doublePair inUpperRight ) {
+    SpriteInstance *instance = mInstances.getElement( inID );
+
+    if( instance->queryStamp == mQueryStamp ) {
+        // already seen in another cell
+        return;
+        }
+    instance->queryStamp = mQueryStamp;
+
+    if( instance->sprite == NULL ||
+        instance->right < inLowerLeft.x ||
+        instance->left > inUpperRight.x ||
+        instance->top < inLowerLeft.y ||
+        instance->bottom > inUpperRight.y ) {
+        return;
+        }
+
+    VisibleInstance v = { instance->depth, instance->sequence, inID };
+    mVisible.push_back( v );
+    }
+
+
+
+int SpriteLayer::compareVisible( const void *inA, const void *inB ) {
+    const VisibleInstance *a = (const VisibleInstance *)inA;
+    const VisibleInstance *b = (const VisibleInstance *)inB;
+
+    if( a->depth < b->depth ) {
+        return -1;
+        }
+    if( a->depth > b->depth ) {
+        return 1;
+        }
+    if( a->sequence < b->sequence ) {
+        return -1;
+        }
+    if( a->sequence > b->sequence ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+int SpriteLayer::draw( doublePair inLowerLeft, doublePair inUpperRight ) {
+
+    // re-bin everything that changed since last draw
+    for( int i=0; i<mDirtyIDs.size(); i++ ) {
+        int id = mDirtyIDs.getElementDirect( i );
+
+        unbin( id );
+        bin( id );
+
+        mInstances.getElement( id )->dirty = false;
+        }
+    mDirtyIDs.deleteAll();
+
+
+    mQueryStamp++;
+    mVisible.deleteAll();
+
+    int x0 = getCellX( inLowerLeft.x );
+    int x1 = getCellX( inUpperRight.x );
+    int y0 = getCellY( inLowerLeft.y );
+    int y1 = getCellY( inUpperRight.y );
+
+    for( int y=y0; y<=y1; y++ ) {
+        for( int x=x0; x<=x1; x++ ) {
+            SimpleVector<int> *cell = &( mCells[ y * mNumCellsX + x ] );
+
+            int numInCell = cell->size();
+
+            for( int i=0; i<numInCell; i++ ) {
+                considerInstance( cell->getElementDirectFast( i ),
+                                  inLowerLeft, inUpperRight );
+                }
+            }
+        }
+
+    for( int i=0; i<mOversize.size(); i++ ) {
+        considerInstance( mOversize.getElementDirect( i ),
+                          inLowerLeft, inUpperRight );
+        }
+
+
+    int numVisible = mVisible.size();
+
+    if( numVisible > 1 ) {
+        qsort( mVisible.getElement( 0 ), numVisible,
+               sizeof( VisibleInstance ), compareVisible );
+        }
+
+
+    FloatColor baseColor = getDrawColor();
+    FloatColor lastColor = baseColor;
+
+    for( int i=0; i<numVisible; i++ ) {
+        SpriteInstance *instance =
+            mInstances.getElement( mVisible.getElementFast( i )->id );
+
+        FloatColor c = instance->color;
+        c.r *= baseColor.r;
+        c.g *= baseColor.g;
+        c.b *= baseColor.b;
+        c.a *= baseColor.a;
+
+        if( c.r != lastColor.r || c.g != lastColor.g ||
+            c.b != lastColor.b || c.a != lastColor.a ) {
+            setDrawColor( c );
+            lastColor = c;
+            }
+
+        drawSprite( instance->sprite, instance->pos, instance->zoom,
+                    instance->rotation, instance->flipH );
+        }
+
+    if( lastColor.r != baseColor.r || lastColor.g != baseColor.g ||
+        lastColor.b != baseColor.b || lastColor.a != baseColor.a ) {
+        setDrawColor( baseColor );
+        }
+
+    countSpritesCulled( mNumLive - numVisible );
+
+    return numVisible;
+    }
+
+
+
+int SpriteLayer::draw() {
+    doublePair lowerLeft, upperRight;
+
+    getViewRect( &lowerLeft, &upperRight );
+
+    return draw( lowerLeft, upperRight );
+    }
@@ -0,0 +1,183 @@
+#ifndef SPRITE_LAYER_INCLUDED
+#define SPRITE_LAYER_INCLUDED
+
+
+#include "minorGems/game/gameGraphics.h"
+#include "minorGems/game/doublePair.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+
+typedef struct SpriteInstance {
+        SpriteHandle sprite;
+        doublePair pos;
+        double zoom;
+        double rotation;
+        char flipH;
+
+        // multiplied by the draw color that is set when the layer is drawn
+        FloatColor color;
+
+        double depth;
+
+        // order of addition, for ties in depth
+        unsigned int sequence;
+
+        char live;
+
+        // changed since last binned
+        char dirty;
+
+        // too big for grid, kept in separate list
+        char oversize;
+
+        // bounding box used when binned
+        double left, right, bottom, top;
+
+        // range of grid cells it's binned in
+        int cellX0, cellY0, cellX1, cellY1;
+
+        // last query that considered it, to skip repeats from other cells
+        unsigned int queryStamp;
+    } SpriteInstance;
+
+
+
+/**
+ * Retained-mode sprite drawing with view culling.
+ *
+ * Holds sprite instances in a uniform grid over the world, so that drawing
+ * only has to consider instances in grid cells that overlap the view,
+ * instead of submitting every object in the world to GL every frame.
+ *
+ * Changing an instance only marks it dirty.  Dirty instances are moved
+ * to their new cells at the start of the next draw, so objects that move
+ * several times per frame (or not at all) cost nothing extra.
+ *
+ * Sprites drawn match what drawSprite would draw for the same instances
+ * in order, minus those that don't overlap the view.
+ *
+ * @author Jason Rohrer
+ */
+class SpriteLayer {
+
+    public:
+
+        // grid covers the world area between inLowerLeft and inUpperRight
+        // with square cells of inCellSize
+        // instances outside of this area still work, but are binned into
+        // the edge cells, so they are culled less efficiently
+        // Cells a few times the size of a typical instance work best.
+        SpriteLayer( doublePair inLowerLeft, doublePair inUpperRight,
+                     double inCellSize );
+
+        ~SpriteLayer();
+
+
+        // returns an ID for the new instance
+        // instances are drawn in order of increasing depth, and in the
+        // order they were added for equal depths
+        int addInstance( SpriteHandle inSprite, doublePair inPos,
+                         double inZoom = 1.0,
+                         double inRotation = 0.0,
+                         char inFlipH = false,
+                         double inDepth = 0.0 );
+
+        // ID may be reused by a later addInstance
+        void removeInstance( int inID );
+
+        void removeAllInstances();
+
+
+        void setInstancePosition( int inID, doublePair inPos );
+        void setInstanceSprite( int inID, SpriteHandle inSprite );
+        void setInstanceZoom( int inID, double inZoom );
+        void setInstanceRotation( int inID, double inRotation );
+        void setInstanceFlipH( int inID, char inFlipH );
+
+        // defaults to white
+        void setInstanceColor( int inID, FloatColor inColor );
+
+        void setInstanceDepth( int inID, double inDepth );
+
+
+        doublePair getInstancePosition( int inID );
+
+
+        // instance bounds are computed from their sprites when binned
+        // call this after calling setSpriteCenterOffset on a sprite that
+        // is in use here
+        void markAllDirty();
+
+
+        // draws instances that overlap a world-space rectangle
+        // returns the number drawn
+        // the rest count as culled (see endCountingSpritesCulled)
+        int draw( doublePair inLowerLeft, doublePair inUpperRight );
+
+        // draws instances that overlap the current view (getViewRect)
+        int draw();
+
+
+        int getNumInstances() {
+            return mNumLive;
+            }
+
+
+    protected:
+
+        double mCellSize;
+
+        doublePair mLowerLeft;
+
+        int mNumCellsX, mNumCellsY;
+
+        // IDs of instances overlapping each cell
+        SimpleVector<int> *mCells;
+
+        // IDs of instances binned outside the grid
+        SimpleVector<int> mOversize;
+
+        SimpleVector<SpriteInstance> mInstances;
+
+        SimpleVector<int> mFreeIDs;
+
+        SimpleVector<int> mDirtyIDs;
+
+        int mNumLive;
+
+        unsigned int mNextSequence;
+        unsigned int mQueryStamp;
+
+
+        typedef struct VisibleInstance {
+                double depth;
+                unsigned int sequence;
+                int id;
+            } VisibleInstance;
+
+        // reused between draws
+        SimpleVector<VisibleInstance> mVisible;
+
+
+        SpriteInstance *getLiveInstance( int inID );
+
+        void markDirty( int inID );
+
+        // cell containing a world coordinate, clamped to grid
+        int getCellX( double inX );
+        int getCellY( double inY );
+
+        void bin( int inID );
+        void unbin( int inID );
+
+        void considerInstance( int inID,
+                               doublePair inLowerLeft,
+                               doublePair inUpperRight );
+
+        static int compareVisible( const void *inA, const void *inB );
+    };
+
+
+
+#endif
@@ -0,0 +1,429 @@
+#include "binaryDelta.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <string.h>
+
+
+
+#define DELTA_CHUNK_SIZE 65536
+
+// chains longer than this are cut off when looking up a block
+#define MAX_BLOCK_CANDIDATES 16
+
+
+
+// rsync's weak rolling checksum over a window of inLength bytes
+static unsigned int startChecksum( unsigned char *inData, int inLength,
+                                   unsigned int *outA, unsigned int *outB ) {
+    unsigned int a = 0;
+    unsigned int b = 0;
+    
+    for( int i=0; i<inLength; i++ ) {
+        a += inData[i];
+        b += ( inLength - i ) * inData[i];
+        }
+    
+    *outA = a & 0xFFFF;
+    *outB = b & 0xFFFF;
+    
+    return *outA | ( *outB << 16 );
+    }
+
+
+
+static inline unsigned int hashChecksum( unsigned int inChecksum,
+                                         int inShift ) {
+    return ( inChecksum * 2654435761U ) >> inShift;
+    }
+
+
+
+static void pushInt( SimpleVector<unsigned char> *inDelta, int inValue ) {
+    unsigned char bytes[4];
+    
+    bytes[0] = ( inValue >> 24 ) & 0xFF;
+    bytes[1] = ( inValue >> 16 ) & 0xFF;
+    bytes[2] = ( inValue >> 8 ) & 0xFF;
+    bytes[3] = inValue & 0xFF;
+    
+    inDelta->appendArray( bytes, 4 );
+    }
+
+
+
+static int readInt( unsigned char *inBytes ) {
+    return 
+        inBytes[0] << 24 |
+        inBytes[1] << 16 |
+        inBytes[2] << 8 |
+        inBytes[3];
+    }
+
+
+
+static void pushAdd( SimpleVector<unsigned char> *inDelta,
+                     unsigned char *inData, int inLength ) {
+    if( inLength <= 0 ) {
+        return;
+        }
+    inDelta->push_back( 'A' );
+    pushInt( inDelta, inLength );
+    inDelta->appendArray( inData, inLength );
+    }
+
+
+
+static void pushCopy( SimpleVector<unsigned char> *inDelta,
+                      int inOffset, int inLength ) {
+    inDelta->push_back( 'C' );
+    pushInt( inDelta, inOffset );
+    pushInt( inDelta, inLength );
+    }
+
+
+
+unsigned char *computeBinaryDelta( unsigned char *inOld, int inOldLength,
+                                   unsigned char *inNew, int inNewLength,
+                                   int *outDeltaLength ) {
+    
+    // roughly sqrt of the old size, so both the block index and the
+    // literal overhead of a partial-block change stay small
+    int blockSize = 64;
+    while( blockSize < 8192 && 
+           blockSize * blockSize < inOldLength ) {
+        blockSize *= 2;
+        }
+    
+    int numBlocks = inOldLength / blockSize;
+    
+    if( numBlocks == 0 || inNewLength < blockSize ) {
+        return NULL;
+        }
+    
+
+    // hash table of block checksums, chained through blockNext
+    int tableBits = 1;
+    while( ( 1 << tableBits ) < 2 * numBlocks ) {
+        tableBits++;
+        }
+    int tableSize = 1 << tableBits;
+    int shift = 32 - tableBits;
+    
+    int *tableHeads = new int[ tableSize ];
+    int *blockNext = new int[ numBlocks ];
+    unsigned int *blockChecksums = new unsigned int[ numBlocks ];
+    
+    for( int i=0; i<tableSize; i++ ) {
+        tableHeads[i] = -1;
+        }
+    
+    // insert in reverse so chains list earlier blocks first
+    for( int k=numBlocks - 1; k>=0; k-- ) {
+        unsigned int a, b;
+        unsigned int sum = 
+            startChecksum( &( inOld[ k * blockSize ] ), blockSize, &a, &b );
+        
+        blockChecksums[k] = sum;
+        
+        int bucket = hashChecksum( sum, shift );
+        blockNext[k] = tableHeads[ bucket ];
+        tableHeads[ bucket ] = k;
+        }
+    
+
+    SimpleVector<unsigned char> delta;
+    
+    int numCopied = 0;
+
+    int literalStart = 0;
+    int pos = 0;
+    
+    unsigned int a, b;
+    unsigned int sum = startChecksum( inNew, blockSize, &a, &b );
+    
+    while( pos + blockSize <= inNewLength ) {
+        
+        int matchBlock = -1;
+        int numCandidates = 0;
+        
+        int k = tableHeads[ hashChecksum( sum, shift ) ];
+        
+        while( k != -1 && numCandidates < MAX_BLOCK_CANDIDATES ) {
+            if( blockChecksums[k] == sum &&
+                memcmp( &( inOld[ k * blockSize ] ), &( inNew[ pos ] ),
+                        blockSize ) == 0 ) {
+                matchBlock = k;
+                break;
+                }
+            k = blockNext[k];
+            numCandidates++;
+            }
+        
+        
+        if( matchBlock != -1 ) {
+            int oldStart = matchBlock * blockSize;
+            int newStart = pos;
+            
+            // grow the match backwards into pending literal bytes
+            while( newStart > literalStart && oldStart > 0 &&
+                   inOld[ oldStart - 1 ] == inNew[ newStart - 1 ] ) {
+                oldStart--;
+                newStart--;
+                }
+            
+            // and forwards past the end of the block
+            int oldEnd = matchBlock * blockSize + blockSize;
+            int newEnd = pos + blockSize;
+            
+            while( newEnd < inNewLength && oldEnd < inOldLength &&
+                   inOld[ oldEnd ] == inNew[ newEnd ] ) {
+                oldEnd++;
+                newEnd++;
+                }
+            
+            pushAdd( &delta, &( inNew[ literalStart ] ), 
+                     newStart - literalStart );
+            pushCopy( &delta, oldStart, newEnd - newStart );
+
+            numCopied += newEnd - newStart;
+            
+            pos = newEnd;
+            literalStart = pos;
+            
+            if( pos + blockSize <= inNewLength ) {
+                sum = startChecksum( &( inNew[ pos ] ), blockSize, &a, &b );
+                }
+            }
+        else {
+            if( pos + blockSize < inNewLength ) {
+                // roll the window forward one byte
+                unsigned int outByte = inNew[ pos ];
+                unsigned int inByte = inNew[ pos + blockSize ];
+                
+                a = ( a - outByte + inByte ) & 0xFFFF;
+                b = ( b - blockSize * outByte + a ) & 0xFFFF;
+                
+                sum = a | ( b << 16 );
+                }
+            pos++;
+            }
+        }
+    
+    pushAdd( &delta, &( inNew[ literalStart ] ), 
+             inNewLength - literalStart );
+    
+
+    delete [] tableHeads;
+    delete [] blockNext;
+    delete [] blockChecksums;
+    
+
+    if( numCopied == 0 ) {
+        return NULL;
+        }
+
+    *outDeltaLength = delta.size();
+    return delta.getElementArray();
+    }
+
+
+
+char computeFileSHA1( const char *inFileName, 
+                      unsigned char outDigest[ SHA1_DIGEST_LENGTH ] ) {
+    FILE *file = fopen( inFileName, "rb" );
+    
+    if( file == NULL ) {
+        return false;
+        }
+
+    SHA_CTX context;
+    SHA1_Init( &context );
+    
+    unsigned char *chunk = new unsigned char[ DELTA_CHUNK_SIZE ];
+    
+    int numRead = fread( chunk, 1, DELTA_CHUNK_SIZE, file );
+    
+    while( numRead > 0 ) {
+        SHA1_Update( &context, chunk, numRead );
+        numRead = fread( chunk, 1, DELTA_CHUNK_SIZE, file );
+        }
+    
+    char success = ! ferror( file );
+    
+    fclose( file );
+    delete [] chunk;
+    
+    SHA1_Final( outDigest, &context );
+    
+    return success;
+    }
+
+
+
+BinaryDeltaApplier::BinaryDeltaApplier( FILE *inOldFile, FILE *inNewFile )
+        : mOldFile( inOldFile ), mNewFile( inNewFile ),
+          mError( false ), mOp( 0 ), mNumArgBytes( 0 ), mAddBytesLeft( 0 ),
+          mBytesWritten( 0 ),
+          mChunk( new unsigned char[ DELTA_CHUNK_SIZE ] ) {
+    
+    SHA1_Init( &mHashContext );
+    }
+
+
+
+BinaryDeltaApplier::~BinaryDeltaApplier() {
+    delete [] mChunk;
+    }
+
+
+
+char BinaryDeltaApplier::writeAndHash( unsigned char *inBytes, 
+                                       int inNumBytes ) {
+    
+    int numWritten = fwrite( inBytes, 1, inNumBytes, mNewFile );
+    
+    if( numWritten != inNumBytes ) {
+        return false;
+        }
+
+    mBytesWritten += inNumBytes;
+    
+    // hash scratch copies (see computeFileSHA1)
+    if( inBytes != mChunk ) {
+        while( inNumBytes > 0 ) {
+            int thisPart = inNumBytes;
+            if( thisPart > DELTA_CHUNK_SIZE ) {
+                thisPart = DELTA_CHUNK_SIZE;
+                }
+            memcpy( mChunk, inBytes, thisPart );
+            SHA1_Update( &mHashContext, mChunk, thisPart );
+            
+            inBytes = &( inBytes[ thisPart ] );
+            inNumBytes -= thisPart;
+            }
+        }
+    else {
+        SHA1_Update( &mHashContext, mChunk, inNumBytes );
+        }
+    
+    return true;
+    }
+
+
+
+char BinaryDeltaApplier::copyFromOld( int inOffset, int inLength ) {
+    if( inOffset < 0 || inLength < 0 ||
+        fseek( mOldFile, inOffset, SEEK_SET ) != 0 ) {
+        return false;
+        }
+    
+    while( inLength > 0 ) {
+        int thisPart = inLength;
+        if( thisPart > DELTA_CHUNK_SIZE ) {
+            thisPart = DELTA_CHUNK_SIZE;
+            }
+        
+        int numRead = fread( mChunk, 1, thisPart, mOldFile );
+        
+        if( numRead != thisPart ) {
+            return false;
+            }
+        
+        if( ! writeAndHash( mChunk, thisPart ) ) {
+            return false;
+            }
+        
+        inLength -= thisPart;
+        }
+    
+    return true;
+    }
+
+
+
+char BinaryDeltaApplier::addDeltaBytes( unsigned char *inBytes, 
+                                        int inNumBytes ) {
+    int pos = 0;
+    
+    while( !mError && pos < inNumBytes ) {
+        
+        if( mOp == 0 ) {
+            mOp = inBytes[ pos ];
+            pos++;
+            
+            if( mOp != 'A' && mOp != 'C' ) {
+                mError = true;
+                }
+            mNumArgBytes = 0;
+            continue;
+            }
+        
+        if( mAddBytesLeft > 0 ) {
+            int thisPart = inNumBytes - pos;
+            if( thisPart > mAddBytesLeft ) {
+                thisPart = mAddBytesLeft;
+                }
+            
+            if( ! writeAndHash( &( inBytes[ pos ] ), thisPart ) ) {
+                mError = true;
+                }
+            
+            pos += thisPart;
+            mAddBytesLeft -= thisPart;
+            
+            if( mAddBytesLeft == 0 ) {
+                mOp = 0;
+                }
+            continue;
+            }
+        
+        int numArgBytesNeeded = 4;
+        if( mOp == 'C' ) {
+            numArgBytesNeeded = 8;
+            }
+        
+        mArgs[ mNumArgBytes ] = inBytes[ pos ];
+        mNumArgBytes++;
+        pos++;
+        
+        if( mNumArgBytes == numArgBytesNeeded ) {
+            if( mOp == 'C' ) {
+                if( ! copyFromOld( readInt( mArgs ), 
+                                   readInt( &( mArgs[4] ) ) ) ) {
+                    mError = true;
+                    }
+                mOp = 0;
+                }
+            else {
+                mAddBytesLeft = readInt( mArgs );
+                
+                if( mAddBytesLeft <= 0 ) {
+                    mError = true;
+                    }
+                }
+            }
+        }
+    
+    return !mError;
+    }
+
+
+
+char BinaryDeltaApplier::isFinished() {
+    return !mError && mOp == 0;
+    }
+
+
+
+int BinaryDeltaApplier::getBytesWritten() {
+    return mBytesWritten;
+    }
+
+
+
+void BinaryDeltaApplier::getResultSHA1( 
+    unsigned char outDigest[ SHA1_DIGEST_LENGTH ] ) {
+    
+    SHA1_Final( outDigest, &mHashContext );
+    }
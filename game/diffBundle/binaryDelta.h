@@ -0,0 +1,115 @@
+#ifndef BINARY_DELTA_INCLUDED
+#define BINARY_DELTA_INCLUDED
+
+
+#include <stdio.h>
+
+#include "minorGems/crypto/hashes/sha1.h"
+
+
+
+// Binary deltas between two versions of a file, rsync style.
+//
+// The old file is cut into fixed-size blocks, indexed by a rolling
+// checksum.  The new file is scanned byte by byte for blocks that also
+// occur in the old file, and each match is grown in both directions.
+//
+// A delta is a sequence of ops:
+//   'C' offset length   copy length bytes from offset in the old file
+//   'A' length data     add length literal bytes
+// with offset and length as 4-byte big-endian values.  The ops end where
+// the delta data ends.
+
+
+
+// Computes a delta that rebuilds inNew from inOld.
+//
+// Returns NULL if inNew has nothing in common with inOld (a delta would
+// only be larger than inNew itself).
+// Result destroyed by caller.
+unsigned char *computeBinaryDelta( unsigned char *inOld, int inOldLength,
+                                   unsigned char *inNew, int inNewLength,
+                                   int *outDeltaLength );
+
+
+
+// Hashes a file in fixed-size chunks without loading it all.
+// Returns true on success.
+//
+// SHA1_Update overwrites the data it hashes (see sha1.h), so here and
+// throughout diffBundle it is only handed scratch copies, or bytes that
+// have already been written out.
+char computeFileSHA1( const char *inFileName, 
+                      unsigned char outDigest[ SHA1_DIGEST_LENGTH ] );
+
+
+
+/**
+ * Rebuilds a new file from an old file and a delta, writing the result as
+ * delta bytes arrive.
+ *
+ * Delta bytes may be added in pieces of any size, split anywhere, so the
+ * whole delta never needs to be in memory.  COPY data is read from the
+ * old file in bounded chunks.
+ */
+class BinaryDeltaApplier {
+        
+    public:
+        
+        /**
+         * @param inOldFile open for binary reading.  Not closed here.
+         * @param inNewFile open for binary writing.  Not closed here.
+         */
+        BinaryDeltaApplier( FILE *inOldFile, FILE *inNewFile );
+        
+        ~BinaryDeltaApplier();
+        
+        
+        // returns false if the delta is malformed or an I/O operation
+        // fails, after which all further calls fail.
+        char addDeltaBytes( unsigned char *inBytes, int inNumBytes );
+        
+
+        // true if the delta ended on an op boundary without errors
+        char isFinished();
+        
+        
+        int getBytesWritten();
+
+
+        // SHA1 of everything written so far
+        // call once, after the last addDeltaBytes
+        void getResultSHA1( unsigned char outDigest[ SHA1_DIGEST_LENGTH ] );
+        
+        
+    protected:
+        
+        FILE *mOldFile;
+        FILE *mNewFile;
+        
+        char mError;
+        
+        // op char, or 0 when between ops
+        unsigned char mOp;
+        
+        // op argument bytes collected so far
+        unsigned char mArgs[8];
+        int mNumArgBytes;
+        
+        // literal bytes left in the current ADD op
+        int mAddBytesLeft;
+        
+        int mBytesWritten;
+        
+        SHA_CTX mHashContext;
+        
+        unsigned char *mChunk;
+        
+        char writeAndHash( unsigned char *inBytes, int inNumBytes );
+        
+        char copyFromOld( int inOffset, int inLength );
+    };
+
+
+
+#endif
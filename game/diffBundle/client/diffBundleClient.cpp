@@ -35,6 +35,15 @@
 #include <stdlib.h>
 
 
+#include "minorGems/game/diffBundle/binaryDelta.h"
+
+
+// newest bundle format we can apply
+// we ask the server for it, and it falls back to version 1 bundles
+// when it has none in this format
+#define BUNDLE_FORMAT_VERSION 2
+
+
 static void copyPermissions( char *inSourceFile, char *inDestFile ) {
     struct stat sourceST;
     
@@ -63,8 +72,6 @@ static int updateSize = -1;
 static double webHandleStartTime = 0;
 
 
-static int updateProgressCompleteSteps;
-
 static char *updateServerURL = NULL;
 static int oldVersionNumber;
 
@@ -97,6 +104,17 @@ static const char *platformCode = "";
 
 static char writeError = false;
 
+
+// format we ask the server for
+// drops to 1 (full files only) if a delta's base doesn't match our file
+static int requestBundleFormat = BUNDLE_FORMAT_VERSION;
+
+// set when a delta entry was made against a different version of its
+// file than the one we have
+// every mirror serves the same delta, so trying another won't help
+static char deltaBaseMismatch = false;
+
+
 char wasUpdateWriteError() {
     return writeError;
     }
@@ -114,12 +132,36 @@ void printDownloadStats( int inDownloadSizeBytes ) {
             
 
 
+// asks the server what updates we need to reach the latest version
+static void startUpdateCheck() {
+    char *fullURL = autoSprintf( "%s?action=is_update_available"
+                                 "&platform=%s&old_version=%d"
+                                 "&bundle_format=%d",
+                                 updateServerURL, platformCode,
+                                 oldVersionNumber,
+                                 requestBundleFormat );
+    
+    printf( "Checking for latest update at %s\n", fullURL );
+    
+    webHandle = startWebRequest( "GET", fullURL, NULL );
+    webHandleStartTime = Time::getCurrentTime();
+
+    delete [] fullURL;
+
+    updateSize = -1;
+    }
+
+
+
 char startUpdate( char *inUpdateServerURL, int inOldVersionNumber,
                   char inSkipUniversalBundles ) {
     // don't auto update
     return false;
     writeError = false;
     
+    requestBundleFormat = BUNDLE_FORMAT_VERSION;
+    deltaBaseMismatch = false;
+
     batchMirrorUpdate = false;
     currentUpdateUniversal = false;
     
@@ -201,34 +243,31 @@ char startUpdate( char *inUpdateServerURL, int inOldVersionNumber,
         platformCode = "all";
         }
     
-
-    char *fullURL = autoSprintf( "%s?action=is_update_available"
-                                 "&platform=%s&old_version=%d",
-                                 inUpdateServerURL, platformCode,
-                                 inOldVersionNumber );
-    
-    printf( "Checking for latest update at %s\n", fullURL );
-    
-    webHandle = startWebRequest( "GET", fullURL, NULL );
-    webHandleStartTime = Time::getCurrentTime();
-
-    delete [] fullURL;
-    
     if( updateServerURL != NULL ) {
         delete [] updateServerURL;
         }
 
-    updateSize = -1;
-    updateProgressCompleteSteps = 0;
-    
     updateServerURL = stringDuplicate( inUpdateServerURL );
     oldVersionNumber = inOldVersionNumber;
 
+    startUpdateCheck();
+
     return true;
     }
 
 
 
+// bundles for the "all" platform, in either bundle format
+static char isUniversalBundleURL( const char *inURL ) {
+    if( strstr( inURL, "_all.dbz" ) != NULL ||
+        strstr( inURL, "_all_delta.dbz" ) != NULL ) {
+        return true;
+        }
+    return false;
+    }
+
+
+
 static void dumpRawDataToFile( unsigned char *inRawBundleData,
                                int inNumBytes ) {
     FILE *dumpFile = fopen( "diffBundle_dump.raw", "wb" );
@@ -241,543 +280,1289 @@ static void dumpRawDataToFile( unsigned char *inRawBundleData,
 
 
 
-// returns 1 on success, -1 on failure
-static int applyUpdateFromWebResult() {
-    // process it, unzip, apply file changes, etc.
-            
+// Bundles are applied while they download.
+//
+// Compressed bytes are inflated in chunks and parsed incrementally, and
+// file data is written out as it arrives, so memory use is bounded by one
+// inflated chunk plus one entry header, no matter how big the bundle is.
+//
+// If the connection drops part way, the download resumes where it left off
+// with an HTTP Range request.  The inflate and parse state live on across
+// requests, so nothing is fetched or applied twice.
+//
+// Each file is built in a temp file next to it, and only moved into place
+// once complete (and, for version 2 bundles, once its SHA1 digest checks
+// out).  Files that it replaces are kept as .bak backups until the whole
+// bundle has been applied, and are restored if applying fails part way.
+
+
+// inflated bytes produced per inflate call
+#define BUNDLE_INFLATE_CHUNK_SIZE 65536
+
+// longer names in a bundle are taken as a sign of corrupt data
+#define MAX_BUNDLE_NAME_LENGTH 4096
+
+// longer outer headers are taken as a sign of a bad response
+#define MAX_BUNDLE_OUTER_HEADER_LENGTH 64
+
+
+
+enum BundleParseState {
+    parseRemovedFileCount = 0,
+    parseRemovedFiles,
+    parseRemovedDirCount,
+    parseRemovedDirs,
+    parseNewDirCount,
+    parseNewDirs,
+    parseFileCount,
+    parseFileHeader,
+    parseFileData,
+    parseDone
+    };
+
+
+
+// true while a bundle download is in progress
+static char bundleActive = false;
+
+// result of the last bundle download, returned if stepped after it ended
+static int lastBundleResult = 0;
+
+// where the bundle comes from, for resuming
+static char *bundleURL = NULL;
+
+// bytes of the bundle file received so far, over all requests
+static int bundleBytesReceived = 0;
+
+// offset that the current request started from
+static int bundleRequestStart = 0;
+
+// bytes of the bundle received by the current request
+static int bundleRequestBytes = 0;
+
+// true once we've checked whether the server honored our Range request
+static char bundleRequestChecked = false;
+
+// bytes to throw away from the start of the current response, when the
+// server ignored our Range request and sent the whole bundle again
+static int bundleBytesToSkip = 0;
+
+
+// "DBZ2 rawSize compSize " or (version 1) "rawSize compSize "
+// collected here until it is complete
+static SimpleVector<char> bundleOuterHeader;
+static char bundleOuterHeaderDone;
+
+static int bundleVersion;
+static int bundleRawSize;
+static int bundleCompSize;
+static int bundleCompBytesSeen;
+static int bundleRawBytesSeen;
+
+static void *bundleInflateStream = NULL;
+static char bundleInflateDone;
+
+// SHA1 of compressed data, for the log
+static SHA_CTX bundleCompHashContext;
+
+// inflated bytes not yet parsed
+static SimpleVector<unsigned char> bundlePendingBytes;
+
+static BundleParseState bundleParseState;
+
+// items left in the list being parsed
+static int bundleItemsLeft;
+
+
+// file entry currently being written
+static char *entryFileName = NULL;
+static char *entryTempName = NULL;
+static FILE *entryTempFile = NULL;
+static FILE *entryOldFile = NULL;
+static BinaryDeltaApplier *entryApplier = NULL;
+static SHA_CTX entryHashContext;
+
+// F for full file data, D for a delta against the old file
+static char entryType;
+
+// bytes of entry data (or delta) in the bundle still to come
+static int entryBytesLeft;
+
+// version 2 digests
+static char entryNewHash[ 41 ];
+static char entryOldHash[ 41 ];
+
+
+// files moved aside, restored if applying fails
+static SimpleVector<char*> bundleBackupList;
+
+// files that did not exist before, removed if applying fails
+static SimpleVector<char*> bundleCreatedList;
+
+// files and dirs the bundle removes
+// only removed once the whole bundle has been applied, since they
+// can't be restored if it fails part way
+static SimpleVector<char*> bundleRemovedFileList;
+static SimpleVector<char*> bundleRemovedDirList;
+
+
+
+// scans a decimal int from inBytes at *ioPos, followed by a single
+// separator character, which is skipped
+// returns 1 on success, 0 if more bytes are needed, -1 if malformed
+static int scanStreamInt( unsigned char *inBytes, int inLength,
+                          int *ioPos, int *outValue ) {
+    int pos = *ioPos;
+    int value = 0;
+    int numDigits = 0;
+
+    while( pos < inLength && inBytes[pos] >= '0' && inBytes[pos] <= '9' ) {
+        value = value * 10 + ( inBytes[pos] - '0' );
+        numDigits++;
+        pos++;
+
+        if( numDigits > 9 ) {
+            return -1;
+            }
+        }
+
+    if( pos == inLength ) {
+        // separator not here yet, more digits may follow
+        return 0;
+        }
+    if( numDigits == 0 ) {
+        return -1;
+        }
+
+    *outValue = value;
+    *ioPos = pos + 1;
+    return 1;
+    }
+
+
+
+// scans a "length name" pair from inBytes at *ioPos, plus the single
+// separator character that follows it
+// returns 1 on success, 0 if more bytes are needed, -1 if malformed
+// outName destroyed by caller on success
+static int scanStreamName( unsigned char *inBytes, int inLength,
+                           int *ioPos, char **outName ) {
+    int pos = *ioPos;
+    int nameLength;
+
+    int result = scanStreamInt( inBytes, inLength, &pos, &nameLength );
+
+    if( result != 1 ) {
+        return result;
+        }
+    if( nameLength > MAX_BUNDLE_NAME_LENGTH ) {
+        return -1;
+        }
+    if( pos + nameLength + 1 > inLength ) {
+        return 0;
+        }
+
+    char *name = new char[ nameLength + 1 ];
+    memcpy( name, &( inBytes[pos] ), nameLength );
+    name[ nameLength ] = '\0';
+
+    *outName = name;
+    *ioPos = pos + nameLength + 1;
+    return 1;
+    }
+
+
+
+// scans a file entry header from inBytes at *ioPos into the entry
+// variables
+// version 1:  "length name size#"
+// version 2:  "length name F size newSHA1#"  or
+//             "length name D size newSHA1 oldSHA1#"
+// returns 1 on success, 0 if more bytes are needed, -1 if malformed
+static int scanFileHeader( unsigned char *inBytes, int inLength,
+                           int *ioPos ) {
+    int pos = *ioPos;
+    char *name;
+
+    int result = scanStreamName( inBytes, inLength, &pos, &name );
+
+    if( result != 1 ) {
+        return result;
+        }
+
+    char type = 'F';
+
+    if( bundleVersion >= 2 ) {
+        if( pos + 2 > inLength ) {
+            delete [] name;
+            return 0;
+            }
+        type = inBytes[pos];
+        pos += 2;
+
+        if( type != 'F' && type != 'D' ) {
+            delete [] name;
+            return -1;
+            }
+        }
+
     int size;
-    unsigned char *result = getWebResult( webHandle, &size );
+    result = scanStreamInt( inBytes, inLength, &pos, &size );
 
-    printDownloadStats( size );
+    if( result != 1 ) {
+        delete [] name;
+        return result;
+        }
 
-    char *nextRawScanPointer = (char*)result;
-            
-    // don't use sscanf here because it scans the entire buffer
-    // (and this buffer has binary data at end)
-    int rawSize = scanIntAndSkip( &nextRawScanPointer );
-    int compSize = scanIntAndSkip( &nextRawScanPointer );
+    entryNewHash[0] = '\0';
+    entryOldHash[0] = '\0';
 
-    if( rawSize > 0 && compSize > 0 ) {
-                
-        unsigned char *compData = (unsigned char*)nextRawScanPointer;
-                
-        char *hash = computeSHA1Digest( compData, compSize );
+    if( bundleVersion >= 2 ) {
+        int hashBytes = 41;
+        if( type == 'D' ) {
+            hashBytes = 82;
+            }
 
-        AppLog::infoF( "Received compressed data with SHA1 = %s\n",
-                       hash );
+        if( pos + hashBytes > inLength ) {
+            delete [] name;
+            return 0;
+            }
+
+        memcpy( entryNewHash, &( inBytes[pos] ), 40 );
+        entryNewHash[40] = '\0';
+
+        if( type == 'D' ) {
+            memcpy( entryOldHash, &( inBytes[ pos + 41 ] ), 40 );
+            entryOldHash[40] = '\0';
+            }
+
+        // hashes plus separators
+        pos += hashBytes;
+        }
+
+    entryFileName = name;
+    entryType = type;
+    entryBytesLeft = size;
+
+    *ioPos = pos;
+    return 1;
+    }
+
+
+
+// closes the current entry's files and frees its names
+// the temp file is removed if it is still there
+static void clearEntry() {
+    if( entryApplier != NULL ) {
+        delete entryApplier;
+        entryApplier = NULL;
+        }
+    if( entryOldFile != NULL ) {
+        fclose( entryOldFile );
+        entryOldFile = NULL;
+        }
+    if( entryTempFile != NULL ) {
+        fclose( entryTempFile );
+        entryTempFile = NULL;
+        }
+    if( entryTempName != NULL ) {
+        remove( entryTempName );
+        delete [] entryTempName;
+        entryTempName = NULL;
+        }
+    if( entryFileName != NULL ) {
+        delete [] entryFileName;
+        entryFileName = NULL;
+        }
+    }
+
+
+
+// makes the directory that will hold inFileName, if needed
+// returns false on failure
+static char makeParentDirectory( char *inFileName ) {
+    if( strstr( inFileName, "/" ) == NULL ) {
+        return true;
+        }
+
+    // file name contains a path
+
+    // make sure the dir exists
+    char *dirName = stringDuplicate( inFileName );
+
+    // find last / and terminate there to get dir name
+    int len = strlen( dirName );
+    for( int i=len-1; i>=0; i-- ) {
+        if( dirName[i] == '/' ) {
+            dirName[i] = '\0';
+            break;
+            }
+        }
+    File dirFile( NULL, dirName );
+
+    char made = true;
+
+    if( ! dirFile.exists() ) {
+        printf( "Making necessary directory %s for "
+                "new file %s\n",
+                dirName, inFileName );
+
+        made = Directory::makeDirectory( &dirFile );
+
+        if( !made ) {
+            printf( "Failed to make directory %s\n",
+                    dirName );
+            }
+        }
+    delete [] dirName;
+
+    return made;
+    }
+
+
+
+// opens the temp file for the entry whose header was just parsed
+// returns false on failure
+static char startEntry() {
+    printf( "   %s\n", entryFileName );
+
+    File targetFile( NULL, entryFileName );
+
+    if( ! targetFile.exists() ) {
+        if( ! makeParentDirectory( entryFileName ) ) {
+            writeError = true;
+            return false;
+            }
+        }
+
+    if( entryType == 'D' ) {
+        // make sure we have the version the delta was made against
+        unsigned char oldDigest[ SHA1_DIGEST_LENGTH ];
+
+        char *oldHash = NULL;
+
+        if( computeFileSHA1( entryFileName, oldDigest ) ) {
+            oldHash = hexEncode( oldDigest, SHA1_DIGEST_LENGTH );
+            }
+
+        char match = ( oldHash != NULL &&
+                       stringCompareIgnoreCase( oldHash,
+                                                entryOldHash ) == 0 );
+        if( oldHash != NULL ) {
+            delete [] oldHash;
+            }
+
+        if( !match ) {
+            printf( "Old version of %s does not match delta base %s\n",
+                    entryFileName, entryOldHash );
+            deltaBaseMismatch = true;
+            return false;
+            }
+
+        entryOldFile = fopen( entryFileName, "rb" );
+
+        if( entryOldFile == NULL ) {
+            printf( "Failed to open %s for reading\n", entryFileName );
+            writeError = true;
+            return false;
+            }
+        }
+
+    entryTempName = autoSprintf( "%s.dbtmp", entryFileName );
+
+    entryTempFile = fopen( entryTempName, "wb" );
+
+    if( entryTempFile == NULL ) {
+        printf( "Failed to open file %s for writing\n",
+                entryTempName );
+        writeError = true;
+        return false;
+        }
+
+    if( entryType == 'D' ) {
+        entryApplier = new BinaryDeltaApplier( entryOldFile, entryTempFile );
+        }
+    else {
+        SHA1_Init( &entryHashContext );
+        }
+
+    return true;
+    }
+
+
+
+// writes the next piece of entry data
+// returns false on failure
+static char addEntryBytes( unsigned char *inBytes, int inNumBytes ) {
+    if( entryType == 'D' ) {
+        if( ! entryApplier->addDeltaBytes( inBytes, inNumBytes ) ) {
+            printf( "Failed to apply delta to %s\n", entryFileName );
+            return false;
+            }
+        return true;
+        }
+
+    int numWritten = fwrite( inBytes, 1, inNumBytes, entryTempFile );
+
+    if( numWritten != inNumBytes ) {
+        printf( "Failed to write %d bytes to file  %s\n",
+                inNumBytes, entryTempName );
+        writeError = true;
+        return false;
+        }
+
+    // hash after writing (see computeFileSHA1)
+    SHA1_Update( &entryHashContext, inBytes, inNumBytes );
+
+    return true;
+    }
+
+
+
+// checks the finished temp file and moves it into place
+// returns false on failure
+static char finishEntry() {
+    unsigned char digest[ SHA1_DIGEST_LENGTH ];
+
+    if( entryType == 'D' ) {
+        if( ! entryApplier->isFinished() ) {
+            printf( "Delta for %s ended part way through\n",
+                    entryFileName );
+            return false;
+            }
+        entryApplier->getResultSHA1( digest );
+
+        delete entryApplier;
+        entryApplier = NULL;
+
+        fclose( entryOldFile );
+        entryOldFile = NULL;
+        }
+    else {
+        SHA1_Final( digest, &entryHashContext );
+        }
+
+    int closeResult = fclose( entryTempFile );
+    entryTempFile = NULL;
+
+    if( closeResult != 0 ) {
+        printf( "Failed to finish writing file %s\n", entryTempName );
+        writeError = true;
+        return false;
+        }
+
+    if( bundleVersion >= 2 ) {
+        char *hash = hexEncode( digest, SHA1_DIGEST_LENGTH );
+
+        char match = ( stringCompareIgnoreCase( hash, entryNewHash ) == 0 );
+
+        if( !match ) {
+            printf( "SHA1 of rebuilt %s is %s, expected %s\n",
+                    entryFileName, hash, entryNewHash );
+            }
         delete [] hash;
 
-        unsigned char *rawData = 
-            zipDecompress( compData,
-                           compSize,
-                           rawSize );
+        if( !match ) {
+            return false;
+            }
+        }
+
 
-        delete [] result;
-                
+    char *fileName = entryFileName;
 
-        if( rawData == NULL ) {
-            printf( "Failed to decompress diff bundle\n" );
+    File targetFile( NULL, fileName );
+
+    char *backupName = NULL;
+
+    if( targetFile.exists() ) {
+        backupName = autoSprintf( "%s.bak", fileName );
+
+        printf( "File %s exists, moving temporariliy to %s\n",
+                fileName, backupName );
+
+        File backFile( NULL, backupName );
+
+        if( backFile.exists() ) {
+            printf( "Backup file %s already exists, skipping move\n",
+                    backupName );
+            remove( fileName );
+            }
+        else {
+            int result = rename( fileName, backupName );
+
+            if( result != 0 ) {
+                printf( "Moving backup to %s failed\n",
+                        backupName );
+                writeError = true;
+                delete [] backupName;
+                return false;
+                }
+            else {
+                bundleBackupList.push_back( stringDuplicate( backupName ) );
+                }
+            }
+        }
+    else {
+        bundleCreatedList.push_back( stringDuplicate( fileName ) );
+        }
+
+    if( rename( entryTempName, fileName ) != 0 ) {
+        printf( "Failed to move %s to %s\n", entryTempName, fileName );
+        writeError = true;
+        if( backupName != NULL ) {
+            delete [] backupName;
+            }
+        return false;
+        }
+
+
+    if( backupName != NULL ) {
+        copyPermissions( backupName, fileName );
+
+        delete [] backupName;
+        }
+    else {
+        // try to set permissions manually on mac for main app exe
+        if( strcmp( PLATFORM_CODE, "mac" ) == 0 ) {
+            if( strstr( fileName, "Contents/MacOS/" ) != NULL ) {
+                const char *mode = "0755";
+                int modeInt = strtol( mode, 0, 8 );
+                chmod( fileName, modeInt );
+                }
+            }
+        }
+
+
+    if( currentUpdateUniversal &&
+        WINDOWS_LINE_ENDS &&
+        stringEndsWith( fileName, ".txt" ) ) {
+        char *contents = targetFile.readFileContents();
+
+        if( contents != NULL ) {
+
+            if( strstr( contents, "\n" ) != NULL &&
+                strstr( contents, "\r\n" ) == NULL ) {
+                // contains at least one unix-style line ending
+                // and no \r, which is part of windows \r\n
+                // and other platforms, or ill-formed, line endings
+
+
+                // replaceAll too slow in this case
+                // some files have 20k + newlines to replace
+                SimpleVector<char> newContents;
+
+                int oldLen = strlen( contents );
+
+                for( int i=0; i<oldLen; i++ ) {
+                    if( contents[i] == '\n' ) {
+                        newContents.push_back( '\r' );
+                        newContents.push_back( '\n' );
+                        }
+                    else {
+                        newContents.push_back( contents[i] );
+                        }
+                    }
+
+                char *convertedContents =
+                    newContents.getElementString();
+
+                targetFile.writeToFile( convertedContents );
+
+                delete [] convertedContents;
+                }
+            delete [] contents;
+            }
+        }
+
+    // already moved into place
+    delete [] entryTempName;
+    entryTempName = NULL;
+
+    delete [] entryFileName;
+    entryFileName = NULL;
+
+    return true;
+    }
+
+
+
+// parses and applies as much of the inflated bundle data as possible
+// returns 1 once the whole bundle has been parsed, 0 if more data is
+// needed, or -1 on failure
+static int parseBundleBytes() {
+    int length = bundlePendingBytes.size();
+
+    unsigned char *bytes = NULL;
+    if( length > 0 ) {
+        bytes = bundlePendingBytes.getElement( 0 );
+        }
+
+    int pos = 0;
+
+    // 1 while items are being parsed
+    int result = 1;
+
+    while( result == 1 && bundleParseState != parseDone ) {
+
+        if( bundleParseState == parseRemovedFileCount ||
+            bundleParseState == parseRemovedDirCount ||
+            bundleParseState == parseNewDirCount ||
+            bundleParseState == parseFileCount ) {
+
+            result = scanStreamInt( bytes, length, &pos, &bundleItemsLeft );
+
+            if( result == 1 ) {
+                switch( bundleParseState ) {
+                    case parseRemovedFileCount:
+                        printf( "Removing %d files\n", bundleItemsLeft );
+                        break;
+                    case parseRemovedDirCount:
+                        printf( "Removing %d dirs\n", bundleItemsLeft );
+                        break;
+                    case parseNewDirCount:
+                        printf( "Creating %d new directories\n",
+                                bundleItemsLeft );
+                        break;
+                    default:
+                        printf( "Updating %d files\n", bundleItemsLeft );
+                        break;
+                    }
+
+                // on to list that follows count
+                bundleParseState =
+                    (BundleParseState)( bundleParseState + 1 );
+                }
+            }
+        else if( bundleParseState == parseRemovedFiles ||
+                 bundleParseState == parseRemovedDirs ||
+                 bundleParseState == parseNewDirs ) {
+
+            if( bundleItemsLeft <= 0 ) {
+                // on to next count
+                bundleParseState =
+                    (BundleParseState)( bundleParseState + 1 );
+                continue;
+                }
+
+            char *fileName;
+            result = scanStreamName( bytes, length, &pos, &fileName );
+
+            if( result != 1 ) {
+                continue;
+                }
+
+            printf( "   %s\n", fileName );
+
+            if( bundleParseState == parseRemovedFiles ) {
+                bundleRemovedFileList.push_back( fileName );
+                bundleItemsLeft--;
+                continue;
+                }
+            else if( bundleParseState == parseRemovedDirs ) {
+                bundleRemovedDirList.push_back( fileName );
+                bundleItemsLeft--;
+                continue;
+                }
+            else {
+                File file( NULL, fileName );
+
+                if( file.exists() ) {
+                    printf( "Directory exists %s\n",
+                            fileName );
+                    }
+                else if( ! Directory::makeDirectory( &file ) ) {
+                    printf( "Failed to make directory %s\n",
+                            fileName );
+                    delete [] fileName;
+                    return -1;
+                    }
+                }
+
+            delete [] fileName;
+
+            bundleItemsLeft--;
+            }
+        else if( bundleParseState == parseFileHeader ) {
+
+            if( bundleItemsLeft <= 0 ) {
+                bundleParseState = parseDone;
+                continue;
+                }
+
+            result = scanFileHeader( bytes, length, &pos );
+
+            if( result != 1 ) {
+                continue;
+                }
+
+            if( ! startEntry() ) {
+                printf( "Ending update process\n" );
+                return -1;
+                }
+
+            bundleParseState = parseFileData;
+            }
+        else if( bundleParseState == parseFileData ) {
+
+            int numAvailable = length - pos;
+
+            int numToAdd = entryBytesLeft;
+            if( numToAdd > numAvailable ) {
+                numToAdd = numAvailable;
+                }
+
+            if( numToAdd > 0 ) {
+                if( ! addEntryBytes( &( bytes[pos] ), numToAdd ) ) {
+                    printf( "Ending update process\n" );
+                    return -1;
+                    }
+                pos += numToAdd;
+                entryBytesLeft -= numToAdd;
+                }
+
+            if( entryBytesLeft > 0 ) {
+                // wait for more
+                result = 0;
+                }
+            else {
+                if( ! finishEntry() ) {
+                    printf( "Ending update process\n" );
+                    return -1;
+                    }
+
+                bundleItemsLeft--;
+                bundleParseState = parseFileHeader;
+                }
+            }
+        }
+
+    if( result == -1 ) {
+        printf( "Failed to parse diff bundle\n" );
+
+        dumpRawDataToFile( &( bytes[pos] ), length - pos );
+        return -1;
+        }
+
+    bundlePendingBytes.deleteStartElements( pos );
+
+    if( bundleParseState == parseDone ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+// parses the outer header from bundleOuterHeader
+// returns the length of the header on success, 0 if more bytes are
+// needed, or -1 on failure
+static int parseBundleOuterHeader() {
+    int length = bundleOuterHeader.size();
+
+    if( length == 0 ) {
+        return 0;
+        }
+
+    unsigned char *bytes =
+        (unsigned char *)bundleOuterHeader.getElement( 0 );
+
+    int pos = 0;
+    int result;
+
+    // version 1 bundles have no version tag
+    bundleVersion = 1;
+
+    if( bytes[0] == 'D' ) {
+        if( length < 3 ) {
+            return 0;
+            }
+        if( memcmp( bytes, "DBZ", 3 ) != 0 ) {
             return -1;
             }
+        pos = 3;
 
-                                
-        char *nextScanPointer = (char*)rawData;
-        char success;
+        result = scanStreamInt( bytes, length, &pos, &bundleVersion );
+        if( result != 1 ) {
+            return result;
+            }
 
+        if( bundleVersion > BUNDLE_FORMAT_VERSION ) {
+            printf( "Diff bundle version %d not supported\n",
+                    bundleVersion );
+            return -1;
+            }
+        }
 
+    result = scanStreamInt( bytes, length, &pos, &bundleRawSize );
+    if( result != 1 ) {
+        return result;
+        }
+    result = scanStreamInt( bytes, length, &pos, &bundleCompSize );
+    if( result != 1 ) {
+        return result;
+        }
 
+    if( bundleRawSize <= 0 || bundleCompSize <= 0 ) {
+        return -1;
+        }
 
-        
-        int numRemovedFiles = scanIntAndSkip( &nextScanPointer, &success );
-                    
-        if( !success ) {
-            printf( "Failed to parse removed file count from diff bundle\n" );
-            dumpRawDataToFile( rawData, rawSize );
-            delete [] rawData;
+    return pos;
+    }
+
+
+
+// inflates compressed bundle bytes and applies what they contain
+// returns 1 once the whole bundle has been applied, 0 if more bytes are
+// needed, or -1 on failure
+static int inflateBundleBytes( unsigned char *inBytes, int inNumBytes ) {
+
+    // ignore anything past the end of the compressed data
+    if( bundleCompBytesSeen + inNumBytes > bundleCompSize ) {
+        inNumBytes = bundleCompSize - bundleCompBytesSeen;
+        }
+    bundleCompBytesSeen += inNumBytes;
+
+    unsigned char *chunk = new unsigned char[ BUNDLE_INFLATE_CHUNK_SIZE ];
+
+    int pos = 0;
+    int result = 0;
+
+    while( result == 0 && ! bundleInflateDone ) {
+        int numConsumed;
+
+        int numInflated =
+            stepZipDecompressStream( bundleInflateStream,
+                                     &( inBytes[pos] ), inNumBytes - pos,
+                                     &numConsumed,
+                                     chunk, BUNDLE_INFLATE_CHUNK_SIZE,
+                                     &bundleInflateDone );
+        if( numInflated < 0 ) {
+            printf( "Failed to decompress diff bundle\n" );
+            result = -1;
+            break;
+            }
+
+        pos += numConsumed;
+
+        if( numInflated > 0 ) {
+            bundleRawBytesSeen += numInflated;
+
+            bundlePendingBytes.appendArray( chunk, numInflated );
+
+            if( parseBundleBytes() == -1 ) {
+                result = -1;
+                }
+            }
+
+        if( numInflated < BUNDLE_INFLATE_CHUNK_SIZE && pos == inNumBytes ) {
+            // all input used and no output held back, need more input
+            break;
+            }
+        if( numInflated == 0 && numConsumed == 0 ) {
+            break;
+            }
+        }
+
+    delete [] chunk;
+
+    // hash after inflating (see computeFileSHA1)
+    SHA1_Update( &bundleCompHashContext, inBytes, inNumBytes );
+
+    if( result == -1 ) {
+        return -1;
+        }
+
+    if( bundleInflateDone ) {
+        // the zlib stream has checked itself
+
+        if( bundleParseState != parseDone ) {
+            printf( "Diff bundle data ended part way through\n" );
             return -1;
             }
+        if( bundleRawBytesSeen != bundleRawSize ) {
+            printf( "Diff bundle expected %d decompressed bytes, got %d\n",
+                    bundleRawSize, bundleRawBytesSeen );
+            return -1;
+            }
+        return 1;
+        }
 
-        printf( "Removing %d files\n", numRemovedFiles );
-                
-        for( int d=0; d<numRemovedFiles; d++ ) {
-                    
-            int fileNameLength = 
-                scanIntAndSkip( &nextScanPointer, &success );
-                    
-            if( !success ) {
-                printf( "Failed to parse removed file name length "
-                        "from diff bundle\n" );
-                dumpRawDataToFile( rawData, rawSize );
-                delete [] rawData;
-                return -1;
+    if( bundleCompBytesSeen == bundleCompSize ) {
+        printf( "Diff bundle compressed data ended early\n" );
+        return -1;
+        }
+
+    return 0;
+    }
+
+
+
+// feeds bytes of the bundle file as they arrive
+// returns 1 once the whole bundle has been applied, 0 if more bytes are
+// needed, or -1 on failure
+static int feedBundleBytes( unsigned char *inBytes, int inNumBytes ) {
+    if( inNumBytes == 0 ) {
+        return 0;
+        }
+
+    if( bundleOuterHeaderDone ) {
+        return inflateBundleBytes( inBytes, inNumBytes );
+        }
+
+    bundleOuterHeader.appendArray( (char*)inBytes, inNumBytes );
+
+    int headerLength = parseBundleOuterHeader();
+
+    if( headerLength == -1 ||
+        ( headerLength == 0 &&
+          bundleOuterHeader.size() > MAX_BUNDLE_OUTER_HEADER_LENGTH ) ) {
+        printf( "Failed to parse diff bundle\n" );
+        return -1;
+        }
+    if( headerLength == 0 ) {
+        return 0;
+        }
+
+    bundleOuterHeaderDone = true;
+
+    int numLeft = bundleOuterHeader.size() - headerLength;
+
+    int result = 0;
+
+    if( numLeft > 0 ) {
+        result = inflateBundleBytes(
+            (unsigned char *)bundleOuterHeader.getElement( headerLength ),
+            numLeft );
+        }
+
+    bundleOuterHeader.deleteAll();
+
+    return result;
+    }
+
+
+
+// cleans up after a bundle download ends
+// if it succeeded, files and dirs it lists for removal are removed
+// if it failed, files it replaced are restored from backups
+static void endBundle( char inSuccess ) {
+
+    clearEntry();
+
+    if( inSuccess ) {
+        // files before dirs, so dirs are empty by the time they're removed
+        for( int i=0; i<bundleRemovedFileList.size(); i++ ) {
+            File file( NULL, bundleRemovedFileList.getElementDirect( i ) );
+
+            if( file.exists() && ! file.isDirectory() ) {
+                file.remove();
                 }
-                    
-            char *fileName = new char[ fileNameLength + 1 ];
-                    
-            memcpy( fileName, nextScanPointer, fileNameLength );
-                    
-            fileName[ fileNameLength ] = '\0';
-                    
-            printf( "   %s\n", fileName );
-                    
+            }
+        for( int i=0; i<bundleRemovedDirList.size(); i++ ) {
+            File file( NULL, bundleRemovedDirList.getElementDirect( i ) );
+
+            if( file.exists() && file.isDirectory() ) {
+                file.remove();
+                }
+            }
+
+        // remove backup files if we can
+
+        for( int i=0; i<bundleBackupList.size(); i++ ) {
+            char *backName = bundleBackupList.getElementDirect( i );
+
+            if( remove( backName ) != 0 ) {
+                // can't remove
+                // save on list to remove later if postUpdate called
+                // (if postUpdate not call, just leave them)
+                FILE *postRemoveListFile =
+                    fopen( "postRemoveList.txt", "a" );
+                if( postRemoveListFile != NULL ) {
+                    fprintf( postRemoveListFile,
+                             "%s\n", backName );
+                    fclose( postRemoveListFile );
+                    }
+                }
+            }
+        }
+    else {
+        // restore from backups if possible
+
+        for( int i=0; i<bundleBackupList.size(); i++ ) {
+            char *backName = bundleBackupList.getElementDirect( i );
+            char *origName = stringDuplicate( backName );
+
+            char *bakStart = strstr( origName, ".bak" );
+
+            if( bakStart != NULL ) {
+                bakStart[0] = '\0';
+                }
+
+            printf( "Trying to restore %s from %s\n",
+                    origName, backName );
+
+            if( remove( origName ) != 0 ) {
+                printf( "    Failed to remove %s\n", origName );
+                }
+            if( rename( backName, origName ) != 0 ) {
+                printf( "    Failed to move %s to %s\n",
+                        backName, origName );
+                }
+            delete [] origName;
+            }
+
+        for( int i=0; i<bundleCreatedList.size(); i++ ) {
+            remove( bundleCreatedList.getElementDirect( i ) );
+            }
+        }
+
+    bundleBackupList.deallocateStringElements();
+    bundleCreatedList.deallocateStringElements();
+    bundleRemovedFileList.deallocateStringElements();
+    bundleRemovedDirList.deallocateStringElements();
+
+
+    if( bundleInflateStream != NULL ) {
+        endZipDecompressStream( bundleInflateStream );
+        bundleInflateStream = NULL;
+        }
 
-            nextScanPointer = 
-                &( nextScanPointer[ fileNameLength + 1 ] );
-                    
-            File fileToRemove( NULL, fileName );
+    bundleOuterHeader.deleteAll();
+    bundlePendingBytes.deleteAll();
 
-            if( fileToRemove.exists() && ! fileToRemove.isDirectory() ) {
-                
-                fileToRemove.remove();
-                }
-                    
-                    
-            delete [] fileName;
-            }
+    if( bundleURL != NULL ) {
+        delete [] bundleURL;
+        bundleURL = NULL;
+        }
 
+    bundleActive = false;
+    }
 
 
-        int numRemovedDirs = scanIntAndSkip( &nextScanPointer, &success );
-                    
-        if( !success ) {
-            printf( "Failed to parse removed file count from diff bundle\n" );
-            dumpRawDataToFile( rawData, rawSize );
-            delete [] rawData;
-            return -1;
-            }
 
-        printf( "Removing %d dirs\n", numRemovedDirs );
-                
-        for( int d=0; d<numRemovedDirs; d++ ) {
-                    
-            int fileNameLength = 
-                scanIntAndSkip( &nextScanPointer, &success );
-                    
-            if( !success ) {
-                printf( "Failed to parse removed dir name length "
-                        "from diff bundle\n" );
-                dumpRawDataToFile( rawData, rawSize );
-                delete [] rawData;
-                return -1;
-                }
-                    
-            char *fileName = new char[ fileNameLength + 1 ];
-                    
-            memcpy( fileName, nextScanPointer, fileNameLength );
-                    
-            fileName[ fileNameLength ] = '\0';
-                    
-            printf( "   %s\n", fileName );
-                    
+// starts downloading a bundle from inURL and applying it as it arrives
+static void startBundleDownload( const char *inURL ) {
+    if( bundleActive ) {
+        endBundle( false );
+        }
 
-            nextScanPointer = 
-                &( nextScanPointer[ fileNameLength + 1 ] );
-                    
-            File dirToRemove( NULL, fileName );
+    bundleURL = stringDuplicate( inURL );
 
-            if( dirToRemove.exists() && dirToRemove.isDirectory() ) {
-                
-                dirToRemove.remove();
-                }
-                    
-                    
-            delete [] fileName;
-            }
+    bundleBytesReceived = 0;
+    bundleRequestStart = 0;
+    bundleRequestBytes = 0;
+    bundleRequestChecked = false;
+    bundleBytesToSkip = 0;
 
+    bundleOuterHeaderDone = false;
+    bundleVersion = 1;
+    bundleRawSize = 0;
+    bundleCompSize = 0;
+    bundleCompBytesSeen = 0;
+    bundleRawBytesSeen = 0;
 
+    bundleInflateStream = startZipDecompressStream();
+    bundleInflateDone = false;
 
+    SHA1_Init( &bundleCompHashContext );
 
+    bundleParseState = parseRemovedFileCount;
+    bundleItemsLeft = 0;
 
+    bundleActive = true;
+    lastBundleResult = 0;
 
+    webHandle = startWebStreamRequest( bundleURL );
+    webHandleStartTime = Time::getCurrentTime();
+    }
 
 
 
+// take another non-blocking step in a bundle download
+// return 1 if bundle applied
+// return -1 if download or applying hit an error
+// return 0 if still in-progress
+static int stepBundleDownload() {
 
-                
-        int numDirs = scanIntAndSkip( &nextScanPointer, &success );
-                    
-        if( !success ) {
-            printf( "Failed to parse dir count from diff bundle\n" );
-            dumpRawDataToFile( rawData, rawSize );
-            delete [] rawData;
-            return -1;
-            }
+    if( ! bundleActive ) {
+        return lastBundleResult;
+        }
 
-        printf( "Creating %d new directories\n", numDirs );
-                
-        for( int d=0; d<numDirs; d++ ) {
-                    
-            int fileNameLength = 
-                scanIntAndSkip( &nextScanPointer, &success );
-                    
-            if( !success ) {
-                printf( "Failed to parse directory name length "
-                        "from diff bundle\n" );
-                dumpRawDataToFile( rawData, rawSize );
-                delete [] rawData;
-                return -1;
-                }
-                    
-            char *fileName = new char[ fileNameLength + 1 ];
-                    
-            memcpy( fileName, nextScanPointer, fileNameLength );
-                    
-            fileName[ fileNameLength ] = '\0';
-                    
-            printf( "   %s\n", fileName );
-                    
+    if( bundleInflateStream == NULL ) {
+        endBundle( false );
+        lastBundleResult = -1;
+        return -1;
+        }
 
-            nextScanPointer = 
-                &( nextScanPointer[ fileNameLength + 1 ] );
-                    
-            File dirFile( NULL, fileName );
+    int stepResult = stepWebRequest( webHandle );
 
-            if( dirFile.exists() ) {
-                printf( "Directory exists %s\n",
-                        fileName );
-                }
-            else {
-                char made = Directory::makeDirectory( &dirFile );
-                    
-                if( !made ) {
-                    printf( "Failed to make directory %s\n",
-                            fileName );
-                            
-                    delete [] fileName;
-                            
-                    dumpRawDataToFile( rawData, rawSize );
-                    delete [] rawData;
-                    return -1;
-                    }
+    int result = 0;
+
+    int numBytes;
+    unsigned char *bytes = getWebStreamBytes( webHandle, &numBytes );
+
+    if( bytes != NULL ) {
+
+        if( ! bundleRequestChecked ) {
+            bundleRequestChecked = true;
+
+            if( bundleRequestStart > 0 &&
+                getWebResultStatus( webHandle ) != 206 ) {
+
+                printf( "Server ignored range request, skipping the "
+                        "%d bytes we already have\n", bundleRequestStart );
+
+                bundleBytesToSkip = bundleRequestStart;
                 }
-                    
-                    
-            delete [] fileName;
             }
-                
 
+        int numToSkip = bundleBytesToSkip;
+        if( numToSkip > numBytes ) {
+            numToSkip = numBytes;
+            }
+        bundleBytesToSkip -= numToSkip;
 
-        int numFiles = scanIntAndSkip( &nextScanPointer, &success );
+        int numNew = numBytes - numToSkip;
 
-        if( !success ) {
-            printf( "Failed to parse file count from diff bundle\n" );
-                    
-            dumpRawDataToFile( rawData, rawSize );
-            delete [] rawData;
-            return -1;
-            }                
+        bundleBytesReceived += numNew;
+        bundleRequestBytes += numNew;
 
-        printf( "Updating %d files\n", numFiles );
-        
-        char fileCreationFailed = false;
-        
-        SimpleVector<char*> backupList;
+        result = feedBundleBytes( &( bytes[ numToSkip ] ), numNew );
 
-        for( int f=0; f<numFiles; f++ ) {
-                    
-            int fileNameLength =
-                scanIntAndSkip( &nextScanPointer, &success );
-                    
-            if( !success ) {
-                printf( "Failed to parse file name length "
-                        "from diff bundle\n" );
-                        
-                dumpRawDataToFile( rawData, rawSize );
-                delete [] rawData;
-                return -1;
-                }
-                    
-            char *fileName = new char[ fileNameLength + 1 ];
-                    
-            memcpy( fileName, nextScanPointer, fileNameLength );
-                    
-            fileName[ fileNameLength ] = '\0';
-                    
-            printf( "   %s\n", fileName );
+        delete [] bytes;
+        }
 
-            nextScanPointer = 
-                &( nextScanPointer[ fileNameLength + 1 ] );
+    if( result == 0 && stepResult != 0 ) {
+        // connection ended before the bundle did
 
-            // single # separates the file size from the file data
-            // this skips it
-            int fileSize = 
-                scanIntAndSkip( &nextScanPointer, &success );
-                    
-            if( !success ) {
-                printf( "Failed to parse file size "
-                        "from diff bundle\n" );
-                delete [] fileName;
-                        
-                dumpRawDataToFile( rawData, rawSize );
-                delete [] rawData;
-                return -1;
-                }
-                    
+        int status = getWebResultStatus( webHandle );
 
-            File targetFile( NULL, fileName );
+        clearWebRequest( webHandle );
+        webHandle = -1;
 
-            char *backupName = NULL;
-                    
-            if( targetFile.exists() ) {
-                backupName = autoSprintf( "%s.bak", fileName );
+        if( bundleRequestBytes > 0 && status < 400 ) {
+            // made progress before it dropped
+            // resume where we left off
+            printf( "Download interrupted after %d bytes, resuming from "
+                    "%s\n", bundleBytesReceived, bundleURL );
 
-                printf( "File %s exists, moving temporariliy to %s\n",
-                        fileName, backupName );
-                
-                File backFile( NULL, backupName );
-                
-                if( backFile.exists() ) {
-                    printf( "Backup file %s already exists, skipping move\n",
-                            backupName );
-                    }
-                else {
-                    int result = rename( fileName, backupName );
-                
-                    if( result != 0 ) {
-                        printf( "Moving backup to %s failed\n",
-                                backupName );
-                        fileCreationFailed = true;
-                        delete [] fileName;
-                        delete [] backupName;
-                        printf( "Ending update process\n" );
-                        break;
-                        }
-                    else {
-                        backupList.push_back( stringDuplicate( backupName ) );
-                        }
-                    }
-                }
-            else {
-                if( strstr( fileName, "/" ) != NULL ) {
-                    // file name contains a path
-                    
-                    // make sure the dir exists
-                    char *dirName = stringDuplicate( fileName );
-                    
-                    // find last / and terminate there to get dir name
-                    int len = strlen( dirName );
-                    for( int i=len-1; i>=0; i-- ) {
-                        if( dirName[i] == '/' ) {
-                            dirName[i] = '\0';
-                            break;
-                            }
-                        }
-                    File dirFile( NULL, dirName );
-                    
-                    if( ! dirFile.exists() ) {
-                        printf( "Making necessary directory %s for "
-                                "new file %s\n",
-                                dirName, fileName );
-                        
-                        char made = Directory::makeDirectory( &dirFile );
-                    
-                        if( !made ) {
-                            printf( "Failed to make directory %s\n",
-                                    dirName );
-                            
-                            delete [] dirName;
-                            printf( "Ending update process\n" );
-                            fileCreationFailed = true;
-                            break;
-                            }
-                        }
-                    delete [] dirName;
-                    }
-                
-                }
-            
+            bundleRequestStart = bundleBytesReceived;
+            bundleRequestBytes = 0;
+            bundleRequestChecked = false;
+            bundleBytesToSkip = 0;
 
-            FILE *file = fopen( fileName, "wb" );
-                    
-                    
-            if( file == NULL ) {
-                printf( "Failed to open file %s for writing\n",
-                        fileName );
-                fileCreationFailed = true;
-                delete [] fileName;
-                if( backupName != NULL ) {
-                    delete [] backupName;
-                    }
-                printf( "Ending update process\n" );
-                break;
-                }
-            else {
-                int numWritten = 
-                    fwrite( (unsigned char *)nextScanPointer, 
-                            1, fileSize, file );
-                if( numWritten != fileSize ) {
-                    printf( "Failed to write %d bytes to file  %s\n",
-                            fileSize, fileName );
-                    }
-                        
-                fclose( file );
-                }
-                    
-                    
-            if( backupName != NULL ) {
-                copyPermissions( backupName, fileName );                        
-                        
-                delete [] backupName;
-                }
-            else {
-                // try to set permissions manually on mac for main app exe
-                if( strcmp( PLATFORM_CODE, "mac" ) == 0 ) {
-                    if( strstr( fileName, "Contents/MacOS/" ) != NULL ) {
-                        const char *mode = "0755";
-                        int modeInt = strtol( mode, 0, 8 );
-                        chmod( fileName, modeInt );
-                        }
-                    }
-                }
-            
+            webHandle = startWebStreamRequest( bundleURL,
+                                               bundleRequestStart );
+            return 0;
+            }
 
-            if( currentUpdateUniversal &&
-                WINDOWS_LINE_ENDS &&
-                strstr( fileName, ".txt" ) != NULL ) {
-                char *contents = targetFile.readFileContents();
-                
-                if( contents != NULL ) {
-                    
-                    if( strstr( contents, "\n" ) != NULL &&
-                        strstr( contents, "\r\n" ) == NULL ) {
-                        // contains at least one unix-style line ending
-                        // and no \r, which is part of windows \r\n
-                        // and other platforms, or ill-formed, line endings
+        printf( "Download failed after %d bytes\n", bundleBytesReceived );
+        result = -1;
+        }
 
+    if( result != 0 ) {
+        printDownloadStats( bundleBytesReceived );
 
-                        // replaceAll too slow in this case
-                        // some files have 20k + newlines to replace
-                        SimpleVector<char> newContents;
-                        
-                        int oldLen = strlen( contents );
-                        
-                        for( int i=0; i<oldLen; i++ ) {
-                            if( contents[i] == '\n' ) {
-                                newContents.push_back( '\r' );
-                                newContents.push_back( '\n' );
-                                }
-                            else {
-                                newContents.push_back( contents[i] );
-                                }
-                            }
-                        
-                        char *convertedContents = 
-                            newContents.getElementString();
-                        
-                        targetFile.writeToFile( convertedContents );
-                        
-                        delete [] convertedContents;
-                        }
-                    delete [] contents;
-                    }
-                }
+        if( result == 1 ) {
+            unsigned char digest[ SHA1_DIGEST_LENGTH ];
+            SHA1_Final( digest, &bundleCompHashContext );
 
-            delete [] fileName;
+            char *hash = hexEncode( digest, SHA1_DIGEST_LENGTH );
 
-                
-            nextScanPointer = &( nextScanPointer[ fileSize ] );
+            AppLog::infoF( "Received compressed data with SHA1 = %s\n",
+                           hash );
+            delete [] hash;
+
+            printf( "Update complete\n" );
             }
-        
-        if( fileCreationFailed ) {
-            writeError = true;
-            
-            // restore from backups if possible
-            
-            
-            for( int i=0; i<backupList.size(); i++ ) {
-                char *backName = backupList.getElementDirect( i );
-                char *origName = stringDuplicate( backName );
-                
-                char *bakStart = strstr( origName, ".bak" );
-                
-                if( bakStart != NULL ) {
-                    bakStart[0] = '\0';
-                    }
-                
-                printf( "Trying to restore %s from %s\n",
-                        origName, backName );
-                       
-                if( remove( origName ) != 0 ) {
-                    printf( "    Failed to remove %s\n", origName );
-                    }
-                if( rename( backName, origName ) != 0 ) {
-                    printf( "    Failed to move %s to %s\n", 
-                            backName, origName );
-                    }
-                delete [] origName;
-                }
 
-            backupList.deallocateStringElements();
-            
-            return -1;
+        if( webHandle != -1 ) {
+            clearWebRequest( webHandle );
+            webHandle = -1;
             }
-        
 
-        // success
-        // remove backup files if we can
+        endBundle( result == 1 );
+
+        lastBundleResult = result;
+        }
+
+    return result;
+    }
+
+
+
+static void clearMirrors() {
+    for( int i=0; i<mirrors.size(); i++ ) {
+        MirrorList *l = mirrors.getElement( i );
         
-        for( int i=0; i<backupList.size(); i++ ) {
-            char *backName = backupList.getElementDirect( i );
-            
-            if( remove( backName ) != 0 ) {
-                // can't remove
-                // save on list to remove later if postUpdate called
-                // (if postUpdate not call, just leave them)
-                FILE *postRemoveListFile =
-                    fopen( "postRemoveList.txt", "a" );
-                if( postRemoveListFile != NULL ) {    
-                    fprintf( postRemoveListFile, 
-                             "%s\n", backName );
-                    fclose( postRemoveListFile );
-                    }
-                }
-            }
         
-        backupList.deallocateStringElements();
+        for( int j=0; j<l->mirrorURLS.size(); j++ ) {
+            delete [] l->mirrorURLS.getElementDirect( j );
+            }        
+        }
+    mirrors.deleteAll();
+    }
 
 
-                
-        delete [] rawData;
-        printf( "Update complete\n" );
-        return 1;
-        }
-    else {
-        printf( "Failed to parse diff bundle\n" );
-        delete [] result;
+
+// called after a bundle failed because a delta's base didn't match
+// (the failed bundle has already been rolled back by endBundle)
+// asks the server again for full-file bundles, starting from the
+// version that we've reached so far
+// return 0 if the new request started
+// return -1 if we were already asking for full-file bundles
+static int fallBackToFullBundles() {
+    deltaBaseMismatch = false;
+
+    if( requestBundleFormat == 1 ) {
         return -1;
         }
 
+    printf( "Delta base mismatch, requesting full-file bundles instead\n" );
+
+    requestBundleFormat = 1;
+
+    if( batchMirrorUpdate && batchStepsDone > 0 ) {
+        // earlier steps were applied
+        oldVersionNumber = 
+            mirrors.getElement( batchStepsDone - 1 )->version;
+        }
+
+    clearMirrors();
+    batchMirrorUpdate = false;
+
+    if( webHandle != -1 ) {
+        clearWebRequest( webHandle );
+        webHandle = -1;
+        }
+
+    startUpdateCheck();
+
+    return 0;
     }
 
-    
 
 
 static int batchMirrorStep() {
 
     if( batchStepsDone < mirrors.size() ) {
         
-        if( webHandle != -1 ) {
+        if( bundleActive ) {
             
-            int result = stepWebRequest( webHandle );
+            int result = stepBundleDownload();
 
             if( result == 1 ) {
-                result = applyUpdateFromWebResult();
-                
-                clearWebRequest( webHandle );
-                webHandle = -1;
-            
-                if( result == 1 ) {
-                    // start next step on next step() call
-                    batchStepsDone ++;
-                    return 0;
-                    }
+                // start next step on next step() call
+                batchStepsDone ++;
+                return 0;
                 }
             
             if( result == -1 ) {
+                if( deltaBaseMismatch ) {
+                    return fallBackToFullBundles();
+                    }
                 if( writeError ) {
                     // stop immediately, don't try another mirror
-                    clearWebRequest( webHandle );
-                    webHandle = -1;
                     return -1;
                     }
                 MirrorList *list = mirrors.getElement( batchStepsDone );
@@ -786,8 +1571,6 @@ static int batchMirrorStep() {
                     
                     list->currentMirror ++;
                     
-                    clearWebRequest( webHandle );
-                    webHandle = -1;
                     // start request next step
                     return 0;
                     }
@@ -803,9 +1586,8 @@ static int batchMirrorStep() {
             
             if( list->currentMirror < list->mirrorURLS.size() ) {
 
-                if( strstr( list->mirrorURLS.getElementDirect( 
-                                list->currentMirror ),
-                            "_all.dbz" ) != NULL ) {
+                if( isUniversalBundleURL( list->mirrorURLS.getElementDirect( 
+                                              list->currentMirror ) ) ) {
                     
                     currentUpdateUniversal = true;
                     }
@@ -819,13 +1601,8 @@ static int batchMirrorStep() {
                         list->mirrorURLS.getElementDirect( 
                             list->currentMirror ) );
                 
-                webHandle = 
-                    startWebRequest( 
-                        "GET", 
-                        list->mirrorURLS.getElementDirect( 
-                        list->currentMirror ), 
-                        NULL );
-                webHandleStartTime = Time::getCurrentTime();
+                startBundleDownload( list->mirrorURLS.getElementDirect( 
+                                         list->currentMirror ) );
 
                 updateSize = list->size;
                 return 0;
@@ -855,6 +1632,16 @@ int stepUpdate() {
         return batchMirrorStep();
         }
 
+    if( updateSize != -1 ) {
+        // direct update from this server
+        int result = stepBundleDownload();
+
+        if( result == -1 && deltaBaseMismatch ) {
+            return fallBackToFullBundles();
+            }
+        return result;
+        }
+
     int result = stepWebRequest( webHandle );
 
     if( result == 1 ) {
@@ -919,8 +1706,8 @@ int stepUpdate() {
 
                             char bundleUniversal = false;
                             
-                            if( strstr( list.mirrorURLS.getElementDirect( 0 ),
-                                        "_all.dbz" ) != NULL ) {
+                            if( isUniversalBundleURL( 
+                                    list.mirrorURLS.getElementDirect( 0 ) ) ) {
                                 bundleUniversal = true;
                                 }
                             
@@ -994,35 +1781,22 @@ int stepUpdate() {
                 clearWebRequest( webHandle );
                 
                 char *fullURL = autoSprintf( "%s?action=get_update"
-                                             "&platform=%s&old_version=%d",
+                                             "&platform=%s&old_version=%d"
+                                             "&bundle_format=%d",
                                              updateServerURL, platformCode,
-                                             oldVersionNumber );
+                                             oldVersionNumber,
+                                             requestBundleFormat );
                 
                 
                 printf( "Downloading update from %s\n", fullURL );
                 
-                webHandle = startWebRequest( "GET", fullURL, NULL );
-                webHandleStartTime = Time::getCurrentTime();
+                startBundleDownload( fullURL );
 
                 delete [] fullURL;
             
                 return 0;
                 }
             }
-        else if( updateProgressCompleteSteps < 1 ) {
-            // don't process data this step, wait until next step
-            updateProgressCompleteSteps++;
-            return 0;
-            }
-        else {
-            // have update itself AND we've let one step go
-            // by for our final update progress to post
-
-            
-            printf( "Update download complete\n" );
-            
-            return applyUpdateFromWebResult();
-            }
         }
     
     return result;
@@ -1039,12 +1813,11 @@ float getUpdateProgress() {
         if( updateSize > 0 ) {
             float progress = 0;
             
-            if( webHandle != -1 ) {
-                progress = getWebProgressSize( webHandle ) / (float)updateSize;
+            if( bundleActive ) {
+                progress = bundleBytesReceived / (float)updateSize;
                 }
             
             if( progress > 1 ) {
-                // getWebProgressSize includes headers
                 progress = 1;
                 }
             
@@ -1057,10 +1830,9 @@ float getUpdateProgress() {
         
         if( updateSize > 0 ) {
             float progress = 
-                getWebProgressSize( webHandle ) / (float)updateSize;
+                bundleBytesReceived / (float)updateSize;
         
             if( progress > 1 ) {
-                // getWebProgressSize includes headers
                 progress = 1;
                 }
             
@@ -1076,7 +1848,15 @@ float getUpdateProgress() {
 
 
 void clearUpdate() {
-    clearWebRequest( webHandle );
+    if( webHandle != -1 ) {
+        clearWebRequest( webHandle );
+        webHandle = -1;
+        }
+    
+    if( bundleActive ) {
+        // cancelled part way, put back what we replaced
+        endBundle( false );
+        }
 
     if( updateServerURL != NULL ) {
         delete [] updateServerURL;
@@ -1084,16 +1864,7 @@ void clearUpdate() {
     
     updateServerURL = NULL;
 
-
-    for( int i=0; i<mirrors.size(); i++ ) {
-        MirrorList *l = mirrors.getElement( i );
-        
-        
-        for( int j=0; j<l->mirrorURLS.size(); j++ ) {
-            delete [] l->mirrorURLS.getElementDirect( j );
-            }        
-        }
-    mirrors.deleteAll();
+    clearMirrors();
     }
 
 
@@ -1,10 +1,24 @@
 
 
 #include "minorGems/io/file/File.h"
+#include "minorGems/io/file/DirectoryWalker.h"
 #include "minorGems/formats/encodingUtils.h"
 #include "minorGems/crypto/hashes/sha1.h"
+#include "minorGems/system/ThreadPool.h"
+
+#include "binaryDelta.h"
 
 #include <stdlib.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 
 // strips off the first step of a path
@@ -38,6 +52,400 @@ static char *getSubdirPath( char *inFullFilePath ) {
 
 
 
+// what we know about one file in a scanned tree
+typedef struct FileRecord {
+        File *file;
+        
+        // path with the tree's root dir stripped off, used to match
+        // files between the old and new trees
+        char *subdirName;
+        
+        char isDir;
+        
+        // from stat, these key digest cache entries
+        int64_t size;
+        int64_t modTime;
+        uint64_t inode;
+        
+        char digestKnown;
+        unsigned char digest[ SHA1_DIGEST_LENGTH ];
+    } FileRecord;
+
+
+
+static int recordCompare( const void *inA, const void *inB ) {
+    FileRecord *a = (FileRecord *)inA;
+    FileRecord *b = (FileRecord *)inB;
+    
+    return strcmp( a->subdirName, b->subdirName );
+    }
+
+
+
+// returns NULL if not found
+static FileRecord *findRecord( FileRecord *inRecords, int inNumRecords,
+                               const char *inSubdirName ) {
+    FileRecord key;
+    key.subdirName = (char *)inSubdirName;
+    
+    return (FileRecord *)bsearch( &key, inRecords, inNumRecords, 
+                                  sizeof( FileRecord ), recordCompare );
+    }
+
+
+
+// walks a tree (to depth 100), making a File and a record for each entry
+// file info comes from the walk's threads instead of a stat per file
+// outFiles are in walk order, with directories before their contents
+// records are sorted by subdirName
+static FileRecord *scanTree( const char *inDirName, 
+                             File ***outFiles, int *outNumFiles ) {
+    
+    DirectoryWalker walker( -1, true );
+    
+    walker.walk( inDirName, 100 );
+    walker.sortEntries();
+    
+    int numFiles = walker.getNumEntries();
+    
+    File **files = new File*[ numFiles ];
+    FileRecord *records = new FileRecord[ numFiles ];
+    
+    for( int i=0; i<numFiles; i++ ) {
+        DirectoryEntry *e = walker.getEntry( i );
+        
+        char *fileName = DirectoryWalker::getFullPath( e );
+        
+        files[i] = new File( NULL, fileName );
+
+        FileRecord *r = &( records[i] );
+        
+        r->file = files[i];
+        r->subdirName = getSubdirPath( fileName );
+        r->isDir = e->isDirectory;
+        r->size = e->size;
+        r->modTime = e->modTime;
+        r->inode = e->inode;
+        r->digestKnown = false;
+
+        delete [] fileName;
+        }
+    
+    qsort( records, numFiles, sizeof( FileRecord ), recordCompare );
+    
+    *outFiles = files;
+    *outNumFiles = numFiles;
+    
+    return records;
+    }
+
+
+
+static void deleteRecords( FileRecord *inRecords, int inNumRecords ) {
+    for( int i=0; i<inNumRecords; i++ ) {
+        delete [] inRecords[i].subdirName;
+        }
+    delete [] inRecords;
+    }
+
+
+
+// digest cache for a tree lives beside it, as dirName.digestCache
+static char *getDigestCachePath( const char *inDirName ) {
+    char *dirName = stringDuplicate( inDirName );
+    
+    int len = strlen( dirName );
+    
+    while( len > 1 && dirName[ len - 1 ] == Path::getDelimeter() ) {
+        dirName[ len - 1 ] = '\0';
+        len--;
+        }
+    
+    char *cachePath = autoSprintf( "%s.digestCache", dirName );
+    
+    delete [] dirName;
+    
+    return cachePath;
+    }
+
+
+
+static const char *digestCacheHeader = "diffBundleDigestCache 1";
+
+
+
+// Each cache line is
+//   size modTime inode sha1 pathLength path
+// A digest is only reused if size, modTime and inode all still match.
+static int loadDigestCache( const char *inCachePath,
+                            FileRecord *inRecords, int inNumRecords ) {
+    
+    File cacheFile( NULL, inCachePath );
+    
+    char *cont = cacheFile.readFileContents();
+    
+    if( cont == NULL ) {
+        return 0;
+        }
+    
+    int numUsed = 0;
+
+    int headerLength = strlen( digestCacheHeader );
+    
+    if( strncmp( cont, digestCacheHeader, headerLength ) != 0 ) {
+        printf( "Ignoring digest cache %s with unknown format\n",
+                inCachePath );
+        delete [] cont;
+        return 0;
+        }
+    
+    char *readPos = &( cont[ headerLength ] );
+    
+    // parse within known bounds, since scanning to the end of the
+    // buffer on each line would be quadratic in the cache size
+    char *end = &( readPos[ strlen( readPos ) ] );
+    
+    while( true ) {
+        char *next;
+        
+        long long size = strtoll( readPos, &next, 10 );
+        if( next == readPos ) {
+            break;
+            }
+        readPos = next;
+        
+        long long modTime = strtoll( readPos, &next, 10 );
+        if( next == readPos ) {
+            break;
+            }
+        readPos = next;
+        
+        unsigned long long inode = strtoull( readPos, &next, 10 );
+        if( next == readPos ) {
+            break;
+            }
+        readPos = next;
+        
+        while( readPos < end && isspace( *readPos ) ) {
+            readPos++;
+            }
+        
+        char hexDigest[ 2 * SHA1_DIGEST_LENGTH + 1 ];
+        int digestLength = 0;
+        
+        while( readPos < end && ! isspace( *readPos ) &&
+               digestLength < 2 * SHA1_DIGEST_LENGTH ) {
+            hexDigest[ digestLength ] = *readPos;
+            digestLength++;
+            readPos++;
+            }
+        hexDigest[ digestLength ] = '\0';
+        
+        long pathLength = strtol( readPos, &next, 10 );
+        if( next == readPos ) {
+            break;
+            }
+        readPos = next;
+        
+        // one space separates the length from the path
+        if( readPos == end || *readPos != ' ' ) {
+            break;
+            }
+        readPos++;
+        
+        if( pathLength < 0 || pathLength > end - readPos ) {
+            break;
+            }
+        
+        char *path = new char[ pathLength + 1 ];
+        memcpy( path, readPos, pathLength );
+        path[ pathLength ] = '\0';
+        
+        readPos = &( readPos[ pathLength ] );
+        
+        
+        FileRecord *r = findRecord( inRecords, inNumRecords, path );
+        
+        delete [] path;
+
+        if( r != NULL && ! r->isDir && 
+            r->size == size && r->modTime == modTime && 
+            r->inode == inode &&
+            digestLength == 2 * SHA1_DIGEST_LENGTH ) {
+            
+            unsigned char *digest = hexDecode( hexDigest );
+            
+            if( digest != NULL ) {
+                memcpy( r->digest, digest, SHA1_DIGEST_LENGTH );
+                r->digestKnown = true;
+                numUsed++;
+                
+                delete [] digest;
+                }
+            }
+        }
+    
+    delete [] cont;
+    
+    return numUsed;
+    }
+
+
+
+static void saveDigestCache( const char *inCachePath,
+                             FileRecord *inRecords, int inNumRecords ) {
+    
+    FILE *cacheFile = fopen( inCachePath, "wb" );
+    
+    if( cacheFile == NULL ) {
+        printf( "Failed to open digest cache %s for writing\n", 
+                inCachePath );
+        return;
+        }
+    
+    // a file modified later in this same second could keep its size and
+    // mod time, so don't vouch for anything that new
+    int64_t now = time( NULL );
+    
+    fprintf( cacheFile, "%s\n", digestCacheHeader );
+    
+    for( int i=0; i<inNumRecords; i++ ) {
+        FileRecord *r = &( inRecords[i] );
+        
+        if( r->digestKnown && r->modTime < now ) {
+            char *hexDigest = hexEncode( r->digest, SHA1_DIGEST_LENGTH );
+            
+            fprintf( cacheFile, "%lld %lld %llu %s %d %s\n",
+                     (long long)r->size, (long long)r->modTime, 
+                     (unsigned long long)r->inode, hexDigest,
+                     (int)strlen( r->subdirName ), r->subdirName );
+            
+            delete [] hexDigest;
+            }
+        }
+    
+    fclose( cacheFile );
+    }
+
+
+
+// returns true on success
+static char hashFile( FileRecord *inRecord ) {
+    
+    char *fileName = inRecord->file->getFullFileName();
+    
+    SHA_CTX context;
+    SHA1_Init( &context );
+    
+    // hash through a scratch buffer (see computeFileSHA1) small enough
+    // to stay in cache
+    int chunkSize = 65536;
+    unsigned char *chunk = new unsigned char[ chunkSize ];
+    
+    char success = false;
+
+    #ifndef WIN32
+    
+    int fd = open( fileName, O_RDONLY );
+    
+    if( fd >= 0 ) {
+        
+        if( inRecord->size == 0 ) {
+            success = true;
+            }
+        else {
+            void *map = mmap( NULL, inRecord->size, PROT_READ, MAP_PRIVATE,
+                              fd, 0 );
+        
+            if( map != MAP_FAILED ) {
+                madvise( map, inRecord->size, MADV_SEQUENTIAL );
+            
+                unsigned char *data = (unsigned char *)map;
+            
+                for( int64_t pos = 0; pos < inRecord->size; 
+                     pos += chunkSize ) {
+                    
+                    int thisChunk = chunkSize;
+                    if( inRecord->size - pos < thisChunk ) {
+                        thisChunk = inRecord->size - pos;
+                        }
+                
+                    memcpy( chunk, &( data[pos] ), thisChunk );
+                    SHA1_Update( &context, chunk, thisChunk );
+                    }
+            
+                munmap( map, inRecord->size );
+                success = true;
+                }
+            }
+        close( fd );
+        }
+    
+    #else
+    
+    FILE *file = fopen( fileName, "rb" );
+    
+    if( file != NULL ) {
+        int64_t total = 0;
+        
+        int numRead = fread( chunk, 1, chunkSize, file );
+        
+        while( numRead > 0 ) {
+            SHA1_Update( &context, chunk, numRead );
+            total += numRead;
+            numRead = fread( chunk, 1, chunkSize, file );
+            }
+        
+        success = ( total == inRecord->size );
+        
+        fclose( file );
+        }
+
+    #endif
+
+    SHA1_Final( inRecord->digest, &context );
+
+    if( !success ) {
+        printf( "Failed to read %s for hashing\n", fileName );
+        }
+    
+    inRecord->digestKnown = success;
+
+    delete [] chunk;
+    delete [] fileName;
+    
+    return success;
+    }
+
+
+
+static void hashFileJob( void *inRecord ) {
+    hashFile( (FileRecord *)inRecord );
+    }
+
+
+
+// hashes the records in parallel, one job per file
+static void hashRecords( SimpleVector<FileRecord *> *inRecords ) {
+    if( inRecords->size() == 0 ) {
+        return;
+        }
+    
+    ThreadPool pool;
+
+    printf( "Hashing %d files on %d threads...\n", inRecords->size(),
+            pool.getNumThreads() );
+
+    for( int i=0; i<inRecords->size(); i++ ) {
+        pool.addJob( hashFileJob, inRecords->getElementDirect( i ) );
+        }
+    
+    pool.waitForAllJobs();
+    }
+
+
+
+
 static void bundleFileList( File **inFiles, int inNumFiles,
                             SimpleVector<unsigned char> *inFileDataBuffer ) {
 
@@ -69,11 +477,25 @@ static void bundleFileList( File **inFiles, int inNumFiles,
 
 
 
+// Deltas against the old version of a file are only worth sending when
+// they are this fraction of the full file size or smaller.
+#define MAX_DELTA_FRACTION 0.75
+
+
+
+// version 1 bundles hold every file in full
+// version 2 bundles can hold binary deltas against the old file, and carry
+// SHA1 digests so clients can verify each file they rebuild
+//
+// inOldFiles[i] is the old version of inFiles[i], or NULL if it is new.
+// inOldFiles can be NULL if there are no old versions.
 static void bundleFiles( File **inFilesToRemove, int inNumFilesToRemove,
                          File **inDirsToRemove, int inNumDirsToRemove,
                          File **inDirs, int inNumDirs,
                          File **inFiles, int inNumFiles,
-                         char *inDBZTargetFile ) {
+                         char *inDBZTargetFile,
+                         int inBundleVersion = 1,
+                         File **inOldFiles = NULL ) {
 
     SimpleVector<unsigned char> fileDataBuffer;
     
@@ -98,50 +520,133 @@ static void bundleFiles( File **inFilesToRemove, int inNumFilesToRemove,
     delete [] fileCount;
     
 
+    int numDeltas = 0;
+    
     for( int i=0; i<inNumFiles; i++ ) {
         char *fileName = inFiles[i]->getFullFileName();
 
         char *fileSubdirName = getSubdirPath( fileName );
         int size = inFiles[i]->getLength();
         
-        
-        // use # as separator before file data instead of space
-        // because when parsing later, sscanf will scan multiple spaces
-        // (for example, spaces at the start of the file data itself) as 
-        // a single space, thus potentially eating part of the file data.
-        // But even if the file data starts with '#', we'll be okay here,
-        // because we can sscanf just a single # after the file size number.
-        char *header = autoSprintf( "%d %s %d#",
-                                    strlen( fileSubdirName ),
-                                    fileSubdirName,
-                                    size );
-        fileDataBuffer.appendArray( (unsigned char*)header, strlen( header ) );
-        delete [] header;
-        
         int contentLength;
         unsigned char *contents = 
             inFiles[i]->readFileContents( &contentLength );
         
-        if( contents != NULL && contentLength == size ) {
-            fileDataBuffer.appendArray( contents, contentLength );
-            }
-        else {
+        if( contents == NULL || contentLength != size ) {
             printf( "Reading file contents of %s failed, or expected size "
                     "%d did not match actual size %d\n",
                     fileName, size, contentLength );
             }
         
+        
+        if( inBundleVersion == 1 ) {
+            
+            // use # as separator before file data instead of space
+            // because when parsing later, sscanf will scan multiple spaces
+            // (for example, spaces at the start of the file data itself) as 
+            // a single space, thus potentially eating part of the file data.
+            // But even if the file data starts with '#', we'll be okay here,
+            // because we can sscanf just a single # after the file size 
+            // number.
+            char *header = autoSprintf( "%d %s %d#",
+                                        strlen( fileSubdirName ),
+                                        fileSubdirName,
+                                        size );
+            fileDataBuffer.appendArray( (unsigned char*)header, 
+                                        strlen( header ) );
+            delete [] header;
+        
+            if( contents != NULL && contentLength == size ) {
+                fileDataBuffer.appendArray( contents, contentLength );
+                }
+            }
+        else if( contents != NULL && contentLength == size ) {
+            
+            char *newHash = computeSHA1Digest( contents, contentLength );
+            
+            unsigned char *delta = NULL;
+            int deltaLength = 0;
+            char *oldHash = NULL;
+            
+            // clients convert line ends of .txt files after writing them,
+            // so their copies can't serve as a delta base
+            if( inOldFiles != NULL && inOldFiles[i] != NULL &&
+                ! stringEndsWith( fileSubdirName, ".txt" ) ) {
+                
+                int oldLength;
+                unsigned char *oldContents = 
+                    inOldFiles[i]->readFileContents( &oldLength );
+                
+                if( oldContents != NULL ) {
+                    delta = computeBinaryDelta( oldContents, oldLength,
+                                                contents, contentLength,
+                                                &deltaLength );
+                    
+                    if( delta != NULL && 
+                        deltaLength > MAX_DELTA_FRACTION * contentLength ) {
+                        delete [] delta;
+                        delta = NULL;
+                        }
+                    
+                    if( delta != NULL ) {
+                        oldHash = computeSHA1Digest( oldContents, 
+                                                     oldLength );
+                        }
+                    
+                    delete [] oldContents;
+                    }
+                }
+            
+            char *header;
+            
+            if( delta != NULL ) {
+                printf( "  Delta for %s is %d bytes (full size %d)\n",
+                        fileSubdirName, deltaLength, contentLength );
+                
+                header = autoSprintf( "%d %s D %d %s %s#",
+                                      strlen( fileSubdirName ),
+                                      fileSubdirName,
+                                      deltaLength, newHash, oldHash );
+                numDeltas++;
+                }
+            else {
+                header = autoSprintf( "%d %s F %d %s#",
+                                      strlen( fileSubdirName ),
+                                      fileSubdirName,
+                                      size, newHash );
+                }
+            
+            fileDataBuffer.appendArray( (unsigned char*)header, 
+                                        strlen( header ) );
+            delete [] header;
+            
+            if( delta != NULL ) {
+                fileDataBuffer.appendArray( delta, deltaLength );
+                delete [] delta;
+                delete [] oldHash;
+                }
+            else {
+                fileDataBuffer.appendArray( contents, contentLength );
+                }
+            
+            delete [] newHash;
+            }
+        
         if( contents != NULL ) {
             delete [] contents;
             }
         
-
                 
         delete [] fileName;
         
         delete [] fileSubdirName;
         }
     
+    if( inBundleVersion >= 2 ) {
+        printf( "%d of %d files bundled as deltas\n", numDeltas, 
+                inNumFiles );
+        }
+    
     int totalSize = fileDataBuffer.size();
     
     unsigned char *data = fileDataBuffer.getElementArray();
@@ -183,6 +688,12 @@ static void bundleFiles( File **inFilesToRemove, int inNumFilesToRemove,
             
             printf( "Writing file %s\n", inDBZTargetFile );
             
+            if( inBundleVersion >= 2 ) {
+                // old clients fail to parse this as a size
+                // (but servers only send it to clients that ask for it)
+                fprintf( outFile, "DBZ%d ", inBundleVersion );
+                }
+            
             fprintf( outFile, "%d %d ", totalSize, compSize );
             
             int numWritten = fwrite( compData, 1, compSize, outFile );
@@ -240,11 +751,24 @@ static void printFileList( const char *inDescription,
 // sub directories
 int main( int inNumArgs, char **inArgs ) {
     
+    char makeDeltaBundle = false;
+    
+    if( inNumArgs > 1 && strcmp( inArgs[1], "-delta" ) == 0 ) {
+        makeDeltaBundle = true;
+        
+        // drop the flag so the positional args below line up
+        inArgs = &( inArgs[1] );
+        inNumArgs--;
+        }
+    
     if( inNumArgs != 5 && inNumArgs != 4 ) {        
-		printf( "\nUsage:  diffBundle  dirOld dirNew "
+		printf( "\nUsage:  diffBundle  [-delta] dirOld dirNew "
                 "outIncremental.dbz [outFull.dbz]\n\n" );
         printf( "If outFull.dbz not supplied, only the incremental bundle is "
                 "generated.\n\n" );
+        printf( "With -delta, a version 2 incremental bundle containing "
+                "binary deltas\nis also written to "
+                "outIncremental_delta.dbz\n\n" );
 		return 1;
 		}
     
@@ -268,11 +792,15 @@ int main( int inNumArgs, char **inArgs ) {
     //File outFullFile( NULL, inArgs[3] );
     
     
+    printf( "Scanning files...\n" );
+
     int numOldChild;
-    File **oldChild = dirOld.getChildFilesRecursive( 100, &numOldChild );
+    File **oldChild;
+    FileRecord *oldRecords = scanTree( inArgs[1], &oldChild, &numOldChild );
     
     int numNewChild;
-    File **newChild = dirNew.getChildFilesRecursive( 100, &numNewChild );
+    File **newChild;
+    FileRecord *newRecords = scanTree( inArgs[2], &newChild, &numNewChild );
     
     // bundle is additive, ignore files in old that are no longer in new
 
@@ -317,7 +845,17 @@ int main( int inNumArgs, char **inArgs ) {
 
     printf( "\n\nMaking incremental bundle...\n" );
     
-    printf( "Scanning files...\n" );
+    char *oldCachePath = getDigestCachePath( inArgs[1] );
+    char *newCachePath = getDigestCachePath( inArgs[2] );
+    
+    int numOldCached = 
+        loadDigestCache( oldCachePath, oldRecords, numOldChild );
+    int numNewCached = 
+        loadDigestCache( newCachePath, newRecords, numNewChild );
+    
+    printf( "Reused %d cached digests from %s, %d from %s\n",
+            numOldCached, oldCachePath, numNewCached, newCachePath );
+    
 
     SimpleVector<File *> removedFiles;
     SimpleVector<File *> removedDirs;
@@ -327,37 +865,18 @@ int main( int inNumArgs, char **inArgs ) {
     // we exit in that case when scanning for differences below
     // we can assume that that kind of change will never happen
     for( int i=0; i<numOldChild; i++ ) {
-
-        char *oldFileName = oldChild[i]->getFullFileName();
-        char *oldFileSubdirName = getSubdirPath( oldFileName );
-
-        char foundNewFile = false;
-        
-        for( int j=0; j<numNewChild && ! foundNewFile; j++ ) {
-            char *newFileName = newChild[j]->getFullFileName();
-            
-            char *newFileSubdirName = getSubdirPath( newFileName );
-
-            if( strcmp( oldFileSubdirName, newFileSubdirName ) == 0 ) {
-                foundNewFile = true;
-                }
-            delete [] newFileName;
-            delete [] newFileSubdirName;
-            }
+        FileRecord *oldRecord = &( oldRecords[i] );
         
-
-        if( !foundNewFile ) {
+        if( findRecord( newRecords, numNewChild, 
+                        oldRecord->subdirName ) == NULL ) {
             
-            if( oldChild[i]->isDirectory() ) {
-                removedDirs.push_back( oldChild[i] );
+            if( oldRecord->isDir ) {
+                removedDirs.push_back( oldRecord->file );
                 }
             else {
-                removedFiles.push_back( oldChild[i] );
+                removedFiles.push_back( oldRecord->file );
                 }
             }
-        
-        delete [] oldFileName;
-        delete [] oldFileSubdirName;
         }
     
 
@@ -372,86 +891,98 @@ int main( int inNumArgs, char **inArgs ) {
 
     SimpleVector<File*> changedFiles;
     
+    // old version of each changed file, or NULL if it is new
+    SimpleVector<File*> changedOldFiles;
+    
+    // same-size files present in both trees, which need digests to compare
+    SimpleVector<FileRecord *> sameSizeNew;
+    SimpleVector<FileRecord *> sameSizeOld;
+    
     for( int i=0; i<numNewChild; i++ ) {        
+        FileRecord *newRecord = &( newRecords[i] );
         
-        char *newFileName = newChild[i]->getFullFileName();
+        FileRecord *oldRecord = findRecord( oldRecords, numOldChild,
+                                            newRecord->subdirName );
         
-        char *newFileSubdirName = getSubdirPath( newFileName );
-
-        int newFileLength;
-        unsigned char *newFileContents = 
-            newChild[i]->readFileContents( &newFileLength );
+        if( oldRecord == NULL ) {
+            if( newRecord->isDir ) {
+                newDirs.push_back( newRecord->file );
+                }
+            else {
+                changedFiles.push_back( newRecord->file );
+                changedOldFiles.push_back( NULL );
+                }
+            continue;
+            }
         
-        char foundOldFile = false;
-        for( int j=0; j<numOldChild && ! foundOldFile; j++ ) {
-            char *oldFileName = oldChild[j]->getFullFileName();
-            
-            char *oldFileSubdirName = getSubdirPath( oldFileName );
-
-            if( strcmp( oldFileSubdirName, newFileSubdirName ) == 0 ) {
-                foundOldFile = true;
-                
-                char doneComparing = false;
-                
-                if( newChild[i]->isDirectory() ) {
-                    if( oldChild[j]->isDirectory() ) {
-                        // both are dirs, no data contents
-                        doneComparing = true;
-                        }
-                    else {
-                        printf( "%s is dir in %s, but non-dir in %s\n",
-                                newFileSubdirName, inArgs[2], inArgs[1] );
-                        
-                        exit( 1 );
-                        }
-                    }
-                else if( oldChild[j]->isDirectory() ) {
-                    printf( "%s is non-dir in %s, but dir in %s\n",
-                            newFileSubdirName, inArgs[2], inArgs[1] );
-                    
-                    exit( 1 );
-                    }
-                
-                
-                if( !doneComparing ) {
-                
-                    int oldFileLength;
-                    unsigned char *oldFileContents = 
-                        oldChild[j]->readFileContents( &oldFileLength );
-                
-                    if( oldFileLength != newFileLength ) {
-                        changedFiles.push_back( newChild[i] );
-                        }
-                    else {
-                        for( int b=0; b<newFileLength; b++ ) {
-                            if( oldFileContents[b] != newFileContents[b] ) {
-                                changedFiles.push_back( newChild[i] );
-                                break;
-                                }
-                            }
-                        }
-
-                    delete [] oldFileContents;
-                    }
+        if( newRecord->isDir ) {
+            if( oldRecord->isDir ) {
+                // both are dirs, no data contents
+                continue;
                 }
+            printf( "%s is dir in %s, but non-dir in %s\n",
+                    newRecord->subdirName, inArgs[2], inArgs[1] );
+            
+            exit( 1 );
+            }
+        else if( oldRecord->isDir ) {
+            printf( "%s is non-dir in %s, but dir in %s\n",
+                    newRecord->subdirName, inArgs[2], inArgs[1] );
             
-            delete [] oldFileName;
-            delete [] oldFileSubdirName;
+            exit( 1 );
             }
         
-        if( !foundOldFile ) {
-            if( newChild[i]->isDirectory() ) {
-                newDirs.push_back( newChild[i] );
-                }
-            else {
-                changedFiles.push_back( newChild[i] );
-                }
+        if( oldRecord->size != newRecord->size ) {
+            changedFiles.push_back( newRecord->file );
+            changedOldFiles.push_back( oldRecord->file );
             }
+        else {
+            sameSizeNew.push_back( newRecord );
+            sameSizeOld.push_back( oldRecord );
+            }
+        }
 
-        delete [] newFileName;
-        delete [] newFileSubdirName;
-        delete [] newFileContents;
+
+    // hash everything whose digest didn't come from a cache
+    SimpleVector<FileRecord *> toHash;
+    
+    for( int i=0; i<sameSizeNew.size(); i++ ) {
+        FileRecord *newRecord = sameSizeNew.getElementDirect( i );
+        FileRecord *oldRecord = sameSizeOld.getElementDirect( i );
+        
+        if( ! newRecord->digestKnown ) {
+            toHash.push_back( newRecord );
+            }
+        if( ! oldRecord->digestKnown ) {
+            toHash.push_back( oldRecord );
+            }
+        }
+    
+    hashRecords( &toHash );
+    
+    
+    for( int i=0; i<sameSizeNew.size(); i++ ) {
+        FileRecord *newRecord = sameSizeNew.getElementDirect( i );
+        FileRecord *oldRecord = sameSizeOld.getElementDirect( i );
+        
+        // if either couldn't be read, bundle it to be safe
+        if( ! newRecord->digestKnown || ! oldRecord->digestKnown ||
+            memcmp( newRecord->digest, oldRecord->digest, 
+                    SHA1_DIGEST_LENGTH ) != 0 ) {
+            
+            changedFiles.push_back( newRecord->file );
+            changedOldFiles.push_back( oldRecord->file );
+            }
         }
+    
+    saveDigestCache( oldCachePath, oldRecords, numOldChild );
+    saveDigestCache( newCachePath, newRecords, numNewChild );
+
+    delete [] oldCachePath;
+    delete [] newCachePath;
+    
+    deleteRecords( oldRecords, numOldChild );
+    deleteRecords( newRecords, numNewChild );
 
     
     printFileList( "new directories", &newDirs );
@@ -479,7 +1010,40 @@ int main( int inNumArgs, char **inArgs ) {
                  removedDirsArray, numRemovedDirs, 
                  newDirsArray, numNewDirs,
                  changedFilesArray, numChanged, inArgs[3] );
-
+    
+    if( makeDeltaBundle ) {
+        char *deltaBundleName;
+        
+        int incNameLength = strlen( inArgs[3] );
+        
+        if( incNameLength > 4 &&
+            strcmp( &( inArgs[3][ incNameLength - 4 ] ), ".dbz" ) == 0 ) {
+            
+            deltaBundleName = stringDuplicate( inArgs[3] );
+            deltaBundleName[ incNameLength - 4 ] = '\0';
+            
+            char *fullName = autoSprintf( "%s_delta.dbz", deltaBundleName );
+            delete [] deltaBundleName;
+            deltaBundleName = fullName;
+            }
+        else {
+            deltaBundleName = autoSprintf( "%s_delta.dbz", inArgs[3] );
+            }
+        
+        printf( "\n\nMaking delta bundle...\n" );
+        
+        File **changedOldFilesArray = changedOldFiles.getElementArray();
+        
+        bundleFiles( removedFilesArray, numRemovedFiles,
+                     removedDirsArray, numRemovedDirs, 
+                     newDirsArray, numNewDirs,
+                     changedFilesArray, numChanged, deltaBundleName,
+                     2, changedOldFilesArray );
+        
+        delete [] changedOldFilesArray;
+        delete [] deltaBundleName;
+        }
+    
     delete [] removedFilesArray;
     delete [] removedDirsArray;
     delete [] changedFilesArray;
@@ -54,6 +54,37 @@ function dbs_getOldVersion() {
 
 
 
+// bundle format version the client can apply (1 if it didn't say)
+function dbs_getBundleFormat() {
+    $format = dbs_requestFilter( "bundle_format", "/[0-9]+/i", "1" );
+
+    if( $format == "" ) {
+        $format = "1";
+        }
+    return $format;
+    }
+
+
+
+// swaps an inc bundle name (or inc urls file name) for its delta 
+// counterpart, if the client can apply format 2 bundles and one exists
+function dbs_preferDeltaBundle( $inName ) {
+    global $downloadFilePath;
+
+    if( dbs_getBundleFormat() < 2 ) {
+        return $inName;
+        }
+    
+    $deltaName = preg_replace( '/(_urls\.txt|\.dbz)$/', '_delta$1', $inName );
+
+    if( file_exists( $downloadFilePath . $deltaName ) ) {
+        return $deltaName;
+        }
+    return $inName;
+    }
+
+
+
 function dbs_getLatestVersion( $inPlatform ) {
     global $downloadFilePath;
 
@@ -148,7 +179,9 @@ function dbs_isUpdateAvailable() {
                                  "$i"."_inc_$platform"."_urls.txt" ) ) {
 
                     $filePath =
-                        $downloadFilePath . "$i"."_inc_$platform"."_urls.txt";
+                        $downloadFilePath . 
+                        dbs_preferDeltaBundle( 
+                            "$i"."_inc_$platform"."_urls.txt" );
                     
                     $fileContents = file_get_contents( $filePath );
                     }
@@ -156,7 +189,8 @@ function dbs_isUpdateAvailable() {
                 if( $fileContents === FALSE ) {
                     // failed to read
                     $filePath =
-                        $downloadFilePath . "$i"."_inc_all_urls.txt";
+                        $downloadFilePath . 
+                        dbs_preferDeltaBundle( "$i"."_inc_all_urls.txt" );
                     
                     $fileContents = file_get_contents( $filePath );
                     }
@@ -187,6 +221,7 @@ function dbs_isUpdateAvailable() {
                 if( filesize( $downloadFilePath . $updateName ) === FALSE ) {
                     $updateName = "$latest"."_inc_all".".dbz";
                     }
+                $updateName = dbs_preferDeltaBundle( $updateName );
                 }
             else {
                 $updateName = "$latest"."_full_$platform".".dbz";
@@ -224,6 +259,7 @@ function dbs_getUpdate() {
         if( filesize( $downloadFilePath . $updateName ) === FALSE ) {
             $updateName = "$latest"."_inc_all".".dbz";
             }
+        $updateName = dbs_preferDeltaBundle( $updateName );
         }
     else {
         $updateName = "$latest"."_full_$platform".".dbz";
@@ -465,6 +465,12 @@ doublePair getViewCenterPosition();
 void setViewSize( float inSize );
 
 
+// world-space rectangle covered by the current view, as set by
+// setViewCenterPosition, setViewSize, and setLetterbox
+// (on non-square screens, part of it may be off-screen)
+void getViewRect( doublePair *outLowerLeft, doublePair *outUpperRight );
+
+
 // sub region in center of view size that should be visible
 // everything outside this region is trimmed away
 // set to -1 to disable letterboxing (default)
@@ -623,6 +629,33 @@ char *getWebResult( int inHandle );
 unsigned char *getWebResult( int inHandle, int *outSize );
 
 
+
+// starts a GET request whose response body is handed out in pieces by
+// getWebStreamBytes as it arrives, instead of all at once by getWebResult,
+// so that large downloads never need to be held in memory
+//
+// inRangeStart > 0 asks the server for the body starting at that byte
+// offset (an HTTP Range request, for resuming an interrupted download).
+// Servers that ignore this send the whole body with status 200 instead
+// of the requested part with status 206.
+//
+// step with stepWebRequest, which returns 1 once the connection has closed
+// returns unique int handle for web request, always > -1 
+int startWebStreamRequest( const char *inURL, int inRangeStart = 0 );
+
+
+// gets body bytes of a stream request that arrived since the last call
+// call until NULL is returned after stepWebRequest returns 1, to get the
+// last of the body
+// returns NULL if there are none, result destroyed by caller
+unsigned char *getWebStreamBytes( int inHandle, int *outSize );
+
+
+// gets the HTTP status code of a web request, or -1 if the response
+// headers have not arrived yet
+int getWebResultStatus( int inHandle );
+
+
 // frees resources associated with a web request
 // if request is not complete, this cancels it
 // if hostname lookup is not complete, this call might block.
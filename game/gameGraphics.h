@@ -158,6 +158,38 @@ void toggleMipMapGeneration( char inGenerateMipMaps );
 void toggleTransparentCropping( char inCrop );
 
 
+// if on, subsequently loaded or filled sprites are packed together into
+// shared textures, so that batching (below) can draw different sprites 
+// with one GL call
+// mipmapped sprites and sprites larger than 256 pixels get their own
+// textures regardless
+// Drawing is unchanged, except where a screen pixel's center lands exactly
+// between two texels:  nearest-neighbor sampling may then pick the other 
+// texel than it would from a sprite-sized texture.
+// defaults to off
+void toggleSpriteAtlas( char inAtlas );
+
+
+// if on, drawSprite calls are queued and drawn together, one GL call for 
+// each run of consecutive sprites that share a texture and filter settings
+// Drawing order and output are unchanged.
+// The other functions here flush the queue as needed, as does the platform
+// at the end of each frame, but game code that makes GL calls of its own
+// must call flushSpriteBatch first.
+// defaults to off
+void toggleSpriteBatching( char inBatch );
+
+void flushSpriteBatch();
+
+
+// draws a run of sprites at the same zoom with the current draw color,
+// queued and drawn together even if sprite batching is off
+// (one GL call if all sprites share an atlas page)
+// NULL entries in inSprites are skipped
+void drawSpriteRun( int inNumSprites, SpriteHandle inSprites[],
+                    doublePair inCenters[], double inZoom = 1.0 );
+
+
 // loads sprite from graphics directory
 // can be NULL on load failure
 SpriteHandle loadSprite( const char *inTGAFileName, 
@@ -230,6 +262,12 @@ int getSpriteHeight( SpriteHandle inSprite );
 void setSpriteCenterOffset( SpriteHandle inSprite, doublePair inOffset );
 
 
+// radius of a circle around a sprite's draw position that contains 
+// everything drawn at zoom 1, at any rotation
+// (includes the center offset and ignores transparent cropped borders)
+double getSpriteBoundingRadius( SpriteHandle inSprite );
+
+
 
 void startCountingSpritePixelsDrawn();
 
@@ -244,6 +282,13 @@ void startCountingSpritesDrawn();
 // returns the number of sprites drawn since we started counting
 double endCountingSpritesDrawn();
 
+// returns the number of sprites skipped by view culling (SpriteLayer)
+// since startCountingSpritesDrawn was called
+double endCountingSpritesCulled();
+
+// for code that culls sprites to report how many it skipped
+void countSpritesCulled( int inNumCulled );
+
 
 
 // draw with current draw color
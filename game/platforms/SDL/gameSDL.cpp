@@ -45,6 +45,7 @@ int main( int inArgCount, char **inArgs ) {
 
 #include "minorGems/system/Time.h"
 #include "minorGems/system/Thread.h"
+#include "minorGems/system/endian.h"
 
 #include "minorGems/io/file/File.h"
 
@@ -59,12 +60,14 @@ int main( int inArgCount, char **inArgs ) {
 #include "minorGems/util/TranslationManager.h"
 #include "minorGems/util/stringUtils.h"
 #include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/Arena.h"
 
 
 #include "minorGems/util/log/AppLog.h"
 #include "minorGems/util/log/FileLog.h"
 
 #include "minorGems/graphics/converters/TGAImageConverter.h"
+#include "minorGems/graphics/converters/FrameEncoderQueue.h"
 
 #include "minorGems/io/file/FileInputStream.h"
 #include "minorGems/util/ByteBufferInputStream.h"
@@ -119,8 +122,8 @@ void freeWriteFailedPanel() {
 static int nextAsyncFileHandle = 0;
 
 typedef struct AsyncFileRecord {
+        // -1 for an empty table slot
         int handle;
-        char *filePath;
         
         int dataLength;
         unsigned char *data;
@@ -131,113 +134,186 @@ typedef struct AsyncFileRecord {
 
 
 
-#include "minorGems/system/StopSignalThread.h"
-#include "minorGems/system/MutexLock.h"
 #include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/io/file/AsyncFileReader.h"
 
-static MutexLock asyncLock;
-static BinarySemaphore newFileToReadSem;
 
+// signaled by the reader each time a file finishes reading
+// (only waited on during playback, where the file-done must happen on a 
+//  specific frame)
 static BinarySemaphore newFileDoneReadingSem;
 
-static SimpleVector<AsyncFileRecord> asyncFiles;
 
+// open-addressed table of records, keyed by handle
+// handles are handed out in order, so handle & mask spreads them evenly
+// a record is removed as soon as getAsyncFileData clears its handle, so
+// one handle that is never collected only keeps its own slot
+static AsyncFileRecord *asyncFiles = NULL;
 
-class AsyncFileThread : public StopSignalThread {
-    
-    public:
-        
-        AsyncFileThread() {
-            start();
-            }
+// power of two, kept at least twice numAsyncFiles
+static int asyncFileTableSize = 0;
+static int numAsyncFiles = 0;
 
-        ~AsyncFileThread() {
-            stop();
-            newFileToReadSem.signal();
-            join();
 
-            for( int i=0; i<asyncFiles.size(); i++ ) {
-        
-                AsyncFileRecord *r = asyncFiles.getElement( i );
-                
-                if( r->filePath != NULL ) {
-                    delete [] r->filePath;
-                    }
+static AsyncFileReader *asyncFileReader = NULL;
+
+
+// stops reader and frees unclaimed file data at exit
+class AsyncFileCleanup {
+    public:
+        ~AsyncFileCleanup() {
+            if( asyncFileReader != NULL ) {
+                delete asyncFileReader;
+                asyncFileReader = NULL;
+                }
+            
+            for( int i=0; i<asyncFileTableSize; i++ ) {
+                AsyncFileRecord *r = &( asyncFiles[i] );
                 
-                if( r->data != NULL ) {
+                if( r->handle != -1 && r->data != NULL ) {
                     delete [] r->data;
                     }
                 }
-            asyncFiles.deleteAll();
+            
+            if( asyncFiles != NULL ) {
+                delete [] asyncFiles;
+                asyncFiles = NULL;
+                }
             }
-        
+    };
 
-        virtual void run() {
-            while( ! isStopped() ) {
-                
-                int handleToRead = -1;
-                char *pathToRead = NULL;
-                
-                asyncLock.lock();
-                
-                for( int i=0; i<asyncFiles.size(); i++ ) {
-                    AsyncFileRecord *r = asyncFiles.getElement( i );
-                    
-                    if( ! r->doneReading ) {
-                        // can't trust pointer to record in vector
-                        // outside of lock, because vector storage may
-                        // change
-                        handleToRead = r->handle;
-                        pathToRead = r->filePath;
-                        break;
-                        }
-                    }
+static AsyncFileCleanup asyncFileCleanup;
 
-                asyncLock.unlock();
 
-                if( handleToRead != -1 ) {
-                    // read file data
 
-                    File f( NULL, pathToRead );
-                    
-                    int dataLength;
-                    unsigned char *data = f.readFileContents( &dataLength );
+// NULL if handle unknown or cleared
+static AsyncFileRecord *getAsyncFileRecord( int inHandle ) {
+    if( asyncFileTableSize == 0 ) {
+        return NULL;
+        }
+    
+    int mask = asyncFileTableSize - 1;
+    
+    int i = inHandle & mask;
+    
+    while( asyncFiles[i].handle != -1 ) {
+        if( asyncFiles[i].handle == inHandle ) {
+            return &( asyncFiles[i] );
+            }
+        i = ( i + 1 ) & mask;
+        }
+    return NULL;
+    }
 
-                    // re-lock vector, search for handle, and add it
-                    // cannot count on vector order or pointers to records
-                    // when we don't have it locked
 
-                    asyncLock.lock();
-                    
-                    for( int i=0; i<asyncFiles.size(); i++ ) {
-                        AsyncFileRecord *r = asyncFiles.getElement( i );
-                    
-                        if( r->handle == handleToRead ) {
-                            r->dataLength = dataLength;
-                            r->data = data;
-                            r->doneReading = true;
-                            break;
-                            }
-                        }
 
-                    asyncLock.unlock();
+// puts a record in the first free slot at or after its home slot
+static void placeAsyncFileRecord( AsyncFileRecord inRecord ) {
+    int mask = asyncFileTableSize - 1;
+    
+    int i = inRecord.handle & mask;
+    
+    while( asyncFiles[i].handle != -1 ) {
+        i = ( i + 1 ) & mask;
+        }
+    asyncFiles[i] = inRecord;
+    }
 
-                    // let anyone waiting for a new file to finish
-                    // reading (only matters in the case of playback, where
-                    // the file-done must happen on a specific frame)
-                    newFileDoneReadingSem.signal();
-                    }
-                else {
-                    // wait on binary semaphore until something else added
-                    // for us to read
-                    newFileToReadSem.wait();
-                    }
+
+
+static void addAsyncFileRecord( AsyncFileRecord inRecord ) {
+    
+    if( ( numAsyncFiles + 1 ) * 2 > asyncFileTableSize ) {
+        AsyncFileRecord *oldTable = asyncFiles;
+        int oldSize = asyncFileTableSize;
+        
+        asyncFileTableSize = ( oldSize == 0 ) ? 16 : oldSize * 2;
+        asyncFiles = new AsyncFileRecord[ asyncFileTableSize ];
+        
+        for( int i=0; i<asyncFileTableSize; i++ ) {
+            asyncFiles[i].handle = -1;
+            }
+        
+        for( int i=0; i<oldSize; i++ ) {
+            if( oldTable[i].handle != -1 ) {
+                placeAsyncFileRecord( oldTable[i] );
                 }
-            };
-    };
+            }
+        
+        if( oldTable != NULL ) {
+            delete [] oldTable;
+            }
+        }
+    
+    placeAsyncFileRecord( inRecord );
+    numAsyncFiles++;
+    }
+
+
+
+// empties a record's slot, shifting later records in the same probe
+// run back so that lookups never stop early at the hole
+static void removeAsyncFileRecord( AsyncFileRecord *inRecord ) {
+    int mask = asyncFileTableSize - 1;
+    
+    int hole = inRecord - asyncFiles;
+    int i = hole;
+    
+    while( true ) {
+        i = ( i + 1 ) & mask;
+        
+        if( asyncFiles[i].handle == -1 ) {
+            break;
+            }
+        
+        int home = asyncFiles[i].handle & mask;
+        
+        // can move back unless its home lies cyclically in (hole, i]
+        char homeAfterHole;
+        if( hole <= i ) {
+            homeAfterHole = ( home > hole && home <= i );
+            }
+        else {
+            homeAfterHole = ( home > hole || home <= i );
+            }
+        
+        if( ! homeAfterHole ) {
+            asyncFiles[ hole ] = asyncFiles[i];
+            hole = i;
+            }
+        }
+    
+    asyncFiles[ hole ].handle = -1;
+    numAsyncFiles--;
+    }
 
 
-static AsyncFileThread fileReadThread;
+
+// moves finished reads off the reader's completion queue into their
+// records
+static void collectAsyncFileReads() {
+    if( asyncFileReader == NULL ) {
+        return;
+        }
+    
+    AsyncFileCompletion c;
+    
+    while( asyncFileReader->getNextCompletion( &c ) ) {
+        AsyncFileRecord *r = getAsyncFileRecord( c.handle );
+        
+        if( r == NULL ) {
+            // handle cleared before its read finished
+            if( c.data != NULL ) {
+                delete [] c.data;
+                }
+            continue;
+            }
+        
+        r->data = c.data;
+        r->dataLength = c.dataLength;
+        r->doneReading = true;
+        }
+    }
 
 
 
@@ -379,6 +455,14 @@ static char *screenShotPrefix = NULL;
 static void takeScreenShot();
 
 
+// encodes output frames off the main thread
+static FrameEncoderQueue *frameEncoderQueue = NULL;
+
+// output frames still being read back through pixel buffers
+static void flushPixelBuffers();
+static void freePixelBuffers();
+
+
 
 
 
@@ -624,6 +708,18 @@ void cleanUpAtExit() {
         }
     
     
+    // needs GL context
+    AppLog::info( "exiting: freeing pixel buffers\n" );
+    freePixelBuffers();
+    
+    if( frameEncoderQueue != NULL ) {
+        AppLog::info( "exiting: waiting for frame encoders\n" );
+        
+        delete frameEncoderQueue;
+        frameEncoderQueue = NULL;
+        }
+    
+
     AppLog::info( "exiting: Deleting screen\n" );
     delete screen;
 
@@ -772,20 +868,21 @@ SoundSpriteHandle loadSoundSprite( const char *inFolderName,
         return NULL;
         }
     
-    int numBytes;
-    unsigned char *data = aiffFile.readFileContents( &numBytes );
+    MappedFile *aiffView = aiffFile.readFileContentsMapped();
     
 
-    if( data == NULL ) {
+    if( aiffView == NULL ) {
         printf( "Failed to read sound file: %s\n", inAIFFFileName );
         return NULL;
         }
 
 
     int numSamples;
-    int16_t *samples = readMono16AIFFData( data, numBytes, &numSamples );
+    int16_t *samples = readMono16AIFFData( 
+        (unsigned char *)aiffView->getData(), aiffView->getLength(), 
+        &numSamples );
     
-    delete [] data;
+    delete aiffView;
     
     if( samples == NULL ) {
         printf( "Failed to parse AIFF sound file: %s\n", inAIFFFileName );
@@ -1343,17 +1440,18 @@ void audioCallback( void *inUserData, Uint8 *inStream, int inLengthToFill ) {
             numSamples = samplesLeftToRecord;
             }
 
-        // reverse byte order
-        int nextByte = 0;
-        for( int i=0; i<numSamples; i++ ) {
-                    
-            fwrite( &( inStream[ nextByte + 1 ] ), 1, 1, aiffOutFile );
-            fwrite( &( inStream[ nextByte ] ), 1, 1, aiffOutFile );
-    
-            fwrite( &( inStream[ nextByte + 3 ] ), 1, 1, aiffOutFile );
-            fwrite( &( inStream[ nextByte + 2 ] ), 1, 1, aiffOutFile );
-            nextByte += 4;
-            }
+        // reverse byte order of a copy (AIFF is big endian) and write
+        // it in one go
+        int numBytes = numSamples * 4;
+        
+        unsigned char *swapped = new unsigned char[ numBytes ];
+        memcpy( swapped, inStream, numBytes );
+        
+        byteSwapArray16( swapped, numSamples * 2 );
+        
+        fwrite( swapped, 1, numBytes, aiffOutFile );
+        
+        delete [] swapped;
         
 
         samplesLeftToRecord -= numSamples;
@@ -2817,8 +2915,15 @@ static float viewSize = 2;
 static float visibleWidth = -1;
 static float visibleHeight = -1;
 
+// world rectangle of current draw matrix
+static doublePair viewLowerLeft = { -1, -1 };
+static doublePair viewUpperRight = { 1, 1 };
+
 
 static void redoDrawMatrix() {
+    // queued sprites were positioned for the old matrix
+    flushSpriteBatch();
+    
     // viewport square centered on screen (even if screen is rectangle)
     float hRadius = viewSize / 2;
     
@@ -2830,6 +2935,11 @@ static void redoDrawMatrix() {
         }
     
 
+    viewLowerLeft.x = viewCenterX - wRadius;
+    viewLowerLeft.y = viewCenterY - hRadius;
+    viewUpperRight.x = viewCenterX + wRadius;
+    viewUpperRight.y = viewCenterY + hRadius;
+
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     glOrtho( viewCenterX - wRadius, viewCenterX + wRadius, 
@@ -2946,6 +3056,12 @@ void setViewSize( float inSize ) {
     }
 
 
+void getViewRect( doublePair *outLowerLeft, doublePair *outUpperRight ) {
+    *outLowerLeft = viewLowerLeft;
+    *outUpperRight = viewUpperRight;
+    }
+
+
 void setLetterbox( float inVisibleWidth, float inVisibleHeight ) {
     visibleWidth = inVisibleWidth;
     visibleHeight = inVisibleHeight;
@@ -3330,6 +3446,9 @@ void GameSceneHandler::drawScene() {
                 }
             }
 
+        flushSpriteBatch();
+        
+        Arena::getFrameArena()->reset();
         return;
         }
     else if( !loadingMessageShown ) {
@@ -3591,6 +3710,7 @@ void GameSceneHandler::drawScene() {
             
             
             // mouse coordinates in screen space
+            flushSpriteBatch();
             glMatrixMode(GL_PROJECTION);
             glLoadIdentity();
             
@@ -3699,6 +3819,7 @@ void GameSceneHandler::drawScene() {
         // thus, to be safe, we keep glScissor off and manually draw letterboxes
         // just in case glViewport doesn't clip the image.
     
+        flushSpriteBatch();
         glMatrixMode(GL_PROJECTION);
         glLoadIdentity();
             
@@ -3773,6 +3894,10 @@ void GameSceneHandler::drawScene() {
         }
     
 
+    // end of frame
+    flushSpriteBatch();
+    
+
     if( shouldTakeScreenshot ) {
         takeScreenShot();
 
@@ -3784,6 +3909,10 @@ void GameSceneHandler::drawScene() {
         }
 
     frameNumber ++;
+
+    // scratch memory from this frame is no longer needed
+    Arena::getFrameArena()->reset();
+    
     //printf( "%d pixels drawn (%.2F MB textures resident)\n", 
     //        numPixelsDrawn, totalLoadedTextureBytes / ( 1024.0 * 1024.0 ) );
     }
@@ -4257,11 +4386,22 @@ static Image *readTGAFile( File *inFile ) {
         }    
 
 
-    FileInputStream tgaStream( inFile );
+    // parse straight out of the page cache, rather than through
+    // FileInputStream's many small freads
+    MappedFile *tgaView = inFile->readFileContentsMapped();
     
-    TGAImageConverter converter;
+    Image *result = NULL;
+
+    if( tgaView != NULL ) {
+        ByteBufferInputStream tgaStream( 
+            (unsigned char *)tgaView->getData(), tgaView->getLength() );
+    
+        TGAImageConverter converter;
     
-    Image *result = converter.deformatImage( &tgaStream );
+        result = converter.deformatImage( &tgaStream );
+
+        delete tgaView;
+        }
 
     if( result == NULL ) {        
         char *fileName = inFile->getFullFileName();
@@ -4299,18 +4439,6 @@ Image *readTGAFileBase( const char *inTGAFileName ) {
 
 
 
-static RawRGBAImage *readTGAFileRaw( InputStream *inStream ) {
-    TGAImageConverter converter;
-    
-    RawRGBAImage *result = converter.deformatImageRaw( inStream );
-
-    
-    return result;
-    }
-
-
-
-
 static RawRGBAImage *readTGAFileRaw( File *inFile ) {
     
     if( !inFile->exists() ) {
@@ -4328,10 +4456,17 @@ static RawRGBAImage *readTGAFileRaw( File *inFile ) {
         }    
 
 
-    FileInputStream tgaStream( inFile );
+    MappedFile *tgaView = inFile->readFileContentsMapped();
     
+    RawRGBAImage *result = NULL;
+
+    if( tgaView != NULL ) {
+        // decode straight from the mapping
+        result = TGAImageConverter::decodeTGA( 
+            (unsigned char *)tgaView->getData(), tgaView->getLength() );
 
-    RawRGBAImage *result = readTGAFileRaw( &tgaStream );
+        delete tgaView;
+        }
 
     if( result == NULL ) {        
         char *fileName = inFile->getFullFileName();
@@ -4372,9 +4507,7 @@ RawRGBAImage *readTGAFileRawBase( const char *inTGAFileName ) {
 RawRGBAImage *readTGAFileRawFromBuffer( unsigned char *inBuffer, 
                                         int inLength ) {
     
-    ByteBufferInputStream tgaStream( inBuffer, inLength );
-    
-    return readTGAFileRaw( &tgaStream );
+    return TGAImageConverter::decodeTGA( inBuffer, inLength );
     }
 
 
@@ -4525,26 +4658,25 @@ void startOutputAllFrames() {
 void stopOutputAllFrames() {
     outputAllFrames = false;
     shouldTakeScreenshot = false;
+    
+    // last frame is still in a pixel buffer
+    flushPixelBuffers();
     }
 
 
 
 
 
-// if manualScreenShot false, then any blend settings (for saving blended 
-// double-frames) are applied
-// can return NULL in this case (when this frame should not be output
-// according to blending settings)
+// reads a region of the frame buffer as RGB bytes, rows bottom to top
 //
 // Region in screen pixels
-static Image *getScreenRegionInternal( 
-    int inStartX, int inStartY, int inWidth, int inHeight,
-    char inForceManual = false ) {    
-        
-    int numBytes = inWidth * inHeight * 3;
+static unsigned char *readScreenBytes( int inStartX, int inStartY, 
+                                       int inWidth, int inHeight ) {
     
     unsigned char *rgbBytes = 
-        new unsigned char[ numBytes ];
+        new unsigned char[ inWidth * inHeight * 3 ];
+
+    flushSpriteBatch();
 
     // w and h might not be multiples of 4
     GLint oldAlignment;
@@ -4557,31 +4689,28 @@ static Image *getScreenRegionInternal(
     
     glPixelStorei( GL_PACK_ALIGNMENT, oldAlignment );
 
+    return rgbBytes;
+    }
 
-    if( ! inForceManual &&
-        ! manualScreenShot && 
-        blendOutputFramePairs && 
-        frameNumber % 2 != 0 && 
-        lastFrame_rgbaBytes != NULL ) {
-        
-        // save blended frames on odd frames
-        if( blendOutputFrameFraction > 0 ) {
-            float blendA = 1 - blendOutputFrameFraction;
-            float blendB = blendOutputFrameFraction;
-            
-            for( int i=0; i<numBytes; i++ ) {
-                rgbBytes[i] = 
-                    (unsigned char)(
-                        blendA * rgbBytes[i] + 
-                        blendB * lastFrame_rgbaBytes[i] );
-                }
-            }
-        
-        }
-    else if( ! inForceManual &&
-             ! manualScreenShot &&
-             blendOutputFramePairs &&
-             frameNumber % 2 == 0 ) {
+
+
+// with blendOutputFramePairs, even frames are not output, only kept to
+// blend into the odd frames after them
+static char isFrameHeldForBlending( unsigned int inFrameNumber ) {
+    return blendOutputFramePairs && inFrameNumber % 2 == 0;
+    }
+
+
+
+// applies blend settings to the bytes of an output frame
+// 
+// returns inRGBBytes, or NULL if the frame should not be output, in which
+// case inRGBBytes are kept for blending into the next frame
+static unsigned char *blendOutputFrame( unsigned char *inRGBBytes,
+                                        int inNumBytes,
+                                        unsigned int inFrameNumber ) {
+    
+    if( isFrameHeldForBlending( inFrameNumber ) ) {
         
         // skip even frames, but save them for next blending
         
@@ -4590,10 +4719,57 @@ static Image *getScreenRegionInternal(
             lastFrame_rgbaBytes = NULL;
             }
 
-        lastFrame_rgbaBytes = rgbBytes;
+        lastFrame_rgbaBytes = inRGBBytes;
         
         return NULL;
         }
+
+    if( blendOutputFramePairs && 
+        lastFrame_rgbaBytes != NULL &&
+        blendOutputFrameFraction > 0 ) {
+        
+        // save blended frames on odd frames
+        float blendA = 1 - blendOutputFrameFraction;
+        float blendB = blendOutputFrameFraction;
+        
+        for( int i=0; i<inNumBytes; i++ ) {
+            inRGBBytes[i] = 
+                (unsigned char)(
+                    blendA * inRGBBytes[i] + 
+                    blendB * lastFrame_rgbaBytes[i] );
+            }
+        }
+
+    return inRGBBytes;
+    }
+
+
+
+// if manualScreenShot false, then any blend settings (for saving blended 
+// double-frames) are applied
+// can return NULL in this case (when this frame should not be output
+// according to blending settings)
+//
+// Region in screen pixels
+static Image *getScreenRegionInternal( 
+    int inStartX, int inStartY, int inWidth, int inHeight,
+    char inForceManual = false ) {    
+        
+    int numBytes = inWidth * inHeight * 3;
+    
+    unsigned char *rgbBytes = 
+        readScreenBytes( inStartX, inStartY, inWidth, inHeight );
+
+
+    if( ! inForceManual &&
+        ! manualScreenShot ) {
+        
+        rgbBytes = blendOutputFrame( rgbBytes, numBytes, frameNumber );
+        
+        if( rgbBytes == NULL ) {
+            return NULL;
+            }
+        }
     
 
     Image *screenImage = new Image( inWidth, inHeight, 3, false );
@@ -4642,6 +4818,334 @@ Image *getScreenRegionRaw(
 
 
 
+// top-down copy of bottom-up screen bytes, ready for a converter
+static RawRGBAImage *flipScreenBytes( unsigned char *inRGBBytes,
+                                      int inWidth, int inHeight ) {
+    
+    int lineBytes = inWidth * 3;
+    
+    unsigned char *flippedBytes = new unsigned char[ lineBytes * inHeight ];
+    
+    for( int y=0; y<inHeight; y++ ) {
+        memcpy( &( flippedBytes[ lineBytes * y ] ),
+                &( inRGBBytes[ lineBytes * ( inHeight - y - 1 ) ] ),
+                lineBytes );
+        }
+
+    return new RawRGBAImage( flippedBytes, inWidth, inHeight, 3 );
+    }
+
+
+
+static FrameEncoderQueue *getFrameEncoderQueue() {
+    if( frameEncoderQueue == NULL ) {
+        
+        int numThreads = -1;
+        
+        #ifdef USE_JPEG
+            // JPEG converter goes through a temp file, one frame at a time
+            numThreads = 1;
+        #endif
+
+        FrameDropPolicy policy = frameBlockWhenFull;
+        
+        if( SettingsManager::getIntSetting( "outputAllFramesDropWhenBehind",
+                                            0 ) == 1 ) {
+            policy = frameDropWhenFull;
+            }
+        
+        frameEncoderQueue = new FrameEncoderQueue( &screenShotConverter,
+                                                   numThreads, 8, policy );
+        }
+    return frameEncoderQueue;
+    }
+
+
+
+// blends and queues a frame for output
+// inRGBBytes (rows bottom to top) destroyed by this call
+// inFile destroyed by this call, NULL for frames held for blending
+static void outputFrameBytes( unsigned char *inRGBBytes,
+                              int inWidth, int inHeight,
+                              unsigned int inFrameNumber,
+                              File *inFile ) {
+    
+    unsigned char *rgbBytes = blendOutputFrame( inRGBBytes,
+                                                inWidth * inHeight * 3,
+                                                inFrameNumber );
+    
+    if( rgbBytes == NULL ) {
+        // held for blending
+        return;
+        }
+
+    RawRGBAImage *frame = flipScreenBytes( rgbBytes, inWidth, inHeight );
+    
+    delete [] rgbBytes;
+
+    if( ! getFrameEncoderQueue()->addFrame( frame, inFile ) ) {
+        printf( "Frame encoders falling behind, dropped a frame\n" );
+        }
+    }
+
+
+
+
+// Output frames are read through a pair of pixel buffer objects:
+// each frame is read into one buffer while the previous frame is copied
+// out of the other, so glReadPixels returns without waiting for the
+// frame to finish drawing and the copy finds its pixels already there.
+//
+// Falls back to glReadPixels straight into memory when pixel buffers
+// aren't supported.
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+
+#ifndef RASPBIAN
+
+typedef void (APIENTRY *GenBuffersFunc)( GLsizei inN, GLuint *outBuffers );
+typedef void (APIENTRY *DeleteBuffersFunc)( GLsizei inN, 
+                                             const GLuint *inBuffers );
+typedef void (APIENTRY *BindBufferFunc)( GLenum inTarget, GLuint inBuffer );
+typedef void (APIENTRY *BufferDataFunc)( GLenum inTarget, ptrdiff_t inSize,
+                                         const void *inData, GLenum inUsage );
+typedef void *(APIENTRY *MapBufferFunc)( GLenum inTarget, GLenum inAccess );
+typedef GLboolean (APIENTRY *UnmapBufferFunc)( GLenum inTarget );
+
+static GenBuffersFunc genBuffersFunc = NULL;
+static DeleteBuffersFunc deleteBuffersFunc = NULL;
+static BindBufferFunc bindBufferFunc = NULL;
+static BufferDataFunc bufferDataFunc = NULL;
+static MapBufferFunc mapBufferFunc = NULL;
+static UnmapBufferFunc unmapBufferFunc = NULL;
+
+#endif
+
+
+static char pixelBuffersLoaded = false;
+static char pixelBuffersSupported = false;
+
+static char pixelBuffersMade = false;
+static GLuint pixelBuffers[2];
+static int pixelBufferWidth = 0;
+static int pixelBufferHeight = 0;
+
+// buffer the next frame will be read into
+static int nextPixelBuffer = 0;
+
+// frames read into buffers but not yet copied out
+static char pixelBufferPending[2] = { false, false };
+static unsigned int pixelBufferFrameNumber[2];
+static File *pixelBufferFile[2] = { NULL, NULL };
+
+
+
+static char loadPixelBufferFunctions() {
+    #ifdef RASPBIAN
+        // GLES 1 has no pixel buffers
+        return false;
+    #else
+        const char *extensions = (const char *)glGetString( GL_EXTENSIONS );
+    
+        if( extensions == NULL || 
+            strstr( extensions, "GL_ARB_pixel_buffer_object" ) == NULL ) {
+            return false;
+            }
+    
+        genBuffersFunc = 
+            (GenBuffersFunc)SDL_GL_GetProcAddress( "glGenBuffersARB" );
+        deleteBuffersFunc = 
+            (DeleteBuffersFunc)SDL_GL_GetProcAddress( "glDeleteBuffersARB" );
+        bindBufferFunc = 
+            (BindBufferFunc)SDL_GL_GetProcAddress( "glBindBufferARB" );
+        bufferDataFunc = 
+            (BufferDataFunc)SDL_GL_GetProcAddress( "glBufferDataARB" );
+        mapBufferFunc = 
+            (MapBufferFunc)SDL_GL_GetProcAddress( "glMapBufferARB" );
+        unmapBufferFunc = 
+            (UnmapBufferFunc)SDL_GL_GetProcAddress( "glUnmapBufferARB" );
+    
+        return ( genBuffersFunc != NULL &&
+                 deleteBuffersFunc != NULL &&
+                 bindBufferFunc != NULL &&
+                 bufferDataFunc != NULL &&
+                 mapBufferFunc != NULL &&
+                 unmapBufferFunc != NULL );
+    #endif
+    }
+
+
+
+// copies a pending frame out of its pixel buffer and outputs it
+static void finishPixelBufferFrame( int inIndex ) {
+    if( ! pixelBufferPending[ inIndex ] ) {
+        return;
+        }
+    pixelBufferPending[ inIndex ] = false;
+
+    #ifndef RASPBIAN
+    
+        int numBytes = pixelBufferWidth * pixelBufferHeight * 3;
+
+        bindBufferFunc( GL_PIXEL_PACK_BUFFER, pixelBuffers[ inIndex ] );
+    
+        unsigned char *mapped = 
+            (unsigned char *)mapBufferFunc( GL_PIXEL_PACK_BUFFER, 
+                                            GL_READ_ONLY );
+    
+        if( mapped == NULL ) {
+            bindBufferFunc( GL_PIXEL_PACK_BUFFER, 0 );
+            
+            printf( "Failed to map pixel buffer, frame lost\n" );
+            
+            if( pixelBufferFile[ inIndex ] != NULL ) {
+                delete pixelBufferFile[ inIndex ];
+                }
+            pixelBufferFile[ inIndex ] = NULL;
+            return;
+            }
+        
+        unsigned char *rgbBytes = new unsigned char[ numBytes ];
+        memcpy( rgbBytes, mapped, numBytes );
+        
+        unmapBufferFunc( GL_PIXEL_PACK_BUFFER );
+        bindBufferFunc( GL_PIXEL_PACK_BUFFER, 0 );
+
+        outputFrameBytes( rgbBytes, pixelBufferWidth, pixelBufferHeight,
+                          pixelBufferFrameNumber[ inIndex ],
+                          pixelBufferFile[ inIndex ] );
+        
+        pixelBufferFile[ inIndex ] = NULL;
+    #endif
+    }
+
+
+
+// outputs the frame still waiting in a pixel buffer, if any
+static void flushPixelBuffers() {
+    // older frame first
+    finishPixelBufferFrame( 1 - nextPixelBuffer );
+    finishPixelBufferFrame( nextPixelBuffer );
+    }
+
+
+
+static void freePixelBuffers() {
+    flushPixelBuffers();
+    
+    #ifndef RASPBIAN
+        if( pixelBuffersMade ) {
+            deleteBuffersFunc( 2, pixelBuffers );
+            pixelBuffersMade = false;
+            }
+    #endif
+    }
+
+
+
+// makes sure pixel buffers of the right size exist
+// returns false if they aren't supported
+static char preparePixelBuffers( int inWidth, int inHeight ) {
+    if( ! pixelBuffersLoaded ) {
+        pixelBuffersLoaded = true;
+        pixelBuffersSupported = loadPixelBufferFunctions();
+        
+        if( ! pixelBuffersSupported ) {
+            AppLog::info( 
+                "Pixel buffers not supported, reading frames directly" );
+            }
+        }
+    
+    if( ! pixelBuffersSupported ) {
+        return false;
+        }
+
+    if( pixelBuffersMade &&
+        pixelBufferWidth == inWidth &&
+        pixelBufferHeight == inHeight ) {
+        return true;
+        }
+
+    #ifndef RASPBIAN
+        // screen size changed
+        freePixelBuffers();
+        
+        genBuffersFunc( 2, pixelBuffers );
+    
+        for( int i=0; i<2; i++ ) {
+            bindBufferFunc( GL_PIXEL_PACK_BUFFER, pixelBuffers[i] );
+            bufferDataFunc( GL_PIXEL_PACK_BUFFER, inWidth * inHeight * 3, 
+                            NULL, GL_STREAM_READ );
+            }
+        bindBufferFunc( GL_PIXEL_PACK_BUFFER, 0 );
+        
+        pixelBuffersMade = true;
+        pixelBufferWidth = inWidth;
+        pixelBufferHeight = inHeight;
+        nextPixelBuffer = 0;
+    #endif
+
+    return true;
+    }
+
+
+
+// starts reading the current frame for output, and outputs the frame
+// before it
+// inFile destroyed by this call, NULL for frames held for blending
+static void captureOutputFrame( File *inFile ) {
+    
+    if( ! preparePixelBuffers( screenWidth, screenHeight ) ) {
+        
+        unsigned char *rgbBytes = 
+            readScreenBytes( 0, 0, screenWidth, screenHeight );
+        
+        outputFrameBytes( rgbBytes, screenWidth, screenHeight, 
+                          frameNumber, inFile );
+        return;
+        }
+    
+    #ifndef RASPBIAN
+        int index = nextPixelBuffer;
+
+        bindBufferFunc( GL_PIXEL_PACK_BUFFER, pixelBuffers[ index ] );
+
+        GLint oldAlignment;
+        glGetIntegerv( GL_PACK_ALIGNMENT, &oldAlignment );
+        glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    
+        // with a pack buffer bound, the pointer is an offset into it
+        glReadPixels( 0, 0, screenWidth, screenHeight, 
+                      GL_RGB, GL_UNSIGNED_BYTE, NULL );
+    
+        glPixelStorei( GL_PACK_ALIGNMENT, oldAlignment );
+    
+        bindBufferFunc( GL_PIXEL_PACK_BUFFER, 0 );
+        
+        pixelBufferPending[ index ] = true;
+        pixelBufferFrameNumber[ index ] = frameNumber;
+        pixelBufferFile[ index ] = inFile;
+        
+        nextPixelBuffer = 1 - index;
+        
+        // previous frame has had a whole frame to finish transferring
+        finishPixelBufferFrame( nextPixelBuffer );
+    #endif
+    }
+
+
+
 static int nextShotNumber = -1;
 static char shotDirExists = false;
 
@@ -4717,30 +5221,56 @@ void takeScreenShot() {
         }
     
 
-    Image *screenImage = 
-        getScreenRegionInternal( 0, 0, screenWidth, screenHeight );
-
-    if( screenImage == NULL ) {
-        // a skipped frame due to blending settings
+    if( screenShotImageDest != NULL ) {
+        // skip writing to file
+        Image *screenImage = 
+            getScreenRegionInternal( 0, 0, screenWidth, screenHeight );
+        
         delete file;
         
+        if( screenImage == NULL ) {
+            // a skipped frame due to blending settings
+            return;
+            }
+        
+        *screenShotImageDest = screenImage;
+        
+        nextShotNumber++;
         return;
         }
     
 
-
+    if( outputAllFrames && ! manualScreenShot ) {
+        
+        if( isFrameHeldForBlending( frameNumber ) ) {
+            // a skipped frame due to blending settings, not numbered
+            delete file;
+            
+            captureOutputFrame( NULL );
+            return;
+            }
+        
+        // written later by encoder threads
+        captureOutputFrame( file );
+        
+        nextShotNumber++;
+        return;
+        }
     
     
-    if( screenShotImageDest != NULL ) {
-        // skip writing to file
-        *screenShotImageDest = screenImage;
-        }
-    else {
-        FileOutputStream tgaStream( file );
-        screenShotConverter.formatImage( screenImage, &tgaStream );
-        delete screenImage;
-        }
+    // manual shot, written now
+    unsigned char *rgbBytes = 
+        readScreenBytes( 0, 0, screenWidth, screenHeight );
     
+    RawRGBAImage *screenImage = 
+        flipScreenBytes( rgbBytes, screenWidth, screenHeight );
+    
+    delete [] rgbBytes;
+    
+    FileOutputStream tgaStream( file );
+    screenShotConverter.formatImageRaw( screenImage, &tgaStream );
+    
+    delete screenImage;
     delete file;
 
     nextShotNumber++;
@@ -4965,6 +5495,122 @@ unsigned char *getWebResult( int inHandle, int *outSize ) {
 
 
 
+int startWebStreamRequest( const char *inURL, int inRangeStart ) {
+    
+    WebRequestRecord r;
+    
+    r.handle = nextWebRequestHandle;
+    nextWebRequestHandle ++;
+    
+
+    if( screen->isPlayingBack() ) {
+        // stop here, don't actually start a real web request
+        return r.handle;
+        }
+
+    char *extraHeaders = NULL;
+    
+    if( inRangeStart > 0 ) {
+        extraHeaders = autoSprintf( "Range: bytes=%d-\r\n", inRangeStart );
+        }
+    
+    r.request = new WebRequest( "GET", inURL, NULL, webProxy, -1,
+                                true, extraHeaders );
+    
+    if( extraHeaders != NULL ) {
+        delete [] extraHeaders;
+        }
+    
+    webRequestRecords.push_back( r );
+    
+    return r.handle;
+    }
+
+
+
+unsigned char *getWebStreamBytes( int inHandle, int *outSize ) {
+    *outSize = 0;
+    
+    if( screen->isPlayingBack() ) {
+        // return recorded stream bytes, if any were fetched at this point
+        
+        int nextType = screen->getWebEventType( inHandle );
+        
+        if( nextType == 2 ) {
+            return (unsigned char *)
+                screen->getWebEventResultBody( inHandle, outSize );
+            }
+        
+        return NULL;
+        }
+
+
+    WebRequest *r = getRequestByHandle( inHandle );
+    
+    if( r != NULL ) {
+        unsigned char *result = r->getNewResultBytes( outSize );
+
+        if( result != NULL ) {    
+            screen->registerWebEvent( inHandle,
+                                      // the type for "result" is 2
+                                      2,
+                                      (char*)result,
+                                      *outSize );
+            }
+        
+        return result;
+        }
+    
+    return NULL;
+    }
+
+
+
+int getWebResultStatus( int inHandle ) {
+    if( screen->isPlayingBack() ) {
+        // the status is recorded as a result body
+        
+        int nextType = screen->getWebEventType( inHandle );
+        
+        if( nextType == 2 ) {
+            char *body = screen->getWebEventResultBody( inHandle );
+            
+            int status = -1;
+            
+            if( body != NULL ) {
+                sscanf( body, "%d", &status );
+                delete [] body;
+                }
+            return status;
+            }
+        
+        return -1;
+        }
+
+
+    WebRequest *r = getRequestByHandle( inHandle );
+    
+    if( r != NULL ) {
+        int status = r->getStatusCode();
+        
+        if( status != -1 ) {
+            char *statusString = autoSprintf( "%d", status );
+            
+            screen->registerWebEvent( inHandle,
+                                      // the type for "result" is 2
+                                      2,
+                                      statusString );
+            delete [] statusString;
+            }
+        
+        return status;
+        }
+    
+    return -1;
+    }
+
+
+
 int getWebProgressSize( int inHandle ) {
     if( screen->isPlayingBack() ) {
         // return a recorded server result
@@ -5272,44 +5918,45 @@ void closeSocket( int inHandle ) {
 
 int startAsyncFileRead( const char *inFilePath ) {
     
+    if( asyncFileReader == NULL ) {
+        asyncFileReader = 
+            AsyncFileReader::createReader( &newFileDoneReadingSem );
+        
+        AppLog::infoF( "Reading files asynchronously with %s",
+                       asyncFileReader->getEngineName() );
+        }
+
     int handle = nextAsyncFileHandle;
     nextAsyncFileHandle ++;
     
     AsyncFileRecord r = {
         handle,
-        stringDuplicate( inFilePath ),
         -1,
         NULL,
         false };
 
-    asyncLock.lock();
-    asyncFiles.push_back( r );
-    asyncLock.unlock();
+    addAsyncFileRecord( r );
     
-    newFileToReadSem.signal();
+    asyncFileReader->startRead( handle, inFilePath );
     
     return handle;
     }
 
 
 
-char checkAsyncFileReadDone( int inHandle ) {
+static char isAsyncFileReadDone( int inHandle ) {
+    collectAsyncFileReads();
+    
+    AsyncFileRecord *r = getAsyncFileRecord( inHandle );
 
-    char ready = false;
+    return ( r != NULL && r->doneReading );
+    }
 
-    asyncLock.lock();
 
-    for( int i=0; i<asyncFiles.size(); i++ ) {
-        AsyncFileRecord *r = asyncFiles.getElement( i );
-                    
-        if( r->handle == inHandle &&
-            r->doneReading ) {
-            
-            ready = true;
-            break;
-            }
-        }
-    asyncLock.unlock();
+
+char checkAsyncFileReadDone( int inHandle ) {
+
+    char ready = isAsyncFileReadDone( inHandle );
 
 
     if( screen->isPlayingBack() ) {
@@ -5329,19 +5976,7 @@ char checkAsyncFileReadDone( int inHandle ) {
             while( !ready ) {                
                 newFileDoneReadingSem.wait();
 
-                asyncLock.lock();
-                
-                for( int i=0; i<asyncFiles.size(); i++ ) {
-                    AsyncFileRecord *r = asyncFiles.getElement( i );
-                    
-                    if( r->handle == inHandle &&
-                        r->doneReading ) {
-                        
-                        ready = true;
-                        break;
-                        }
-                    }
-                asyncLock.unlock();
+                ready = isAsyncFileReadDone( inHandle );
                 }
             
             return true;
@@ -5361,27 +5996,18 @@ char checkAsyncFileReadDone( int inHandle ) {
 
 unsigned char *getAsyncFileData( int inHandle, int *outDataLength ) {
 
-    unsigned char *data = NULL;
-    
-    asyncLock.lock();
-
-    for( int i=0; i<asyncFiles.size(); i++ ) {
-        AsyncFileRecord *r = asyncFiles.getElement( i );
-                    
-        if( r->handle == inHandle ) {
-            
-            data = r->data;
-            *outDataLength = r->dataLength;
-            
-            if( r->filePath != NULL ) {
-                delete [] r->filePath;
-                }
+    collectAsyncFileReads();
 
-            asyncFiles.deleteElement( i );
-            break;
-            }
+    AsyncFileRecord *r = getAsyncFileRecord( inHandle );
+    
+    if( r == NULL ) {
+        return NULL;
         }
-    asyncLock.unlock();
+
+    unsigned char *data = r->data;
+    *outDataLength = r->dataLength;
+    
+    removeAsyncFileRecord( r );
 
     return data;
     }
@@ -16,6 +16,41 @@ char SpriteGL::sGenerateMipMaps = false;
 char SpriteGL::sCountingPixels = false;
 double SpriteGL::sPixelsDrawn = 0;
 
+char SpriteGL::sPackIntoAtlas = false;
+TextureAtlasGL *SpriteGL::sAtlas = NULL;
+
+char SpriteGL::sBatching = false;
+
+// GL's initial current color
+float SpriteGL::sDrawColor[4] = { 1, 1, 1, 1 };
+
+
+
+char SpriteGL::packIntoAtlas( unsigned char *inRGBA, 
+                              unsigned int inWidth, unsigned int inHeight,
+                              char inExpandEdges ) {
+    mInAtlas = false;
+    
+    if( !sPackIntoAtlas || sGenerateMipMaps ) {
+        return false;
+        }
+    
+    if( sAtlas == NULL ) {
+        sAtlas = new TextureAtlasGL();
+        }
+    
+    if( inExpandEdges ) {
+        SingleTextureGL::expandEdges( inRGBA, inWidth, inHeight );
+        }
+
+    if( sAtlas->addImage( inRGBA, inWidth, inHeight, &mAtlasRegion ) ) {
+        mTexture = mAtlasRegion.texture;
+        mInAtlas = true;
+        }
+    
+    return mInAtlas;
+    }
+
 
 
 void SpriteGL::findColoredRadii( Image *inImage ) {
@@ -195,8 +230,7 @@ void SpriteGL::initTexture( Image *inImage,
                             int inNumFrames,
                             int inNumPages, char inSetColoredRadii ) {
     
-    mLastSetMinFilter = -1;
-    mLastSetMagFilter = -1;
+    mInAtlas = false;
     
     mColoredRadiusLeftX = 0.5;
     mColoredRadiusRightX = 0.5;
@@ -251,10 +285,21 @@ void SpriteGL::initTexture( Image *inImage,
         }
     
 
-    mTexture = new SingleTextureGL( spriteImage,
-                                    // no wrap
-                                    false,
-                                    sGenerateMipMaps );
+    if( sPackIntoAtlas && !sGenerateMipMaps ) {
+        unsigned char *rgba = RGBAImage::getRGBABytes( spriteImage );
+        
+        packIntoAtlas( rgba, 
+                       spriteImage->getWidth(), spriteImage->getHeight() );
+        
+        delete [] rgba;
+        }
+    
+    if( !mInAtlas ) {
+        mTexture = new SingleTextureGL( spriteImage,
+                                        // no wrap
+                                        false,
+                                        sGenerateMipMaps );
+        }
 
 
     mWidth = spriteImage->getWidth();
@@ -282,8 +327,7 @@ SpriteGL::SpriteGL( unsigned char *inRGBA,
                     int inNumPages,
                     char inSetColoredRadii ) {
 
-    mLastSetMinFilter = -1;
-    mLastSetMagFilter = -1;
+    mInAtlas = false;
     
     mColoredRadiusLeftX = 0.5;
     mColoredRadiusRightX = 0.5;
@@ -297,10 +341,12 @@ SpriteGL::SpriteGL( unsigned char *inRGBA,
         findColoredRadii( inRGBA, inWidth, inHeight );
         }
     
-    mTexture = new SingleTextureGL( inRGBA, inWidth, inHeight,
-                                    // no wrap
-                                    false,
-                                    sGenerateMipMaps );    
+    if( !packIntoAtlas( inRGBA, inWidth, inHeight ) ) {
+        mTexture = new SingleTextureGL( inRGBA, inWidth, inHeight,
+                                        // no wrap
+                                        false,
+                                        sGenerateMipMaps );    
+        }
 
     mWidth = inWidth;
     mHeight = inHeight;
@@ -325,8 +371,7 @@ SpriteGL::SpriteGL( char inAlphaOnly,
                     int inNumPages,
                     char inSetColoredRadii ) {
 
-    mLastSetMinFilter = -1;
-    mLastSetMagFilter = -1;
+    mInAtlas = false;
     
     mColoredRadiusLeftX = 0.5;
     mColoredRadiusRightX = 0.5;
@@ -340,11 +385,32 @@ SpriteGL::SpriteGL( char inAlphaOnly,
         findColoredRadiiAlpha( inA, inWidth, inHeight );
         }
 
-    mTexture = new SingleTextureGL( inAlphaOnly,
-                                    inA, inWidth, inHeight,
-                                    // no wrap
-                                    false,
-                                    sGenerateMipMaps );
+    if( sPackIntoAtlas && !sGenerateMipMaps ) {
+        // atlas is RGBA, and single-channel textures read as black
+        // anyway
+        int numPixels = inWidth * inHeight;
+        
+        unsigned char *rgba = new unsigned char[ numPixels * 4 ];
+        memset( rgba, 0, numPixels * 4 );
+        
+        for( int i=0; i<numPixels; i++ ) {
+            rgba[ i * 4 + 3 ] = inA[i];
+            }
+        
+        packIntoAtlas( rgba, inWidth, inHeight, 
+                       // single-channel textures aren't edge-expanded
+                       false );
+        
+        delete [] rgba;
+        }
+    
+    if( !mInAtlas ) {
+        mTexture = new SingleTextureGL( inAlphaOnly,
+                                        inA, inWidth, inHeight,
+                                        // no wrap
+                                        false,
+                                        sGenerateMipMaps );
+        }
 
     mWidth = inWidth;
     mHeight = inHeight;
@@ -363,8 +429,32 @@ SpriteGL::SpriteGL( char inAlphaOnly,
 
 
 
+double SpriteGL::getBoundingRadius() {
+    double xRadius = mBaseScaleX * 
+        ( mColoredRadiusLeftX > mColoredRadiusRightX ?
+          mColoredRadiusLeftX : mColoredRadiusRightX );
+    
+    double yRadius = mBaseScaleY * 
+        ( mColoredRadiusTopY > mColoredRadiusBottomY ?
+          mColoredRadiusTopY : mColoredRadiusBottomY );
+    
+    return sqrt( xRadius * xRadius + yRadius * yRadius ) +
+        sqrt( mCenterOffset.x * mCenterOffset.x + 
+              mCenterOffset.y * mCenterOffset.y );
+    }
+
+
+
 SpriteGL::~SpriteGL() {
-    delete mTexture;
+    // queued draws might use our texture or atlas region
+    flushBatch();
+    
+    if( mInAtlas ) {
+        sAtlas->releaseRegion( &mAtlasRegion );
+        }
+    else {
+        delete mTexture;
+        }
     }
 
 
@@ -376,6 +466,17 @@ SpriteGL::~SpriteGL() {
 #ifdef GLES
 
 
+void SpriteGL::toggleBatching( char inBatch ) {
+    // not supported, always draw immediately
+    }
+
+
+
+void SpriteGL::flushBatch() {
+    }
+
+
+
 // opt (found with profiler)
 // only construct these once, not every draw call
 GLfloat squareVertices[4*2];
@@ -468,44 +569,7 @@ void SpriteGL::prepareDraw( int inFrame,
 
 
     mTexture->enable();
-    
-    if( inMipMapFilter ) {
-        if( mLastSetMinFilter != 2 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                             GL_LINEAR_MIPMAP_LINEAR );
-            mLastSetMinFilter = 2;
-            }
-        }
-    else {
-        
-        if( inLinearMagFilter ) {
-            if( mLastSetMinFilter != 1 ) {
-                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                                 GL_LINEAR );
-                mLastSetMinFilter = 1;
-                }
-            }
-        else {
-            if( mLastSetMinFilter != 0 ) {
-                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                                 GL_NEAREST );
-                mLastSetMinFilter = 0;
-                }
-            }
-        }
-    
-    if( inLinearMagFilter ) {
-        if( mLastSetMagFilter != 1 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-            mLastSetMagFilter = 1;
-            }
-        }
-    else {
-        if( mLastSetMagFilter != 0 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-            mLastSetMagFilter = 0;
-            }
-        }
+    mTexture->setFiltering( inLinearMagFilter, inMipMapFilter );
     
 
 
@@ -524,6 +588,16 @@ void SpriteGL::prepareDraw( int inFrame,
     textYA += (float)( 0.5 - mColoredRadiusTopY );
     textYB -= (float)( 0.5 - mColoredRadiusBottomY );
 
+    if( mInAtlas ) {
+        textXA = (float)( mAtlasRegion.uOffset + 
+                          textXA * mAtlasRegion.uScale );
+        textXB = (float)( mAtlasRegion.uOffset + 
+                          textXB * mAtlasRegion.uScale );
+        textYA = (float)( mAtlasRegion.vOffset + 
+                          textYA * mAtlasRegion.vScale );
+        textYB = (float)( mAtlasRegion.vOffset + 
+                          textYB * mAtlasRegion.vScale );
+        }
 
 
     squareTextureCoords[0] = textXA;
@@ -552,7 +626,7 @@ void SpriteGL::draw( int inFrame,
     
     
     prepareDraw( inFrame, inPosition, inScale, inLinearMagFilter, 
-                 inMipMapFilter
+                 inMipMapFilter,
                  inRotation, inFlipH );
 
     glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
@@ -777,45 +851,10 @@ void SpriteGL::prepareDraw( int inFrame,
         glColor4f( 1, 1, 1, inFadeFactor );
         }
     */          
-    mTexture->enable();
-    
-
-    if( inMipMapFilter ) {
-        if( mLastSetMinFilter != 2 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                             GL_LINEAR_MIPMAP_LINEAR );
-            mLastSetMinFilter = 2;
-            }
-        }
-    else {
-        
-        if( inLinearMagFilter ) {
-            if( mLastSetMinFilter != 1 ) {
-                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                                 GL_LINEAR );
-                mLastSetMinFilter = 1;
-                }
-            }
-        else {
-            if( mLastSetMinFilter != 0 ) {
-                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
-                                 GL_NEAREST );
-                mLastSetMinFilter = 0;
-                }
-            }
-        }
-    
-    if( inLinearMagFilter ) {
-        if( mLastSetMagFilter != 1 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-            mLastSetMagFilter = 1;
-            }
-        }
-    else {
-        if( mLastSetMagFilter != 0 ) {
-            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-            mLastSetMagFilter = 0;
-            }
+    if( !sBatching ) {
+        // batch sets texture up when flushed
+        mTexture->enable();
+        mTexture->setFiltering( inLinearMagFilter, inMipMapFilter );
         }
 
     
@@ -834,6 +873,13 @@ void SpriteGL::prepareDraw( int inFrame,
     textYB += 0.5 - mColoredRadiusTopY;
     textYA -= 0.5 - mColoredRadiusBottomY;
 
+    if( mInAtlas ) {
+        textXA = mAtlasRegion.uOffset + textXA * mAtlasRegion.uScale;
+        textXB = mAtlasRegion.uOffset + textXB * mAtlasRegion.uScale;
+        textYA = mAtlasRegion.vOffset + textYA * mAtlasRegion.vScale;
+        textYB = mAtlasRegion.vOffset + textYB * mAtlasRegion.vScale;
+        }
+
     squareTextureCoords[0] = textXA;
     squareTextureCoords[1] = textYA;
 
@@ -849,6 +895,124 @@ void SpriteGL::prepareDraw( int inFrame,
 
 
         
+// batched quads are drawn as triangle pairs, since GL_QUADS splits them
+// along the other diagonal, which changes how corner colors are 
+// interpolated
+// short indices limit us to 16384 quads
+#define MAX_BATCH_QUADS 4096
+
+static GLfloat batchVertices[ MAX_BATCH_QUADS * 4 * 2 ];
+static GLfloat batchTextureCoords[ MAX_BATCH_QUADS * 4 * 2 ];
+static GLfloat batchColors[ MAX_BATCH_QUADS * 4 * 4 ];
+
+static GLushort batchIndices[ MAX_BATCH_QUADS * 6 ];
+static char batchIndicesSet = false;
+
+static int batchNumQuads = 0;
+
+// state shared by all queued quads
+static SingleTextureGL *batchTexture = NULL;
+static char batchLinearMagFilter = false;
+static char batchMipMapFilter = false;
+
+
+
+void SpriteGL::toggleBatching( char inBatch ) {
+    if( !inBatch ) {
+        flushBatch();
+        }
+    sBatching = inBatch;
+    
+    if( !batchIndicesSet ) {
+        // same triangles that GL_TRIANGLE_STRIP makes from 4 vertices
+        for( int q=0; q<MAX_BATCH_QUADS; q++ ) {
+            GLushort v = (GLushort)( q * 4 );
+            GLushort *indices = &( batchIndices[ q * 6 ] );
+            
+            indices[0] = v;
+            indices[1] = v + 1;
+            indices[2] = v + 2;
+            
+            indices[3] = v + 2;
+            indices[4] = v + 1;
+            indices[5] = v + 3;
+            }
+        batchIndicesSet = true;
+        }
+    }
+
+
+
+void SpriteGL::flushBatch() {
+    if( batchNumQuads == 0 ) {
+        return;
+        }
+    
+    batchTexture->enable();
+    batchTexture->setFiltering( batchLinearMagFilter, batchMipMapFilter );
+    
+    glVertexPointer( 2, GL_FLOAT, 0, batchVertices );
+    glTexCoordPointer( 2, GL_FLOAT, 0, batchTextureCoords );
+
+    if( !sStateSet ) {    
+        glEnableClientState( GL_VERTEX_ARRAY );
+        glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+        sStateSet = true;
+        }
+
+    glColorPointer( 4, GL_FLOAT, 0, batchColors );
+    glEnableClientState( GL_COLOR_ARRAY );
+    
+    glDrawElements( GL_TRIANGLES, batchNumQuads * 6, 
+                    GL_UNSIGNED_SHORT, batchIndices );
+    
+    glDisableClientState( GL_COLOR_ARRAY );
+
+    // current color is undefined after drawing with a color array
+    glColor4fv( sDrawColor );
+    
+    batchNumQuads = 0;
+    }
+
+
+
+void SpriteGL::addToBatch( char inLinearMagFilter, char inMipMapFilter,
+                           float *inVertexColors ) {
+    
+    if( batchNumQuads > 0 &&
+        ( batchTexture != mTexture ||
+          batchLinearMagFilter != inLinearMagFilter ||
+          batchMipMapFilter != inMipMapFilter ||
+          batchNumQuads == MAX_BATCH_QUADS ) ) {
+        flushBatch();
+        }
+    
+    batchTexture = mTexture;
+    batchLinearMagFilter = inLinearMagFilter;
+    batchMipMapFilter = inMipMapFilter;
+    
+    memcpy( &( batchVertices[ batchNumQuads * 8 ] ), squareVertices,
+            8 * sizeof( GLfloat ) );
+    memcpy( &( batchTextureCoords[ batchNumQuads * 8 ] ), 
+            squareTextureCoords,
+            8 * sizeof( GLfloat ) );
+
+    GLfloat *colors = &( batchColors[ batchNumQuads * 16 ] );
+    
+    if( inVertexColors != NULL ) {
+        memcpy( colors, inVertexColors, 16 * sizeof( GLfloat ) );
+        }
+    else {
+        for( int v=0; v<4; v++ ) {
+            memcpy( &( colors[ v * 4 ] ), sDrawColor, 4 * sizeof( GLfloat ) );
+            }
+        }
+    
+    batchNumQuads++;
+    }
+
+
+
 extern int numPixelsDrawn;
 
 
@@ -868,6 +1032,11 @@ void SpriteGL::draw( int inFrame,
                  inMipMapFilter,
                  inRotation, inFlipH );
 
+    if( sBatching ) {
+        addToBatch( inLinearMagFilter, inMipMapFilter, NULL );
+        return;
+        }
+    
 
     glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
     
@@ -923,15 +1092,6 @@ void SpriteGL::draw( int inFrame,
                  inRotation, inFlipH );
 
 
-    glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
-    glTexCoordPointer( 2, GL_FLOAT, 0, squareTextureCoords );
-    
-    if( !sStateSet ) {    
-        glEnableClientState( GL_VERTEX_ARRAY );
-        glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-        sStateSet = true;
-        }
-
     for( int c=0; c<4; c++ ) {
         
         int cDest = c;
@@ -948,8 +1108,23 @@ void SpriteGL::draw( int inFrame,
         squareColors[ start + 2 ] = inCornerColors[c].b;
         squareColors[ start + 3 ] = inCornerColors[c].a;
         }
+
+    if( sBatching ) {
+        addToBatch( inLinearMagFilter, inMipMapFilter, squareColors );
+        return;
+        }
+
+
+    glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
+    glTexCoordPointer( 2, GL_FLOAT, 0, squareTextureCoords );
     
-    
+    if( !sStateSet ) {    
+        glEnableClientState( GL_VERTEX_ARRAY );
+        glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+        sStateSet = true;
+        }
+
+
     glColorPointer( 4, GL_FLOAT, 0, squareColors );
     glEnableClientState( GL_COLOR_ARRAY );
 
@@ -992,15 +1167,6 @@ void SpriteGL::draw( int inFrame,
     squareVertices[7] = inCornerPos[2].y;
     
     
-    glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
-    glTexCoordPointer( 2, GL_FLOAT, 0, squareTextureCoords );
-    
-    if( !sStateSet ) {    
-        glEnableClientState( GL_VERTEX_ARRAY );
-        glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-        sStateSet = true;
-        }
-
     for( int c=0; c<4; c++ ) {
         
         int cDest = c;
@@ -1017,8 +1183,23 @@ void SpriteGL::draw( int inFrame,
         squareColors[ start + 2 ] = inCornerColors[c].b;
         squareColors[ start + 3 ] = inCornerColors[c].a;
         }
+
+    if( sBatching ) {
+        addToBatch( inLinearMagFilter, inMipMapFilter, squareColors );
+        return;
+        }
+
+
+    glVertexPointer( 2, GL_FLOAT, 0, squareVertices );
+    glTexCoordPointer( 2, GL_FLOAT, 0, squareTextureCoords );
     
-    
+    if( !sStateSet ) {    
+        glEnableClientState( GL_VERTEX_ARRAY );
+        glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+        sStateSet = true;
+        }
+
+
     glColorPointer( 4, GL_FLOAT, 0, squareColors );
     glEnableClientState( GL_COLOR_ARRAY );
 
@@ -3,6 +3,7 @@
 
 
 #include "minorGems/graphics/openGL/SingleTextureGL.h"
+#include "minorGems/graphics/openGL/TextureAtlasGL.h"
 #include "minorGems/game/gameGraphics.h"
 #include "minorGems/game/doublePair.h"
 
@@ -20,7 +21,48 @@ class SpriteGL{
         static void toggleMipMapGeneration( char inGenerateMipMaps ) {
             sGenerateMipMaps = inGenerateMipMaps;
             }
+
+        // packs sprites into shared atlas pages instead of giving each
+        // its own texture
+        // ignored for mipmapped sprites and for sprites too large for 
+        // the atlas
+        static void toggleAtlasPacking( char inPackIntoAtlas ) {
+            sPackIntoAtlas = inPackIntoAtlas;
+            }
+            
+
+
+        // when batching is on, draw calls are queued and drawn together, 
+        // one GL draw call for each run of consecutive sprites that share 
+        // a texture and filter settings
+        // 
+        // Anything else that draws or changes GL state must call 
+        // flushBatch first.
+        //
+        // Not supported for GLES, where sprites are always drawn 
+        // immediately.
+        static void toggleBatching( char inBatch );
+
+        static char isBatching() {
+            return sBatching;
+            }
+        
+        // draws all queued sprites
+        static void flushBatch();
+        
+        
+        // sets the GL color used for subsequent sprite draws
+        // (wraps glColor4f, which queued sprites can't use directly)
+        static void setDrawColor( float inR, float inG, float inB, 
+                                  float inA ) {
+            sDrawColor[0] = inR;
+            sDrawColor[1] = inG;
+            sDrawColor[2] = inB;
+            sDrawColor[3] = inA;
             
+            glColor4f( inR, inG, inB, inA );
+            }
+        
         
 
         // transparent color for RGB images can be taken from lower-left
@@ -141,6 +183,11 @@ class SpriteGL{
         void setCenterOffset( doublePair inOffset ) {
             mCenterOffset = inOffset;
             }
+        
+
+        // radius of a circle around the draw position that contains the
+        // drawn quad at scale 1, for any rotation or flip
+        double getBoundingRadius();
 
 
 
@@ -157,6 +204,8 @@ class SpriteGL{
         
         
         static void setTexturingDisabled() {
+            flushBatch();
+            
             // need to renable client states later
             sStateSet = false;
             SingleTextureGL::disableTexturing();
@@ -171,20 +220,27 @@ class SpriteGL{
         
         static char sCountingPixels;
         static double sPixelsDrawn;
-
-        // -1 for unset, 0 for nearest, 1 for linear, 2 for mipmap
-        int mLastSetMinFilter;
-        
-        // -1 for unset, 0 for nearest, 1 for linear
-        int mLastSetMagFilter;
         
         static char sWrapSet;
 
         static char sStateSet;
         
+        static char sPackIntoAtlas;
+        
+        // shared by all sprites, created when first needed
+        static TextureAtlasGL *sAtlas;
 
+        static char sBatching;
+        
+        static float sDrawColor[4];
+        
+
+        // either our own texture, or an atlas page
         SingleTextureGL *mTexture;
         
+        char mInAtlas;
+        TextureAtlasRegion mAtlasRegion;
+        
         int mNumFrames;
         int mNumPages;
         
@@ -232,6 +288,21 @@ class SpriteGL{
 
 
 
+        // packs RGBA pixels into atlas, if atlas packing is on and they fit
+        // pixels are edge-expanded as SingleTextureGL would, so they
+        // might be modified
+        // returns true if mTexture is now set to an atlas page
+        char packIntoAtlas( unsigned char *inRGBA, 
+                            unsigned int inWidth, unsigned int inHeight,
+                            char inExpandEdges = true );
+        
+        
+        // adds quad set up by prepareDraw to the batch, with colors in
+        // vertex order, or current draw color if inVertexColors is NULL
+        void addToBatch( char inLinearMagFilter, char inMipMapFilter,
+                         float *inVertexColors );
+        
+
         void findColoredRadii( Image *inImage );
         
         void findColoredRadii( unsigned char *inRGBA, 
@@ -101,7 +101,7 @@ void setDrawColor( float inR, float inG, float inB, float inA ) {
         inA *= globalFadeTotal;
         }
         
-    glColor4f( inR, inG, inB, inA );
+    SpriteGL::setDrawColor( inR, inG, inB, inA );
     }
 
 
@@ -126,7 +126,7 @@ FloatColor getDrawColor() {
 void setDrawFade( float inA ) {    
     lastA = inA;
     
-    glColor4f( lastR, lastG, lastB, inA * globalFadeTotal );
+    SpriteGL::setDrawColor( lastR, lastG, lastB, inA * globalFadeTotal );
     }
 
 
@@ -162,6 +162,8 @@ static void setNormalBlend() {
 
 
 void toggleAdditiveBlend( char inAdditive ) {
+    SpriteGL::flushBatch();
+    
     if( inAdditive ) {
         glBlendFunc( GL_SRC_ALPHA, GL_ONE );
         }
@@ -173,6 +175,8 @@ void toggleAdditiveBlend( char inAdditive ) {
 
 
 void toggleMultiplicativeBlend( char inMultiplicative ) {
+    SpriteGL::flushBatch();
+    
     if( inMultiplicative ) {
         glBlendFunc( GL_DST_COLOR, GL_ZERO );
         }
@@ -183,6 +187,8 @@ void toggleMultiplicativeBlend( char inMultiplicative ) {
 
 
 void toggleInvertedBlend( char inInverted ) {
+    SpriteGL::flushBatch();
+    
     if( inInverted ) {
         glBlendFunc( GL_ONE_MINUS_DST_COLOR, GL_ZERO );
         }
@@ -194,6 +200,8 @@ void toggleInvertedBlend( char inInverted ) {
 
 
 void toggleAdditiveTextureColoring( char inAdditive ) {
+    SpriteGL::flushBatch();
+    
     if( inAdditive ) {
         glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD );
         }
@@ -241,6 +249,24 @@ void toggleTransparentCropping( char inCrop ) {
     }
 
 
+
+void toggleSpriteAtlas( char inAtlas ) {
+    SpriteGL::toggleAtlasPacking( inAtlas );
+    }
+
+
+
+void toggleSpriteBatching( char inBatch ) {
+    SpriteGL::toggleBatching( inBatch );
+    }
+
+
+
+void flushSpriteBatch() {
+    SpriteGL::flushBatch();
+    }
+
+
 #ifdef GLES
 // GL ES versions of these functions
 
@@ -528,6 +554,7 @@ void drawTrianglesColor( int inNumTriangles, double inVertices[],
 
 
 void enableScissor( double inX, double inY, double inWidth, double inHeight ) {
+    SpriteGL::flushBatch();
     
     double endX = inX + inWidth;
     double endY = inY + inHeight;
@@ -562,6 +589,7 @@ void enableScissor( double inX, double inY, double inWidth, double inHeight ) {
 
 
 void disableScissor() {
+    SpriteGL::flushBatch();
     glDisable( GL_SCISSOR_TEST );
     }
 
@@ -569,6 +597,8 @@ void disableScissor() {
 
 void startAddingToStencil( char inDrawColorToo, char inAdd,
                            float inMinAlpha ) {
+    SpriteGL::flushBatch();
+    
     if( !inDrawColorToo ) {
         
         // stop updating color
@@ -601,6 +631,8 @@ void startAddingToStencil( char inDrawColorToo, char inAdd,
 
 
 void startDrawingThroughStencil( char inInvertStencil ) {
+    SpriteGL::flushBatch();
+    
     // Re-enable update of color
     glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
     glDisable( GL_ALPHA_TEST );
@@ -629,6 +661,8 @@ void stopStencil() {
 
 
 void disableStencil() {
+    SpriteGL::flushBatch();
+    
     // Re-enable update of color (just in case stencil drawing was not started)
     glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
     glDisable( GL_ALPHA_TEST );
@@ -699,6 +733,13 @@ void setSpriteCenterOffset( SpriteHandle inSprite, doublePair inOffset ) {
 
 
 
+double getSpriteBoundingRadius( SpriteHandle inSprite ) {
+    SpriteGL *sprite = (SpriteGL *)inSprite;
+    return sprite->getBoundingRadius();
+    }
+
+
+
 
 
 void startCountingSpritePixelsDrawn() {
@@ -717,10 +758,12 @@ double  endCountingSpritePixelsDrawn() {
 // instead of keeping an "are we counting" state
 // just set this to zero whenever user asks to start counting
 static double numSpritesDrawn = 0;
+static double numSpritesCulled = 0;
 
 
 void startCountingSpritesDrawn() {
     numSpritesDrawn = 0;
+    numSpritesCulled = 0;
     }
 
 
@@ -731,6 +774,18 @@ double endCountingSpritesDrawn() {
 
 
 
+double endCountingSpritesCulled() {
+    return numSpritesCulled;
+    }
+
+
+
+void countSpritesCulled( int inNumCulled ) {
+    numSpritesCulled += inNumCulled;
+    }
+
+
+
 // profiler found constructor/deconstructor calls were using 1.8% of time
 static Vector3D spritePos( 0, 0, 0 );
 
@@ -787,6 +842,28 @@ void drawSprite( SpriteHandle inSprite, doublePair inCornerPos[4],
 
 
 
+void drawSpriteRun( int inNumSprites, SpriteHandle inSprites[],
+                    doublePair inCenters[], double inZoom ) {
+    char wasBatching = SpriteGL::isBatching();
+    
+    if( !wasBatching ) {
+        SpriteGL::toggleBatching( true );
+        }
+    
+    for( int i=0; i<inNumSprites; i++ ) {
+        if( inSprites[i] != NULL ) {
+            drawSprite( inSprites[i], inCenters[i], inZoom );
+            }
+        }
+
+    if( !wasBatching ) {
+        // flushes the run
+        SpriteGL::toggleBatching( false );
+        }
+    }
+
+
+
 void drawSpriteAlphaOnly( SpriteHandle inSprite, doublePair inCenter, 
                           double inZoom, double inRotation, char inFlipH ) {
 
@@ -796,6 +873,9 @@ void drawSpriteAlphaOnly( SpriteHandle inSprite, doublePair inCenter,
     // http://stackoverflow.com/questions/2485370/
     //      use-only-alpha-channel-of-texture-in-opengl
 
+    // texture mode can't change in the middle of a batch
+    SpriteGL::flushBatch();
+
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
     glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE);
     glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_PREVIOUS);
@@ -807,6 +887,8 @@ void drawSpriteAlphaOnly( SpriteHandle inSprite, doublePair inCenter,
 
     drawSprite( inSprite, inCenter, inZoom, inRotation, inFlipH );
 
+    SpriteGL::flushBatch();
+
     // restore texture mode
     glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
     }
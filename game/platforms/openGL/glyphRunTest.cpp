@@ -0,0 +1,452 @@
+/*
+ * Checks GlyphRunCache against a simple least-recently-used model, with a
+ * table small enough that most runs share hash buckets, then checks that
+ * Font lays out and draws strings the same with its glyph run cache on,
+ * off, and constantly evicting.
+ *
+ * Font needs a GL context for its sprites, and loads graphics/font.ttf
+ * (any TrueType font will do) for non-ASCII characters.  The font sheet
+ * itself is generated here instead of read from a TGA.
+ *
+ * Renders offscreen through EGL, so it runs without a display
+ * (with Mesa, LIBGL_ALWAYS_SOFTWARE=1 forces llvmpipe).
+ */
+
+
+#include "minorGems/game/Font.h"
+#include "minorGems/game/gameGraphics.h"
+#include "minorGems/graphics/openGL/glInclude.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define SCREEN_SIZE 256
+
+
+
+static char startGL() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+
+    #ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if( getPlatformDisplay != NULL ) {
+        display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA,
+                                      EGL_DEFAULT_DISPLAY, NULL );
+        }
+    #endif
+    if( display == EGL_NO_DISPLAY ) {
+        display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+        }
+
+    EGLint major, minor;
+    if( ! eglInitialize( display, &major, &minor ) ) {
+        return false;
+        }
+
+    eglBindAPI( EGL_OPENGL_API );
+
+    EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                  EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                  EGL_RED_SIZE, 8,
+                                  EGL_GREEN_SIZE, 8,
+                                  EGL_BLUE_SIZE, 8,
+                                  EGL_ALPHA_SIZE, 8,
+                                  EGL_STENCIL_SIZE, 8,
+                                  EGL_NONE };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    eglChooseConfig( display, configAttributes, &config, 1, &numConfigs );
+
+    if( numConfigs < 1 ) {
+        return false;
+        }
+
+    EGLint surfaceAttributes[] = { EGL_WIDTH, SCREEN_SIZE,
+                                   EGL_HEIGHT, SCREEN_SIZE,
+                                   EGL_NONE };
+
+    EGLSurface surface =
+        eglCreatePbufferSurface( display, config, surfaceAttributes );
+    EGLContext context =
+        eglCreateContext( display, config, EGL_NO_CONTEXT, NULL );
+
+    if( surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+        ! eglMakeCurrent( display, surface, surface, context ) ) {
+        return false;
+        }
+
+    printf( "Rendering with %s\n", glGetString( GL_RENDERER ) );
+
+    glViewport( 0, 0, SCREEN_SIZE, SCREEN_SIZE );
+    glMatrixMode( GL_PROJECTION );
+    glLoadIdentity();
+    glOrtho( 0, SCREEN_SIZE, 0, SCREEN_SIZE, -1, 1 );
+    glMatrixMode( GL_MODELVIEW );
+    glLoadIdentity();
+
+    glEnable( GL_BLEND );
+    toggleAdditiveBlend( false );
+    glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+
+    return true;
+    }
+
+
+
+// stands in for the platform's TGA loader
+// a 16x16 sheet of 16-pixel characters with ragged edges, so that
+// every character gets its own width and kerning
+Image *readTGAFile( const char *inTGAFileName ) {
+    int cellSize = 16;
+    int sheetSize = cellSize * 16;
+
+    Image *image = new Image( sheetSize, sheetSize, 4, true );
+
+    srand( 99 );
+
+    for( int c=33; c<127; c++ ) {
+        int x0 = ( c % 16 ) * cellSize;
+        int y0 = ( c / 16 ) * cellSize;
+
+        int left = rand() % 6;
+        int right = 10 + rand() % 6;
+
+        for( int y=2; y<14; y++ ) {
+            int rowLeft = left + rand() % 3;
+            int rowRight = right - rand() % 3;
+
+            for( int x=rowLeft; x<rowRight; x++ ) {
+                double v = ( rand() % 4 == 0 ) ? 0.3 : 1.0;
+
+                for( int k=0; k<4; k++ ) {
+                    image->getChannel( k )[ ( y0 + y ) * sheetSize +
+                                            x0 + x ] = v;
+                    }
+                }
+            }
+        }
+
+    return image;
+    }
+
+
+
+// adds a run for inString whose end is inEnd
+static GlyphRun *addRun( GlyphRunCache *inCache, const char *inString,
+                         char inKerning, double inEnd ) {
+    int numChars = strlen( inString );
+
+    unicode *chars = new unicode[ numChars ];
+    double *offsets = new double[ numChars ];
+
+    for( int i=0; i<numChars; i++ ) {
+        chars[i] = (unsigned char)inString[i];
+        offsets[i] = i;
+        }
+
+    return inCache->add( inString, inKerning, numChars, chars, offsets,
+                         inEnd, inEnd );
+    }
+
+
+
+static void testEviction() {
+    GlyphRunCache cache( 3 );
+
+    addRun( &cache, "a", true, 1 );
+    addRun( &cache, "b", true, 2 );
+    addRun( &cache, "c", true, 3 );
+
+    // a becomes most recently used, so b is evicted next
+    check( cache.find( "a", true ) != NULL, "find a" );
+
+    addRun( &cache, "d", true, 4 );
+
+    check( cache.getNumRuns() == 3, "full cache stays full" );
+    check( cache.find( "b", true ) == NULL, "least recently used evicted" );
+    check( cache.find( "a", true ) != NULL, "recently found kept" );
+    check( cache.find( "c", true ) != NULL, "c kept" );
+    check( cache.find( "d", true ) != NULL, "d kept" );
+
+    // same string with other kerning is a different run
+    check( cache.find( "a", false ) == NULL, "kerning is part of key" );
+
+    // leaves c oldest
+    cache.find( "a", true );
+    cache.find( "d", true );
+
+    addRun( &cache, "a", false, 5 );
+
+    check( cache.find( "c", true ) == NULL, "oldest evicted" );
+
+    GlyphRun *kerned = cache.find( "a", true );
+    GlyphRun *unkerned = cache.find( "a", false );
+
+    check( kerned != NULL && kerned->end == 1, "kerned run" );
+    check( unkerned != NULL && unkerned->end == 5, "unkerned run" );
+
+    cache.clear();
+
+    check( cache.getNumRuns() == 0, "clear empties" );
+    check( cache.find( "a", true ) == NULL, "nothing found after clear" );
+
+    addRun( &cache, "e", true, 6 );
+    check( cache.find( "e", true ) != NULL, "add after clear" );
+    }
+
+
+
+// random adds and finds on a cache with only 8 buckets, checked against
+// a list of keys in least-recently-used order
+// evicted runs must be unlinked from the middle of bucket chains as well
+// as the ends, or later finds walk into reused slots
+static void testAgainstModel() {
+    int maxRuns = 4;
+    int numKeys = 12;
+
+    GlyphRunCache cache( maxRuns );
+
+    // oldest first
+    SimpleVector<int> model;
+
+    srand( 4321 );
+
+    int numMismatches = 0;
+
+    for( int i=0; i<20000; i++ ) {
+        int key = rand() % numKeys;
+
+        char *string = autoSprintf( "key %d", key );
+
+        int modelIndex = -1;
+        for( int j=0; j<model.size(); j++ ) {
+            if( model.getElementDirect( j ) == key ) {
+                modelIndex = j;
+                break;
+                }
+            }
+
+        GlyphRun *run = cache.find( string, true );
+
+        if( modelIndex != -1 ) {
+            if( run == NULL || run->end != key ||
+                strcmp( run->string, string ) != 0 ) {
+                numMismatches++;
+                }
+            model.deleteElement( modelIndex );
+            model.push_back( key );
+            }
+        else {
+            if( run != NULL ) {
+                numMismatches++;
+                }
+
+            addRun( &cache, string, true, key );
+
+            if( model.size() == maxRuns ) {
+                model.deleteElement( 0 );
+                }
+            model.push_back( key );
+            }
+
+        if( cache.getNumRuns() != model.size() ) {
+            numMismatches++;
+            }
+
+        delete [] string;
+        }
+
+    check( numMismatches == 0, "cache matches LRU model" );
+    }
+
+
+
+static const char *testStrings[] = {
+    "Hello, World!",
+    "AVATAR Wally",
+    "kerning TEST ok",
+    "",
+    " ",
+    "x",
+    "The quick brown fox",
+    "1234567890",
+    "caf\xc3\xa9 na\xc3\xafve",
+    "\xe4\xbd\xa0\xe5\xa5\xbd abc" };
+
+#define NUM_TEST_STRINGS 10
+
+
+
+static void testLayout( Font *inFont ) {
+    int numMismatches = 0;
+
+    for( int kerning=0; kerning<2; kerning++ ) {
+        inFont->enableKerning( kerning );
+
+        for( int s=0; s<NUM_TEST_STRINGS; s++ ) {
+            for( int a=0; a<3; a++ ) {
+                TextAlignment align = (TextAlignment)a;
+
+                doublePair pos = { 77.77, 5.5 };
+
+                SimpleVector<doublePair> uncached, cached;
+
+                inFont->setGlyphRunCacheSize( 0 );
+
+                double uncachedEnd =
+                    inFont->getCharPos( &uncached, testStrings[s], pos,
+                                        align );
+                double uncachedWidth =
+                    inFont->measureString( testStrings[s] );
+
+                inFont->setGlyphRunCacheSize( 256 );
+
+                // first call fills cache, second reads from it
+                inFont->getCharPos( &cached, testStrings[s], pos, align );
+                cached.deleteAll();
+
+                double cachedEnd =
+                    inFont->getCharPos( &cached, testStrings[s], pos,
+                                        align );
+                double cachedWidth =
+                    inFont->measureString( testStrings[s] );
+
+                if( uncachedEnd != cachedEnd ||
+                    uncachedWidth != cachedWidth ||
+                    uncached.size() != cached.size() ) {
+                    numMismatches++;
+                    continue;
+                    }
+
+                for( int i=0; i<uncached.size(); i++ ) {
+                    doublePair u = uncached.getElementDirect( i );
+                    doublePair c = cached.getElementDirect( i );
+
+                    if( u.x != c.x || u.y != c.y ) {
+                        numMismatches++;
+                        }
+                    }
+                }
+            }
+        }
+
+    inFont->enableKerning( true );
+
+    check( numMismatches == 0, "cached layout matches uncached" );
+    }
+
+
+
+// fills outEnds with the x of each string's end
+static void drawStrings( Font *inFont, double *outEnds ) {
+    glClearColor( 0, 0, 0, 1 );
+    glClear( GL_COLOR_BUFFER_BIT );
+
+    for( int s=0; s<NUM_TEST_STRINGS; s++ ) {
+        doublePair pos = { 128.3, 10.0 + s * 24 };
+
+        setDrawColor( 1, 0.5 + s * 0.04, 1, 0.9 );
+
+        outEnds[s] = inFont->drawString( testStrings[s], pos,
+                                         (TextAlignment)( s % 3 ) );
+        }
+    }
+
+
+
+static unsigned char *readScreen() {
+    unsigned char *pixels = new unsigned char[ SCREEN_SIZE * SCREEN_SIZE * 4 ];
+
+    glFinish();
+    glReadPixels( 0, 0, SCREEN_SIZE, SCREEN_SIZE, GL_RGBA, GL_UNSIGNED_BYTE,
+                  pixels );
+    return pixels;
+    }
+
+
+
+static void testDrawing( Font *inFont ) {
+    double uncachedEnds[ NUM_TEST_STRINGS ];
+    double cachedEnds[ NUM_TEST_STRINGS ];
+    double evictingEnds[ NUM_TEST_STRINGS ];
+
+    inFont->setGlyphRunCacheSize( 0 );
+    drawStrings( inFont, uncachedEnds );
+    unsigned char *uncached = readScreen();
+
+    inFont->setGlyphRunCacheSize( 256 );
+    drawStrings( inFont, cachedEnds );
+    drawStrings( inFont, cachedEnds );
+    unsigned char *cached = readScreen();
+
+    // smaller than the number of strings, so every draw misses
+    inFont->setGlyphRunCacheSize( 3 );
+    drawStrings( inFont, evictingEnds );
+    drawStrings( inFont, evictingEnds );
+    unsigned char *evicting = readScreen();
+
+    int numBytes = SCREEN_SIZE * SCREEN_SIZE * 4;
+
+    check( memcmp( uncached, cached, numBytes ) == 0,
+           "cached draw matches uncached" );
+    check( memcmp( uncached, evicting, numBytes ) == 0,
+           "evicting draw matches uncached" );
+
+    int numEndMismatches = 0;
+    for( int s=0; s<NUM_TEST_STRINGS; s++ ) {
+        if( cachedEnds[s] != uncachedEnds[s] ||
+            evictingEnds[s] != uncachedEnds[s] ) {
+            numEndMismatches++;
+            }
+        }
+    check( numEndMismatches == 0, "drawString return values match" );
+
+    delete [] uncached;
+    delete [] cached;
+    delete [] evicting;
+
+    inFont->setGlyphRunCacheSize( 256 );
+    }
+
+
+
+int main() {
+
+    testEviction();
+    testAgainstModel();
+
+
+    File fontFile( NULL, "graphics/font.ttf" );
+
+    if( ! fontFile.exists() ) {
+        printf( "graphics/font.ttf not found, skipping Font checks\n" );
+        }
+    else if( ! startGL() ) {
+        printf( "Couldn't set up an offscreen GL context, "
+                "skipping Font checks\n" );
+        }
+    else {
+        Font *font = new Font( "font.tga", 2, 8, false, 16 );
+        font->setMinimumPositionPrecision( 0.5 );
+
+        testLayout( font );
+        testDrawing( font );
+
+        delete font;
+        }
+
+
+    return reportChecks();
+    }
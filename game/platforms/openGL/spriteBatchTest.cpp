@@ -0,0 +1,390 @@
+/*
+ * Draws the same sprite scene with and without atlas packing and batching,
+ * checking that the rendered pixels match, then measures sprites per frame.
+ *
+ * Atlas sprites are only compared against separate sprites in a scene 
+ * drawn away from texel boundaries:  where a pixel center falls exactly 
+ * between two texels, nearest-neighbor sampling can round either way 
+ * depending on texture size, and linear filtering weights can differ in 
+ * their last bit.
+ *
+ * Renders offscreen through EGL, so it runs without a display
+ * (with Mesa, LIBGL_ALWAYS_SOFTWARE=1 forces llvmpipe).
+ */
+
+
+#include "minorGems/game/gameGraphics.h"
+#include "minorGems/graphics/openGL/glInclude.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SCREEN_SIZE 256
+
+#define NUM_SPRITES 24
+
+
+
+static char startGL() {
+    EGLDisplay display = EGL_NO_DISPLAY;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+
+    #ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if( getPlatformDisplay != NULL ) {
+        display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA,
+                                      EGL_DEFAULT_DISPLAY, NULL );
+        }
+    #endif
+    if( display == EGL_NO_DISPLAY ) {
+        display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+        }
+
+    EGLint major, minor;
+    if( ! eglInitialize( display, &major, &minor ) ) {
+        return false;
+        }
+
+    eglBindAPI( EGL_OPENGL_API );
+
+    EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                  EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                  EGL_RED_SIZE, 8,
+                                  EGL_GREEN_SIZE, 8,
+                                  EGL_BLUE_SIZE, 8,
+                                  EGL_ALPHA_SIZE, 8,
+                                  EGL_STENCIL_SIZE, 8,
+                                  EGL_NONE };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    eglChooseConfig( display, configAttributes, &config, 1, &numConfigs );
+
+    if( numConfigs < 1 ) {
+        return false;
+        }
+
+    EGLint surfaceAttributes[] = { EGL_WIDTH, SCREEN_SIZE,
+                                   EGL_HEIGHT, SCREEN_SIZE,
+                                   EGL_NONE };
+
+    EGLSurface surface =
+        eglCreatePbufferSurface( display, config, surfaceAttributes );
+    EGLContext context =
+        eglCreateContext( display, config, EGL_NO_CONTEXT, NULL );
+
+    if( surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+        ! eglMakeCurrent( display, surface, surface, context ) ) {
+        return false;
+        }
+
+    printf( "Rendering with %s\n", glGetString( GL_RENDERER ) );
+
+    glViewport( 0, 0, SCREEN_SIZE, SCREEN_SIZE );
+    glMatrixMode( GL_PROJECTION );
+    glLoadIdentity();
+    glOrtho( 0, SCREEN_SIZE, 0, SCREEN_SIZE, -1, 1 );
+    glMatrixMode( GL_MODELVIEW );
+    glLoadIdentity();
+
+    glEnable( GL_BLEND );
+    toggleAdditiveBlend( false );
+    glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+
+    return true;
+    }
+
+
+
+// a mix of sizes, with soft edges, transparent borders, and
+// alpha-only sprites
+static void loadSprites( SpriteHandle *outSprites ) {
+    srand( 1234 );
+
+    for( int i=0; i<NUM_SPRITES; i++ ) {
+        int w = 4 + rand() % 40;
+        int h = 4 + rand() % 40;
+
+        if( i == NUM_SPRITES - 1 ) {
+            // too big for atlas
+            w = 300;
+            h = 20;
+            }
+
+        if( i % 6 == 5 ) {
+            unsigned char *a = new unsigned char[ w * h ];
+            for( int p=0; p<w * h; p++ ) {
+                a[p] = (unsigned char)( rand() % 256 );
+                }
+            outSprites[i] = fillSpriteAlphaOnly( a, w, h );
+            delete [] a;
+            continue;
+            }
+
+        unsigned char *rgba = new unsigned char[ w * h * 4 ];
+
+        for( int y=0; y<h; y++ ) {
+            for( int x=0; x<w; x++ ) {
+                unsigned char *p = &( rgba[ ( y * w + x ) * 4 ] );
+
+                p[0] = (unsigned char)( rand() % 256 );
+                p[1] = (unsigned char)( rand() % 256 );
+                p[2] = (unsigned char)( rand() % 256 );
+                p[3] = 255;
+
+                if( i % 3 == 1 ) {
+                    p[3] = (unsigned char)( rand() % 256 );
+                    }
+                else if( i % 3 == 2 &&
+                         ( x == 0 || y == 0 || x == w - 1 || y == h - 1 ) ) {
+                    // transparent border, for edge expansion
+                    p[3] = 0;
+                    }
+                }
+            }
+
+        outSprites[i] = fillSprite( rgba, w, h );
+        delete [] rgba;
+        }
+    }
+
+
+
+// if inMixed is false, only plain, unfiltered sprites are drawn, offset
+// so that pixel centers don't land on texel boundaries
+static void drawScene( SpriteHandle *inSprites, int inNumDraws, 
+                       char inMixed ) {
+    glClearColor( 0.2f, 0.3f, 0.4f, 1 );
+    glClear( GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+
+    srand( 5678 );
+
+    for( int i=0; i<inNumDraws; i++ ) {
+        SpriteHandle sprite = inSprites[ rand() % NUM_SPRITES ];
+
+        doublePair pos = { (double)( rand() % SCREEN_SIZE ),
+                           (double)( rand() % SCREEN_SIZE ) };
+
+        int kind = rand() % 16;
+
+        if( ! inMixed ) {
+            pos.x += 0.25;
+            pos.y += 0.25;
+            if( kind < 5 ) {
+                kind = 7;
+                }
+            }
+
+        setDrawColor( ( rand() % 256 ) / 255.0f,
+                      ( rand() % 256 ) / 255.0f,
+                      ( rand() % 256 ) / 255.0f,
+                      ( rand() % 256 ) / 255.0f );
+
+        if( kind == 0 ) {
+            FloatColor corners[4] = { { 1, 0, 0, 1 }, { 0, 1, 0, 0.5f },
+                                      { 0, 0, 1, 1 }, { 1, 1, 1, 0.25f } };
+            drawSprite( sprite, pos, corners, 1.5, 0.1 );
+            }
+        else if( kind == 1 ) {
+            doublePair corners[4] = { pos,
+                                      { pos.x + 30, pos.y + 5 },
+                                      { pos.x + 25, pos.y + 40 },
+                                      { pos.x - 3, pos.y + 20 } };
+            FloatColor colors[4] = { { 1, 1, 1, 1 }, { 1, 0.5f, 1, 1 },
+                                     { 0.5f, 1, 1, 1 }, { 1, 1, 0.5f, 1 } };
+            drawSprite( sprite, corners, colors );
+            }
+        else if( kind == 2 ) {
+            drawSpriteAlphaOnly( sprite, pos, 2 );
+            }
+        else if( kind == 3 ) {
+            double verts[8] = { pos.x, pos.y, pos.x + 10, pos.y,
+                                pos.x + 10, pos.y + 10, pos.x, pos.y + 10 };
+            drawQuads( 1, verts );
+            }
+        else if( kind == 4 ) {
+            toggleLinearMagFilter( ! getLinearMagFilterOn() );
+            drawSprite( sprite, pos, 2.5, 0.3, true );
+            }
+        else if( kind == 5 ) {
+            toggleAdditiveBlend( rand() % 2 );
+            drawSprite( sprite, pos );
+            }
+        else if( kind == 6 ) {
+            setDrawFade( 0.5f );
+            
+            // minified pixel centers hit texel boundaries
+            double zoom = inMixed ? 0.75 : 2;
+            drawSprite( sprite, pos, zoom );
+            }
+        else {
+            drawSprite( sprite, pos, 1, 0, rand() % 2 );
+            }
+        }
+
+    toggleAdditiveBlend( false );
+    toggleLinearMagFilter( false );
+
+    flushSpriteBatch();
+    }
+
+
+
+static unsigned char *readPixels() {
+    unsigned char *pixels =
+        new unsigned char[ SCREEN_SIZE * SCREEN_SIZE * 4 ];
+
+    glReadPixels( 0, 0, SCREEN_SIZE, SCREEN_SIZE, GL_RGBA,
+                  GL_UNSIGNED_BYTE, pixels );
+    return pixels;
+    }
+
+
+
+static int countDifferences( unsigned char *inA, unsigned char *inB ) {
+    int numDifferent = 0;
+
+    for( int i=0; i<SCREEN_SIZE * SCREEN_SIZE; i++ ) {
+        if( memcmp( &( inA[ i * 4 ] ), &( inB[ i * 4 ] ), 4 ) != 0 ) {
+            numDifferent++;
+            }
+        }
+    return numDifferent;
+    }
+
+
+
+static void freeSprites( SpriteHandle *inSprites ) {
+    for( int i=0; i<NUM_SPRITES; i++ ) {
+        freeSprite( inSprites[i] );
+        }
+    }
+
+
+
+static double timeFrames( SpriteHandle *inSprites, int inSpritesPerFrame,
+                          char inMixed ) {
+    int numFrames = 5;
+
+    drawScene( inSprites, inSpritesPerFrame, inMixed );
+    glFinish();
+
+    double start = Time::getCurrentTime();
+
+    for( int f=0; f<numFrames; f++ ) {
+        drawScene( inSprites, inSpritesPerFrame, inMixed );
+        glFinish();
+        }
+
+    return ( Time::getCurrentTime() - start ) / numFrames;
+    }
+
+
+
+static void timeAll( SpriteHandle *inSeparate, SpriteHandle *inPacked,
+                     int inSpritesPerFrame, char inMixed ) {
+    
+    double immediateTime = timeFrames( inSeparate, inSpritesPerFrame, 
+                                       inMixed );
+
+    toggleSpriteBatching( true );
+    double batchedTime = timeFrames( inSeparate, inSpritesPerFrame, 
+                                     inMixed );
+    double atlasTime = timeFrames( inPacked, inSpritesPerFrame, inMixed );
+    toggleSpriteBatching( false );
+
+    printf( "%d %s sprites per frame:  immediate %.1f ms, "
+            "batched %.1f ms, batched with atlas %.1f ms\n",
+            inSpritesPerFrame, inMixed ? "mixed" : "plain",
+            immediateTime * 1000, batchedTime * 1000, atlasTime * 1000 );
+    }
+
+
+
+int main() {
+
+    if( ! startGL() ) {
+        printf( "Couldn't set up an offscreen GL context\n" );
+        return 1;
+        }
+
+    SpriteHandle separate[ NUM_SPRITES ];
+    SpriteHandle packed[ NUM_SPRITES ];
+
+    loadSprites( separate );
+
+    toggleSpriteAtlas( true );
+    loadSprites( packed );
+    toggleSpriteAtlas( false );
+
+
+    int numDraws = 2000;
+
+    drawScene( separate, numDraws, true );
+    unsigned char *reference = readPixels();
+
+    drawScene( separate, numDraws, false );
+    unsigned char *plainReference = readPixels();
+
+
+    toggleSpriteBatching( true );
+
+    drawScene( separate, numDraws, true );
+    unsigned char *batched = readPixels();
+    check( countDifferences( reference, batched ) == 0,
+           "batched matches unbatched" );
+
+    drawScene( packed, numDraws, true );
+    unsigned char *packedBatched = readPixels();
+
+    drawScene( packed, numDraws, false );
+    unsigned char *packedPlain = readPixels();
+    check( countDifferences( plainReference, packedPlain ) == 0,
+           "atlas sprites match separate sprites" );
+
+    toggleSpriteBatching( false );
+
+    drawScene( packed, numDraws, true );
+    unsigned char *packedUnbatched = readPixels();
+    check( countDifferences( packedUnbatched, packedBatched ) == 0,
+           "batched atlas sprites match unbatched" );
+
+
+    // freeing everything empties atlas pages for reuse
+    freeSprites( packed );
+    toggleSpriteAtlas( true );
+    loadSprites( packed );
+    toggleSpriteAtlas( false );
+
+    drawScene( packed, numDraws, false );
+    unsigned char *reloaded = readPixels();
+    check( countDifferences( plainReference, reloaded ) == 0,
+           "atlas sprites match after reload" );
+
+
+    timeAll( separate, packed, 10000, false );
+    timeAll( separate, packed, 10000, true );
+
+
+    delete [] reference;
+    delete [] plainReference;
+    delete [] packedPlain;
+    delete [] batched;
+    delete [] packedBatched;
+    delete [] packedUnbatched;
+    delete [] reloaded;
+
+    freeSprites( separate );
+    freeSprites( packed );
+
+
+    return reportChecks();
+    }
@@ -0,0 +1,401 @@
+/*
+ * Checks that SpriteLayer draws exactly the instances that overlap the 
+ * view, in depth order, through moves, removals and oversize instances,
+ * and measures culling cost for a large world.
+ *
+ * The gameGraphics functions that SpriteLayer uses are stubbed here to
+ * record draws, so no GL context is needed.
+ */
+
+
+#include "minorGems/game/SpriteLayer.h"
+#include "minorGems/game/game.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+// stubs standing in for a platform
+
+typedef struct TestSprite {
+        double radius;
+    } TestSprite;
+
+
+typedef struct DrawRecord {
+        SpriteHandle sprite;
+        doublePair pos;
+        double zoom;
+        FloatColor color;
+    } DrawRecord;
+
+
+static SimpleVector<DrawRecord> drawn;
+
+static FloatColor drawColor = { 1, 1, 1, 1 };
+
+static double numCulled = 0;
+
+static doublePair viewLowerLeft = { 0, 0 };
+static doublePair viewUpperRight = { 100, 100 };
+
+
+
+double getSpriteBoundingRadius( SpriteHandle inSprite ) {
+    return ( (TestSprite *)inSprite )->radius;
+    }
+
+
+void drawSprite( SpriteHandle inSprite, doublePair inCenter, 
+                 double inZoom, double inRotation, char inFlipH ) {
+    DrawRecord r = { inSprite, inCenter, inZoom, drawColor };
+    drawn.push_back( r );
+    }
+
+
+void setDrawColor( FloatColor inColor ) {
+    drawColor = inColor;
+    }
+
+
+FloatColor getDrawColor() {
+    return drawColor;
+    }
+
+
+void countSpritesCulled( int inNumCulled ) {
+    numCulled += inNumCulled;
+    }
+
+
+void getViewRect( doublePair *outLowerLeft, doublePair *outUpperRight ) {
+    *outLowerLeft = viewLowerLeft;
+    *outUpperRight = viewUpperRight;
+    }
+
+
+
+// what the layer should hold, kept the simple way
+
+#define MAX_IDS 20000
+
+typedef struct MirrorInstance {
+        char live;
+        SpriteHandle sprite;
+        doublePair pos;
+        double zoom;
+        double depth;
+        unsigned int sequence;
+        FloatColor color;
+    } MirrorInstance;
+
+
+static MirrorInstance mirror[ MAX_IDS ];
+
+static unsigned int nextSequence = 0;
+
+
+
+static double randRange( double inLow, double inHigh ) {
+    return inLow + ( inHigh - inLow ) * ( rand() / (double)RAND_MAX );
+    }
+
+
+
+static int addBoth( SpriteLayer *inLayer, SpriteHandle inSprite,
+                    doublePair inPos, double inZoom, double inDepth ) {
+    int id = inLayer->addInstance( inSprite, inPos, inZoom, 0, false, 
+                                   inDepth );
+    
+    MirrorInstance m = { true, inSprite, inPos, inZoom, inDepth,
+                         nextSequence, { 1, 1, 1, 1 } };
+    nextSequence++;
+    
+    if( id >= 0 && id < MAX_IDS ) {
+        mirror[id] = m;
+        }
+    return id;
+    }
+
+
+
+static int compareMirror( const void *inA, const void *inB ) {
+    const MirrorInstance *a = &( mirror[ *(const int *)inA ] );
+    const MirrorInstance *b = &( mirror[ *(const int *)inB ] );
+
+    if( a->depth != b->depth ) {
+        return a->depth < b->depth ? -1 : 1;
+        }
+    return a->sequence < b->sequence ? -1 : 1;
+    }
+
+
+
+// draws through the layer and compares with a brute-force pass
+static void checkDraw( SpriteLayer *inLayer, doublePair inLowerLeft,
+                       doublePair inUpperRight, const char *inDescription ) {
+    int expected[ MAX_IDS ];
+    int numExpected = 0;
+    int numLive = 0;
+    
+    for( int i=0; i<MAX_IDS; i++ ) {
+        MirrorInstance *m = &( mirror[i] );
+        
+        if( ! m->live ) {
+            continue;
+            }
+        numLive++;
+        
+        double r = getSpriteBoundingRadius( m->sprite ) * fabs( m->zoom );
+        
+        if( m->pos.x + r >= inLowerLeft.x && m->pos.x - r <= inUpperRight.x &&
+            m->pos.y + r >= inLowerLeft.y && m->pos.y - r <= inUpperRight.y ) {
+            expected[ numExpected ] = i;
+            numExpected++;
+            }
+        }
+    
+    qsort( expected, numExpected, sizeof( int ), compareMirror );
+    
+    
+    drawn.deleteAll();
+    numCulled = 0;
+    
+    FloatColor base = { 0.5, 1, 1, 0.5 };
+    drawColor = base;
+    
+    int numDrawn = inLayer->draw( inLowerLeft, inUpperRight );
+    
+    char match = ( numDrawn == numExpected && drawn.size() == numExpected );
+    
+    for( int i=0; i<numExpected && match; i++ ) {
+        MirrorInstance *m = &( mirror[ expected[i] ] );
+        DrawRecord *d = drawn.getElement( i );
+        
+        if( d->sprite != m->sprite || 
+            d->pos.x != m->pos.x || d->pos.y != m->pos.y ||
+            d->zoom != m->zoom ||
+            d->color.r != m->color.r * base.r ||
+            d->color.a != m->color.a * base.a ) {
+            match = false;
+            }
+        }
+    
+    check( match, inDescription );
+    check( numCulled == numLive - numExpected, "culled count" );
+    check( inLayer->getNumInstances() == numLive, "instance count" );
+    check( drawColor.r == base.r && drawColor.a == base.a, 
+           "draw color restored" );
+    }
+
+
+
+static doublePair randPos( double inLow, double inHigh ) {
+    doublePair p = { randRange( inLow, inHigh ), randRange( inLow, inHigh ) };
+    return p;
+    }
+
+
+
+static void checkRandomViews( SpriteLayer *inLayer, int inNumViews, 
+                              const char *inDescription ) {
+    for( int v=0; v<inNumViews; v++ ) {
+        doublePair ll = randPos( -150, 1050 );
+        doublePair size = randPos( 1, 400 );
+        doublePair ur = add( ll, size );
+        
+        checkDraw( inLayer, ll, ur, inDescription );
+        }
+    }
+
+
+
+static void timeCulling() {
+    // large world map, small view
+    TestSprite tile = { 10 };
+    
+    doublePair worldLL = { 0, 0 };
+    doublePair worldUR = { 20000, 20000 };
+    
+    SpriteLayer layer( worldLL, worldUR, 100 );
+    
+    SimpleVector<doublePair> positions;
+    
+    for( int y=0; y<20000; y+=40 ) {
+        for( int x=0; x<20000; x+=40 ) {
+            doublePair p = { (double)x, (double)y };
+            layer.addInstance( &tile, p );
+            positions.push_back( p );
+            }
+        }
+    
+    int numInstances = positions.size();
+    int numFrames = 200;
+    
+    
+    // what game code does without the layer:  submit everything, 
+    // here with the cheapest possible test standing in for GL clipping
+    double startTime = Time::getCurrentTime();
+    
+    int numDrawnNaive = 0;
+    
+    for( int f=0; f<numFrames; f++ ) {
+        drawn.deleteAll();
+        doublePair ll = { 5000.0 + f * 10, 7000 };
+        doublePair ur = { ll.x + 1000, ll.y + 750 };
+        
+        for( int i=0; i<numInstances; i++ ) {
+            doublePair p = positions.getElementDirectFast( i );
+            
+            if( p.x + tile.radius >= ll.x && p.x - tile.radius <= ur.x &&
+                p.y + tile.radius >= ll.y && p.y - tile.radius <= ur.y ) {
+                drawSprite( &tile, p, 1, 0, false );
+                numDrawnNaive++;
+                }
+            }
+        }
+    
+    double naiveTime = Time::getCurrentTime() - startTime;
+    
+    
+    startTime = Time::getCurrentTime();
+    
+    int numDrawn = 0;
+    
+    for( int f=0; f<numFrames; f++ ) {
+        drawn.deleteAll();
+        doublePair ll = { 5000.0 + f * 10, 7000 };
+        doublePair ur = { ll.x + 1000, ll.y + 750 };
+        numDrawn += layer.draw( ll, ur );
+        }
+    
+    double layerTime = Time::getCurrentTime() - startTime;
+    
+    check( numDrawn == numDrawnNaive, "timed draw count" );
+    
+    printf( "%d instances, %d in view:  "
+            "%.3f ms per frame testing every instance, "
+            "%.3f ms per frame with layer\n",
+            numInstances, numDrawn / numFrames,
+            1000 * naiveTime / numFrames, 1000 * layerTime / numFrames );
+    }
+
+
+
+int main() {
+    srand( 5678 );
+    
+    TestSprite sprites[4] = { { 3 }, { 10 }, { 30 }, { 2000 } };
+    
+    doublePair worldLL = { 0, 0 };
+    doublePair worldUR = { 1000, 1000 };
+    
+    SpriteLayer layer( worldLL, worldUR, 50 );
+    
+    SimpleVector<int> ids;
+    
+    for( int i=0; i<3000; i++ ) {
+        // some outside of grid
+        doublePair p = randPos( -100, 1100 );
+        
+        int s = rand() % 3;
+        if( i % 500 == 0 ) {
+            // a backdrop, too big for grid cells
+            s = 3;
+            }
+        
+        ids.push_back( addBoth( &layer, &( sprites[s] ), p,
+                                randRange( 0.5, 2 ),
+                                // mostly on one depth, so sequence matters
+                                ( rand() % 4 == 0 ) ? rand() % 5 : 0 ) );
+        }
+    
+    checkRandomViews( &layer, 100, "static instances" );
+    
+    
+    // move some, several times per frame
+    for( int f=0; f<20; f++ ) {
+        for( int i=0; i<200; i++ ) {
+            int id = ids.getElementDirect( rand() % ids.size() );
+            
+            for( int k=0; k<3; k++ ) {
+                doublePair p = randPos( -100, 1100 );
+                layer.setInstancePosition( id, p );
+                mirror[id].pos = p;
+                }
+            
+            if( rand() % 4 == 0 ) {
+                double z = randRange( 0.25, 3 );
+                layer.setInstanceZoom( id, z );
+                mirror[id].zoom = z;
+                }
+            if( rand() % 4 == 0 ) {
+                double d = rand() % 5;
+                layer.setInstanceDepth( id, d );
+                mirror[id].depth = d;
+                }
+            if( rand() % 4 == 0 ) {
+                FloatColor c = { 0.25, 1, 1, 0.75 };
+                layer.setInstanceColor( id, c );
+                mirror[id].color = c;
+                }
+            }
+        checkRandomViews( &layer, 5, "moved instances" );
+        }
+    
+    
+    // remove half, including some that are dirty, then add more
+    for( int i=0; i<ids.size(); i+=2 ) {
+        int id = ids.getElementDirect( i );
+        
+        if( i % 6 == 0 ) {
+            layer.setInstancePosition( id, randPos( 0, 1000 ) );
+            }
+        layer.removeInstance( id );
+        mirror[id].live = false;
+        }
+    
+    checkRandomViews( &layer, 50, "after removal" );
+    
+    for( int i=0; i<1000; i++ ) {
+        addBoth( &layer, &( sprites[ rand() % 3 ] ), randPos( 0, 1000 ),
+                 1, rand() % 3 );
+        }
+    
+    checkRandomViews( &layer, 50, "reused IDs" );
+    
+    
+    // sprite bounds changed behind the layer's back
+    sprites[0].radius = 40;
+    layer.markAllDirty();
+    checkRandomViews( &layer, 50, "after markAllDirty" );
+    
+    
+    // whole grid, and views entirely outside it
+    checkDraw( &layer, worldLL, worldUR, "whole grid" );
+    
+    doublePair farLL = { 5000, 5000 };
+    doublePair farUR = { 6000, 6000 };
+    checkDraw( &layer, farLL, farUR, "far outside grid" );
+    
+    
+    drawn.deleteAll();
+    check( layer.draw() == layer.draw( viewLowerLeft, viewUpperRight ),
+           "draw uses view rect" );
+    
+    
+    layer.removeAllInstances();
+    for( int i=0; i<MAX_IDS; i++ ) {
+        mirror[i].live = false;
+        }
+    checkDraw( &layer, worldLL, worldUR, "empty layer" );
+    
+    
+    timeCulling();
+
+
+    return reportChecks();
+    }
@@ -312,6 +312,9 @@ class Image : public Serializable {
 		// implement the Serializable interface
 		virtual int serialize( OutputStream *inOutputStream );
 		virtual int deserialize( InputStream *inInputStream );
+
+		virtual void serializeBinary( BinaryWriter *inWriter );
+		virtual char deserializeBinary( BinaryReader *inReader );
 	
 	protected:
 		long mWide, mHigh, mNumPixels, mNumChannels;
@@ -813,6 +816,77 @@ inline int Image::deserialize( InputStream *inInputStream ) {
 
 
 
+inline void Image::serializeBinary( BinaryWriter *inWriter ) {
+	inWriter->writeUVarint( mWide );
+	inWriter->writeUVarint( mHigh );
+	inWriter->writeUVarint( mNumChannels );
+
+	unsigned char *byteArray = new unsigned char[ mNumPixels ];
+
+	// same 8-bit quantization as serialize
+	for( int i=0; i<mNumChannels; i++ ) {
+		double *channel = mChannels[i];
+
+		for( int p=0; p<mNumPixels; p++ ) {
+			byteArray[p] = (unsigned char)( lrint( channel[p] * 255 ) );
+			}
+		inWriter->write( byteArray, mNumPixels );
+		}
+
+	delete [] byteArray;
+	}
+
+
+
+inline char Image::deserializeBinary( BinaryReader *inReader ) {
+	uint64_t wide = inReader->readUVarint();
+	uint64_t high = inReader->readUVarint();
+	uint64_t numChannels = inReader->readUVarint();
+
+	if( ! inReader->isOK() ||
+		wide > 65536 || high > 65536 || numChannels > 256 ) {
+		return false;
+		}
+
+	long numPixels = (long)( wide * high );
+
+	if( numPixels * (long)numChannels > inReader->getNumRemaining() ) {
+		return false;
+		}
+
+	for( int i=0; i<mNumChannels; i++ ) {
+		delete [] mChannels[i];
+		}
+	delete [] mChannels;
+
+	mWide = (long)wide;
+	mHigh = (long)high;
+	mNumPixels = numPixels;
+	mNumChannels = (long)numChannels;
+
+	mChannels = new double*[ mNumChannels ];
+
+	unsigned char *byteArray = new unsigned char[ mNumPixels ];
+
+	for( int i=0; i<mNumChannels; i++ ) {
+		mChannels[i] = new double[ mNumPixels ];
+
+		inReader->read( byteArray, mNumPixels );
+
+		double *channel = mChannels[i];
+		for( int p=0; p<mNumPixels; p++ ) {
+			channel[p] = (double)( byteArray[p] ) / 255.0;
+			}
+		}
+
+	delete [] byteArray;
+
+	return true;
+	}
+
+
+
+
 
 static double maxVal( double inA, double inB, double inC ) {
     if( inA >= inB &&
@@ -28,15 +28,26 @@
 #define IMAGE_COLOR_CONVERTER_INCLUDED
 
 #include <math.h>
+#include <stdio.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
 
 
 #include "Image.h"
+#include "PixelImage.h"
 
 
 /**
  * A container class for static functions that convert
  * images between various color spaces.
  *
+ * Besides the functions that return new images, each conversion can
+ * write into an existing image (which can be the source image itself),
+ * and can work on packed 8-bit or float PixelImages.  The linear
+ * conversions use SSE2 where available.
+ *
  * @author Jason Rohrer
  */ 
 class ImageColorConverter {
@@ -183,6 +194,74 @@ class ImageColorConverter {
 		static Image *YCbCrToRGB( Image *inYCbCrImage );
 
 
+
+		/**
+		 * Same as the conversions above, but writing into an existing
+		 * 3-channel image instead of returning a new one.
+		 *
+		 * @param inImage the image to convert.  Must be destroyed by
+		 *   caller.
+		 * @param outImage the image to write the result into, the same
+		 *   size as inImage.  Can be inImage to convert in place.
+		 *   Must be destroyed by caller.
+		 *
+		 * @return true on success, or false if either image does not 
+		 *   have 3 channels or their sizes differ.
+		 */
+		static char RGBToHSB( Image *inImage, Image *outImage );
+		static char RGBToYIQ( Image *inImage, Image *outImage );
+		static char YIQToRGB( Image *inImage, Image *outImage );
+		static char RGBToYCbCr( Image *inImage, Image *outImage );
+		static char YCbCrToRGB( Image *inImage, Image *outImage );
+		
+
+		/**
+		 * Conversions between RGB and YCbCr in place on packed 8-bit
+		 * images, in fixed point.  Cb and Cr are shifted into [0,255].
+		 * Other channels (like alpha) are left alone.
+		 *
+		 * @param inImage the image to convert.  Must be destroyed by
+		 *   caller.
+		 *
+		 * @return true on success, or false if inImage has fewer than 
+		 *   3 channels.
+		 */
+		static char RGBToYCbCr( PixelImage8 *inImage );
+		static char YCbCrToRGB( PixelImage8 *inImage );
+		
+
+		/**
+		 * Conversions in place on float images.  Values are not clipped,
+		 * except for the RGB results of YCbCrToRGB, as above.
+		 *
+		 * @param inImage the image to convert.  Must be destroyed by
+		 *   caller.
+		 *
+		 * @return true on success, or false if inImage has fewer than 
+		 *   3 channels.
+		 */
+		static char RGBToYIQ( PixelImageFloat *inImage );
+		static char YIQToRGB( PixelImageFloat *inImage );
+		static char RGBToYCbCr( PixelImageFloat *inImage );
+		static char YCbCrToRGB( PixelImageFloat *inImage );
+
+
+		/**
+		 * Computes only the NTSC luminance (the Y of YIQ, and the gray
+		 * of RGBToGrayscale) of an RGB image, without producing the 
+		 * other channels.
+		 *
+		 * @param inImage the RGB image.  Must have at least 3 channels.
+		 *   Must be destroyed by caller.
+		 * @param outLuminance the channel to write luminance into, one
+		 *   value per pixel.  Must be destroyed by caller.
+		 */
+		static void RGBToLuminance( Image *inImage, double *outLuminance );
+		static void RGBToLuminance( PixelImage8 *inImage, 
+									unsigned char *outLuminance );
+		static void RGBToLuminance( PixelImageFloat *inImage, 
+									float *outLuminance );
+
 		
 	protected:
 
@@ -213,7 +292,82 @@ class ImageColorConverter {
 										  double inC20,
 										  double inC21,
 										  double inC22 );
-											 
+		
+
+		/**
+		 * Converts 3 channels with a matrix of conversion coefficients
+		 * plus an offset for each output channel:
+		 *
+		 * outChanK = inMatrix[3K] * inChan0 + inMatrix[3K+1] * inChan1 +
+		 *            inMatrix[3K+2] * inChan2 + inOffsets[K]
+		 *
+		 * Each pixel is read before it is written, so input and output
+		 * channels can be the same.
+		 *
+		 * @param inChannels the 3 input channels.  Destroyed by caller.
+		 * @param outChannels the 3 output channels.  Destroyed by caller.
+		 * @param inStride the distance between samples in each channel.
+		 * @param inNumPixels the number of pixels.
+		 * @param inMatrix the 9 coefficients.
+		 * @param inOffsets the 3 offsets.
+		 * @param inClip true to clip results to [0,1].
+		 */
+		template <class T>
+		static void convertChannels( T **inChannels, T **outChannels,
+									 int inStride, int inNumPixels,
+									 const double *inMatrix,
+									 const double *inOffsets,
+									 char inClip );
+
+		
+		// convertChannels for pixels inStart up to (not including) inEnd,
+		// without SIMD
+		template <class T>
+		static void convertChannelsScalar( T **inChannels, T **outChannels,
+										   int inStride, 
+										   int inStart, int inEnd,
+										   const double *inMatrix,
+										   const double *inOffsets,
+										   char inClip );
+
+
+		/**
+		 * Same as convertChannels, but in place on a packed 8-bit image,
+		 * in 14-bit fixed point.  Offsets are in [0,1] units.
+		 * Results are always clipped to [0,255].
+		 */
+		static void convertBytes( PixelImage8 *inImage,
+								  const double *inMatrix,
+								  const double *inOffsets );
+		
+
+		// calls convertChannels on an Image, checking channel counts
+		static char convertImage( Image *inImage, Image *outImage,
+								  const double *inMatrix,
+								  const double *inOffsets,
+								  char inClip );
+		
+		// calls convertChannels in place on a PixelImage
+		template <class T>
+		static char convertPixelImage( PixelImage<T> *inImage,
+									   const double *inMatrix,
+									   const double *inOffsets,
+									   char inClip );
+
+
+		// conversion coefficients, from the color space faq
+		static const double *getYIQMatrix();
+		static const double *getInverseYIQMatrix();
+		static const double *getYCbCrMatrix();
+		static const double *getInverseYCbCrMatrix();
+		
+		// Cb and Cr shifted into [0,1]
+		static const double *getYCbCrOffsets();
+		
+		// folds the un-shifting of Cb and Cr into offsets for the 
+		// inverse matrix
+		static const double *getInverseYCbCrOffsets();
+
 	};		
 
 
@@ -221,20 +375,11 @@ class ImageColorConverter {
 inline Image *ImageColorConverter::RGBToGrayscale( Image *inImage ) {
 	int w = inImage->getWidth();
 	int h = inImage->getHeight();
-	int numPixels = w * h;
-	
-	Image *grayImage = new Image( w, h, 1 );
-	
-	double *red = inImage->getChannel( 0 );
-	double *green = inImage->getChannel( 1 );
-	double *blue = inImage->getChannel( 2 );
 	
-	double *gray = grayImage->getChannel( 0 );
+	Image *grayImage = new Image( w, h, 1, false );
 	
-	for( int i=0; i<numPixels; i++ ) {
-		// NTSC luminosity formula
-		gray[i] = .299 * red[i] + .587 * green[i] + .114 * blue[i];
-		}
+	// NTSC luminosity formula
+	RGBToLuminance( inImage, grayImage->getChannel( 0 ) );
 		
 	return grayImage;
 	}
@@ -315,20 +460,34 @@ inline Image *ImageColorConverter::RGBToHSB( Image *inRGBImage ) {
 		return NULL;
 		}
 
-	int w = inRGBImage->getWidth();
-	int h = inRGBImage->getHeight();
+	Image *hsbImage = new Image( inRGBImage->getWidth(), 
+								 inRGBImage->getHeight(), 3, false );
+	
+	RGBToHSB( inRGBImage, hsbImage );
+
+	return hsbImage;
+	}
 
-	int numPixels = w * h;
-				
-	Image *hsbImage = new Image( w, h, 3 );
 
-	double *redChannel = inRGBImage->getChannel( 0 );
-	double *greenChannel = inRGBImage->getChannel( 1 );
-	double *blueChannel = inRGBImage->getChannel( 2 );
 
-	double *hueChannel = hsbImage->getChannel( 0 );
-	double *satChannel = hsbImage->getChannel( 1 );
-	double *brightChannel = hsbImage->getChannel( 2 );
+inline char ImageColorConverter::RGBToHSB( Image *inImage, 
+										   Image *outImage ) {
+	if( inImage->getNumChannels() != 3 || 
+		outImage->getNumChannels() != 3 ||
+		inImage->getWidth() != outImage->getWidth() ||
+		inImage->getHeight() != outImage->getHeight() ) {
+		return false;
+		}
+	
+	int numPixels = inImage->getWidth() * inImage->getHeight();
+
+	double *redChannel = inImage->getChannel( 0 );
+	double *greenChannel = inImage->getChannel( 1 );
+	double *blueChannel = inImage->getChannel( 2 );
+
+	double *hueChannel = outImage->getChannel( 0 );
+	double *satChannel = outImage->getChannel( 1 );
+	double *brightChannel = outImage->getChannel( 2 );
 
 				
 	for( int i=0; i<numPixels; i++ ) {
@@ -359,12 +518,12 @@ inline Image *ImageColorConverter::RGBToHSB( Image *inRGBImage ) {
 			hue = 0;
 			}
 		else {
-			double redc =
-				( (double)( cmax - r ) ) / ( (double)( cmax - cmin ) );
-			double greenc =
-				( (double) ( cmax - g ) ) / ( (double)( cmax - cmin ) );
-			double bluec =
-				( (double)( cmax - b ) ) / ( (double)( cmax - cmin ) );
+			// one division per pixel instead of three
+			double invRange = 1.0 / (double)( cmax - cmin );
+			
+			double redc = ( cmax - r ) * invRange;
+			double greenc = ( cmax - g ) * invRange;
+			double bluec = ( cmax - b ) * invRange;
 
 			if( r == cmax ) {
 				hue = bluec - greenc;
@@ -382,12 +541,13 @@ inline Image *ImageColorConverter::RGBToHSB( Image *inRGBImage ) {
 				}
 			}
 
+		// rgb already read, so this is safe in place
 		hueChannel[i] = hue;
 		satChannel[i] = sat;
 		brightChannel[i] = bright;
 		}
 
-	return hsbImage;
+	return true;
 	}
 
 
@@ -399,10 +559,10 @@ inline Image *ImageColorConverter::RGBToYIQ( Image *inRGBImage ) {
 		return NULL;
 		}
 
-	Image *yiqImage = coefficientConvert( inRGBImage,
-										  0.299,  0.587,  0.114,
-										  0.596, -0.274, -0.322,
-										  0.212, -0.523,  0.311 );
+	Image *yiqImage = new Image( inRGBImage->getWidth(), 
+								 inRGBImage->getHeight(), 3, false );
+	
+	RGBToYIQ( inRGBImage, yiqImage );
 
 	return yiqImage;
 	}
@@ -416,10 +576,11 @@ inline Image *ImageColorConverter::YIQToRGB( Image *inYIQImage ) {
 		return NULL;
 		}
 
-	Image *rgbImage = coefficientConvert( inYIQImage,
-										  1.0,  0.956,  0.621,
-										  1.0, -0.272, -0.647,
-										  1.0, -1.105,  1.702 );
+	Image *rgbImage = new Image( inYIQImage->getWidth(), 
+								 inYIQImage->getHeight(), 3, false );
+	
+	YIQToRGB( inYIQImage, rgbImage );
+	
 	return rgbImage;
 	}
 
@@ -432,37 +593,10 @@ inline Image *ImageColorConverter::RGBToYCbCr( Image *inRGBImage ) {
 		return NULL;
 		}
 
-	// coefficients taken from the color space faq
-	/*
-	  RGB -> YCbCr (with Rec 601-1 specs)
-	  Y  =  0.2989 * Red + 0.5866 * Green + 0.1145 * Blue
-	  Cb = -0.1687 * Red - 0.3312 * Green + 0.5000 * Blue
-	  Cr =  0.5000 * Red - 0.4183 * Green - 0.0816 * Blue
-
-	  YCbCr (with Rec 601-1 specs) -> RGB
-	  Red   = Y + 0.0000 * Cb + 1.4022 * Cr
-	  Green = Y - 0.3456 * Cb - 0.7145 * Cr
-	  Blue  = Y + 1.7710 * Cb + 0.0000 * Cr
-	*/
-	
-	Image *ycbcrImage = coefficientConvert( inRGBImage,
-											 0.2989,  0.5866,  0.1145,
-											-0.1687, -0.3312,  0.5000,
-											 0.5000, -0.4183, -0.0816 );
-
-	// adjust the Cb and Cr channels so they are in the range [0,1]
-	int numPixels = ycbcrImage->getWidth() * ycbcrImage->getHeight();
-	double *cbChannel = ycbcrImage->getChannel( 1 );
-	double *crChannel = ycbcrImage->getChannel( 2 );
-	for( int i=0; i<numPixels; i++ ) {
-		cbChannel[i] += 0.5;
-		crChannel[i] += 0.5;
-		}
-
-	// no need to clip pixels to the range [0,1], since
-	// all possible rgb pixel values are represented by in-range
-	// yCbCr pixel values
-
+	Image *ycbcrImage = new Image( inRGBImage->getWidth(), 
+								   inRGBImage->getHeight(), 3, false );
+	
+	RGBToYCbCr( inRGBImage, ycbcrImage );
 	
 	return ycbcrImage;
 	}
@@ -476,52 +610,487 @@ inline Image *ImageColorConverter::YCbCrToRGB( Image *inYCbCrImage ) {
 		return NULL;
 		}
 
-	// adjust the normalized Cb and Cr channels
-	// so they are in the range [-0.5,0.5]
+	Image *rgbImage = new Image( inYCbCrImage->getWidth(), 
+								 inYCbCrImage->getHeight(), 3, false );
 	
-	int numPixels = inYCbCrImage->getWidth() * inYCbCrImage->getHeight();
-	double *cbChannel = inYCbCrImage->getChannel( 1 );
-	double *crChannel = inYCbCrImage->getChannel( 2 );
-	for( int i=0; i<numPixels; i++ ) {
-		cbChannel[i] -= 0.5;
-		crChannel[i] -= 0.5;
-		}
+	YCbCrToRGB( inYCbCrImage, rgbImage );
 
-	// coefficients taken from the color space faq
-	/*
-	  RGB -> YCbCr (with Rec 601-1 specs)
-	  Y  =  0.2989 * Red + 0.5866 * Green + 0.1145 * Blue
-	  Cb = -0.1687 * Red - 0.3312 * Green + 0.5000 * Blue
-	  Cr =  0.5000 * Red - 0.4183 * Green - 0.0816 * Blue
+	return rgbImage;
+	}
+
+
+
+inline char ImageColorConverter::RGBToYIQ( Image *inImage, 
+										   Image *outImage ) {
+	return convertImage( inImage, outImage, 
+						 getYIQMatrix(), NULL, false );
+	}
+
+
+
+inline char ImageColorConverter::YIQToRGB( Image *inImage, 
+										   Image *outImage ) {
+	return convertImage( inImage, outImage, 
+						 getInverseYIQMatrix(), NULL, false );
+	}
+
+
+
+inline char ImageColorConverter::RGBToYCbCr( Image *inImage, 
+											 Image *outImage ) {
+	// no need to clip pixels to the range [0,1], since
+	// all possible rgb pixel values are represented by in-range
+	// yCbCr pixel values
+	return convertImage( inImage, outImage, 
+						 getYCbCrMatrix(), getYCbCrOffsets(), false );
+	}
 
-	  YCbCr (with Rec 601-1 specs) -> RGB
-	  Red   = Y + 0.0000 * Cb + 1.4022 * Cr
-	  Green = Y - 0.3456 * Cb - 0.7145 * Cr
-	  Blue  = Y + 1.7710 * Cb + 0.0000 * Cr
-	*/
-	
-	Image *rgbImage = coefficientConvert( inYCbCrImage,
-										  1.0,  0.0000,  1.4022,
-										  1.0, -0.3456, -0.7145,
-										  1.0,  1.7710,  0.0000 );
 
+
+inline char ImageColorConverter::YCbCrToRGB( Image *inImage, 
+											 Image *outImage ) {
 	// clip r, g, and b channels to the range [0,1], since
 	// some YCbCr pixel values might map out of this range
 	// (in other words, some YCbCr values map outside of rgb space)
-	for( int c=0; c<3; c++ ) {
-		double *channel = rgbImage->getChannel( c );
+	return convertImage( inImage, outImage, 
+						 getInverseYCbCrMatrix(), 
+						 getInverseYCbCrOffsets(), true );
+	}
+
+
+
+inline char ImageColorConverter::RGBToYCbCr( PixelImage8 *inImage ) {
+	if( inImage->getNumChannels() < 3 ) {
+		return false;
+		}
+	convertBytes( inImage, getYCbCrMatrix(), getYCbCrOffsets() );
+	return true;
+	}
+
+
+
+inline char ImageColorConverter::YCbCrToRGB( PixelImage8 *inImage ) {
+	if( inImage->getNumChannels() < 3 ) {
+		return false;
+		}
+	convertBytes( inImage, getInverseYCbCrMatrix(), 
+				  getInverseYCbCrOffsets() );
+	return true;
+	}
+
+
+
+inline char ImageColorConverter::RGBToYIQ( PixelImageFloat *inImage ) {
+	return convertPixelImage( inImage, getYIQMatrix(), NULL, false );
+	}
+
+
+
+inline char ImageColorConverter::YIQToRGB( PixelImageFloat *inImage ) {
+	return convertPixelImage( inImage, getInverseYIQMatrix(), NULL, 
+							  false );
+	}
+
+
+
+inline char ImageColorConverter::RGBToYCbCr( PixelImageFloat *inImage ) {
+	return convertPixelImage( inImage, getYCbCrMatrix(), 
+							  getYCbCrOffsets(), false );
+	}
+
+
+
+inline char ImageColorConverter::YCbCrToRGB( PixelImageFloat *inImage ) {
+	return convertPixelImage( inImage, getInverseYCbCrMatrix(), 
+							  getInverseYCbCrOffsets(), true );
+	}
+
+
+
+inline void ImageColorConverter::RGBToLuminance( Image *inImage, 
+												 double *outLuminance ) {
+	int numPixels = inImage->getWidth() * inImage->getHeight();
+
+	double *red = inImage->getChannel( 0 );
+	double *green = inImage->getChannel( 1 );
+	double *blue = inImage->getChannel( 2 );
+
+	// first row of the YIQ matrix
+	const double *m = getYIQMatrix();
+	
+	int i = 0;
+	
+#if defined(__SSE2__)
+	__m128d cR = _mm_set1_pd( m[0] );
+	__m128d cG = _mm_set1_pd( m[1] );
+	__m128d cB = _mm_set1_pd( m[2] );
+	
+	for( ; i + 2 <= numPixels; i += 2 ) {
+		__m128d y = 
+			_mm_add_pd( 
+				_mm_add_pd( _mm_mul_pd( cR, _mm_loadu_pd( &( red[i] ) ) ),
+							_mm_mul_pd( cG, _mm_loadu_pd( &( green[i] ) ) ) ),
+				_mm_mul_pd( cB, _mm_loadu_pd( &( blue[i] ) ) ) );
+		_mm_storeu_pd( &( outLuminance[i] ), y );
+		}
+#endif
+	
+	for( ; i<numPixels; i++ ) {
+		outLuminance[i] = m[0] * red[i] + m[1] * green[i] + m[2] * blue[i];
+		}
+	}
+
+
+
+inline void ImageColorConverter::RGBToLuminance( 
+	PixelImageFloat *inImage, float *outLuminance ) {
+	
+	int numPixels = inImage->getWidth() * inImage->getHeight();
+	int stride = inImage->getChannelStride();
+	
+	float *red = inImage->getChannel( 0 );
+	float *green = inImage->getChannel( 1 );
+	float *blue = inImage->getChannel( 2 );
+
+	const double *m = getYIQMatrix();
+	float cR = (float)m[0];
+	float cG = (float)m[1];
+	float cB = (float)m[2];
+	
+	for( int i=0; i<numPixels; i++ ) {
+		int j = i * stride;
+		outLuminance[i] = cR * red[j] + cG * green[j] + cB * blue[j];
+		}
+	}
+
+
+
+// fixed-point scale for 8-bit conversions
+#define IMAGE_COLOR_FIXED_BITS 14
+
+
+
+inline void ImageColorConverter::RGBToLuminance( 
+	PixelImage8 *inImage, unsigned char *outLuminance ) {
+	
+	int numPixels = inImage->getWidth() * inImage->getHeight();
+	
+	const double *m = getYIQMatrix();
+	
+	int cR = (int)lrint( m[0] * ( 1 << IMAGE_COLOR_FIXED_BITS ) );
+	int cG = (int)lrint( m[1] * ( 1 << IMAGE_COLOR_FIXED_BITS ) );
+	int cB = (int)lrint( m[2] * ( 1 << IMAGE_COLOR_FIXED_BITS ) );
+	int round = 1 << ( IMAGE_COLOR_FIXED_BITS - 1 );
+
+	int i = 0;
+	
+#if defined(__SSE2__)
+	if( inImage->isInterleaved() && inImage->getNumChannels() == 4 ) {
+		unsigned char *bytes = inImage->getSamples();
+		
+		__m128i byteMask = _mm_set1_epi32( 0xFF );
+		
+		// coefficient in the low 16 bits of each 32-bit lane, so madd 
+		// gives sample * coefficient
+		__m128i vR = _mm_set1_epi32( (unsigned short)cR );
+		__m128i vG = _mm_set1_epi32( (unsigned short)cG );
+		__m128i vB = _mm_set1_epi32( (unsigned short)cB );
+		__m128i vRound = _mm_set1_epi32( round );
+		
+		for( ; i + 4 <= numPixels; i += 4 ) {
+			__m128i pixels = 
+				_mm_loadu_si128( (__m128i *)&( bytes[ i * 4 ] ) );
+			
+			__m128i r = _mm_and_si128( pixels, byteMask );
+			__m128i g = _mm_and_si128( _mm_srli_epi32( pixels, 8 ), 
+									   byteMask );
+			__m128i b = _mm_and_si128( _mm_srli_epi32( pixels, 16 ), 
+									   byteMask );
+			
+			__m128i y = _mm_add_epi32( 
+				_mm_add_epi32( _mm_madd_epi16( r, vR ),
+							   _mm_madd_epi16( g, vG ) ),
+				_mm_add_epi32( _mm_madd_epi16( b, vB ), vRound ) );
+			
+			y = _mm_srai_epi32( y, IMAGE_COLOR_FIXED_BITS );
+			y = _mm_packs_epi32( y, y );
+			y = _mm_packus_epi16( y, y );
+			
+			int packed = _mm_cvtsi128_si32( y );
+			memcpy( &( outLuminance[i] ), &packed, 4 );
+			}
+		}
+#endif
+
+	int stride = inImage->getChannelStride();
+	unsigned char *red = inImage->getChannel( 0 );
+	unsigned char *green = inImage->getChannel( 1 );
+	unsigned char *blue = inImage->getChannel( 2 );
+
+	for( ; i<numPixels; i++ ) {
+		int j = i * stride;
+		int y = ( cR * red[j] + cG * green[j] + cB * blue[j] + round ) 
+			>> IMAGE_COLOR_FIXED_BITS;
+		
+		if( y > 255 ) {
+			y = 255;
+			}
+		outLuminance[i] = (unsigned char)y;
+		}
+	}
+
+
+
+inline void ImageColorConverter::convertBytes( PixelImage8 *inImage,
+											   const double *inMatrix,
+											   const double *inOffsets ) {
+	
+	int numPixels = inImage->getWidth() * inImage->getHeight();
+	
+	int c[9];
+	for( int k=0; k<9; k++ ) {
+		c[k] = (int)lrint( inMatrix[k] * ( 1 << IMAGE_COLOR_FIXED_BITS ) );
+		}
+	
+	// offsets scaled to 8-bit units, with rounding folded in
+	int o[3];
+	for( int k=0; k<3; k++ ) {
+		o[k] = (int)lrint( inOffsets[k] * 255 * 
+						   ( 1 << IMAGE_COLOR_FIXED_BITS ) ) +
+			( 1 << ( IMAGE_COLOR_FIXED_BITS - 1 ) );
+		}
+	
+	int i = 0;
+
+#if defined(__SSE2__)
+	if( inImage->isInterleaved() && inImage->getNumChannels() == 4 ) {
+		unsigned char *bytes = inImage->getSamples();
+		
+		__m128i byteMask = _mm_set1_epi32( 0xFF );
+		__m128i alphaMask = _mm_set1_epi32( (int)0xFF000000 );
+		__m128i zero = _mm_setzero_si128();
+		
+		__m128i vC[9];
+		for( int k=0; k<9; k++ ) {
+			vC[k] = _mm_set1_epi32( (unsigned short)c[k] );
+			}
+		__m128i vO[3];
+		for( int k=0; k<3; k++ ) {
+			vO[k] = _mm_set1_epi32( o[k] );
+			}
+
+		for( ; i + 4 <= numPixels; i += 4 ) {
+			__m128i *p = (__m128i *)&( bytes[ i * 4 ] );
+			__m128i pixels = _mm_loadu_si128( p );
+			
+			__m128i in[3];
+			in[0] = _mm_and_si128( pixels, byteMask );
+			in[1] = _mm_and_si128( _mm_srli_epi32( pixels, 8 ), byteMask );
+			in[2] = _mm_and_si128( _mm_srli_epi32( pixels, 16 ), 
+								   byteMask );
+			
+			__m128i result = _mm_and_si128( pixels, alphaMask );
+			
+			for( int k=0; k<3; k++ ) {
+				__m128i v = _mm_add_epi32(
+					_mm_add_epi32( _mm_madd_epi16( in[0], vC[ 3 * k ] ),
+								   _mm_madd_epi16( in[1], vC[ 3 * k + 1 ] ) ),
+					_mm_add_epi32( _mm_madd_epi16( in[2], vC[ 3 * k + 2 ] ),
+								   vO[k] ) );
+				v = _mm_srai_epi32( v, IMAGE_COLOR_FIXED_BITS );
+				
+				// saturate to [0,255], then back to one byte per lane
+				v = _mm_packs_epi32( v, v );
+				v = _mm_packus_epi16( v, v );
+				v = _mm_unpacklo_epi16( _mm_unpacklo_epi8( v, zero ), zero );
+				
+				result = _mm_or_si128( result, 
+									   _mm_slli_epi32( v, 8 * k ) );
+				}
+			
+			_mm_storeu_si128( p, result );
+			}
+		}
+#endif
+	
+	int stride = inImage->getChannelStride();
+	unsigned char *channels[3];
+	for( int k=0; k<3; k++ ) {
+		channels[k] = inImage->getChannel( k );
+		}
+
+	for( ; i<numPixels; i++ ) {
+		int j = i * stride;
+		int in0 = channels[0][j];
+		int in1 = channels[1][j];
+		int in2 = channels[2][j];
 		
-		for( int p=0; p<numPixels; p++ ) {
-			if( channel[p] < 0 ) {
-				channel[p] = 0;
+		for( int k=0; k<3; k++ ) {
+			int v = ( c[ 3 * k ] * in0 + c[ 3 * k + 1 ] * in1 + 
+					  c[ 3 * k + 2 ] * in2 + o[k] ) 
+				>> IMAGE_COLOR_FIXED_BITS;
+			
+			if( v < 0 ) {
+				v = 0;
 				}
-			else if( channel[p] > 1 ) {
-				channel[p] = 1.0;
+			else if( v > 255 ) {
+				v = 255;
 				}
+			channels[k][j] = (unsigned char)v;
 			}
 		}
+	}
+
+
+
+template <class T>
+inline void ImageColorConverter::convertChannels( T **inChannels, 
+												  T **outChannels,
+												  int inStride, 
+												  int inNumPixels,
+												  const double *inMatrix,
+												  const double *inOffsets,
+												  char inClip ) {
+	convertChannelsScalar( inChannels, outChannels, inStride, 
+						   0, inNumPixels, inMatrix, inOffsets, inClip );
+	}
+
+
+
+template <class T>
+inline void ImageColorConverter::convertChannelsScalar( 
+	T **inChannels, T **outChannels, int inStride, int inStart, int inEnd,
+	const double *inMatrix, const double *inOffsets, char inClip ) {
+	
+	double o[3] = { 0, 0, 0 };
+	if( inOffsets != NULL ) {
+		memcpy( o, inOffsets, sizeof( o ) );
+		}
+	const double *m = inMatrix;
 	
-	return rgbImage;
+	for( int i=inStart; i<inEnd; i++ ) {
+		int j = i * inStride;
+		
+		double in0 = inChannels[0][j];
+		double in1 = inChannels[1][j];
+		double in2 = inChannels[2][j];
+		
+		for( int k=0; k<3; k++ ) {
+			double v = m[ 3 * k ] * in0 + m[ 3 * k + 1 ] * in1 + 
+				m[ 3 * k + 2 ] * in2 + o[k];
+			
+			if( inClip ) {
+				if( v < 0 ) {
+					v = 0;
+					}
+				else if( v > 1 ) {
+					v = 1;
+					}
+				}
+			outChannels[k][j] = (T)v;
+			}
+		}
+	}
+
+
+
+#if defined(__SSE2__)
+
+// Image channels, two pixels at a time
+template <>
+inline void ImageColorConverter::convertChannels<double>( 
+	double **inChannels, double **outChannels, int inStride, 
+	int inNumPixels, const double *inMatrix, const double *inOffsets,
+	char inClip ) {
+	
+	int i = 0;
+	
+	// any other stride is a PixelImage<double>, handled below
+	if( inStride == 1 ) {
+		
+		__m128d vM[9];
+		for( int k=0; k<9; k++ ) {
+			vM[k] = _mm_set1_pd( inMatrix[k] );
+			}
+		__m128d vO[3];
+		for( int k=0; k<3; k++ ) {
+			vO[k] = _mm_set1_pd( ( inOffsets != NULL ) ? inOffsets[k] : 0 );
+			}
+		__m128d zero = _mm_setzero_pd();
+		__m128d one = _mm_set1_pd( 1.0 );
+	
+		for( ; i + 2 <= inNumPixels; i += 2 ) {
+			__m128d in0 = _mm_loadu_pd( &( inChannels[0][i] ) );
+			__m128d in1 = _mm_loadu_pd( &( inChannels[1][i] ) );
+			__m128d in2 = _mm_loadu_pd( &( inChannels[2][i] ) );
+		
+			for( int k=0; k<3; k++ ) {
+				__m128d v = _mm_add_pd(
+					_mm_add_pd( _mm_mul_pd( vM[ 3 * k ], in0 ),
+								_mm_mul_pd( vM[ 3 * k + 1 ], in1 ) ),
+					_mm_add_pd( _mm_mul_pd( vM[ 3 * k + 2 ], in2 ), vO[k] ) );
+			
+				if( inClip ) {
+					v = _mm_min_pd( _mm_max_pd( v, zero ), one );
+					}
+				_mm_storeu_pd( &( outChannels[k][i] ), v );
+				}
+			}
+		}
+	
+	convertChannelsScalar( inChannels, outChannels, inStride, 
+						   i, inNumPixels, inMatrix, inOffsets, inClip );
+	}
+
+#endif
+
+
+
+inline char ImageColorConverter::convertImage( Image *inImage, 
+											   Image *outImage,
+											   const double *inMatrix,
+											   const double *inOffsets,
+											   char inClip ) {
+	if( inImage->getNumChannels() != 3 || 
+		outImage->getNumChannels() != 3 ||
+		inImage->getWidth() != outImage->getWidth() ||
+		inImage->getHeight() != outImage->getHeight() ) {
+		return false;
+		}
+	
+	double *inChannels[3];
+	double *outChannels[3];
+	for( int c=0; c<3; c++ ) {
+		inChannels[c] = inImage->getChannel( c );
+		outChannels[c] = outImage->getChannel( c );
+		}
+	
+	convertChannels( inChannels, outChannels, 1, 
+					 inImage->getWidth() * inImage->getHeight(),
+					 inMatrix, inOffsets, inClip );
+	return true;
+	}
+
+
+
+template <class T>
+inline char ImageColorConverter::convertPixelImage( PixelImage<T> *inImage,
+													const double *inMatrix,
+													const double *inOffsets,
+													char inClip ) {
+	if( inImage->getNumChannels() < 3 ) {
+		return false;
+		}
+	
+	T *channels[3];
+	for( int c=0; c<3; c++ ) {
+		channels[c] = inImage->getChannel( c );
+		}
+	
+	convertChannels( channels, channels, inImage->getChannelStride(),
+					 inImage->getWidth() * inImage->getHeight(),
+					 inMatrix, inOffsets, inClip );
+	return true;
 	}
 
 
@@ -539,39 +1108,87 @@ inline Image *ImageColorConverter::coefficientConvert( Image *inImage,
 	if( inImage->getNumChannels() != 3 ) {
 		return NULL;
 		}
-
 	
-	int w = inImage->getWidth();
-	int h = inImage->getHeight();
+	double matrix[9] = { inC00, inC01, inC02,
+						 inC10, inC11, inC12,
+						 inC20, inC21, inC22 };
+	
+	Image *outImage = new Image( inImage->getWidth(), inImage->getHeight(), 
+								 3, false );
+	
+	convertImage( inImage, outImage, matrix, NULL, false );
 
-	int numPixels = w * h;
-				
-	Image *outImage = new Image( w, h, 3 );
+	return outImage;
+	}
 
-	double *outChannel0 = outImage->getChannel( 0 );
-	double *outChannel1 = outImage->getChannel( 1 );
-	double *outChannel2 = outImage->getChannel( 2 );
 
-	double *inChannel0 = inImage->getChannel( 0 );
-	double *inChannel1 = inImage->getChannel( 1 );
-	double *inChannel2 = inImage->getChannel( 2 );
-	
-	for( int i=0; i<numPixels; i++ ) {
-		outChannel0[i] =
-			inC00 * inChannel0[i] +
-			inC01 * inChannel1[i] +
-			inC02 * inChannel2[i];
-		outChannel1[i] =
-			inC10 * inChannel0[i] +
-			inC11 * inChannel1[i] +
-			inC12 * inChannel2[i];
-		outChannel2[i] =
-			inC20 * inChannel0[i] +
-			inC21 * inChannel1[i] +
-			inC22 * inChannel2[i];
-		}
 
-	return outImage;
+inline const double *ImageColorConverter::getYIQMatrix() {
+	static const double matrix[9] = { 0.299,  0.587,  0.114,
+									  0.596, -0.274, -0.322,
+									  0.212, -0.523,  0.311 };
+	return matrix;
+	}
+
+
+
+inline const double *ImageColorConverter::getInverseYIQMatrix() {
+	static const double matrix[9] = { 1.0,  0.956,  0.621,
+									  1.0, -0.272, -0.647,
+									  1.0, -1.105,  1.702 };
+	return matrix;
+	}
+
+
+
+// coefficients taken from the color space faq
+/*
+  RGB -> YCbCr (with Rec 601-1 specs)
+  Y  =  0.2989 * Red + 0.5866 * Green + 0.1145 * Blue
+  Cb = -0.1687 * Red - 0.3312 * Green + 0.5000 * Blue
+  Cr =  0.5000 * Red - 0.4183 * Green - 0.0816 * Blue
+  
+  YCbCr (with Rec 601-1 specs) -> RGB
+  Red   = Y + 0.0000 * Cb + 1.4022 * Cr
+  Green = Y - 0.3456 * Cb - 0.7145 * Cr
+  Blue  = Y + 1.7710 * Cb + 0.0000 * Cr
+*/
+
+inline const double *ImageColorConverter::getYCbCrMatrix() {
+	static const double matrix[9] = {  0.2989,  0.5866,  0.1145,
+									  -0.1687, -0.3312,  0.5000,
+									   0.5000, -0.4183, -0.0816 };
+	return matrix;
+	}
+
+
+
+inline const double *ImageColorConverter::getInverseYCbCrMatrix() {
+	static const double matrix[9] = { 1.0,  0.0000,  1.4022,
+									  1.0, -0.3456, -0.7145,
+									  1.0,  1.7710,  0.0000 };
+	return matrix;
+	}
+
+
+
+inline const double *ImageColorConverter::getYCbCrOffsets() {
+	static const double offsets[3] = { 0, 0.5, 0.5 };
+	return offsets;
+	}
+
+
+
+inline const double *ImageColorConverter::getInverseYCbCrOffsets() {
+	// M * ( in - shift ) = M * in - M * shift
+	const double *m = getInverseYCbCrMatrix();
+	
+	static const double offsets[3] = { 
+		-0.5 * ( m[1] + m[2] ),
+		-0.5 * ( m[4] + m[5] ),
+		-0.5 * ( m[7] + m[8] ) };
+	
+	return offsets;
 	}
 
 
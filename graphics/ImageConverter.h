@@ -17,6 +17,7 @@
 
 
 #include "Image.h"
+#include "RawRGBAImage.h"
 #include "minorGems/io/InputStream.h"
 #include "minorGems/io/OutputStream.h"
 
@@ -54,6 +55,25 @@ class ImageConverter {
 		 *   operation fails.  Must be destroyed by caller.
 		 */
 		virtual Image *deformatImage( InputStream *inStream ) = 0;		
+
+
+
+		/**
+		 * Sends raw 8-bit pixels out to a stream as a particular
+		 * format.
+		 *
+		 * Formats that can take bytes directly override this to skip
+		 * the conversion to a double-per-channel Image.  By default,
+		 * the bytes are converted and passed to formatImage.
+		 *
+		 * None of the parameters are destroyed by this call.
+		 *
+		 * @param inImage the image to convert, 3 or 4 channels,
+		 *   rows from top to bottom.
+		 * @param inStream the stream to write the formatted image to.
+		 */
+		virtual void formatImageRaw( RawRGBAImage *inImage,
+									 OutputStream *inStream );
         
 
 
@@ -64,4 +84,26 @@ class ImageConverter {
 	};
 
 
+
+inline void ImageConverter::formatImageRaw( RawRGBAImage *inImage,
+											OutputStream *inStream ) {
+	int numChannels = inImage->mNumChannels;
+	int numPixels = inImage->mWidth * inImage->mHeight;
+	
+	Image image( inImage->mWidth, inImage->mHeight, numChannels, false );
+
+	for( int c=0; c<numChannels; c++ ) {
+		double *channel = image.getChannel( c );
+		unsigned char *bytes = &( inImage->mRGBABytes[c] );
+		
+		for( int i=0; i<numPixels; i++ ) {
+			channel[i] = bytes[ i * numChannels ] / 255.0;
+			}
+		}
+
+	formatImage( &image, inStream );
+	}
+
+
+
 #endif
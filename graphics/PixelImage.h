@@ -0,0 +1,698 @@
+#ifndef PIXEL_IMAGE_INCLUDED
+#define PIXEL_IMAGE_INCLUDED
+
+
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+
+#include "Image.h"
+#include "RawRGBAImage.h"
+
+
+
+/**
+ * Sample ranges and arithmetic for each PixelImage sample type.
+ *
+ * Integer samples run from 0 to their maximum value, and filters on them
+ * work in fixed point:  sums are integers, and averages are taken by
+ * multiplying by a 32.32 fixed-point reciprocal.
+ *
+ * Float samples run from 0 to 1, like Image.
+ */
+template <class T> struct PixelTraits {
+    };
+
+
+
+template <> struct PixelTraits<unsigned char> {
+
+        // sums of many samples
+        // (summed-area tables may wrap around, but differences between
+        //  their entries are still exact while a box sum fits)
+        typedef unsigned int Sum;
+
+        // the factor that turns a sum into an average
+        typedef unsigned long long Scale;
+
+
+        static unsigned char getMaxValue() {
+            return 255;
+            }
+
+        static unsigned char fromDouble( double inValue ) {
+            if( inValue <= 0 ) {
+                return 0;
+                }
+            if( inValue >= 1 ) {
+                return 255;
+                }
+            return (unsigned char)lrint( inValue * 255 );
+            }
+
+        static double toDouble( unsigned char inSample ) {
+            return inSample * ( 1.0 / 255 );
+            }
+
+        static Scale getReciprocal( unsigned int inCount ) {
+            return ( ( 1ULL << 32 ) + inCount / 2 ) / inCount;
+            }
+
+        static unsigned char scaleSum( Sum inSum, Scale inReciprocal ) {
+            Scale v = ( inSum * inReciprocal + ( 1ULL << 31 ) ) >> 32;
+            if( v > 255 ) {
+                v = 255;
+                }
+            return (unsigned char)v;
+            }
+    };
+
+
+
+template <> struct PixelTraits<unsigned short> {
+        typedef unsigned long long Sum;
+        typedef unsigned long long Scale;
+
+
+        static unsigned short getMaxValue() {
+            return 65535;
+            }
+
+        static unsigned short fromDouble( double inValue ) {
+            if( inValue <= 0 ) {
+                return 0;
+                }
+            if( inValue >= 1 ) {
+                return 65535;
+                }
+            return (unsigned short)lrint( inValue * 65535 );
+            }
+
+        static double toDouble( unsigned short inSample ) {
+            return inSample * ( 1.0 / 65535 );
+            }
+
+        static Scale getReciprocal( unsigned int inCount ) {
+            return ( ( 1ULL << 32 ) + inCount / 2 ) / inCount;
+            }
+
+        // good for averages of up to 65536 samples
+        static unsigned short scaleSum( Sum inSum, Scale inReciprocal ) {
+            Scale v = ( inSum * inReciprocal + ( 1ULL << 31 ) ) >> 32;
+            if( v > 65535 ) {
+                v = 65535;
+                }
+            return (unsigned short)v;
+            }
+    };
+
+
+
+template <> struct PixelTraits<float> {
+        typedef double Sum;
+        typedef double Scale;
+
+
+        static float getMaxValue() {
+            return 1.0f;
+            }
+
+        static float fromDouble( double inValue ) {
+            return (float)inValue;
+            }
+
+        static double toDouble( float inSample ) {
+            return inSample;
+            }
+
+        static Scale getReciprocal( unsigned int inCount ) {
+            return 1.0 / inCount;
+            }
+
+        static float scaleSum( Sum inSum, Scale inReciprocal ) {
+            return (float)( inSum * inReciprocal );
+            }
+    };
+
+
+
+// doubles, as stored in Image channels, so filters can share one
+// templated implementation between Image and PixelImage
+template <> struct PixelTraits<double> {
+        typedef double Sum;
+        typedef double Scale;
+
+
+        static double getMaxValue() {
+            return 1.0;
+            }
+
+        static double fromDouble( double inValue ) {
+            return inValue;
+            }
+
+        static double toDouble( double inSample ) {
+            return inSample;
+            }
+
+        static Scale getReciprocal( unsigned int inCount ) {
+            return 1.0 / inCount;
+            }
+
+        static double scaleSum( Sum inSum, Scale inReciprocal ) {
+            return inSum * inReciprocal;
+            }
+    };
+
+
+
+
+/**
+ * A compact image with samples of type T, either interleaved (RGBARGBA...)
+ * or planar (RRR...GGG...), for image processing without Image's 8-byte
+ * doubles.  An 8-bit RGBA PixelImage takes an eighth of the memory of the
+ * same Image.
+ *
+ * Rows run from top to bottom with no padding.
+ *
+ * Usually used through PixelImage8 (unsigned char), PixelImage16
+ * (unsigned short) or PixelImageFloat.
+ *
+ * @author Jason Rohrer
+ */
+template <class T> class PixelImage {
+
+    public:
+
+        /**
+         * Constructs an image, with all samples set to zero.
+         *
+         * @param inWidth, inHeight the size in pixels.
+         * @param inNumChannels the number of channels.
+         * @param inInterleaved true to store channels interleaved, or
+         *   false to store them one plane after another.
+         *   Defaults to true.
+         */
+        PixelImage( int inWidth, int inHeight, int inNumChannels,
+                    char inInterleaved = true );
+
+
+        /**
+         * Constructs an image on existing samples.
+         *
+         * @param inSamples the samples, in the layout given.
+         * @param inWidth, inHeight the size in pixels.
+         * @param inNumChannels the number of channels.
+         * @param inInterleaved true if channels are interleaved.
+         * @param inTakeOwnership true to destroy inSamples (with delete [])
+         *   when this image is destroyed, or false to make a view that
+         *   leaves them to the caller.
+         */
+        PixelImage( T *inSamples, int inWidth, int inHeight,
+                    int inNumChannels, char inInterleaved,
+                    char inTakeOwnership );
+
+
+        /**
+         * Constructs a view onto the bytes of a RawRGBAImage, without
+         * copying.  Only for PixelImage<unsigned char>.
+         *
+         * @param inImage the image to view.  Must be destroyed by caller
+         *   after this view is destroyed.
+         */
+        PixelImage( RawRGBAImage *inImage );
+
+
+        ~PixelImage();
+
+
+
+        int getWidth();
+        int getHeight();
+        int getNumChannels();
+        char isInterleaved();
+
+
+        // all samples, not copied
+        T *getSamples();
+
+
+        /**
+         * Gets the first sample of a channel.  Successive samples of the
+         * channel, in row-major order, are getChannelStride() apart.
+         *
+         * @param inChannel the channel.
+         *
+         * @return the first sample, not copied.
+         */
+        T *getChannel( int inChannel );
+
+        int getChannelStride();
+
+
+
+        T getSample( int inX, int inY, int inChannel );
+
+        void setSample( int inX, int inY, int inChannel, T inValue );
+
+
+
+        /**
+         * Copies this image, optionally changing its layout.
+         *
+         * @param inInterleaved the layout of the copy.
+         *
+         * @return the copy.  Must be destroyed by caller.
+         */
+        PixelImage<T> *copy( char inInterleaved );
+
+
+
+        /**
+         * Converts an Image.  Values are clamped to 0..1 for integer
+         * sample types.
+         *
+         * @param inImage the image to convert.  Destroyed by caller.
+         * @param inInterleaved the layout of the result.
+         *
+         * @return the new image.  Must be destroyed by caller.
+         */
+        static PixelImage<T> *fromImage( Image *inImage,
+                                         char inInterleaved = true );
+
+
+        /**
+         * Converts to an Image.
+         *
+         * @return the new image.  Must be destroyed by caller.
+         */
+        Image *toImage();
+
+
+
+    protected:
+
+        T *mSamples;
+
+        int mWidth;
+        int mHeight;
+        int mNumChannels;
+
+        char mInterleaved;
+        char mOwnsSamples;
+
+
+        // converts Image channels in, or out, with SSE2 where it helps
+        void setFromImage( Image *inImage );
+        void channelFromDoubles( int inChannel, double *inValues );
+        void channelToDoubles( int inChannel, double *outValues );
+
+    };
+
+
+
+typedef PixelImage<unsigned char> PixelImage8;
+typedef PixelImage<unsigned short> PixelImage16;
+typedef PixelImage<float> PixelImageFloat;
+
+
+
+
+template <class T>
+inline PixelImage<T>::PixelImage( int inWidth, int inHeight,
+                                  int inNumChannels, char inInterleaved )
+        : mSamples( new T[ inWidth * inHeight * inNumChannels ] ),
+          mWidth( inWidth ), mHeight( inHeight ),
+          mNumChannels( inNumChannels ),
+          mInterleaved( inInterleaved ),
+          mOwnsSamples( true ) {
+
+    memset( mSamples, 0, sizeof( T ) * inWidth * inHeight * inNumChannels );
+    }
+
+
+
+template <class T>
+inline PixelImage<T>::PixelImage( T *inSamples, int inWidth, int inHeight,
+                                  int inNumChannels, char inInterleaved,
+                                  char inTakeOwnership )
+        : mSamples( inSamples ),
+          mWidth( inWidth ), mHeight( inHeight ),
+          mNumChannels( inNumChannels ),
+          mInterleaved( inInterleaved ),
+          mOwnsSamples( inTakeOwnership ) {
+    }
+
+
+
+template <class T>
+inline PixelImage<T>::PixelImage( RawRGBAImage *inImage )
+        : mSamples( inImage->mRGBABytes ),
+          mWidth( inImage->mWidth ), mHeight( inImage->mHeight ),
+          mNumChannels( inImage->mNumChannels ),
+          mInterleaved( true ),
+          mOwnsSamples( false ) {
+    }
+
+
+
+template <class T>
+inline PixelImage<T>::~PixelImage() {
+    if( mOwnsSamples ) {
+        delete [] mSamples;
+        }
+    }
+
+
+
+template <class T>
+inline int PixelImage<T>::getWidth() {
+    return mWidth;
+    }
+
+
+template <class T>
+inline int PixelImage<T>::getHeight() {
+    return mHeight;
+    }
+
+
+template <class T>
+inline int PixelImage<T>::getNumChannels() {
+    return mNumChannels;
+    }
+
+
+template <class T>
+inline char PixelImage<T>::isInterleaved() {
+    return mInterleaved;
+    }
+
+
+template <class T>
+inline T *PixelImage<T>::getSamples() {
+    return mSamples;
+    }
+
+
+
+template <class T>
+inline T *PixelImage<T>::getChannel( int inChannel ) {
+    if( mInterleaved ) {
+        return &( mSamples[ inChannel ] );
+        }
+    return &( mSamples[ inChannel * mWidth * mHeight ] );
+    }
+
+
+
+template <class T>
+inline int PixelImage<T>::getChannelStride() {
+    if( mInterleaved ) {
+        return mNumChannels;
+        }
+    return 1;
+    }
+
+
+
+template <class T>
+inline T PixelImage<T>::getSample( int inX, int inY, int inChannel ) {
+    return getChannel( inChannel )[
+        ( inY * mWidth + inX ) * getChannelStride() ];
+    }
+
+
+
+template <class T>
+inline void PixelImage<T>::setSample( int inX, int inY, int inChannel,
+                                      T inValue ) {
+    getChannel( inChannel )[
+        ( inY * mWidth + inX ) * getChannelStride() ] = inValue;
+    }
+
+
+
+template <class T>
+inline PixelImage<T> *PixelImage<T>::copy( char inInterleaved ) {
+    PixelImage<T> *result =
+        new PixelImage<T>( mWidth, mHeight, mNumChannels, inInterleaved );
+
+    int numSamples = mWidth * mHeight * mNumChannels;
+
+    if( inInterleaved == mInterleaved ) {
+        memcpy( result->mSamples, mSamples, numSamples * sizeof( T ) );
+        return result;
+        }
+
+    int numPixels = mWidth * mHeight;
+
+    for( int c=0; c<mNumChannels; c++ ) {
+        T *source = getChannel( c );
+        int sourceStride = getChannelStride();
+
+        T *dest = result->getChannel( c );
+        int destStride = result->getChannelStride();
+
+        for( int i=0; i<numPixels; i++ ) {
+            dest[ i * destStride ] = source[ i * sourceStride ];
+            }
+        }
+
+    return result;
+    }
+
+
+
+template <class T>
+inline void PixelImage<T>::setFromImage( Image *inImage ) {
+    for( int c=0; c<mNumChannels; c++ ) {
+        channelFromDoubles( c, inImage->getChannel( c ) );
+        }
+    }
+
+
+
+template <class T>
+inline void PixelImage<T>::channelFromDoubles( int inChannel,
+                                               double *inValues ) {
+    T *dest = getChannel( inChannel );
+    int stride = getChannelStride();
+    int numPixels = mWidth * mHeight;
+
+    for( int i=0; i<numPixels; i++ ) {
+        dest[ i * stride ] = PixelTraits<T>::fromDouble( inValues[i] );
+        }
+    }
+
+
+
+template <class T>
+inline void PixelImage<T>::channelToDoubles( int inChannel,
+                                             double *outValues ) {
+    T *source = getChannel( inChannel );
+    int stride = getChannelStride();
+    int numPixels = mWidth * mHeight;
+
+    for( int i=0; i<numPixels; i++ ) {
+        outValues[i] = PixelTraits<T>::toDouble( source[ i * stride ] );
+        }
+    }
+
+
+
+#if defined(__SSE2__)
+
+// 8-bit conversions, four pixels at a time
+
+// rounds four clamped, scaled doubles to ints
+static inline __m128i pixelImageRoundFour( double *inValues ) {
+    __m128d zero = _mm_setzero_pd();
+    __m128d max = _mm_set1_pd( 255.0 );
+
+    __m128d a = _mm_mul_pd( _mm_loadu_pd( inValues ), max );
+    __m128d b = _mm_mul_pd( _mm_loadu_pd( &( inValues[2] ) ), max );
+
+    a = _mm_min_pd( _mm_max_pd( a, zero ), max );
+    b = _mm_min_pd( _mm_max_pd( b, zero ), max );
+
+    // rounds to nearest, like lrint
+    return _mm_unpacklo_epi64( _mm_cvtpd_epi32( a ), _mm_cvtpd_epi32( b ) );
+    }
+
+
+
+template <>
+inline void PixelImage<unsigned char>::channelFromDoubles( int inChannel,
+                                                           double *inValues ) {
+    unsigned char *dest = getChannel( inChannel );
+    int stride = getChannelStride();
+    int numPixels = mWidth * mHeight;
+
+    int i = 0;
+
+    if( stride == 1 ) {
+        for( ; i + 16 <= numPixels; i += 16 ) {
+            __m128i a = _mm_packs_epi32(
+                pixelImageRoundFour( &( inValues[i] ) ),
+                pixelImageRoundFour( &( inValues[ i + 4 ] ) ) );
+            __m128i b = _mm_packs_epi32(
+                pixelImageRoundFour( &( inValues[ i + 8 ] ) ),
+                pixelImageRoundFour( &( inValues[ i + 12 ] ) ) );
+
+            _mm_storeu_si128( (__m128i *)&( dest[i] ),
+                              _mm_packus_epi16( a, b ) );
+            }
+        }
+
+    for( ; i<numPixels; i++ ) {
+        dest[ i * stride ] =
+            PixelTraits<unsigned char>::fromDouble( inValues[i] );
+        }
+    }
+
+
+
+template <>
+inline void PixelImage<unsigned char>::setFromImage( Image *inImage ) {
+    
+    if( ! mInterleaved || mNumChannels != 4 ) {
+        for( int c=0; c<mNumChannels; c++ ) {
+            channelFromDoubles( c, inImage->getChannel( c ) );
+            }
+        return;
+        }
+
+    // build whole RGBA pixels at once
+    double *r = inImage->getChannel( 0 );
+    double *g = inImage->getChannel( 1 );
+    double *b = inImage->getChannel( 2 );
+    double *a = inImage->getChannel( 3 );
+
+    int numPixels = mWidth * mHeight;
+
+    int i = 0;
+
+    for( ; i + 4 <= numPixels; i += 4 ) {
+        __m128i pixels = 
+            _mm_or_si128(
+                _mm_or_si128( 
+                    pixelImageRoundFour( &( r[i] ) ),
+                    _mm_slli_epi32( pixelImageRoundFour( &( g[i] ) ), 8 ) ),
+                _mm_or_si128(
+                    _mm_slli_epi32( pixelImageRoundFour( &( b[i] ) ), 16 ),
+                    _mm_slli_epi32( pixelImageRoundFour( &( a[i] ) ), 24 ) ) );
+        
+        _mm_storeu_si128( (__m128i *)&( mSamples[ i * 4 ] ), pixels );
+        }
+
+    for( ; i<numPixels; i++ ) {
+        unsigned char *pixel = &( mSamples[ i * 4 ] );
+        
+        pixel[0] = PixelTraits<unsigned char>::fromDouble( r[i] );
+        pixel[1] = PixelTraits<unsigned char>::fromDouble( g[i] );
+        pixel[2] = PixelTraits<unsigned char>::fromDouble( b[i] );
+        pixel[3] = PixelTraits<unsigned char>::fromDouble( a[i] );
+        }
+    }
+
+
+
+template <>
+inline void PixelImage<unsigned char>::channelToDoubles( int inChannel,
+                                                         double *outValues ) {
+    unsigned char *source = getChannel( inChannel );
+    int stride = getChannelStride();
+    int numPixels = mWidth * mHeight;
+
+    __m128d scale = _mm_set1_pd( 1.0 / 255 );
+    __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+
+    if( stride == 1 ) {
+        for( ; i + 4 <= numPixels; i += 4 ) {
+            int fourBytes;
+            memcpy( &fourBytes, &( source[i] ), 4 );
+
+            __m128i v = _mm_unpacklo_epi16(
+                _mm_unpacklo_epi8( _mm_cvtsi32_si128( fourBytes ), zero ),
+                zero );
+
+            _mm_storeu_pd( &( outValues[i] ),
+                           _mm_mul_pd( _mm_cvtepi32_pd( v ), scale ) );
+            _mm_storeu_pd( &( outValues[ i + 2 ] ),
+                           _mm_mul_pd(
+                               _mm_cvtepi32_pd( _mm_srli_si128( v, 8 ) ),
+                               scale ) );
+            }
+        }
+    else if( stride == 4 ) {
+        __m128i mask = _mm_set1_epi32( 0xFF );
+        __m128i shift = _mm_cvtsi32_si128( inChannel * 8 );
+
+        for( ; i + 4 <= numPixels; i += 4 ) {
+            // four whole pixels, shifted so this channel is in the low
+            // byte of each
+            __m128i pixels =
+                _mm_loadu_si128( (__m128i *)&( mSamples[ i * 4 ] ) );
+            __m128i v = _mm_and_si128( _mm_srl_epi32( pixels, shift ),
+                                       mask );
+
+            _mm_storeu_pd( &( outValues[i] ),
+                           _mm_mul_pd( _mm_cvtepi32_pd( v ), scale ) );
+            _mm_storeu_pd( &( outValues[ i + 2 ] ),
+                           _mm_mul_pd(
+                               _mm_cvtepi32_pd( _mm_srli_si128( v, 8 ) ),
+                               scale ) );
+            }
+        }
+
+    for( ; i<numPixels; i++ ) {
+        outValues[i] =
+            PixelTraits<unsigned char>::toDouble( source[ i * stride ] );
+        }
+    }
+
+#endif
+
+
+
+template <class T>
+inline PixelImage<T> *PixelImage<T>::fromImage( Image *inImage,
+                                                char inInterleaved ) {
+
+    int numChannels = inImage->getNumChannels();
+
+    PixelImage<T> *result = new PixelImage<T>(
+        new T[ inImage->getWidth() * inImage->getHeight() * numChannels ],
+        inImage->getWidth(), inImage->getHeight(), numChannels,
+        inInterleaved, true );
+
+    result->setFromImage( inImage );
+
+    return result;
+    }
+
+
+
+template <class T>
+inline Image *PixelImage<T>::toImage() {
+
+    Image *result = new Image( mWidth, mHeight, mNumChannels, false );
+
+    for( int c=0; c<mNumChannels; c++ ) {
+        channelToDoubles( c, result->getChannel( c ) );
+        }
+
+    return result;
+    }
+
+
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef SKYLINE_PACKER_INCLUDED
+#define SKYLINE_PACKER_INCLUDED
+
+
+
+#include <string.h>
+
+
+
+/**
+ * Packs rectangles into a fixed-size bin, for building texture atlases.
+ *
+ * Keeps the "skyline" of the packed area:  a list of horizontal segments
+ * that together span the bin's width, each at the height of the tallest
+ * rectangle packed below it.  A new rectangle goes at the bottom-left-most
+ * spot where it fits on top of the skyline (lowest resulting top edge,
+ * with ties going to the narrowest segment).
+ *
+ * Space wasted under overhanging rectangles is never reclaimed, so
+ * rectangles can't be freed individually, only all at once with reset.
+ * Packing quality is close to maxrects for sprite-sized rectangles, at a
+ * fraction of the cost.
+ *
+ * @author Jason Rohrer
+ */
+class SkylinePacker {
+
+    public:
+
+        SkylinePacker( int inWidth, int inHeight )
+                : mWidth( inWidth ), mHeight( inHeight ),
+                  // every segment is at least 1 wide, and an insert adds at
+                  // most one segment before trimming those it covers
+                  mNodes( new SkylineNode[ inWidth + 1 ] ) {
+            reset();
+            }
+
+
+        ~SkylinePacker() {
+            delete [] mNodes;
+            }
+
+
+
+        // packs a rectangle, returning its lower-left corner in
+        // outX and outY
+        // returns false (and leaves the packer unchanged) if there's no room
+        char pack( int inWidth, int inHeight, int *outX, int *outY );
+
+
+        // empties the bin
+        void reset() {
+            mNumNodes = 1;
+            mNodes[0].x = 0;
+            mNodes[0].y = 0;
+            mNodes[0].width = mWidth;
+            mUsedArea = 0;
+            }
+
+
+        int getWidth() {
+            return mWidth;
+            }
+
+        int getHeight() {
+            return mHeight;
+            }
+
+
+        // fraction of the bin's area covered by packed rectangles
+        double getOccupancy() {
+            return (double)mUsedArea / ( (double)mWidth * mHeight );
+            }
+
+
+    protected:
+
+        typedef struct SkylineNode {
+                int x, y, width;
+            } SkylineNode;
+
+        int mWidth, mHeight;
+
+        SkylineNode *mNodes;
+        int mNumNodes;
+
+        long long mUsedArea;
+
+
+        // y at which a rectangle starting at the left of node inIndex
+        // would rest, or -1 if it doesn't fit there
+        int fitAt( int inIndex, int inWidth, int inHeight );
+
+        void addLevel( int inIndex, int inX, int inY,
+                       int inWidth, int inHeight );
+
+    };
+
+
+
+inline char SkylinePacker::pack( int inWidth, int inHeight,
+                                 int *outX, int *outY ) {
+    if( inWidth <= 0 || inHeight <= 0 ||
+        inWidth > mWidth || inHeight > mHeight ) {
+        return false;
+        }
+
+    int bestIndex = -1;
+    int bestTop = mHeight + 1;
+    int bestWidth = mWidth + 1;
+    int bestY = 0;
+
+    for( int i=0; i<mNumNodes; i++ ) {
+        int y = fitAt( i, inWidth, inHeight );
+
+        if( y >= 0 ) {
+            int top = y + inHeight;
+
+            if( top < bestTop ||
+                ( top == bestTop && mNodes[i].width < bestWidth ) ) {
+                bestIndex = i;
+                bestTop = top;
+                bestWidth = mNodes[i].width;
+                bestY = y;
+                }
+            }
+        }
+
+    if( bestIndex == -1 ) {
+        return false;
+        }
+
+    *outX = mNodes[ bestIndex ].x;
+    *outY = bestY;
+
+    addLevel( bestIndex, *outX, bestY, inWidth, inHeight );
+
+    mUsedArea += (long long)inWidth * inHeight;
+
+    return true;
+    }
+
+
+
+inline int SkylinePacker::fitAt( int inIndex, int inWidth, int inHeight ) {
+    if( mNodes[ inIndex ].x + inWidth > mWidth ) {
+        return -1;
+        }
+
+    int y = 0;
+    int widthLeft = inWidth;
+    int i = inIndex;
+
+    // segments always span the full bin width, so we can't run off the end
+    while( widthLeft > 0 ) {
+        if( mNodes[i].y > y ) {
+            y = mNodes[i].y;
+            }
+        if( y + inHeight > mHeight ) {
+            return -1;
+            }
+        widthLeft -= mNodes[i].width;
+        i++;
+        }
+
+    return y;
+    }
+
+
+
+inline void SkylinePacker::addLevel( int inIndex, int inX, int inY,
+                                     int inWidth, int inHeight ) {
+
+    memmove( &( mNodes[ inIndex + 1 ] ), &( mNodes[ inIndex ] ),
+             ( mNumNodes - inIndex ) * sizeof( SkylineNode ) );
+    mNumNodes++;
+
+    mNodes[ inIndex ].x = inX;
+    mNodes[ inIndex ].y = inY + inHeight;
+    mNodes[ inIndex ].width = inWidth;
+
+
+    // trim or remove the segments now covered by the new one
+    int i = inIndex + 1;
+    int newEnd = inX + inWidth;
+
+    while( i < mNumNodes && mNodes[i].x < newEnd ) {
+        int shrink = newEnd - mNodes[i].x;
+
+        if( shrink < mNodes[i].width ) {
+            mNodes[i].x += shrink;
+            mNodes[i].width -= shrink;
+            break;
+            }
+
+        memmove( &( mNodes[i] ), &( mNodes[ i + 1 ] ),
+                 ( mNumNodes - i - 1 ) * sizeof( SkylineNode ) );
+        mNumNodes--;
+        }
+
+
+    // merge neighbors at the same height
+    i = 0;
+    while( i < mNumNodes - 1 ) {
+        if( mNodes[i].y == mNodes[ i + 1 ].y ) {
+            mNodes[i].width += mNodes[ i + 1 ].width;
+
+            memmove( &( mNodes[ i + 1 ] ), &( mNodes[ i + 2 ] ),
+                     ( mNumNodes - i - 2 ) * sizeof( SkylineNode ) );
+            mNumNodes--;
+            }
+        else {
+            i++;
+            }
+        }
+    }
+
+
+
+#endif
@@ -97,30 +97,30 @@ inline void BMPImageConverter::formatImage( Image *inImage,
 	long colorsUsed = 0;
 	long colorsImportant = 0;
 	
-	// write the header
-	unsigned char *signature = new unsigned char[2];
-	signature[0] = 'B';
-	signature[1] = 'M';
-	inStream->write( signature, 2 );
-	delete [] signature;
-	writeLittleEndianLong( fileSize, inStream );
-	writeLittleEndianLong( 0, inStream );
-	writeLittleEndianLong( offsetToRaster, inStream );
-	
-	// write the info header
+	// build both headers in one buffer and write them together
+	unsigned char header[54];
+	header[0] = 'B';
+	header[1] = 'M';
+	storeLittleEndian32( &( header[2] ), fileSize );
+	storeLittleEndian32( &( header[6] ), 0 );
+	storeLittleEndian32( &( header[10] ), offsetToRaster );
+	
+	// the info header
 	// header size
-	writeLittleEndianLong( 40, inStream );
-	writeLittleEndianLong( width, inStream );
-	writeLittleEndianLong( height, inStream );
+	storeLittleEndian32( &( header[14] ), 40 );
+	storeLittleEndian32( &( header[18] ), width );
+	storeLittleEndian32( &( header[22] ), height );
 	// numPlanes
-	writeLittleEndianShort( 1, inStream );
-	writeLittleEndianShort( bitCount, inStream );
-	writeLittleEndianLong( compressionType, inStream );
-	writeLittleEndianLong( rasterSize, inStream );
-	writeLittleEndianLong( pixelsPerMeter, inStream );
-	writeLittleEndianLong( pixelsPerMeter, inStream );
-	writeLittleEndianLong( colorsUsed, inStream );
-	writeLittleEndianLong( colorsImportant, inStream );
+	storeLittleEndian16( &( header[26] ), 1 );
+	storeLittleEndian16( &( header[28] ), bitCount );
+	storeLittleEndian32( &( header[30] ), compressionType );
+	storeLittleEndian32( &( header[34] ), rasterSize );
+	storeLittleEndian32( &( header[38] ), pixelsPerMeter );
+	storeLittleEndian32( &( header[42] ), pixelsPerMeter );
+	storeLittleEndian32( &( header[46] ), colorsUsed );
+	storeLittleEndian32( &( header[50] ), colorsImportant );
+	
+	inStream->write( header, 54 );
 	
 	// no color table...
 	
@@ -164,44 +164,37 @@ inline void BMPImageConverter::formatImage( Image *inImage,
 
 
 inline Image *BMPImageConverter::deformatImage( InputStream *inStream ) {
-	// temp buffer used to skip data in the stream
-	unsigned char *temp = new unsigned char[ 100 ];
-	
-	// skip signature
-	inStream->read( temp, 2 );
-	
-	long fileSize = readLittleEndianLong( inStream );
+	// read the file header and info header in one go and
+	// pick the fields out of it
+	unsigned char header[54];
 	
-	// skip unused
-	inStream->read( temp, 4 );
+	if( inStream->read( header, 54 ) != 54 ) {
+		return NULL;
+		}
 	
-	long rasterOffset = readLittleEndianLong( inStream );
+	long fileSize = (int32_t)loadLittleEndian32( &( header[2] ) );
+	long rasterOffset = (int32_t)loadLittleEndian32( &( header[10] ) );
 	long rasterSize = fileSize - rasterOffset;
 	
-	// skip size of header
-	inStream->read( temp, 4 );
-	
-	long width = readLittleEndianLong( inStream );
-	long height = readLittleEndianLong( inStream );
+	long width = (int32_t)loadLittleEndian32( &( header[18] ) );
+	long height = (int32_t)loadLittleEndian32( &( header[22] ) );
 	
-	// skip planes
-	inStream->read( temp, 2 );
-	
-	short bitCount = readLittleEndianShort( inStream );
+	short bitCount = (short)loadLittleEndian16( &( header[28] ) );
 	
 	char failing = false;
 	if( bitCount != 24 ) {
 		printf( "Only 24-bit BMP file formats supported.\n" );
 		failing = true;
 		}
-	long compression = readLittleEndianLong( inStream );
+	long compression = (int32_t)loadLittleEndian32( &( header[30] ) );
 	if( compression != 0 ) {
 		printf( "Only uncompressed BMP file formats supported.\n" );
 		failing = true;
 		}
 	
-	// skip imageSize, resolution, and color usage information
-	inStream->read( temp, 20 );
+	if( failing || width <= 0 || height <= 0 || rasterSize <= 0 ) {
+		return NULL;
+		}
 	
 	// now we're at the raster.
 
@@ -209,45 +202,41 @@ inline Image *BMPImageConverter::deformatImage( InputStream *inStream ) {
 	// end on a 4-byte boundary
 	int numZeroPaddingBytes = ( 4 - ( width * 3 ) % 4 ) % 4;
 	
-	unsigned char *raster = new unsigned char[ rasterSize ];
-	inStream->read( raster, rasterSize );
-	Image *returnImage;
-	if( failing ) {
+	if( rasterSize < ( width * 3 + numZeroPaddingBytes ) * height ) {
+		printf( "BMP raster too short for image size.\n" );
 		return NULL;
 		}
-	else {
-		
-		returnImage = new Image( width, height, 3 );
-		
-		double *red = returnImage->getChannel( 0 );
-		double *green = returnImage->getChannel( 1 );
-		double *blue = returnImage->getChannel( 2 );
+	
+	unsigned char *raster = new unsigned char[ rasterSize ];
+	inStream->read( raster, rasterSize );
+	Image *returnImage = new Image( width, height, 3 );
+	double *red = returnImage->getChannel( 0 );
+	double *green = returnImage->getChannel( 1 );
+	double *blue = returnImage->getChannel( 2 );
 
-		// pixels are stored bottom-up, left to right
-		// (row major order)
+	// pixels are stored bottom-up, left to right
+	// (row major order)
 
-		long rasterIndex = 0;
-		for( int y=height-1; y>=0; y-- ) {
-			for( int x=0; x<width; x++ ) {
-				int imageIndex = y * width + x;
+	long rasterIndex = 0;
+	for( int y=height-1; y>=0; y-- ) {
+		for( int x=0; x<width; x++ ) {
+			int imageIndex = y * width + x;
 
-				blue[imageIndex] = 
-					(double)( raster[rasterIndex] ) / 255.0;
-				green[imageIndex] = 
-					(double)( raster[rasterIndex + 1] ) / 255.0;
-				red[imageIndex] = 
-					(double)( raster[rasterIndex + 2] ) / 255.0;
+			blue[imageIndex] = 
+				(double)( raster[rasterIndex] ) / 255.0;
+			green[imageIndex] = 
+				(double)( raster[rasterIndex + 1] ) / 255.0;
+			red[imageIndex] = 
+				(double)( raster[rasterIndex + 2] ) / 255.0;
 
-				rasterIndex += 3;
-				}
-			
-			// skip the zero padding bytes at the end of this line
-			rasterIndex += numZeroPaddingBytes;
+			rasterIndex += 3;
 			}
+		
+		// skip the zero padding bytes at the end of this line
+		rasterIndex += numZeroPaddingBytes;
 		}
 	
 	delete [] raster;	
-	delete [] temp;
 	
 	return returnImage;
 	}
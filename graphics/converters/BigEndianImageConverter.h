@@ -11,6 +11,7 @@
 
 
 #include "minorGems/graphics/ImageConverter.h"
+#include "minorGems/system/endian.h"
 
 
 /**
@@ -82,10 +83,7 @@ inline void BigEndianImageConverter::writeBigEndianLong( long inLong,
 	
 	unsigned char buffer[4];
 	
-	buffer[0] = (unsigned char)( ( inLong >> 24 ) & 0xFF );
-    buffer[1] = (unsigned char)( ( inLong >> 16 ) & 0xFF );
-	buffer[2] = (unsigned char)( ( inLong >> 8 ) & 0xFF );
-    buffer[3] = (unsigned char)( inLong & 0xFF );
+	storeBigEndian32( buffer, (uint32_t)inLong );
 	
 	inStream->write( buffer, 4 );
 	}
@@ -99,13 +97,7 @@ inline long BigEndianImageConverter::readBigEndianLong(
 	
 	inStream->read( buffer, 4 );
 	
-	long outLong =
-        ( buffer[0] << 24 ) |
-        ( buffer[1] << 16 ) |
-        ( buffer[2] << 8 )  |
-        buffer[3];
-	
-	return outLong;
+	return (long)(int32_t)loadBigEndian32( buffer );
 	}
 
 
@@ -115,8 +107,7 @@ inline void BigEndianImageConverter::writeBigEndianShort( short inShort,
 	
 	unsigned char buffer[2];
 	
-	buffer[0] = (unsigned char)( ( inShort >> 8 ) & 0xFF );
-	buffer[1] = (unsigned char)( inShort & 0xFF );
+	storeBigEndian16( buffer, (uint16_t)inShort );
 	
 	inStream->write( buffer, 2 );
 	}
@@ -130,11 +121,7 @@ inline short BigEndianImageConverter::readBigEndianShort(
 	
 	inStream->read( buffer, 2 );
 	
-	long outShort =
-        ( buffer[0] << 8 ) |
-        buffer[1];
-	
-	return outShort;
+	return (short)loadBigEndian16( buffer );
 	}
 
 
@@ -0,0 +1,121 @@
+#include "FrameEncoderQueue.h"
+
+#include "minorGems/io/file/FileOutputStream.h"
+
+#include <stdio.h>
+
+
+
+typedef struct FrameEncoderJob {
+        FrameEncoderQueue *queue;
+        RawRGBAImage *image;
+        File *file;
+    } FrameEncoderJob;
+
+
+
+static void frameEncoderJobFunction( void *inJobData ) {
+    FrameEncoderJob *job = (FrameEncoderJob *)inJobData;
+    
+    job->queue->encodeFrame( job->image, job->file );
+
+    delete job;
+    }
+
+
+
+FrameEncoderQueue::FrameEncoderQueue( ImageConverter *inConverter,
+                                      int inNumThreads,
+                                      int inMaxQueued,
+                                      FrameDropPolicy inPolicy )
+        : mConverter( inConverter ),
+          mPolicy( inPolicy ),
+          mFreeSlots( inMaxQueued ),
+          mNumEncoded( 0 ),
+          mNumDropped( 0 ),
+          mPool( new ThreadPool( inNumThreads ) ) {
+    }
+
+
+
+FrameEncoderQueue::~FrameEncoderQueue() {
+    // waits for jobs to finish
+    delete mPool;
+    }
+
+
+
+char FrameEncoderQueue::addFrame( RawRGBAImage *inImage, File *inFile ) {
+    
+    int timeout = -1;
+    
+    if( mPolicy == frameDropWhenFull ) {
+        timeout = 0;
+        }
+    
+    if( mFreeSlots.wait( timeout ) != 1 ) {
+        mLock.lock();
+        mNumDropped ++;
+        mLock.unlock();
+
+        delete inImage;
+        delete inFile;
+        return false;
+        }
+
+    FrameEncoderJob *job = new FrameEncoderJob;
+    job->queue = this;
+    job->image = inImage;
+    job->file = inFile;
+
+    mPool->addJob( frameEncoderJobFunction, job );
+    
+    return true;
+    }
+
+
+
+void FrameEncoderQueue::encodeFrame( RawRGBAImage *inImage, File *inFile ) {
+
+    // closed before the frame is counted as written
+    {
+        FileOutputStream stream( inFile );
+    
+        mConverter->formatImageRaw( inImage, &stream );
+        }
+
+    delete inImage;
+    delete inFile;
+
+    mLock.lock();
+    mNumEncoded ++;
+    mLock.unlock();
+
+    mFreeSlots.signal();
+    }
+
+
+
+void FrameEncoderQueue::waitForAll() {
+    mPool->waitForAllJobs();
+    }
+
+
+
+int FrameEncoderQueue::getNumEncoded() {
+    mLock.lock();
+    int n = mNumEncoded;
+    mLock.unlock();
+    
+    return n;
+    }
+
+
+
+int FrameEncoderQueue::getNumDropped() {
+    mLock.lock();
+    int n = mNumDropped;
+    mLock.unlock();
+    
+    return n;
+    }
@@ -0,0 +1,114 @@
+#ifndef FRAME_ENCODER_QUEUE_INCLUDED
+#define FRAME_ENCODER_QUEUE_INCLUDED
+
+
+
+#include "minorGems/graphics/ImageConverter.h"
+#include "minorGems/graphics/RawRGBAImage.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/system/ThreadPool.h"
+#include "minorGems/system/Semaphore.h"
+#include "minorGems/system/MutexLock.h"
+
+
+
+// what addFrame does when maxQueued frames are already waiting
+enum FrameDropPolicy {
+    // wait for an encoder to finish a frame
+    frameBlockWhenFull = 0,
+    
+    // drop the new frame
+    frameDropWhenFull
+    };
+
+
+
+/**
+ * Encodes captured frames and writes them to files on a pool of
+ * encoder threads, so that the thread capturing frames never waits on
+ * compression or disk.
+ *
+ * At most inMaxQueued frames are held at once (queued or being
+ * encoded), which bounds memory use when encoding falls behind capture.
+ *
+ * @author Jason Rohrer
+ */
+class FrameEncoderQueue {
+
+    public:
+
+        /**
+         * Constructs a queue and starts its encoder threads.
+         *
+         * @param inConverter the converter used to write frames.
+         *   Its formatImageRaw is called from several threads at once,
+         *   so it must keep no per-call state in members (true of the
+         *   TGA and PNG converters).
+         *   Must be destroyed by caller after this queue is destroyed.
+         * @param inNumThreads the number of encoder threads, or -1 for
+         *   one per processor.
+         * @param inMaxQueued the most frames held at once.
+         * @param inPolicy what to do with new frames when full.
+         */
+        FrameEncoderQueue( ImageConverter *inConverter,
+                           int inNumThreads = -1,
+                           int inMaxQueued = 8,
+                           FrameDropPolicy inPolicy = frameBlockWhenFull );
+
+
+        // waits for all queued frames to be written
+        ~FrameEncoderQueue();
+
+
+        
+        /**
+         * Queues a frame to be encoded and written.  
+         *
+         * @param inImage the frame, rows top to bottom.
+         *   Destroyed by this queue.
+         * @param inFile the file to write to.
+         *   Destroyed by this queue.
+         *
+         * @return true if the frame was queued, or false if it was
+         *   dropped because the queue was full.
+         */
+        char addFrame( RawRGBAImage *inImage, File *inFile );
+
+        
+
+        // blocks until every frame added so far has been written
+        void waitForAll();
+        
+
+        
+        int getNumEncoded();
+
+        int getNumDropped();
+
+
+        
+        // called by encoder jobs
+        void encodeFrame( RawRGBAImage *inImage, File *inFile );
+        
+
+    protected:
+        
+        ImageConverter *mConverter;
+        
+        FrameDropPolicy mPolicy;
+
+        // counts free frame slots
+        Semaphore mFreeSlots;
+        
+        MutexLock mLock;
+        int mNumEncoded;
+        int mNumDropped;
+
+        // destroyed before the semaphore, since its threads signal it
+        ThreadPool *mPool;
+        
+    };
+
+
+
+#endif
@@ -11,6 +11,7 @@
 
 
 #include "minorGems/graphics/ImageConverter.h"
+#include "minorGems/system/endian.h"
 
 
 /**
@@ -82,10 +83,7 @@ inline void LittleEndianImageConverter::writeLittleEndianLong( long inLong,
 	
 	unsigned char buffer[4];
 	
-	buffer[0] = (unsigned char)( inLong & 0xFF );
-	buffer[1] = (unsigned char)( ( inLong >> 8 ) & 0xFF );
-	buffer[2] = (unsigned char)( ( inLong >> 16 ) & 0xFF );
-	buffer[3] = (unsigned char)( ( inLong >> 24 ) & 0xFF );
+	storeLittleEndian32( buffer, (uint32_t)inLong );
 	
 	inStream->write( buffer, 4 );
 	}
@@ -99,10 +97,7 @@ inline long LittleEndianImageConverter::readLittleEndianLong(
 	
 	inStream->read( buffer, 4 );
 	
-	long outLong = buffer[0] | ( buffer[1] << 8 ) | ( buffer[2] << 16 )
-		| ( buffer[3] << 24 );
-	
-	return outLong;
+	return (long)(int32_t)loadLittleEndian32( buffer );
 	}
 
 
@@ -112,8 +107,7 @@ inline void LittleEndianImageConverter::writeLittleEndianShort( short inShort,
 	
 	unsigned char buffer[2];
 	
-	buffer[0] = (unsigned char)( inShort & 0xFF );
-	buffer[1] = (unsigned char)( ( inShort >> 8 ) & 0xFF );
+	storeLittleEndian16( buffer, (uint16_t)inShort );
 	
 	inStream->write( buffer, 2 );
 	}
@@ -127,9 +121,7 @@ inline short LittleEndianImageConverter::readLittleEndianShort(
 	
 	inStream->read( buffer, 2 );
 	
-	long outShort = buffer[0] | ( buffer[1] << 8 );
-	
-	return outShort;
+	return (short)loadLittleEndian16( buffer );
 	}
 
 
@@ -16,38 +16,53 @@
 
 #include "minorGems/util/SimpleVector.h"
 #include "minorGems/graphics/RGBAImage.h"
+#include "minorGems/system/ThreadPool.h"
+#include "minorGems/system/Semaphore.h"
 
 #include <math.h>
+#include <string.h>
+#include <stdlib.h>
 
-//#include "lodepng.h"
+#include <png.h>
 
-//#include <zlib.h>
 
-#include <png.h>
+// miniz is compiled in encodingUtils.cpp
+// png.h brings in zlib, so keep miniz's zlib-style names out of the way
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "minorGems/formats/miniz.h"
 
 
 
-PNGImageConverter::PNGImageConverter( int inCompressionLevel )
-        : mCompressionLevel( inCompressionLevel  ) {
+PNGImageConverter::PNGImageConverter( int inCompressionLevel,
+                                      int inNumThreads )
+        : mCompressionLevel( inCompressionLevel ),
+          mNumThreads( inNumThreads ),
+          mPool( NULL ) {
 
-    // set up the CRC table
+    if( mCompressionLevel < 0 ) {
+        mCompressionLevel = 0;
+        }
+    if( mCompressionLevel > 9 ) {
+        mCompressionLevel = 9;
+        }
     
-    // code taken from the PNG spec:
-    // http://www.w3.org/TR/2003/REC-PNG-20031110/#D-CRCAppendix
-    unsigned long c;
-    int n, k;
-   
-    for( n=0; n<256; n++ ) {
-        c = (unsigned long)n;
-        for( k=0; k<8; k++ ) {
-            if( c & 1 ) {
-                c = 0xedb88320L ^ (c >> 1);
-                }
-            else {
-                c = c >> 1;
-                }
-            }
-        mCRCTable[n] = c;
+    if( mNumThreads == -1 ) {
+        mNumThreads = ThreadPool::getNumProcessors();
+        }
+    if( mNumThreads < 1 ) {
+        mNumThreads = 1;
+        }
+
+    if( mNumThreads > 1 ) {
+        mPool = new ThreadPool( mNumThreads );
+        }
+    }
+
+
+
+PNGImageConverter::~PNGImageConverter() {
+    if( mPool != NULL ) {
+        delete mPool;
         }
     }
 
@@ -56,18 +71,10 @@ PNGImageConverter::PNGImageConverter( int inCompressionLevel )
 unsigned long PNGImageConverter::updateCRC(
     unsigned long inCRC, unsigned char *inData, int inLength ) {
 
-    // code taken from the PNG spec:
-    // http://www.w3.org/TR/2003/REC-PNG-20031110/#D-CRCAppendix
-    
-    unsigned long c = inCRC;
-    int n;
-   
-    for( n=0; n<inLength; n++ ) {
-        c = mCRCTable[ (c ^ inData[n]) & 0xff ]
-            ^
-            (c >> 8);
-        }
-    return c;    
+    // mz_crc32 takes and returns finished (inverted) CRCs, where ours
+    // are inverted at the end by the caller
+    return ( ~mz_crc32( ( ~inCRC ) & 0xffffffffL, inData, inLength ) )
+        & 0xffffffffL;
     }
 
 
@@ -75,28 +82,43 @@ unsigned long PNGImageConverter::updateCRC(
 #define ADLER_BASE 65521 /* largest prime smaller than 65536 */
 
 /**
- * Updates an adler32 checksum.
- * code found here  http://www.ietf.org/rfc/rfc1950.txt
- *
- * New adlers should start with inAdler set to 1.
+ * Combines the adler32 checksums of two blocks of data into the checksum
+ * of both blocks in a row.
+ * Same as adler32_combine in zlib.
  *
- * @param inAdler the current state of the checksum.
- * @param inData the data to add.  Destroyed by caller.
- * @param inLength the length of the data in bytes.
+ * @param inAdlerA the checksum of the first block.
+ * @param inAdlerB the checksum of the second block.
+ * @param inLengthB the length of the second block in bytes.
  *
- * @return the new checksum.
+ * @return the checksum of both blocks.
  */
-unsigned long updateAdler32( unsigned long inAdler,
-                             unsigned char *inData, int inLength ) {
-    unsigned long s1 = inAdler & 0xffff;
-    unsigned long s2 = (inAdler >> 16) & 0xffff;
-    int n;
+static unsigned long combineAdler32( unsigned long inAdlerA,
+                                     unsigned long inAdlerB,
+                                     unsigned long inLengthB ) {
 
-    for (n = 0; n < inLength; n++) {
-        s1 = (s1 + inData[n]) % ADLER_BASE;
-        s2 = (s2 + s1)     % ADLER_BASE;
+    unsigned long rem = inLengthB % ADLER_BASE;
+    
+    unsigned long sum1 = inAdlerA & 0xffff;
+    unsigned long sum2 = ( rem * sum1 ) % ADLER_BASE;
+    
+    sum1 += ( inAdlerB & 0xffff ) + ADLER_BASE - 1;
+    sum2 += ( ( inAdlerA >> 16 ) & 0xffff ) + ( ( inAdlerB >> 16 ) & 0xffff )
+        + ADLER_BASE - rem;
+    
+    if( sum1 >= ADLER_BASE ) {
+        sum1 -= ADLER_BASE;
+        }
+    if( sum1 >= ADLER_BASE ) {
+        sum1 -= ADLER_BASE;
+        }
+    if( sum2 >= ( ADLER_BASE << 1 ) ) {
+        sum2 -= ( ADLER_BASE << 1 );
+        }
+    if( sum2 >= ADLER_BASE ) {
+        sum2 -= ADLER_BASE;
         }
-    return (s2 << 16) + s1;
+    
+    return sum1 | ( sum2 << 16 );
     }
 
 
@@ -113,10 +135,12 @@ void PNGImageConverter::writeChunk(
     // 4-byte CRC (applied to type and data parts)
 
 
-    // write the length
-    writeBigEndianLong( inNumBytes, inStream );
+    // write the length and type together
+    unsigned char chunkHeader[8];
+    storeBigEndian32( chunkHeader, (uint32_t)inNumBytes );
+    memcpy( &( chunkHeader[4] ), inChunkType, 4 );
 
-    inStream->write( (unsigned char *)inChunkType, 4 );
+    inStream->write( chunkHeader, 8 );
 
     // start the crc
     unsigned long crc = updateCRC( mStartCRC,
@@ -139,207 +163,247 @@ void PNGImageConverter::writeChunk(
 
 
 
-// callbacks for libpng io
-void libpngWriteCallback( png_structp png_ptr,
-                          png_bytep data, png_size_t length ) {
-    
-    // unpack our extra parameter
-    void *write_io_ptr = png_get_io_ptr( png_ptr );
+// filter types, from the PNG spec
+enum PNGFilterType {
+    filterNone = 0,
+    filterSub,
+    filterUp,
+    filterAverage,
+    filterPaeth
+    };
 
-    OutputStream *inStream = (OutputStream *)write_io_ptr;    
-    
-    inStream->write( data, length );
-    }
 
 
+static inline unsigned char paethPredictor( int inA, int inB, int inC ) {
+    int p = inA + inB - inC;
+    int pa = abs( p - inA );
+    int pb = abs( p - inB );
+    int pc = abs( p - inC );
 
-void libpngFlushCallback( png_structp png_ptr ) {
-    // do nothing?
+    if( pa <= pb && pa <= pc ) {
+        return (unsigned char)inA;
+        }
+    if( pb <= pc ) {
+        return (unsigned char)inB;
+        }
+    return (unsigned char)inC;
     }
 
 
 
-void PNGImageConverter::formatImage( Image *inImage, 
-	OutputStream *inStream ) {
-
-	int numChannels = inImage->getNumChannels();
-	
-	// make sure the image is in the right format
-	if( numChannels != 3 &&
-		numChannels != 4 ) {
-		printf( "Only 3- and 4-channel images can be converted to " );
-		printf( "the PNG format.\n" );
-		return;
-		}
-
-	int w = inImage->getWidth();
-	int h = inImage->getHeight();
-	
-    //RGBAImage rgbaImage( inImage );
+// filters one row into outFiltered
+// inPrevRow is NULL for the top row
+// returns the sum of the filtered bytes taken as signed, which is smaller
+// for rows that will compress well
+static unsigned long filterRow( int inType, 
+                                unsigned char *inRow,
+                                unsigned char *inPrevRow,
+                                int inRowBytes, int inBytesPerPixel,
+                                unsigned char *outFiltered ) {
     
-    unsigned char *imageBytes = RGBAImage::getRGBABytes( inImage );
-
+    unsigned long sum = 0;
+    int bpp = inBytesPerPixel;
     
+    for( int i=0; i<inRowBytes; i++ ) {
+        
+        int a = 0;
+        int b = 0;
+        int c = 0;
+        
+        if( i >= bpp ) {
+            a = inRow[ i - bpp ];
+            }
+        if( inPrevRow != NULL ) {
+            b = inPrevRow[i];
+            if( i >= bpp ) {
+                c = inPrevRow[ i - bpp ];
+                }
+            }
 
-    // libpng implementation
-
-    // adapted from this:
-    //  http://zarb.org/~gc/html/libpng.html
-
-
-    // get pointers to rows
-    unsigned char **rows = new unsigned char *[h];
-    
-    for( int y=0; y<h; y++ ) {
-        rows[y] = &( imageBytes[ y * (w * 4) ] );
+        unsigned char predicted;
+        
+        switch( inType ) {
+            case filterSub:
+                predicted = (unsigned char)a;
+                break;
+            case filterUp:
+                predicted = (unsigned char)b;
+                break;
+            case filterAverage:
+                predicted = (unsigned char)( ( a + b ) >> 1 );
+                break;
+            case filterPaeth:
+                predicted = paethPredictor( a, b, c );
+                break;
+            default:
+                predicted = 0;
+                break;
+            }
+        
+        unsigned char v = (unsigned char)( inRow[i] - predicted );
+        outFiltered[i] = v;
+        
+        // |v| as a signed byte
+        if( v < 128 ) {
+            sum += v;
+            }
+        else {
+            sum += 256 - v;
+            }
         }
 
+    return sum;
+    }
 
-    png_structp png_ptr;
-    png_infop info_ptr;
 
-	// initialize structures
-	png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, 
-                                       NULL, NULL, NULL );
-	if( !png_ptr ) {
-        delete [] imageBytes;
-        delete [] rows;
-        printf( "PNG Writing:  png_create_write_struct failed\n" );
-        return;
-        }
-    
-    png_set_compression_level( png_ptr, mCompressionLevel );
 
+// one horizontal strip of the image, filtered and compressed on its own
+typedef struct PNGStrip {
+        // settings, same for all strips
+        unsigned char *imageBytes;
+        int width;
+        int numChannels;
+        int compressionLevel;
+        
+        int startRow;
+        int endRow;
+        
+        // the last strip ends the deflate stream
+        char isLast;
+        
+        // results
+        // adler32 of the filtered bytes
+        unsigned long adler;
+        unsigned long numFilteredBytes;
+        SimpleVector<unsigned char> *compressed;
+        
+        // signaled when done, if non-NULL
+        Semaphore *doneSemaphore;
+    } PNGStrip;
 
-	info_ptr = png_create_info_struct( png_ptr );
-	
-    if( !info_ptr ) {
-        delete [] imageBytes;
-        delete [] rows;
-        png_destroy_write_struct( &png_ptr, NULL );
 
-        printf( "PNG Writing:  png_create_info_struct failed\n" );
-        return;
-        }
-    
-    // weird way that libpng handles errors with a jump
-	if( setjmp( png_jmpbuf( png_ptr ) ) ) {
-        delete [] imageBytes;
-        delete [] rows;
-        png_destroy_write_struct( &png_ptr, &info_ptr );
 
-        printf( "PNG Writing: error when setting writing funciton\n" );
-        return;
-        }
+static mz_bool stripOutputCallback( const void *inBuffer, int inLength,
+                                    void *inUserData ) {
+    SimpleVector<unsigned char> *compressed = 
+        (SimpleVector<unsigned char> *)inUserData;
     
-
-	//png_init_io(png_ptr, fp);
-
-
-    // set our write callback (since we're not writing directly to file)
-    // pass the stream as the extra void* parameter
-    png_set_write_fn( png_ptr,
-                      (void*)inStream, 
-                      libpngWriteCallback,
-                      libpngFlushCallback );
+    compressed->appendArray( (unsigned char *)inBuffer, inLength );
     
+    return MZ_TRUE;
+    }
 
-	// write header
-	if( setjmp( png_jmpbuf( png_ptr ) ) ) {
-        delete [] imageBytes;
-        delete [] rows;
-        png_destroy_write_struct( &png_ptr, &info_ptr );
-
-        printf( "PNG Writing: error writing header\n" );
-        return;
-        }
-
-	png_set_IHDR( png_ptr, info_ptr, w, h,
-                  8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
-                  PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE );
-
-	png_write_info( png_ptr, info_ptr );
-
-
-	// write bytes
-    // write header
-	if( setjmp( png_jmpbuf( png_ptr ) ) ) {
-        delete [] imageBytes;
-        delete [] rows;
-        png_destroy_write_struct( &png_ptr, &info_ptr );
-
-        printf( "PNG Writing: error writing image bytes\n" );
-        return;
-        }
-
-	png_write_image( png_ptr, rows );
-
-
-	// end write
-    if( setjmp( png_jmpbuf( png_ptr ) ) ) {
-        delete [] imageBytes;
-        delete [] rows;
-        png_destroy_write_struct( &png_ptr, &info_ptr );
 
-        printf( "PNG Writing: error ending write\n" );
-        return;
-        }
 
-	png_write_end( png_ptr, NULL );
+static void compressStrip( void *inStripData ) {
+    PNGStrip *strip = (PNGStrip *)inStripData;
 
+    int rowBytes = strip->width * strip->numChannels;
+    int numRows = strip->endRow - strip->startRow;
 
-    png_destroy_write_struct( &png_ptr, &info_ptr );
+    // each row starts with filter type byte
+    strip->numFilteredBytes = (unsigned long)numRows * ( rowBytes + 1 );
     
-    delete [] imageBytes;
-    delete [] rows;
+    unsigned char *filtered = new unsigned char[ strip->numFilteredBytes ];
     
+    // a scratch row for each filter type but None
+    unsigned char *trialRows = new unsigned char[ rowBytes * 4 ];
 
-    if( true ) {
-        return;
-        }
     
+    for( int y=strip->startRow; y<strip->endRow; y++ ) {
 
+        unsigned char *row = &( strip->imageBytes[ y * rowBytes ] );
+        unsigned char *prevRow = NULL;
+        if( y > 0 ) {
+            prevRow = &( strip->imageBytes[ ( y - 1 ) * rowBytes ] );
+            }
+        
+        unsigned char *dest = 
+            &( filtered[ ( y - strip->startRow ) * ( rowBytes + 1 ) ] );
+
+        if( strip->compressionLevel == 0 ) {
+            // no point in filtering bytes that won't be compressed
+            dest[0] = filterNone;
+            memcpy( &( dest[1] ), row, rowBytes );
+            continue;
+            }
+        
+        // adaptive filtering, as suggested in the PNG spec:
+        // try each filter and keep the one with the smallest sum of
+        // absolute differences
+        unsigned long bestSum = filterRow( filterNone, row, prevRow, 
+                                           rowBytes, strip->numChannels,
+                                           &( dest[1] ) );
+        int bestType = filterNone;
+        
+        for( int t=filterSub; t<=filterPaeth; t++ ) {
+            unsigned char *trial = &( trialRows[ ( t - 1 ) * rowBytes ] );
+            
+            unsigned long sum = filterRow( t, row, prevRow, 
+                                           rowBytes, strip->numChannels,
+                                           trial );
+            if( sum < bestSum ) {
+                bestSum = sum;
+                bestType = t;
+                }
+            }
+        
+        dest[0] = (unsigned char)bestType;
+        
+        if( bestType != filterNone ) {
+            memcpy( &( dest[1] ), 
+                    &( trialRows[ ( bestType - 1 ) * rowBytes ] ), 
+                    rowBytes );
+            }
+        }
 
-
-
-
-
+    delete [] trialRows;
     
 
+    strip->adler = mz_adler32( MZ_ADLER32_INIT, filtered, 
+                               strip->numFilteredBytes );
 
 
-
-    /*
-
-    // LodePNG implementation
+    // raw deflate, zlib header and checksum are added around all strips
+    int flags = tdefl_create_comp_flags_from_zip_params(
+        strip->compressionLevel, -MZ_DEFAULT_WINDOW_BITS, 
+        MZ_DEFAULT_STRATEGY );
     
-    unsigned char *encodedBytes;
-    size_t encodedSize;
-
-    unsigned int error = LodePNG_encode32( &encodedBytes, &encodedSize, 
-                                           imageBytes, w, h );
+    // too big for the stack
+    tdefl_compressor *compressor = 
+        (tdefl_compressor *)malloc( sizeof( tdefl_compressor ) );
     
-    delete [] imageBytes;
+    tdefl_init( compressor, stripOutputCallback, strip->compressed, flags );
+
+    // a sync flush ends non-final strips on a byte boundary with an empty
+    // stored block, so the next strip's blocks can follow directly
+    tdefl_flush flush = TDEFL_SYNC_FLUSH;
     
-    if( error ) {
-        delete [] encodedBytes;
-        
-        printf( "Error encoding PNG image\n" );
-        return;
+    if( strip->isLast ) {
+        flush = TDEFL_FINISH;
         }
+    
+    tdefl_compress_buffer( compressor, filtered, strip->numFilteredBytes, 
+                           flush );
 
-    inStream->write( encodedBytes, encodedSize );
+    free( compressor );
+    delete [] filtered;
 
-    delete [] encodedBytes;
-    
-    if( true ) {
-        return;
+    if( strip->doneSemaphore != NULL ) {
+        strip->doneSemaphore->signal();
         }
-    
-    */    
+    }
 
 
 
+// smallest strip worth its own job
+#define MIN_STRIP_ROWS 32
+
+
+void PNGImageConverter::writePNG( unsigned char *inBytes, int w, int h,
+                                  int inNumChannels,
+                                  OutputStream *inStream ) {
+
     // same for all PNG images
     // used to check for basic transmission errors, such as line-end flipping
     unsigned char pngSignature[8] = { 0x89, 0x50, 0x4E, 0x47,
@@ -352,24 +416,24 @@ void PNGImageConverter::formatImage( Image *inImage,
     unsigned char headerData[13];
 
     // width
-    headerData[0] = (w >> 24) & 0xff;
-    headerData[1] = (w >> 16) & 0xff;
-    headerData[2] = (w >> 8) & 0xff;
-    headerData[3] = w & 0xff;
+    storeBigEndian32( &( headerData[0] ), w );
 
     // height
-    headerData[4] = (h >> 24) & 0xff;
-    headerData[5] = (h >> 16) & 0xff;
-    headerData[6] = (h >> 8) & 0xff;
-    headerData[7] = h & 0xff;
+    storeBigEndian32( &( headerData[4] ), h );
 
     // bit depth
     headerData[8] = 8;
 
     // color type
     // 2 = truecolor (RGB)
-    headerData[9] = 2;
-
+    // 6 = truecolor with alpha (RGBA)
+    if( inNumChannels == 3 ) {
+        headerData[9] = 2;
+        }
+    else {
+        headerData[9] = 6;
+        }
+    
     // compression method
     // method 0  (deflate)
     headerData[10] = 0;
@@ -384,257 +448,169 @@ void PNGImageConverter::formatImage( Image *inImage,
     writeChunk( "IHDR", headerData, 13, inStream );
 
 
-    int numRawBytes = w * h * 3;
-    // extra byte per scanline for filter type
-    numRawBytes += h;
-
-    unsigned char *rawScanlineBytes = new unsigned char[ numRawBytes ];
-
-    // ignore alpha channel
-    double *channels[3];
-    int i;
-    for( i=0; i<3; i++ ) {
-        channels[i] = inImage->getChannel( i );
-        }
-
-    int pixelNumber = 0;
-    for( int y=0; y<h; y++ ) {
-        // each scanline starts with filter type byte
-        // using filter type 0 (no filtering)
-
-        int index = y * ( w * 3 + 1 );
-
-        // filter type
-        rawScanlineBytes[ index ] = 0;
-
-        index++;
-
-        for( int x=0; x<w; x++ ) {
-
-            for( i=0; i<3; i++ ) {
-                rawScanlineBytes[ index ] =
-                    (unsigned char)( lrint( 255 * channels[i][pixelNumber] ) );
-
-                index ++;
-                }
-
-            pixelNumber++;
-            }        
-        }
-
-
-    // zlib block contains
-    // zlib compression method  (1 byte)
-    // flags  (1 byte)
-    // compressed data blocks
-    // check value (4 bytes) (not CRC)
-
-    SimpleVector<unsigned char> zlibBlock;
-
-    // compression method 8 (deflate)
-    // with a LZ77 window size parameter of w=7
-    // LZ77 window size is then 2^( w + 8 ), or in this case 32768
-    zlibBlock.push_back( 0x78 );
-
-    // flags
-    // compression level 0  (2 bytes = 00b)
-    // no preset dictionary (1 byte = 0b)
-    // check bits for compression method (5 bits)
-    //   Should be such that if the 8-bit compression method, followed
-    //   by the 8-bit flags field, is viewed as a 16-bit number,
-    //   it is an even multiple of 31
-    //   For our settings, check bits of 00001 works
-    //zlibBlock.push_back( 0x01 );
-    // hack:  mimic zlib here
-    zlibBlock.push_back( 0xda );
-
-    
-    // now ready for compressed data blocks
-
-    int rawDataIndex = 0;
-
-    // length field is 16 bits
-    int maxUncompressedBlockLength = 65535;
+    // split into strips, one per thread
+    int numStrips = 1;
     
-    while( rawDataIndex < numRawBytes ) {
-
-        // push another deflate block
-
-        // first bit BFINAL
-        //   only 1 for final block
-        // next two bits BTYPE
-        //   BTYPE=00 is an uncompressed block
-        // remaining 5 bits ignored
-        // Thus, we put 0x00 for uncompressed blocks that are not final
-        // and 0x80 for final uncompressed block
-
-        
-        int bytesLeft = numRawBytes - rawDataIndex;
-
-        int bytesInBlock;
+    if( mPool != NULL && mCompressionLevel > 0 ) {
+        numStrips = h / MIN_STRIP_ROWS;
         
-        if( bytesLeft <= maxUncompressedBlockLength ) {
-            // final
-
-            // hack:  when comparing output with zlib, noticed that it doesn't
-            // set 0x80 for the final block, instead it uses 0x01
-            // For some reason, this was making the PNG unreadable
-            // zlibBlock.push_back( 0x80 );
-            zlibBlock.push_back( 0x01 );
-
-            bytesInBlock = bytesLeft;
+        if( numStrips > mNumThreads ) {
+            numStrips = mNumThreads;
             }
-        else {
-            // not final
-            zlibBlock.push_back( 0x00 );
-            
-            bytesInBlock = maxUncompressedBlockLength;
+        if( numStrips < 1 ) {
+            numStrips = 1;
             }
+        }
 
-        // length in least-significant-byte-first order
-        unsigned char firstLengthByte = bytesInBlock & 0xff;
-        unsigned char secondLengthByte = (bytesInBlock >> 8) & 0xff;
-        zlibBlock.push_back( firstLengthByte );
-        zlibBlock.push_back( secondLengthByte );
-
-        // those same length bytes inverted
-        // (called "one's compliment" in the spec
-        zlibBlock.push_back( firstLengthByte ^ 0xff);
-        zlibBlock.push_back( secondLengthByte ^ 0xff );
-
-        // now the uncompressed data
-
-        for( int b=0; b< bytesInBlock; b++ ) {
-            zlibBlock.push_back( rawScanlineBytes[ rawDataIndex ] );
+    PNGStrip *strips = new PNGStrip[ numStrips ];
+    
+    Semaphore doneSemaphore;
 
-            rawDataIndex++;
+    for( int i=0; i<numStrips; i++ ) {
+        PNGStrip *strip = &( strips[i] );
+        
+        strip->imageBytes = inBytes;
+        strip->width = w;
+        strip->numChannels = inNumChannels;
+        strip->compressionLevel = mCompressionLevel;
+        strip->startRow = ( h * i ) / numStrips;
+        strip->endRow = ( h * ( i + 1 ) ) / numStrips;
+        strip->isLast = ( i == numStrips - 1 );
+        strip->compressed = new SimpleVector<unsigned char>();
+        strip->doneSemaphore = NULL;
+        }
+    
+    if( numStrips == 1 ) {
+        compressStrip( &( strips[0] ) );
+        }
+    else {
+        // wait on our own strips only, the pool may be shared by
+        // other threads writing images
+        for( int i=0; i<numStrips; i++ ) {
+            strips[i].doneSemaphore = &doneSemaphore;
+            mPool->addJob( compressStrip, &( strips[i] ) );
+            }
+        for( int i=0; i<numStrips; i++ ) {
+            doneSemaphore.wait();
             }
         }
     
 
-    // finally, adler32 of original data
-    unsigned long adler = updateAdler32( 1L, rawScanlineBytes, numRawBytes );
-    
-    zlibBlock.push_back( (adler >> 24) & 0xff );
-    zlibBlock.push_back( (adler >> 16) & 0xff );
-    zlibBlock.push_back( (adler >> 8) & 0xff );
-    zlibBlock.push_back( adler & 0xff );
-    
-
-    // the zlib block is now complete
-
+    // stitch strips into one zlib stream
 
-
-    
-    /*
-    // check against real zlib implementation
-    z_stream zStream;
-
-    zStream.next_in = rawScanlineBytes;
-    zStream.avail_in = numRawBytes;
-    zStream.total_in = 0;
+    // compression method 8 (deflate)
+    // with a LZ77 window size parameter of w=7
+    // LZ77 window size is then 2^( w + 8 ), or in this case 32768
+    unsigned char cmf = 0x78;
     
-    int outSize = 2 * numRawBytes + 100;
-    unsigned char *zlibOutBuffer = new unsigned char[ outSize ]; 
-    zStream.next_out = zlibOutBuffer;
-    zStream.avail_out = outSize;
-    zStream.total_out = 0;
-
-    zStream.data_type = Z_BINARY;
-
-    zStream.zalloc = Z_NULL;
-    zStream.zfree = Z_NULL;
-
-    // init the stream
-    // no compression
-    int result;
-    //result = deflateInit( &zStream, Z_DEFAULT_COMPRESSION);
-    result = deflateInit( &zStream, Z_NO_COMPRESSION);
-
-    if( result != Z_OK ) {
-        printf( "zlib deflateInit error: %s\n", zStream.msg );
+    // flags
+    // compression level hint in top 2 bits
+    // no preset dictionary
+    // check bits such that cmf * 256 + flg is a multiple of 31
+    unsigned char flevel;
+    if( mCompressionLevel < 2 ) {
+        flevel = 0;
+        }
+    else if( mCompressionLevel < 6 ) {
+        flevel = 1;
+        }
+    else if( mCompressionLevel == 6 ) {
+        flevel = 2;
+        }
+    else {
+        flevel = 3;
         }
+    unsigned char flg = (unsigned char)( flevel << 6 );
+    flg = (unsigned char)( flg + 31 - ( ( cmf * 256 + flg ) % 31 ) );
 
     
-    // deflate and flush
-    result = deflate( &zStream, Z_FINISH );
-
-    if( result != Z_STREAM_END ) {
-        printf( "zlib deflate error (%d): %s\n", result, zStream.msg );
+    unsigned long zlibLength = 2 + 4;
+    for( int i=0; i<numStrips; i++ ) {
+        zlibLength += strips[i].compressed->size();
         }
-    printf( "Total in = %d, total out = %d\n",
-            zStream.total_in, zStream.total_out );
     
+    unsigned char *zlibBytes = new unsigned char[ zlibLength ];
     
-
+    zlibBytes[0] = cmf;
+    zlibBytes[1] = flg;
     
-    printf( "Our raw bytes (%d):\n", numRawBytes );
-    int b;
-    for( b=0; b<numRawBytes; b++ ) {
-        printf( "%02x ", rawScanlineBytes[ b ] );
+    unsigned long index = 2;
+    unsigned long adler = 1;
+
+    for( int i=0; i<numStrips; i++ ) {
+        SimpleVector<unsigned char> *compressed = strips[i].compressed;
+        
+        int numCompressed = compressed->size();
+        
+        if( numCompressed > 0 ) {
+            memcpy( &( zlibBytes[ index ] ), compressed->getElement( 0 ),
+                    numCompressed );
+            }
+        index += numCompressed;
+        
+        adler = combineAdler32( adler, strips[i].adler,
+                                strips[i].numFilteredBytes );
+        
+        delete compressed;
         }
     
-    printf( "\n\nOur zlib bytes (%d) (adler = %d) :\n",
-            zlibBlock.size(), adler );
+    delete [] strips;
     
-    for( b=0; b<zlibBlock.size(); b++ ) {
-        printf( "%02x ", *( zlibBlock.getElement( b ) ) );
-        }
+    // adler32 of all filtered data
+    storeBigEndian32( &( zlibBytes[ index ] ), (uint32_t)adler );
 
 
-    printf( "\n\nTheir zlib bytes (%d) (adler = %d) :\n",
-            (int)( zStream.total_out ), zStream.adler );
-    for( b=0; b<zStream.total_out; b++ ) {
-        printf( "%02x ", zlibOutBuffer[ b ] );
-        }
+    // the zlib block is the data of an IDAT chunk
+    writeChunk( "IDAT", zlibBytes, zlibLength, inStream );
+    
+    delete [] zlibBytes;
 
-    int minBytes = zStream.total_out;
-    if( minBytes > zlibBlock.size() ) {
-        minBytes = zlibBlock.size();
-        }
+    // no data in end chunk
+    writeChunk( "IEND", NULL, 0, inStream );
+    }
 
-    for( b=0; b<minBytes; b++ ) {
-        if( zlibOutBuffer[b] != *( zlibBlock.getElement( b ) ) ) {
-            printf( "mismatch at byte %d\n", b );
-            printf( "Theirs: %02x, ours: %02x\n", zlibOutBuffer[b],
-                    *( zlibBlock.getElement( b ) ) );
-            }
-        }
 
-    
-    printf( "\n\n" );
-    
 
-    
-    
-    delete [] zlibOutBuffer;
-    result = deflateEnd( &zStream );
+void PNGImageConverter::formatImageRaw( RawRGBAImage *inImage,
+                                        OutputStream *inStream ) {
 
-    if( result != Z_OK ) {
-        printf( "zlib deflateEnd error (%d): %s\n", result, zStream.msg );
+    int numChannels = inImage->mNumChannels;
+    
+    if( numChannels != 3 &&
+        numChannels != 4 ) {
+        printf( "Only 3- and 4-channel images can be converted to " );
+        printf( "the PNG format.\n" );
+        return;
         }
 
-    */    
-    
+    // rows are filtered straight out of the image, no conversion needed
+    writePNG( inImage->mRGBABytes, inImage->mWidth, inImage->mHeight,
+              numChannels, inStream );
+    }
 
-    
-    // the zlib block is the data of an IDAT chunk
 
-    unsigned char *zlibBytes = zlibBlock.getElementArray();
 
-    writeChunk( "IDAT", zlibBytes, zlibBlock.size(), inStream );
-    
-    
-    delete [] zlibBytes;
-    
-    // no data in end chunk
-    writeChunk( "IEND", NULL, 0, inStream );
+void PNGImageConverter::formatImage( Image *inImage, 
+	OutputStream *inStream ) {
 
+	int numChannels = inImage->getNumChannels();
+	
+	// make sure the image is in the right format
+	if( numChannels != 3 &&
+		numChannels != 4 ) {
+		printf( "Only 3- and 4-channel images can be converted to " );
+		printf( "the PNG format.\n" );
+		return;
+		}
 
-    delete [] rawScanlineBytes;
+	int w = inImage->getWidth();
+	int h = inImage->getHeight();
+	
+    unsigned char *imageBytes = RGBAImage::getRGBABytes( inImage );
 
+    writePNG( imageBytes, w, h, 4, inStream );
     
-    // done
+    delete [] imageBytes;
 	}
 
 
@@ -16,6 +16,9 @@
 #include "BigEndianImageConverter.h"
 
 
+class ThreadPool;
+
+
 
 /**
  * PNG implementation of the image conversion interface.
@@ -23,6 +26,10 @@
  * Note that it only supports 32-bit PNG files
  * (3-channel Images are given a solid alpha channel).
  *
+ * Images are written with adaptive row filters and miniz's deflate,
+ * so encodingUtils.cpp (which compiles miniz) must be linked in.
+ * Reading still uses libpng.
+ *
  * @author Jason Rohrer
  */
 class PNGImageConverter : public BigEndianImageConverter {
@@ -37,7 +44,17 @@ class PNGImageConverter : public BigEndianImageConverter {
         // 3 to 6 are supposed to be "nearly as good" as 7-9, but "much faster"
         //
         // Defaults to 5.
-        PNGImageConverter( int inCompressionLevel=5 );
+        //
+        // With more than one thread, the image is split into horizontal
+        // strips that are filtered and compressed in parallel and
+        // stitched into one stream.  Strips don't share a dictionary,
+        // which costs a little compression.  Level 0 always uses one 
+        // thread.
+        // inNumThreads can be -1 for one thread per processor.
+        // Defaults to 1.
+        PNGImageConverter( int inCompressionLevel=5, int inNumThreads=1 );
+        
+        ~PNGImageConverter();
         
         
         
@@ -47,11 +64,33 @@ class PNGImageConverter : public BigEndianImageConverter {
 			
 		virtual Image *deformatImage( InputStream *inStream );		
 
+        // 3-channel images are written as 24-bit PNGs
+        virtual void formatImageRaw( RawRGBAImage *inImage,
+                                     OutputStream *inStream );
+
 
     protected:
         
         int mCompressionLevel;
         
+        int mNumThreads;
+        
+        // NULL for one thread
+        ThreadPool *mPool;
+        
+
+        /**
+         * Writes a PNG.  Thread safe.
+         *
+         * @param inBytes the image bytes, 8 bits per channel, rows top to
+         *   bottom.  Destroyed by caller.
+         * @param inWidth, inHeight the image size.
+         * @param inNumChannels 3 for RGB or 4 for RGBA.
+         * @param inStream the stream to write to.  Destroyed by caller.
+         */
+        void writePNG( unsigned char *inBytes, int inWidth, int inHeight,
+                       int inNumChannels, OutputStream *inStream );
+
 
         /**
          * Writes a chunk to a stream.
@@ -67,10 +106,6 @@ class PNGImageConverter : public BigEndianImageConverter {
                          unsigned long inNumBytes, OutputStream *inStream );
 
 
-        
-        // precomputed CRCs for all 8-bit messages
-        unsigned long mCRCTable[256];
-
 
         const static unsigned long mStartCRC = 0xffffffffL;
 
@@ -22,10 +22,34 @@
 
 #include <math.h>
 
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
 
 #include "LittleEndianImageConverter.h"
 
 #include "minorGems/graphics/RawRGBAImage.h"
+#include "minorGems/system/endian.h"
+
+
+
+// what a TGA header says about the image that follows it
+typedef struct TGAInfo {
+		int width;
+		int height;
+		
+		// 3 or 4
+		int numChannels;
+		
+		// type 10 instead of type 2
+		char runLengthEncoded;
+		
+		char originAtTop;
+		
+		// where the pixel data starts, counting from the header
+		int pixelOffset;
+	} TGAInfo;
 
 
 /**
@@ -33,6 +57,11 @@
  *
  * Note that it only supports 24- and 32-bit TGA files
  * (and thus only 3- and 4-channel Images).
+ * Both uncompressed (type 2) and run-length encoded (type 10) files
+ * can be read.  Files are always written uncompressed.
+ *
+ * Files already in memory (or mapped) can be decoded directly with 
+ * decodeTGA, without going through a stream.
  *
  * TGA format information taken from:
  * http://www.cubic.org/source/archive/fileform/graphic/tga/targa.txt
@@ -51,6 +80,85 @@ class TGAImageConverter : public LittleEndianImageConverter {
 
 		virtual RawRGBAImage *deformatImageRaw( InputStream *inStream );
 
+		// writes bytes straight through, swapping red and blue
+		virtual void formatImageRaw( RawRGBAImage *inImage,
+									 OutputStream *inStream );
+		
+
+		/**
+		 * Parses a TGA header.
+		 *
+		 * @param inData the start of the file.  Destroyed by caller.
+		 * @param inLength the number of bytes in inData.  Must be at
+		 *   least 18 (the header size).
+		 * @param outInfo where to put the image description.  Destroyed
+		 *   by caller.
+		 *
+		 * @return true if this is a TGA file that can be decoded.
+		 */
+		static char readTGAInfo( unsigned char *inData, long inLength,
+								 TGAInfo *outInfo );
+		
+
+		/**
+		 * Decodes a whole TGA file from memory.
+		 *
+		 * @param inData the file contents.  Destroyed by caller.
+		 * @param inLength the number of bytes in inData.
+		 *
+		 * @return the image, with rows top to bottom and RGB(A) bytes,
+		 *   or NULL if the file can't be decoded.  Destroyed by caller.
+		 */
+		static RawRGBAImage *decodeTGA( unsigned char *inData, 
+										long inLength );
+		
+
+		/**
+		 * Decodes a TGA file from memory into a caller's buffer, such as 
+		 * a texture staging buffer or a region of an atlas.
+		 *
+		 * @param inData the file contents.  Destroyed by caller.
+		 * @param inLength the number of bytes in inData.
+		 * @param inInfo the header, from readTGAInfo.  Destroyed by
+		 *   caller.
+		 * @param outBytes where to put the first pixel of the top row.  
+		 *   Destroyed by caller.
+		 * @param inOutChannels the number of bytes per output pixel,
+		 *   either inInfo->numChannels or 4.  24-bit images written with
+		 *   4 channels get opaque alpha.
+		 * @param inOutRowStride the number of bytes from one output row
+		 *   to the next.
+		 *
+		 * @return true on success, or false if the data is truncated 
+		 *   or corrupt.
+		 */
+		static char decodeTGA( unsigned char *inData, long inLength,
+							   TGAInfo *inInfo,
+							   unsigned char *outBytes, int inOutChannels,
+							   long inOutRowStride );
+		
+
+	protected:
+		
+		// decodes the pixel data that follows the header
+		// parameters are the same as for decodeTGA
+		static char decodePixels( unsigned char *inPixels, long inLength,
+								  TGAInfo *inInfo,
+								  unsigned char *outBytes, 
+								  int inOutChannels,
+								  long inOutRowStride );
+		
+		// copies pixels from BGR(A) to RGB(A) order
+		static void swizzlePixels( unsigned char *inSource, 
+								   int inSourceChannels,
+								   unsigned char *outDest, 
+								   int inDestChannels,
+								   int inNumPixels );
+
+		// writes the header for an unmapped, top-left-origin image
+		void writeHeader( long inWidth, long inHeight, int inNumChannels,
+						  OutputStream *inStream );
+
 	};
 
 
@@ -74,6 +182,57 @@ inline void TGAImageConverter::formatImage( Image *inImage,
 	long numPixels = width * height;
 
 	
+	writeHeader( width, height, numChannels, inStream );
+
+
+	// now we write the pixels, in BGR(A) order
+	unsigned char *raster = new unsigned char[ numPixels * numChannels ];
+	double *red = inImage->getChannel( 0 );
+	double *green = inImage->getChannel( 1 );
+	double *blue = inImage->getChannel( 2 );
+
+	long rasterIndex = 0;
+	
+	if( numChannels == 3 ) {
+		for( int i=0; i<numPixels; i++ ) {
+			raster[rasterIndex] = 
+				(unsigned char)( lrint( 255 * blue[i] ) );
+			raster[rasterIndex + 1] = 
+				(unsigned char)( lrint( 255 * green[i] ) );
+			raster[rasterIndex + 2] = 
+				(unsigned char)( lrint( 255 * red[i] ) );
+		
+			rasterIndex += 3;
+			}
+		}
+	else {  // numChannels == 4
+		double *alpha = inImage->getChannel( 3 );
+		
+		for( int i=0; i<numPixels; i++ ) {
+			raster[rasterIndex] = 
+				(unsigned char)( lrint( 255 * blue[i] ) );
+			raster[rasterIndex + 1] = 
+				(unsigned char)( lrint( 255 * green[i] ) );
+			raster[rasterIndex + 2] = 
+				(unsigned char)( lrint( 255 * red[i] ) );
+			raster[rasterIndex + 3] = 
+				(unsigned char)( lrint( 255 * alpha[i] ) );
+		
+			rasterIndex += 4;
+			}
+		}
+
+	inStream->write( raster, numPixels * numChannels );
+	
+	delete [] raster;
+	}
+
+
+
+inline void TGAImageConverter::writeHeader( long width, long height,
+											int numChannels,
+											OutputStream *inStream ) {
+
 	// a buffer for writing single bytes
 	unsigned char *byteBuffer = new unsigned char[1];
 
@@ -149,48 +308,41 @@ inline void TGAImageConverter::formatImage( Image *inImage,
 	// We also skip the color map data,
 	// since we have none (as specified above).
 
+	delete [] byteBuffer;
+	}
 
-	// now we write the pixels, in BGR(A) order
-	unsigned char *raster = new unsigned char[ numPixels * numChannels ];
-	double *red = inImage->getChannel( 0 );
-	double *green = inImage->getChannel( 1 );
-	double *blue = inImage->getChannel( 2 );
 
-	long rasterIndex = 0;
-	
-	if( numChannels == 3 ) {
-		for( int i=0; i<numPixels; i++ ) {
-			raster[rasterIndex] = 
-				(unsigned char)( lrint( 255 * blue[i] ) );
-			raster[rasterIndex + 1] = 
-				(unsigned char)( lrint( 255 * green[i] ) );
-			raster[rasterIndex + 2] = 
-				(unsigned char)( lrint( 255 * red[i] ) );
-		
-			rasterIndex += 3;
-			}
+
+inline void TGAImageConverter::formatImageRaw( RawRGBAImage *inImage,
+											   OutputStream *inStream ) {
+
+	int numChannels = inImage->mNumChannels;
+
+	if( numChannels != 3 &&
+		numChannels != 4 ) {
+		printf( "Only 3- and 4-channel images can be converted to " );
+		printf( "the TGA format.\n" );
+		return;
 		}
-	else {  // numChannels == 4
-		double *alpha = inImage->getChannel( 3 );
-		
-		for( int i=0; i<numPixels; i++ ) {
-			raster[rasterIndex] = 
-				(unsigned char)( lrint( 255 * blue[i] ) );
-			raster[rasterIndex + 1] = 
-				(unsigned char)( lrint( 255 * green[i] ) );
-			raster[rasterIndex + 2] = 
-				(unsigned char)( lrint( 255 * red[i] ) );
-			raster[rasterIndex + 3] = 
-				(unsigned char)( lrint( 255 * alpha[i] ) );
-		
-			rasterIndex += 4;
-			}
+
+	long numBytes = (long)inImage->mWidth * inImage->mHeight * numChannels;
+
+	writeHeader( inImage->mWidth, inImage->mHeight, numChannels, inStream );
+
+	// RGB(A) to BGR(A)
+	unsigned char *raster = new unsigned char[ numBytes ];
+	unsigned char *source = inImage->mRGBABytes;
+
+	memcpy( raster, source, numBytes );
+	
+	for( long i=0; i<numBytes; i += numChannels ) {
+		raster[i] = source[i + 2];
+		raster[i + 2] = source[i];
 		}
 
-	inStream->write( raster, numPixels * numChannels );
+	inStream->write( raster, numBytes );
 	
 	delete [] raster;
-	delete [] byteBuffer;
 	}
 
 
@@ -199,138 +351,362 @@ inline void TGAImageConverter::formatImage( Image *inImage,
 inline RawRGBAImage *TGAImageConverter::deformatImageRaw( 
     InputStream *inStream ) {
     
-    // a buffer for reading single bytes
-	unsigned char *byteBuffer = new unsigned char[1];
+	// read the whole header in one go
+	unsigned char header[18];
+	
+	if( inStream->read( header, 18 ) != 18 ) {
+		return NULL;
+		}
 
-	// read the identification field size
-	inStream->read( byteBuffer, 1 );
+	TGAInfo info;
+	if( ! readTGAInfo( header, 18, &info ) ) {
+		return NULL;
+		}
+	
+	// skip the image identification field
+	int identificationFieldSize = info.pixelOffset - 18;
 
-	int identificationFieldSize = byteBuffer[0];
-		
-	// read the color map type
-	// (only 0, or no color map, is supported)
-	inStream->read( byteBuffer, 1 );
-	if( byteBuffer[0] != 0 ) {
-		printf( "Only TGA files without colormaps can be read.\n" );
-		delete [] byteBuffer;
+	if( identificationFieldSize > 0 ) {
+		unsigned char identificationField[256];
+		inStream->read( identificationField, identificationFieldSize );
+		}
+	
+	long numPixels = (long)info.width * info.height;
+	
+	// run-length data is never bigger than one packet header per pixel
+	long maxBytes = numPixels * info.numChannels;
+	if( info.runLengthEncoded ) {
+		maxBytes += numPixels;
+		}
+	
+	unsigned char *pixelData = new unsigned char[ maxBytes ];
+	
+	long numRead = 0;
+	while( numRead < maxBytes ) {
+		long result = inStream->read( &( pixelData[ numRead ] ), 
+									  maxBytes - numRead );
+		if( result <= 0 ) {
+			break;
+			}
+		numRead += result;
+		}
+
+	unsigned char *raster = 
+		new unsigned char[ numPixels * info.numChannels ];
+	
+	char success = decodePixels( pixelData, numRead, &info, 
+								 raster, info.numChannels, 
+								 info.width * info.numChannels );
+	delete [] pixelData;
+	
+	if( ! success ) {
+		delete [] raster;
 		return NULL;
 		}
 	
-	// read the image type code
-	// (only type 2, unmapped RGB image, is supported)
-	inStream->read( byteBuffer, 1 );
-	if( byteBuffer[0] != 2 ) {
+    return new RawRGBAImage( raster, info.width, info.height, 
+							 info.numChannels );
+    }
+
+
+
+inline char TGAImageConverter::readTGAInfo( unsigned char *inData, 
+											long inLength,
+											TGAInfo *outInfo ) {
+	if( inLength < 18 ) {
+		return false;
+		}
+	
+	int identificationFieldSize = inData[0];
+	
+	// only 0, or no color map, is supported
+	if( inData[1] != 0 ) {
+		printf( "Only TGA files without colormaps can be read.\n" );
+		return false;
+		}
+	
+	// type 2 is an unmapped RGB image, and 10 is the same, run-length
+	// encoded
+	if( inData[2] != 2 && inData[2] != 10 ) {
 		printf(
 			"Only TGA files containing unmapped RGB images can be read.\n" );
-		delete [] byteBuffer;
-		return NULL;
+		return false;
 		}
 	
+	// skip color map spec (5 bytes) and the x and y origin (4 bytes)
 	
-	// ignore color map spec
-	// (skip all 5 bytes of it)
-	unsigned char *colorMapSpec = new unsigned char[5];
-	inStream->read( colorMapSpec, 5 );
-	delete [] colorMapSpec;
-
-
-	// now for the image specification
+	outInfo->width = loadLittleEndian16( &( inData[12] ) );
+	outInfo->height = loadLittleEndian16( &( inData[14] ) );
+	
+	int bitsPerPixel = inData[16];
+	if( bitsPerPixel != 24 && bitsPerPixel != 32 ) {
+		printf( "Only 24- and 32-bit TGA files can be read.\n" );
+		return false;
+		}
+	outInfo->numChannels = bitsPerPixel / 8;
+	
+	outInfo->runLengthEncoded = ( inData[2] == 10 );
 
-    // don't need either of these
-    // don't set to a variable for now to avoid unused variable warnings
-	// x origin coordinate
-	readLittleEndianShort( inStream );
-	// y origin coordinate
-	readLittleEndianShort( inStream );
+	// bit 5 of the image descriptor is set for an upper left origin
+	outInfo->originAtTop = ( ( inData[17] & ( 1 << 5 ) ) != 0 );
+	
+	// we also skip the color map data, since there is none
+	outInfo->pixelOffset = 18 + identificationFieldSize;
 	
-	long width = readLittleEndianShort( inStream );
-	long height = readLittleEndianShort( inStream );
+	return true;
+	}
 
-	long numPixels = width * height;
 
+
+inline RawRGBAImage *TGAImageConverter::decodeTGA( unsigned char *inData, 
+												   long inLength ) {
+	TGAInfo info;
 	
-	// number of bits in pixels
-	// only 24 bits per pixel supported
+	if( ! readTGAInfo( inData, inLength, &info ) ) {
+		return NULL;
+		}
 	
-	inStream->read( byteBuffer, 1 );
-	if( byteBuffer[0] != 24 && byteBuffer[0] != 32 ) {
-		printf( "Only 24- and 32-bit TGA files can be read.\n" );
-		delete [] byteBuffer;
+	unsigned char *raster = 
+		new unsigned char[ (long)info.width * info.height * 
+						   info.numChannels ];
+	
+	if( ! decodeTGA( inData, inLength, &info, raster, info.numChannels,
+					 info.width * info.numChannels ) ) {
+		delete [] raster;
 		return NULL;
 		}
+	
+	return new RawRGBAImage( raster, info.width, info.height, 
+							 info.numChannels );
+	}
+
 
-	int numChannels = 0;
-	if( byteBuffer[0] == 24 ) {
-		numChannels = 3;
+
+inline char TGAImageConverter::decodeTGA( unsigned char *inData, 
+										  long inLength,
+										  TGAInfo *inInfo,
+										  unsigned char *outBytes, 
+										  int inOutChannels,
+										  long inOutRowStride ) {
+	if( inInfo->pixelOffset > inLength ) {
+		return false;
 		}
-	else {
-		numChannels = 4;
+	
+	return decodePixels( &( inData[ inInfo->pixelOffset ] ),
+						 inLength - inInfo->pixelOffset, inInfo,
+						 outBytes, inOutChannels, inOutRowStride );
+	}
+
+
+
+inline char TGAImageConverter::decodePixels( unsigned char *inPixels, 
+											 long inLength,
+											 TGAInfo *inInfo,
+											 unsigned char *outBytes, 
+											 int inOutChannels,
+											 long inOutRowStride ) {
+	int width = inInfo->width;
+	int height = inInfo->height;
+	int channels = inInfo->numChannels;
+	
+	if( inOutChannels != channels && inOutChannels != 4 ) {
+		return false;
 		}
 	
+	long numPixels = (long)width * height;
 	
-	// image descriptor byte
-	// setting to 0 specifies:
-	// -- no attributes per pixel (for 24-bit)
-	// -- screen origin in lower left corner
-	// -- non-interleaved data storage
-	// set bit 5 to 1 to specify screen origin in upper left corner
-	inStream->read( byteBuffer, 1 );
-	char originAtTop = byteBuffer[0] & ( 1 << 5 );
-
 	
-	if( identificationFieldSize > 0 ) {
-		// We skip the image identification field
-		unsigned char *identificationField =
-			new unsigned char[ identificationFieldSize ];
-		inStream->read( identificationField, identificationFieldSize );
-		delete [] identificationField;
+	// output rows, top to bottom
+	// files stored bottom-up are flipped as rows are written
+	unsigned char *firstRow = outBytes;
+	long rowStep = inOutRowStride;
+	
+	if( ! inInfo->originAtTop ) {
+		firstRow = &( outBytes[ ( height - 1 ) * inOutRowStride ] );
+		rowStep = -inOutRowStride;
 		}
 	
 	
-	// We also skip the color map data,
-	// since we have none (as specified above).
-
+	if( ! inInfo->runLengthEncoded ) {
+		
+		if( inLength < numPixels * channels ) {
+			printf( "TGA pixel data truncated.\n" );
+			return false;
+			}
+		
+		for( int y=0; y<height; y++ ) {
+			swizzlePixels( &( inPixels[ (long)y * width * channels ] ),
+						   channels,
+						   &( firstRow[ y * rowStep ] ), inOutChannels,
+						   width );
+			}
+		return true;
+		}
 
 	
+	// run-length packets can run across row boundaries
+	long sourceIndex = 0;
+	long pixelIndex = 0;
 	
-	// now we read the pixels, in BGR(A) order
-	unsigned char *raster = new unsigned char[ numPixels * numChannels ];
-	inStream->read( raster, numPixels * numChannels );
-
-    if( !originAtTop ) {
-
-        // flip it
-        unsigned char *flippedRaster = 
-            new unsigned char[ numPixels * numChannels ];
-        
+	int x = 0;
+	int y = 0;
+	unsigned char *dest = firstRow;
+	
+	while( pixelIndex < numPixels ) {
+		if( sourceIndex >= inLength ) {
+			printf( "TGA run-length data truncated.\n" );
+			return false;
+			}
+		
+		int packetHeader = inPixels[ sourceIndex++ ];
+		int count = ( packetHeader & 0x7F ) + 1;
+		char isRun = ( packetHeader & 0x80 ) != 0;
+		
+		if( count > numPixels - pixelIndex ) {
+			printf( "TGA run-length packet runs past end of image.\n" );
+			return false;
+			}
+		
+		long packetBytes = channels;
+		if( ! isRun ) {
+			packetBytes = (long)count * channels;
+			}
+		
+		if( sourceIndex + packetBytes > inLength ) {
+			printf( "TGA run-length data truncated.\n" );
+			return false;
+			}
+		
+		unsigned char *source = &( inPixels[ sourceIndex ] );
+		sourceIndex += packetBytes;
+		pixelIndex += count;
+
+		if( isRun ) {
+			// swizzle once, then repeat
+			unsigned char pixel[4];
+			swizzlePixels( source, channels, pixel, inOutChannels, 1 );
+			
+			while( count > 0 ) {
+				int span = width - x;
+				if( span > count ) {
+					span = count;
+					}
+				
+				unsigned char *d = &( dest[ x * inOutChannels ] );
+				
+				if( inOutChannels == 4 ) {
+					uint32_t value;
+					memcpy( &value, pixel, 4 );
+					
+					for( int i=0; i<span; i++ ) {
+						memcpy( &( d[ i * 4 ] ), &value, 4 );
+						}
+					}
+				else {
+					for( int i=0; i<span; i++ ) {
+						d[ i * 3 ] = pixel[0];
+						d[ i * 3 + 1 ] = pixel[1];
+						d[ i * 3 + 2 ] = pixel[2];
+						}
+					}
+				
+				count -= span;
+				x += span;
+				if( x == width ) {
+					x = 0;
+					y++;
+					dest = &( firstRow[ y * rowStep ] );
+					}
+				}
+			}
+		else {
+			while( count > 0 ) {
+				int span = width - x;
+				if( span > count ) {
+					span = count;
+					}
+				
+				swizzlePixels( source, channels,
+							   &( dest[ x * inOutChannels ] ), inOutChannels,
+							   span );
+				source = &( source[ span * channels ] );
+				
+				count -= span;
+				x += span;
+				if( x == width ) {
+					x = 0;
+					y++;
+					dest = &( firstRow[ y * rowStep ] );
+					}
+				}
+			}
+		}
+	
+	return true;
+	}
 
-        int lineBytes = width * numChannels;
 
-        for( int y=0; y<height; y++ ) {
-            memcpy( &( flippedRaster[lineBytes * y] ),
-                    &( raster[ lineBytes * ( height - y - 1 ) ] ),
-                    lineBytes );
-            }
-        
-        delete [] raster;
-        raster = flippedRaster;
-        }
-    
-    // convert to RGB(A) order
-    int numBytes = numPixels * numChannels;
-    int r = 2;
-    for( int b=0; b<numBytes; b+= numChannels ) {
-        unsigned char temp = raster[b];
-        
-        raster[b] = raster[r];
-        raster[r] = temp;
-        
-        r += numChannels;
-        }
 
-    delete [] byteBuffer;
-    return new RawRGBAImage( raster, width, height, numChannels );
-    }
+inline void TGAImageConverter::swizzlePixels( unsigned char *inSource, 
+											  int inSourceChannels,
+											  unsigned char *outDest, 
+											  int inDestChannels,
+											  int inNumPixels ) {
+	int i = 0;
+	
+	if( inSourceChannels == 4 ) {
+		
+#if defined(__SSE2__)
+		// swap the first and third byte of each 32-bit pixel,
+		// four pixels at a time
+		__m128i keepMask = _mm_set1_epi32( (int)0xFF00FF00 );
+		__m128i lowMask = _mm_set1_epi32( 0x000000FF );
+		
+		for( ; i + 4 <= inNumPixels; i += 4 ) {
+			__m128i v = 
+				_mm_loadu_si128( (__m128i *)&( inSource[ i * 4 ] ) );
+			
+			__m128i swapped = _mm_or_si128(
+				_mm_and_si128( v, keepMask ),
+				_mm_or_si128( 
+					_mm_and_si128( _mm_srli_epi32( v, 16 ), lowMask ),
+					_mm_slli_epi32( _mm_and_si128( v, lowMask ), 16 ) ) );
+			
+			_mm_storeu_si128( (__m128i *)&( outDest[ i * 4 ] ), swapped );
+			}
+#endif
+		
+		for( ; i<inNumPixels; i++ ) {
+			unsigned char *s = &( inSource[ i * 4 ] );
+			unsigned char *d = &( outDest[ i * 4 ] );
+			d[0] = s[2];
+			d[1] = s[1];
+			d[2] = s[0];
+			d[3] = s[3];
+			}
+		}
+	else if( inDestChannels == 3 ) {
+		for( ; i<inNumPixels; i++ ) {
+			unsigned char *s = &( inSource[ i * 3 ] );
+			unsigned char *d = &( outDest[ i * 3 ] );
+			unsigned char blue = s[0];
+			d[0] = s[2];
+			d[1] = s[1];
+			d[2] = blue;
+			}
+		}
+	else {
+		// 24-bit to 32-bit, with opaque alpha
+		for( ; i<inNumPixels; i++ ) {
+			unsigned char *s = &( inSource[ i * 3 ] );
+			unsigned char *d = &( outDest[ i * 4 ] );
+			d[0] = s[2];
+			d[1] = s[1];
+			d[2] = s[0];
+			d[3] = 255;
+			}
+		}
+	}
 
 
 
@@ -0,0 +1,135 @@
+#include "FrameEncoderQueue.h"
+#include "TGAImageConverter.h"
+
+#include "minorGems/io/file/FileInputStream.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+static RawRGBAImage *makeFrame( int inW, int inH, int inChannels,
+                                int inSeed ) {
+    int numBytes = inW * inH * inChannels;
+    unsigned char *bytes = new unsigned char[ numBytes ];
+    
+    for( int i=0; i<numBytes; i++ ) {
+        bytes[i] = (unsigned char)( i * 7 + inSeed * 13 );
+        }
+    return new RawRGBAImage( bytes, inW, inH, inChannels );
+    }
+
+
+
+// a converter slow enough to fill the queue
+class SlowConverter : public TGAImageConverter {
+    public:
+        virtual void formatImageRaw( RawRGBAImage *inImage,
+                                     OutputStream *inStream ) {
+            usleep( 50000 );
+            TGAImageConverter::formatImageRaw( inImage, inStream );
+            }
+    };
+
+
+
+int main() {
+
+    TGAImageConverter tga;
+
+    int numFrames = 20;
+
+    // block policy, every frame written
+    {
+        FrameEncoderQueue queue( &tga, 4, 3 );
+        
+        for( int f=0; f<numFrames; f++ ) {
+            char *name = autoSprintf( "frameTest_%d.tga", f );
+            
+            char added = queue.addFrame( makeFrame( 64, 48, 3 + f % 2, f ),
+                                         new File( NULL, name ) );
+            check( added, "frame added in block mode" );
+            delete [] name;
+            }
+        
+        queue.waitForAll();
+        
+        check( queue.getNumEncoded() == numFrames, "all frames encoded" );
+        check( queue.getNumDropped() == 0, "no frames dropped" );
+        }
+    
+
+    // read back, compare to source bytes
+    for( int f=0; f<numFrames; f++ ) {
+        char *name = autoSprintf( "frameTest_%d.tga", f );
+        File file( NULL, name );
+        
+        FileInputStream stream( &file );
+        RawRGBAImage *read = tga.deformatImageRaw( &stream );
+        RawRGBAImage *expected = makeFrame( 64, 48, 3 + f % 2, f );
+
+        check( read != NULL, "frame read back" );
+        
+        if( read != NULL ) {
+            check( read->mWidth == 64 && read->mHeight == 48 &&
+                   read->mNumChannels == expected->mNumChannels,
+                   "frame size" );
+            check( memcmp( read->mRGBABytes, expected->mRGBABytes,
+                           64 * 48 * expected->mNumChannels ) == 0,
+                   "frame bytes round trip" );
+            delete read;
+            }
+        delete expected;
+        
+        file.remove();
+        delete [] name;
+        }
+    
+
+    // drop policy, slow encoder
+    SlowConverter slow;
+    
+    {
+        FrameEncoderQueue queue( &slow, 1, 2, frameDropWhenFull );
+        
+        int numAdded = 0;
+        
+        for( int f=0; f<10; f++ ) {
+            char *name = autoSprintf( "frameTest_%d.tga", f );
+            
+            if( queue.addFrame( makeFrame( 16, 16, 4, f ),
+                                new File( NULL, name ) ) ) {
+                numAdded++;
+                }
+            delete [] name;
+            }
+
+        queue.waitForAll();
+        
+        check( numAdded == 2, "only queue-size frames accepted" );
+        check( queue.getNumDropped() == 8, "rest dropped" );
+        check( queue.getNumEncoded() == numAdded, "accepted frames encoded" );
+
+        // room again once drained
+        char *name = autoSprintf( "frameTest_%d.tga", 10 );
+        check( queue.addFrame( makeFrame( 16, 16, 4, 10 ),
+                               new File( NULL, name ) ),
+               "frame accepted after drain" );
+        delete [] name;
+        }
+
+    for( int f=0; f<=10; f++ ) {
+        char *name = autoSprintf( "frameTest_%d.tga", f );
+        File file( NULL, name );
+        if( file.exists() ) {
+            file.remove();
+            }
+        delete [] name;
+        }
+    
+
+    return reportChecks();
+    }
@@ -3,42 +3,134 @@
 #include "minorGems/graphics/Image.h"
 
 #include "minorGems/io/file/FileOutputStream.h"
+#include "minorGems/io/file/FileInputStream.h"
 
 #include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
 
+#include <stdlib.h>
 
-int main() {
 
-    int imageSize = 640;
-    Image testImage( imageSize, imageSize, 3, false );
+// writes a raw image with the converter, reads it back with libpng,
+// and compares
+static void roundTrip( PNGImageConverter *inConverter, RawRGBAImage *inImage,
+                       const char *inDescription ) {
+    
+    File file( NULL, "test.png" );
 
+    double t = Time::getCurrentTime();
+    {
+        FileOutputStream outStream( &file );
+        inConverter->formatImageRaw( inImage, &outStream );
+        }
+    t = Time::getCurrentTime() - t;
+    
+    printf( "%s:  %ld bytes in %f seconds\n", inDescription,
+            file.getLength(), t );
     
-    // red fades toward bottom
-    // green fades toward right
-    double *red = testImage.getChannel( 0 );
-    double *green = testImage.getChannel( 1 );
 
-    for( int y=0; y<imageSize; y++ ) {
-        for( int x=0; x<imageSize; x++ ) {
-            red[y*imageSize+x] = 1.0 - ( y / (double)imageSize );
-            green[y*imageSize+x] = 1.0 - ( x / (double)imageSize );
-            green[y*imageSize+x] = 0;
+    FileInputStream inStream( &file );
+    Image *readImage = inConverter->deformatImage( &inStream );
+
+    check( readImage != NULL, inDescription );
+    
+    if( readImage == NULL ) {
+        return;
+        }
+    
+    check( readImage->getWidth() == inImage->mWidth &&
+           readImage->getHeight() == inImage->mHeight, inDescription );
+    
+    int numPixels = inImage->mWidth * inImage->mHeight;
+    int numChannels = inImage->mNumChannels;
+    
+    int numWrong = 0;
+    for( int c=0; c<numChannels; c++ ) {
+        double *channel = readImage->getChannel( c );
+        
+        for( int i=0; i<numPixels; i++ ) {
+            if( lrint( channel[i] * 255 ) != 
+                inImage->mRGBABytes[ i * numChannels + c ] ) {
+                numWrong++;
+                }
             }
         }
+    check( numWrong == 0, inDescription );
     
-    PNGImageConverter png;
+    delete readImage;
+    }
 
 
-    File outFileB( NULL, "test.png" );
-    FileOutputStream outStreamB( &outFileB );
 
+int main() {
 
-    double t = Time::getCurrentTime();
-                    
-    png.formatImage( &testImage, &outStreamB );
+    int w = 1280;
+    int h = 720;
 
-    printf( "Converter took %f seconds\n", 
-            Time::getCurrentTime() - t );
+    // smooth gradients with some noise and flat areas, like a screen shot
+    for( int numChannels=3; numChannels<=4; numChannels++ ) {
+        
+        unsigned char *bytes = new unsigned char[ w * h * numChannels ];
+        
+        for( int y=0; y<h; y++ ) {
+            for( int x=0; x<w; x++ ) {
+                unsigned char *p = &( bytes[ ( y * w + x ) * numChannels ] );
+                
+                if( x < w / 4 ) {
+                    p[0] = 40;
+                    p[1] = 80;
+                    p[2] = 120;
+                    }
+                else {
+                    p[0] = (unsigned char)( 255 * y / h );
+                    p[1] = (unsigned char)( 255 * x / w );
+                    p[2] = (unsigned char)( rand() % 8 + 100 );
+                    }
+                if( numChannels == 4 ) {
+                    p[3] = (unsigned char)( x ^ y );
+                    }
+                }
+            }
+        
+        RawRGBAImage image( bytes, w, h, numChannels );
+        
+        printf( "%d channels, %d raw bytes\n", numChannels, 
+                w * h * numChannels );
+        
+        int levels[3] = { 0, 1, 6 };
+        
+        for( int i=0; i<3; i++ ) {
+            for( int threads=1; threads<=4; threads += 3 ) {
+                PNGImageConverter png( levels[i], threads );
+                
+                char *description = 
+                    autoSprintf( "level %d, %d threads", levels[i], 
+                                 threads );
+                roundTrip( &png, &image, description );
+                delete [] description;
+                }
+            }
+        }
+    
+    // more strips than rows, and a single-row image
+    unsigned char *smallBytes = new unsigned char[ 7 * 3 * 3 ];
+    for( int i=0; i<7*3*3; i++ ) {
+        smallBytes[i] = (unsigned char)( i * 37 );
+        }
+    RawRGBAImage small( smallBytes, 7, 3, 3 );
+    PNGImageConverter png( 9, 8 );
+    roundTrip( &png, &small, "tiny image" );
+
+    unsigned char *rowBytes = new unsigned char[ 300 * 4 ];
+    for( int i=0; i<300*4; i++ ) {
+        rowBytes[i] = (unsigned char)( i / 5 );
+        }
+    RawRGBAImage row( rowBytes, 300, 1, 4 );
+    roundTrip( &png, &row, "one row" );
+    
+    File file( NULL, "test.png" );
+    file.remove();
+    
 
-    return 0;
+    return reportChecks();
     }
@@ -0,0 +1,300 @@
+#include "TGAImageConverter.h"
+
+#include "minorGems/util/StringBufferOutputStream.h"
+#include "minorGems/util/ByteBufferInputStream.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdlib.h>
+
+
+static RawRGBAImage *makeImage( int inWidth, int inHeight, 
+                                int inNumChannels ) {
+    int numBytes = inWidth * inHeight * inNumChannels;
+    unsigned char *bytes = new unsigned char[ numBytes ];
+    
+    for( int i=0; i<numBytes; i++ ) {
+        bytes[i] = (unsigned char)( rand() );
+        }
+    return new RawRGBAImage( bytes, inWidth, inHeight, inNumChannels );
+    }
+
+
+
+static char sameImage( RawRGBAImage *inA, RawRGBAImage *inB ) {
+    if( inA == NULL || inB == NULL ||
+        inA->mWidth != inB->mWidth || inA->mHeight != inB->mHeight ||
+        inA->mNumChannels != inB->mNumChannels ) {
+        return false;
+        }
+    return memcmp( inA->mRGBABytes, inB->mRGBABytes, 
+                   inA->mWidth * inA->mHeight * inA->mNumChannels ) == 0;
+    }
+
+
+
+static void appendHeader( SimpleVector<unsigned char> *inFile,
+                          int inType, int inWidth, int inHeight,
+                          int inNumChannels, char inOriginAtTop,
+                          int inIDLength ) {
+    unsigned char header[18];
+    memset( header, 0, 18 );
+    
+    header[0] = (unsigned char)inIDLength;
+    header[2] = (unsigned char)inType;
+    header[12] = inWidth & 0xFF;
+    header[13] = inWidth >> 8;
+    header[14] = inHeight & 0xFF;
+    header[15] = inHeight >> 8;
+    header[16] = (unsigned char)( inNumChannels * 8 );
+    if( inOriginAtTop ) {
+        header[17] = 1 << 5;
+        }
+    inFile->appendArray( header, 18 );
+    
+    for( int i=0; i<inIDLength; i++ ) {
+        inFile->push_back( 'x' );
+        }
+    }
+
+
+
+// run-length encodes an image, with runs and raw packets that cross
+// row boundaries
+static unsigned char *encodeRLE( RawRGBAImage *inImage, char inOriginAtTop,
+                                 int *outLength ) {
+    SimpleVector<unsigned char> file;
+    
+    int w = inImage->mWidth;
+    int h = inImage->mHeight;
+    int c = inImage->mNumChannels;
+    
+    appendHeader( &file, 10, w, h, c, inOriginAtTop, 5 );
+    
+    // pixels in file order, BGR(A)
+    int numPixels = w * h;
+    unsigned char *pixels = new unsigned char[ numPixels * c ];
+    
+    for( int y=0; y<h; y++ ) {
+        int sourceY = inOriginAtTop ? y : ( h - 1 - y );
+        
+        for( int x=0; x<w; x++ ) {
+            unsigned char *s = 
+                &( inImage->mRGBABytes[ ( sourceY * w + x ) * c ] );
+            unsigned char *d = &( pixels[ ( y * w + x ) * c ] );
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = s[0];
+            if( c == 4 ) {
+                d[3] = s[3];
+                }
+            }
+        }
+    
+    int p = 0;
+    while( p < numPixels ) {
+        // length of run of identical pixels starting here
+        int run = 1;
+        while( p + run < numPixels && run < 128 &&
+               memcmp( &( pixels[ p * c ] ), &( pixels[ ( p + run ) * c ] ),
+                       c ) == 0 ) {
+            run++;
+            }
+        
+        if( run > 1 ) {
+            file.push_back( (unsigned char)( 0x80 | ( run - 1 ) ) );
+            file.appendArray( &( pixels[ p * c ] ), c );
+            p += run;
+            }
+        else {
+            int count = 1;
+            while( p + count < numPixels && count < 128 &&
+                   memcmp( &( pixels[ ( p + count - 1 ) * c ] ), 
+                           &( pixels[ ( p + count ) * c ] ), c ) != 0 ) {
+                count++;
+                }
+            file.push_back( (unsigned char)( count - 1 ) );
+            file.appendArray( &( pixels[ p * c ] ), count * c );
+            p += count;
+            }
+        }
+    
+    delete [] pixels;
+    
+    *outLength = file.size();
+    return file.getElementArray();
+    }
+
+
+
+// image with long runs, like sprite backgrounds
+static RawRGBAImage *makeRunImage( int inWidth, int inHeight,
+                                   int inNumChannels ) {
+    RawRGBAImage *image = makeImage( inWidth, inHeight, inNumChannels );
+    
+    for( int i=0; i<inWidth * inHeight; i++ ) {
+        if( ( i / 37 ) % 2 == 0 ) {
+            memset( &( image->mRGBABytes[ i * inNumChannels ] ), 
+                    ( i / 37 ) & 0xFF, inNumChannels );
+            }
+        }
+    return image;
+    }
+
+
+
+static void checkUncompressed( int inNumChannels ) {
+    TGAImageConverter converter;
+    RawRGBAImage *image = makeImage( 61, 17, inNumChannels );
+    
+    StringBufferOutputStream outStream;
+    converter.formatImageRaw( image, &outStream );
+    
+    int length;
+    unsigned char *file = outStream.getBytes( &length );
+    
+    RawRGBAImage *fromMemory = TGAImageConverter::decodeTGA( file, length );
+    check( sameImage( image, fromMemory ), "uncompressed from memory" );
+    
+    ByteBufferInputStream inStream( file, length );
+    RawRGBAImage *fromStream = converter.deformatImageRaw( &inStream );
+    check( sameImage( image, fromStream ), "uncompressed from stream" );
+    
+    // into a wider staging buffer, always 4 channels
+    TGAInfo info;
+    check( TGAImageConverter::readTGAInfo( file, length, &info ), 
+           "header" );
+    
+    int stride = 64 * 4;
+    unsigned char *staging = new unsigned char[ stride * 17 ];
+    memset( staging, 7, stride * 17 );
+    
+    check( TGAImageConverter::decodeTGA( file, length, &info, 
+                                         staging, 4, stride ), 
+           "into staging buffer" );
+    
+    char same = true;
+    for( int y=0; y<17; y++ ) {
+        for( int x=0; x<64; x++ ) {
+            unsigned char *d = &( staging[ y * stride + x * 4 ] );
+            
+            if( x >= 61 ) {
+                if( d[0] != 7 ) {
+                    same = false;
+                    }
+                continue;
+                }
+            unsigned char *s = 
+                &( image->mRGBABytes[ ( y * 61 + x ) * inNumChannels ] );
+            
+            int alpha = 255;
+            if( inNumChannels == 4 ) {
+                alpha = s[3];
+                }
+            if( d[0] != s[0] || d[1] != s[1] || d[2] != s[2] || 
+                d[3] != alpha ) {
+                same = false;
+                }
+            }
+        }
+    check( same, "staging buffer contents" );
+    
+    // truncated pixel data is rejected
+    check( TGAImageConverter::decodeTGA( file, length - 1 ) == NULL,
+           "truncated file rejected" );
+    
+    delete [] staging;
+    delete fromStream;
+    delete fromMemory;
+    delete [] file;
+    delete image;
+    }
+
+
+
+static void checkRunLength( int inNumChannels, char inOriginAtTop ) {
+    RawRGBAImage *image = makeRunImage( 53, 29, inNumChannels );
+    
+    int length;
+    unsigned char *file = encodeRLE( image, inOriginAtTop, &length );
+    
+    RawRGBAImage *fromMemory = TGAImageConverter::decodeTGA( file, length );
+    check( sameImage( image, fromMemory ), "RLE from memory" );
+    
+    TGAImageConverter converter;
+    ByteBufferInputStream inStream( file, length );
+    RawRGBAImage *fromStream = converter.deformatImageRaw( &inStream );
+    check( sameImage( image, fromStream ), "RLE from stream" );
+
+    check( TGAImageConverter::decodeTGA( file, length - 2 ) == NULL,
+           "truncated RLE rejected" );
+    
+    // a 2x2 image with a run of 5 pixels
+    SimpleVector<unsigned char> overrunFile;
+    appendHeader( &overrunFile, 10, 2, 2, inNumChannels, inOriginAtTop, 0 );
+    overrunFile.push_back( 0x80 | 4 );
+    for( int i=0; i<inNumChannels; i++ ) {
+        overrunFile.push_back( 9 );
+        }
+    unsigned char *overrunBytes = overrunFile.getElementArray();
+    RawRGBAImage *overrun = 
+        TGAImageConverter::decodeTGA( overrunBytes, overrunFile.size() );
+    check( overrun == NULL, "RLE overrun rejected" );
+    delete [] overrunBytes;
+    
+    delete fromStream;
+    delete fromMemory;
+    delete [] file;
+    delete image;
+    }
+
+
+
+int main() {
+    
+    checkUncompressed( 3 );
+    checkUncompressed( 4 );
+    
+    checkRunLength( 3, true );
+    checkRunLength( 3, false );
+    checkRunLength( 4, true );
+    checkRunLength( 4, false );
+
+    
+    // timing on a sprite-sheet-sized image
+    TGAImageConverter converter;
+    RawRGBAImage *image = makeRunImage( 1024, 1024, 4 );
+    
+    StringBufferOutputStream outStream;
+    converter.formatImageRaw( image, &outStream );
+    int length;
+    unsigned char *file = outStream.getBytes( &length );
+    
+    int rleLength;
+    unsigned char *rleFile = encodeRLE( image, false, &rleLength );
+
+    double t = Time::getCurrentTime();
+    for( int i=0; i<10; i++ ) {
+        delete TGAImageConverter::decodeTGA( file, length );
+        }
+    double rawTime = ( Time::getCurrentTime() - t ) / 10;
+    
+    t = Time::getCurrentTime();
+    for( int i=0; i<10; i++ ) {
+        delete TGAImageConverter::decodeTGA( rleFile, rleLength );
+        }
+    double rleTime = ( Time::getCurrentTime() - t ) / 10;
+    
+    printf( "1024x1024 RGBA decode:  uncompressed %.2f ms (%d bytes), "
+            "RLE %.2f ms (%d bytes)\n", rawTime * 1000, length,
+            rleTime * 1000, rleLength );
+    
+    delete [] rleFile;
+    delete [] file;
+    delete image;
+    
+    
+    return reportChecks();
+    }
@@ -23,6 +23,13 @@
 #define BOX_BLUR_FILTER_INCLUDED
  
 #include "minorGems/graphics/ChannelFilter.h" 
+#include "minorGems/graphics/PixelImage.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
  
 /**
  * Blur convolution filter that uses a box for averaging.
@@ -60,10 +67,142 @@ class BoxBlurFilter : public ChannelFilter {
 		// implements the ChannelFilter interface
 		void apply( double *inChannel, int inWidth, int inHeight );
 
+		
+		/**
+		 * Averages each row in a band of rows over a box of a given 
+		 * radius.  Boxes are clipped at the ends of each row.
+		 *
+		 * Bands can be run in parallel (see SeparableBlurFilter).
+		 *
+		 * @param inSource the source channel.  Destroyed by caller.
+		 * @param outDest the channel to write averages into.  Must not
+		 *   be inSource.  Destroyed by caller.
+		 * @param inWidth the channel width.
+		 * @param inStartRow, inEndRow the band of rows, with inEndRow
+		 *   not included.
+		 * @param inRadius the box radius.
+		 */
+		static void blurRows( double *inSource, double *outDest,
+							  int inWidth, int inStartRow, int inEndRow,
+							  int inRadius );
+		
+
+		/**
+		 * Same as blurRows, but averages down each column in a band
+		 * of columns.
+		 *
+		 * @param inStartColumn, inEndColumn the band of columns, with
+		 *   inEndColumn not included.
+		 */
+		static void blurColumns( double *inSource, double *outDest,
+								 int inWidth, int inHeight,
+								 int inStartColumn, int inEndColumn,
+								 int inRadius );
+
+
+		/**
+		 * Applies this filter directly to a PixelImage, in fixed point
+		 * for integer samples.
+		 *
+		 * @param inImage the image to filter.  Destroyed by caller.
+		 * @param inChannel the channel to filter, or -1 for all channels.
+		 */
+		template <class T>
+		void apply( PixelImage<T> *inImage, int inChannel = -1 );
+		
+
+		/**
+		 * Applies this filter to one channel of samples.
+		 *
+		 * @param inChannel the first sample of the channel.
+		 * @param inStride the distance between samples.
+		 * @param inWidth, inHeight the channel size.
+		 */
+		template <class T>
+		void applyToSamples( T *inChannel, int inStride,
+							 int inWidth, int inHeight );
+
 	private:
 		int mRadius;
+
+		// table of 1/n for every box size up to 2 * inRadius + 1
+		// Must be destroyed by caller.
+		static double *getReciprocals( int inRadius );
 	};
 	
+
+
+// row operations for the column pass, two doubles at a time with SSE2
+
+#if defined(__SSE2__)
+
+inline void boxBlurAddRow( double *inTotals, double *inRow, int inLength ) {
+    int i = 0;
+    for( ; i + 2 <= inLength; i += 2 ) {
+        _mm_storeu_pd( &( inTotals[i] ),
+                       _mm_add_pd( _mm_loadu_pd( &( inTotals[i] ) ),
+                                   _mm_loadu_pd( &( inRow[i] ) ) ) );
+        }
+    for( ; i < inLength; i++ ) {
+        inTotals[i] += inRow[i];
+        }
+    }
+
+
+inline void boxBlurSubtractRow( double *inTotals, double *inRow, 
+                                int inLength ) {
+    int i = 0;
+    for( ; i + 2 <= inLength; i += 2 ) {
+        _mm_storeu_pd( &( inTotals[i] ),
+                       _mm_sub_pd( _mm_loadu_pd( &( inTotals[i] ) ),
+                                   _mm_loadu_pd( &( inRow[i] ) ) ) );
+        }
+    for( ; i < inLength; i++ ) {
+        inTotals[i] -= inRow[i];
+        }
+    }
+
+
+inline void boxBlurScaleRow( double *outRow, double *inTotals, 
+                             double inScale, int inLength ) {
+    __m128d scale = _mm_set1_pd( inScale );
+    int i = 0;
+    for( ; i + 2 <= inLength; i += 2 ) {
+        _mm_storeu_pd( &( outRow[i] ),
+                       _mm_mul_pd( _mm_loadu_pd( &( inTotals[i] ) ), 
+                                   scale ) );
+        }
+    for( ; i < inLength; i++ ) {
+        outRow[i] = inTotals[i] * inScale;
+        }
+    }
+
+#else
+
+inline void boxBlurAddRow( double *inTotals, double *inRow, int inLength ) {
+    for( int i=0; i<inLength; i++ ) {
+        inTotals[i] += inRow[i];
+        }
+    }
+
+
+inline void boxBlurSubtractRow( double *inTotals, double *inRow, 
+                                int inLength ) {
+    for( int i=0; i<inLength; i++ ) {
+        inTotals[i] -= inRow[i];
+        }
+    }
+
+
+inline void boxBlurScaleRow( double *outRow, double *inTotals, 
+                             double inScale, int inLength ) {
+    for( int i=0; i<inLength; i++ ) {
+        outRow[i] = inTotals[i] * inScale;
+        }
+    }
+
+#endif
+	
 	
 	
 inline BoxBlurFilter::BoxBlurFilter( int inRadius ) 
@@ -88,121 +227,254 @@ inline int BoxBlurFilter::getRadius() {
 inline void BoxBlurFilter::apply( double *inChannel, 
                                   int inWidth, int inHeight ) {
 
-    // the basis for this method was found in this article:
-    // 
-    // http://www.gamasutra.com/view/feature/3102/
-    //        four_tricks_for_fast_blurring_in_.php?page=1
-    //
-    // however, the code provided seems to contain mistakes, which I have fixed
+    // a box is separable:  average along each row, then average those
+    // averages down each column.  Both passes slide a running sum, so
+    // the cost per pixel doesn't depend on the radius.
+    double *rowAverages = new double[ inWidth * inHeight ];
+    
+    blurRows( inChannel, rowAverages, inWidth, 0, inHeight, mRadius );
+    
+    blurColumns( rowAverages, inChannel, inWidth, inHeight, 
+                 0, inWidth, mRadius );
+    
+    delete [] rowAverages;
+    }
 
 
-    // sum of all pixels to left and above each position 
-    // (including that position)
-    double *accumTotals = new double[ inWidth * inHeight ];
+
+inline double *BoxBlurFilter::getReciprocals( int inRadius ) {
+    int maxCount = 2 * inRadius + 1;
+    
+    double *reciprocals = new double[ maxCount + 1 ];
     
+    reciprocals[0] = 0;
+    for( int i=1; i<=maxCount; i++ ) {
+        reciprocals[i] = 1.0 / i;
+        }
+    return reciprocals;
+    }
 
-    double *accumPointer = accumTotals;
-    double *sourcePointer = inChannel;
-    for( int y=0; y<inHeight; y++ ) {
-        for( int x=0; x<inWidth; x++ ) {
-            double total = sourcePointer[0];
 
-            if( x>0 ) {    
-                total += accumPointer[-1];
-                }
+
+inline void BoxBlurFilter::blurRows( double *inSource, double *outDest,
+                                     int inWidth, 
+                                     int inStartRow, int inEndRow,
+                                     int inRadius ) {
+    
+    double *reciprocals = getReciprocals( inRadius );
+    
+    // the box always holds this many pixels at first, clipped to the row
+    int firstEnd = inRadius;
+    if( firstEnd >= inWidth ) {
+        firstEnd = inWidth - 1;
+        }
+
+    for( int y=inStartRow; y<inEndRow; y++ ) {
+        double *source = &( inSource[ y * inWidth ] );
+        double *dest = &( outDest[ y * inWidth ] );
+        
+        double total = 0;
+        for( int x=0; x<=firstEnd; x++ ) {
+            total += source[x];
+            }
+        int count = firstEnd + 1;
+        
+        for( int x=0; x<inWidth; x++ ) {
+            dest[x] = total * reciprocals[ count ];
             
-            if( y>0 ) {    
-                total += accumPointer[ -inWidth ];
-                }
+            // slide box one pixel to the right
+            int enter = x + inRadius + 1;
+            int leave = x - inRadius;
             
-            if( x>0 && y>0 ) {
-                total -= accumPointer[ -inWidth - 1 ];
+            if( enter < inWidth ) {
+                total += source[ enter ];
+                count++;
+                }
+            if( leave >= 0 ) {
+                total -= source[ leave ];
+                count--;
                 }
-            
-            *accumPointer = total;
-            accumPointer++;
-            
-            sourcePointer++;
             }
         }
     
+    delete [] reciprocals;
+    }
+
+
+
+inline void BoxBlurFilter::blurColumns( double *inSource, double *outDest,
+                                        int inWidth, int inHeight,
+                                        int inStartColumn, int inEndColumn,
+                                        int inRadius ) {
+    
+    double *reciprocals = getReciprocals( inRadius );
+    
+    int numColumns = inEndColumn - inStartColumn;
+    
+    // running box total for each column, updated a whole row at a time
+    // so the inner loops run over contiguous memory
+    double *totals = new double[ numColumns ];
+    memset( totals, 0, numColumns * sizeof( double ) );
+
+    inSource = &( inSource[ inStartColumn ] );
+    outDest = &( outDest[ inStartColumn ] );
+    
+    int firstEnd = inRadius;
+    if( firstEnd >= inHeight ) {
+        firstEnd = inHeight - 1;
+        }
+    
+    for( int y=0; y<=firstEnd; y++ ) {
+        boxBlurAddRow( totals, &( inSource[ y * inWidth ] ), numColumns );
+        }
+    int count = firstEnd + 1;
+    
+    for( int y=0; y<inHeight; y++ ) {
+        boxBlurScaleRow( &( outDest[ y * inWidth ] ), totals, 
+                         reciprocals[ count ], numColumns );
+        
+        int enter = y + inRadius + 1;
+        int leave = y - inRadius;
+        
+        if( enter < inHeight ) {
+            boxBlurAddRow( totals, &( inSource[ enter * inWidth ] ), 
+                           numColumns );
+            count++;
+            }
+        if( leave >= 0 ) {
+            boxBlurSubtractRow( totals, &( inSource[ leave * inWidth ] ),
+                                numColumns );
+            count--;
+            }
+        }
+    
+    delete [] totals;
+    delete [] reciprocals;
+    }
+
+
+
+template <class T>
+inline void BoxBlurFilter::apply( PixelImage<T> *inImage, int inChannel ) {
+    
+    int start = inChannel;
+    int end = inChannel;
     
+    if( inChannel == -1 ) {
+        start = 0;
+        end = inImage->getNumChannels() - 1;
+        }
     
+    for( int c=start; c<=end; c++ ) {
+        applyToSamples( inImage->getChannel( c ), 
+                        inImage->getChannelStride(),
+                        inImage->getWidth(), inImage->getHeight() );
+        }
+    }
+
+
+
+template <class T>
+inline void BoxBlurFilter::applyToSamples( T *inChannel, int inStride,
+                                           int inWidth, int inHeight ) {
+
+    typedef typename PixelTraits<T>::Sum Sum;
+    typedef typename PixelTraits<T>::Scale Scale;
+
+    // same summed-area method as apply() above, in integers
+    Sum *accumTotals = new Sum[ inWidth * inHeight ];
     
+    for( int y=0; y<inHeight; y++ ) {
+        Sum rowTotal = 0;
+        
+        Sum *accumRow = &( accumTotals[ y * inWidth ] );
+        T *sourceRow = &( inChannel[ y * inWidth * inStride ] );
+        
+        for( int x=0; x<inWidth; x++ ) {
+            rowTotal += sourceRow[ x * inStride ];
+            
+            if( y > 0 ) {
+                accumRow[x] = rowTotal + accumRow[ x - inWidth ];
+                }
+            else {
+                accumRow[x] = rowTotal;
+                }
+            }
+        }
+    
+
+    int fullBoxWidth = 2 * mRadius + 1;
     
-    // sum boxes right into passed-in channel
     for( int y=0; y<inHeight; y++ ) {
-        // seems like Gamasutra's code had a mistake
-        // need to extend start of box 1 past actual box, for this to work
-        // properly
         int boxYStart = y - mRadius - 1;
         int boxYEnd = y + mRadius;
 
-        double yOutsideFactor = 1;
+        char yOutside = true;
         
-        int yDimensionExtra = 0;
-
         if( boxYStart < 0 ) {
-            boxYStart = 0;
-            yOutsideFactor = 0;
-            yDimensionExtra = 1;
+            yOutside = false;
             }
         if( boxYEnd >= inHeight ) {
             boxYEnd = inHeight - 1;
             }
-        int yDimension = boxYEnd - boxYStart + yDimensionExtra;
+        int yDimension = boxYEnd - boxYStart;
+        if( !yOutside ) {
+            yDimension = boxYEnd + 1;
+            }
+        
+        Sum *endRow = &( accumTotals[ boxYEnd * inWidth ] );
+        Sum *startRow = NULL;
+        if( yOutside ) {
+            startRow = &( accumTotals[ boxYStart * inWidth ] );
+            }
 
+        // same for all boxes in this row that are away from the edges
+        Scale fullReciprocal = 
+            PixelTraits<T>::getReciprocal( yDimension * fullBoxWidth );
+
+        T *destRow = &( inChannel[ y * inWidth * inStride ] );
 
         for( int x=0; x<inWidth; x++ ) {
             
             int boxXStart = x - mRadius - 1;
             int boxXEnd = x + mRadius;
             
-            double xOutsideFactor = 1;
+            if( boxXEnd >= inWidth ) {
+                boxXEnd = inWidth - 1;
+                }
             
-            int xDimensionExtra = 0;
+            Sum total = endRow[ boxXEnd ];
+            int xDimension;
             
-            if( boxXStart < 0 ) {
-                boxXStart = 0;
-                xOutsideFactor = 0;
-                xDimensionExtra = 1;
+            if( boxXStart >= 0 ) {
+                total -= endRow[ boxXStart ];
+                xDimension = boxXEnd - boxXStart;
                 }
-            if( boxXEnd >= inWidth ) {
-                boxXEnd = inWidth - 1;
+            else {
+                xDimension = boxXEnd + 1;
                 }
             
-            double outsideOverlapFactor = yOutsideFactor * xOutsideFactor;
+            if( yOutside ) {
+                total -= startRow[ boxXEnd ];
+                
+                if( boxXStart >= 0 ) {
+                    total += startRow[ boxXStart ];
+                    }
+                }
             
-
-            int xDimension = boxXEnd - boxXStart + xDimensionExtra;
-
-            int numPixelsInBox = (yDimension) * (xDimension);
-    
-            double boxValueMultiplier = 1.0 / numPixelsInBox;
-
+            Scale reciprocal = fullReciprocal;
             
-            inChannel[ y * inWidth + x ] = 
-                boxValueMultiplier * (
-                    // total sum of pixels in image from far corner
-                    // of box back to (0,0)
-                    accumTotals[ boxYEnd * inWidth + boxXEnd ]
-                    // subtract regions outside of box, if any
-                    -
-                    yOutsideFactor * 
-                    accumTotals[ boxYStart * inWidth + boxXEnd ]
-                    -
-                    xOutsideFactor * 
-                    accumTotals[ boxYEnd * inWidth + boxXStart ]
-                    // add back in region that was subtracted twice, if any
-                    +
-                    outsideOverlapFactor *
-                    accumTotals[ boxYStart * inWidth + boxXStart ]
-                    );
+            if( xDimension != fullBoxWidth ) {
+                reciprocal = 
+                    PixelTraits<T>::getReciprocal( yDimension * xDimension );
+                }
             
+            destRow[ x * inStride ] = 
+                PixelTraits<T>::scaleSum( total, reciprocal );
             }
         }
     
-    delete [] accumTotals;    
+    delete [] accumTotals;
     }
 
 
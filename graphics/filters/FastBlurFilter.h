@@ -10,6 +10,7 @@
 #define FAST_BLUR_FILTER_INCLUDED
  
 #include "minorGems/graphics/ChannelFilter.h" 
+#include "minorGems/graphics/PixelImage.h"
  
 /**
  * Fast implementation of a radius-1 box filter.
@@ -24,6 +25,29 @@ class FastBlurFilter : public ChannelFilter {
     
         // implements the ChannelFilter interface
         void apply( double *inChannel, int inWidth, int inHeight );
+        
+
+        /**
+         * Applies this filter directly to a PixelImage, in fixed point
+         * for integer samples.
+         *
+         * @param inImage the image to filter.  Destroyed by caller.
+         * @param inChannel the channel to filter, or -1 for all channels.
+         */
+        template <class T>
+        void apply( PixelImage<T> *inImage, int inChannel = -1 );
+        
+
+        /**
+         * Applies this filter to one channel of samples.
+         *
+         * @param inChannel the first sample of the channel.
+         * @param inStride the distance between samples.
+         * @param inWidth, inHeight the channel size.
+         */
+        template <class T>
+        void applyToSamples( T *inChannel, int inStride,
+                             int inWidth, int inHeight );
 
     };
         
@@ -31,68 +55,90 @@ class FastBlurFilter : public ChannelFilter {
     
 inline void FastBlurFilter::apply( double *inChannel, 
                                    int inWidth, int inHeight ) {
+    // same as the sample path, without a stride
+    applyToSamples( inChannel, 1, inWidth, inHeight );
+    }
 
 
-    // use pointer tricks to walk through neighbor box of each pixel
 
-    // four "corners" around box
-    int cornerOffsetA = inWidth + 1;
-    int cornerOffsetB = -inWidth + 1;
-    int cornerOffsetC = inWidth - 1;
-    int cornerOffsetD = -inWidth - 1;
+template <class T>
+inline void FastBlurFilter::apply( PixelImage<T> *inImage, int inChannel ) {
+    
+    int start = inChannel;
+    int end = inChannel;
+    
+    if( inChannel == -1 ) {
+        start = 0;
+        end = inImage->getNumChannels() - 1;
+        }
+    
+    for( int c=start; c<=end; c++ ) {
+        applyToSamples( inImage->getChannel( c ), 
+                        inImage->getChannelStride(),
+                        inImage->getWidth(), inImage->getHeight() );
+        }
+    }
 
-    // sides around box
-    int sideOffsetA = inWidth;
-    int sideOffsetB = -inWidth;
-    int sideOffsetC = 1;
-    int sideOffsetD = -1;
 
-    
-    int numPixels = inWidth * inHeight;
 
+template <class T>
+inline void FastBlurFilter::applyToSamples( T *inChannel, int inStride,
+                                            int inWidth, int inHeight ) {
 
-    double *sourceData = new double[ numPixels ];
+    typedef typename PixelTraits<T>::Sum Sum;
     
-    memcpy( sourceData, inChannel, numPixels * sizeof( double ) );
-        
-
-    // avoid edges
-    int numPixelsInRow = inWidth - 2;
+    if( inWidth < 3 || inHeight < 3 ) {
+        return;
+        }
     
-    double boxMultiplier = 1.0 / 9.0;
+    int rowStride = inWidth * inStride;
     
-
+    // keep three source rows, since the rows above are overwritten as 
+    // we go
+    int numRowSamples = inWidth * inStride;
+    
+    // don't run past the end of the image for the last channel of
+    // interleaved samples
+    int copySize = ( ( inWidth - 1 ) * inStride + 1 ) * sizeof( T );
+    
+    T *rows = new T[ 3 * numRowSamples ];
+    
+    memcpy( rows, inChannel, copySize );
+    memcpy( &( rows[ numRowSamples ] ), &( inChannel[ rowStride ] ), 
+            copySize );
+    
+    typename PixelTraits<T>::Scale reciprocal = 
+        PixelTraits<T>::getReciprocal( 9 );
     
-    // sum boxes right into passed-in channel
-
-    // avoid edges where box falls off edge
     for( int y=1; y<inHeight-1; y++ ) {
         
-        // skip first pixel in row to avoid box falling off edge
-        int pixelIndex = y * inWidth + 1;
-
-        for( int i=0; i<numPixelsInRow; i++ ) {
-
-            double *sourcePointer = &( sourceData[ pixelIndex ] );
-
-            inChannel[ pixelIndex ] =
-                ( sourcePointer[ 0 ] +
-                  sourcePointer[ cornerOffsetA ] +
-                  sourcePointer[ cornerOffsetB ] +
-                  sourcePointer[ cornerOffsetC ] +
-                  sourcePointer[ cornerOffsetD ] +
-                  sourcePointer[ sideOffsetA ] +
-                  sourcePointer[ sideOffsetB ] +
-                  sourcePointer[ sideOffsetC ] +
-                  sourcePointer[ sideOffsetD ]
-                  ) * boxMultiplier;
+        T *above = &( rows[ ( ( y - 1 ) % 3 ) * numRowSamples ] );
+        T *center = &( rows[ ( y % 3 ) * numRowSamples ] );
+        T *below = &( rows[ ( ( y + 1 ) % 3 ) * numRowSamples ] );
+        
+        memcpy( below, &( inChannel[ ( y + 1 ) * rowStride ] ), copySize );
+        
+        T *dest = &( inChannel[ y * rowStride ] );
+        
+        // running column sums, so each pixel adds one new column
+        Sum left = (Sum)above[0] + center[0] + below[0];
+        Sum middle = 
+            (Sum)above[inStride] + center[inStride] + below[inStride];
+        
+        for( int x=1; x<inWidth-1; x++ ) {
+            int i = ( x + 1 ) * inStride;
+            
+            Sum right = (Sum)above[i] + center[i] + below[i];
             
-            pixelIndex++;
+            dest[ x * inStride ] = 
+                PixelTraits<T>::scaleSum( left + middle + right, 
+                                          reciprocal );
+            left = middle;
+            middle = right;
             }
-
         }
 
-    delete [] sourceData;
+    delete [] rows;
     }
 
 
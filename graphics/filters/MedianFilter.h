@@ -19,6 +19,7 @@
 #define MEDIAN_FILTER_INCLUDED
  
 #include "minorGems/graphics/ChannelFilter.h" 
+#include "minorGems/graphics/PixelImage.h"
 #include "quickselect.h"
 
 
@@ -27,6 +28,10 @@ int medianFilterCompareInt( const void *x, const void *y );
 /**
  * Median convolution filter.
  *
+ * Channels whose values fit into 16-bit bins (including any Image
+ * channel in 0..1) are filtered in constant time per pixel with
+ * histograms.  Others fall back to quick_select on each box.
+ *
  * @author Jeremy Tavan 
  */
 class MedianFilter : public ChannelFilter { 
@@ -60,6 +65,88 @@ class MedianFilter : public ChannelFilter {
   // implements the ChannelFilter interface
   void apply( double *inChannel, int inWidth, int inHeight );
 
+
+  /**
+   * Applies this filter directly to a PixelImage, without converting
+   * samples to doubles.
+   *
+   * @param inImage the image to filter.  Destroyed by caller.
+   * @param inChannel the channel to filter, or -1 for all channels.
+   */
+  template <class T>
+  void apply( PixelImage<T> *inImage, int inChannel = -1 );
+
+
+  /**
+   * Applies this filter to one channel of samples.
+   *
+   * @param inChannel the first sample of the channel.
+   * @param inStride the distance between samples.
+   * @param inWidth, inHeight the channel size.
+   */
+  template <class T>
+  void applyToSamples( T *inChannel, int inStride,
+                       int inWidth, int inHeight );
+
+  // 8- and 16-bit samples use the histogram method
+  void applyToSamples( unsigned char *inChannel, int inStride,
+                       int inWidth, int inHeight );
+  void applyToSamples( unsigned short *inChannel, int inStride,
+                       int inWidth, int inHeight );
+
+
+  /**
+   * Median filters a band of rows of a channel of histogram bin indices
+   * in constant time per pixel, independent of the radius.
+   *
+   * Uses the column histograms of Perreault and Hebert, "Median
+   * Filtering in Constant Time", with each histogram split into coarse
+   * and fine levels.  Wide channels are done in column tiles to bound
+   * the memory used by the histograms.
+   *
+   * Boxes are clipped at the channel edges, and the lower median is 
+   * taken for even counts, like quick_select.
+   *
+   * @param inBins the source bin indices.  Destroyed by caller.
+   * @param outBins the bins to write medians into.  Must not be inBins.
+   *   Destroyed by caller.
+   * @param inWidth, inHeight the channel size.
+   * @param inNumBins one more than the largest bin index.
+   * @param inRadius the radius of the box.
+   * @param inStartRow, inEndRow the band of rows, with inEndRow not
+   *   included.
+   */
+  static void filterBinBand( unsigned short *inBins, unsigned short *outBins,
+                             int inWidth, int inHeight, int inNumBins,
+                             int inRadius, int inStartRow, int inEndRow );
+
+ protected:
+  
+  /**
+   * Median filters a whole channel of bin indices.  Parameters are the
+   * same as for filterBinBand.
+   *
+   * Can be overridden to split the channel into bands.
+   */
+  virtual void filterBins( unsigned short *inBins, unsigned short *outBins,
+                           int inWidth, int inHeight, int inNumBins,
+                           int inRadius );
+  
+  
+  /**
+   * The quick_select method, for channels with values that don't fit
+   * into 16-bit bins.
+   */
+  void applyQuickSelect( double *inChannel, int inWidth, int inHeight );
+
+
+  /**
+   * Runs filterBins on one channel of 8- or 16-bit samples.
+   */
+  template <class T>
+  void applyHistogram( T *inChannel, int inStride,
+                       int inWidth, int inHeight, int inNumBins );
+
  private:
   int mRadius;
 };
@@ -86,7 +173,65 @@ inline int MedianFilter::getRadius() {
 				
 				
 inline void MedianFilter::apply( double *inChannel, 
-																 int inWidth, int inHeight ) {
+                                 int inWidth, int inHeight ) {
+  
+  int numPixels = inWidth * inHeight;
+  if( numPixels == 0 ) {
+    return;
+  }
+  
+  // same integer values that quick_select would see
+  int *intChannel = new int[ numPixels ];
+  int minValue = (int)( 1000 * inChannel[0] );
+  int maxValue = minValue;
+  
+  for( int p=0; p<numPixels; p++ ) {
+    int v = (int)( 1000 * inChannel[p] );
+    intChannel[p] = v;
+
+    if( v < minValue ) {
+      minValue = v;
+    }
+    if( v > maxValue ) {
+      maxValue = v;
+    }
+  }
+
+  // counts in the column histograms are 16-bit
+  int boxHeight = 2 * mRadius + 1;
+  if( boxHeight > inHeight ) {
+    boxHeight = inHeight;
+  }
+  
+  if( (double)maxValue - minValue >= 65536 || boxHeight >= 65536 ) {
+    delete [] intChannel;
+    applyQuickSelect( inChannel, inWidth, inHeight );
+    return;
+  }
+  
+  unsigned short *bins = new unsigned short[ numPixels ];
+  for( int p=0; p<numPixels; p++ ) {
+    bins[p] = (unsigned short)( intChannel[p] - minValue );
+  }
+  delete [] intChannel;
+  
+  unsigned short *medians = new unsigned short[ numPixels ];
+  
+  filterBins( bins, medians, inWidth, inHeight, 
+              maxValue - minValue + 1, mRadius );
+
+  for( int p=0; p<numPixels; p++ ) {
+    inChannel[p] = (double)( medians[p] + minValue ) / 1000.0;
+  }
+  
+  delete [] medians;
+  delete [] bins;
+}
+
+
+
+inline void MedianFilter::applyQuickSelect( double *inChannel, 
+                                            int inWidth, int inHeight ) {
 
   // pre-compute an integer version of the channel for the
   // median alg to use
@@ -156,4 +301,445 @@ inline void MedianFilter::apply( double *inChannel,
   delete [] intChannel;
 }
 
+
+
+/**
+ * Same as quick_select, for any sample type.
+ *
+ * @param inArray the values.  Reordered.  Destroyed by caller.
+ * @param inLength the number of values.
+ *
+ * @return the median value.
+ */
+template <class T>
+inline T medianFilterQuickSelect( T *inArray, int inLength ) {
+  int low = 0;
+  int high = inLength - 1;
+  int median = ( low + high ) / 2;
+
+  T *a = inArray;
+  
+  for( ;; ) {
+    if( high <= low ) {
+      return a[median];
+    }
+    if( high == low + 1 ) {
+      if( a[low] > a[high] ) {
+        T t = a[low]; a[low] = a[high]; a[high] = t;
+      }
+      return a[median];
+    }
+
+    // median of low, middle and high into position low
+    int middle = ( low + high ) / 2;
+    T t;
+    if( a[middle] > a[high] ) {
+      t = a[middle]; a[middle] = a[high]; a[high] = t;
+    }
+    if( a[low] > a[high] ) {
+      t = a[low]; a[low] = a[high]; a[high] = t;
+    }
+    if( a[middle] > a[low] ) {
+      t = a[middle]; a[middle] = a[low]; a[low] = t;
+    }
+    t = a[middle]; a[middle] = a[low + 1]; a[low + 1] = t;
+
+    int ll = low + 1;
+    int hh = high;
+    for( ;; ) {
+      do ll++; while( a[low] > a[ll] );
+      do hh--; while( a[hh] > a[low] );
+      if( hh < ll ) {
+        break;
+      }
+      t = a[ll]; a[ll] = a[hh]; a[hh] = t;
+    }
+    t = a[low]; a[low] = a[hh]; a[hh] = t;
+
+    if( hh <= median ) {
+      low = ll;
+    }
+    if( hh >= median ) {
+      high = hh - 1;
+    }
+  }
+}
+
+
+
+template <class T>
+inline void MedianFilter::apply( PixelImage<T> *inImage, int inChannel ) {
+  
+  int start = inChannel;
+  int end = inChannel;
+  
+  if( inChannel == -1 ) {
+    start = 0;
+    end = inImage->getNumChannels() - 1;
+  }
+  
+  for( int c=start; c<=end; c++ ) {
+    applyToSamples( inImage->getChannel( c ), 
+                    inImage->getChannelStride(),
+                    inImage->getWidth(), inImage->getHeight() );
+  }
+}
+
+
+
+template <class T>
+inline void MedianFilter::applyToSamples( T *inChannel, int inStride,
+                                          int inWidth, int inHeight ) {
+
+  int numPixels = inWidth * inHeight;
+  
+  // packed copy of the source, so boxes read contiguous rows
+  T *source = new T[ numPixels ];
+  for( int p=0; p<numPixels; p++ ) {
+    source[p] = inChannel[ p * inStride ];
+  }
+
+  int boxWidth = 2 * mRadius + 1;
+  T *buffer = new T[ boxWidth * boxWidth ];
+  
+  for( int y=0; y<inHeight; y++ ) {
+    int startBoxY = y - mRadius;
+    int endBoxY = y + mRadius;
+    
+    if( startBoxY < 0 ) {
+      startBoxY = 0;
+    }
+    if( endBoxY >= inHeight ) {
+      endBoxY = inHeight - 1;
+    }
+    
+    for( int x=0; x<inWidth; x++ ) {
+      int startBoxX = x - mRadius;
+      int endBoxX = x + mRadius;
+      
+      if( startBoxX < 0 ) {
+        startBoxX = 0;
+      }
+      if( endBoxX >= inWidth ) {
+        endBoxX = inWidth - 1;
+      }
+      
+      int boxSizeX = endBoxX - startBoxX + 1;
+      int numInBox = 0;
+      
+      for( int boxY = startBoxY; boxY<=endBoxY; boxY++ ) {
+        memcpy( &( buffer[ numInBox ] ), 
+                &( source[ boxY * inWidth + startBoxX ] ),
+                boxSizeX * sizeof( T ) );
+        numInBox += boxSizeX;
+      }
+      
+      inChannel[ ( y * inWidth + x ) * inStride ] = 
+        medianFilterQuickSelect( buffer, numInBox );
+    }
+  }
+  
+  delete [] buffer;
+  delete [] source;
+}
+
+
+
+inline void MedianFilter::applyToSamples( unsigned char *inChannel, 
+                                          int inStride,
+                                          int inWidth, int inHeight ) {
+  applyHistogram( inChannel, inStride, inWidth, inHeight, 256 );
+}
+
+
+
+inline void MedianFilter::applyToSamples( unsigned short *inChannel, 
+                                          int inStride,
+                                          int inWidth, int inHeight ) {
+  applyHistogram( inChannel, inStride, inWidth, inHeight, 65536 );
+}
+
+
+
+template <class T>
+inline void MedianFilter::applyHistogram( T *inChannel, int inStride,
+                                          int inWidth, int inHeight, 
+                                          int inNumBins ) {
+  
+  // counts in the column histograms are 16-bit
+  if( 2 * mRadius + 1 >= 65536 && inHeight >= 65536 ) {
+    applyToSamples<T>( inChannel, inStride, inWidth, inHeight );
+    return;
+  }
+
+  int numPixels = inWidth * inHeight;
+  
+  unsigned short *bins = new unsigned short[ numPixels ];
+  for( int p=0; p<numPixels; p++ ) {
+    bins[p] = inChannel[ p * inStride ];
+  }
+  
+  unsigned short *medians = new unsigned short[ numPixels ];
+  
+  filterBins( bins, medians, inWidth, inHeight, inNumBins, mRadius );
+  
+  for( int p=0; p<numPixels; p++ ) {
+    inChannel[ p * inStride ] = (T)medians[p];
+  }
+
+  delete [] medians;
+  delete [] bins;
+}
+
+
+
+inline void MedianFilter::filterBins( unsigned short *inBins, 
+                                      unsigned short *outBins,
+                                      int inWidth, int inHeight, 
+                                      int inNumBins, int inRadius ) {
+  filterBinBand( inBins, outBins, inWidth, inHeight, inNumBins, inRadius,
+                 0, inHeight );
+}
+
+
+
+inline void MedianFilter::filterBinBand( unsigned short *inBins, 
+                                         unsigned short *outBins,
+                                         int inWidth, int inHeight, 
+                                         int inNumBins, int inRadius,
+                                         int inStartRow, int inEndRow ) {
+  
+  if( inStartRow >= inEndRow || inWidth == 0 ) {
+    return;
+  }
+
+  // split bins into coarse groups of fineSize fine bins, with about
+  // as many groups as bins per group
+  int fineBits = 0;
+  while( ( 1 << ( 2 * fineBits ) ) < inNumBins ) {
+    fineBits++;
+  }
+  int fineSize = 1 << fineBits;
+  int numCoarse = ( inNumBins + fineSize - 1 ) / fineSize;
+  int numFine = numCoarse * fineSize;
+  
+  
+  // cap fine histogram memory at about 4 MiB per band
+  int maxColumns = ( 4 << 20 ) / ( numFine * (int)sizeof( unsigned short ) );
+  int tileWidth = maxColumns - 2 * inRadius;
+  if( tileWidth < 16 ) {
+    tileWidth = 16;
+  }
+  if( tileWidth > inWidth ) {
+    tileWidth = inWidth;
+  }
+  
+  int maxHistColumns = tileWidth + 2 * inRadius;
+  if( maxHistColumns > inWidth ) {
+    maxHistColumns = inWidth;
+  }
+  
+  // column histograms
+  unsigned short *columnFine = 
+    new unsigned short[ maxHistColumns * numFine ];
+  unsigned short *columnCoarse = 
+    new unsigned short[ maxHistColumns * numCoarse ];
+  
+  // kernel histogram
+  unsigned int *kernelFine = new unsigned int[ numFine ];
+  unsigned int *kernelCoarse = new unsigned int[ numCoarse ];
+  
+  // range of columns summed into each coarse group's part of kernelFine,
+  // which is only brought up to date when that group holds a median
+  int *fineLeft = new int[ numCoarse ];
+  int *fineRight = new int[ numCoarse ];
+  
+  
+  for( int tileStart=0; tileStart<inWidth; tileStart += tileWidth ) {
+    int tileEnd = tileStart + tileWidth;
+    if( tileEnd > inWidth ) {
+      tileEnd = inWidth;
+    }
+    
+    int histStart = tileStart - inRadius;
+    if( histStart < 0 ) {
+      histStart = 0;
+    }
+    int histEnd = tileEnd + inRadius;
+    if( histEnd > inWidth ) {
+      histEnd = inWidth;
+    }
+    int numHistColumns = histEnd - histStart;
+
+    memset( columnFine, 0, 
+            numHistColumns * numFine * sizeof( unsigned short ) );
+    memset( columnCoarse, 0, 
+            numHistColumns * numCoarse * sizeof( unsigned short ) );
+    
+    // column histograms start out covering the first row's box
+    int rowStart = inStartRow - inRadius;
+    if( rowStart < 0 ) {
+      rowStart = 0;
+    }
+    int rowEnd = inStartRow + inRadius;
+    if( rowEnd >= inHeight ) {
+      rowEnd = inHeight - 1;
+    }
+    
+    for( int y=rowStart; y<=rowEnd; y++ ) {
+      unsigned short *row = &( inBins[ y * inWidth + histStart ] );
+      
+      for( int c=0; c<numHistColumns; c++ ) {
+        int bin = row[c];
+        columnFine[ c * numFine + bin ]++;
+        columnCoarse[ c * numCoarse + ( bin >> fineBits ) ]++;
+      }
+    }
+    
+    
+    for( int y=inStartRow; y<inEndRow; y++ ) {
+      
+      if( y > inStartRow ) {
+        // slide column histograms down one row
+        int leave = y - inRadius - 1;
+        int enter = y + inRadius;
+        
+        if( leave >= 0 ) {
+          unsigned short *row = &( inBins[ leave * inWidth + histStart ] );
+          
+          for( int c=0; c<numHistColumns; c++ ) {
+            int bin = row[c];
+            columnFine[ c * numFine + bin ]--;
+            columnCoarse[ c * numCoarse + ( bin >> fineBits ) ]--;
+          }
+          rowStart++;
+        }
+        if( enter < inHeight ) {
+          unsigned short *row = &( inBins[ enter * inWidth + histStart ] );
+          
+          for( int c=0; c<numHistColumns; c++ ) {
+            int bin = row[c];
+            columnFine[ c * numFine + bin ]++;
+            columnCoarse[ c * numCoarse + ( bin >> fineBits ) ]++;
+          }
+          rowEnd++;
+        }
+      }
+      
+      int boxHeight = rowEnd - rowStart + 1;
+      
+
+      // start the kernel at the first column of the tile
+      memset( kernelCoarse, 0, numCoarse * sizeof( unsigned int ) );
+      for( int g=0; g<numCoarse; g++ ) {
+        // empty
+        fineLeft[g] = 0;
+        fineRight[g] = -1;
+      }
+      
+      int left = tileStart - inRadius;
+      if( left < 0 ) {
+        left = 0;
+      }
+      int right = tileStart + inRadius;
+      if( right >= inWidth ) {
+        right = inWidth - 1;
+      }
+      
+      for( int x=left; x<=right; x++ ) {
+        unsigned short *coarse = 
+          &( columnCoarse[ ( x - histStart ) * numCoarse ] );
+        for( int g=0; g<numCoarse; g++ ) {
+          kernelCoarse[g] += coarse[g];
+        }
+      }
+      
+      unsigned short *outRow = &( outBins[ y * inWidth ] );
+      
+      for( int x=tileStart; x<tileEnd; x++ ) {
+        
+        if( x > tileStart ) {
+          // slide kernel right one column
+          int leave = x - inRadius - 1;
+          int enter = x + inRadius;
+          
+          if( leave >= 0 ) {
+            unsigned short *coarse = 
+              &( columnCoarse[ ( leave - histStart ) * numCoarse ] );
+            for( int g=0; g<numCoarse; g++ ) {
+              kernelCoarse[g] -= coarse[g];
+            }
+            left++;
+          }
+          if( enter < inWidth ) {
+            unsigned short *coarse = 
+              &( columnCoarse[ ( enter - histStart ) * numCoarse ] );
+            for( int g=0; g<numCoarse; g++ ) {
+              kernelCoarse[g] += coarse[g];
+            }
+            right++;
+          }
+        }
+        
+        // the lower median, as quick_select picks
+        unsigned int rank = 
+          ( (unsigned int)( boxHeight * ( right - left + 1 ) ) - 1 ) / 2;
+        
+        unsigned int total = 0;
+        int g = 0;
+        while( total + kernelCoarse[g] <= rank ) {
+          total += kernelCoarse[g];
+          g++;
+        }
+        
+        
+        // bring this group's fine counts up to date
+        unsigned int *fine = &( kernelFine[ g * fineSize ] );
+        
+        if( fineRight[g] < left || fineLeft[g] > right ) {
+          // nothing shared with the current kernel
+          memset( fine, 0, fineSize * sizeof( unsigned int ) );
+          fineLeft[g] = left;
+          fineRight[g] = left - 1;
+        }
+        else {
+          for( int c=fineLeft[g]; c<left; c++ ) {
+            unsigned short *column = 
+              &( columnFine[ ( c - histStart ) * numFine + g * fineSize ] );
+            for( int b=0; b<fineSize; b++ ) {
+              fine[b] -= column[b];
+            }
+          }
+          fineLeft[g] = left;
+        }
+        
+        for( int c=fineRight[g] + 1; c<=right; c++ ) {
+          unsigned short *column = 
+            &( columnFine[ ( c - histStart ) * numFine + g * fineSize ] );
+          for( int b=0; b<fineSize; b++ ) {
+            fine[b] += column[b];
+          }
+        }
+        fineRight[g] = right;
+        
+        
+        int b = 0;
+        while( total + fine[b] <= rank ) {
+          total += fine[b];
+          b++;
+        }
+        
+        outRow[x] = (unsigned short)( g * fineSize + b );
+      }
+    }
+  }
+  
+  delete [] fineRight;
+  delete [] fineLeft;
+  delete [] kernelCoarse;
+  delete [] kernelFine;
+  delete [] columnCoarse;
+  delete [] columnFine;
+}
+
 #endif
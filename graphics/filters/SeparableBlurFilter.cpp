@@ -0,0 +1,178 @@
+#include "SeparableBlurFilter.h"
+#include "BoxBlurFilter.h"
+
+#include "minorGems/system/ThreadPool.h"
+
+#include <math.h>
+
+
+
+SeparableBlurFilter::SeparableBlurFilter( int inRadius, 
+                                          int inNumThreads ) 
+        : mPool( NULL ), mNumBands( 1 ) {
+    
+    if( inNumThreads == -1 ) {
+        inNumThreads = ThreadPool::getNumProcessors();
+        }
+    
+    if( inNumThreads > 1 ) {
+        mPool = new ThreadPool( inNumThreads );
+        mNumBands = inNumThreads;
+        }
+    
+    setBoxRadius( inRadius );
+    }
+
+
+
+SeparableBlurFilter::~SeparableBlurFilter() {
+    if( mPool != NULL ) {
+        delete mPool;
+        }
+    }
+
+
+
+void SeparableBlurFilter::setBoxRadius( int inRadius ) {
+    mPassRadii.deleteAll();
+    mPassRadii.push_back( inRadius );
+    }
+
+
+
+void SeparableBlurFilter::setGaussianSigma( double inSigma ) {
+    int radii[3];
+    getGaussianRadii( inSigma, 3, radii );
+    
+    mPassRadii.deleteAll();
+    mPassRadii.appendArray( radii, 3 );
+    }
+
+
+
+SimpleVector<int> *SeparableBlurFilter::getPassRadii() {
+    return &mPassRadii;
+    }
+
+
+
+void SeparableBlurFilter::getGaussianRadii( double inSigma, int inNumPasses,
+                                            int *outRadii ) {
+    
+    double variance = 12 * inSigma * inSigma;
+    
+    // ideal box width if all passes used the same width
+    double idealWidth = sqrt( variance / inNumPasses + 1 );
+    
+    // odd widths just below and above the ideal
+    int lowerWidth = (int)floor( idealWidth );
+    if( lowerWidth % 2 == 0 ) {
+        lowerWidth--;
+        }
+    int upperWidth = lowerWidth + 2;
+    
+    // how many passes use the lower width so that the variances add up
+    int numLower = (int)lrint( 
+        ( variance 
+          - inNumPasses * lowerWidth * lowerWidth
+          - 4 * inNumPasses * lowerWidth 
+          - 3 * inNumPasses ) 
+        / ( -4 * lowerWidth - 4 ) );
+    
+    for( int i=0; i<inNumPasses; i++ ) {
+        int width = upperWidth;
+        if( i < numLower ) {
+            width = lowerWidth;
+            }
+        outRadii[i] = ( width - 1 ) / 2;
+        }
+    }
+
+
+
+typedef struct SeparableBlurBand {
+        double *source;
+        double *dest;
+        int width;
+        int height;
+        
+        // rows for a row pass, columns for a column pass
+        int start;
+        int end;
+        
+        int radius;
+        char columns;
+    } SeparableBlurBand;
+
+
+
+static void blurBand( void *inBand ) {
+    SeparableBlurBand *band = (SeparableBlurBand *)inBand;
+    
+    if( band->columns ) {
+        BoxBlurFilter::blurColumns( band->source, band->dest, 
+                                    band->width, band->height,
+                                    band->start, band->end, band->radius );
+        }
+    else {
+        BoxBlurFilter::blurRows( band->source, band->dest, band->width,
+                                 band->start, band->end, band->radius );
+        }
+    }
+
+
+
+void SeparableBlurFilter::apply( double *inChannel, 
+                                 int inWidth, int inHeight ) {
+
+    double *rowAverages = new double[ inWidth * inHeight ];
+    
+    SeparableBlurBand *bands = new SeparableBlurBand[ mNumBands ];
+    
+    for( int p=0; p<mPassRadii.size(); p++ ) {
+        int radius = mPassRadii.getElementDirect( p );
+        
+        for( int pass=0; pass<2; pass++ ) {
+            char columns = ( pass == 1 );
+            
+            int length = inHeight;
+            if( columns ) {
+                length = inWidth;
+                }
+            
+            for( int b=0; b<mNumBands; b++ ) {
+                SeparableBlurBand *band = &( bands[b] );
+                
+                if( columns ) {
+                    band->source = rowAverages;
+                    band->dest = inChannel;
+                    }
+                else {
+                    band->source = inChannel;
+                    band->dest = rowAverages;
+                    }
+                band->width = inWidth;
+                band->height = inHeight;
+                band->start = ( length * b ) / mNumBands;
+                band->end = ( length * ( b + 1 ) ) / mNumBands;
+                band->radius = radius;
+                band->columns = columns;
+                }
+
+            if( mPool == NULL ) {
+                blurBand( &( bands[0] ) );
+                }
+            else {
+                for( int b=0; b<mNumBands; b++ ) {
+                    if( bands[b].end > bands[b].start ) {
+                        mPool->addJob( blurBand, &( bands[b] ) );
+                        }
+                    }
+                mPool->waitForAllJobs();
+                }
+            }
+        }
+    
+    delete [] bands;
+    delete [] rowAverages;
+    }
@@ -0,0 +1,97 @@
+#ifndef SEPARABLE_BLUR_FILTER_INCLUDED
+#define SEPARABLE_BLUR_FILTER_INCLUDED
+ 
+#include "minorGems/graphics/ChannelFilter.h" 
+#include "minorGems/util/SimpleVector.h"
+
+
+class ThreadPool;
+
+
+ 
+/**
+ * Blur filter that runs one or more box passes, each split into a row
+ * pass and a column pass.  Each pass costs the same per pixel for any
+ * radius (see BoxBlurFilter::blurRows).
+ *
+ * One pass is a plain box blur.  Three passes of the right sizes
+ * approximate a Gaussian blur closely.
+ *
+ * With more than one thread, each row pass and column pass is split into
+ * bands that are blurred in parallel.
+ *
+ * @author Jason Rohrer 
+ */
+class SeparableBlurFilter : public ChannelFilter { 
+    
+    public:
+        
+        /**
+         * Constructs a filter that runs a single box pass.
+         *
+         * @param inRadius the radius of the box in pixels.
+         * @param inNumThreads the number of threads to blur with, or -1
+         *   for one per processor.  Defaults to 1.
+         */
+        SeparableBlurFilter( int inRadius, int inNumThreads = 1 );
+        
+        ~SeparableBlurFilter();
+        
+
+        /**
+         * Switches to a single box pass.
+         *
+         * @param inRadius the radius of the box in pixels.
+         */
+        void setBoxRadius( int inRadius );
+        
+
+        /**
+         * Switches to three box passes that approximate a Gaussian.
+         *
+         * @param inSigma the standard deviation of the Gaussian in pixels.
+         */
+        void setGaussianSigma( double inSigma );
+        
+
+        /**
+         * Gets the box radius of each pass.
+         *
+         * @return the radii.  Destroyed when this filter is destroyed or
+         *   its passes change.
+         */
+        SimpleVector<int> *getPassRadii();
+        
+
+        /**
+         * Computes the box radii for passes that approximate a Gaussian.
+         *
+         * Uses box widths that bracket the ideal width, as described
+         * by Peter Kovesi in "Fast Almost-Gaussian Filtering".
+         *
+         * @param inSigma the standard deviation of the Gaussian.
+         * @param inNumPasses the number of passes.
+         * @param outRadii array of inNumPasses radii to fill.  Destroyed
+         *   by caller.
+         */
+        static void getGaussianRadii( double inSigma, int inNumPasses,
+                                      int *outRadii );
+        
+        
+        // implements the ChannelFilter interface
+        void apply( double *inChannel, int inWidth, int inHeight );
+        
+
+    protected:
+        
+        SimpleVector<int> mPassRadii;
+        
+        // NULL for one thread
+        ThreadPool *mPool;
+        
+        int mNumBands;
+        
+    };
+        
+    
+#endif
@@ -0,0 +1,88 @@
+#include "ThreadedMedianFilter.h"
+
+#include "minorGems/system/ThreadPool.h"
+
+
+
+ThreadedMedianFilter::ThreadedMedianFilter( int inRadius, 
+                                            int inNumThreads ) 
+        : MedianFilter( inRadius ), mPool( NULL ), mNumBands( 1 ) {
+    
+    if( inNumThreads == -1 ) {
+        inNumThreads = ThreadPool::getNumProcessors();
+        }
+    
+    if( inNumThreads > 1 ) {
+        mPool = new ThreadPool( inNumThreads );
+        mNumBands = inNumThreads;
+        }
+    }
+
+
+
+ThreadedMedianFilter::~ThreadedMedianFilter() {
+    if( mPool != NULL ) {
+        delete mPool;
+        }
+    }
+
+
+
+typedef struct MedianBand {
+        unsigned short *inBins;
+        unsigned short *outBins;
+        int width;
+        int height;
+        int numBins;
+        int radius;
+        int startRow;
+        int endRow;
+    } MedianBand;
+
+
+
+static void filterBand( void *inBand ) {
+    MedianBand *band = (MedianBand *)inBand;
+    
+    MedianFilter::filterBinBand( band->inBins, band->outBins, 
+                                 band->width, band->height, band->numBins,
+                                 band->radius, 
+                                 band->startRow, band->endRow );
+    }
+
+
+
+void ThreadedMedianFilter::filterBins( unsigned short *inBins, 
+                                       unsigned short *outBins,
+                                       int inWidth, int inHeight, 
+                                       int inNumBins, int inRadius ) {
+    
+    if( mPool == NULL ) {
+        MedianFilter::filterBins( inBins, outBins, inWidth, inHeight,
+                                  inNumBins, inRadius );
+        return;
+        }
+    
+    MedianBand *bands = new MedianBand[ mNumBands ];
+    
+    for( int b=0; b<mNumBands; b++ ) {
+        MedianBand *band = &( bands[b] );
+        
+        band->inBins = inBins;
+        band->outBins = outBins;
+        band->width = inWidth;
+        band->height = inHeight;
+        band->numBins = inNumBins;
+        band->radius = inRadius;
+        band->startRow = ( inHeight * b ) / mNumBands;
+        band->endRow = ( inHeight * ( b + 1 ) ) / mNumBands;
+        
+        if( band->endRow > band->startRow ) {
+            mPool->addJob( filterBand, band );
+            }
+        }
+    
+    mPool->waitForAllJobs();
+    
+    delete [] bands;
+    }
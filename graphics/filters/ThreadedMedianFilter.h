@@ -0,0 +1,53 @@
+#ifndef THREADED_MEDIAN_FILTER_INCLUDED
+#define THREADED_MEDIAN_FILTER_INCLUDED
+ 
+#include "MedianFilter.h"
+
+
+class ThreadPool;
+
+
+ 
+/**
+ * Median filter that splits each channel into bands of rows that are
+ * filtered in parallel.
+ *
+ * Each band builds its own column histograms, which costs about one
+ * box height of extra rows per band.
+ *
+ * @author Jason Rohrer 
+ */
+class ThreadedMedianFilter : public MedianFilter { 
+    
+    public:
+        
+        /**
+         * Constructs a filter.
+         *
+         * @param inRadius the radius of the box in pixels.
+         * @param inNumThreads the number of threads to filter with, or 
+         *   -1 for one per processor.  Defaults to -1.
+         */
+        ThreadedMedianFilter( int inRadius, int inNumThreads = -1 );
+        
+        ~ThreadedMedianFilter();
+        
+
+    protected:
+        
+        // NULL for one thread
+        ThreadPool *mPool;
+        
+        int mNumBands;
+        
+
+        // overrides MedianFilter
+        virtual void filterBins( unsigned short *inBins, 
+                                 unsigned short *outBins,
+                                 int inWidth, int inHeight, int inNumBins,
+                                 int inRadius );
+        
+    };
+        
+    
+#endif
@@ -4,9 +4,9 @@
  *  Cambridge University Press, 1992, Section 8.5, ISBN 0-521-43108-5
  */ 
 
-#define ELEM_SWAP(a,b) { register int t=(a);(a)=(b);(b)=t; }
+#define ELEM_SWAP(a,b) { int t=(a);(a)=(b);(b)=t; }
 
-int quick_select(int arr[], int n)
+inline int quick_select(int arr[], int n)
 {
     int low, high;
     int median;
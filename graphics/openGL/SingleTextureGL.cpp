@@ -78,6 +78,9 @@ void SingleTextureGL::reloadFromBackup() {
                     error, glGetString( error ) );
             }
         
+        // new texture starts with default filters
+        mLastSetMinFilter = -1;
+        mLastSetMagFilter = -1;
         
         setTextureData( mBackupBytes, mAlphaOnly, 
                         mWidthBackup, mHeightBackup, 
@@ -94,6 +97,8 @@ SingleTextureGL::SingleTextureGL( Image *inImage, char inRepeat,
     : mRepeat( inRepeat ), 
       mMipMap( inMipMap ),
       mAlphaOnly( false ),
+      mLastSetMinFilter( -1 ),
+      mLastSetMagFilter( -1 ),
       mBackupBytes( NULL ) {
 
     glGenTextures( 1, &mTextureID );
@@ -119,6 +124,8 @@ SingleTextureGL::SingleTextureGL( unsigned char *inRGBA,
     : mRepeat( inRepeat ),
       mMipMap( inMipMap ),
       mAlphaOnly( false ),
+      mLastSetMinFilter( -1 ),
+      mLastSetMagFilter( -1 ),
       mBackupBytes( NULL ) {
 
     glGenTextures( 1, &mTextureID );
@@ -144,6 +151,8 @@ SingleTextureGL::SingleTextureGL( char inAlphaOnly,
     : mRepeat( inRepeat ),
       mMipMap( inMipMap ),
       mAlphaOnly( true ),
+      mLastSetMinFilter( -1 ),
+      mLastSetMagFilter( -1 ),
       mBackupBytes( NULL ) {
 
     glGenTextures( 1, &mTextureID );
@@ -228,151 +237,158 @@ void SingleTextureGL::replaceBackupData( unsigned char *inBytes,
 
 
 
-void SingleTextureGL::setTextureData( unsigned char *inBytes,
-                                      char inAlphaOnly,
-                                      unsigned int inWidth, 
-                                      unsigned int inHeight,
-                                      char inExpandEdge ) {
+void SingleTextureGL::expandEdges( unsigned char *inBytes,
+                                   unsigned int inWidth, 
+                                   unsigned int inHeight ) {
     
-    if( inExpandEdge && !inAlphaOnly ) {
-        
-        unsigned int maxY = 0;
-        unsigned int minY = inHeight - 1;
-        
-        unsigned int maxX = 0;
-        unsigned int minX = inWidth - 1;
-        
-        int aIndex = 3;
-        for( unsigned int y=0; y<inHeight; y++ ) {
-            for( unsigned int x=0; x<inWidth; x++ ) {
-                
-                if( inBytes[ aIndex ] > 0 ) {    
-                    if( x > maxX ) {
-                        maxX = x;
-                        }
-                    if( x < minX ) {
-                        minX = x;
-                        }
-                    if( y > maxY ) {
-                        maxY = y;
-                        }
-                    if( y < minY ) {
-                        minY = y;
-                        }
+    unsigned int maxY = 0;
+    unsigned int minY = inHeight - 1;
+    
+    unsigned int maxX = 0;
+    unsigned int minX = inWidth - 1;
+    
+    int aIndex = 3;
+    for( unsigned int y=0; y<inHeight; y++ ) {
+        for( unsigned int x=0; x<inWidth; x++ ) {
+            
+            if( inBytes[ aIndex ] > 0 ) {    
+                if( x > maxX ) {
+                    maxX = x;
+                    }
+                if( x < minX ) {
+                    minX = x;
+                    }
+                if( y > maxY ) {
+                    maxY = y;
+                    }
+                if( y < minY ) {
+                    minY = y;
                     }
-
-                aIndex += 4;
                 }
+
+            aIndex += 4;
             }
+        }
 
-        if( minY < maxY &&
-            minX < maxX &&
-            minY > 0 &&
-            maxY < inHeight - 1 &&  
-            minX > 0 &&
-            maxX < inWidth - 1 ) {
+    if( minY < maxY &&
+        minX < maxX &&
+        minY > 0 &&
+        maxY < inHeight - 1 &&  
+        minX > 0 &&
+        maxX < inWidth - 1 ) {
 
-            // found edges away from image edge
+        // found edges away from image edge
 
-            // duplicate them
-            
-            // row edges
+        // duplicate them
+        
+        // row edges
 
-            int rowBytes = inWidth * 4;
+        int rowBytes = inWidth * 4;
 
-            int rowStart = minY * rowBytes;
-            int rowDestStart = rowStart - rowBytes;
+        int rowStart = minY * rowBytes;
+        int rowDestStart = rowStart - rowBytes;
 
-            // don't duplicate row unless it has some fully-opaque
-            // pixels in it (it's something of a hard edge)
-            // thus, we don't accidentally expand the soft edges
-            // of feathered sprites, fonts, etc
-            char solidPresent = false;
-            
-            for( int i=rowStart + 3; i<rowStart + rowBytes; i+=4 ) {
-                if( inBytes[i] == 255 ) {
-                    solidPresent = true;
-                    break;
-                    }
+        // don't duplicate row unless it has some fully-opaque
+        // pixels in it (it's something of a hard edge)
+        // thus, we don't accidentally expand the soft edges
+        // of feathered sprites, fonts, etc
+        char solidPresent = false;
+        
+        for( int i=rowStart + 3; i<rowStart + rowBytes; i+=4 ) {
+            if( inBytes[i] == 255 ) {
+                solidPresent = true;
+                break;
                 }
+            }
 
-            if( solidPresent ) {
-                memcpy( &( inBytes[ rowDestStart ] ), 
-                        &( inBytes[ rowStart ] ), 
-                        inWidth * 4 );
-                }
-            
-            rowStart = maxY * inWidth * 4;
-            rowDestStart = rowStart + inWidth * 4;
+        if( solidPresent ) {
+            memcpy( &( inBytes[ rowDestStart ] ), 
+                    &( inBytes[ rowStart ] ), 
+                    inWidth * 4 );
+            }
+        
+        rowStart = maxY * inWidth * 4;
+        rowDestStart = rowStart + inWidth * 4;
 
-            solidPresent = false;
+        solidPresent = false;
 
-            for( int i=rowStart + 3; i<rowStart + rowBytes; i+=4 ) {
-                if( inBytes[i] == 255 ) {
-                    solidPresent = true;
-                    break;
-                    }
+        for( int i=rowStart + 3; i<rowStart + rowBytes; i+=4 ) {
+            if( inBytes[i] == 255 ) {
+                solidPresent = true;
+                break;
                 }
+            }
 
-            if( solidPresent ) {
-                memcpy( &( inBytes[ rowDestStart ] ), 
-                        &( inBytes[ rowStart ] ), 
-                        inWidth * 4 );
-                }
-            
+        if( solidPresent ) {
+            memcpy( &( inBytes[ rowDestStart ] ), 
+                    &( inBytes[ rowStart ] ), 
+                    inWidth * 4 );
+            }
+        
 
-            // now column edges
+        // now column edges
 
-            char solidPresentLeft = false;
-            char solidPresentRight = false;
-            
-            for( unsigned int y=minY; y<=maxY; y++ ) {
+        char solidPresentLeft = false;
+        char solidPresentRight = false;
+        
+        for( unsigned int y=minY; y<=maxY; y++ ) {
 
-                int iL = (y * inWidth + minX) * 4;
+            int iL = (y * inWidth + minX) * 4;
 
-                if( inBytes[ iL + 3 ] == 255 ) {
-                    solidPresentLeft = true;
-                    break;
-                    }
+            if( inBytes[ iL + 3 ] == 255 ) {
+                solidPresentLeft = true;
+                break;
                 }
-            
-            for( unsigned int y=minY; y<=maxY; y++ ) {
+            }
+        
+        for( unsigned int y=minY; y<=maxY; y++ ) {
 
-                int iR = (y * inWidth + maxX) * 4;
+            int iR = (y * inWidth + maxX) * 4;
 
-                if( inBytes[ iR + 3 ] == 255 ) {
-                    solidPresentRight = true;
-                    break;
-                    }
+            if( inBytes[ iR + 3 ] == 255 ) {
+                solidPresentRight = true;
+                break;
                 }
-            
+            }
+        
 
-            if( solidPresentLeft ) {    
-                for( unsigned int y=minY; y<=maxY; y++ ) {
-                    int iL = (y * inWidth + minX) * 4;
-                    
-                    inBytes[iL - 4] = inBytes[ iL ];
-                    inBytes[iL - 3] = inBytes[ iL + 1 ];
-                    inBytes[iL - 2] = inBytes[ iL + 2 ];
-                    inBytes[iL - 1] = inBytes[ iL + 3 ];
-                    }
+        if( solidPresentLeft ) {    
+            for( unsigned int y=minY; y<=maxY; y++ ) {
+                int iL = (y * inWidth + minX) * 4;
+                
+                inBytes[iL - 4] = inBytes[ iL ];
+                inBytes[iL - 3] = inBytes[ iL + 1 ];
+                inBytes[iL - 2] = inBytes[ iL + 2 ];
+                inBytes[iL - 1] = inBytes[ iL + 3 ];
                 }
+            }
+        
             
-                
 
-            if( solidPresentRight ) {
-                for( unsigned int y=minY; y<=maxY; y++ ) {
-                    int iR = (y * inWidth + maxX) * 4;
-                    inBytes[iR + 4] = inBytes[ iR ];
-                    inBytes[iR + 5] = inBytes[ iR + 1 ];
-                    inBytes[iR + 6] = inBytes[ iR + 2 ];
-                    inBytes[iR + 7] = inBytes[ iR + 3 ];
-                    }
+        if( solidPresentRight ) {
+            for( unsigned int y=minY; y<=maxY; y++ ) {
+                int iR = (y * inWidth + maxX) * 4;
+                inBytes[iR + 4] = inBytes[ iR ];
+                inBytes[iR + 5] = inBytes[ iR + 1 ];
+                inBytes[iR + 6] = inBytes[ iR + 2 ];
+                inBytes[iR + 7] = inBytes[ iR + 3 ];
                 }
-            
             }
         
         }
+    }
+
+
+
+void SingleTextureGL::setTextureData( unsigned char *inBytes,
+                                      char inAlphaOnly,
+                                      unsigned int inWidth, 
+                                      unsigned int inHeight,
+                                      char inExpandEdge ) {
+    
+    if( inExpandEdge && !inAlphaOnly ) {
+        expandEdges( inBytes, inWidth, inHeight );
+        }
     
 
     replaceBackupData( inBytes, inAlphaOnly, inWidth, inHeight );
@@ -391,6 +407,8 @@ void SingleTextureGL::setTextureData( unsigned char *inBytes,
     
 
 	glBindTexture( GL_TEXTURE_2D, mTextureID );
+    // keep enable() from skipping the next bind of another texture
+    sLastBoundTextureID = mTextureID;
 
     error = glGetError();
 	if( error != GL_NO_ERROR ) {		// error
@@ -466,6 +484,7 @@ void SingleTextureGL::replaceTextureData( unsigned char *inBytes,
 
 
     glBindTexture( GL_TEXTURE_2D, mTextureID );
+    sLastBoundTextureID = mTextureID;
     
     error = glGetError();
 	if( error != GL_NO_ERROR ) {		// error
@@ -494,3 +513,40 @@ void SingleTextureGL::replaceTextureData( unsigned char *inBytes,
     }
 
         
+
+
+
+void SingleTextureGL::replaceTextureRegion( unsigned char *inRGBA,
+                                            unsigned int inX, 
+                                            unsigned int inY,
+                                            unsigned int inWidth, 
+                                            unsigned int inHeight ) {
+
+    // keep backup current for context changes
+    if( mBackupBytes != NULL && ! mAlphaOnly ) {
+        for( unsigned int y=0; y<inHeight; y++ ) {
+            memcpy( &( mBackupBytes[ ( ( inY + y ) * mWidthBackup + inX ) 
+                                     * 4 ] ),
+                    &( inRGBA[ y * inWidth * 4 ] ),
+                    inWidth * 4 );
+            }
+        }
+
+
+    glBindTexture( GL_TEXTURE_2D, mTextureID );
+    sLastBoundTextureID = mTextureID;
+
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    
+    glTexSubImage2D( GL_TEXTURE_2D, 0,
+                     inX, inY,
+                     inWidth, inHeight, 
+                     GL_RGBA,
+                     GL_UNSIGNED_BYTE, inRGBA );
+
+	int error = glGetError();
+	if( error != GL_NO_ERROR ) {		// error
+		printf( "Error replacing texture region for id %d, error = %d\n",
+                (int)mTextureID, error );
+		}
+    }
@@ -124,6 +124,19 @@ class SingleTextureGL {
                                  char inAlphaOnly,
                                  unsigned int inWidth, 
                                  unsigned int inHeight );
+
+
+        /**
+         * Replaces a rectangular region of an RGBA texture, leaving the
+         * rest of it alone.
+         *
+         * inRGBA holds inWidth x inHeight pixels.  Region must lie inside
+         * the texture.
+         */
+        void replaceTextureRegion( unsigned char *inRGBA,
+                                   unsigned int inX, unsigned int inY,
+                                   unsigned int inWidth, 
+                                   unsigned int inHeight );
         
 
 		
@@ -163,6 +176,15 @@ class SingleTextureGL {
                              unsigned int inHeight,
                              char inExpandEdge = false );        
 
+
+        /**
+         * Repeats the edges of the non-transparent area of RGBA data out
+         * by one row/column, as described for setTextureData.
+         */
+        static void expandEdges( unsigned char *inRGBA,
+                                 unsigned int inWidth, 
+                                 unsigned int inHeight );
+
 		
 		/**
 		 * Enables this texture.
@@ -170,6 +192,19 @@ class SingleTextureGL {
 		void enable();	
 
 
+        /**
+         * Sets min and mag filters for this texture, skipping GL calls
+         * if they're already set.
+         *
+         * Texture must be enabled.
+         *
+         * @param inLinearMagFilter true for linear filtering, false for
+         *   nearest-neighbor.
+         * @param inMipMapFilter true to use mipmaps for minification.
+         */
+        void setFiltering( char inLinearMagFilter, char inMipMapFilter );
+
+
         // tell all textures about a GL context change so they can reload
         // int texture memory
         static void contextChanged();
@@ -191,6 +226,12 @@ class SingleTextureGL {
         
         char mAlphaOnly;
 
+        // -1 for unset, 0 for nearest, 1 for linear, 2 for mipmap
+        int mLastSetMinFilter;
+        
+        // -1 for unset, 0 for nearest, 1 for linear
+        int mLastSetMagFilter;
+
         // in case of context switch where we need to reload our texture
         // backup bytes might contain either RGBA or A only bytes
         unsigned char *mBackupBytes;
@@ -240,6 +281,50 @@ inline void SingleTextureGL::enable() {
         }
     
 	}
+
+
+
+inline void SingleTextureGL::setFiltering( char inLinearMagFilter,
+                                           char inMipMapFilter ) {
+    
+    if( inMipMapFilter ) {
+        if( mLastSetMinFilter != 2 ) {
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
+                             GL_LINEAR_MIPMAP_LINEAR );
+            mLastSetMinFilter = 2;
+            }
+        }
+    else {
+        
+        if( inLinearMagFilter ) {
+            if( mLastSetMinFilter != 1 ) {
+                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
+                                 GL_LINEAR );
+                mLastSetMinFilter = 1;
+                }
+            }
+        else {
+            if( mLastSetMinFilter != 0 ) {
+                glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
+                                 GL_NEAREST );
+                mLastSetMinFilter = 0;
+                }
+            }
+        }
+    
+    if( inLinearMagFilter ) {
+        if( mLastSetMagFilter != 1 ) {
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+            mLastSetMagFilter = 1;
+            }
+        }
+    else {
+        if( mLastSetMagFilter != 0 ) {
+            glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+            mLastSetMagFilter = 0;
+            }
+        }
+    }
 	
 	
 	
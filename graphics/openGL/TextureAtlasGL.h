@@ -0,0 +1,228 @@
+#ifndef TEXTURE_ATLAS_GL_INCLUDED
+#define TEXTURE_ATLAS_GL_INCLUDED
+
+
+#include "SingleTextureGL.h"
+
+#include "minorGems/graphics/SkylinePacker.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include <string.h>
+
+
+
+// where a packed image ended up
+typedef struct TextureAtlasRegion {
+        SingleTextureGL *texture;
+
+        int page;
+
+        // maps the image's own 0..1 texture coordinates into the page
+        // u = uOffset + uImage * uScale
+        double uOffset, vOffset;
+        double uScale, vScale;
+    } TextureAtlasRegion;
+
+
+
+/**
+ * Packs many small RGBA images into a few large shared textures (pages),
+ * so that drawing different images doesn't require binding different
+ * textures.
+ *
+ * Each image is surrounded by a one-pixel border that repeats its edge
+ * pixels, so that linear filtering at its edges gives the same result as
+ * GL_CLAMP_TO_EDGE on a texture of its own.  Pages have no mipmaps.
+ *
+ * Regions can't be reused individually:  a page is emptied for reuse
+ * once all of its regions have been released.
+ *
+ * Like SingleTextureGL, can only be used after a GL context has been set up.
+ *
+ * @author Jason Rohrer
+ */
+class TextureAtlasGL {
+
+    public:
+
+        // inPageSize is clamped to GL_MAX_TEXTURE_SIZE
+        // images larger than inMaxImageSize in either dimension are
+        // rejected, since they'd waste page space better left to small ones
+        TextureAtlasGL( int inPageSize = 1024, int inMaxImageSize = 256 );
+
+        ~TextureAtlasGL();
+
+
+        // packs RGBA pixels, opening a new page if needed
+        // returns false if image is too large
+        char addImage( unsigned char *inRGBA, int inWidth, int inHeight,
+                       TextureAtlasRegion *outRegion );
+
+
+        // releases a region returned by addImage
+        void releaseRegion( TextureAtlasRegion *inRegion );
+
+
+        int getNumPages() {
+            return mPages.size();
+            }
+
+        int getPageSize() {
+            return mPageSize;
+            }
+
+
+    protected:
+
+        typedef struct AtlasPage {
+                SingleTextureGL *texture;
+                SkylinePacker *packer;
+                int numRegions;
+            } AtlasPage;
+
+        int mPageSize;
+        int mMaxImageSize;
+
+        SimpleVector<AtlasPage> mPages;
+
+
+        // copies inRGBA into a buffer with a one-pixel repeated border
+        static unsigned char *addBorder( unsigned char *inRGBA,
+                                         int inWidth, int inHeight );
+
+    };
+
+
+
+inline TextureAtlasGL::TextureAtlasGL( int inPageSize, int inMaxImageSize )
+        : mPageSize( inPageSize ), mMaxImageSize( inMaxImageSize ) {
+
+    GLint maxSize = 0;
+    glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxSize );
+
+    if( maxSize > 0 && mPageSize > maxSize ) {
+        mPageSize = maxSize;
+        }
+    if( mMaxImageSize > mPageSize - 2 ) {
+        mMaxImageSize = mPageSize - 2;
+        }
+    }
+
+
+
+inline TextureAtlasGL::~TextureAtlasGL() {
+    for( int i=0; i<mPages.size(); i++ ) {
+        AtlasPage *p = mPages.getElement( i );
+        delete p->texture;
+        delete p->packer;
+        }
+    }
+
+
+
+inline unsigned char *TextureAtlasGL::addBorder( unsigned char *inRGBA,
+                                                 int inWidth,
+                                                 int inHeight ) {
+    int w = inWidth + 2;
+    int h = inHeight + 2;
+
+    unsigned char *bordered = new unsigned char[ w * h * 4 ];
+
+    for( int y=0; y<h; y++ ) {
+        int srcY = y - 1;
+        if( srcY < 0 ) {
+            srcY = 0;
+            }
+        if( srcY >= inHeight ) {
+            srcY = inHeight - 1;
+            }
+
+        unsigned char *srcRow = &( inRGBA[ srcY * inWidth * 4 ] );
+        unsigned char *destRow = &( bordered[ y * w * 4 ] );
+
+        memcpy( destRow, srcRow, 4 );
+        memcpy( &( destRow[4] ), srcRow, inWidth * 4 );
+        memcpy( &( destRow[ ( w - 1 ) * 4 ] ),
+                &( srcRow[ ( inWidth - 1 ) * 4 ] ), 4 );
+        }
+
+    return bordered;
+    }
+
+
+
+inline char TextureAtlasGL::addImage( unsigned char *inRGBA,
+                                      int inWidth, int inHeight,
+                                      TextureAtlasRegion *outRegion ) {
+    if( inWidth <= 0 || inHeight <= 0 ||
+        inWidth > mMaxImageSize || inHeight > mMaxImageSize ) {
+        return false;
+        }
+
+    int w = inWidth + 2;
+    int h = inHeight + 2;
+
+    int x = 0;
+    int y = 0;
+    int pageIndex = -1;
+
+    for( int i=0; i<mPages.size(); i++ ) {
+        if( mPages.getElement( i )->packer->pack( w, h, &x, &y ) ) {
+            pageIndex = i;
+            break;
+            }
+        }
+
+    if( pageIndex == -1 ) {
+        unsigned char *empty =
+            new unsigned char[ mPageSize * mPageSize * 4 ];
+        memset( empty, 0, mPageSize * mPageSize * 4 );
+
+        AtlasPage p;
+        p.texture = new SingleTextureGL( empty, mPageSize, mPageSize,
+                                         // no wrap, no mipmaps
+                                         false, false );
+        p.packer = new SkylinePacker( mPageSize, mPageSize );
+        p.numRegions = 0;
+
+        delete [] empty;
+
+        p.packer->pack( w, h, &x, &y );
+
+        mPages.push_back( p );
+        pageIndex = mPages.size() - 1;
+        }
+
+    AtlasPage *page = mPages.getElement( pageIndex );
+    page->numRegions++;
+
+    unsigned char *bordered = addBorder( inRGBA, inWidth, inHeight );
+    page->texture->replaceTextureRegion( bordered, x, y, w, h );
+    delete [] bordered;
+
+    outRegion->texture = page->texture;
+    outRegion->page = pageIndex;
+    outRegion->uOffset = ( x + 1 ) / (double)mPageSize;
+    outRegion->vOffset = ( y + 1 ) / (double)mPageSize;
+    outRegion->uScale = inWidth / (double)mPageSize;
+    outRegion->vScale = inHeight / (double)mPageSize;
+
+    return true;
+    }
+
+
+
+inline void TextureAtlasGL::releaseRegion( TextureAtlasRegion *inRegion ) {
+    AtlasPage *page = mPages.getElement( inRegion->page );
+
+    page->numRegions--;
+
+    if( page->numRegions == 0 ) {
+        // old pixels stay in the texture until they're overwritten
+        page->packer->reset();
+        }
+    }
+
+
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Checks the separable box blurs against a direct box average, then times
+ * them over a range of radii.
+ */
+
+
+#include "minorGems/graphics/filters/BoxBlurFilter.h"
+#include "minorGems/graphics/filters/FastBlurFilter.h"
+#include "minorGems/graphics/filters/SeparableBlurFilter.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/system/ThreadPool.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+static double *makeChannel( int inWidth, int inHeight ) {
+    double *channel = new double[ inWidth * inHeight ];
+    for( int i=0; i<inWidth * inHeight; i++ ) {
+        channel[i] = rand() / (double)RAND_MAX;
+        }
+    return channel;
+    }
+
+
+
+// averages the in-bounds part of each box directly
+static double *directBoxBlur( double *inChannel, int inWidth, int inHeight,
+                              int inRadius ) {
+    double *result = new double[ inWidth * inHeight ];
+    
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            double total = 0;
+            int count = 0;
+            
+            for( int by=y-inRadius; by<=y+inRadius; by++ ) {
+                for( int bx=x-inRadius; bx<=x+inRadius; bx++ ) {
+                    if( by >= 0 && by < inHeight && 
+                        bx >= 0 && bx < inWidth ) {
+                        total += inChannel[ by * inWidth + bx ];
+                        count++;
+                        }
+                    }
+                }
+            result[ y * inWidth + x ] = total / count;
+            }
+        }
+    return result;
+    }
+
+
+
+static double maxDifference( double *inA, double *inB, int inLength ) {
+    double maxDiff = 0;
+    for( int i=0; i<inLength; i++ ) {
+        double diff = fabs( inA[i] - inB[i] );
+        if( diff > maxDiff ) {
+            maxDiff = diff;
+            }
+        }
+    return maxDiff;
+    }
+
+
+
+static void checkBox( int inWidth, int inHeight, int inRadius ) {
+    double *channel = makeChannel( inWidth, inHeight );
+    double *expected = directBoxBlur( channel, inWidth, inHeight, inRadius );
+    
+    int length = inWidth * inHeight;
+    
+    double *boxed = new double[ length ];
+    memcpy( boxed, channel, length * sizeof( double ) );
+    
+    BoxBlurFilter box( inRadius );
+    box.apply( boxed, inWidth, inHeight );
+    
+    char description[100];
+    sprintf( description, "box %dx%d radius %d", 
+             inWidth, inHeight, inRadius );
+    check( maxDifference( boxed, expected, length ) < 1e-9, description );
+    
+    
+    memcpy( boxed, channel, length * sizeof( double ) );
+    
+    SeparableBlurFilter threaded( inRadius, 3 );
+    threaded.apply( boxed, inWidth, inHeight );
+    
+    sprintf( description, "threaded box %dx%d radius %d", 
+             inWidth, inHeight, inRadius );
+    check( maxDifference( boxed, expected, length ) < 1e-9, description );
+    
+    delete [] boxed;
+    delete [] expected;
+    delete [] channel;
+    }
+
+
+
+static void checkFast() {
+    int w = 31;
+    int h = 17;
+    double *channel = makeChannel( w, h );
+    double *expected = directBoxBlur( channel, w, h, 1 );
+    
+    double *fast = new double[ w * h ];
+    memcpy( fast, channel, w * h * sizeof( double ) );
+    
+    FastBlurFilter filter;
+    filter.apply( fast, w, h );
+    
+    double maxDiff = 0;
+    char edgesSame = true;
+    
+    for( int y=0; y<h; y++ ) {
+        for( int x=0; x<w; x++ ) {
+            int i = y * w + x;
+            
+            if( x == 0 || y == 0 || x == w - 1 || y == h - 1 ) {
+                if( fast[i] != channel[i] ) {
+                    edgesSame = false;
+                    }
+                }
+            else if( fabs( fast[i] - expected[i] ) > maxDiff ) {
+                maxDiff = fabs( fast[i] - expected[i] );
+                }
+            }
+        }
+    check( maxDiff < 1e-9, "fast blur interior" );
+    check( edgesSame, "fast blur skips edges" );
+    
+    delete [] fast;
+    delete [] expected;
+    delete [] channel;
+    }
+
+
+
+static void checkGaussian( double inSigma ) {
+    int size = 201;
+    double *channel = new double[ size * size ];
+    memset( channel, 0, size * size * sizeof( double ) );
+    
+    // an impulse spreads into the filter's kernel
+    int center = size / 2;
+    channel[ center * size + center ] = 1;
+    
+    SeparableBlurFilter gauss( 0, 2 );
+    gauss.setGaussianSigma( inSigma );
+    gauss.apply( channel, size, size );
+    
+    double total = 0;
+    double variance = 0;
+    for( int x=0; x<size; x++ ) {
+        double v = channel[ center * size + x ];
+        
+        // sum down the column to get the 1D kernel
+        double column = 0;
+        for( int y=0; y<size; y++ ) {
+            column += channel[ y * size + x ];
+            }
+        total += column;
+        variance += column * ( x - center ) * ( x - center );
+        
+        // running sums leave rounding noise where the kernel is zero
+        if( v < -1e-12 ) {
+            check( false, "gaussian non-negative" );
+            }
+        }
+    
+    char description[100];
+    sprintf( description, "gaussian sigma %.1f keeps total", inSigma );
+    check( fabs( total - 1 ) < 1e-9, description );
+    
+    double sigma = sqrt( variance );
+    sprintf( description, "gaussian sigma %.1f measured %.2f", 
+             inSigma, sigma );
+    check( fabs( sigma - inSigma ) < 0.15 * inSigma + 0.3, description );
+    
+    delete [] channel;
+    }
+
+
+
+static double timeFilter( ChannelFilter *inFilter, double *inChannel,
+                          int inWidth, int inHeight ) {
+    double start = Time::getCurrentTime();
+    inFilter->apply( inChannel, inWidth, inHeight );
+    return ( Time::getCurrentTime() - start ) * 1000;
+    }
+
+
+
+int main() {
+    
+    int sizes[][2] = { { 1, 1 }, { 5, 1 }, { 1, 7 }, { 13, 9 }, 
+                       { 40, 33 }, { 64, 64 } };
+    int radii[] = { 0, 1, 2, 3, 7, 20, 70 };
+    
+    for( int s=0; s<6; s++ ) {
+        for( int r=0; r<7; r++ ) {
+            checkBox( sizes[s][0], sizes[s][1], radii[r] );
+            }
+        }
+
+    checkFast();
+    
+    checkGaussian( 1.0 );
+    checkGaussian( 3.0 );
+    checkGaussian( 10.0 );
+    
+    
+    int w = 1024;
+    int h = 1024;
+    double *channel = makeChannel( w, h );
+    
+    BoxBlurFilter box( 1 );
+    SeparableBlurFilter threaded( 1, -1 );
+    SeparableBlurFilter gauss( 1, -1 );
+    
+    printf( "%dx%d channel, ms  (%d processors)\n", w, h,
+            ThreadPool::getNumProcessors() );
+    printf( "radius     box  threaded  gaussian\n" );
+    
+    for( int r=1; r<=64; r *= 2 ) {
+        box.setRadius( r );
+        threaded.setBoxRadius( r );
+        gauss.setGaussianSigma( r );
+        
+        double boxTime = timeFilter( &box, channel, w, h );
+        double threadedTime = timeFilter( &threaded, channel, w, h );
+        double gaussTime = timeFilter( &gauss, channel, w, h );
+        
+        printf( "%6d  %6.1f  %8.1f  %8.1f\n", 
+                r, boxTime, threadedTime, gaussTime );
+        }
+    
+    delete [] channel;
+
+    
+    return reportChecks();
+    }
@@ -0,0 +1,333 @@
+/*
+ * Checks the ImageColorConverter conversions against direct per-pixel
+ * formulas, for Images, packed 8-bit images and float images.
+ */
+
+
+#include "minorGems/graphics/ImageColorConverter.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+static Image *makeRGB( int inWidth, int inHeight ) {
+    Image *image = new Image( inWidth, inHeight, 3, false );
+    
+    for( int c=0; c<3; c++ ) {
+        double *channel = image->getChannel( c );
+        for( int i=0; i<inWidth * inHeight; i++ ) {
+            channel[i] = ( rand() % 256 ) / 255.0;
+            }
+        }
+    return image;
+    }
+
+
+
+static double maxDifference( Image *inA, Image *inB ) {
+    double maxDiff = 0;
+    int numPixels = inA->getWidth() * inA->getHeight();
+    
+    for( int c=0; c<inA->getNumChannels(); c++ ) {
+        for( int i=0; i<numPixels; i++ ) {
+            double diff = fabs( inA->getChannel( c )[i] - 
+                                inB->getChannel( c )[i] );
+            if( diff > maxDiff ) {
+                maxDiff = diff;
+                }
+            }
+        }
+    return maxDiff;
+    }
+
+
+
+// the formulas as the converter used to apply them, pixel by pixel
+static Image *directConvert( Image *inImage, const double *inMatrix,
+                             double inPreShift1, double inPostShift1,
+                             char inClip ) {
+    int numPixels = inImage->getWidth() * inImage->getHeight();
+    Image *result = new Image( inImage->getWidth(), inImage->getHeight(), 
+                               3, false );
+    
+    for( int i=0; i<numPixels; i++ ) {
+        double in[3];
+        for( int c=0; c<3; c++ ) {
+            in[c] = inImage->getChannel( c )[i];
+            if( c > 0 ) {
+                in[c] -= inPreShift1;
+                }
+            }
+        
+        for( int k=0; k<3; k++ ) {
+            double v = inMatrix[ 3 * k ] * in[0] + 
+                inMatrix[ 3 * k + 1 ] * in[1] +
+                inMatrix[ 3 * k + 2 ] * in[2];
+            if( k > 0 ) {
+                v += inPostShift1;
+                }
+            if( inClip ) {
+                v = ( v < 0 ) ? 0 : ( ( v > 1 ) ? 1 : v );
+                }
+            result->getChannel( k )[i] = v;
+            }
+        }
+    return result;
+    }
+
+
+
+static void checkImageConversions() {
+    double yiq[9] = { 0.299,  0.587,  0.114,
+                      0.596, -0.274, -0.322,
+                      0.212, -0.523,  0.311 };
+    double ycbcr[9] = { 0.2989,  0.5866,  0.1145,
+                        -0.1687, -0.3312,  0.5000,
+                        0.5000, -0.4183, -0.0816 };
+    double inverseYCbCr[9] = { 1.0,  0.0000,  1.4022,
+                               1.0, -0.3456, -0.7145,
+                               1.0,  1.7710,  0.0000 };
+    
+    // odd size, to cover SIMD tails
+    Image *rgb = makeRGB( 37, 21 );
+    
+    Image *expected = directConvert( rgb, yiq, 0, 0, false );
+    Image *result = ImageColorConverter::RGBToYIQ( rgb );
+    check( maxDifference( expected, result ) < 1e-12, "RGBToYIQ" );
+    delete result;
+    delete expected;
+    
+    expected = directConvert( rgb, ycbcr, 0, 0.5, false );
+    Image *ycc = ImageColorConverter::RGBToYCbCr( rgb );
+    check( maxDifference( expected, ycc ) < 1e-12, "RGBToYCbCr" );
+    delete expected;
+    
+    Image *yccCopy = ycc->copy();
+    expected = directConvert( ycc, inverseYCbCr, 0.5, 0, true );
+    result = ImageColorConverter::YCbCrToRGB( ycc );
+    check( maxDifference( expected, result ) < 1e-12, "YCbCrToRGB" );
+    check( maxDifference( ycc, yccCopy ) == 0, 
+           "YCbCrToRGB leaves its input alone" );
+    check( maxDifference( rgb, result ) < 0.002, "YCbCr round trip" );
+    delete result;
+    delete expected;
+    delete yccCopy;
+    delete ycc;
+    
+    
+    // in place gives the same as into a new image
+    Image *hsb = ImageColorConverter::RGBToHSB( rgb );
+    Image *work = rgb->copy();
+    check( ImageColorConverter::RGBToHSB( work, work ), "HSB in place" );
+    check( maxDifference( hsb, work ) == 0, "HSB in place values" );
+    delete work;
+    delete hsb;
+    
+    Image *yiqImage = ImageColorConverter::RGBToYIQ( rgb );
+    work = rgb->copy();
+    ImageColorConverter::RGBToYIQ( work, work );
+    check( maxDifference( yiqImage, work ) == 0, "YIQ in place" );
+    ImageColorConverter::YIQToRGB( work, work );
+    check( maxDifference( rgb, work ) < 0.01, "YIQ round trip" );
+    delete work;
+    
+    Image *gray = ImageColorConverter::RGBToGrayscale( rgb );
+    double maxDiff = 0;
+    for( int i=0; i<37 * 21; i++ ) {
+        double diff = fabs( gray->getChannel( 0 )[i] - 
+                            yiqImage->getChannel( 0 )[i] );
+        if( diff > maxDiff ) {
+            maxDiff = diff;
+            }
+        }
+    check( maxDiff < 1e-12, "grayscale is YIQ luminance" );
+    delete gray;
+    delete yiqImage;
+    
+    Image *wrongSize = new Image( 5, 5, 3 );
+    check( ! ImageColorConverter::RGBToYIQ( rgb, wrongSize ), 
+           "size mismatch rejected" );
+    delete wrongSize;
+    
+    delete rgb;
+    }
+
+
+
+static void checkPackedConversions( int inNumChannels, char inInterleaved ) {
+    Image *rgb = makeRGB( 29, 13 );
+    Image *ycc = ImageColorConverter::RGBToYCbCr( rgb );
+    
+    // extra channels are alpha-like and must be left alone
+    Image *source = new Image( 29, 13, inNumChannels, false );
+    for( int c=0; c<inNumChannels; c++ ) {
+        double *channel = source->getChannel( c );
+        for( int i=0; i<29 * 13; i++ ) {
+            if( c < 3 ) {
+                channel[i] = rgb->getChannel( c )[i];
+                }
+            else {
+                channel[i] = ( i % 256 ) / 255.0;
+                }
+            }
+        }
+    
+    char description[100];
+    
+    PixelImage8 *bytes = PixelImage8::fromImage( source, inInterleaved );
+    
+    unsigned char *luminance = new unsigned char[ 29 * 13 ];
+    ImageColorConverter::RGBToLuminance( bytes, luminance );
+    
+    int maxLumDiff = 0;
+    for( int i=0; i<29 * 13; i++ ) {
+        double y = 0.299 * rgb->getChannel( 0 )[i] +
+            0.587 * rgb->getChannel( 1 )[i] +
+            0.114 * rgb->getChannel( 2 )[i];
+        int diff = abs( (int)lrint( y * 255 ) - luminance[i] );
+        if( diff > maxLumDiff ) {
+            maxLumDiff = diff;
+            }
+        }
+    sprintf( description, "8-bit luminance, %d channels, interleaved %d",
+             inNumChannels, inInterleaved );
+    check( maxLumDiff <= 1, description );
+    delete [] luminance;
+    
+    
+    ImageColorConverter::RGBToYCbCr( bytes );
+    
+    int maxDiff = 0;
+    char otherSame = true;
+    for( int y=0; y<13; y++ ) {
+        for( int x=0; x<29; x++ ) {
+            int i = y * 29 + x;
+            for( int c=0; c<inNumChannels; c++ ) {
+                int sample = bytes->getSample( x, y, c );
+                if( c < 3 ) {
+                    int diff = abs( (int)lrint( ycc->getChannel( c )[i] 
+                                                * 255 ) - sample );
+                    if( diff > maxDiff ) {
+                        maxDiff = diff;
+                        }
+                    }
+                else if( sample != i % 256 ) {
+                    otherSame = false;
+                    }
+                }
+            }
+        }
+    sprintf( description, "8-bit YCbCr, %d channels, interleaved %d",
+             inNumChannels, inInterleaved );
+    check( maxDiff <= 1, description );
+    check( otherSame, "8-bit extra channels untouched" );
+    
+    ImageColorConverter::YCbCrToRGB( bytes );
+    maxDiff = 0;
+    for( int y=0; y<13; y++ ) {
+        for( int x=0; x<29; x++ ) {
+            for( int c=0; c<3; c++ ) {
+                int expected = 
+                    (int)lrint( rgb->getChannel( c )[ y * 29 + x ] * 255 );
+                int diff = abs( expected - bytes->getSample( x, y, c ) );
+                if( diff > maxDiff ) {
+                    maxDiff = diff;
+                    }
+                }
+            }
+        }
+    sprintf( description, "8-bit YCbCr round trip, %d channels", 
+             inNumChannels );
+    check( maxDiff <= 2, description );
+    
+    delete bytes;
+    
+
+    PixelImageFloat *floats = 
+        PixelImageFloat::fromImage( source, inInterleaved );
+    ImageColorConverter::RGBToYCbCr( floats );
+    
+    double maxFloatDiff = 0;
+    for( int y=0; y<13; y++ ) {
+        for( int x=0; x<29; x++ ) {
+            for( int c=0; c<3; c++ ) {
+                double diff = fabs( ycc->getChannel( c )[ y * 29 + x ] - 
+                                    floats->getSample( x, y, c ) );
+                if( diff > maxFloatDiff ) {
+                    maxFloatDiff = diff;
+                    }
+                }
+            }
+        }
+    check( maxFloatDiff < 1e-6, "float YCbCr" );
+    delete floats;
+    
+    delete source;
+    delete ycc;
+    delete rgb;
+    }
+
+
+
+int main() {
+    
+    checkImageConversions();
+    
+    checkPackedConversions( 4, true );
+    checkPackedConversions( 4, false );
+    checkPackedConversions( 3, true );
+    checkPackedConversions( 3, false );
+    
+    
+    Image *rgb = makeRGB( 1024, 1024 );
+    Image *out = new Image( 1024, 1024, 3, false );
+    
+    double start = Time::getCurrentTime();
+    Image *ycc = ImageColorConverter::RGBToYCbCr( rgb );
+    double newImageTime = Time::getCurrentTime() - start;
+    
+    start = Time::getCurrentTime();
+    ImageColorConverter::RGBToYCbCr( rgb, out );
+    double intoTime = Time::getCurrentTime() - start;
+    
+    double *luminance = new double[ 1024 * 1024 ];
+    start = Time::getCurrentTime();
+    ImageColorConverter::RGBToLuminance( rgb, luminance );
+    double luminanceTime = Time::getCurrentTime() - start;
+
+    Image *rgba = new Image( 1024, 1024, 4, false );
+    for( int c=0; c<3; c++ ) {
+        memcpy( rgba->getChannel( c ), rgb->getChannel( c ), 
+                1024 * 1024 * sizeof( double ) );
+        }
+    PixelImage8 *bytes = PixelImage8::fromImage( rgba );
+    
+    start = Time::getCurrentTime();
+    ImageColorConverter::RGBToYCbCr( bytes );
+    double bytesTime = Time::getCurrentTime() - start;
+
+    unsigned char *byteLuminance = new unsigned char[ 1024 * 1024 ];
+    start = Time::getCurrentTime();
+    ImageColorConverter::RGBToLuminance( bytes, byteLuminance );
+    double byteLuminanceTime = Time::getCurrentTime() - start;
+    
+    printf( "1024x1024 RGB to YCbCr:  new Image %.1f ms, "
+            "into Image %.1f ms, 8-bit RGBA %.1f ms\n", 
+            newImageTime * 1000, intoTime * 1000, bytesTime * 1000 );
+    printf( "1024x1024 luminance:  Image %.1f ms, 8-bit RGBA %.1f ms\n",
+            luminanceTime * 1000, byteLuminanceTime * 1000 );
+    
+    delete [] byteLuminance;
+    delete bytes;
+    delete rgba;
+    delete [] luminance;
+    delete ycc;
+    delete out;
+    delete rgb;
+    
+    
+    return reportChecks();
+    }
@@ -0,0 +1,225 @@
+/*
+ * Checks the histogram median filter against a direct median of each box,
+ * then times it against the quick_select method over a range of radii.
+ */
+
+
+#include "minorGems/graphics/filters/MedianFilter.h"
+#include "minorGems/graphics/filters/ThreadedMedianFilter.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+// exposes the quick_select method for comparison
+class QuickSelectMedianFilter : public MedianFilter {
+    public:
+        QuickSelectMedianFilter( int inRadius )
+                : MedianFilter( inRadius ) {
+            }
+        
+        void apply( double *inChannel, int inWidth, int inHeight ) {
+            applyQuickSelect( inChannel, inWidth, inHeight );
+            }
+    };
+
+
+
+static int compareInts( const void *inA, const void *inB ) {
+    return *(int *)inA - *(int *)inB;
+    }
+
+
+
+// lower median of each clipped box, by sorting
+template <class T>
+static T *directMedian( T *inChannel, int inWidth, int inHeight, 
+                        int inRadius ) {
+    T *result = new T[ inWidth * inHeight ];
+    int *box = new int[ ( 2 * inRadius + 1 ) * ( 2 * inRadius + 1 ) ];
+    
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            int count = 0;
+            
+            for( int by=y-inRadius; by<=y+inRadius; by++ ) {
+                for( int bx=x-inRadius; bx<=x+inRadius; bx++ ) {
+                    if( by >= 0 && by < inHeight && 
+                        bx >= 0 && bx < inWidth ) {
+                        box[ count++ ] = inChannel[ by * inWidth + bx ];
+                        }
+                    }
+                }
+            qsort( box, count, sizeof( int ), compareInts );
+            
+            result[ y * inWidth + x ] = (T)box[ ( count - 1 ) / 2 ];
+            }
+        }
+    
+    delete [] box;
+    return result;
+    }
+
+
+
+template <class T>
+static void checkSamples( int inWidth, int inHeight, int inRadius,
+                          int inMaxValue, MedianFilter *inFilter,
+                          const char *inName ) {
+    int numPixels = inWidth * inHeight;
+    
+    // two interleaved channels, filtering the second
+    PixelImage<T> image( inWidth, inHeight, 2 );
+    T *values = new T[ numPixels ];
+    
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            T v = (T)( rand() % ( inMaxValue + 1 ) );
+            values[ y * inWidth + x ] = v;
+            image.setSample( x, y, 0, 7 );
+            image.setSample( x, y, 1, v );
+            }
+        }
+    
+    T *expected = directMedian( values, inWidth, inHeight, inRadius );
+    
+    inFilter->setRadius( inRadius );
+    inFilter->apply( &image, 1 );
+    
+    char same = true;
+    char otherSame = true;
+    for( int y=0; y<inHeight; y++ ) {
+        for( int x=0; x<inWidth; x++ ) {
+            if( image.getSample( x, y, 1 ) != expected[ y * inWidth + x ] ) {
+                same = false;
+                }
+            if( image.getSample( x, y, 0 ) != 7 ) {
+                otherSame = false;
+                }
+            }
+        }
+    
+    char description[100];
+    sprintf( description, "%s %dx%d radius %d", 
+             inName, inWidth, inHeight, inRadius );
+    check( same, description );
+    check( otherSame, "other channel untouched" );
+    
+    delete [] expected;
+    delete [] values;
+    }
+
+
+
+static void checkDoubles( int inWidth, int inHeight, int inRadius,
+                          double inScale ) {
+    int numPixels = inWidth * inHeight;
+    
+    double *channel = new double[ numPixels ];
+    double *quick = new double[ numPixels ];
+    for( int i=0; i<numPixels; i++ ) {
+        channel[i] = inScale * ( rand() / (double)RAND_MAX - 0.25 );
+        quick[i] = channel[i];
+        }
+    
+    MedianFilter median( inRadius );
+    median.apply( channel, inWidth, inHeight );
+    
+    QuickSelectMedianFilter quickMedian( inRadius );
+    quickMedian.apply( quick, inWidth, inHeight );
+
+    char description[100];
+    sprintf( description, "doubles %dx%d radius %d scale %.0f", 
+             inWidth, inHeight, inRadius, inScale );
+    check( memcmp( channel, quick, numPixels * sizeof( double ) ) == 0,
+           description );
+    
+    delete [] quick;
+    delete [] channel;
+    }
+
+
+
+int main() {
+    
+    MedianFilter median( 1 );
+    ThreadedMedianFilter threaded( 1, 3 );
+    
+    int sizes[][2] = { { 1, 1 }, { 7, 1 }, { 1, 6 }, { 13, 9 }, 
+                       { 40, 33 } };
+    int radii[] = { 0, 1, 2, 5, 30 };
+    
+    for( int s=0; s<5; s++ ) {
+        for( int r=0; r<5; r++ ) {
+            int w = sizes[s][0];
+            int h = sizes[s][1];
+            
+            checkSamples<unsigned char>( w, h, radii[r], 255, 
+                                         &median, "8-bit" );
+            checkSamples<unsigned char>( w, h, radii[r], 3, 
+                                         &median, "8-bit few values" );
+            checkSamples<unsigned short>( w, h, radii[r], 65535, 
+                                          &median, "16-bit" );
+            checkSamples<unsigned char>( w, h, radii[r], 255, 
+                                         &threaded, "threaded 8-bit" );
+            checkSamples<float>( w, h, radii[r], 1000, 
+                                 &median, "float" );
+            
+            checkDoubles( w, h, radii[r], 1 );
+            }
+        }
+    
+    // wide enough for 16-bit histograms to be split into tiles
+    checkSamples<unsigned short>( 150, 20, 3, 65535, &median, 
+                                  "16-bit tiled" );
+    checkSamples<unsigned short>( 150, 20, 3, 65535, &threaded, 
+                                  "threaded 16-bit tiled" );
+    
+    // values too spread out for 16-bit bins
+    checkDoubles( 30, 20, 2, 1000 );
+    
+    
+    int w = 512;
+    int h = 512;
+    double *channel = new double[ w * h ];
+    double *work = new double[ w * h ];
+    for( int i=0; i<w * h; i++ ) {
+        channel[i] = rand() / (double)RAND_MAX;
+        }
+
+    PixelImage8 image( w, h, 1 );
+    
+    printf( "%dx%d channel, ms\n", w, h );
+    printf( "radius  quickselect  histogram  8-bit\n" );
+    
+    for( int r=1; r<=16; r *= 2 ) {
+        QuickSelectMedianFilter quickMedian( r );
+        median.setRadius( r );
+        
+        memcpy( work, channel, w * h * sizeof( double ) );
+        double start = Time::getCurrentTime();
+        quickMedian.apply( work, w, h );
+        double quickTime = Time::getCurrentTime() - start;
+        
+        memcpy( work, channel, w * h * sizeof( double ) );
+        start = Time::getCurrentTime();
+        median.apply( work, w, h );
+        double histTime = Time::getCurrentTime() - start;
+        
+        start = Time::getCurrentTime();
+        median.apply( &image );
+        double byteTime = Time::getCurrentTime() - start;
+        
+        printf( "%6d  %11.1f  %9.1f  %5.1f\n", r, quickTime * 1000, 
+                histTime * 1000, byteTime * 1000 );
+        }
+    
+    delete [] work;
+    delete [] channel;
+
+    
+    return reportChecks();
+    }
@@ -0,0 +1,245 @@
+/*
+ * Checks PixelImage conversions and the fixed-point filter paths against
+ * the double-precision filters.
+ */
+
+
+#include "minorGems/graphics/PixelImage.h"
+#include "minorGems/graphics/filters/BoxBlurFilter.h"
+#include "minorGems/graphics/filters/FastBlurFilter.h"
+#include "minorGems/graphics/filters/MedianFilter.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// image with 8-bit-exact values, so double and fixed-point paths start
+// from the same samples
+static Image *makeTestImage( int inWidth, int inHeight, 
+                             int inNumChannels ) {
+    Image *image = new Image( inWidth, inHeight, inNumChannels, false );
+
+    for( int c=0; c<inNumChannels; c++ ) {
+        double *channel = image->getChannel( c );
+        
+        for( int i=0; i<inWidth * inHeight; i++ ) {
+            channel[i] = ( rand() % 256 ) / 255.0;
+            }
+        }
+    return image;
+    }
+
+
+
+static int maxDifference( Image *inA, PixelImage8 *inB ) {
+    int maxDiff = 0;
+    
+    for( int c=0; c<inB->getNumChannels(); c++ ) {
+        double *channel = inA->getChannel( c );
+        
+        for( int y=0; y<inB->getHeight(); y++ ) {
+            for( int x=0; x<inB->getWidth(); x++ ) {
+                int a = (int)lrint( channel[ y * inB->getWidth() + x ] 
+                                    * 255 );
+                int diff = abs( a - inB->getSample( x, y, c ) );
+                
+                if( diff > maxDiff ) {
+                    maxDiff = diff;
+                    }
+                }
+            }
+        }
+    return maxDiff;
+    }
+
+
+
+static void checkRoundTrip( int inNumChannels, char inInterleaved ) {
+    Image *image = makeTestImage( 37, 23, inNumChannels );
+    
+    PixelImage8 *pixels = PixelImage8::fromImage( image, inInterleaved );
+    
+    check( maxDifference( image, pixels ) == 0, "fromImage values" );
+    check( pixels->isInterleaved() == inInterleaved, "layout" );
+    
+    Image *back = pixels->toImage();
+    
+    double maxError = 0;
+    for( int c=0; c<inNumChannels; c++ ) {
+        for( int i=0; i<37 * 23; i++ ) {
+            double e = fabs( back->getChannel( c )[i] - 
+                             image->getChannel( c )[i] );
+            if( e > maxError ) {
+                maxError = e;
+                }
+            }
+        }
+    check( maxError < 1e-6, "toImage round trip" );
+
+    PixelImage8 *other = pixels->copy( !inInterleaved );
+    check( other->isInterleaved() != inInterleaved, "copy layout" );
+    check( maxDifference( image, other ) == 0, "copy values" );
+    
+    delete other;
+    delete back;
+    delete pixels;
+    delete image;
+    }
+
+
+
+template <class T>
+static void checkWideType( const char *inName ) {
+    Image *image = makeTestImage( 16, 9, 3 );
+    
+    PixelImage<T> *pixels = PixelImage<T>::fromImage( image );
+    Image *back = pixels->toImage();
+    
+    double maxError = 0;
+    for( int c=0; c<3; c++ ) {
+        for( int i=0; i<16 * 9; i++ ) {
+            double e = fabs( back->getChannel( c )[i] - 
+                             image->getChannel( c )[i] );
+            if( e > maxError ) {
+                maxError = e;
+                }
+            }
+        }
+    check( maxError < 1e-4, inName );
+    
+    // a constant image stays constant through the box blur
+    PixelImage<T> flat( 20, 20, 1 );
+    T value = PixelTraits<T>::fromDouble( 0.75 );
+    for( int y=0; y<20; y++ ) {
+        for( int x=0; x<20; x++ ) {
+            flat.setSample( x, y, 0, value );
+            }
+        }
+    BoxBlurFilter blur( 3 );
+    blur.apply( &flat );
+    
+    char same = true;
+    for( int y=0; y<20; y++ ) {
+        for( int x=0; x<20; x++ ) {
+            if( flat.getSample( x, y, 0 ) != value ) {
+                same = false;
+                }
+            }
+        }
+    check( same, "flat box blur" );
+    
+    delete back;
+    delete pixels;
+    delete image;
+    }
+
+
+
+static void checkFilter( ChannelFilter *inFilter, 
+                         void (*inApply)( PixelImage8 *, void * ),
+                         void *inFilterObject,
+                         char inInterleaved, const char *inName ) {
+    Image *image = makeTestImage( 41, 29, 4 );
+    PixelImage8 *pixels = PixelImage8::fromImage( image, inInterleaved );
+    
+    image->filter( inFilter );
+    inApply( pixels, inFilterObject );
+    
+    int diff = maxDifference( image, pixels );
+    
+    if( diff > 1 ) {
+        printf( "%s differs by %d\n", inName, diff );
+        }
+    check( diff <= 1, inName );
+    
+    delete pixels;
+    delete image;
+    }
+
+
+template <class F>
+static void applyFilter( PixelImage8 *inImage, void *inFilter ) {
+    ( (F*)inFilter )->apply( inImage );
+    }
+
+
+
+static void timeFilter( ChannelFilter *inFilter,
+                        void (*inApply)( PixelImage8 *, void * ),
+                        void *inFilterObject, const char *inName ) {
+    Image *image = makeTestImage( 512, 512, 4 );
+    PixelImage8 *pixels = PixelImage8::fromImage( image );
+    
+    double start = Time::getCurrentTime();
+    image->filter( inFilter );
+    double doubleTime = Time::getCurrentTime() - start;
+    
+    start = Time::getCurrentTime();
+    inApply( pixels, inFilterObject );
+    double fixedTime = Time::getCurrentTime() - start;
+    
+    printf( "%s 512x512 RGBA:  double %.1f ms, 8-bit %.1f ms\n",
+            inName, doubleTime * 1000, fixedTime * 1000 );
+    
+    delete pixels;
+    delete image;
+    }
+
+
+
+int main() {
+    
+    checkRoundTrip( 4, true );
+    checkRoundTrip( 4, false );
+    checkRoundTrip( 3, true );
+    checkRoundTrip( 3, false );
+    checkRoundTrip( 1, true );
+    
+    
+    // view onto raw bytes
+    unsigned char *bytes = new unsigned char[ 8 * 4 * 4 ];
+    for( int i=0; i<8 * 4 * 4; i++ ) {
+        bytes[i] = (unsigned char)i;
+        }
+    RawRGBAImage raw( bytes, 8, 4, 4 );
+    PixelImage8 *view = new PixelImage8( &raw );
+    check( view->getSamples() == bytes, "view shares bytes" );
+    check( view->getSample( 2, 1, 3 ) == ( 1 * 8 + 2 ) * 4 + 3, 
+           "view sample" );
+    view->setSample( 0, 0, 1, 200 );
+    check( bytes[1] == 200, "view write" );
+    delete view;
+    
+
+    checkWideType<unsigned short>( "16-bit round trip" );
+    checkWideType<float>( "float round trip" );
+    checkWideType<unsigned char>( "8-bit flat" );
+    
+    
+    BoxBlurFilter box( 3 );
+    BoxBlurFilter bigBox( 12 );
+    FastBlurFilter fast;
+    MedianFilter median( 2 );
+    
+    for( int i=0; i<2; i++ ) {
+        char interleaved = ( i == 0 );
+        
+        checkFilter( &box, applyFilter<BoxBlurFilter>, &box, 
+                     interleaved, "box blur" );
+        checkFilter( &bigBox, applyFilter<BoxBlurFilter>, &bigBox, 
+                     interleaved, "big box blur" );
+        checkFilter( &fast, applyFilter<FastBlurFilter>, &fast,
+                     interleaved, "fast blur" );
+        checkFilter( &median, applyFilter<MedianFilter>, &median,
+                     interleaved, "median" );
+        }
+    
+    timeFilter( &box, applyFilter<BoxBlurFilter>, &box, "box blur r3" );
+    timeFilter( &fast, applyFilter<FastBlurFilter>, &fast, "fast blur" );
+    timeFilter( &median, applyFilter<MedianFilter>, &median, "median r2" );
+    
+
+    return reportChecks();
+    }
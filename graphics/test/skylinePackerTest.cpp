@@ -0,0 +1,136 @@
+/*
+ * Checks that SkylinePacker keeps rectangles inside the bin and apart
+ * from each other, and reports how densely it packs sprite-sized
+ * rectangles.
+ */
+
+
+#include "minorGems/graphics/SkylinePacker.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// packs random rectangles until one fails, checking each against
+// a coverage map of the bin
+// returns the final occupancy
+static double fillBin( SkylinePacker *inPacker, int inMinSize, 
+                       int inMaxSize ) {
+    int w = inPacker->getWidth();
+    int h = inPacker->getHeight();
+    
+    char *covered = new char[ w * h ];
+    memset( covered, false, w * h );
+
+    char inBounds = true;
+    char overlap = false;
+    long long area = 0;
+
+    int numFailedPacks = 0;
+    
+    // keep going past the first failure, since smaller rectangles may
+    // still fit
+    while( numFailedPacks < 20 ) {
+        int rw = inMinSize + rand() % ( inMaxSize - inMinSize + 1 );
+        int rh = inMinSize + rand() % ( inMaxSize - inMinSize + 1 );
+        
+        int x, y;
+        if( ! inPacker->pack( rw, rh, &x, &y ) ) {
+            numFailedPacks++;
+            continue;
+            }
+        
+        if( x < 0 || y < 0 || x + rw > w || y + rh > h ) {
+            inBounds = false;
+            continue;
+            }
+        
+        for( int py=y; py<y+rh; py++ ) {
+            for( int px=x; px<x+rw; px++ ) {
+                if( covered[ py * w + px ] ) {
+                    overlap = true;
+                    }
+                covered[ py * w + px ] = true;
+                }
+            }
+        area += rw * rh;
+        }
+    
+    check( inBounds, "rectangles inside bin" );
+    check( ! overlap, "rectangles don't overlap" );
+    
+    double occupancy = inPacker->getOccupancy();
+    
+    check( occupancy == (double)area / ( (double)w * h ), 
+           "occupancy matches packed area" );
+
+    delete [] covered;
+
+    return occupancy;
+    }
+
+
+
+int main() {
+
+    SkylinePacker packer( 512, 512 );
+    
+    int x, y;
+    check( ! packer.pack( 513, 10, &x, &y ), "too wide rejected" );
+    check( ! packer.pack( 10, 513, &x, &y ), "too tall rejected" );
+    check( ! packer.pack( 0, 10, &x, &y ), "empty rejected" );
+    
+    check( packer.pack( 512, 512, &x, &y ) && x == 0 && y == 0, 
+           "exact fit" );
+    check( ! packer.pack( 1, 1, &x, &y ), "full bin rejects" );
+    
+    packer.reset();
+    check( packer.getOccupancy() == 0, "reset empties bin" );
+
+
+    // bottom-left placement
+    packer.pack( 100, 50, &x, &y );
+    check( x == 0 && y == 0, "first at origin" );
+    packer.pack( 100, 20, &x, &y );
+    check( x == 100 && y == 0, "second beside first" );
+    packer.pack( 100, 20, &x, &y );
+    check( x == 200 && y == 0, "third beside second" );
+    packer.pack( 312, 10, &x, &y );
+    check( x == 100 && y == 20, "wide one on lowest span that fits" );
+    packer.reset();
+    
+    
+    double start = Time::getCurrentTime();
+
+    double smallOccupancy = fillBin( &packer, 8, 64 );
+    
+    packer.reset();
+    double largeOccupancy = fillBin( &packer, 16, 128 );
+    
+    printf( "512x512 bin occupancy:  %.1f%% (8-64 px), "
+            "%.1f%% (16-128 px), %.1f ms\n",
+            smallOccupancy * 100, largeOccupancy * 100, 
+            ( Time::getCurrentTime() - start ) * 1000 );
+    
+    check( smallOccupancy > 0.75, "small rectangles pack densely" );
+    check( largeOccupancy > 0.6, "large rectangles pack densely" );
+
+
+    // thin strips push the segment count to its limit
+    SkylinePacker strips( 64, 64 );
+    int numPacked = 0;
+    for( int i=0; i<64; i++ ) {
+        if( strips.pack( 1, 1 + i % 7, &x, &y ) ) {
+            numPacked++;
+            }
+        }
+    check( numPacked == 64, "one-pixel strips all fit" );
+    
+    strips.reset();
+    fillBin( &strips, 1, 3 );
+    
+
+    return reportChecks();
+    }
@@ -0,0 +1,485 @@
+#include "minorGems/common.h"
+
+
+#ifndef BINARY_READER_CLASS_INCLUDED
+#define BINARY_READER_CLASS_INCLUDED
+
+#include "InputStream.h"
+#include "BinaryWriter.h"
+
+#include "minorGems/system/endian.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+
+/**
+ * Reads values written by a BinaryWriter from a contiguous buffer.
+ *
+ * Reads past the end of the buffer or malformed values set a sticky error
+ * flag (see isOK) and return zero values, so a whole record can be read
+ * and then checked once.  Length prefixes are checked against the bytes
+ * remaining before anything is allocated.
+ *
+ * Is also an InputStream, so code written against streams can read from
+ * the same buffer.
+ *
+ * @author Jason Rohrer
+ */
+class BinaryReader : public InputStream {
+
+    public:
+
+        /**
+         * Constructs a reader over a buffer.
+         *
+         * @param inData the buffer to read.
+         *   Must be destroyed by caller after this reader is destroyed.
+         * @param inLength the number of bytes in inData.
+         */
+        BinaryReader( const unsigned char *inData, long inLength );
+
+        virtual ~BinaryReader();
+
+
+
+        /**
+         * Reads a frame written by BinaryWriter::writeFrame.
+         *
+         * @param inInputStream the stream to read from.
+         *   Must be destroyed by caller.
+         * @param inMaxLength the largest frame to accept.
+         *
+         * @return a reader over the frame, or NULL on a stream error or
+         *   a frame longer than inMaxLength.
+         *   Must be destroyed by caller if non-NULL.
+         */
+        static BinaryReader *readFrame( InputStream *inInputStream,
+                                        long inMaxLength );
+
+
+
+        /**
+         * Reads a header written by BinaryWriter::writeHeader.
+         *
+         * @param inSchemaID the ID of the data expected.
+         * @param inMaxSchemaVersion the newest version understood.
+         *
+         * @return the version of the data, or -1 if the header is missing,
+         *   is for a different schema ID, or has a version newer than
+         *   inMaxSchemaVersion.
+         */
+        int readHeader( uint32_t inSchemaID, uint32_t inMaxSchemaVersion );
+
+
+
+        uint8_t readUInt8();
+
+        char readBool();
+
+        uint64_t readUVarint();
+
+        int64_t readVarint();
+
+        float readFloat();
+
+        double readDouble();
+
+
+
+        /**
+         * Reads bytes written with a length prefix.
+         *
+         * @param outLength pointer to where the number of bytes should be
+         *   returned.
+         *
+         * @return the bytes, or NULL on error.
+         *   Must be destroyed by caller if non-NULL.
+         */
+        unsigned char *readByteString( int *outLength );
+
+
+        // reads a string written by writeText
+        // returns a \0-terminated string, or NULL on error
+        // must be destroyed by caller if non-NULL
+        char *readText();
+
+
+
+        // arrays return NULL on error, and otherwise must be destroyed by
+        // caller
+
+        uint8_t *readUInt8Array( int *outCount );
+
+        int32_t *readInt32Array( int *outCount );
+
+        float *readFloatArray( int *outCount );
+
+        double *readDoubleArray( int *outCount );
+
+
+
+        // implements the InputStream interface
+        // reads raw bytes, returning fewer than requested at the end of
+        // the buffer
+        virtual long read( unsigned char *inBuffer, long inNumBytes );
+
+
+
+        /**
+         * Gets whether all reads so far have succeeded.
+         */
+        char isOK();
+
+
+        long getPosition();
+
+        long getNumRemaining();
+
+
+
+    protected:
+
+        // reads a varint count and checks that inElementSize bytes per
+        // element remain
+        // returns -1 on error
+        int readCount( int inElementSize );
+
+        // copies inCount elements of inElementSize bytes each, stored
+        // little-endian
+        void getLittleEndian( void *outValues, int inCount,
+                              int inElementSize );
+
+        const unsigned char *mData;
+        long mLength;
+        long mPosition;
+
+        char mError;
+
+        // non-NULL if this reader owns its buffer
+        unsigned char *mOwnedData;
+
+    };
+
+
+
+inline BinaryReader::BinaryReader( const unsigned char *inData,
+                                   long inLength )
+    : mData( inData ), mLength( inLength ), mPosition( 0 ),
+      mError( false ), mOwnedData( NULL ) {
+    }
+
+
+
+inline BinaryReader::~BinaryReader() {
+    if( mOwnedData != NULL ) {
+        delete [] mOwnedData;
+        }
+    }
+
+
+
+inline BinaryReader *BinaryReader::readFrame( InputStream *inInputStream,
+                                              long inMaxLength ) {
+    uint64_t length = 0;
+    int shift = 0;
+
+    while( true ) {
+        unsigned char byte;
+
+        if( inInputStream->readByte( &byte ) != 1 || shift > 63 ) {
+            return NULL;
+            }
+
+        length |= (uint64_t)( byte & 0x7F ) << shift;
+        shift += 7;
+
+        if( ( byte & 0x80 ) == 0 ) {
+            break;
+            }
+        }
+
+    if( length > (uint64_t)inMaxLength ) {
+        return NULL;
+        }
+
+    unsigned char *data = new unsigned char[ length > 0 ? length : 1 ];
+
+    if( length > 0 &&
+        inInputStream->read( data, (long)length ) != (long)length ) {
+        delete [] data;
+        return NULL;
+        }
+
+    BinaryReader *reader = new BinaryReader( data, (long)length );
+    reader->mOwnedData = data;
+
+    return reader;
+    }
+
+
+
+inline int BinaryReader::readHeader( uint32_t inSchemaID,
+                                     uint32_t inMaxSchemaVersion ) {
+    if( readUInt8() != BINARY_HEADER_MAGIC ) {
+        mError = true;
+        return -1;
+        }
+
+    uint64_t id = readUVarint();
+    uint64_t version = readUVarint();
+
+    if( mError || id != inSchemaID || version > inMaxSchemaVersion ) {
+        mError = true;
+        return -1;
+        }
+
+    return (int)version;
+    }
+
+
+
+inline uint8_t BinaryReader::readUInt8() {
+    if( mPosition >= mLength ) {
+        mError = true;
+        return 0;
+        }
+    return mData[ mPosition++ ];
+    }
+
+
+
+inline char BinaryReader::readBool() {
+    return ( readUInt8() != 0 );
+    }
+
+
+
+inline uint64_t BinaryReader::readUVarint() {
+    uint64_t value = 0;
+    int shift = 0;
+
+    while( mPosition < mLength && shift <= 63 ) {
+        unsigned char byte = mData[ mPosition++ ];
+
+        value |= (uint64_t)( byte & 0x7F ) << shift;
+
+        if( ( byte & 0x80 ) == 0 ) {
+            return value;
+            }
+        shift += 7;
+        }
+
+    // ran off the end, or more than 10 bytes
+    mError = true;
+    return 0;
+    }
+
+
+
+inline int64_t BinaryReader::readVarint() {
+    uint64_t value = readUVarint();
+
+    return (int64_t)( value >> 1 ) ^ -(int64_t)( value & 1 );
+    }
+
+
+
+inline void BinaryReader::getLittleEndian( void *outValues, int inCount,
+                                           int inElementSize ) {
+    long numBytes = (long)inCount * inElementSize;
+
+    memcpy( outValues, &( mData[ mPosition ] ), numBytes );
+
+    if( inElementSize == 8 ) {
+        littleEndianArray64( outValues, inCount );
+        }
+    else {
+        littleEndianArray32( outValues, inCount );
+        }
+
+    mPosition += numBytes;
+    }
+
+
+
+inline float BinaryReader::readFloat() {
+    float value = 0;
+
+    if( mLength - mPosition < 4 ) {
+        mError = true;
+        mPosition = mLength;
+        }
+    else {
+        getLittleEndian( &value, 1, 4 );
+        }
+    return value;
+    }
+
+
+
+inline double BinaryReader::readDouble() {
+    double value = 0;
+
+    if( mLength - mPosition < 8 ) {
+        mError = true;
+        mPosition = mLength;
+        }
+    else {
+        getLittleEndian( &value, 1, 8 );
+        }
+    return value;
+    }
+
+
+
+inline int BinaryReader::readCount( int inElementSize ) {
+    uint64_t count = readUVarint();
+
+    if( mError ||
+        count > (uint64_t)( mLength - mPosition ) / inElementSize ) {
+        mError = true;
+        return -1;
+        }
+
+    return (int)count;
+    }
+
+
+
+inline unsigned char *BinaryReader::readByteString( int *outLength ) {
+    int length = readCount( 1 );
+
+    if( length < 0 ) {
+        return NULL;
+        }
+
+    unsigned char *bytes = new unsigned char[ length > 0 ? length : 1 ];
+    memcpy( bytes, &( mData[ mPosition ] ), length );
+    mPosition += length;
+
+    *outLength = length;
+    return bytes;
+    }
+
+
+
+inline char *BinaryReader::readText() {
+    int length = readCount( 1 );
+
+    if( length < 0 ) {
+        return NULL;
+        }
+
+    char *string = new char[ length + 1 ];
+    memcpy( string, &( mData[ mPosition ] ), length );
+    string[ length ] = '\0';
+    mPosition += length;
+
+    return string;
+    }
+
+
+
+inline uint8_t *BinaryReader::readUInt8Array( int *outCount ) {
+    return readByteString( outCount );
+    }
+
+
+
+inline int32_t *BinaryReader::readInt32Array( int *outCount ) {
+    // each element takes at least one byte
+    int count = readCount( 1 );
+
+    if( count < 0 ) {
+        return NULL;
+        }
+
+    int32_t *values = new int32_t[ count > 0 ? count : 1 ];
+
+    for( int i=0; i<count; i++ ) {
+        uint32_t v = (uint32_t)readUVarint();
+        values[i] = (int32_t)( v >> 1 ) ^ -(int32_t)( v & 1 );
+        }
+
+    if( mError ) {
+        delete [] values;
+        return NULL;
+        }
+
+    *outCount = count;
+    return values;
+    }
+
+
+
+inline float *BinaryReader::readFloatArray( int *outCount ) {
+    int count = readCount( 4 );
+
+    if( count < 0 ) {
+        return NULL;
+        }
+
+    float *values = new float[ count > 0 ? count : 1 ];
+    getLittleEndian( values, count, 4 );
+
+    *outCount = count;
+    return values;
+    }
+
+
+
+inline double *BinaryReader::readDoubleArray( int *outCount ) {
+    int count = readCount( 8 );
+
+    if( count < 0 ) {
+        return NULL;
+        }
+
+    double *values = new double[ count > 0 ? count : 1 ];
+    getLittleEndian( values, count, 8 );
+
+    *outCount = count;
+    return values;
+    }
+
+
+
+inline long BinaryReader::read( unsigned char *inBuffer, long inNumBytes ) {
+    long numToRead = mLength - mPosition;
+
+    if( numToRead > inNumBytes ) {
+        numToRead = inNumBytes;
+        }
+    if( numToRead < inNumBytes ) {
+        mError = true;
+        }
+
+    memcpy( inBuffer, &( mData[ mPosition ] ), numToRead );
+    mPosition += numToRead;
+
+    return numToRead;
+    }
+
+
+
+inline char BinaryReader::isOK() {
+    return ! mError;
+    }
+
+
+
+inline long BinaryReader::getPosition() {
+    return mPosition;
+    }
+
+
+
+inline long BinaryReader::getNumRemaining() {
+    return mLength - mPosition;
+    }
+
+
+
+#endif
@@ -0,0 +1,388 @@
+#include "minorGems/common.h"
+
+
+#ifndef BINARY_WRITER_CLASS_INCLUDED
+#define BINARY_WRITER_CLASS_INCLUDED
+
+#include "OutputStream.h"
+
+#include "minorGems/system/endian.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+
+// first byte of every header written by BinaryWriter::writeHeader
+#define BINARY_HEADER_MAGIC 0xB5
+
+
+
+/**
+ * Writes values into a contiguous, growing buffer using a compact binary
+ * encoding:
+ *
+ * Unsigned integers are LEB128 varints (7 bits per byte, low bits first,
+ * high bit set on all but the last byte).  Signed integers are zigzag
+ * encoded first, so small negative values stay small.  Floats and doubles
+ * are fixed-size little-endian.  Strings and arrays are prefixed with a
+ * varint count.
+ *
+ * Is also an OutputStream, so code written against streams can write into
+ * the same buffer.  See BinaryReader.
+ *
+ * @author Jason Rohrer
+ */
+class BinaryWriter : public OutputStream {
+
+    public:
+
+        /**
+         * Constructs a writer with an empty buffer.
+         *
+         * @param inInitialSize the number of bytes to allocate at first.
+         *   Defaults to 256.
+         */
+        BinaryWriter( int inInitialSize = 256 );
+
+        virtual ~BinaryWriter();
+
+
+
+        /**
+         * Writes a header that identifies the data that follows.
+         *
+         * @param inSchemaID an ID for the kind of data written.
+         * @param inSchemaVersion the version of that data's layout.
+         */
+        void writeHeader( uint32_t inSchemaID, uint32_t inSchemaVersion );
+
+
+
+        void writeUInt8( uint8_t inValue );
+
+        void writeBool( char inValue );
+
+        void writeUVarint( uint64_t inValue );
+
+        // zigzag encoded
+        void writeVarint( int64_t inValue );
+
+        void writeFloat( float inValue );
+
+        void writeDouble( double inValue );
+
+
+
+        /**
+         * Writes bytes with a length prefix.
+         *
+         * @param inBytes the bytes to write.
+         *   Must be destroyed by caller.
+         * @param inLength the number of bytes.
+         */
+        void writeByteString( const unsigned char *inBytes, int inLength );
+
+
+        // writes a \0-terminated string with a length prefix, without the
+        // terminator
+        void writeText( const char *inString );
+
+
+
+        // arrays are written with a count prefix
+        // all must be destroyed by caller
+
+        void writeUInt8Array( const uint8_t *inValues, int inCount );
+
+        // each element zigzag encoded
+        void writeInt32Array( const int32_t *inValues, int inCount );
+
+        void writeFloatArray( const float *inValues, int inCount );
+
+        void writeDoubleArray( const double *inValues, int inCount );
+
+
+
+        // implements the OutputStream interface
+        // appends raw bytes, with no length prefix
+        virtual long write( unsigned char *inBuffer, long inNumBytes );
+
+
+
+        /**
+         * Gets the bytes written so far.
+         *
+         * @return the buffer.  Remains owned by this writer, and is valid
+         *   until the next write.
+         */
+        unsigned char *getData();
+
+        long getLength();
+
+
+        // empties the buffer, keeping its memory
+        void reset();
+
+
+
+        /**
+         * Writes the buffer to a stream with a varint length prefix, in
+         * a single write, to be read by BinaryReader::readFrame.
+         *
+         * @param inOutputStream the stream to write to.
+         *   Must be destroyed by caller.
+         *
+         * @return the number of bytes written, or -1 for a stream error.
+         */
+        long writeFrame( OutputStream *inOutputStream );
+
+
+    protected:
+
+        // makes room for inNumBytes more bytes
+        void ensureSpace( long inNumBytes );
+
+        // no size check
+        void putUVarint( uint64_t inValue );
+
+        // copies inCount elements of inElementSize bytes each,
+        // little-endian
+        void putLittleEndian( const void *inValues, int inCount,
+                              int inElementSize );
+
+
+        unsigned char *mData;
+        long mLength;
+        long mSize;
+
+    };
+
+
+
+inline BinaryWriter::BinaryWriter( int inInitialSize )
+    : mData( new unsigned char[ inInitialSize > 0 ? inInitialSize : 1 ] ),
+      mLength( 0 ),
+      mSize( inInitialSize > 0 ? inInitialSize : 1 ) {
+    }
+
+
+
+inline BinaryWriter::~BinaryWriter() {
+    delete [] mData;
+    }
+
+
+
+inline void BinaryWriter::ensureSpace( long inNumBytes ) {
+    if( mLength + inNumBytes <= mSize ) {
+        return;
+        }
+
+    long newSize = mSize * 2;
+    if( newSize < mLength + inNumBytes ) {
+        newSize = mLength + inNumBytes;
+        }
+
+    unsigned char *newData = new unsigned char[ newSize ];
+    memcpy( newData, mData, mLength );
+
+    delete [] mData;
+    mData = newData;
+    mSize = newSize;
+    }
+
+
+
+inline void BinaryWriter::putUVarint( uint64_t inValue ) {
+    while( inValue >= 0x80 ) {
+        mData[ mLength++ ] = (unsigned char)( inValue | 0x80 );
+        inValue >>= 7;
+        }
+    mData[ mLength++ ] = (unsigned char)inValue;
+    }
+
+
+
+inline void BinaryWriter::putLittleEndian( const void *inValues, int inCount,
+                                           int inElementSize ) {
+    long numBytes = (long)inCount * inElementSize;
+
+    memcpy( &( mData[ mLength ] ), inValues, numBytes );
+
+    if( inElementSize == 8 ) {
+        littleEndianArray64( &( mData[ mLength ] ), inCount );
+        }
+    else {
+        littleEndianArray32( &( mData[ mLength ] ), inCount );
+        }
+
+    mLength += numBytes;
+    }
+
+
+
+inline void BinaryWriter::writeHeader( uint32_t inSchemaID,
+                                       uint32_t inSchemaVersion ) {
+    ensureSpace( 11 );
+
+    mData[ mLength++ ] = BINARY_HEADER_MAGIC;
+    putUVarint( inSchemaID );
+    putUVarint( inSchemaVersion );
+    }
+
+
+
+inline void BinaryWriter::writeUInt8( uint8_t inValue ) {
+    ensureSpace( 1 );
+    mData[ mLength++ ] = inValue;
+    }
+
+
+
+inline void BinaryWriter::writeBool( char inValue ) {
+    writeUInt8( inValue ? 1 : 0 );
+    }
+
+
+
+inline void BinaryWriter::writeUVarint( uint64_t inValue ) {
+    ensureSpace( 10 );
+    putUVarint( inValue );
+    }
+
+
+
+inline void BinaryWriter::writeVarint( int64_t inValue ) {
+    ensureSpace( 10 );
+    putUVarint( ( (uint64_t)inValue << 1 ) ^ (uint64_t)( inValue >> 63 ) );
+    }
+
+
+
+inline void BinaryWriter::writeFloat( float inValue ) {
+    ensureSpace( 4 );
+    putLittleEndian( &inValue, 1, 4 );
+    }
+
+
+
+inline void BinaryWriter::writeDouble( double inValue ) {
+    ensureSpace( 8 );
+    putLittleEndian( &inValue, 1, 8 );
+    }
+
+
+
+inline void BinaryWriter::writeByteString( const unsigned char *inBytes,
+                                           int inLength ) {
+    ensureSpace( 10 + inLength );
+    putUVarint( inLength );
+
+    memcpy( &( mData[ mLength ] ), inBytes, inLength );
+    mLength += inLength;
+    }
+
+
+
+inline void BinaryWriter::writeText( const char *inString ) {
+    writeByteString( (const unsigned char *)inString, strlen( inString ) );
+    }
+
+
+
+inline void BinaryWriter::writeUInt8Array( const uint8_t *inValues,
+                                           int inCount ) {
+    writeByteString( inValues, inCount );
+    }
+
+
+
+inline void BinaryWriter::writeInt32Array( const int32_t *inValues,
+                                           int inCount ) {
+    // worst case is 5 bytes per element
+    ensureSpace( 10 + (long)inCount * 5 );
+    putUVarint( inCount );
+
+    for( int i=0; i<inCount; i++ ) {
+        int32_t v = inValues[i];
+        putUVarint( (uint32_t)( ( (uint32_t)v << 1 ) ^ (uint32_t)( v >> 31 ) ) );
+        }
+    }
+
+
+
+inline void BinaryWriter::writeFloatArray( const float *inValues,
+                                           int inCount ) {
+    ensureSpace( 10 + (long)inCount * 4 );
+    putUVarint( inCount );
+    putLittleEndian( inValues, inCount, 4 );
+    }
+
+
+
+inline void BinaryWriter::writeDoubleArray( const double *inValues,
+                                            int inCount ) {
+    ensureSpace( 10 + (long)inCount * 8 );
+    putUVarint( inCount );
+    putLittleEndian( inValues, inCount, 8 );
+    }
+
+
+
+inline long BinaryWriter::write( unsigned char *inBuffer, long inNumBytes ) {
+    ensureSpace( inNumBytes );
+
+    memcpy( &( mData[ mLength ] ), inBuffer, inNumBytes );
+    mLength += inNumBytes;
+
+    return inNumBytes;
+    }
+
+
+
+inline unsigned char *BinaryWriter::getData() {
+    return mData;
+    }
+
+
+
+inline long BinaryWriter::getLength() {
+    return mLength;
+    }
+
+
+
+inline void BinaryWriter::reset() {
+    mLength = 0;
+    }
+
+
+
+inline long BinaryWriter::writeFrame( OutputStream *inOutputStream ) {
+    // build the prefix in front of a copy, so the frame goes out in one
+    // write
+    unsigned char prefix[10];
+    int prefixLength = 0;
+
+    uint64_t length = mLength;
+    while( length >= 0x80 ) {
+        prefix[ prefixLength++ ] = (unsigned char)( length | 0x80 );
+        length >>= 7;
+        }
+    prefix[ prefixLength++ ] = (unsigned char)length;
+
+    unsigned char *frame = new unsigned char[ prefixLength + mLength ];
+    memcpy( frame, prefix, prefixLength );
+    memcpy( &( frame[ prefixLength ] ), mData, mLength );
+
+    long numWritten = inOutputStream->write( frame, prefixLength + mLength );
+
+    delete [] frame;
+
+    return numWritten;
+    }
+
+
+
+#endif
@@ -18,20 +18,60 @@
 #include "minorGems/io/InputStream.h"
 #include "minorGems/io/OutputStream.h"
 
-#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/util/ByteBuffer.h"
 
 #include <string.h>
 
+
+
+// a run of buffered bytes, as returned by PipedStream::peek
+typedef struct PipedStreamView {
+		unsigned char *data;
+		long length;
+	} PipedStreamView;
+
+
+
+// internal to PipedStream
+typedef struct PipedStreamSegment {
+		unsigned char *data;
+
+		// bytes written into data
+		long length;
+
+		// 0 for handed-over buffers, which are never appended to
+		long capacity;
+
+		long readPosition;
+
+		// holds the bytes of segments written with writeBuffer,
+		// null otherwise
+		ByteBuffer buffer;
+
+		PipedStreamSegment *next;
+	} PipedStreamSegment;
+
+
+
 /**
- * An input/output stream that can server as a pipe between
+ * An input/output stream that can serve as a pipe between
  * two components that read from and write to streams.
  *
- * Buffered internally to prevent blocking, so is compatible
- * with non-threaded components.  Note, however, that
- * ever buffer written to the stream is copied internally, 
- * so max memory usage is doubled.
+ * Data is kept in a chain of fixed-size segments that are reused as they
+ * are drained, so small writes are packed together and steady traffic
+ * does not allocate.  Buffers handed over with writeOwned or
+ * writeBuffer join the chain without being copied, and readBuffer hands
+ * pooled buffers back out the same way.
  *
- * IS NOT THREAD-SAFE!
+ * Thread-safe:  one or more threads can write while others read.  By
+ * default the stream is unbounded and reads never block, which is
+ * compatible with non-threaded components.  A bounded stream blocks
+ * writers while full, and a blocking stream blocks readers until all
+ * requested bytes arrive or the stream is closed.
  *
  * @author Jason Rohrer
  */ 
@@ -41,8 +81,15 @@ class PipedStream : public InputStream, public OutputStream {
 		
 		/**
 		 * Constructs a PipedStream.
+		 *
+		 * @param inMaxBufferedBytes the most unread bytes to hold before
+		 *   writes block, or -1 for no limit.  Defaults to -1.
+		 * @param inBlockingReads true to make read() wait for all
+		 *   requested bytes, false to return what is available.
+		 *   Defaults to false.
 		 */
-		PipedStream();
+		PipedStream( long inMaxBufferedBytes = -1,
+					 char inBlockingReads = false );
 		
 		/**
 		 * Destroys any pending unread buffers.
@@ -53,124 +100,658 @@ class PipedStream : public InputStream, public OutputStream {
 		
 		
 		// implements the InputStream interface
+		// returns -1 if the stream is closed and empty
 		long read( unsigned char *inBuffer, long inNumBytes );
 		
 		
 		// implements the OutputStream interface
+		// returns -1 if the stream has been closed
 		long write( unsigned char *inBuffer, long inNumBytes );
 		
 		
+
+		/**
+		 * Writes a buffer without copying it.
+		 *
+		 * Blocks like write() on a bounded stream, except that a buffer
+		 * bigger than the bound is accepted once the stream is empty.
+		 *
+		 * @param inBuffer the bytes to write.
+		 *   Will be destroyed by this class.
+		 * @param inNumBytes the number of bytes in inBuffer.
+		 *
+		 * @return inNumBytes, or -1 if the stream has been closed.
+		 */
+		long writeOwned( unsigned char *inBuffer, long inNumBytes );
+
+
+
+		/**
+		 * Writes a pooled buffer without copying it.  The stream keeps
+		 * a reference until the bytes are read.
+		 *
+		 * Blocks like writeOwned.
+		 *
+		 * @param inBuffer the bytes to write.
+		 *
+		 * @return the number of bytes written, or -1 if the stream has
+		 *   been closed.
+		 */
+		long writeBuffer( ByteBuffer inBuffer );
+
+
+
+		/**
+		 * Reads whatever is available, without blocking for the rest.
+		 *
+		 * @param inBuffer the buffer where read bytes will be put.
+		 * @param inMaxBytes the most bytes to read.  Can be 0 to just
+		 *   wait for data.
+		 * @param inTimeoutInMilliseconds how long to wait for the first
+		 *   byte if the stream is empty, or -1 to wait forever.
+		 *   Defaults to 0.
+		 *
+		 * @return the number of bytes read, or -1 if the stream is
+		 *   closed and empty.
+		 */
+		long readAvailable( unsigned char *inBuffer, long inMaxBytes,
+							int inTimeoutInMilliseconds = 0 );
+
+
+
+		/**
+		 * Like readAvailable, but reads into a pooled buffer.
+		 *
+		 * @return the bytes read, which can be empty, or a null buffer
+		 *   if the stream is closed and empty.
+		 */
+		ByteBuffer readBuffer( long inMaxBytes,
+							   int inTimeoutInMilliseconds = 0 );
+
+
+
+		/**
+		 * Gets the buffered bytes in place, without consuming them.
+		 *
+		 * Views stay valid until the bytes they cover are consumed.
+		 * Only one thread should read from a stream that is peeked.
+		 *
+		 * @param outViews array where views will be put.
+		 *   Must be destroyed by caller.
+		 * @param inMaxViews the size of outViews.
+		 *
+		 * @return the number of views filled in.
+		 */
+		int peek( PipedStreamView *outViews, int inMaxViews );
+
+
+		/**
+		 * Discards bytes from the front of the stream, typically after
+		 * handling them through peek.
+		 *
+		 * @param inNumBytes the number of bytes to discard.  Clamped to
+		 *   the number buffered.
+		 */
+		void consume( long inNumBytes );
+
+
+
+		/**
+		 * Gets the number of unread bytes.
+		 */
+		long getNumBufferedBytes();
+
+
+
+		/**
+		 * Marks the end of the data.  Further writes fail, and readers
+		 * get what remains, then -1.  Wakes all blocked threads.
+		 */
+		void close();
+
+
 	protected:
-		SimpleVector<unsigned char *> *mBuffers;	
-		SimpleVector<long> *mBufferSizes;
 		
-		long mCurrentBufferIndex;
+		// size of the segments that copied writes go into
+		static const long mSegmentSize = 16384;
+
+		// most drained segments kept for reuse
+		static const int mMaxFreeSegments = 16;
+
+
+		// both must be called with mLock held
+
+		// copies up to inNumBytes out of the front of the stream
+		long takeBytes( unsigned char *inBuffer, long inNumBytes );
+
+		void releaseSegment( PipedStreamSegment *inSegment );
+
+		// frees a segment that is not going to be reused
+		void deleteSegment( PipedStreamSegment *inSegment );
+
+		// adds a segment whose bytes were handed over, waiting for
+		// space on a bounded stream
+		// deletes the segment and returns -1 if the stream is closed
+		// must be called without mLock held
+		long appendHandedOverSegment( PipedStreamSegment *inSegment );
+
+
+		// to be called before blocking with mLock held
+		// releases mLock while waiting
+		void waitOn( BinarySemaphore *inSemaphore,
+					 int inTimeoutInMilliseconds = -1 );
+
+		// waits until data arrives, the stream closes, or the timeout
+		// passes (negative to wait forever)
+		// mDataSemaphore can hold a stale signal from an earlier reader,
+		// so one wake-up doesn't mean there is data
+		void waitForData( int inTimeoutInMilliseconds );
+
+
+		long mMaxBufferedBytes;
+		char mBlockingReads;
+
+		MutexLock mLock;
+
+		// signaled when data arrives or the stream closes
+		BinarySemaphore mDataSemaphore;
+
+		// signaled when data is consumed or the stream closes
+		BinarySemaphore mSpaceSemaphore;
+
+		PipedStreamSegment *mHead;
+		PipedStreamSegment *mTail;
+
+		PipedStreamSegment *mFreeSegments;
+		int mNumFreeSegments;
+
+		long mNumBufferedBytes;
+
+		char mClosed;
 		
 	};		
 
 
 
-inline PipedStream::PipedStream()
-	: mBuffers( new SimpleVector<unsigned char*>() ),
-	mBufferSizes( new SimpleVector<long>() ),
-	mCurrentBufferIndex( 0 ) {
+inline PipedStream::PipedStream( long inMaxBufferedBytes,
+								 char inBlockingReads )
+	: mMaxBufferedBytes( inMaxBufferedBytes ),
+	mBlockingReads( inBlockingReads ),
+	mHead( NULL ), mTail( NULL ),
+	mFreeSegments( NULL ), mNumFreeSegments( 0 ),
+	mNumBufferedBytes( 0 ),
+	mClosed( false ) {
 	
 	}
 
 		
 
 inline PipedStream::~PipedStream() {
-	int numRemaining = mBuffers->size();
-	for( int i=0; i<numRemaining; i++ ) {
-		unsigned char *buffer = *( mBuffers->getElement( i ) );
+	PipedStreamSegment *lists[2] = { mHead, mFreeSegments };
 		
-		delete [] buffer;
+	for( int i=0; i<2; i++ ) {
+		PipedStreamSegment *segment = lists[i];
+
+		while( segment != NULL ) {
+			PipedStreamSegment *next = segment->next;
+
+			deleteSegment( segment );
+
+			segment = next;
+			}
 		}
-	delete mBuffers;
-	delete mBufferSizes;
+	}
+
+
+
+inline void PipedStream::waitOn( BinarySemaphore *inSemaphore,
+								 int inTimeoutInMilliseconds ) {
+	mLock.unlock();
+	inSemaphore->wait( inTimeoutInMilliseconds );
+	mLock.lock();
+	}
+
+
+
+inline void PipedStream::waitForData( int inTimeoutInMilliseconds ) {
+	double startTime = Time::getCurrentTime();
+
+	while( mHead == NULL && ! mClosed ) {
+		int timeLeft = -1;
+
+		if( inTimeoutInMilliseconds >= 0 ) {
+			timeLeft = inTimeoutInMilliseconds -
+				(int)( ( Time::getCurrentTime() - startTime ) * 1000 );
+
+			if( timeLeft <= 0 ) {
+				return;
+				}
+			}
+
+		waitOn( &mDataSemaphore, timeLeft );
+		}
+	}
+
+
+
+inline void PipedStream::releaseSegment( PipedStreamSegment *inSegment ) {
+	if( inSegment->capacity == mSegmentSize &&
+		mNumFreeSegments < mMaxFreeSegments ) {
+
+		inSegment->length = 0;
+		inSegment->readPosition = 0;
+		inSegment->next = mFreeSegments;
+		mFreeSegments = inSegment;
+		mNumFreeSegments++;
+		}
+	else {
+		deleteSegment( inSegment );
+		}
+	}
+
+
+
+inline void PipedStream::deleteSegment( PipedStreamSegment *inSegment ) {
+	if( inSegment->buffer.isNull() ) {
+		delete [] inSegment->data;
+		}
+	// else the buffer's reference is dropped with the segment
+
+	delete inSegment;
+	}
+
+
+
+inline long PipedStream::takeBytes( unsigned char *inBuffer,
+									long inNumBytes ) {
+	long numTaken = 0;
+
+	while( numTaken < inNumBytes && mHead != NULL ) {
+		PipedStreamSegment *segment = mHead;
+
+		long numInSegment = segment->length - segment->readPosition;
+		long numToTake = inNumBytes - numTaken;
+
+		if( numToTake > numInSegment ) {
+			numToTake = numInSegment;
+			}
+
+		if( inBuffer != NULL ) {
+			memcpy( &( inBuffer[ numTaken ] ),
+					&( segment->data[ segment->readPosition ] ),
+					numToTake );
+			}
+
+		segment->readPosition += numToTake;
+		numTaken += numToTake;
+
+		if( segment->readPosition == segment->length ) {
+			mHead = segment->next;
+			if( mHead == NULL ) {
+				mTail = NULL;
+				}
+			releaseSegment( segment );
+			}
+		}
+
+	mNumBufferedBytes -= numTaken;
+
+	if( numTaken > 0 ) {
+		mSpaceSemaphore.signal();
+		}
+
+	return numTaken;
 	}
 		
 		
 
 inline long PipedStream::read( unsigned char *inBuffer, long inNumBytes ) {
-	if( mBuffers->size() == 0 ) {
+	mLock.lock();
+
+	long numRead = takeBytes( inBuffer, inNumBytes );
+
+	while( mBlockingReads && numRead < inNumBytes && ! mClosed ) {
+		waitOn( &mDataSemaphore );
+
+		numRead += takeBytes( &( inBuffer[ numRead ] ),
+							  inNumBytes - numRead );
+		}
+
+	if( mHead != NULL || mClosed ) {
+		// pass the wake-up on to any other blocked reader
+		mDataSemaphore.signal();
+		}
+
+	if( numRead == 0 && mClosed && inNumBytes > 0 ) {
+		InputStream::setNewLastErrorConst( "Piped stream closed." );
+		numRead = -1;
+		}
+	else if( numRead == 0 && inNumBytes > 0 ) {
 		// none read, since no buffers available
 		InputStream::
 			setNewLastErrorConst( "No data available on piped stream read." );
-		return 0;
 		}
-	else {
-		
-		unsigned char *currentBuffer = *( mBuffers->getElement( 0 ) );
-		long currentBufferSize = *( mBufferSizes->getElement( 0 ) ); 
-
-		long outputIndex = 0;
-
-		while( outputIndex < inNumBytes ) {
-			long bytesRemaining = inNumBytes - outputIndex;
-
-			long bytesRemainingInCurrent = currentBufferSize - mCurrentBufferIndex;
-
-			// if current buffer isn't big enough to fill output
-			if( bytesRemaining >= bytesRemainingInCurrent ) {
-				// copy all of current buffer into inBuffer
-				memcpy( &( inBuffer[outputIndex] ), 
-					&( currentBuffer[mCurrentBufferIndex] ), 
-					bytesRemainingInCurrent );
-
-				outputIndex += bytesRemainingInCurrent;
-
-				// delete the current buffer
-				mBuffers->deleteElement( 0 );
-				mBufferSizes->deleteElement( 0 );
-				delete [] currentBuffer;
-				
-				mCurrentBufferIndex = 0;
-				
-				if( outputIndex != inNumBytes && mBuffers->size() == 0 ) {
-					// partial read, since no more buffers available
-					InputStream::setNewLastErrorConst( 
-						"Partial data available on piped stream read." );
-					return outputIndex;
-					}
-				if( mBuffers->size() != 0 ) {
-					// get the new current buffer 
-					currentBuffer = *( mBuffers->getElement( 0 ) );
-					currentBufferSize = *( mBufferSizes->getElement( 0 ) );
-					}
+	else if( numRead < inNumBytes ) {
+		InputStream::setNewLastErrorConst(
+			"Partial data available on piped stream read." );
+		}
+
+	mLock.unlock();
+
+	return numRead;
+	}
+
+
+
+inline long PipedStream::readAvailable( unsigned char *inBuffer,
+										long inMaxBytes,
+										int inTimeoutInMilliseconds ) {
+	mLock.lock();
+
+	if( inTimeoutInMilliseconds != 0 ) {
+		waitForData( inTimeoutInMilliseconds );
+		}
+
+	long numRead = takeBytes( inBuffer, inMaxBytes );
+
+	if( mHead != NULL || mClosed ) {
+		mDataSemaphore.signal();
+		}
+
+	if( numRead == 0 && mClosed && mHead == NULL ) {
+		InputStream::setNewLastErrorConst( "Piped stream closed." );
+		numRead = -1;
+		}
+
+	mLock.unlock();
+
+	return numRead;
+	}
+
+
+
+inline ByteBuffer PipedStream::readBuffer( long inMaxBytes,
+										  int inTimeoutInMilliseconds ) {
+	mLock.lock();
+
+	if( inTimeoutInMilliseconds != 0 ) {
+		waitForData( inTimeoutInMilliseconds );
+		}
+
+	ByteBuffer result;
+
+	if( mHead != NULL ) {
+		long numToTake = inMaxBytes;
+
+		if( ! mHead->buffer.isNull() ) {
+			// hand back the written buffer itself
+			long numInSegment = mHead->length - mHead->readPosition;
+
+			if( numToTake > numInSegment ) {
+				numToTake = numInSegment;
 				}
-			else {
-				// current buffer is bigger
-				memcpy( &( inBuffer[outputIndex] ), 
-					&( currentBuffer[mCurrentBufferIndex] ), 
-					bytesRemaining );
-				
-				mCurrentBufferIndex += bytesRemaining;
-				outputIndex += bytesRemaining;
+
+			result = mHead->buffer.slice( (int)mHead->readPosition,
+										  (int)numToTake );
+			takeBytes( NULL, numToTake );
+			}
+		else {
+			// copy out of segments up to the next handed-over buffer
+			long numCopyable = 0;
+
+			PipedStreamSegment *segment = mHead;
+
+			while( segment != NULL && segment->buffer.isNull() ) {
+				numCopyable += segment->length - segment->readPosition;
+				segment = segment->next;
 				}
 
-			} // end while
-		
-		// if we made it out of the while loop, we read all bytes
-		return inNumBytes;
+			if( numToTake > numCopyable ) {
+				numToTake = numCopyable;
+				}
+
+			result = ByteBuffer( (int)numToTake );
+			result.setLength(
+				(int)takeBytes( result.getData(), numToTake ) );
+			}
+		}
+	else if( ! mClosed ) {
+		// nothing yet
+		result = ByteBuffer( 0 );
+		}
+	else {
+		InputStream::setNewLastErrorConst( "Piped stream closed." );
+		}
 		
-		} // end else
+	if( mHead != NULL || mClosed ) {
+		mDataSemaphore.signal();
+		}
+
+	mLock.unlock();
+
+	return result;
 	}
 	
 		
 		
 inline long PipedStream::write( unsigned char *inBuffer, long inNumBytes ) {
-	// add a copy of the buffer to the vector of buffers
-	unsigned char *copy = new unsigned char[ inNumBytes ];
+	mLock.lock();
 	
-	memcpy( copy, inBuffer, inNumBytes );
+	long numWritten = 0;
 	
-	mBuffers->push_back( copy );
-	mBufferSizes->push_back( inNumBytes );
+	while( numWritten < inNumBytes ) {
+
+		if( mClosed ) {
+			OutputStream::setNewLastErrorConst( "Piped stream closed." );
+			// pass the wake-up on to any other blocked writer
+			mSpaceSemaphore.signal();
+			mLock.unlock();
+			return -1;
+			}
+
+		long numToCopy = inNumBytes - numWritten;
+
+		if( mMaxBufferedBytes >= 0 ) {
+			long spaceLeft = mMaxBufferedBytes - mNumBufferedBytes;
+
+			if( spaceLeft <= 0 ) {
+				waitOn( &mSpaceSemaphore );
+				continue;
+				}
+			if( numToCopy > spaceLeft ) {
+				numToCopy = spaceLeft;
+				}
+			}
+
+		PipedStreamSegment *segment = mTail;
+
+		// owned segments (capacity 0) can't be appended to
+		if( segment == NULL || segment->capacity == 0 ||
+			segment->length >= segment->capacity ) {
+			// start a new segment
+			if( mFreeSegments != NULL ) {
+				segment = mFreeSegments;
+				mFreeSegments = segment->next;
+				mNumFreeSegments--;
+				}
+			else {
+				segment = new PipedStreamSegment;
+				segment->data = new unsigned char[ mSegmentSize ];
+				segment->capacity = mSegmentSize;
+				segment->length = 0;
+				segment->readPosition = 0;
+				}
+			segment->next = NULL;
+
+			if( mTail == NULL ) {
+				mHead = segment;
+				}
+			else {
+				mTail->next = segment;
+				}
+			mTail = segment;
+			}
+
+		long segmentSpace = segment->capacity - segment->length;
+
+		if( numToCopy > segmentSpace ) {
+			numToCopy = segmentSpace;
+			}
+
+		memcpy( &( segment->data[ segment->length ] ),
+				&( inBuffer[ numWritten ] ), numToCopy );
+
+		segment->length += numToCopy;
+		numWritten += numToCopy;
+		mNumBufferedBytes += numToCopy;
+
+		mDataSemaphore.signal();
+		}
+
+	if( mMaxBufferedBytes >= 0 && mNumBufferedBytes < mMaxBufferedBytes ) {
+		// pass the wake-up on to any other blocked writer
+		mSpaceSemaphore.signal();
+		}
+
+	mLock.unlock();
 	
 	return inNumBytes;
 	}
 	
 	
 	
+inline long PipedStream::writeOwned( unsigned char *inBuffer,
+									 long inNumBytes ) {
+	PipedStreamSegment *segment = new PipedStreamSegment;
+	segment->data = inBuffer;
+	segment->length = inNumBytes;
+
+	return appendHandedOverSegment( segment );
+	}
+
+
+
+inline long PipedStream::writeBuffer( ByteBuffer inBuffer ) {
+	PipedStreamSegment *segment = new PipedStreamSegment;
+	segment->data = inBuffer.getData();
+	segment->length = inBuffer.getLength();
+	segment->buffer = inBuffer;
+
+	return appendHandedOverSegment( segment );
+	}
+
+
+
+inline long PipedStream::appendHandedOverSegment(
+	PipedStreamSegment *inSegment ) {
+
+	long numBytes = inSegment->length;
+
+	inSegment->capacity = 0;
+	inSegment->readPosition = 0;
+	inSegment->next = NULL;
+
+	mLock.lock();
+
+	while( ! mClosed && mMaxBufferedBytes >= 0 &&
+		   mNumBufferedBytes > 0 &&
+		   mNumBufferedBytes + numBytes > mMaxBufferedBytes ) {
+
+		waitOn( &mSpaceSemaphore );
+		}
+
+	if( mClosed ) {
+		OutputStream::setNewLastErrorConst( "Piped stream closed." );
+		mSpaceSemaphore.signal();
+		mLock.unlock();
+
+		deleteSegment( inSegment );
+		return -1;
+		}
+
+	if( numBytes == 0 ) {
+		mLock.unlock();
+
+		deleteSegment( inSegment );
+		return 0;
+		}
+
+	if( mTail == NULL ) {
+		mHead = inSegment;
+		}
+	else {
+		mTail->next = inSegment;
+		}
+	mTail = inSegment;
+
+	mNumBufferedBytes += numBytes;
+
+	mDataSemaphore.signal();
+
+	mLock.unlock();
+
+	return numBytes;
+	}
+
+
+
+inline int PipedStream::peek( PipedStreamView *outViews, int inMaxViews ) {
+	mLock.lock();
+
+	int numViews = 0;
+
+	PipedStreamSegment *segment = mHead;
+
+	while( segment != NULL && numViews < inMaxViews ) {
+		outViews[ numViews ].data =
+			&( segment->data[ segment->readPosition ] );
+		outViews[ numViews ].length =
+			segment->length - segment->readPosition;
+
+		numViews++;
+		segment = segment->next;
+		}
+
+	mLock.unlock();
+
+	return numViews;
+	}
+
+
+
+inline void PipedStream::consume( long inNumBytes ) {
+	mLock.lock();
+
+	takeBytes( NULL, inNumBytes );
+
+	mLock.unlock();
+	}
+
+
+
+inline long PipedStream::getNumBufferedBytes() {
+	mLock.lock();
+
+	long numBytes = mNumBufferedBytes;
+
+	mLock.unlock();
+
+	return numBytes;
+	}
+
+
+
+inline void PipedStream::close() {
+	mLock.lock();
+
+	mClosed = true;
+
+	mDataSemaphore.signal();
+	mSpaceSemaphore.signal();
+
+	mLock.unlock();
+	}
+
+
+
 #endif
@@ -25,6 +25,8 @@
 
 #include "InputStream.h"
 #include "OutputStream.h"
+#include "BinaryWriter.h"
+#include "BinaryReader.h"
 
 /**
  * Interface for an object that can be serialized to and deserialized
@@ -64,6 +66,30 @@ class Serializable {
 		virtual int deserialize( InputStream *inInputStream ) = 0;
 		
 
+
+		/**
+		 * Writes this object into a buffer in compact binary form, with
+		 * no per-field stream calls.
+		 *
+		 * The default implementation writes what serialize() would.
+		 * Subclasses override this with a varint encoding.
+		 *
+		 * @param inWriter the writer to write to.
+		 */
+		virtual void serializeBinary( BinaryWriter *inWriter );
+		
+		
+		/**
+		 * Reads this object from data written by serializeBinary.
+		 *
+		 * @param inReader the reader to read from.
+		 *
+		 * @return true on success, or false if the data was short or
+		 *   malformed.
+		 */
+		virtual char deserializeBinary( BinaryReader *inReader );
+		
+
         
         virtual ~Serializable();
         
@@ -75,6 +101,20 @@ inline Serializable::~Serializable() {
     // does nothing
     // exists to ensure that subclass destructors are called
     }
+
+
+
+inline void Serializable::serializeBinary( BinaryWriter *inWriter ) {
+	serialize( inWriter );
+	}
+
+
+
+inline char Serializable::deserializeBinary( BinaryReader *inReader ) {
+	deserialize( inReader );
+	
+	return inReader->isOK();
+	}
 	
 
 
@@ -18,6 +18,10 @@
 #ifndef TYPE_IO_INCLUDED
 #define TYPE_IO_INCLUDED
 
+
+#include "minorGems/system/endian.h"
+
+
 /**
  * Interfaces for platform-independent type input and output.
  *
@@ -97,6 +101,39 @@ class TypeIO {
 		 * @return the double represented by the bytes.
 		 */
 		static double bytesToDouble( unsigned char *inBytes );
+
+
+
+		/**
+		 * Converts arrays of 32-bit integers to and from bytes in the
+		 * same format as longToBytes, a whole array at a time.
+		 *
+		 * @param inInts/outInts the integers.
+		 * @param inBytes/outBytes 4 bytes per integer.
+		 * @param inNumInts the number of integers.
+		 * All must be destroyed by caller.
+		 */
+		static void longsToBytes( long *inInts, int inNumInts,
+								  unsigned char *outBytes );
+		
+		static void bytesToLongs( unsigned char *inBytes, int inNumInts,
+								  long *outInts );
+
+
+		/**
+		 * Converts arrays of 16-bit integers to and from bytes in the
+		 * same format as shortToBytes, a whole array at a time.
+		 *
+		 * @param inShorts/outShorts the integers.
+		 * @param inBytes/outBytes 2 bytes per integer.
+		 * @param inNumShorts the number of integers.
+		 * All must be destroyed by caller.
+		 */
+		static void shortsToBytes( short *inShorts, int inNumShorts,
+								   unsigned char *outBytes );
+		
+		static void bytesToShorts( unsigned char *inBytes, int inNumShorts,
+								   short *outShorts );
 		
 	};		
 
@@ -108,17 +145,13 @@ class TypeIO {
 inline void TypeIO::longToBytes( long inInt, 
 	unsigned char *outBytes ) {
 	// use a big-endian conversion
-	outBytes[0] = (unsigned char)( inInt >> 24 & 0xFF );
-	outBytes[1] = (unsigned char)( inInt >> 16 & 0xFF );
-	outBytes[2] = (unsigned char)( inInt >> 8 & 0xFF );
-	outBytes[3] = (unsigned char)( inInt & 0xFF );
+	storeBigEndian32( outBytes, (uint32_t)inInt );
 	} 
 
 
 
 inline long TypeIO::bytesToLong( unsigned char *inBytes ) {
-	return (long)( inBytes[0] << 24 | 
-		inBytes[1] << 16 | inBytes[2] << 8 | inBytes[3] );
+	return (long)(int32_t)loadBigEndian32( inBytes );
 	}
 
 
@@ -126,14 +159,48 @@ inline long TypeIO::bytesToLong( unsigned char *inBytes ) {
 inline void TypeIO::shortToBytes( short inInt, 
 	unsigned char *outBytes ) {
 	// use a big-endian conversion
-	outBytes[0] = (unsigned char)( inInt >> 8 & 0xFF );
-	outBytes[1] = (unsigned char)( inInt & 0xFF );
+	storeBigEndian16( outBytes, (uint16_t)inInt );
 	} 
 
 
 
 inline short TypeIO::bytesToShort( unsigned char *inBytes ) {
-	return (short)( inBytes[0] << 8 | inBytes[1] );
+	return (short)loadBigEndian16( inBytes );
+	}
+
+
+
+inline void TypeIO::longsToBytes( long *inInts, int inNumInts,
+								  unsigned char *outBytes ) {
+	// long may be wider than 4 bytes, so narrow each one
+	for( int i=0; i<inNumInts; i++ ) {
+		storeBigEndian32( &( outBytes[ i * 4 ] ), (uint32_t)inInts[i] );
+		}
+	}
+
+
+
+inline void TypeIO::bytesToLongs( unsigned char *inBytes, int inNumInts,
+								  long *outInts ) {
+	for( int i=0; i<inNumInts; i++ ) {
+		outInts[i] = (long)(int32_t)loadBigEndian32( &( inBytes[ i * 4 ] ) );
+		}
+	}
+
+
+
+inline void TypeIO::shortsToBytes( short *inShorts, int inNumShorts,
+								   unsigned char *outBytes ) {
+	memcpy( outBytes, inShorts, inNumShorts * 2 );
+	bigEndianArray16( outBytes, inNumShorts );
+	}
+
+
+
+inline void TypeIO::bytesToShorts( unsigned char *inBytes, int inNumShorts,
+								   short *outShorts ) {
+	memcpy( outShorts, inBytes, inNumShorts * 2 );
+	bigEndianArray16( outShorts, inNumShorts );
 	}
 
 
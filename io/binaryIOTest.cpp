@@ -0,0 +1,234 @@
+// Checks BinaryWriter/BinaryReader round trips, including the binary
+// Serializable fast paths, and compares sizes and speed against the
+// stream encoding.
+
+
+#include "BinaryWriter.h"
+#include "BinaryReader.h"
+
+#include "minorGems/network/HostAddress.h"
+#include "minorGems/network/Message.h"
+#include "minorGems/graphics/Image.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+static void testValues() {
+    BinaryWriter writer( 4 );
+
+    writer.writeHeader( 77, 3 );
+
+    uint64_t unsignedValues[6] = { 0, 1, 127, 128, 300, 0xFFFFFFFFFFFFFFFFULL };
+    int64_t signedValues[6] = { 0, -1, 1, -64, 64,
+                                (int64_t)0x8000000000000000ULL };
+
+    for( int i=0; i<6; i++ ) {
+        writer.writeUVarint( unsignedValues[i] );
+        writer.writeVarint( signedValues[i] );
+        }
+
+    writer.writeFloat( 1.5f );
+    writer.writeDouble( -2.25 );
+    writer.writeBool( true );
+    writer.writeText( "hello" );
+
+    int32_t ints[5] = { 0, -1, 1000, -100000, 2147483647 };
+    float floats[3] = { 0.5f, -1.0f, 3.25f };
+    double doubles[2] = { 1e100, -1e-100 };
+
+    writer.writeInt32Array( ints, 5 );
+    writer.writeFloatArray( floats, 3 );
+    writer.writeDoubleArray( doubles, 2 );
+
+
+    BinaryReader reader( writer.getData(), writer.getLength() );
+
+    check( reader.readHeader( 77, 5 ) == 3, "header" );
+
+    for( int i=0; i<6; i++ ) {
+        check( reader.readUVarint() == unsignedValues[i], "uvarint" );
+        check( reader.readVarint() == signedValues[i], "varint" );
+        }
+
+    check( reader.readFloat() == 1.5f, "float" );
+    check( reader.readDouble() == -2.25, "double" );
+    check( reader.readBool(), "bool" );
+
+    char *text = reader.readText();
+    check( text != NULL && strcmp( text, "hello" ) == 0, "text" );
+    if( text != NULL ) {
+        delete [] text;
+        }
+
+    int count;
+    int32_t *readInts = reader.readInt32Array( &count );
+    check( readInts != NULL && count == 5 &&
+           memcmp( readInts, ints, sizeof( ints ) ) == 0, "int32 array" );
+    if( readInts != NULL ) {
+        delete [] readInts;
+        }
+
+    float *readFloats = reader.readFloatArray( &count );
+    check( readFloats != NULL && count == 3 &&
+           memcmp( readFloats, floats, sizeof( floats ) ) == 0,
+           "float array" );
+    if( readFloats != NULL ) {
+        delete [] readFloats;
+        }
+
+    double *readDoubles = reader.readDoubleArray( &count );
+    check( readDoubles != NULL && count == 2 &&
+           memcmp( readDoubles, doubles, sizeof( doubles ) ) == 0,
+           "double array" );
+    if( readDoubles != NULL ) {
+        delete [] readDoubles;
+        }
+
+    check( reader.isOK() && reader.getNumRemaining() == 0, "all read" );
+
+    // reading past the end sets the error
+    reader.readUVarint();
+    check( ! reader.isOK(), "overrun detected" );
+
+
+    // wrong schema and future versions are rejected
+    BinaryReader wrongID( writer.getData(), writer.getLength() );
+    check( wrongID.readHeader( 78, 5 ) == -1, "wrong schema ID" );
+
+    BinaryReader newer( writer.getData(), writer.getLength() );
+    check( newer.readHeader( 77, 2 ) == -1, "newer version" );
+
+
+    // a length prefix bigger than the data is caught before allocating
+    BinaryWriter bad;
+    bad.writeUVarint( 1000000000 );
+    BinaryReader badReader( bad.getData(), bad.getLength() );
+    check( badReader.readText() == NULL && ! badReader.isOK(),
+           "bad length" );
+    }
+
+
+
+static void testSerializables() {
+    BinaryWriter streamWriter;
+    BinaryWriter binaryWriter;
+
+
+    HostAddress address( stringDuplicate( "192.168.1.20" ), 8005 );
+
+    address.serialize( &streamWriter );
+    address.serializeBinary( &binaryWriter );
+
+    printf( "HostAddress:  %ld bytes as stream, %ld as binary\n",
+            streamWriter.getLength(), binaryWriter.getLength() );
+
+    HostAddress readAddress;
+    BinaryReader addressReader( binaryWriter.getData(),
+                                binaryWriter.getLength() );
+
+    check( readAddress.deserializeBinary( &addressReader ) &&
+           strcmp( readAddress.mAddressString, "192.168.1.20" ) == 0 &&
+           readAddress.mPort == 8005, "HostAddress round trip" );
+
+
+    streamWriter.reset();
+    binaryWriter.reset();
+
+    Message message;
+    message.mOpcode = 12;
+
+    message.serialize( &streamWriter );
+    message.serializeBinary( &binaryWriter );
+
+    printf( "Message:      %ld bytes as stream, %ld as binary\n",
+            streamWriter.getLength(), binaryWriter.getLength() );
+
+    Message readMessage;
+    BinaryReader messageReader( binaryWriter.getData(),
+                                binaryWriter.getLength() );
+
+    check( readMessage.deserializeBinary( &messageReader ) &&
+           readMessage.mOpcode == 12, "Message round trip" );
+
+
+    streamWriter.reset();
+    binaryWriter.reset();
+
+    Image image( 64, 32, 3 );
+    for( int c=0; c<3; c++ ) {
+        double *channel = image.getChannel( c );
+        for( int p=0; p<64 * 32; p++ ) {
+            channel[p] = ( ( p * ( c + 1 ) ) % 256 ) / 255.0;
+            }
+        }
+
+    image.serialize( &streamWriter );
+    image.serializeBinary( &binaryWriter );
+
+    printf( "Image:        %ld bytes as stream, %ld as binary\n",
+            streamWriter.getLength(), binaryWriter.getLength() );
+
+    Image readImage( 1, 1, 1 );
+    BinaryReader imageReader( binaryWriter.getData(),
+                              binaryWriter.getLength() );
+
+    check( readImage.deserializeBinary( &imageReader ) &&
+           readImage.getWidth() == 64 && readImage.getHeight() == 32 &&
+           readImage.getNumChannels() == 3 &&
+           memcmp( readImage.getChannel( 2 ), image.getChannel( 2 ),
+                   64 * 32 * sizeof( double ) ) == 0,
+           "Image round trip" );
+
+    // truncated data fails cleanly
+    BinaryReader shortReader( binaryWriter.getData(),
+                              binaryWriter.getLength() - 1 );
+    check( ! readImage.deserializeBinary( &shortReader ),
+           "truncated Image" );
+    }
+
+
+
+static void timeFields() {
+    int numValues = 10000000;
+
+    BinaryWriter writer( numValues * 4 );
+
+    double startTime = Time::getCurrentTime();
+
+    for( int i=0; i<numValues; i++ ) {
+        writer.writeLong( i % 1000 );
+        }
+
+    double streamTime = Time::getCurrentTime() - startTime;
+    long streamLength = writer.getLength();
+
+    writer.reset();
+
+    startTime = Time::getCurrentTime();
+
+    for( int i=0; i<numValues; i++ ) {
+        writer.writeVarint( i % 1000 );
+        }
+
+    double binaryTime = Time::getCurrentTime() - startTime;
+
+    printf( "%d small ints:  writeLong %ld bytes %.1f ms, "
+            "writeVarint %ld bytes %.1f ms\n",
+            numValues, streamLength, streamTime * 1000,
+            writer.getLength(), binaryTime * 1000 );
+    }
+
+
+
+int main() {
+    testValues();
+    testSerializables();
+    timeFields();
+
+    return reportChecks();
+    }
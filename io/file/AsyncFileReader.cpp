@@ -0,0 +1,746 @@
+#include "minorGems/io/file/AsyncFileReader.h"
+
+#include "minorGems/io/file/File.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/ThreadPool.h"
+#include "minorGems/util/stringUtils.h"
+
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASYNC_FILE_READER_IO_URING
+#endif
+#endif
+
+
+#ifdef ASYNC_FILE_READER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+
+
+AsyncFileReader::AsyncFileReader( BinarySemaphore *inCompletionSignal )
+        : mNextCompletionIndex( 0 ),
+          mCompletionSignal( inCompletionSignal ) {
+    }
+
+
+
+AsyncFileReader::~AsyncFileReader() {
+    for( int i=mNextCompletionIndex; i<mCompletions.size(); i++ ) {
+        AsyncFileCompletion *c = mCompletions.getElement( i );
+
+        if( c->data != NULL ) {
+            delete [] c->data;
+            }
+        }
+    }
+
+
+
+char AsyncFileReader::getNextCompletion(
+    AsyncFileCompletion *outCompletion ) {
+
+    char found = false;
+
+    mCompletionLock.lock();
+
+    if( mNextCompletionIndex < mCompletions.size() ) {
+        *outCompletion = mCompletions.getElementDirect( mNextCompletionIndex );
+        mNextCompletionIndex++;
+        found = true;
+
+        if( mNextCompletionIndex == mCompletions.size() ) {
+            mCompletions.deleteAll();
+            mNextCompletionIndex = 0;
+            }
+        }
+
+    mCompletionLock.unlock();
+
+    return found;
+    }
+
+
+
+void AsyncFileReader::addCompletion( int inHandle, unsigned char *inData,
+                                     int inDataLength ) {
+    AsyncFileCompletion c = { inHandle, inData, inDataLength };
+
+    mCompletionLock.lock();
+    mCompletions.push_back( c );
+    mCompletionLock.unlock();
+
+    if( mCompletionSignal != NULL ) {
+        mCompletionSignal->signal();
+        }
+    }
+
+
+
+
+// reads whole files with ordinary blocking reads, several at a time
+class ThreadPoolFileReader : public AsyncFileReader {
+
+    public:
+
+        ThreadPoolFileReader( BinarySemaphore *inCompletionSignal )
+                : AsyncFileReader( inCompletionSignal ),
+                  mStopping( false ) {
+
+            // reads are mostly waiting on the disk, so use a few more
+            // threads than a small machine has processors
+            int numThreads = ThreadPool::getNumProcessors();
+            if( numThreads < 4 ) {
+                numThreads = 4;
+                }
+            mPool = new ThreadPool( numThreads );
+            }
+
+
+        virtual ~ThreadPoolFileReader() {
+            // queued jobs still run while the pool shuts down,
+            // but skip their reads
+            mStopping = true;
+            delete mPool;
+            }
+
+
+        virtual void startRead( int inHandle, const char *inFilePath ) {
+            ReadJob *job = new ReadJob;
+            job->reader = this;
+            job->handle = inHandle;
+            job->filePath = stringDuplicate( inFilePath );
+
+            mPool->addJob( runReadJob, job );
+            }
+
+
+        virtual const char *getEngineName() {
+            return "threads";
+            }
+
+
+    protected:
+
+        typedef struct ReadJob {
+                ThreadPoolFileReader *reader;
+                int handle;
+                char *filePath;
+            } ReadJob;
+
+
+        static void runReadJob( void *inJobData ) {
+            ReadJob *job = (ReadJob *)inJobData;
+
+            if( ! job->reader->mStopping ) {
+                File f( NULL, job->filePath );
+
+                int dataLength = 0;
+                unsigned char *data = f.readFileContents( &dataLength );
+
+                if( data == NULL ) {
+                    dataLength = 0;
+                    }
+                job->reader->addCompletion( job->handle, data, dataLength );
+                }
+
+            delete [] job->filePath;
+            delete job;
+            }
+
+
+        ThreadPool *mPool;
+
+        volatile char mStopping;
+    };
+
+
+
+
+#ifdef ASYNC_FILE_READER_IO_URING
+
+
+// queue depth, and so the most reads in flight at once
+#define IO_URING_ENTRIES 64
+
+
+class IOUringFileReader;
+
+
+class IOUringServiceThread : public Thread {
+    public:
+
+        IOUringServiceThread( IOUringFileReader *inReader )
+                : mReader( inReader ) {
+            }
+
+        virtual void run();
+
+    protected:
+        IOUringFileReader *mReader;
+    };
+
+
+
+/**
+ * Reads whole files through one io_uring.
+ *
+ * A service thread opens files, submits their reads in batches, and
+ * waits on the ring.  New requests wake it through an eventfd that it
+ * keeps a poll on in the same ring, so one io_uring_enter call waits for
+ * both.
+ */
+class IOUringFileReader : public AsyncFileReader {
+
+    public:
+
+        // returns NULL if the kernel refuses to set up a ring
+        static IOUringFileReader *create(
+            BinarySemaphore *inCompletionSignal ) {
+
+            IOUringFileReader *reader =
+                new IOUringFileReader( inCompletionSignal );
+
+            if( ! reader->mRingOK ) {
+                delete reader;
+                return NULL;
+                }
+
+            reader->mThread = new IOUringServiceThread( reader );
+            reader->mThread->start();
+
+            return reader;
+            }
+
+
+        virtual ~IOUringFileReader() {
+            if( mThread != NULL ) {
+                mRequestLock.lock();
+                mStopping = true;
+                mRequestLock.unlock();
+
+                wake();
+
+                // thread waits for reads in flight before returning
+                mThread->join();
+                delete mThread;
+                }
+
+            for( int i=mNextRequestIndex; i<mRequests.size(); i++ ) {
+                delete [] mRequests.getElementDirect( i ).filePath;
+                }
+
+            if( mSQRing != NULL ) {
+                munmap( mSQRing, mSQRingSize );
+                }
+            if( mCQRing != NULL && mCQRing != mSQRing ) {
+                munmap( mCQRing, mCQRingSize );
+                }
+            if( mSQEs != NULL ) {
+                munmap( mSQEs, mSQEsSize );
+                }
+            if( mRingFD >= 0 ) {
+                close( mRingFD );
+                }
+            if( mWakeFD >= 0 ) {
+                close( mWakeFD );
+                }
+            }
+
+
+        virtual void startRead( int inHandle, const char *inFilePath ) {
+            ReadRequest r = { inHandle, stringDuplicate( inFilePath ) };
+
+            mRequestLock.lock();
+            mRequests.push_back( r );
+            mRequestLock.unlock();
+
+            wake();
+            }
+
+
+        virtual const char *getEngineName() {
+            return "io_uring";
+            }
+
+
+        // called by service thread
+        void serviceLoop();
+
+
+    protected:
+
+        typedef struct ReadRequest {
+                int handle;
+                char *filePath;
+            } ReadRequest;
+
+        // a read in flight, passed through the ring as user_data
+        typedef struct RingRead {
+                int handle;
+                int fd;
+                unsigned char *data;
+                int dataLength;
+                int numRead;
+                struct iovec vec;
+            } RingRead;
+
+
+        IOUringFileReader( BinarySemaphore *inCompletionSignal );
+
+        void wake();
+
+        // returns NULL if the submission queue is full
+        struct io_uring_sqe *getSQE();
+
+        void submitPoll();
+        void submitRead( RingRead *inRead );
+
+        // opens the file and submits its first read, or finishes the
+        // request right away if there is nothing to read
+        void beginRead( ReadRequest *inRequest );
+
+        void finishRead( RingRead *inRead, char inSuccess );
+
+        void handleCQE( struct io_uring_cqe *inCQE );
+
+        // fails reads in flight and all later requests
+        void failAll();
+
+
+        int mRingFD;
+        int mWakeFD;
+        char mRingOK;
+
+        void *mSQRing;
+        void *mCQRing;
+        size_t mSQRingSize;
+        size_t mCQRingSize;
+        struct io_uring_sqe *mSQEs;
+        size_t mSQEsSize;
+
+        unsigned int *mSQHead;
+        unsigned int *mSQTail;
+        unsigned int *mSQMask;
+        unsigned int *mSQArray;
+        unsigned int *mCQHead;
+        unsigned int *mCQTail;
+        unsigned int *mCQMask;
+        struct io_uring_cqe *mCQEs;
+
+        // SQEs filled since the last io_uring_enter
+        int mNumUnsubmitted;
+
+        SimpleVector<RingRead *> mInFlight;
+        char mPollArmed;
+
+        // set if io_uring_enter fails in a way we can't recover from,
+        // after which reads fail instead of hanging
+        char mBroken;
+
+        MutexLock mRequestLock;
+        SimpleVector<ReadRequest> mRequests;
+        int mNextRequestIndex;
+        char mStopping;
+
+        Thread *mThread;
+    };
+
+
+
+void IOUringServiceThread::run() {
+    mReader->serviceLoop();
+    }
+
+
+
+IOUringFileReader::IOUringFileReader( BinarySemaphore *inCompletionSignal )
+        : AsyncFileReader( inCompletionSignal ),
+          mRingFD( -1 ), mWakeFD( -1 ), mRingOK( false ),
+          mSQRing( NULL ), mCQRing( NULL ), mSQEs( NULL ),
+          mNumUnsubmitted( 0 ), mPollArmed( false ), mBroken( false ),
+          mNextRequestIndex( 0 ), mStopping( false ), mThread( NULL ) {
+
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+
+    mRingFD = syscall( __NR_io_uring_setup, IO_URING_ENTRIES, &params );
+
+    if( mRingFD < 0 ) {
+        return;
+        }
+
+    mWakeFD = eventfd( 0, EFD_CLOEXEC );
+
+    if( mWakeFD < 0 ) {
+        return;
+        }
+
+    mSQRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    mCQRingSize =
+        params.cq_off.cqes +
+        params.cq_entries * sizeof( struct io_uring_cqe );
+
+    if( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        if( mCQRingSize > mSQRingSize ) {
+            mSQRingSize = mCQRingSize;
+            }
+        mCQRingSize = mSQRingSize;
+        }
+
+    mSQRing = mmap( NULL, mSQRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, mRingFD, IORING_OFF_SQ_RING );
+
+    if( mSQRing == MAP_FAILED ) {
+        mSQRing = NULL;
+        return;
+        }
+
+    if( params.features & IORING_FEAT_SINGLE_MMAP ) {
+        mCQRing = mSQRing;
+        }
+    else {
+        mCQRing = mmap( NULL, mCQRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, mRingFD,
+                        IORING_OFF_CQ_RING );
+        if( mCQRing == MAP_FAILED ) {
+            mCQRing = NULL;
+            return;
+            }
+        }
+
+    mSQEsSize = params.sq_entries * sizeof( struct io_uring_sqe );
+
+    void *sqes = mmap( NULL, mSQEsSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, mRingFD, IORING_OFF_SQES );
+
+    if( sqes == MAP_FAILED ) {
+        return;
+        }
+    mSQEs = (struct io_uring_sqe *)sqes;
+
+    unsigned char *sq = (unsigned char *)mSQRing;
+    unsigned char *cq = (unsigned char *)mCQRing;
+
+    mSQHead = (unsigned int *)( sq + params.sq_off.head );
+    mSQTail = (unsigned int *)( sq + params.sq_off.tail );
+    mSQMask = (unsigned int *)( sq + params.sq_off.ring_mask );
+    mSQArray = (unsigned int *)( sq + params.sq_off.array );
+
+    mCQHead = (unsigned int *)( cq + params.cq_off.head );
+    mCQTail = (unsigned int *)( cq + params.cq_off.tail );
+    mCQMask = (unsigned int *)( cq + params.cq_off.ring_mask );
+    mCQEs = (struct io_uring_cqe *)( cq + params.cq_off.cqes );
+
+    mRingOK = true;
+    }
+
+
+
+void IOUringFileReader::wake() {
+    uint64_t one = 1;
+
+    // only fails if the counter would overflow, and then the service
+    // thread is already due to wake up
+    ssize_t numWritten = write( mWakeFD, &one, sizeof( one ) );
+    (void)numWritten;
+    }
+
+
+
+struct io_uring_sqe *IOUringFileReader::getSQE() {
+    unsigned int head = __atomic_load_n( mSQHead, __ATOMIC_ACQUIRE );
+    unsigned int tail = *mSQTail;
+
+    if( tail - head > *mSQMask ) {
+        return NULL;
+        }
+
+    unsigned int index = tail & *mSQMask;
+
+    struct io_uring_sqe *sqe = &( mSQEs[ index ] );
+    memset( sqe, 0, sizeof( *sqe ) );
+
+    mSQArray[ index ] = index;
+
+    __atomic_store_n( mSQTail, tail + 1, __ATOMIC_RELEASE );
+
+    mNumUnsubmitted++;
+
+    return sqe;
+    }
+
+
+
+void IOUringFileReader::submitPoll() {
+    struct io_uring_sqe *sqe = getSQE();
+
+    if( sqe == NULL ) {
+        return;
+        }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = mWakeFD;
+    sqe->poll_events = POLLIN;
+
+    // user_data 0 marks the wake poll, reads use their RingRead pointer
+    sqe->user_data = 0;
+
+    mPollArmed = true;
+    }
+
+
+
+void IOUringFileReader::submitRead( RingRead *inRead ) {
+    struct io_uring_sqe *sqe = getSQE();
+
+    if( sqe == NULL ) {
+        // never happens, reads in flight are capped below the queue size
+        finishRead( inRead, false );
+        return;
+        }
+
+    inRead->vec.iov_base = inRead->data + inRead->numRead;
+    inRead->vec.iov_len = inRead->dataLength - inRead->numRead;
+
+    // READV instead of READ works back to the first io_uring kernels
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = inRead->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&( inRead->vec );
+    sqe->len = 1;
+    sqe->off = inRead->numRead;
+    sqe->user_data = (uint64_t)(uintptr_t)inRead;
+    }
+
+
+
+void IOUringFileReader::beginRead( ReadRequest *inRequest ) {
+    int fd = open( inRequest->filePath, O_RDONLY | O_CLOEXEC );
+
+    if( fd < 0 ) {
+        addCompletion( inRequest->handle, NULL, 0 );
+        return;
+        }
+
+    struct stat fileInfo;
+
+    if( fstat( fd, &fileInfo ) != 0 || fileInfo.st_size > INT_MAX ) {
+        close( fd );
+        addCompletion( inRequest->handle, NULL, 0 );
+        return;
+        }
+
+    RingRead *r = new RingRead;
+    r->handle = inRequest->handle;
+    r->fd = fd;
+    r->dataLength = (int)( fileInfo.st_size );
+    r->numRead = 0;
+    r->data = new unsigned char[ r->dataLength ];
+
+    if( r->dataLength == 0 ) {
+        // matches File::readFileContents, which returns an empty array
+        finishRead( r, true );
+        return;
+        }
+
+    mInFlight.push_back( r );
+    submitRead( r );
+    }
+
+
+
+void IOUringFileReader::finishRead( RingRead *inRead, char inSuccess ) {
+    close( inRead->fd );
+
+    if( inSuccess ) {
+        addCompletion( inRead->handle, inRead->data, inRead->numRead );
+        }
+    else {
+        delete [] inRead->data;
+        addCompletion( inRead->handle, NULL, 0 );
+        }
+    delete inRead;
+    }
+
+
+
+void IOUringFileReader::handleCQE( struct io_uring_cqe *inCQE ) {
+    if( inCQE->user_data == 0 ) {
+        // wake poll fired, clear the eventfd counter
+        uint64_t count;
+        ssize_t numRead = read( mWakeFD, &count, sizeof( count ) );
+        (void)numRead;
+
+        mPollArmed = false;
+        return;
+        }
+
+    RingRead *r = (RingRead *)(uintptr_t)( inCQE->user_data );
+
+    int result = inCQE->res;
+
+    if( result == -EINTR || result == -EAGAIN ) {
+        submitRead( r );
+        return;
+        }
+
+    if( result < 0 ) {
+        mInFlight.deleteElementEqualTo( r );
+        finishRead( r, false );
+        return;
+        }
+
+    r->numRead += result;
+
+    if( result > 0 && r->numRead < r->dataLength ) {
+        // short read, go back for the rest
+        submitRead( r );
+        return;
+        }
+
+    // done, or file shrank since we checked its size
+    mInFlight.deleteElementEqualTo( r );
+    finishRead( r, true );
+    }
+
+
+
+void IOUringFileReader::failAll() {
+    // the kernel may still own buffers of reads in flight, so leak them
+    // rather than risk it writing into freed memory
+    for( int i=0; i<mInFlight.size(); i++ ) {
+        RingRead *r = mInFlight.getElementDirect( i );
+        close( r->fd );
+        addCompletion( r->handle, NULL, 0 );
+        delete r;
+        }
+    mInFlight.deleteAll();
+
+    mBroken = true;
+    }
+
+
+
+void IOUringFileReader::serviceLoop() {
+
+    while( true ) {
+
+        if( ! mBroken ) {
+            // reap everything that has finished
+            unsigned int head = *mCQHead;
+            unsigned int tail = __atomic_load_n( mCQTail, __ATOMIC_ACQUIRE );
+
+            while( head != tail ) {
+                handleCQE( &( mCQEs[ head & *mCQMask ] ) );
+                head++;
+                }
+            __atomic_store_n( mCQHead, head, __ATOMIC_RELEASE );
+            }
+
+
+        mRequestLock.lock();
+        char stopping = mStopping;
+        mRequestLock.unlock();
+
+        if( stopping ) {
+            // can't return while the kernel may still write into
+            // our buffers
+            if( mInFlight.size() == 0 ) {
+                return;
+                }
+            }
+        else {
+            if( ! mPollArmed && ! mBroken ) {
+                submitPoll();
+                }
+
+            // one queue slot is kept for the wake poll
+            int numFree = IO_URING_ENTRIES - 1 - mInFlight.size();
+
+            SimpleVector<ReadRequest> toStart;
+
+            mRequestLock.lock();
+            while( numFree > 0 && mNextRequestIndex < mRequests.size() ) {
+                toStart.push_back(
+                    mRequests.getElementDirect( mNextRequestIndex ) );
+                mNextRequestIndex++;
+                numFree--;
+                }
+            if( mNextRequestIndex == mRequests.size() ) {
+                mRequests.deleteAll();
+                mNextRequestIndex = 0;
+                }
+            mRequestLock.unlock();
+
+            for( int i=0; i<toStart.size(); i++ ) {
+                ReadRequest *r = toStart.getElement( i );
+
+                if( mBroken ) {
+                    addCompletion( r->handle, NULL, 0 );
+                    }
+                else {
+                    beginRead( r );
+                    }
+                delete [] r->filePath;
+                }
+            }
+
+
+        if( mBroken ) {
+            // nothing in flight, block on the eventfd for more requests
+            uint64_t count;
+            ssize_t numRead = read( mWakeFD, &count, sizeof( count ) );
+            (void)numRead;
+            continue;
+            }
+
+        // submit the batch and sleep until something finishes
+        // (a read, or the wake poll)
+        int numSubmitted = syscall( __NR_io_uring_enter, mRingFD,
+                                    mNumUnsubmitted, 1,
+                                    IORING_ENTER_GETEVENTS, NULL, 0 );
+
+        if( numSubmitted > 0 ) {
+            mNumUnsubmitted -= numSubmitted;
+            }
+        else if( numSubmitted < 0 && errno != EINTR && errno != EAGAIN &&
+                 errno != EBUSY ) {
+            printf( "AsyncFileReader:  io_uring_enter failed, errno %d\n",
+                    errno );
+            failAll();
+            }
+        }
+    }
+
+
+#endif
+
+
+
+
+AsyncFileReader *AsyncFileReader::createReader(
+    BinarySemaphore *inCompletionSignal, AsyncFileEngine inEngine ) {
+
+#ifdef ASYNC_FILE_READER_IO_URING
+    if( inEngine == asyncEngineBest ) {
+        AsyncFileReader *reader =
+            IOUringFileReader::create( inCompletionSignal );
+
+        if( reader != NULL ) {
+            return reader;
+            }
+        }
+#endif
+
+    return new ThreadPoolFileReader( inCompletionSignal );
+    }
@@ -0,0 +1,133 @@
+#ifndef ASYNC_FILE_READER_INCLUDED
+#define ASYNC_FILE_READER_INCLUDED
+
+
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+
+
+
+// the result of one whole-file read
+typedef struct AsyncFileCompletion {
+        int handle;
+
+        // NULL if the file could not be read
+        unsigned char *data;
+        int dataLength;
+
+    } AsyncFileCompletion;
+
+
+
+// which engine createReader should build
+enum AsyncFileEngine {
+    // io_uring where the kernel supports it, otherwise threads
+    asyncEngineBest = 0,
+    asyncEngineThreads
+    };
+
+
+
+/**
+ * Reads whole files in the background, keeping many reads in flight at
+ * once, and hands finished reads back through a completion queue.
+ *
+ * Subclasses are the I/O engines.  They only have to implement
+ * startRead and call addCompletion as each read finishes.
+ */
+class AsyncFileReader {
+
+    public:
+
+        /**
+         * Builds the best available reader.
+         *
+         * On Linux kernels with io_uring, reads are submitted to the
+         * kernel in batches from one service thread.  Otherwise (or if
+         * io_uring is blocked, as in some sandboxes), a small pool of
+         * threads each read whole files.
+         *
+         * @param inCompletionSignal signaled once after each read
+         *   finishes, or NULL.  Lets callers block until the next
+         *   completion.  Must be destroyed by caller after the reader.
+         * @param inEngine the engine to use.  Defaults to
+         *   asyncEngineBest.
+         *
+         * @return a new reader.  Must be destroyed by caller.
+         *   Destroying it waits for reads in flight, and discards
+         *   undelivered results.
+         */
+        static AsyncFileReader *createReader(
+            BinarySemaphore *inCompletionSignal = NULL,
+            AsyncFileEngine inEngine = asyncEngineBest );
+
+
+        virtual ~AsyncFileReader();
+
+
+
+        /**
+         * Starts reading a file.
+         *
+         * Reads may finish in any order.
+         *
+         * @param inHandle the handle to report the read's completion
+         *   under.
+         * @param inFilePath the file to read.
+         *   Must be destroyed by caller if non-const.
+         */
+        virtual void startRead( int inHandle, const char *inFilePath ) = 0;
+
+
+
+        /**
+         * Takes the next finished read off the completion queue.
+         *
+         * Thread safe.
+         *
+         * @param outCompletion where to return the completion.  Its
+         *   data is then destroyed by caller.
+         *
+         * @return true if a completion was returned, or false if no
+         *   reads have finished since the last call.
+         */
+        char getNextCompletion( AsyncFileCompletion *outCompletion );
+
+
+
+        // name of this engine, for logging
+        virtual const char *getEngineName() = 0;
+
+
+    protected:
+
+        AsyncFileReader( BinarySemaphore *inCompletionSignal );
+
+
+        /**
+         * Queues a finished read.  Called by engines from any thread.
+         *
+         * @param inData the file contents, or NULL on failure.
+         *   Destroyed by whoever takes the completion.
+         */
+        void addCompletion( int inHandle, unsigned char *inData,
+                            int inDataLength );
+
+
+        MutexLock mCompletionLock;
+
+        SimpleVector<AsyncFileCompletion> mCompletions;
+
+        // completions before this index have been taken
+        // (avoids shifting the vector on every take)
+        int mNextCompletionIndex;
+
+        BinarySemaphore *mCompletionSignal;
+
+    };
+
+
+
+#endif
@@ -0,0 +1,548 @@
+#include "minorGems/io/file/DirectoryWalker.h"
+
+#include "minorGems/io/file/Path.h"
+#include "minorGems/system/ThreadPool.h"
+#include "minorGems/util/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// getdents64 has no glibc wrapper before 2.30
+typedef struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    } LinuxDirent64;
+
+#elif !defined(WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+
+#define STRING_BLOCK_SIZE 65536
+
+#define DIRECTORY_READ_BUFFER_SIZE 65536
+
+
+
+// what the scan of one directory found about one of its entries
+typedef struct ScannedEntry {
+        // offset into the directory's name buffer
+        int nameStart;
+
+        char isDirectory;
+
+        // false for links to directories
+        char descend;
+
+        int64_t size;
+        int64_t modTime;
+        uint64_t inode;
+    } ScannedEntry;
+
+
+
+// a directory waiting to be scanned
+typedef struct ScanJob {
+        DirectoryWalker *walker;
+
+        // kept in the walker's string blocks
+        const char *path;
+
+        int depth;
+    } ScanJob;
+
+
+
+// the pool for the walk in progress, or NULL if walking on one thread
+// (in which case pending scans wait in scanStack)
+typedef struct WalkState {
+        ThreadPool *pool;
+        SimpleVector<ScanJob> scanStack;
+    } WalkState;
+
+
+
+static void runScanJob( void *inJobData ) {
+    ScanJob *job = (ScanJob *)inJobData;
+
+    job->walker->scanDirectory( job->path, job->depth );
+
+    delete job;
+    }
+
+
+
+DirectoryWalker::DirectoryWalker( int inNumThreads, char inGetFileInfo )
+        : mNumThreads( inNumThreads ), mGetFileInfo( inGetFileInfo ),
+          mDepthLimit( 0 ), mCallback( NULL ), mCallbackData( NULL ),
+          mStringBlockUsed( 0 ), mStringBlockSize( 0 ), mWalkState( NULL ) {
+
+    if( mNumThreads <= 0 ) {
+        mNumThreads = ThreadPool::getNumProcessors();
+        }
+    }
+
+
+
+DirectoryWalker::~DirectoryWalker() {
+    clearEntries();
+    }
+
+
+
+void DirectoryWalker::clearEntries() {
+    mEntries.deleteAll();
+
+    for( int i=0; i<mStringBlocks.size(); i++ ) {
+        delete [] mStringBlocks.getElementDirect( i );
+        }
+    mStringBlocks.deleteAll();
+
+    mStringBlockUsed = 0;
+    mStringBlockSize = 0;
+    }
+
+
+
+char *DirectoryWalker::allocateString( int inLength ) {
+    if( mStringBlockUsed + inLength > mStringBlockSize ) {
+        // start a new block, leaving the tail of the old one unused
+        mStringBlockSize = STRING_BLOCK_SIZE;
+
+        if( inLength > mStringBlockSize ) {
+            mStringBlockSize = inLength;
+            }
+        mStringBlocks.push_back( new char[ mStringBlockSize ] );
+        mStringBlockUsed = 0;
+        }
+
+    char *block = mStringBlocks.getElementDirect( mStringBlocks.size() - 1 );
+
+    char *space = &( block[ mStringBlockUsed ] );
+
+    mStringBlockUsed += inLength;
+
+    return space;
+    }
+
+
+
+char *DirectoryWalker::keepString( const char *inString, int inLength ) {
+    char *kept = allocateString( inLength );
+    memcpy( kept, inString, inLength );
+
+    return kept;
+    }
+
+
+
+char DirectoryWalker::walk( const char *inRootPath, int inDepthLimit ) {
+    mCallback = NULL;
+    mCallbackData = NULL;
+
+    return startWalk( inRootPath, inDepthLimit );
+    }
+
+
+
+char DirectoryWalker::walk( const char *inRootPath, int inDepthLimit,
+                            DirectoryWalkerCallback inCallback,
+                            void *inCallbackData ) {
+    mCallback = inCallback;
+    mCallbackData = inCallbackData;
+
+    return startWalk( inRootPath, inDepthLimit );
+    }
+
+
+
+char DirectoryWalker::startWalk( const char *inRootPath, int inDepthLimit ) {
+    clearEntries();
+
+    mDepthLimit = inDepthLimit;
+
+    DIR *root = opendir( inRootPath );
+
+    if( root == NULL ) {
+        return false;
+        }
+    closedir( root );
+
+
+    // drop trailing delimiters, so child paths don't double them up
+    int rootLength = strlen( inRootPath );
+    char delim = Path::getDelimeter();
+
+    while( rootLength > 1 &&
+           ( inRootPath[ rootLength - 1 ] == delim ||
+             inRootPath[ rootLength - 1 ] == '/' ) ) {
+        rootLength--;
+        }
+
+    char *rootCopy = new char[ rootLength + 1 ];
+    memcpy( rootCopy, inRootPath, rootLength );
+    rootCopy[ rootLength ] = '\0';
+
+    const char *rootPath = keepString( rootCopy, rootLength + 1 );
+
+    delete [] rootCopy;
+
+
+    WalkState state;
+
+    mWalkState = &state;
+
+    if( mNumThreads > 1 ) {
+        state.pool = new ThreadPool( mNumThreads );
+
+        ScanJob *job = new ScanJob;
+        job->walker = this;
+        job->path = rootPath;
+        job->depth = 0;
+
+        state.pool->addJob( runScanJob, job );
+
+        // scans add their subdirectories before they finish, so the
+        // pool only runs dry when the whole tree is done
+        state.pool->waitForAllJobs();
+
+        delete state.pool;
+        }
+    else {
+        state.pool = NULL;
+
+        ScanJob job = { this, rootPath, 0 };
+        state.scanStack.push_back( job );
+
+        while( state.scanStack.size() > 0 ) {
+            int last = state.scanStack.size() - 1;
+
+            job = state.scanStack.getElementDirect( last );
+            state.scanStack.deleteElement( last );
+
+            scanDirectory( job.path, job.depth );
+            }
+        }
+
+    mWalkState = NULL;
+
+    return true;
+    }
+
+
+
+// fills in type and info for an entry by asking the filesystem
+// returns false if the entry vanished
+static char statEntry( int inDirFD, const char *inDirectoryPath,
+                       const char *inName, char inGetFileInfo,
+                       ScannedEntry *inOutEntry ) {
+    struct stat info;
+
+#ifdef WIN32
+    char *fullPath = autoSprintf( "%s%c%s", inDirectoryPath,
+                                  Path::getDelimeter(), inName );
+    int result = stat( fullPath, &info );
+    delete [] fullPath;
+
+    if( result != 0 ) {
+        return false;
+        }
+#else
+    // lstat first, links to directories are listed but not followed
+    if( fstatat( inDirFD, inName, &info, AT_SYMLINK_NOFOLLOW ) != 0 ) {
+        return false;
+        }
+
+    if( S_ISLNK( info.st_mode ) ) {
+        inOutEntry->descend = false;
+
+        if( fstatat( inDirFD, inName, &info, 0 ) != 0 ) {
+            // dangling link, report the link itself
+            fstatat( inDirFD, inName, &info, AT_SYMLINK_NOFOLLOW );
+            }
+        }
+#endif
+
+    inOutEntry->isDirectory = S_ISDIR( info.st_mode );
+
+    if( inGetFileInfo ) {
+        inOutEntry->size = info.st_size;
+        inOutEntry->modTime = info.st_mtime;
+        inOutEntry->inode = info.st_ino;
+        }
+    return true;
+    }
+
+
+
+// adds one raw directory entry to the scan's results
+// inType is a DT_ value, or -1 if unknown
+static void addScannedEntry( int inDirFD, const char *inDirectoryPath,
+                             const char *inName, int inType,
+                             char inGetFileInfo,
+                             SimpleVector<char> *inNames,
+                             SimpleVector<ScannedEntry> *inEntries ) {
+
+    if( strcmp( inName, "." ) == 0 || strcmp( inName, ".." ) == 0 ) {
+        return;
+        }
+
+    ScannedEntry e;
+    e.nameStart = inNames->size();
+    e.isDirectory = false;
+    e.descend = true;
+    e.size = 0;
+    e.modTime = 0;
+    e.inode = 0;
+
+    char needStat = inGetFileInfo;
+
+#ifdef DT_DIR
+    if( inType == DT_DIR ) {
+        e.isDirectory = true;
+        }
+    else if( inType == DT_UNKNOWN || inType == DT_LNK || inType == -1 ) {
+        needStat = true;
+        }
+#else
+    needStat = true;
+#endif
+
+    if( needStat ) {
+        if( ! statEntry( inDirFD, inDirectoryPath, inName, inGetFileInfo,
+                         &e ) ) {
+            return;
+            }
+        }
+
+    inNames->appendArray( (char *)inName, strlen( inName ) + 1 );
+    inEntries->push_back( e );
+    }
+
+
+
+void DirectoryWalker::scanDirectory( const char *inDirectoryPath,
+                                     int inDepth ) {
+
+    SimpleVector<char> names;
+    SimpleVector<ScannedEntry> entries;
+
+
+#ifdef __linux__
+
+    int dirFD = open( inDirectoryPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if( dirFD < 0 ) {
+        return;
+        }
+
+    char *buffer = new char[ DIRECTORY_READ_BUFFER_SIZE ];
+
+    while( true ) {
+        long numRead = syscall( SYS_getdents64, dirFD, buffer,
+                                DIRECTORY_READ_BUFFER_SIZE );
+
+        if( numRead <= 0 ) {
+            break;
+            }
+
+        long pos = 0;
+        while( pos < numRead ) {
+            LinuxDirent64 *d = (LinuxDirent64 *)( buffer + pos );
+
+            addScannedEntry( dirFD, inDirectoryPath, d->d_name, d->d_type,
+                             mGetFileInfo, &names, &entries );
+
+            pos += d->d_reclen;
+            }
+        }
+
+    delete [] buffer;
+
+    close( dirFD );
+
+#else
+
+    DIR *directory = opendir( inDirectoryPath );
+
+    if( directory == NULL ) {
+        return;
+        }
+
+    #ifdef WIN32
+    int dirFD = -1;
+    #else
+    int dirFD = dirfd( directory );
+    #endif
+
+    struct dirent *d = readdir( directory );
+
+    while( d != NULL ) {
+        #ifdef DT_DIR
+        int type = d->d_type;
+        #else
+        int type = -1;
+        #endif
+
+        addScannedEntry( dirFD, inDirectoryPath, d->d_name, type,
+                         mGetFileInfo, &names, &entries );
+
+        d = readdir( directory );
+        }
+
+    closedir( directory );
+
+#endif
+
+
+    int numEntries = entries.size();
+
+    if( numEntries == 0 ) {
+        return;
+        }
+
+    char *nameBuffer = names.getElementArray();
+    int namesLength = names.size();
+
+
+    int dirPathLength = strlen( inDirectoryPath );
+    char delim = Path::getDelimeter();
+
+    char canDescend = ( inDepth < mDepthLimit );
+
+    // subdirectory scans to start, added once our lock is released
+    SimpleVector<ScanJob *> subScans;
+
+
+    if( mCallback != NULL ) {
+        for( int i=0; i<numEntries; i++ ) {
+            ScannedEntry *s = entries.getElement( i );
+
+            DirectoryEntry e = { inDirectoryPath,
+                                 &( nameBuffer[ s->nameStart ] ),
+                                 s->isDirectory, inDepth,
+                                 s->size, s->modTime, s->inode };
+
+            mCallback( &e, mCallbackData );
+            }
+        }
+
+
+    mLock.lock();
+
+    const char *keptNames = nameBuffer;
+
+    if( mCallback == NULL ) {
+        keptNames = keepString( nameBuffer, namesLength );
+        }
+
+    for( int i=0; i<numEntries; i++ ) {
+        ScannedEntry *s = entries.getElement( i );
+
+        const char *name = &( keptNames[ s->nameStart ] );
+
+        if( mCallback == NULL ) {
+            DirectoryEntry e = { inDirectoryPath, name,
+                                 s->isDirectory, inDepth,
+                                 s->size, s->modTime, s->inode };
+            mEntries.push_back( e );
+            }
+
+        if( s->isDirectory && s->descend && canDescend ) {
+            // child's path is kept for the whole walk, and shared by
+            // all of the child's entries
+            int nameLength = strlen( name );
+            int childLength = dirPathLength + 1 + nameLength;
+
+            char *childPath = allocateString( childLength + 1 );
+            memcpy( childPath, inDirectoryPath, dirPathLength );
+            childPath[ dirPathLength ] = delim;
+            memcpy( &( childPath[ dirPathLength + 1 ] ), name, nameLength );
+            childPath[ childLength ] = '\0';
+
+            ScanJob *job = new ScanJob;
+            job->walker = this;
+            job->path = childPath;
+            job->depth = inDepth + 1;
+
+            subScans.push_back( job );
+            }
+        }
+
+    mLock.unlock();
+
+    delete [] nameBuffer;
+
+
+    for( int i=0; i<subScans.size(); i++ ) {
+        ScanJob *job = subScans.getElementDirect( i );
+
+        if( mWalkState->pool != NULL ) {
+            mWalkState->pool->addJob( runScanJob, job );
+            }
+        else {
+            mWalkState->scanStack.push_back( *job );
+            delete job;
+            }
+        }
+    }
+
+
+
+int DirectoryWalker::getNumEntries() {
+    return mEntries.size();
+    }
+
+
+
+DirectoryEntry *DirectoryWalker::getEntry( int inIndex ) {
+    return mEntries.getElement( inIndex );
+    }
+
+
+
+static int entryCompare( const void *inA, const void *inB ) {
+    DirectoryEntry *a = (DirectoryEntry *)inA;
+    DirectoryEntry *b = (DirectoryEntry *)inB;
+
+    // siblings share one path pointer, so this usually skips strcmp
+    if( a->directoryPath != b->directoryPath ) {
+        int result = strcmp( a->directoryPath, b->directoryPath );
+
+        if( result != 0 ) {
+            return result;
+            }
+        }
+    return strcmp( a->name, b->name );
+    }
+
+
+
+void DirectoryWalker::sortEntries() {
+    if( mEntries.size() < 2 ) {
+        return;
+        }
+    qsort( mEntries.getElement( 0 ), mEntries.size(),
+           sizeof( DirectoryEntry ), entryCompare );
+    }
+
+
+
+char *DirectoryWalker::getFullPath( DirectoryEntry *inEntry ) {
+    return autoSprintf( "%s%c%s", inEntry->directoryPath,
+                        Path::getDelimeter(), inEntry->name );
+    }
@@ -0,0 +1,184 @@
+#ifndef DIRECTORY_WALKER_INCLUDED
+#define DIRECTORY_WALKER_INCLUDED
+
+
+
+#include <stdint.h>
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/MutexLock.h"
+
+
+
+// one file or directory found by a DirectoryWalker
+typedef struct DirectoryEntry {
+        // path of the directory containing this entry, starting with the
+        // walk's root path (shared by all entries in that directory)
+        const char *directoryPath;
+
+        const char *name;
+
+        char isDirectory;
+
+        // 0 for children of the root
+        int depth;
+
+        // only filled in if the walker was asked for file info,
+        // otherwise 0
+        int64_t size;
+        int64_t modTime;
+        uint64_t inode;
+
+    } DirectoryEntry;
+
+
+
+// called once per entry by a callback walk
+// may be called from several threads at once
+// inEntry and its strings are only valid during the call
+typedef void (*DirectoryWalkerCallback)( DirectoryEntry *inEntry,
+                                         void *inCallbackData );
+
+
+
+/**
+ * Walks a directory tree quickly, without building a File for each
+ * entry.
+ *
+ * Entries are read from the OS in large batches (getdents64 on Linux), and
+ * the entry type comes from the directory itself, so files are only
+ * stat-ed when the filesystem doesn't report types or when file info is
+ * requested.  Subdirectories are scanned in parallel on a thread pool.
+ *
+ * Symbolic links to directories are reported as directories, but not
+ * descended into.
+ *
+ * Entries are either kept for iteration after the walk, with their
+ * strings packed into large shared blocks, or passed to a callback as
+ * they are found.
+ */
+class DirectoryWalker {
+
+    public:
+
+        /**
+         * Constructs a walker.
+         *
+         * @param inNumThreads the number of threads to scan with, or -1
+         *   for one per processor.  Defaults to -1.
+         * @param inGetFileInfo true to stat each entry for its size,
+         *   modification time and inode.  Defaults to false.
+         */
+        DirectoryWalker( int inNumThreads = -1, char inGetFileInfo = false );
+
+        ~DirectoryWalker();
+
+
+
+        /**
+         * Walks a tree and keeps its entries, replacing any kept from a
+         * previous walk.
+         *
+         * Entries are in no particular order until sortEntries is called.
+         *
+         * @param inRootPath the directory to walk.
+         *   Must be destroyed by caller if non-const.
+         * @param inDepthLimit the maximum subdirectory depth to descend
+         *   into.  0 returns only the root's children.
+         *
+         * @return true on success, or false if the root could not be
+         *   opened.
+         */
+        char walk( const char *inRootPath, int inDepthLimit );
+
+
+
+        /**
+         * Walks a tree and passes each entry to a callback as it is
+         * found.  No entries are kept.
+         *
+         * Same as above, except:
+         *
+         * @param inCallback called for each entry, from the walker's
+         *   threads.
+         * @param inCallbackData passed to inCallback.
+         *   Must be destroyed by caller.
+         */
+        char walk( const char *inRootPath, int inDepthLimit,
+                   DirectoryWalkerCallback inCallback,
+                   void *inCallbackData );
+
+
+
+        int getNumEntries();
+
+
+        // entry remains valid until the next walk or until this walker is
+        // destroyed
+        DirectoryEntry *getEntry( int inIndex );
+
+
+
+        /**
+         * Sorts kept entries by directory path, then by name.
+         *
+         * Directories then come before their contents.
+         */
+        void sortEntries();
+
+
+
+        /**
+         * Gets the full path of an entry, directory path plus name.
+         *
+         * @return the path.  Must be destroyed by caller.
+         */
+        static char *getFullPath( DirectoryEntry *inEntry );
+
+
+
+        // called by scanning jobs
+        void scanDirectory( const char *inDirectoryPath, int inDepth );
+
+
+    protected:
+
+        // reserves space in the current string block
+        // must be called with mLock held
+        char *allocateString( int inLength );
+
+        // copies inLength bytes into the current string block
+        // must be called with mLock held
+        char *keepString( const char *inString, int inLength );
+
+        void clearEntries();
+
+        char startWalk( const char *inRootPath, int inDepthLimit );
+
+
+        int mNumThreads;
+        char mGetFileInfo;
+
+        int mDepthLimit;
+
+        DirectoryWalkerCallback mCallback;
+        void *mCallbackData;
+
+
+        MutexLock mLock;
+
+        SimpleVector<DirectoryEntry> mEntries;
+
+        // large blocks that kept strings are packed into
+        SimpleVector<char *> mStringBlocks;
+
+        int mStringBlockUsed;
+        int mStringBlockSize;
+
+        // pool or scan stack of the walk in progress
+        struct WalkState *mWalkState;
+    };
+
+
+
+#endif
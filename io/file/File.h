@@ -132,9 +132,26 @@
 
 #include <dirent.h>
 
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+
+// copy_file_range wrapper appeared in glibc 2.27
+#if defined(__GLIBC__) && \
+    ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 27 ) )
+#define FILE_HAS_COPY_FILE_RANGE
+#endif
+#endif
+
+
 #include "Path.h"
+#include "MappedFile.h"
 
 #include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/ByteBuffer.h"
 #include "minorGems/util/stringUtils.h"
 #include "minorGems/system/Time.h"
 
@@ -310,6 +327,8 @@ class File {
 		 *   Must be destroyed by caller.
 		 * @param inBlockSize the block size to use when copying.
 		 *   Defaults to blocks of 5000 bytes.
+		 *   Ignored on Linux, where the kernel copies the file
+		 *   directly.
 		 */
 		void copy( File *inDestination, long inBlockSize = 5000 );
         
@@ -394,6 +413,38 @@ class File {
 
 
 
+        /**
+         * Reads the contents of this file into a pooled buffer.
+         *
+         * @param outBuffer pointer to where the contents should be
+         *   returned.  Left unchanged on failure.
+         * @param inTextMode true to open the file as text, false as binary.
+         *   Defaults to false.
+         *
+         * @return true on success.
+         */
+        char readFileContents( ByteBuffer *outBuffer, 
+                               char inTextMode = false );
+
+
+
+        /**
+         * Maps the contents of this file into memory instead of copying
+         * them.  Best for large binary files that are parsed once.
+         *
+         * @param inAccess hint about how the contents will be read.
+         *   Defaults to mapSequential.
+         *
+         * @return a read-only view of the file contents, or NULL if the
+         *   file could not be mapped.
+         *   Contents are valid until the view is destroyed.
+         *   Must be destroyed by caller.
+         */
+        MappedFile *readFileContentsMapped( 
+            MappedFileAccess inAccess = mapSequential );
+
+
+
         /**
          * Writes a string to this file.
          *
@@ -449,6 +500,12 @@ class File {
                                      SimpleVector<File *> *inResultVector );
 
 
+        // copies a file without moving its contents through user space
+        // returns false if the platform or filesystem can't do this
+        static char copyInKernel( const char *inSourceFileName,
+                                  const char *inDestinationFileName );
+
+
         
 	};		
 
@@ -905,6 +962,12 @@ inline void File::copy( File *inDestination, long inBlockSize ) {
 	char *thisFileName = getFullFileName();
 	char *destinationFileName = inDestination->getFullFileName();
 
+    if( copyInKernel( thisFileName, destinationFileName ) ) {
+        delete [] thisFileName;
+        delete [] destinationFileName;
+        return;
+        }
+
 	FILE *thisFile = fopen( thisFileName, "rb" );
 	FILE *destinationFile = fopen( destinationFileName, "wb" );
 
@@ -939,6 +1002,79 @@ inline void File::copy( File *inDestination, long inBlockSize ) {
 
 
 
+inline char File::copyInKernel( const char *inSourceFileName,
+                                const char *inDestinationFileName ) {
+#ifdef __linux__
+    int source = open( inSourceFileName, O_RDONLY );
+
+    if( source < 0 ) {
+        return false;
+        }
+
+    struct stat sourceInfo;
+    
+    if( fstat( source, &sourceInfo ) != 0 ) {
+        close( source );
+        return false;
+        }
+
+    int destination = open( inDestinationFileName, 
+                            O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+
+    if( destination < 0 ) {
+        close( source );
+        return false;
+        }
+
+    off_t bytesLeft = sourceInfo.st_size;
+    char success = true;
+
+    #ifdef FILE_HAS_COPY_FILE_RANGE
+    // lets the filesystem share extents or copy server-side,
+    // but older kernels and cross-filesystem copies refuse it
+    char useCopyRange = true;
+    #endif
+    
+    while( bytesLeft > 0 ) {
+        ssize_t numCopied = -1;
+        
+        #ifdef FILE_HAS_COPY_FILE_RANGE
+        if( useCopyRange ) {
+            numCopied = copy_file_range( source, NULL, destination, NULL,
+                                         bytesLeft, 0 );
+            if( numCopied < 0 && 
+                ( errno == ENOSYS || errno == EXDEV || 
+                  errno == EINVAL || errno == EOPNOTSUPP ) ) {
+                useCopyRange = false;
+                continue;
+                }
+            }
+        else
+        #endif
+            numCopied = sendfile( destination, source, NULL, bytesLeft );
+
+        if( numCopied <= 0 ) {
+            // error, or file shrank underneath us
+            success = false;
+            break;
+            }
+        bytesLeft -= numCopied;
+        }
+
+    close( source );
+    
+    if( close( destination ) != 0 ) {
+        success = false;
+        }
+
+    return success;
+#else
+    return false;
+#endif
+    }
+
+
+
 inline char File::contentsMatches( File *inOtherFile ) {
     if( !exists() || ! inOtherFile->exists() ) {
         return false;
@@ -1167,6 +1303,59 @@ inline unsigned char *File::readFileContents( int *outLength,
 
 
 
+inline char File::readFileContents( ByteBuffer *outBuffer, 
+                                   char inTextMode ) {
+
+    if( ! exists() ) {
+        return false;
+        }
+
+    int length = getLength();
+
+    if( length < 0 ) {
+        return false;
+        }
+
+    ByteBuffer buffer( length );
+
+    FileInputStream *input = new FileInputStream( this, inTextMode );
+    int numRead = input->read( buffer.getData(), length );
+
+    delete input;
+
+    // in text mode, read length might not equal binary file length,
+    // due to line end conversion
+    if( numRead == length ||
+        ( inTextMode && numRead >= 0 ) ) {
+
+        buffer.setLength( numRead );
+        *outBuffer = buffer;
+        return true;
+        }
+
+    return false;
+    }
+
+
+
+inline MappedFile *File::readFileContentsMapped( 
+    MappedFileAccess inAccess ) {
+
+    char *fileName = getFullFileName();
+    
+    MappedFile *view = new MappedFile( fileName, inAccess );
+
+    delete [] fileName;
+
+    if( ! view->isMapped() ) {
+        delete view;
+        return NULL;
+        }
+    return view;
+    }
+
+
+
 inline char File::writeToFile( const char *inString ) {
     return writeToFile( (unsigned char *)inString, strlen( inString ) );    
     }
@@ -0,0 +1,236 @@
+#ifndef MAPPED_FILE_INCLUDED
+#define MAPPED_FILE_INCLUDED
+
+
+#include <stdio.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+
+// hints about how the contents of a mapped file will be read
+enum MappedFileAccess {
+    mapNormal = 0,
+    // front to back, once (most asset loading)
+    mapSequential,
+    // jumping around (lookups into big tables)
+    mapRandom
+    };
+
+
+
+/**
+ * Read-only view of the contents of a file.
+ *
+ * The file is memory mapped, so reading it does not copy it through a
+ * user-space buffer, and pages are only read from disk as they are
+ * touched.  The view stays valid until this object is destroyed.
+ *
+ * Where mmap is not available (Windows), the contents are read into memory
+ * instead, behind the same interface.
+ */
+class MappedFile {
+
+    public:
+
+        /**
+         * Maps a file.
+         *
+         * @param inFileName the name of the file to map.
+         *   Must be destroyed by caller if non-const.
+         * @param inAccess hint about how the contents will be read.
+         *   Defaults to mapSequential.
+         */
+        MappedFile( const char *inFileName,
+                    MappedFileAccess inAccess = mapSequential );
+
+        ~MappedFile();
+
+
+        /**
+         * Gets whether the file was mapped successfully.
+         *
+         * An empty file counts as mapped, with NULL data and length 0.
+         */
+        char isMapped();
+
+
+        /**
+         * Gets the file contents.
+         *
+         * @return the contents, or NULL if the file is empty or could not
+         *   be mapped.  NOT \0-terminated.  Read only.
+         *   Destroyed when this class is destroyed.
+         */
+        const unsigned char *getData();
+
+
+        int getLength();
+
+
+        /**
+         * Asks the OS to start reading all pages of the file in the
+         * background, ahead of when they are touched.
+         */
+        void prefetch();
+
+
+    protected:
+
+        unsigned char *mData;
+        int mLength;
+
+        char mOK;
+
+
+    private:
+
+        // not copyable
+        MappedFile( const MappedFile &inOther );
+        MappedFile &operator=( const MappedFile &inOther );
+    };
+
+
+
+inline MappedFile::MappedFile( const char *inFileName,
+                               MappedFileAccess inAccess )
+        : mData( NULL ), mLength( 0 ), mOK( false ) {
+
+#ifndef WIN32
+
+    int fd = open( inFileName, O_RDONLY );
+
+    if( fd < 0 ) {
+        return;
+        }
+
+    struct stat fileInfo;
+
+    if( fstat( fd, &fileInfo ) != 0 ||
+        fileInfo.st_size > INT_MAX ) {
+        close( fd );
+        return;
+        }
+
+    mLength = (int)( fileInfo.st_size );
+
+    if( mLength == 0 ) {
+        // mmap refuses empty ranges
+        close( fd );
+        mOK = true;
+        return;
+        }
+
+    void *mapping = mmap( NULL, mLength, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+    // mapping stays valid after its descriptor is closed
+    close( fd );
+
+    if( mapping == MAP_FAILED ) {
+        mLength = 0;
+        return;
+        }
+
+    mData = (unsigned char *)mapping;
+    mOK = true;
+
+    switch( inAccess ) {
+        case mapSequential:
+            madvise( mapping, mLength, MADV_SEQUENTIAL );
+            break;
+        case mapRandom:
+            madvise( mapping, mLength, MADV_RANDOM );
+            break;
+        default:
+            break;
+        }
+
+#else
+
+    FILE *file = fopen( inFileName, "rb" );
+
+    if( file == NULL ) {
+        return;
+        }
+
+    fseek( file, 0, SEEK_END );
+    long length = ftell( file );
+    fseek( file, 0, SEEK_SET );
+
+    if( length < 0 || length > INT_MAX ) {
+        fclose( file );
+        return;
+        }
+
+    mLength = (int)length;
+
+    if( mLength > 0 ) {
+        mData = new unsigned char[ mLength ];
+
+        int numRead = fread( mData, 1, mLength, file );
+
+        if( numRead != mLength ) {
+            delete [] mData;
+            mData = NULL;
+            mLength = 0;
+            fclose( file );
+            return;
+            }
+        }
+
+    fclose( file );
+
+    mOK = true;
+
+#endif
+    }
+
+
+
+inline MappedFile::~MappedFile() {
+    if( mData != NULL ) {
+#ifndef WIN32
+        munmap( mData, mLength );
+#else
+        delete [] mData;
+#endif
+        }
+    }
+
+
+
+inline char MappedFile::isMapped() {
+    return mOK;
+    }
+
+
+
+inline const unsigned char *MappedFile::getData() {
+    return mData;
+    }
+
+
+
+inline int MappedFile::getLength() {
+    return mLength;
+    }
+
+
+
+inline void MappedFile::prefetch() {
+#ifndef WIN32
+    if( mData != NULL ) {
+        madvise( mData, mLength, MADV_WILLNEED );
+        }
+#endif
+    }
+
+
+
+#endif
@@ -0,0 +1,163 @@
+// Reads every file in a directory through each AsyncFileReader engine,
+// checks the results against File::readFileContents, and reports how
+// long each engine took.
+//
+// Usage:  asyncFileReaderTest directory [depth_limit]
+
+
+#include "minorGems/io/file/AsyncFileReader.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+static char testEngine( AsyncFileEngine inEngine, File **inFiles,
+                        int inNumFiles ) {
+
+    BinarySemaphore doneSem;
+
+    double startTime = Time::getCurrentTime();
+
+    AsyncFileReader *reader =
+        AsyncFileReader::createReader( &doneSem, inEngine );
+
+    for( int i=0; i<inNumFiles; i++ ) {
+        char *path = inFiles[i]->getFullFileName();
+        reader->startRead( i, path );
+        delete [] path;
+        }
+
+    int numDone = 0;
+    int numBad = 0;
+    double numBytes = 0;
+
+    char *seen = new char[ inNumFiles ];
+    memset( seen, false, inNumFiles );
+
+    SimpleVector<AsyncFileCompletion> results;
+
+    while( numDone < inNumFiles ) {
+        AsyncFileCompletion c;
+
+        if( reader->getNextCompletion( &c ) ) {
+            results.push_back( c );
+            numDone++;
+            }
+        else {
+            doneSem.wait();
+            }
+        }
+
+    double seconds = Time::getCurrentTime() - startTime;
+
+    const char *engineName = reader->getEngineName();
+
+    delete reader;
+
+    for( int i=0; i<results.size(); i++ ) {
+        AsyncFileCompletion *c = results.getElement( i );
+
+        if( c->handle < 0 || c->handle >= inNumFiles || seen[ c->handle ] ) {
+            printf( "  bad handle %d\n", c->handle );
+            numBad++;
+            continue;
+            }
+        seen[ c->handle ] = true;
+
+        int length;
+        unsigned char *expected =
+            inFiles[ c->handle ]->readFileContents( &length );
+
+        if( expected == NULL || c->data == NULL ||
+            length != c->dataLength ||
+            memcmp( expected, c->data, length ) != 0 ) {
+
+            char *path = inFiles[ c->handle ]->getFullFileName();
+            printf( "  mismatch for %s\n", path );
+            delete [] path;
+            numBad++;
+            }
+        else {
+            numBytes += length;
+            }
+
+        if( expected != NULL ) {
+            delete [] expected;
+            }
+        if( c->data != NULL ) {
+            delete [] c->data;
+            }
+        }
+    delete [] seen;
+
+    printf( "%-10s %6d files %9.1f MB/s %9.1f ms  %d bad\n", engineName,
+            inNumFiles, numBytes / ( seconds * 1024 * 1024 ),
+            seconds * 1000, numBad );
+
+    return ( numBad == 0 );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs < 2 ) {
+        printf( "Usage:  asyncFileReaderTest directory [depth_limit]\n" );
+        return 1;
+        }
+
+    int depthLimit = 10;
+
+    if( inNumArgs > 2 ) {
+        depthLimit = atoi( inArgs[2] );
+        }
+
+    File dir( NULL, inArgs[1] );
+
+    if( ! dir.exists() || ! dir.isDirectory() ) {
+        printf( "Not a directory:  %s\n", inArgs[1] );
+        return 1;
+        }
+
+    int numFiles;
+    File **allFiles = dir.getChildFilesRecursive( depthLimit, &numFiles );
+
+    File **files = new File*[ numFiles ];
+    int numRegular = 0;
+
+    for( int i=0; i<numFiles; i++ ) {
+        if( allFiles[i]->isDirectory() ) {
+            delete allFiles[i];
+            }
+        else {
+            files[ numRegular ] = allFiles[i];
+            numRegular++;
+            }
+        }
+    delete [] allFiles;
+
+
+    char ok = true;
+
+    // twice each, so the second runs read from a warm page cache
+    for( int run=0; run<2; run++ ) {
+        ok = testEngine( asyncEngineThreads, files, numRegular ) && ok;
+        ok = testEngine( asyncEngineBest, files, numRegular ) && ok;
+        }
+
+
+    for( int i=0; i<numRegular; i++ ) {
+        delete files[i];
+        }
+    delete [] files;
+
+    if( ! ok ) {
+        printf( "FAILED\n" );
+        return 1;
+        }
+    return 0;
+    }
@@ -0,0 +1,97 @@
+// Times scanning a directory tree with File::getChildFilesRecursive
+// (plus isDirectory on each result) against DirectoryWalker, on one
+// thread and on many.
+//
+// Note that File follows links to directories and DirectoryWalker does
+// not, so counts differ for trees containing such links.
+//
+// Usage:  directoryWalkerBenchmark directory [depth_limit]
+
+
+#include "minorGems/io/file/DirectoryWalker.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+static void report( const char *inLabel, int inNumEntries, int inNumDirs,
+                    double inStartTime ) {
+    double seconds = Time::getCurrentTime() - inStartTime;
+
+    printf( "%-24s %8d entries %7d dirs %9.1f ms\n", inLabel, inNumEntries,
+            inNumDirs, seconds * 1000 );
+    }
+
+
+
+static void walkerPass( const char *inLabel, const char *inRoot,
+                        int inDepthLimit, int inNumThreads ) {
+    double startTime = Time::getCurrentTime();
+
+    DirectoryWalker walker( inNumThreads );
+
+    walker.walk( inRoot, inDepthLimit );
+    walker.sortEntries();
+
+    int numDirs = 0;
+    for( int i=0; i<walker.getNumEntries(); i++ ) {
+        if( walker.getEntry( i )->isDirectory ) {
+            numDirs++;
+            }
+        }
+
+    report( inLabel, walker.getNumEntries(), numDirs, startTime );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs < 2 ) {
+        printf( "Usage:  directoryWalkerBenchmark directory "
+                "[depth_limit]\n" );
+        return 1;
+        }
+
+    int depthLimit = 100;
+
+    if( inNumArgs > 2 ) {
+        depthLimit = atoi( inArgs[2] );
+        }
+
+
+    for( int run=0; run<2; run++ ) {
+        // first run warms the dentry cache
+        if( run == 1 ) {
+            printf( "\n" );
+            }
+
+        double startTime = Time::getCurrentTime();
+
+        File dir( NULL, inArgs[1] );
+
+        int numFiles;
+        File **files = dir.getChildFilesRecursive( depthLimit, &numFiles );
+
+        int numDirs = 0;
+        for( int i=0; i<numFiles; i++ ) {
+            if( files[i]->isDirectory() ) {
+                numDirs++;
+                }
+            delete files[i];
+            }
+        if( files != NULL ) {
+            delete [] files;
+            }
+
+        report( "File", numFiles, numDirs, startTime );
+
+        walkerPass( "DirectoryWalker 1 thread", inArgs[1], depthLimit, 1 );
+        walkerPass( "DirectoryWalker", inArgs[1], depthLimit, -1 );
+        }
+
+    return 0;
+    }
@@ -0,0 +1,247 @@
+// Measures asset loading from a directory of game files, copying each
+// file into memory with readFileContents versus viewing it through
+// readFileContentsMapped.  TGA files are also decoded both ways,
+// through FileInputStream and through a ByteBufferInputStream over the
+// mapped view, which is how gameSDL loads them.
+//
+// Each pass runs twice and the second run is reported, so the page cache
+// is warm for every method.  Drop caches between runs (as root) to
+// measure cold loading.
+//
+// Usage:  mappedFileBenchmark asset_directory [depth_limit]
+
+
+#include "minorGems/io/file/File.h"
+#include "minorGems/io/file/FileInputStream.h"
+#include "minorGems/util/ByteBufferInputStream.h"
+#include "minorGems/graphics/converters/TGAImageConverter.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+static File **files;
+static int numFiles;
+
+// sum of bytes touched, printed so the reads can't be optimized away
+static unsigned int checksum = 0;
+
+
+
+static void reportRate( const char *inLabel, double inNumBytes,
+                        int inNumFiles, double inStartTime ) {
+    double seconds = Time::getCurrentTime() - inStartTime;
+
+    if( inNumFiles == 0 ) {
+        printf( "%-28s no files to read\n", inLabel );
+        return;
+        }
+    if( seconds <= 0 ) {
+        printf( "%-28s %6d files, too fast to time\n", inLabel,
+                inNumFiles );
+        return;
+        }
+
+    printf( "%-28s %6d files %9.1f MB/s %9.1f ms\n", inLabel, inNumFiles,
+            inNumBytes / ( seconds * 1024 * 1024 ), seconds * 1000 );
+    }
+
+
+
+static char isTGA( File *inFile ) {
+    char *name = inFile->getFileName();
+
+    char result = false;
+
+    int length = strlen( name );
+    if( length > 4 && strcmp( &( name[ length - 4 ] ), ".tga" ) == 0 ) {
+        result = true;
+        }
+    delete [] name;
+    return result;
+    }
+
+
+
+static void touchBytes( const unsigned char *inData, int inLength ) {
+    // one byte per page is enough to fault the whole file in,
+    // but a loader looks at every byte
+    for( int i=0; i<inLength; i++ ) {
+        checksum += inData[i];
+        }
+    }
+
+
+
+static void readCopied( char inReport ) {
+    double startTime = Time::getCurrentTime();
+    double numBytes = 0;
+
+    for( int i=0; i<numFiles; i++ ) {
+        int length;
+        unsigned char *data = files[i]->readFileContents( &length );
+
+        if( data != NULL ) {
+            touchBytes( data, length );
+            numBytes += length;
+            delete [] data;
+            }
+        }
+    if( inReport ) {
+        reportRate( "readFileContents", numBytes, numFiles, startTime );
+        }
+    }
+
+
+
+static void readMapped( char inReport ) {
+    double startTime = Time::getCurrentTime();
+    double numBytes = 0;
+
+    for( int i=0; i<numFiles; i++ ) {
+        MappedFile *view = files[i]->readFileContentsMapped();
+
+        if( view != NULL ) {
+            touchBytes( view->getData(), view->getLength() );
+            numBytes += view->getLength();
+            delete view;
+            }
+        }
+    if( inReport ) {
+        reportRate( "readFileContentsMapped", numBytes, numFiles,
+                    startTime );
+        }
+    }
+
+
+
+static void decodeTGAStreamed( char inReport ) {
+    double startTime = Time::getCurrentTime();
+    double numBytes = 0;
+    int numTGA = 0;
+
+    TGAImageConverter converter;
+
+    for( int i=0; i<numFiles; i++ ) {
+        if( ! isTGA( files[i] ) ) {
+            continue;
+            }
+        FileInputStream stream( files[i] );
+
+        Image *image = converter.deformatImage( &stream );
+
+        if( image != NULL ) {
+            numBytes += files[i]->getLength();
+            numTGA++;
+            delete image;
+            }
+        }
+    if( inReport ) {
+        reportRate( "TGA via FileInputStream", numBytes, numTGA, startTime );
+        }
+    }
+
+
+
+static void decodeTGAMapped( char inReport ) {
+    double startTime = Time::getCurrentTime();
+    double numBytes = 0;
+    int numTGA = 0;
+
+    TGAImageConverter converter;
+
+    for( int i=0; i<numFiles; i++ ) {
+        if( ! isTGA( files[i] ) ) {
+            continue;
+            }
+        MappedFile *view = files[i]->readFileContentsMapped();
+
+        if( view == NULL ) {
+            continue;
+            }
+
+        ByteBufferInputStream stream( (unsigned char *)view->getData(),
+                                      view->getLength() );
+
+        Image *image = converter.deformatImage( &stream );
+
+        if( image != NULL ) {
+            numBytes += view->getLength();
+            numTGA++;
+            delete image;
+            }
+        delete view;
+        }
+    if( inReport ) {
+        reportRate( "TGA via mapped view", numBytes, numTGA, startTime );
+        }
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs < 2 ) {
+        printf( "Usage:  mappedFileBenchmark asset_directory "
+                "[depth_limit]\n" );
+        return 1;
+        }
+
+    int depthLimit = 10;
+
+    if( inNumArgs > 2 ) {
+        depthLimit = atoi( inArgs[2] );
+        }
+
+    File dir( NULL, inArgs[1] );
+
+    if( ! dir.exists() || ! dir.isDirectory() ) {
+        printf( "Not a directory:  %s\n", inArgs[1] );
+        return 1;
+        }
+
+    File **allFiles = dir.getChildFilesRecursive( depthLimit, &numFiles );
+
+    // skip subdirectories
+    files = new File*[ numFiles ];
+    int numRegular = 0;
+
+    for( int i=0; i<numFiles; i++ ) {
+        if( allFiles[i]->isDirectory() ) {
+            delete allFiles[i];
+            }
+        else {
+            files[ numRegular ] = allFiles[i];
+            numRegular++;
+            }
+        }
+    delete [] allFiles;
+    numFiles = numRegular;
+
+    if( numFiles == 0 ) {
+        printf( "No files found in %s\n", inArgs[1] );
+        delete [] files;
+        return 1;
+        }
+
+    for( int run=0; run<2; run++ ) {
+        char report = ( run == 1 );
+
+        readCopied( report );
+        readMapped( report );
+        decodeTGAStreamed( report );
+        decodeTGAMapped( report );
+        }
+
+    printf( "\n(checksum %u)\n", checksum );
+
+
+    for( int i=0; i<numFiles; i++ ) {
+        delete files[i];
+        }
+    delete [] files;
+
+    return 0;
+    }
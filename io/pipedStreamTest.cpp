@@ -10,6 +10,239 @@
 #include "PipedStream.h"
 
 #include "minorGems/util/random/StdRandomSource.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+
+
+// writes a counting byte pattern in uneven chunks, alternating between
+// copied and handed-over buffers
+class PipeWriterThread : public Thread {
+	public:
+		PipeWriterThread( PipedStream *inStream, long inNumBytes )
+			: mStream( inStream ), mNumBytes( inNumBytes ) {
+			}
+
+		void run() {
+			long numWritten = 0;
+			int chunkSize = 1;
+			int numChunks = 0;
+
+			while( numWritten < mNumBytes ) {
+				int size = chunkSize;
+				if( size > mNumBytes - numWritten ) {
+					size = mNumBytes - numWritten;
+					}
+
+				unsigned char *chunk = new unsigned char[ size ];
+				for( int i=0; i<size; i++ ) {
+					chunk[i] = (unsigned char)( numWritten + i );
+					}
+
+				// chunkSize is always odd, so alternate on count instead
+				if( numChunks % 2 == 0 ) {
+					mStream->writeOwned( chunk, size );
+					}
+				else {
+					mStream->write( chunk, size );
+					delete [] chunk;
+					}
+
+				numWritten += size;
+				numChunks++;
+				chunkSize = ( chunkSize * 7 + 3 ) % 40000 + 1;
+				}
+
+			mStream->close();
+			}
+
+	protected:
+		PipedStream *mStream;
+		long mNumBytes;
+	};
+
+
+
+// checks that copied writes start a new segment after a handed-over
+// buffer, rather than appending to it
+static void testWriteAfterOwned() {
+	PipedStream stream;
+
+	unsigned char *owned = new unsigned char[ 10 ];
+	for( int i=0; i<10; i++ ) {
+		owned[i] = (unsigned char)i;
+		}
+	stream.writeOwned( owned, 10 );
+
+	unsigned char copied[ 5 ];
+	for( int i=0; i<5; i++ ) {
+		copied[i] = (unsigned char)( 10 + i );
+		}
+	stream.write( copied, 5 );
+
+	unsigned char buffer[ 15 ];
+	long numGot = stream.read( buffer, 15 );
+
+	char ok = ( numGot == 15 );
+	for( int i=0; i<numGot && ok; i++ ) {
+		if( buffer[i] != i ) {
+			ok = false;
+			}
+		}
+
+	check( ok, "write after writeOwned" );
+	}
+
+
+
+// writes a few bytes after a delay
+class DelayedWriterThread : public Thread {
+	public:
+		DelayedWriterThread( PipedStream *inStream )
+			: mStream( inStream ) {
+			}
+
+		void run() {
+			sleep( 200 );
+
+			unsigned char bytes[ 5 ] = { 1, 2, 3, 4, 5 };
+			mStream->write( bytes, 5 );
+			}
+
+	protected:
+		PipedStream *mStream;
+	};
+
+
+
+// leaves the data semaphore signaled on an empty stream:  two writes
+// signal it, and one read empties the stream without waiting
+static void leaveStaleSignal( PipedStream *inStream ) {
+	unsigned char buffer[ 100 ];
+
+	while( inStream->readAvailable( buffer, 100 ) > 0 ) {
+		}
+
+	inStream->write( buffer, 5 );
+	inStream->write( buffer, 5 );
+	inStream->read( buffer, 10 );
+	}
+
+
+
+// checks that timed and untimed waits on an empty stream still wait for
+// data despite a stale signal
+static void testStaleSignal() {
+	PipedStream stream;
+
+	unsigned char buffer[ 10 ];
+
+	leaveStaleSignal( &stream );
+
+	double startTime = Time::getCurrentTime();
+	long numGot = stream.readAvailable( buffer, 10, 100 );
+	double waited = Time::getCurrentTime() - startTime;
+
+	check( numGot == 0, "timed wait on empty stream gets nothing" );
+	check( waited > 0.09, "timed wait not cut short by stale signal" );
+
+	leaveStaleSignal( &stream );
+
+	DelayedWriterThread writer( &stream );
+	writer.start();
+
+	numGot = stream.readAvailable( buffer, 10, -1 );
+
+	check( numGot == 5, "untimed readAvailable waits for data" );
+
+	writer.join();
+
+	leaveStaleSignal( &stream );
+
+	DelayedWriterThread bufferWriter( &stream );
+	bufferWriter.start();
+
+	ByteBuffer result = stream.readBuffer( 10, -1 );
+
+	check( ! result.isNull() && result.getLength() == 5,
+		   "untimed readBuffer waits for data" );
+
+	bufferWriter.join();
+	}
+
+
+
+// checks that a bounded, blocking stream carries a pattern between threads,
+// reading alternately with read and with peek/consume
+static void testThreadedPipe() {
+	long numBytes = 50000000;
+
+	PipedStream stream( 100000, true );
+
+	PipeWriterThread writer( &stream, numBytes );
+	writer.start();
+
+	unsigned char buffer[ 1000 ];
+
+	long numRead = 0;
+	char ok = true;
+	char usePeek = false;
+
+	while( ok ) {
+		if( usePeek ) {
+			PipedStreamView views[ 4 ];
+
+			int numViews = stream.peek( views, 4 );
+
+			long numPeeked = 0;
+			for( int v=0; v<numViews && ok; v++ ) {
+				for( int i=0; i<views[v].length; i++ ) {
+					if( views[v].data[i] !=
+						(unsigned char)( numRead + numPeeked ) ) {
+						ok = false;
+						break;
+						}
+					numPeeked++;
+					}
+				}
+			stream.consume( numPeeked );
+			numRead += numPeeked;
+
+			if( numViews == 0 &&
+				stream.readAvailable( buffer, 0, 100 ) == -1 ) {
+				break;
+				}
+			}
+		else {
+			long numGot = stream.read( buffer, sizeof( buffer ) );
+
+			if( numGot == -1 ) {
+				break;
+				}
+			for( int i=0; i<numGot; i++ ) {
+				if( buffer[i] != (unsigned char)( numRead + i ) ) {
+					ok = false;
+					break;
+					}
+				}
+			numRead += numGot;
+			}
+		usePeek = ! usePeek;
+		}
+
+	writer.join();
+
+	if( ok && numRead != numBytes ) {
+		ok = false;
+		}
+
+	printf( "Threaded pipe:  read %ld of %ld bytes\n", numRead, numBytes );
+
+	check( ok, "threaded pipe" );
+	}
+
+
 
 // test function for piped streams
 int main() {
@@ -75,4 +308,10 @@ int main() {
 	
 	delete randSource;
 	delete stream;
+
+	testWriteAfterOwned();
+	testStaleSignal();
+	testThreadedPipe();
+
+	return reportChecks();
 	} 
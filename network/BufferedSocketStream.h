@@ -0,0 +1,537 @@
+#include "minorGems/common.h"
+
+
+#ifndef BUFFERED_SOCKET_STREAM_CLASS_INCLUDED
+#define BUFFERED_SOCKET_STREAM_CLASS_INCLUDED
+
+#include "SocketStream.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <string.h>
+
+
+
+/**
+ * A SocketStream that buffers reads and writes.
+ *
+ * Small reads are served from a read buffer that is filled with whatever
+ * has arrived on the socket, so reading a request a byte at a time does
+ * not cost a system call per byte.  Small writes collect in a write
+ * buffer until it fills, flush() is called, a read has to wait on the
+ * socket, or the stream is destroyed.  Large reads and writes bypass the
+ * buffers.
+ *
+ * Read timeout behavior matches SocketStream.
+ *
+ * @author Jason Rohrer
+ */
+class BufferedSocketStream : public SocketStream {
+
+    public:
+
+
+        /**
+         * Constructs a stream.
+         *
+         * @param inSocket the network socket wrapped by this stream.
+         *   inSocket is NOT destroyed when the stream is destroyed.
+         * @param inReadBufferSize the size of the read buffer in bytes.
+         *   Defaults to 16384.
+         * @param inWriteBufferSize the size of the write buffer in bytes.
+         *   Defaults to 16384.
+         */
+        BufferedSocketStream( Socket *inSocket,
+                              int inReadBufferSize = 16384,
+                              int inWriteBufferSize = 16384 );
+
+
+        // flushes any buffered writes
+        virtual ~BufferedSocketStream();
+
+
+
+        // overrides the SocketStream implementations
+
+        virtual long read( unsigned char *inBuffer, long inNumBytes );
+
+        virtual long write( unsigned char *inBuffer, long inNumBytes );
+
+
+
+        /**
+         * Writes several buffers.  Buffers that fit are gathered into the
+         * write buffer.  Otherwise, buffered bytes and all of the passed
+         * buffers go out in a single gather send.
+         *
+         * @param inBuffers the buffers to write.
+         *   Must be destroyed by caller.
+         * @param inLengths the number of bytes in each buffer.
+         *   Must be destroyed by caller.
+         * @param inNumBuffers the number of buffers.
+         *
+         * @return the total number of bytes written, or -1 for a stream
+         *   error.
+         */
+        long writev( unsigned char **inBuffers, long *inLengths,
+                     int inNumBuffers );
+
+
+
+        /**
+         * Sends any buffered writes.
+         *
+         * @return the number of bytes sent, or -1 for a stream error.
+         */
+        long flush();
+
+
+
+        /**
+         * Reads up to and including the first occurrence of a delimiter.
+         *
+         * @param inDelimiter the \0-terminated delimiter to look for.
+         *   Must be destroyed by caller if non-const.
+         * @param inMaxBytes the maximum number of bytes to read.
+         * @param outLength pointer to where the length of the returned
+         *   data, including the delimiter, should be returned, or NULL.
+         *   Defaults to NULL.
+         *
+         * @return the data read, \0-terminated, or NULL if reading fails,
+         *   times out, or inMaxBytes are read without finding the
+         *   delimiter.
+         *   Must be destroyed by caller if non-NULL.
+         */
+        char *readUntil( const char *inDelimiter, int inMaxBytes,
+                         int *outLength = NULL );
+
+
+
+    protected:
+
+        // copies up to inNumBytes out of the read buffer
+        long takeBuffered( unsigned char *inBuffer, long inNumBytes );
+
+
+        // refills the empty read buffer with whatever data has arrived
+        //
+        // if inWait is true, waits for data according to the read
+        // timeout.  With no read timeout, waits for at least
+        // inMinBytes.
+        //
+        // returns the number of bytes received, -1 on a socket error or
+        // closed connection, or -2 if no data arrived in time
+        int fillReadBuffer( long inMinBytes, char inWait );
+
+
+        // both buffers come from the pool, since servers make a
+        // stream per connection
+        ByteBuffer mReadStorage;
+        ByteBuffer mWriteStorage;
+
+        unsigned char *mReadBuffer;
+        long mReadBufferSize;
+
+        // unread bytes are mReadBuffer[ mReadStart ... mReadEnd - 1 ]
+        long mReadStart;
+        long mReadEnd;
+
+        unsigned char *mWriteBuffer;
+        long mWriteBufferSize;
+        long mWriteLength;
+
+    };
+
+
+
+inline BufferedSocketStream::BufferedSocketStream( Socket *inSocket,
+                                                   int inReadBufferSize,
+                                                   int inWriteBufferSize )
+    : SocketStream( inSocket ),
+      mReadStorage( inReadBufferSize ),
+      mWriteStorage( inWriteBufferSize ),
+      mReadBuffer( mReadStorage.getData() ),
+      mReadBufferSize( inReadBufferSize ),
+      mReadStart( 0 ), mReadEnd( 0 ),
+      mWriteBuffer( mWriteStorage.getData() ),
+      mWriteBufferSize( inWriteBufferSize ),
+      mWriteLength( 0 ) {
+
+    }
+
+
+
+inline BufferedSocketStream::~BufferedSocketStream() {
+    flush();
+    }
+
+
+
+inline long BufferedSocketStream::takeBuffered( unsigned char *inBuffer,
+                                                long inNumBytes ) {
+    long numToTake = mReadEnd - mReadStart;
+
+    if( numToTake > inNumBytes ) {
+        numToTake = inNumBytes;
+        }
+
+    memcpy( inBuffer, &( mReadBuffer[ mReadStart ] ), numToTake );
+    mReadStart += numToTake;
+
+    return numToTake;
+    }
+
+
+
+inline int BufferedSocketStream::fillReadBuffer( long inMinBytes,
+                                                 char inWait ) {
+    // the other end may be waiting on what we have written
+    if( mWriteLength > 0 && flush() == -1 ) {
+        return -1;
+        }
+
+    long timeout = mReadTimeout;
+
+    if( ! inWait || mReadTimeout == -1 ) {
+        // first take whatever has already arrived
+        timeout = 0;
+        }
+
+    int numReceived = mSocket->receive( mReadBuffer, mReadBufferSize,
+                                        timeout );
+
+    if( numReceived == -2 && inWait && mReadTimeout == -1 ) {
+        // nothing there yet, block for what the caller needs
+        numReceived = mSocket->receive( mReadBuffer, inMinBytes, -1 );
+        }
+
+    if( numReceived == 0 ) {
+        // connection closed
+        numReceived = -1;
+        }
+
+    mReadStart = 0;
+    mReadEnd = 0;
+
+    if( numReceived > 0 ) {
+        mReadEnd = numReceived;
+        }
+
+    return numReceived;
+    }
+
+
+
+inline long BufferedSocketStream::read( unsigned char *inBuffer,
+                                        long inNumBytes ) {
+
+    long numRead = takeBuffered( inBuffer, inNumBytes );
+
+    while( numRead < inNumBytes ) {
+        long numRemaining = inNumBytes - numRead;
+
+        // with a timeout, only wait if nothing has been read yet,
+        // and otherwise return what is available
+        char wait = ( mReadTimeout == -1 || numRead == 0 );
+
+        int numReceived;
+
+        if( numRemaining >= mReadBufferSize ) {
+            // too big to be worth buffering
+            if( mWriteLength > 0 && flush() == -1 ) {
+                return -1;
+                }
+
+            long timeout = mReadTimeout;
+            if( ! wait ) {
+                timeout = 0;
+                }
+
+            numReceived = mSocket->receive( &( inBuffer[ numRead ] ),
+                                            numRemaining, timeout );
+            if( numReceived == 0 ) {
+                numReceived = -1;
+                }
+            if( numReceived > 0 ) {
+                numRead += numReceived;
+                }
+            }
+        else {
+            numReceived = fillReadBuffer( numRemaining, wait );
+
+            if( numReceived > 0 ) {
+                numRead += takeBuffered( &( inBuffer[ numRead ] ),
+                                         numRemaining );
+                }
+            }
+
+        if( numReceived == -2 ) {
+            if( numRead > 0 ) {
+                return numRead;
+                }
+            return -2;
+            }
+        if( numReceived < 0 ) {
+            if( numRead > 0 ) {
+                // let the next read report the error
+                return numRead;
+                }
+            InputStream::setNewLastErrorConst(
+                "Network socket error on receive." );
+            return -1;
+            }
+        }
+
+    return numRead;
+    }
+
+
+
+inline long BufferedSocketStream::flush() {
+    long numToSend = mWriteLength;
+
+    if( numToSend == 0 ) {
+        return 0;
+        }
+
+    mWriteLength = 0;
+
+    return SocketStream::write( mWriteBuffer, numToSend );
+    }
+
+
+
+inline long BufferedSocketStream::write( unsigned char *inBuffer,
+                                         long inNumBytes ) {
+
+    if( mWriteLength + inNumBytes > mWriteBufferSize ) {
+        if( flush() == -1 ) {
+            return -1;
+            }
+
+        if( inNumBytes >= mWriteBufferSize ) {
+            return SocketStream::write( inBuffer, inNumBytes );
+            }
+        }
+
+    memcpy( &( mWriteBuffer[ mWriteLength ] ), inBuffer, inNumBytes );
+    mWriteLength += inNumBytes;
+
+    return inNumBytes;
+    }
+
+
+
+inline long BufferedSocketStream::writev( unsigned char **inBuffers,
+                                          long *inLengths,
+                                          int inNumBuffers ) {
+    long numTotal = 0;
+
+    for( int i=0; i<inNumBuffers; i++ ) {
+        numTotal += inLengths[i];
+        }
+
+    if( mWriteLength + numTotal <= mWriteBufferSize ) {
+        for( int i=0; i<inNumBuffers; i++ ) {
+            memcpy( &( mWriteBuffer[ mWriteLength ] ), inBuffers[i],
+                    inLengths[i] );
+            mWriteLength += inLengths[i];
+            }
+        return numTotal;
+        }
+
+
+    // buffered bytes go first, followed by the caller's buffers
+    SimpleVector<unsigned char *> buffers;
+    SimpleVector<int> lengths;
+
+    if( mWriteLength > 0 ) {
+        buffers.push_back( mWriteBuffer );
+        lengths.push_back( mWriteLength );
+        }
+    for( int i=0; i<inNumBuffers; i++ ) {
+        if( inLengths[i] > 0 ) {
+            buffers.push_back( inBuffers[i] );
+            lengths.push_back( inLengths[i] );
+            }
+        }
+
+    long numLeft = mWriteLength + numTotal;
+    mWriteLength = 0;
+
+    // index of first buffer with unsent bytes
+    int first = 0;
+
+    while( numLeft > 0 ) {
+        int numSent = mSocket->sendv( buffers.getElement( first ),
+                                      lengths.getElement( first ),
+                                      buffers.size() - first );
+
+        if( numSent == -1 || numSent == 0 ) {
+            OutputStream::setNewLastErrorConst(
+                "Network socket error on send." );
+            return -1;
+            }
+
+        numLeft -= numSent;
+
+        // skip past what was sent
+        while( numSent > 0 ) {
+            int length = lengths.getElementDirect( first );
+
+            if( numSent >= length ) {
+                numSent -= length;
+                first++;
+                }
+            else {
+                *( buffers.getElement( first ) ) += numSent;
+                *( lengths.getElement( first ) ) -= numSent;
+                numSent = 0;
+                }
+            }
+        }
+
+    return numTotal;
+    }
+
+
+
+// finds the first occurrence of a delimiter in a block of data
+// returns its index, or -1 if not found
+inline long bufferedSocketStreamFind( const unsigned char *inData,
+                                      long inLength,
+                                      const unsigned char *inDelimiter,
+                                      long inDelimiterLength ) {
+    long lastStart = inLength - inDelimiterLength;
+
+    long i = 0;
+
+    while( i <= lastStart ) {
+        // let memchr skip quickly to each candidate first byte
+        const unsigned char *candidate =
+            (const unsigned char *)memchr( &( inData[i] ), inDelimiter[0],
+                                           lastStart - i + 1 );
+        if( candidate == NULL ) {
+            return -1;
+            }
+
+        i = candidate - inData;
+
+        if( memcmp( &( inData[i + 1] ), &( inDelimiter[1] ),
+                    inDelimiterLength - 1 ) == 0 ) {
+            return i;
+            }
+        i++;
+        }
+
+    return -1;
+    }
+
+
+
+inline char *BufferedSocketStream::readUntil( const char *inDelimiter,
+                                              int inMaxBytes,
+                                              int *outLength ) {
+
+    const unsigned char *delimiter = (const unsigned char *)inDelimiter;
+    long delimiterLength = strlen( inDelimiter );
+
+    if( delimiterLength == 0 ) {
+        return NULL;
+        }
+
+
+    // fast path:  delimiter already in the read buffer
+    long numBuffered = mReadEnd - mReadStart;
+    if( numBuffered > inMaxBytes ) {
+        numBuffered = inMaxBytes;
+        }
+
+    long index = bufferedSocketStreamFind( &( mReadBuffer[ mReadStart ] ),
+                                           numBuffered,
+                                           delimiter, delimiterLength );
+    if( index != -1 ) {
+        long length = index + delimiterLength;
+
+        char *result = new char[ length + 1 ];
+        memcpy( result, &( mReadBuffer[ mReadStart ] ), length );
+        result[ length ] = '\0';
+
+        mReadStart += length;
+
+        if( outLength != NULL ) {
+            *outLength = length;
+            }
+        return result;
+        }
+
+
+    SimpleVector<char> received;
+
+    while( true ) {
+        if( mReadStart == mReadEnd ) {
+            int numReceived = fillReadBuffer( 1, true );
+
+            if( numReceived == -1 ) {
+                InputStream::setNewLastErrorConst(
+                    "Network socket error on receive." );
+                return NULL;
+                }
+            else if( numReceived < 0 ) {
+                // timed out
+                return NULL;
+                }
+            }
+
+        long oldLength = received.size();
+
+        long numToAdd = mReadEnd - mReadStart;
+        if( oldLength + numToAdd > inMaxBytes ) {
+            numToAdd = inMaxBytes - oldLength;
+            }
+
+        received.appendArray( (char *)&( mReadBuffer[ mReadStart ] ),
+                              numToAdd );
+
+        // delimiter may straddle the old data and the new
+        long searchStart = oldLength - ( delimiterLength - 1 );
+        if( searchStart < 0 ) {
+            searchStart = 0;
+            }
+
+        unsigned char *data = (unsigned char *)received.getElement( 0 );
+        long length = received.size();
+
+        index = bufferedSocketStreamFind( &( data[ searchStart ] ),
+                                          length - searchStart,
+                                          delimiter, delimiterLength );
+
+        if( index != -1 ) {
+            long resultLength = searchStart + index + delimiterLength;
+
+            // leave the rest in the read buffer
+            mReadStart += resultLength - oldLength;
+
+            char *result = new char[ resultLength + 1 ];
+            memcpy( result, data, resultLength );
+            result[ resultLength ] = '\0';
+
+            if( outLength != NULL ) {
+                *outLength = resultLength;
+                }
+            return result;
+            }
+
+        mReadStart += numToAdd;
+
+        if( length >= inMaxBytes ) {
+            InputStream::setNewLastErrorConst(
+                "Delimiter not found within read limit." );
+            return NULL;
+            }
+        }
+    }
+
+
+
+#endif
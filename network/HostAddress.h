@@ -184,6 +184,10 @@ class HostAddress : public Serializable {
 
 		virtual int deserialize( InputStream *inInputStream );
 
+		virtual void serializeBinary( BinaryWriter *inWriter );
+
+		virtual char deserializeBinary( BinaryReader *inReader );
+
 		
 		
 		char *mAddressString;
@@ -391,5 +395,38 @@ inline int HostAddress::deserialize( InputStream *inInputStream ) {
 	}
 
 
+
+
+inline void HostAddress::serializeBinary( BinaryWriter *inWriter ) {
+	inWriter->writeByteString( (unsigned char *)mAddressString,
+							   mAddressLength );
+	inWriter->writeUVarint( mPort );
+	}
+
+
+
+inline char HostAddress::deserializeBinary( BinaryReader *inReader ) {
+	char *addressString = inReader->readText();
+	int port = (int)inReader->readUVarint();
+
+	if( addressString == NULL || ! inReader->isOK() ) {
+		if( addressString != NULL ) {
+			delete [] addressString;
+			}
+		return false;
+		}
+
+	if( mAddressString != NULL ) {
+		delete [] mAddressString;
+		}
+
+	mAddressString = addressString;
+	mAddressLength = strlen( addressString );
+	mPort = port;
+	
+	return true;
+	}
+
+
 	
 #endif
@@ -31,6 +31,9 @@ class Message : public Serializable {
 		// implement the Serializable interface
 		virtual int serialize( OutputStream *inOutputStream );
 		virtual int deserialize( InputStream *inInputStream );		
+
+		virtual void serializeBinary( BinaryWriter *inWriter );
+		virtual char deserializeBinary( BinaryReader *inReader );
 	};		
 
 
@@ -46,4 +49,24 @@ inline int Message::deserialize( InputStream *inInputStream ) {
 	}
 
 
+
+
+inline void Message::serializeBinary( BinaryWriter *inWriter ) {
+	inWriter->writeVarint( mOpcode );
+	}
+
+
+
+inline char Message::deserializeBinary( BinaryReader *inReader ) {
+	long opcode = (long)inReader->readVarint();
+
+	if( ! inReader->isOK() ) {
+		return false;
+		}
+	mOpcode = opcode;
+
+	return true;
+	}
+
+
 #endif
@@ -159,6 +159,23 @@ class Socket {
 		int send( unsigned char *inBuffer, int inNumBytes,
                   char inAllowedToBlock = true,
                   char inAllowDelay = true );
+
+
+
+        /**
+         * Sends several buffers through this socket in one call, blocking.
+         *
+         * @param inBuffers the buffers of bytes to send.
+         *   Must be destroyed by caller.
+         * @param inLengths the number of bytes in each buffer.
+         *   Must be destroyed by caller.
+         * @param inNumBuffers the number of buffers.
+         *
+         * @return the total number of bytes sent successfully, which may
+         *   end part way through any buffer, or -1 for a socket error.
+         */
+        int sendv( unsigned char **inBuffers, int *inLengths,
+                   int inNumBuffers );
 		
 		
 		/**
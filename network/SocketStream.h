@@ -35,6 +35,8 @@
 #include "minorGems/io/InputStream.h"
 #include "minorGems/io/OutputStream.h"
 
+#include "minorGems/util/ByteBuffer.h"
+
 
 /**
  * A input and output stream interface for a network socket.
@@ -90,6 +92,24 @@ class SocketStream : public InputStream, public OutputStream {
 		
 		// implements the OutputStream interface
 		virtual long write( unsigned char *inBuffer, long inNumBytes );
+
+
+
+        /**
+         * Reads into a pooled buffer, through read().
+         *
+         * @param inMaxBytes the size of the buffer.  Like read(), fills
+         *   it unless a read timeout is set.
+         *
+         * @return the bytes read, an empty buffer if the read timed out,
+         *   or a null buffer on error.
+         */
+        ByteBuffer readBuffer( long inMaxBytes );
+
+
+        // writes a pooled buffer, through write()
+        // returns the number of bytes written, or -1 on error
+        long writeBuffer( ByteBuffer inBuffer );
 		
 		
 	protected:
@@ -162,6 +182,31 @@ inline long SocketStream::write( unsigned char *inBuffer, long inNumBytes ) {
     
 	return numTotalSent;	
 	}
+
+
+
+inline ByteBuffer SocketStream::readBuffer( long inMaxBytes ) {
+    ByteBuffer buffer( (int)inMaxBytes );
+
+    long numRead = read( buffer.getData(), inMaxBytes );
+
+    if( numRead == -2 ) {
+        numRead = 0;
+        }
+    else if( numRead < 0 ) {
+        return ByteBuffer();
+        }
+
+    buffer.setLength( (int)numRead );
+
+    return buffer;
+    }
+
+
+
+inline long SocketStream::writeBuffer( ByteBuffer inBuffer ) {
+    return write( inBuffer.getData(), inBuffer.getLength() );
+    }
 	
 	
 	
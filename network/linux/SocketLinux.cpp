@@ -94,6 +94,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/errno.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -293,6 +294,53 @@ int Socket::send( unsigned char *inBuffer, int inNumBytes,
             }
         }
     }
+
+
+
+
+int Socket::sendv( unsigned char **inBuffers, int *inLengths,
+                   int inNumBuffers ) {
+
+    // sendmsg takes at most IOV_MAX buffers, so send in groups
+    struct iovec vectors[ 64 ];
+
+    int numTotalSent = 0;
+    
+    for( int b=0; b<inNumBuffers; b += 64 ) {
+        int numInGroup = inNumBuffers - b;
+        if( numInGroup > 64 ) {
+            numInGroup = 64;
+            }
+
+        int numInGroupBytes = 0;
+        
+        for( int i=0; i<numInGroup; i++ ) {
+            vectors[i].iov_base = inBuffers[ b + i ];
+            vectors[i].iov_len = inLengths[ b + i ];
+            numInGroupBytes += inLengths[ b + i ];
+            }
+        
+        struct msghdr message;
+        memset( &message, 0, sizeof( message ) );
+        message.msg_iov = vectors;
+        message.msg_iovlen = numInGroup;
+
+        int numSent = sendmsg( mNativeSocketID, &message, 0 );
+
+        if( numSent == -1 ) {
+            return -1;
+            }
+
+        numTotalSent += numSent;
+        
+        if( numSent < numInGroupBytes ) {
+            // partial send
+            break;
+            }
+        }
+    
+    return numTotalSent;
+    }
 		
 		
 int Socket::receive( unsigned char *inBuffer, int inNumBytes,
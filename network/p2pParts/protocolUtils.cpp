@@ -11,6 +11,7 @@
 
 
 #include "minorGems/network/p2pParts/protocolUtils.h"
+#include "minorGems/network/BufferedSocketStream.h"
 #include "minorGems/util/log/AppLog.h"
 #include "minorGems/util/stringUtils.h"
 
@@ -20,6 +21,27 @@ char *readStreamUpToTag( InputStream *inInputStream,
                          char *inTag,
                          int inMaxCharsToRead ) {
 
+    BufferedSocketStream *bufferedStream =
+        dynamic_cast<BufferedSocketStream *>( inInputStream );
+
+    if( bufferedStream != NULL ) {
+        // scan the stream's buffer instead of reading a byte at a time
+        char *returnString = 
+            bufferedStream->readUntil( inTag, inMaxCharsToRead );
+
+        if( returnString == NULL ) {
+            char *message = autoSprintf( "Failed to find end tag \"%s\"\n",
+                                         inTag );
+        
+            AppLog::info( "readStreamUpToTag", message );
+
+            delete [] message;
+            }
+        
+        return returnString;
+        }
+    
+
     char *readCharBuffer = new char[ inMaxCharsToRead + 1 ];
 
 
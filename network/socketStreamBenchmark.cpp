@@ -0,0 +1,206 @@
+// Measures small-message throughput over loopback, sending with
+// SocketStream and reading a line at a time, then doing the same with
+// BufferedSocketStream.
+//
+// Each message is written as a short header line and a short body line,
+// the way the web server writes responses.
+//
+// Usage:  socketStreamBenchmark [num_messages]
+
+
+#include "Socket.h"
+#include "SocketStream.h"
+#include "BufferedSocketStream.h"
+#include "SocketServer.h"
+#include "SocketClient.h"
+#include "HostAddress.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/stringUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+static int port = 5159;
+
+
+
+// reads lines the way protocolUtils::readStreamUpToTag does without a
+// buffered stream, one byte per read
+static int readLineBytewise( SocketStream *inStream, char *outLine,
+                             int inMaxLength ) {
+    int length = 0;
+
+    while( length < inMaxLength - 1 ) {
+        unsigned char c;
+        if( inStream->read( &c, 1 ) != 1 ) {
+            return -1;
+            }
+        outLine[ length ] = c;
+        length++;
+
+        if( c == '\n' ) {
+            break;
+            }
+        }
+    outLine[ length ] = '\0';
+
+    return length;
+    }
+
+
+
+class ReceiverThread : public Thread {
+
+    public:
+
+        ReceiverThread( SocketServer *inServer, char inBuffered,
+                        int inNumMessages )
+            : mServer( inServer ), mBuffered( inBuffered ),
+              mNumMessages( inNumMessages ), mNumLinesOK( 0 ) {
+            }
+
+        void run() {
+            Socket *sock = mServer->acceptConnection();
+
+            if( sock == NULL ) {
+                return;
+                }
+
+            int numLines = mNumMessages * 2;
+
+            if( mBuffered ) {
+                BufferedSocketStream stream( sock );
+
+                for( int i=0; i<numLines; i++ ) {
+                    char *line = stream.readUntil( "\n", 1000 );
+
+                    if( line == NULL ) {
+                        break;
+                        }
+                    if( checkLine( i, line ) ) {
+                        mNumLinesOK++;
+                        }
+                    delete [] line;
+                    }
+                }
+            else {
+                SocketStream stream( sock );
+
+                char line[ 1000 ];
+
+                for( int i=0; i<numLines; i++ ) {
+                    if( readLineBytewise( &stream, line, 1000 ) < 0 ) {
+                        break;
+                        }
+                    if( checkLine( i, line ) ) {
+                        mNumLinesOK++;
+                        }
+                    }
+                }
+
+            delete sock;
+            }
+
+
+        static char checkLine( int inLineNumber, const char *inLine ) {
+            int number;
+            if( inLineNumber % 2 == 0 ) {
+                return ( sscanf( inLine, "Message: %d\r\n", &number ) == 1
+                         && number == inLineNumber / 2 );
+                }
+            return ( strcmp( inLine, "body of the message\r\n" ) == 0 );
+            }
+
+
+        SocketServer *mServer;
+        char mBuffered;
+        int mNumMessages;
+
+        int mNumLinesOK;
+    };
+
+
+
+static char runPass( SocketServer *inServer, char inBuffered,
+                     int inNumMessages ) {
+
+    ReceiverThread receiver( inServer, inBuffered, inNumMessages );
+    receiver.start();
+
+    HostAddress address( stringDuplicate( "127.0.0.1" ), port );
+
+    Socket *sock = SocketClient::connectToServer( &address );
+
+    if( sock == NULL ) {
+        printf( "Failed to connect\n" );
+        receiver.join();
+        return false;
+        }
+
+    double startTime = Time::getCurrentTime();
+
+    SocketStream *stream;
+
+    if( inBuffered ) {
+        stream = new BufferedSocketStream( sock );
+        }
+    else {
+        stream = new SocketStream( sock );
+        }
+
+    for( int i=0; i<inNumMessages; i++ ) {
+        char *header = autoSprintf( "Message: %d\r\n", i );
+
+        stream->writeString( header );
+        stream->writeString( "body of the message\r\n" );
+
+        delete [] header;
+        }
+
+    // flushes buffered writes
+    delete stream;
+
+    receiver.join();
+
+    double seconds = Time::getCurrentTime() - startTime;
+
+    delete sock;
+
+    char ok = ( receiver.mNumLinesOK == inNumMessages * 2 );
+
+    printf( "%-20s %8d messages %10.0f messages/s %8.1f ms  %s\n",
+            inBuffered ? "BufferedSocketStream" : "SocketStream",
+            inNumMessages, inNumMessages / seconds, seconds * 1000,
+            ok ? "OK" : "FAILED" );
+
+    return ok;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numMessages = 100000;
+
+    if( inNumArgs > 1 ) {
+        numMessages = atoi( inArgs[1] );
+        }
+
+    SocketServer server( port, 10 );
+
+    char ok = true;
+
+    ok = runPass( &server, false, numMessages ) && ok;
+    ok = runPass( &server, true, numMessages ) && ok;
+
+    if( ! ok ) {
+        printf( "FAILED\n" );
+        return 1;
+        }
+    return 0;
+    }
@@ -173,7 +173,8 @@ char *WebClient::executeWebMethod( const char *inMethod,
 
     
     if( sock != NULL ) {
-        SocketStream *stream = new SocketStream( sock );
+        // buffered, so the request goes out in one send
+        BufferedSocketStream *stream = new BufferedSocketStream( sock );
 
         // reuse the same timeout for read operations
         stream->setReadTimeout( inTimeoutInMilliseconds );
@@ -205,7 +206,8 @@ char *WebClient::executeWebMethod( const char *inMethod,
             stream->writeString( "\r\n" );
             }
         
-        
+        stream->flush();
+
 
         delete [] methodWithSpace;
 
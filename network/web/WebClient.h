@@ -34,6 +34,7 @@
 #include "minorGems/network/Socket.h"
 #include "minorGems/network/SocketClient.h"
 #include "minorGems/network/SocketStream.h"
+#include "minorGems/network/BufferedSocketStream.h"
 
 
 #include <string.h>
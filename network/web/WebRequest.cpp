@@ -9,12 +9,34 @@
 
 
 
+// streamed requests give up if the headers grow beyond this without ending
+#define MAX_STREAM_HEADER_BYTES 65536
+
+
+
+// parses the status code out of the first line of an HTTP response
+// returns -1 on failure
+static int parseStatusCode( const char *inResponse ) {
+    int code;
+    
+    if( sscanf( inResponse, "HTTP/%*d.%*d %d", &code ) == 1 ) {
+        return code;
+        }
+    return -1;
+    }
+
+
+
 WebRequest::WebRequest( const char *inMethod, const char *inURL,
                         const char *inBody, const char *inProxy,
-                        double inTimeoutSeconds )
+                        double inTimeoutSeconds,
+                        char inStreamResult,
+                        const char *inExtraHeaders )
         : mError( false ), mURL( stringDuplicate( inURL ) ),
           mRequest( NULL ), mRequestPosition( -1 ),
-          mResultReady( false ), mResult( NULL ),
+          mStreamResult( inStreamResult ), mHeadersDone( false ),
+          mStatusCode( -1 ),
+          mResultReady( false ),
           mSock( NULL ), mRequestStartTime( Time::getCurrentTime() ),
           mRequestTimeoutSeconds( inTimeoutSeconds ) {
         
@@ -130,6 +152,10 @@ WebRequest::WebRequest( const char *inMethod, const char *inURL,
     tempStream.writeString( "Host: " );
     tempStream.writeString( requestHostNameCopy );
     tempStream.writeString( "\r\n" );
+    
+    if( inExtraHeaders != NULL ) {
+        tempStream.writeString( inExtraHeaders );
+        }
         
     if( inBody != NULL ) {
         char *lengthString = autoSprintf( "Content-Length: %d\r\n",
@@ -188,10 +214,6 @@ WebRequest::~WebRequest() {
     if( mRequest != NULL ) {
         delete [] mRequest;
         }
-    
-    if( mResult != NULL ) {
-        delete [] mResult;
-        }
     }
 
 
@@ -318,7 +340,8 @@ int WebRequest::step() {
                 // finished sending our request
                 
                 // start our thread that will receive the resonse
-                mCompletionThread = new WebRequestCompletionThread( mSock );
+                mCompletionThread = 
+                    new WebRequestCompletionThread( mSock, mStreamResult );
                 }
             
             return 0;
@@ -326,6 +349,9 @@ int WebRequest::step() {
         else if( mResultReady ) {
             return 1;
             }
+        else if( mStreamResult ) {
+            return stepStream();
+            }
         else {
             
             // done sending request
@@ -345,6 +371,8 @@ int WebRequest::step() {
                 mCompletionThread = NULL;
                 
                 char *responseString = (char*)response;
+                
+                mStatusCode = parseStatusCode( responseString );
 
                 // search for error headers, but only in short responses
                 // (if we have a 48MB response, don't search through entire 
@@ -382,13 +410,11 @@ int WebRequest::step() {
                         - strlen( contentStartString )
                         - (int)( contentStart - responseString );
 
-                    mResultSize = resultLength;
-                    
-                    mResult = new char[ resultLength + 1 ];
-                    memcpy( mResult,
+                    mResult = ByteBuffer( resultLength, resultLength + 1 );
+                    memcpy( mResult.getData(),
                             content, resultLength );
 
-                    mResult[ resultLength ] = '\0';
+                    mResult.getData()[ resultLength ] = '\0';
                     mResultReady = true;
                     
                     delete [] response;
@@ -427,6 +453,105 @@ int WebRequest::step() {
 
 
 
+int WebRequest::stepStream() {
+    
+    // check done before taking bytes, so no bytes can arrive after
+    // our last take
+    char done = mCompletionThread->isWebRequestDone();
+    
+    int numBytes;
+    unsigned char *bytes = 
+        mCompletionThread->takeReceivedBytes( &numBytes );
+    
+    if( bytes != NULL ) {
+        
+        if( mHeadersDone ) {
+            mStreamBytes.appendArray( bytes, numBytes );
+            }
+        else {
+            mResponse.appendArray( (char*)bytes, numBytes );
+            
+            // look for end of headers
+            int endIndex = -1;
+            
+            int responseLength = mResponse.size();
+            char *response = mResponse.getElement( 0 );
+            
+            for( int i=0; i <= responseLength - 4; i++ ) {
+                if( memcmp( &( response[i] ), "\r\n\r\n", 4 ) == 0 ) {
+                    endIndex = i;
+                    break;
+                    }
+                }
+            
+            if( endIndex != -1 ) {
+                mHeadersDone = true;
+                
+                // terminate after status line for parsing
+                response[ endIndex ] = '\0';
+                mStatusCode = parseStatusCode( response );
+                
+                int bodyStart = endIndex + 4;
+                
+                mStreamBytes.appendArray( 
+                    (unsigned char*)&( response[ bodyStart ] ),
+                    responseLength - bodyStart );
+                
+                mResponse.deleteAll();
+                
+                if( mStatusCode == 404 ) {
+                    mError = true;
+                    
+                    printf( "Error:  "
+                            "WebRequest got 404 Not Found error for URL:  %s",
+                            mURL );
+                    }
+                else if( mStatusCode == -1 ) {
+                    mError = true;
+                    
+                    printf( "Error:  "
+                            "WebRequest got badly formatted response "
+                            "status for URL:  %s\n", mURL );
+                    }
+                }
+            else if( responseLength > MAX_STREAM_HEADER_BYTES ) {
+                mError = true;
+                
+                printf( "Error:  "
+                        "WebRequest got no end of headers in first %d bytes "
+                        "for URL:  %s\n", responseLength, mURL );
+                }
+            }
+        
+        delete [] bytes;
+        
+        if( mError ) {
+            return -1;
+            }
+        }
+    
+    if( done ) {
+        delete mCompletionThread;
+        mCompletionThread = NULL;
+        
+        if( ! mHeadersDone ) {
+            mError = true;
+
+            printf( "Error:  "
+                    "WebRequest connection closed before end of headers "
+                    "for URL:  %s\n", mURL );
+            return -1;
+            }
+        
+        mResultReady = true;
+        return 1;
+        }
+    
+    return 0;
+    }
+
+
+
 int WebRequest::getProgressSize() {
     if( mCompletionThread != NULL ) {
         return mCompletionThread->getBytesReceivedSoFar();
@@ -440,8 +565,8 @@ int WebRequest::getProgressSize() {
         
 
 char *WebRequest::getResult() {
-    if( mResultReady ) {
-        return stringDuplicate( mResult );
+    if( mResultReady && ! mStreamResult ) {
+        return stringDuplicate( (char *)mResult.getData() );
         }
     else {
         return NULL;
@@ -450,15 +575,44 @@ char *WebRequest::getResult() {
 
 
 unsigned char *WebRequest::getResult( int *outSize ) {
-    if( mResultReady ) {
-        unsigned char *result = new unsigned char[ mResultSize ];
-        memcpy( result, mResult, mResultSize );
-        
-        *outSize = mResultSize;
+    if( mResultReady && ! mStreamResult ) {
+        *outSize = mResult.getLength();
 
-        return result;
+        return mResult.copyToArray();
         }
     else {
         return NULL;
         }
     }
+
+
+
+ByteBuffer WebRequest::getResultBuffer() {
+    if( mResultReady && ! mStreamResult ) {
+        return mResult;
+        }
+    else {
+        return ByteBuffer();
+        }
+    }
+
+
+
+unsigned char *WebRequest::getNewResultBytes( int *outSize ) {
+    *outSize = mStreamBytes.size();
+    
+    if( *outSize == 0 ) {
+        return NULL;
+        }
+    
+    unsigned char *bytes = mStreamBytes.getElementArray();
+    mStreamBytes.deleteAll();
+    
+    return bytes;
+    }
+
+
+
+int WebRequest::getStatusCode() {
+    return mStatusCode;
+    }
@@ -7,6 +7,8 @@
 #include "minorGems/network/LookupThread.h"
 #include "minorGems/network/web/WebRequestCompletionThread.h"
 
+#include "minorGems/util/ByteBuffer.h"
+
 
 
 // a non-blocking web request
@@ -27,9 +29,17 @@ class WebRequest {
         //   step() will return -1.
         //   Set to -1 for no timeout (will wait forever for request to 
         //   complete).  Defaults to -1
+        // inStreamResult set to true to take the response body in pieces
+        //   with getNewResultBytes as it arrives, instead of all at once
+        //   with getResult.  Defaults to false.
+        // inExtraHeaders is extra header lines to send, each ending with
+        //   \r\n (like "Range: bytes=100-\r\n"), or NULL to send none.
+        //   Defaults to NULL.
         WebRequest( const char *inMethod, const char *inURL,
                     const char *inBody, const char *inProxy = NULL,
-                    double inTimeoutSeconds = -1 );
+                    double inTimeoutSeconds = -1,
+                    char inStreamResult = false,
+                    const char *inExtraHeaders = NULL );
         
 
         // if request is not complete, destruction cancels it
@@ -53,6 +63,26 @@ class WebRequest {
 
         // gets the response body as bytes
         unsigned char *getResult( int *outSize );
+
+
+        // gets the response body without copying it
+        // the buffer shares bytes with this request, and stays valid after
+        // this request is destroyed
+        // returns a null buffer if the result is not ready
+        ByteBuffer getResultBuffer();
+
+
+        // for streamed requests, gets the body bytes that arrived since the
+        // last call
+        // Keep calling after step returns 1 until this returns NULL, to get
+        // the last of the body.
+        // returns NULL if there are none, result destroyed by caller
+        unsigned char *getNewResultBytes( int *outSize );
+        
+
+        // gets the HTTP status code of the response (200, 206, 404, etc.)
+        // or -1 if the response headers have not arrived yet
+        int getStatusCode();
         
         
 
@@ -65,13 +95,21 @@ class WebRequest {
         
         int mRequestPosition;
         
+        // for streamed requests, holds the response headers until they 
+        // have all arrived
         SimpleVector<char> mResponse;
         
-        char mResultReady;
+        char mStreamResult;
+        char mHeadersDone;
+        int mStatusCode;
         
-        char *mResult;
+        // streamed body bytes not yet taken
+        SimpleVector<unsigned char> mStreamBytes;
         
-        int mResultSize;
+        char mResultReady;
+        
+        // \0-terminated past its length
+        ByteBuffer mResult;
 
         HostAddress *mSuppliedAddress;
         HostAddress *mNumericalAddress;
@@ -83,6 +121,9 @@ class WebRequest {
         double mRequestTimeoutSeconds;
 
         WebRequestCompletionThread *mCompletionThread;
+        
+        // step for streamed requests, once the request has been sent
+        int stepStream();
     };
 
 
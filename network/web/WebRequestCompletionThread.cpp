@@ -1,9 +1,18 @@
 #include "WebRequestCompletionThread.h"
 
+#include "minorGems/util/ByteBuffer.h"
 
-WebRequestCompletionThread::WebRequestCompletionThread( Socket *inSocket )
-        : mDone( false ), mForceEnd( false ), mSocket( inSocket ),
-          mBytesSoFar( 0 ) {
+
+// streaming threads stop reading from the socket while this many bytes
+// are waiting to be taken
+#define MAX_UNTAKEN_STREAM_BYTES 1048576
+
+
+
+WebRequestCompletionThread::WebRequestCompletionThread( Socket *inSocket,
+                                                        char inStreaming )
+        : mDone( false ), mForceEnd( false ), mStreaming( inStreaming ),
+          mSocket( inSocket ), mBytesSoFar( 0 ) {
     
     start();
     }
@@ -61,9 +70,32 @@ unsigned char *WebRequestCompletionThread::getResponse( int *outSize ) {
 
     
 
+
+unsigned char *WebRequestCompletionThread::takeReceivedBytes( int *outSize ) {
+    mLock.lock();
+    
+    *outSize = mReceivedBytes.size();
+    
+    unsigned char *bytes = NULL;
+    
+    if( *outSize > 0 ) {
+        bytes = mReceivedBytes.getElementArray();
+        mReceivedBytes.deleteAll();
+        }
+    
+    mLock.unlock();
+    
+    return bytes;
+    }
+
+    
+
 void WebRequestCompletionThread::run() {
     long bufferLength = 5000;
-    unsigned char *buffer = new unsigned char[ bufferLength ];
+
+    // receive buffer comes from the pool, one request thread after another
+    ByteBuffer bufferStorage( bufferLength );
+    unsigned char *buffer = bufferStorage.getData();
 
     char endForced = false;
     
@@ -74,21 +106,45 @@ void WebRequestCompletionThread::run() {
         // keep reading as long as we get non-empty buffers
         int numRead = bufferLength;
         
+        char paused = false;
+        
         while( numRead > 0 && ! endForced ) {
             
+            if( mStreaming ) {
+                mLock.lock();
+                int numUntaken = mReceivedBytes.size();
+                mLock.unlock();
+                
+                if( numUntaken >= MAX_UNTAKEN_STREAM_BYTES ) {
+                    // let the socket buffer fill up until some are taken
+                    paused = true;
+                    break;
+                    }
+                }
+            
             numRead = mSocket->receive( buffer, bufferLength, 0 );
             
             if( numRead > 0 ) {
                 
-                // this is fast for unsigned char vectors, using
-                // memcpy internally
-                mReceivedBytes.push_back( buffer, numRead );                
-
-                // protect mBytesSoFar with lock, not add-to-vector code
-                mLock.lock();
-                mBytesSoFar += numRead;
-                endForced = mForceEnd;
-                mLock.unlock();
+                if( mStreaming ) {
+                    // other thread takes bytes out of vector as we go
+                    mLock.lock();
+                    mReceivedBytes.push_back( buffer, numRead );
+                    mBytesSoFar += numRead;
+                    endForced = mForceEnd;
+                    mLock.unlock();
+                    }
+                else {
+                    // this is fast for unsigned char vectors, using
+                    // memcpy internally
+                    mReceivedBytes.push_back( buffer, numRead );                
+                    
+                    // protect mBytesSoFar with lock, not add-to-vector code
+                    mLock.lock();
+                    mBytesSoFar += numRead;
+                    endForced = mForceEnd;
+                    mLock.unlock();
+                    }
                 }
             }
         
@@ -100,6 +156,9 @@ void WebRequestCompletionThread::run() {
         endForced = mForceEnd;
         mLock.unlock();
                 
+        if( paused ) {
+            Thread::staticSleep( 10 );
+            }
 
         if( numRead == -1 ) {
             // connection closed, done done receiving result
@@ -111,8 +170,6 @@ void WebRequestCompletionThread::run() {
         }
     
 
-
-    delete [] buffer;
             
         
 
@@ -25,8 +25,13 @@ class WebRequestCompletionThread : public FinishedSignalThread {
          *
 		 * @param inSocket the socket on which the web request has already.
          *   been sent.  Destroyed by caller after this class is destroyed.
+         * @param inStreaming true if the response will be taken in pieces
+         *   with takeReceivedBytes while it is still arriving.  Receiving
+         *   pauses while too many untaken bytes are waiting.
+         *   Defaults to false.
 		 */
-		WebRequestCompletionThread( Socket *inSocket );
+		WebRequestCompletionThread( Socket *inSocket, 
+                                    char inStreaming = false );
         
         
         /**
@@ -67,6 +72,19 @@ class WebRequestCompletionThread : public FinishedSignalThread {
         unsigned char *getResponse( int *outSize );
         
 
+        
+        /**
+         * Takes the bytes received since the last call, for streaming
+         * threads.  Includes all headers sent by server.
+         *
+         * Safe to call while the response is still arriving.
+         *
+         * @return the bytes, or NULL if there are none.
+         *   Destroyed by caller.
+         */
+        unsigned char *takeReceivedBytes( int *outSize );
+        
+
 		// override the run method from Thread
 		void run();
 	
@@ -77,6 +95,8 @@ class WebRequestCompletionThread : public FinishedSignalThread {
         
         char mForceEnd;
         
+        char mStreaming;
+        
 
         Socket *mSocket;
 
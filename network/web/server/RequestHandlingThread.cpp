@@ -40,6 +40,8 @@
 
 #include "RequestHandlingThread.h"
 
+#include "minorGems/util/Arena.h"
+
 
 
 
@@ -137,18 +139,26 @@ void RequestHandlingThread::run() {
 
     int maxLength = 5000;
     
+    // all scratch memory for this request, on the stack unless a
+    // page generator's cache header is huge
+    unsigned char arenaStorage[ 3 * 4096 ];
+    Arena requestArena( arenaStorage, sizeof( arenaStorage ), 4096 );
+    
     
     // first, receive the request and parse it
     
 
-    SocketStream *sockStream = new SocketStream( mSocket );
+    // buffered, so that reading the request a byte at a time and writing
+    // the header a line at a time don't each cost a system call
+    SocketStream *sockStream = new BufferedSocketStream( mSocket );
 
     int requestBufferLength = maxLength;
-    char *requestBuffer = new char[requestBufferLength];
+    char *requestBuffer =
+        requestArena.allocateArray<char>( requestBufferLength );
     int requestBufferIndex = 0;
         
     // read until we see two \r\n 's in a row
-    unsigned char *charRead = new unsigned char[1];
+    unsigned char charRead[1];
     charRead[0] = 0;
     char requestDone = false;
 
@@ -227,14 +237,14 @@ void RequestHandlingThread::run() {
         // if maxLength = 500,
         // formatString = "%499s"
         // used to limit length of scanned string 
-        char *formatString = new char[ 20 ];
-        sprintf( formatString, "%%%ds", maxLength - 1 );
+        char *formatString =
+            requestArena.formatString( "%%%ds", maxLength - 1 );
         
         
         // the second string scanned from the buffer should
         // be the file path requested
         
-        char *filePathBuffer = new char[ maxLength ];
+        char *filePathBuffer = requestArena.allocateArray<char>( maxLength );
         int numRead = sscanf( requestBuffer, formatString, filePathBuffer );
 
         if( numRead != 1 || strcmp( filePathBuffer, "GET" ) != 0 ) {
@@ -255,12 +265,6 @@ void RequestHandlingThread::run() {
                 }
             }
         
-        delete [] requestBuffer;
-        delete [] charRead;
-
-
-        delete [] formatString;
-        
         if( !error ) {
             // now we have the requested file string
             sockStream->writeString(
@@ -273,13 +277,11 @@ void RequestHandlingThread::run() {
                 sockStream->writeString( "cache-control: no-cache\r\n" );
                 }
             else {
-                char *cacheString = autoSprintf( 
+                char *cacheString = requestArena.formatString( 
                     "cache-control: private, max-age=%d\r\n",
                     cacheSeconds );
                 
                 sockStream->writeString( cacheString );
-                
-                delete [] cacheString;
                 }
             
 
@@ -300,12 +302,6 @@ void RequestHandlingThread::run() {
             // pass it to our page generator, which will send the content
             mGenerator->generatePage( filePathBuffer, sockStream );
             }
-
-        delete [] filePathBuffer;  
-        }
-    else {
-        delete [] requestBuffer;
-        delete [] charRead;
         }
 
     
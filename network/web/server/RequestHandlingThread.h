@@ -28,6 +28,7 @@
 
 #include "minorGems/network/Socket.h"
 #include "minorGems/network/SocketStream.h"
+#include "minorGems/network/BufferedSocketStream.h"
 
 #include "minorGems/system/Thread.h"
 #include "minorGems/system/MutexLock.h"
@@ -276,6 +276,32 @@ int Socket::send( unsigned char *inBuffer, int inNumBytes,
         }
     }
 		
+
+
+
+
+int Socket::sendv( unsigned char **inBuffers, int *inLengths,
+                   int inNumBuffers ) {
+
+    // winsock 1 has no gather send, so send buffers one at a time
+    int numTotalSent = 0;
+    
+    for( int i=0; i<inNumBuffers; i++ ) {
+        int numSent = send( inBuffers[i], inLengths[i] );
+
+        if( numSent == -1 ) {
+            return -1;
+            }
+
+        numTotalSent += numSent;
+        
+        if( numSent < inLengths[i] ) {
+            break;
+            }
+        }
+    
+    return numTotalSent;
+    }
 		
 		
 int Socket::receive( unsigned char *inBuffer, int inNumBytes,
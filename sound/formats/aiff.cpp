@@ -15,6 +15,9 @@
 #include "aiff.h"
 
 #include "minorGems/util/StringBufferOutputStream.h"
+#include "minorGems/system/endian.h"
+
+#include <string.h>
 
 
 
@@ -122,16 +125,14 @@ int16_t *readMono16AIFFData( unsigned char *inData, int inNumBytes,
         }
     
 
-    int numSamples =
-        inData[22] << 24 |
-        inData[23] << 16 |
-        inData[24] << 8 |
-        inData[25];
+    int numSamples = (int32_t)loadBigEndian32( &( inData[22] ) );
 
+    if( numSamples < 0 ) {
+        printf( "AIFF has bad sample count\n" );
+        return NULL;
+        }
 
-    int sampleRate =
-        inData[30] << 8 |
-        inData[31];
+    int sampleRate = loadBigEndian16( &( inData[30] ) );
     
     if( outSampleRate != NULL ) {
         *outSampleRate = sampleRate;
@@ -142,8 +143,9 @@ int16_t *readMono16AIFFData( unsigned char *inData, int inNumBytes,
 
     // there may be other chunks before SSND chunk
     // walk forward until SSND is encountered
+    // (never peek past the end, inData may be a memory-mapped file)
 
-    while( lookForSSNDByte < inNumBytes &&
+    while( lookForSSNDByte + 3 < inNumBytes &&
            ( inData[lookForSSNDByte] != 'S' ||
              inData[lookForSSNDByte + 1] != 'S' ||
              inData[lookForSSNDByte + 2] != 'N' ||
@@ -152,7 +154,7 @@ int16_t *readMono16AIFFData( unsigned char *inData, int inNumBytes,
         }
 
 
-    if( lookForSSNDByte >= inNumBytes ) {
+    if( lookForSSNDByte + 3 >= inNumBytes ) {
         printf( "SSND chunk not found in AIFF inData\n" );
         return NULL;
         }
@@ -166,7 +168,8 @@ int16_t *readMono16AIFFData( unsigned char *inData, int inNumBytes,
     
     int numBytes = numSamples * 2;
                         
-    if( inNumBytes < sampleStartByte + numBytes ) {
+    if( numSamples > inNumBytes / 2 ||
+        inNumBytes < sampleStartByte + numBytes ) {
         printf( "AIFF not long enough for inData\n" );
         return NULL;
         }
@@ -174,13 +177,9 @@ int16_t *readMono16AIFFData( unsigned char *inData, int inNumBytes,
     int16_t *samples = new int16_t[numSamples];
                             
 
-    int b = sampleStartByte;
-    for( int i=0; i<numSamples; i++ ) {
-        samples[i] = 
-            ( inData[b] << 8 ) |
-            inData[b+1];
-        b += 2;
-        }
+    // copy the whole block and swap it into our byte order at once
+    memcpy( samples, &( inData[ sampleStartByte ] ), numBytes );
+    bigEndianArray16( samples, numSamples );
     
     *outNumSamples = numSamples;
                             
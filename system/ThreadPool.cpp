@@ -0,0 +1,166 @@
+#include "minorGems/system/ThreadPool.h"
+
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+
+class ThreadPoolWorker : public Thread {
+    public:
+        
+        ThreadPoolWorker( ThreadPool *inPool )
+                : mPool( inPool ) {
+            }
+        
+        virtual void run() {
+            while( mPool->runNextJob() ) {
+                }
+            }
+        
+    protected:
+        ThreadPool *mPool;
+    };
+
+
+
+ThreadPool::ThreadPool( int inNumThreads )
+        : mJobsAvailable( 0 ), mAllDone( 0 ), 
+          mNextJobIndex( 0 ), mNumUnfinished( 0 ), mNumWaiting( 0 ) {
+    
+    if( inNumThreads <= 0 ) {
+        inNumThreads = getNumProcessors();
+        }
+    
+    for( int i=0; i<inNumThreads; i++ ) {
+        Thread *worker = new ThreadPoolWorker( this );
+        
+        mThreads.push_back( worker );
+        
+        worker->start();
+        }
+    }
+
+
+
+ThreadPool::~ThreadPool() {
+    waitForAllJobs();
+    
+    int numThreads = mThreads.size();
+    
+    // a NULL job tells one worker to exit
+    mLock.lock();
+    for( int i=0; i<numThreads; i++ ) {
+        ThreadPoolJob job = { NULL, NULL };
+        mJobs.push_back( job );
+        }
+    mLock.unlock();
+
+    for( int i=0; i<numThreads; i++ ) {
+        mJobsAvailable.signal();
+        }
+    
+    for( int i=0; i<numThreads; i++ ) {
+        Thread *worker = mThreads.getElementDirect( i );
+        worker->join();
+        delete worker;
+        }
+    }
+
+
+
+void ThreadPool::addJob( ThreadPoolJobFunction inFunction, 
+                         void *inJobData ) {
+    ThreadPoolJob job = { inFunction, inJobData };
+    
+    mLock.lock();
+    mJobs.push_back( job );
+    mNumUnfinished++;
+    mLock.unlock();
+    
+    mJobsAvailable.signal();
+    }
+
+
+
+void ThreadPool::waitForAllJobs() {
+    mLock.lock();
+    
+    if( mNumUnfinished == 0 ) {
+        mLock.unlock();
+        return;
+        }
+    
+    mNumWaiting++;
+    mLock.unlock();
+    
+    mAllDone.wait();
+    }
+
+
+
+int ThreadPool::getNumThreads() {
+    return mThreads.size();
+    }
+
+
+
+int ThreadPool::getNumProcessors() {
+    #ifdef WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo( &info );
+        int num = (int)info.dwNumberOfProcessors;
+    #else
+        int num = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    #endif
+    
+    if( num < 1 ) {
+        num = 1;
+        }
+    return num;
+    }
+
+
+
+char ThreadPool::runNextJob() {
+    mJobsAvailable.wait();
+    
+    mLock.lock();
+    
+    ThreadPoolJob job = mJobs.getElementDirect( mNextJobIndex );
+    mNextJobIndex++;
+    
+    if( mNextJobIndex == mJobs.size() ) {
+        // queue drained, reclaim the taken slots
+        mJobs.deleteAll();
+        mNextJobIndex = 0;
+        }
+    
+    mLock.unlock();
+    
+    
+    if( job.function == NULL ) {
+        return false;
+        }
+    
+    job.function( job.data );
+    
+    
+    mLock.lock();
+    
+    mNumUnfinished--;
+    
+    if( mNumUnfinished == 0 ) {
+        for( int i=0; i<mNumWaiting; i++ ) {
+            mAllDone.signal();
+            }
+        mNumWaiting = 0;
+        }
+    
+    mLock.unlock();
+    
+    return true;
+    }
@@ -0,0 +1,112 @@
+#ifndef THREAD_POOL_INCLUDED
+#define THREAD_POOL_INCLUDED
+
+
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/Semaphore.h"
+
+
+
+// a job function run by one of the pool's worker threads
+typedef void (*ThreadPoolJobFunction)( void *inJobData );
+
+
+
+/**
+ * A fixed set of worker threads that run queued jobs in FIFO order.
+ *
+ * Jobs are plain function/data pairs, so callers can fan out independent
+ * work (hashing files, encoding strips of an image, etc.) without
+ * writing a Thread subclass for each task.
+ */
+class ThreadPool {
+
+    public:
+
+        /**
+         * Constructs a pool and starts its threads.
+         *
+         * @param inNumThreads the number of worker threads, or -1 for one
+         *   thread per processor.  Defaults to -1.
+         */
+        ThreadPool( int inNumThreads = -1 );
+
+
+        /**
+         * Waits for all queued jobs to finish, then stops and joins the
+         * worker threads.
+         */
+        ~ThreadPool();
+
+
+        
+        /**
+         * Queues a job.  Thread safe.
+         *
+         * @param inFunction the function to run.
+         * @param inJobData passed to inFunction.
+         *   Must be destroyed by caller (or by inFunction).
+         */
+        void addJob( ThreadPoolJobFunction inFunction, void *inJobData );
+        
+
+        
+        /**
+         * Blocks until every job added so far has finished running.
+         */
+        void waitForAllJobs();
+        
+
+        
+        int getNumThreads();
+
+
+        
+        /**
+         * Gets the number of online processors, or 1 if it can't be
+         * determined.
+         */
+        static int getNumProcessors();
+
+
+        
+        // called by worker threads
+        // returns false when the worker should exit
+        char runNextJob();
+        
+        
+    protected:
+        
+        typedef struct ThreadPoolJob {
+                ThreadPoolJobFunction function;
+                void *data;
+            } ThreadPoolJob;
+        
+
+        MutexLock mLock;
+        
+        // counts jobs waiting in mJobs
+        Semaphore mJobsAvailable;
+        
+        // signaled once per waiter when mNumUnfinished hits 0
+        Semaphore mAllDone;
+        
+        SimpleVector<ThreadPoolJob> mJobs;
+
+        // jobs before this index have been taken by workers
+        // (avoids shifting the vector every time a job is removed)
+        int mNextJobIndex;
+        
+        int mNumUnfinished;
+        int mNumWaiting;
+        
+        SimpleVector<Thread *> mThreads;
+        
+    };
+
+
+
+#endif
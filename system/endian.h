@@ -109,3 +109,294 @@
 
 
 
+
+
+
+#ifndef ENDIAN_HELPERS_INCLUDED
+#define ENDIAN_HELPERS_INCLUDED
+
+
+/**
+ * Helpers for loading and storing values at any alignment and in either
+ * byte order, and for swapping whole arrays of values at once.
+ *
+ * Loads and stores go through memcpy, which compilers turn into single
+ * moves, so they are safe on unaligned data and don't break aliasing
+ * rules the way casting a byte pointer to a wider type does.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENDIAN_SWAP_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ENDIAN_SWAP_NEON
+#endif
+
+
+
+inline uint16_t byteSwap16( uint16_t inValue ) {
+    return (uint16_t)( ( inValue << 8 ) | ( inValue >> 8 ) );
+    }
+
+
+inline uint32_t byteSwap32( uint32_t inValue ) {
+#if defined(__GNUC__)
+    return __builtin_bswap32( inValue );
+#else
+    return ( inValue << 24 ) | ( ( inValue << 8 ) & 0x00FF0000 ) |
+        ( ( inValue >> 8 ) & 0x0000FF00 ) | ( inValue >> 24 );
+#endif
+    }
+
+
+inline uint64_t byteSwap64( uint64_t inValue ) {
+#if defined(__GNUC__)
+    return __builtin_bswap64( inValue );
+#else
+    return ( (uint64_t)byteSwap32( (uint32_t)inValue ) << 32 ) |
+        byteSwap32( (uint32_t)( inValue >> 32 ) );
+#endif
+    }
+
+
+
+inline uint16_t loadUnaligned16( const void *inAddress ) {
+    uint16_t value;
+    memcpy( &value, inAddress, 2 );
+    return value;
+    }
+
+
+inline uint32_t loadUnaligned32( const void *inAddress ) {
+    uint32_t value;
+    memcpy( &value, inAddress, 4 );
+    return value;
+    }
+
+
+inline uint64_t loadUnaligned64( const void *inAddress ) {
+    uint64_t value;
+    memcpy( &value, inAddress, 8 );
+    return value;
+    }
+
+
+inline void storeUnaligned16( void *inAddress, uint16_t inValue ) {
+    memcpy( inAddress, &inValue, 2 );
+    }
+
+
+inline void storeUnaligned32( void *inAddress, uint32_t inValue ) {
+    memcpy( inAddress, &inValue, 4 );
+    }
+
+
+inline void storeUnaligned64( void *inAddress, uint64_t inValue ) {
+    memcpy( inAddress, &inValue, 8 );
+    }
+
+
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ENDIAN_FROM_BIG( bits, value ) byteSwap##bits( value )
+#define ENDIAN_FROM_LITTLE( bits, value ) ( value )
+#else
+#define ENDIAN_FROM_BIG( bits, value ) ( value )
+#define ENDIAN_FROM_LITTLE( bits, value ) byteSwap##bits( value )
+#endif
+
+
+// loads and stores of values in a given byte order, at any alignment
+
+inline uint16_t loadBigEndian16( const void *inAddress ) {
+    return ENDIAN_FROM_BIG( 16, loadUnaligned16( inAddress ) );
+    }
+
+inline uint32_t loadBigEndian32( const void *inAddress ) {
+    return ENDIAN_FROM_BIG( 32, loadUnaligned32( inAddress ) );
+    }
+
+inline uint64_t loadBigEndian64( const void *inAddress ) {
+    return ENDIAN_FROM_BIG( 64, loadUnaligned64( inAddress ) );
+    }
+
+inline uint16_t loadLittleEndian16( const void *inAddress ) {
+    return ENDIAN_FROM_LITTLE( 16, loadUnaligned16( inAddress ) );
+    }
+
+inline uint32_t loadLittleEndian32( const void *inAddress ) {
+    return ENDIAN_FROM_LITTLE( 32, loadUnaligned32( inAddress ) );
+    }
+
+inline uint64_t loadLittleEndian64( const void *inAddress ) {
+    return ENDIAN_FROM_LITTLE( 64, loadUnaligned64( inAddress ) );
+    }
+
+
+inline void storeBigEndian16( void *inAddress, uint16_t inValue ) {
+    storeUnaligned16( inAddress, ENDIAN_FROM_BIG( 16, inValue ) );
+    }
+
+inline void storeBigEndian32( void *inAddress, uint32_t inValue ) {
+    storeUnaligned32( inAddress, ENDIAN_FROM_BIG( 32, inValue ) );
+    }
+
+inline void storeBigEndian64( void *inAddress, uint64_t inValue ) {
+    storeUnaligned64( inAddress, ENDIAN_FROM_BIG( 64, inValue ) );
+    }
+
+inline void storeLittleEndian16( void *inAddress, uint16_t inValue ) {
+    storeUnaligned16( inAddress, ENDIAN_FROM_LITTLE( 16, inValue ) );
+    }
+
+inline void storeLittleEndian32( void *inAddress, uint32_t inValue ) {
+    storeUnaligned32( inAddress, ENDIAN_FROM_LITTLE( 32, inValue ) );
+    }
+
+inline void storeLittleEndian64( void *inAddress, uint64_t inValue ) {
+    storeUnaligned64( inAddress, ENDIAN_FROM_LITTLE( 64, inValue ) );
+    }
+
+
+
+/**
+ * Reverses the byte order of every value in an array, in place.
+ *
+ * inValues can have any alignment.  Sixteen bytes are swapped at a time
+ * with SSE2 or NEON where available.
+ *
+ * @param inValues the array of values to swap.
+ *   Must be destroyed by caller.
+ * @param inNumValues the number of values (not bytes) in the array.
+ */
+inline void byteSwapArray16( void *inValues, int inNumValues ) {
+    unsigned char *bytes = (unsigned char *)inValues;
+    long i = 0;
+
+#if defined(ENDIAN_SWAP_SSE2)
+    for( ; i + 8 <= inNumValues; i += 8 ) {
+        __m128i *p = (__m128i *)( &( bytes[ i * 2 ] ) );
+        __m128i v = _mm_loadu_si128( p );
+        v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+        _mm_storeu_si128( p, v );
+        }
+#elif defined(ENDIAN_SWAP_NEON)
+    for( ; i + 8 <= inNumValues; i += 8 ) {
+        uint8_t *p = &( bytes[ i * 2 ] );
+        vst1q_u8( p, vrev16q_u8( vld1q_u8( p ) ) );
+        }
+#endif
+
+    unsigned char *end = &( bytes[ (long)inNumValues * 2 ] );
+
+    for( unsigned char *p = &( bytes[ i * 2 ] ); p < end; p += 2 ) {
+        storeUnaligned16( p, byteSwap16( loadUnaligned16( p ) ) );
+        }
+    }
+
+
+inline void byteSwapArray32( void *inValues, int inNumValues ) {
+    unsigned char *bytes = (unsigned char *)inValues;
+    long i = 0;
+
+#if defined(ENDIAN_SWAP_SSE2)
+    for( ; i + 4 <= inNumValues; i += 4 ) {
+        __m128i *p = (__m128i *)( &( bytes[ i * 4 ] ) );
+        __m128i v = _mm_loadu_si128( p );
+        // swap bytes within each 16-bit half, then swap the halves
+        v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+        v = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        v = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        _mm_storeu_si128( p, v );
+        }
+#elif defined(ENDIAN_SWAP_NEON)
+    for( ; i + 4 <= inNumValues; i += 4 ) {
+        uint8_t *p = &( bytes[ i * 4 ] );
+        vst1q_u8( p, vrev32q_u8( vld1q_u8( p ) ) );
+        }
+#endif
+
+    unsigned char *end = &( bytes[ (long)inNumValues * 4 ] );
+
+    for( unsigned char *p = &( bytes[ i * 4 ] ); p < end; p += 4 ) {
+        storeUnaligned32( p, byteSwap32( loadUnaligned32( p ) ) );
+        }
+    }
+
+
+inline void byteSwapArray64( void *inValues, int inNumValues ) {
+    unsigned char *bytes = (unsigned char *)inValues;
+    long i = 0;
+
+#if defined(ENDIAN_SWAP_SSE2)
+    for( ; i + 2 <= inNumValues; i += 2 ) {
+        __m128i *p = (__m128i *)( &( bytes[ i * 8 ] ) );
+        __m128i v = _mm_loadu_si128( p );
+        // swap bytes within each 16-bit quarter, then reverse the quarters
+        v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+        v = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+        v = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+        _mm_storeu_si128( p, v );
+        }
+#elif defined(ENDIAN_SWAP_NEON)
+    for( ; i + 2 <= inNumValues; i += 2 ) {
+        uint8_t *p = &( bytes[ i * 8 ] );
+        vst1q_u8( p, vrev64q_u8( vld1q_u8( p ) ) );
+        }
+#endif
+
+    unsigned char *end = &( bytes[ (long)inNumValues * 8 ] );
+
+    for( unsigned char *p = &( bytes[ i * 8 ] ); p < end; p += 8 ) {
+        storeUnaligned64( p, byteSwap64( loadUnaligned64( p ) ) );
+        }
+    }
+
+
+
+// converts arrays between a file byte order and this machine's, in place
+// (the same swap serves both directions)
+
+inline void bigEndianArray16( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    byteSwapArray16( inValues, inNumValues );
+#endif
+    }
+
+inline void bigEndianArray32( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    byteSwapArray32( inValues, inNumValues );
+#endif
+    }
+
+inline void bigEndianArray64( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    byteSwapArray64( inValues, inNumValues );
+#endif
+    }
+
+inline void littleEndianArray16( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    byteSwapArray16( inValues, inNumValues );
+#endif
+    }
+
+inline void littleEndianArray32( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    byteSwapArray32( inValues, inNumValues );
+#endif
+    }
+
+inline void littleEndianArray64( void *inValues, int inNumValues ) {
+#if __BYTE_ORDER == __BIG_ENDIAN
+    byteSwapArray64( inValues, inNumValues );
+#endif
+    }
+
+
+#endif
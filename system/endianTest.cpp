@@ -0,0 +1,173 @@
+// Checks the endian.h load/store and array swap helpers against a
+// byte-at-a-time reference, at every alignment and for lengths that leave
+// a scalar tail, then times swapping a large array both ways.
+
+
+#include "endian.h"
+#include "Time.h"
+
+#include "minorGems/io/TypeIO.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+
+// reverses each inSize-byte value, one byte at a time
+static void referenceSwap( unsigned char *inBytes, int inNumValues,
+                           int inSize ) {
+    for( int i=0; i<inNumValues; i++ ) {
+        unsigned char *p = &( inBytes[ i * inSize ] );
+        for( int b=0; b<inSize / 2; b++ ) {
+            unsigned char temp = p[b];
+            p[b] = p[ inSize - 1 - b ];
+            p[ inSize - 1 - b ] = temp;
+            }
+        }
+    }
+
+
+
+static void testArraySwaps() {
+    unsigned char source[ 8 * 40 + 16 ];
+    for( unsigned int i=0; i<sizeof( source ); i++ ) {
+        source[i] = (unsigned char)( i * 7 + 3 );
+        }
+
+    for( int size=2; size<=8; size *= 2 ) {
+        for( int offset=0; offset<8; offset++ ) {
+            for( int count=0; count<=40; count++ ) {
+                unsigned char expected[ sizeof( source ) ];
+                unsigned char actual[ sizeof( source ) ];
+
+                memcpy( expected, source, sizeof( source ) );
+                memcpy( actual, source, sizeof( source ) );
+
+                referenceSwap( &( expected[ offset ] ), count, size );
+
+                if( size == 2 ) {
+                    byteSwapArray16( &( actual[ offset ] ), count );
+                    }
+                else if( size == 4 ) {
+                    byteSwapArray32( &( actual[ offset ] ), count );
+                    }
+                else {
+                    byteSwapArray64( &( actual[ offset ] ), count );
+                    }
+
+                if( memcmp( expected, actual, sizeof( source ) ) != 0 ) {
+                    printf( "size %d, offset %d, count %d\n",
+                            size, offset, count );
+                    check( false, "array swap" );
+                    }
+                }
+            }
+        }
+    }
+
+
+
+static void testLoadsAndStores() {
+    unsigned char bytes[9] = { 0, 0x12, 0x34, 0x56, 0x78,
+                               0x9A, 0xBC, 0xDE, 0xF0 };
+
+    // odd address on purpose
+    check( loadBigEndian16( &( bytes[1] ) ) == 0x1234, "big 16" );
+    check( loadBigEndian32( &( bytes[1] ) ) == 0x12345678, "big 32" );
+    check( loadBigEndian64( &( bytes[1] ) ) == 0x123456789ABCDEF0ULL,
+           "big 64" );
+    check( loadLittleEndian16( &( bytes[1] ) ) == 0x3412, "little 16" );
+    check( loadLittleEndian32( &( bytes[1] ) ) == 0x78563412, "little 32" );
+    check( loadLittleEndian64( &( bytes[1] ) ) == 0xF0DEBC9A78563412ULL,
+           "little 64" );
+
+    unsigned char out[9];
+    storeBigEndian32( &( out[1] ), 0x12345678 );
+    check( memcmp( &( out[1] ), &( bytes[1] ), 4 ) == 0, "store big 32" );
+
+    storeLittleEndian64( &( out[1] ), 0xF0DEBC9A78563412ULL );
+    check( memcmp( &( out[1] ), &( bytes[1] ), 8 ) == 0,
+           "store little 64" );
+
+
+    // TypeIO keeps its old format, including sign extension
+    unsigned char typeBytes[4];
+    TypeIO::longToBytes( -2, typeBytes );
+    check( typeBytes[0] == 0xFF && typeBytes[3] == 0xFE, "longToBytes" );
+    check( TypeIO::bytesToLong( typeBytes ) == -2, "bytesToLong" );
+
+    TypeIO::shortToBytes( -300, typeBytes );
+    check( TypeIO::bytesToShort( typeBytes ) == -300, "bytesToShort" );
+
+    long longs[3] = { 1, -1, 2147483647 };
+    long readLongs[3];
+    unsigned char longBytes[12];
+    TypeIO::longsToBytes( longs, 3, longBytes );
+    TypeIO::bytesToLongs( longBytes, 3, readLongs );
+    check( memcmp( longs, readLongs, sizeof( longs ) ) == 0,
+           "long array round trip" );
+    check( TypeIO::bytesToLong( &( longBytes[4] ) ) == -1,
+           "long array format" );
+
+    short shorts[5] = { 0, 1, -1, 32767, -32768 };
+    short readShorts[5];
+    unsigned char shortBytes[10];
+    TypeIO::shortsToBytes( shorts, 5, shortBytes );
+    TypeIO::bytesToShorts( shortBytes, 5, readShorts );
+    check( memcmp( shorts, readShorts, sizeof( shorts ) ) == 0,
+           "short array round trip" );
+    check( shortBytes[6] == 0x7F && shortBytes[7] == 0xFF,
+           "short array format" );
+    }
+
+
+
+static void timeSwaps() {
+    int numValues = 1 << 22;
+    int numPasses = 20;
+
+    int16_t *samples = new int16_t[ numValues ];
+    for( int i=0; i<numValues; i++ ) {
+        samples[i] = (int16_t)( i * 31 );
+        }
+
+    unsigned char *bytes = (unsigned char *)samples;
+
+    double startTime = Time::getCurrentTime();
+
+    for( int p=0; p<numPasses; p++ ) {
+        // the way readers decoded samples before
+        for( int i=0; i<numValues; i++ ) {
+            samples[i] = (int16_t)( ( bytes[ i * 2 ] << 8 ) |
+                                    bytes[ i * 2 + 1 ] );
+            }
+        }
+
+    double perValueTime = Time::getCurrentTime() - startTime;
+
+    startTime = Time::getCurrentTime();
+
+    for( int p=0; p<numPasses; p++ ) {
+        byteSwapArray16( samples, numValues );
+        }
+
+    double arrayTime = Time::getCurrentTime() - startTime;
+
+    printf( "Swapping %d x %d 16-bit values:  per value %.1f ms, "
+            "array %.1f ms\n", numPasses, numValues,
+            perValueTime * 1000, arrayTime * 1000 );
+
+    delete [] samples;
+    }
+
+
+
+int main() {
+    testArraySwaps();
+    testLoadsAndStores();
+    timeSwaps();
+
+    return reportChecks();
+    }
@@ -105,7 +105,12 @@ int BinarySemaphore::wait( int inTimeoutInMilliseconds ) {
 
         if( inTimeoutInMilliseconds == -1 ) {
             // no timeout
-            pthread_cond_wait( &( condPointer[0] ), &( mutexPointer[0] ) );
+            // loop, because another thread can take the signal between
+            // our wake-up and our re-lock (and wake-ups can be spurious)
+            while( mSemaphoreValue == 0 ) {
+                pthread_cond_wait( &( condPointer[0] ), 
+                                   &( mutexPointer[0] ) );
+                }
             }
         else {
             // use timeout version
@@ -142,11 +147,15 @@ int BinarySemaphore::wait( int inTimeoutInMilliseconds ) {
             abstime.tv_sec = absTimeoutSec;
             abstime.tv_nsec = absTimeoutNsec;
 
-            int result = pthread_cond_timedwait( &( condPointer[0] ),
+            int result = 0;
+            
+            while( mSemaphoreValue == 0 && result == 0 ) {
+                result = pthread_cond_timedwait( &( condPointer[0] ),
                                                  &( mutexPointer[0] ),
                                                  &abstime );
+                }
 
-            if( result != 0 ) {
+            if( mSemaphoreValue == 0 ) {
                 // timed out
                 returnValue = 0;
                 }
@@ -43,10 +43,18 @@
  * g++ -lpthread
  * If thread profiling is desired for gprof on linux, compile
  * with -DUSE_GPROF_THREADS (otherwise, only main thread is profiled).
+ * To have SamplingProfiler sample every Thread, compile with
+ * -DUSE_SAMPLING_PROFILER.
  */
 
 
 
+#ifdef USE_SAMPLING_PROFILER
+#include "minorGems/util/development/wallClockProfiler/SamplingProfiler.h"
+#endif
+
+
+
 #ifdef USE_GPROF_THREADS
 // prototype
 int gprof_pthread_create( pthread_t * thread, pthread_attr_t * attr,
@@ -141,8 +149,17 @@ void Thread::staticSleep( unsigned long inTimeInMilliseconds ) {
 // takes a pointer to a Thread object as the data value
 void *linuxThreadFunction( void *inPtrToThread ) {
 	Thread *threadToRun = (Thread *)inPtrToThread;
+
+#ifdef USE_SAMPLING_PROFILER
+    SamplingProfiler::registerThread();
+#endif
+
 	threadToRun->run();
 
+#ifdef USE_SAMPLING_PROFILER
+    SamplingProfiler::unregisterThread();
+#endif
+
     if( threadToRun->isDetatched() ) {
         // thread detached, so we must destroy it
         delete threadToRun;
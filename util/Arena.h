@@ -0,0 +1,431 @@
+#include "minorGems/common.h"
+
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+
+
+// internal to Arena
+typedef struct ArenaChunk {
+        ArenaChunk *next;
+
+        // bytes of data after this header
+        size_t size;
+
+        // bytes handed out so far
+        size_t used;
+
+        // true if the data is caller-supplied and must not be deleted
+        char external;
+
+        // the data, aligned past the header
+        unsigned char *data;
+    } ArenaChunk;
+
+
+
+// a saved allocation point, see Arena::getMarker
+typedef struct ArenaMarker {
+        ArenaChunk *chunk;
+        size_t used;
+    } ArenaMarker;
+
+
+
+/**
+ * A bump-pointer allocator for scratch memory that all dies at once.
+ *
+ * Allocation just advances a pointer through a chunk of memory.  Nothing
+ * is freed individually:  reset() or resetToMarker() hand back everything
+ * allocated since.  Chunks are kept across resets, so once an arena has
+ * grown to fit a frame's or a request's scratch memory, later frames do
+ * no heap allocation at all.
+ *
+ * Only for plain data:  constructors and destructors are never run.
+ *
+ * Not thread-safe.  Each thread has its own frame arena (getFrameArena),
+ * which the game loop resets at the end of every frame.
+ *
+ * @author Jason Rohrer
+ */
+class Arena {
+
+    public:
+
+        /**
+         * Constructs an empty arena.
+         *
+         * @param inChunkSize the size of each chunk allocated from the
+         *   heap.  Bigger requests get a chunk of their own.
+         *   Defaults to 64 KiB.
+         */
+        Arena( size_t inChunkSize = 65536 );
+
+
+        /**
+         * Constructs an arena that starts out in caller-supplied memory,
+         * typically a local array, and only uses the heap if that runs
+         * out.
+         *
+         * @param inInitialBuffer the memory to use first.
+         *   Must be destroyed by caller after this arena is destroyed.
+         * @param inInitialSize the size of inInitialBuffer.
+         * @param inChunkSize the size of heap chunks after that.
+         */
+        Arena( void *inInitialBuffer, size_t inInitialSize,
+               size_t inChunkSize = 65536 );
+
+        ~Arena();
+
+
+
+        /**
+         * Allocates memory that lives until the next reset.
+         *
+         * @param inNumBytes the number of bytes.
+         * @param inAlignment a power of two.  Defaults to 16.
+         *
+         * @return the memory, uninitialized.  Never NULL.
+         *   Must NOT be destroyed by caller.
+         */
+        void *allocate( size_t inNumBytes, size_t inAlignment = 16 );
+
+
+        // allocates an array of plain data, uninitialized
+        template <class Type>
+        Type *allocateArray( size_t inCount );
+
+
+        // copies a \0-terminated string into the arena
+        char *duplicateString( const char *inString );
+
+
+        // like autoSprintf, but the result lives in the arena
+        char *formatString( const char *inFormatString, ... );
+
+
+
+        /**
+         * Gets the current allocation point, so that later allocations
+         * can be handed back with resetToMarker.  Markers nest.
+         */
+        ArenaMarker getMarker();
+
+
+        // hands back everything allocated since inMarker was taken
+        void resetToMarker( ArenaMarker inMarker );
+
+
+        // hands back everything, keeping all chunks for reuse
+        void reset();
+
+
+
+        // bytes currently handed out
+        size_t getNumBytesUsed();
+
+        // how many chunks have come from the heap over this arena's life
+        int getNumHeapChunks();
+
+
+
+        /**
+         * Gets this thread's frame arena, for scratch memory that only
+         * has to last until the end of the current frame.
+         *
+         * @return the arena.  Must NOT be destroyed by caller.
+         */
+        static Arena *getFrameArena();
+
+
+    protected:
+
+        // makes the chunk after mCurrent able to hold inNumBytes at
+        // inAlignment and moves to it
+        void advance( size_t inNumBytes, size_t inAlignment );
+
+        ArenaChunk *newChunk( size_t inSize );
+
+
+        size_t mChunkSize;
+
+        ArenaChunk *mFirst;
+        ArenaChunk *mCurrent;
+
+        // header for caller-supplied memory
+        ArenaChunk mInitialChunk;
+
+        int mNumHeapChunks;
+
+    };
+
+
+
+/**
+ * Resets an arena to where it was when this scope was entered, when the
+ * scope is left.
+ *
+ * Lets helpers use the frame arena for their own scratch memory without
+ * waiting for the end of the frame.
+ */
+class ArenaScope {
+
+    public:
+
+        ArenaScope( Arena *inArena )
+            : mArena( inArena ), mMarker( inArena->getMarker() ) {
+            }
+
+        ~ArenaScope() {
+            mArena->resetToMarker( mMarker );
+            }
+
+    protected:
+        Arena *mArena;
+        ArenaMarker mMarker;
+    };
+
+
+
+// header space at the start of each heap chunk, keeping data aligned
+#define ARENA_HEADER_SIZE ( ( sizeof( ArenaChunk ) + 15 ) & ~(size_t)15 )
+
+
+
+inline Arena::Arena( size_t inChunkSize )
+    : mChunkSize( inChunkSize ),
+      mFirst( NULL ), mCurrent( NULL ),
+      mNumHeapChunks( 0 ) {
+    }
+
+
+
+inline Arena::Arena( void *inInitialBuffer, size_t inInitialSize,
+                     size_t inChunkSize )
+    : mChunkSize( inChunkSize ),
+      mNumHeapChunks( 0 ) {
+
+    mInitialChunk.next = NULL;
+    mInitialChunk.size = inInitialSize;
+    mInitialChunk.used = 0;
+    mInitialChunk.external = true;
+    mInitialChunk.data = (unsigned char *)inInitialBuffer;
+
+    mFirst = &mInitialChunk;
+    mCurrent = &mInitialChunk;
+    }
+
+
+
+inline Arena::~Arena() {
+    ArenaChunk *chunk = mFirst;
+
+    while( chunk != NULL ) {
+        ArenaChunk *next = chunk->next;
+
+        if( ! chunk->external ) {
+            delete [] (unsigned char *)chunk;
+            }
+        chunk = next;
+        }
+    }
+
+
+
+inline ArenaChunk *Arena::newChunk( size_t inSize ) {
+    unsigned char *block = new unsigned char[ ARENA_HEADER_SIZE + inSize ];
+
+    ArenaChunk *chunk = (ArenaChunk *)block;
+
+    chunk->next = NULL;
+    chunk->size = inSize;
+    chunk->used = 0;
+    chunk->external = false;
+    chunk->data = &( block[ ARENA_HEADER_SIZE ] );
+
+    mNumHeapChunks++;
+
+    return chunk;
+    }
+
+
+
+inline void Arena::advance( size_t inNumBytes, size_t inAlignment ) {
+    // room for the worst-case alignment padding
+    size_t needed = inNumBytes + inAlignment;
+
+    ArenaChunk *next;
+
+    if( mCurrent == NULL ) {
+        next = mFirst;
+        }
+    else {
+        next = mCurrent->next;
+        }
+
+    if( next == NULL || next->size < needed ) {
+        // insert a new chunk here, ahead of any smaller one
+        size_t size = mChunkSize;
+        if( size < needed ) {
+            size = needed;
+            }
+
+        ArenaChunk *chunk = newChunk( size );
+        chunk->next = next;
+
+        if( mCurrent == NULL ) {
+            mFirst = chunk;
+            }
+        else {
+            mCurrent->next = chunk;
+            }
+        next = chunk;
+        }
+
+    next->used = 0;
+    mCurrent = next;
+    }
+
+
+
+inline void *Arena::allocate( size_t inNumBytes, size_t inAlignment ) {
+
+    if( mCurrent != NULL ) {
+        size_t address = (size_t)( mCurrent->data + mCurrent->used );
+        size_t padding = ( inAlignment - ( address & ( inAlignment - 1 ) ) ) &
+            ( inAlignment - 1 );
+
+        if( mCurrent->used + padding + inNumBytes <= mCurrent->size ) {
+            mCurrent->used += padding;
+
+            void *result = mCurrent->data + mCurrent->used;
+            mCurrent->used += inNumBytes;
+
+            return result;
+            }
+        }
+
+    advance( inNumBytes, inAlignment );
+
+    // now fits, with padding
+    return allocate( inNumBytes, inAlignment );
+    }
+
+
+
+template <class Type>
+inline Type *Arena::allocateArray( size_t inCount ) {
+    size_t alignment = __alignof__( Type );
+    if( alignment < 8 ) {
+        alignment = 8;
+        }
+    return (Type *)allocate( inCount * sizeof( Type ), alignment );
+    }
+
+
+
+inline char *Arena::duplicateString( const char *inString ) {
+    size_t length = strlen( inString );
+
+    char *copy = (char *)allocate( length + 1, 1 );
+    memcpy( copy, inString, length + 1 );
+
+    return copy;
+    }
+
+
+
+inline char *Arena::formatString( const char *inFormatString, ... ) {
+    va_list argList;
+
+    va_start( argList, inFormatString );
+    int length = vsnprintf( NULL, 0, inFormatString, argList );
+    va_end( argList );
+
+    if( length < 0 ) {
+        length = 0;
+        }
+
+    char *result = (char *)allocate( length + 1, 1 );
+
+    va_start( argList, inFormatString );
+    vsnprintf( result, length + 1, inFormatString, argList );
+    va_end( argList );
+
+    return result;
+    }
+
+
+
+inline ArenaMarker Arena::getMarker() {
+    ArenaMarker marker;
+    marker.chunk = mCurrent;
+    marker.used = ( mCurrent != NULL ) ? mCurrent->used : 0;
+
+    return marker;
+    }
+
+
+
+inline void Arena::resetToMarker( ArenaMarker inMarker ) {
+    mCurrent = inMarker.chunk;
+
+    if( mCurrent != NULL ) {
+        mCurrent->used = inMarker.used;
+        }
+    }
+
+
+
+inline void Arena::reset() {
+    mCurrent = mFirst;
+
+    if( mCurrent != NULL ) {
+        mCurrent->used = 0;
+        }
+    }
+
+
+
+inline size_t Arena::getNumBytesUsed() {
+    size_t total = 0;
+
+    if( mCurrent == NULL ) {
+        // nothing allocated yet, or reset to before the first allocation
+        return 0;
+        }
+    
+    for( ArenaChunk *chunk = mFirst; chunk != NULL; chunk = chunk->next ) {
+        total += chunk->used;
+
+        if( chunk == mCurrent ) {
+            break;
+            }
+        }
+    return total;
+    }
+
+
+
+inline int Arena::getNumHeapChunks() {
+    return mNumHeapChunks;
+    }
+
+
+
+inline Arena *Arena::getFrameArena() {
+    static thread_local Arena frameArena;
+
+    return &frameArena;
+    }
+
+
+
+#endif
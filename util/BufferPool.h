@@ -0,0 +1,503 @@
+#include "minorGems/common.h"
+
+
+#ifndef BUFFER_POOL_INCLUDED
+#define BUFFER_POOL_INCLUDED
+
+
+#include <stddef.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define bufferPoolYield() SwitchToThread()
+#else
+#include <sched.h>
+#define bufferPoolYield() sched_yield()
+#endif
+
+
+
+// smallest pooled block is 256 bytes
+#define BUFFER_POOL_MIN_CLASS_BITS 8
+
+// largest is 256 << 14 = 4 MiB; bigger requests bypass the pool
+#define BUFFER_POOL_NUM_CLASSES 15
+
+// how many bytes of blocks of each size a thread keeps for itself
+#define BUFFER_POOL_THREAD_CACHE_BYTES ( 1 << 20 )
+
+// each class's shared depot holds this many thread caches' worth
+#define BUFFER_POOL_DEPOT_FACTOR 4
+
+
+
+/**
+ * Header at the start of every pooled block.  Data follows it.
+ */
+typedef struct BufferPoolBlock {
+        // link while on a free list
+        BufferPoolBlock *next;
+
+        // -1 for blocks too big for the pool
+        int sizeClass;
+
+        // usable bytes after the header
+        int capacity;
+
+        // number of ByteBuffers sharing this block
+        int refCount;
+
+        // pads the header to 32 bytes so data stays 16-byte aligned
+        int padding[ ( 32 - sizeof( void* ) - 3 * sizeof( int ) ) /
+                     sizeof( int ) ];
+    } BufferPoolBlock;
+
+
+
+typedef struct BufferPoolStats {
+        // blocks that had to come from new[]
+        long numFreshAllocations;
+
+        // blocks handed out again from a cache or the depot
+        long numReuses;
+
+        // blocks deleted because the depot was full
+        long numDiscards;
+    } BufferPoolStats;
+
+
+
+/**
+ * A pool of byte blocks in power-of-two size classes, shared by all
+ * threads.
+ *
+ * Each thread keeps a small cache of free blocks per size class, so
+ * allocate and release normally touch no shared state.  Caches trade
+ * blocks with a global depot in batches of half a cache, under a
+ * spin lock, when they run empty or full.  Blocks freed by one thread
+ * and reused by another pass through the depot.
+ *
+ * Header-only, so code can use pooled buffers without linking anything
+ * extra.  Usually used through ByteBuffer, which reference-counts blocks.
+ *
+ * @author Jason Rohrer
+ */
+class BufferPool {
+
+    public:
+
+        /**
+         * Gets a block with at least inMinCapacity data bytes.
+         *
+         * @param inMinCapacity the number of bytes needed.
+         *
+         * @return a block with its refCount set to 1.
+         *   Must be returned with release.
+         */
+        static BufferPoolBlock *allocate( int inMinCapacity );
+
+
+        /**
+         * Returns a block to the pool.
+         *
+         * @param inBlock the block.  Can come from any thread.
+         */
+        static void release( BufferPoolBlock *inBlock );
+
+
+        // gets the data bytes of a block
+        static unsigned char *getData( BufferPoolBlock *inBlock );
+
+
+        // counts since the program started, across all threads
+        static void getStats( BufferPoolStats *outStats );
+
+
+        // deletes all blocks held by the depot
+        static void trim();
+
+
+    protected:
+
+        typedef struct ThreadCache {
+                BufferPoolBlock *lists[ BUFFER_POOL_NUM_CLASSES ];
+                int counts[ BUFFER_POOL_NUM_CLASSES ];
+
+                ThreadCache();
+
+                // hands everything to the depot when the thread exits
+                ~ThreadCache();
+            } ThreadCache;
+
+
+        typedef struct Depot {
+                BufferPoolBlock *lists[ BUFFER_POOL_NUM_CLASSES ];
+                int counts[ BUFFER_POOL_NUM_CLASSES ];
+
+                char lockFlag;
+
+                BufferPoolStats stats;
+            } Depot;
+
+
+        // NULL once this thread's cache has been destroyed
+        static ThreadCache *getThreadCache();
+
+        // set once a thread's cache is gone, so releases during thread
+        // teardown go straight to the depot
+        static char *getCacheDestroyedFlag();
+
+        static Depot *getDepot();
+
+        static void lockDepot( Depot *inDepot );
+        static void unlockDepot( Depot *inDepot );
+
+        static int getSizeClass( int inMinCapacity );
+
+        static int getClassCapacity( int inSizeClass );
+
+        // how many free blocks of a class one thread keeps
+        static int getCacheLimit( int inSizeClass );
+
+        static void countStat( long *inCounter );
+
+        // moves up to inNumBlocks blocks from the depot into a cache
+        static void refill( ThreadCache *inCache, int inSizeClass,
+                            int inNumBlocks );
+
+        // moves inNumBlocks blocks from a list to the depot,
+        // deleting those that don't fit
+        // returns the rest of the list
+        static BufferPoolBlock *drain( BufferPoolBlock *inList,
+                                       int inSizeClass, int inNumBlocks );
+
+        static void deleteBlock( BufferPoolBlock *inBlock );
+
+    };
+
+
+
+inline BufferPool::ThreadCache::ThreadCache() {
+    for( int c=0; c<BUFFER_POOL_NUM_CLASSES; c++ ) {
+        lists[c] = NULL;
+        counts[c] = 0;
+        }
+    }
+
+
+
+inline char *BufferPool::getCacheDestroyedFlag() {
+    static thread_local char destroyed = false;
+
+    return &destroyed;
+    }
+
+
+
+inline BufferPool::ThreadCache::~ThreadCache() {
+    for( int c=0; c<BUFFER_POOL_NUM_CLASSES; c++ ) {
+        drain( lists[c], c, counts[c] );
+        lists[c] = NULL;
+        counts[c] = 0;
+        }
+    *getCacheDestroyedFlag() = true;
+    }
+
+
+
+inline BufferPool::ThreadCache *BufferPool::getThreadCache() {
+    if( *getCacheDestroyedFlag() ) {
+        return NULL;
+        }
+
+    static thread_local ThreadCache cache;
+
+    return &cache;
+    }
+
+
+
+inline BufferPool::Depot *BufferPool::getDepot() {
+    // zero-initialized before any code runs
+    static Depot depot;
+
+    return &depot;
+    }
+
+
+
+inline void BufferPool::lockDepot( Depot *inDepot ) {
+    while( __atomic_test_and_set( &( inDepot->lockFlag ),
+                                  __ATOMIC_ACQUIRE ) ) {
+        // held only for a few list operations
+        bufferPoolYield();
+        }
+    }
+
+
+
+inline void BufferPool::unlockDepot( Depot *inDepot ) {
+    __atomic_clear( &( inDepot->lockFlag ), __ATOMIC_RELEASE );
+    }
+
+
+
+inline int BufferPool::getSizeClass( int inMinCapacity ) {
+    if( inMinCapacity <= ( 1 << BUFFER_POOL_MIN_CLASS_BITS ) ) {
+        return 0;
+        }
+
+    // bits needed to hold inMinCapacity - 1 is log2 of the class size
+    int numBits = 32 - __builtin_clz( (unsigned int)( inMinCapacity - 1 ) );
+
+    int sizeClass = numBits - BUFFER_POOL_MIN_CLASS_BITS;
+
+    if( sizeClass >= BUFFER_POOL_NUM_CLASSES ) {
+        return -1;
+        }
+    return sizeClass;
+    }
+
+
+
+inline int BufferPool::getClassCapacity( int inSizeClass ) {
+    return 1 << ( BUFFER_POOL_MIN_CLASS_BITS + inSizeClass );
+    }
+
+
+
+inline int BufferPool::getCacheLimit( int inSizeClass ) {
+    int limit = BUFFER_POOL_THREAD_CACHE_BYTES /
+        getClassCapacity( inSizeClass );
+
+    if( limit > 64 ) {
+        limit = 64;
+        }
+    if( limit < 2 ) {
+        limit = 2;
+        }
+    return limit;
+    }
+
+
+
+inline void BufferPool::countStat( long *inCounter ) {
+    __atomic_add_fetch( inCounter, 1, __ATOMIC_RELAXED );
+    }
+
+
+
+inline unsigned char *BufferPool::getData( BufferPoolBlock *inBlock ) {
+    return (unsigned char *)inBlock + sizeof( BufferPoolBlock );
+    }
+
+
+
+inline void BufferPool::deleteBlock( BufferPoolBlock *inBlock ) {
+    delete [] (unsigned char *)inBlock;
+    }
+
+
+
+inline void BufferPool::refill( ThreadCache *inCache, int inSizeClass,
+                                int inNumBlocks ) {
+    Depot *depot = getDepot();
+
+    lockDepot( depot );
+
+    while( inNumBlocks > 0 && depot->lists[ inSizeClass ] != NULL ) {
+        BufferPoolBlock *block = depot->lists[ inSizeClass ];
+        depot->lists[ inSizeClass ] = block->next;
+        depot->counts[ inSizeClass ]--;
+
+        block->next = inCache->lists[ inSizeClass ];
+        inCache->lists[ inSizeClass ] = block;
+        inCache->counts[ inSizeClass ]++;
+
+        inNumBlocks--;
+        }
+
+    unlockDepot( depot );
+    }
+
+
+
+inline BufferPoolBlock *BufferPool::drain( BufferPoolBlock *inList,
+                                           int inSizeClass,
+                                           int inNumBlocks ) {
+    Depot *depot = getDepot();
+
+    int depotLimit = getCacheLimit( inSizeClass ) * BUFFER_POOL_DEPOT_FACTOR;
+
+    // blocks that don't fit are deleted after the lock is dropped
+    BufferPoolBlock *discards = NULL;
+
+    lockDepot( depot );
+
+    while( inNumBlocks > 0 && inList != NULL ) {
+        BufferPoolBlock *block = inList;
+        inList = block->next;
+
+        if( depot->counts[ inSizeClass ] < depotLimit ) {
+            block->next = depot->lists[ inSizeClass ];
+            depot->lists[ inSizeClass ] = block;
+            depot->counts[ inSizeClass ]++;
+            }
+        else {
+            block->next = discards;
+            discards = block;
+            }
+        inNumBlocks--;
+        }
+
+    unlockDepot( depot );
+
+    while( discards != NULL ) {
+        BufferPoolBlock *next = discards->next;
+        deleteBlock( discards );
+        countStat( &( depot->stats.numDiscards ) );
+        discards = next;
+        }
+
+    return inList;
+    }
+
+
+
+inline BufferPoolBlock *BufferPool::allocate( int inMinCapacity ) {
+    if( inMinCapacity < 0 ) {
+        inMinCapacity = 0;
+        }
+
+    int sizeClass = getSizeClass( inMinCapacity );
+
+    BufferPoolBlock *block = NULL;
+
+    if( sizeClass >= 0 ) {
+        ThreadCache *cache = getThreadCache();
+
+        if( cache != NULL ) {
+            if( cache->lists[ sizeClass ] == NULL ) {
+                refill( cache, sizeClass, getCacheLimit( sizeClass ) / 2 );
+                }
+
+            block = cache->lists[ sizeClass ];
+
+            if( block != NULL ) {
+                cache->lists[ sizeClass ] = block->next;
+                cache->counts[ sizeClass ]--;
+                }
+            }
+        }
+
+    Depot *depot = getDepot();
+
+    if( block != NULL ) {
+        countStat( &( depot->stats.numReuses ) );
+        }
+    else {
+        int capacity = inMinCapacity;
+
+        if( sizeClass >= 0 ) {
+            capacity = getClassCapacity( sizeClass );
+            }
+
+        block = (BufferPoolBlock *)
+            new unsigned char[ sizeof( BufferPoolBlock ) + capacity ];
+
+        block->sizeClass = sizeClass;
+        block->capacity = capacity;
+
+        countStat( &( depot->stats.numFreshAllocations ) );
+        }
+
+    block->next = NULL;
+    block->refCount = 1;
+
+    return block;
+    }
+
+
+
+inline void BufferPool::release( BufferPoolBlock *inBlock ) {
+    int sizeClass = inBlock->sizeClass;
+
+    if( sizeClass < 0 ) {
+        deleteBlock( inBlock );
+        return;
+        }
+
+    ThreadCache *cache = getThreadCache();
+
+    if( cache == NULL ) {
+        inBlock->next = NULL;
+        drain( inBlock, sizeClass, 1 );
+        return;
+        }
+
+    inBlock->next = cache->lists[ sizeClass ];
+    cache->lists[ sizeClass ] = inBlock;
+    cache->counts[ sizeClass ]++;
+
+    int limit = getCacheLimit( sizeClass );
+
+    if( cache->counts[ sizeClass ] > limit ) {
+        // give the depot half, keeping the most recently used blocks
+        int numToKeep = limit / 2;
+
+        BufferPoolBlock *lastKept = cache->lists[ sizeClass ];
+        for( int i=1; i<numToKeep; i++ ) {
+            lastKept = lastKept->next;
+            }
+
+        int numToDrain = cache->counts[ sizeClass ] - numToKeep;
+
+        drain( lastKept->next, sizeClass, numToDrain );
+
+        lastKept->next = NULL;
+        cache->counts[ sizeClass ] = numToKeep;
+        }
+    }
+
+
+
+inline void BufferPool::getStats( BufferPoolStats *outStats ) {
+    BufferPoolStats *stats = &( getDepot()->stats );
+
+    outStats->numFreshAllocations =
+        __atomic_load_n( &( stats->numFreshAllocations ), __ATOMIC_RELAXED );
+    outStats->numReuses =
+        __atomic_load_n( &( stats->numReuses ), __ATOMIC_RELAXED );
+    outStats->numDiscards =
+        __atomic_load_n( &( stats->numDiscards ), __ATOMIC_RELAXED );
+    }
+
+
+
+inline void BufferPool::trim() {
+    Depot *depot = getDepot();
+
+    BufferPoolBlock *lists[ BUFFER_POOL_NUM_CLASSES ];
+
+    lockDepot( depot );
+
+    for( int c=0; c<BUFFER_POOL_NUM_CLASSES; c++ ) {
+        lists[c] = depot->lists[c];
+        depot->lists[c] = NULL;
+        depot->counts[c] = 0;
+        }
+
+    unlockDepot( depot );
+
+    for( int c=0; c<BUFFER_POOL_NUM_CLASSES; c++ ) {
+        while( lists[c] != NULL ) {
+            BufferPoolBlock *next = lists[c]->next;
+            deleteBlock( lists[c] );
+            lists[c] = next;
+            }
+        }
+    }
+
+
+
+#endif
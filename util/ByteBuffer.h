@@ -0,0 +1,283 @@
+#include "minorGems/common.h"
+
+
+#ifndef BYTE_BUFFER_INCLUDED
+#define BYTE_BUFFER_INCLUDED
+
+
+#include "BufferPool.h"
+
+#include <string.h>
+
+
+
+/**
+ * A reference-counted handle to bytes in a pooled block.
+ *
+ * Copying a ByteBuffer shares its bytes instead of copying them, and
+ * slices share the bytes of the buffer they were cut from, so one buffer
+ * can be passed between stages (file, compressor, socket, pipe) without
+ * copies.  The block goes back to the BufferPool when its last handle is
+ * destroyed.
+ *
+ * Handles can be passed between threads, but a single handle should not
+ * be used by two threads at once.  Shared bytes are not copied on write:
+ * writers should only write to buffers they have just allocated.
+ *
+ * @author Jason Rohrer
+ */
+class ByteBuffer {
+
+    public:
+
+        // constructs a null buffer with no bytes
+        ByteBuffer();
+
+
+        /**
+         * Constructs a buffer from the pool.
+         *
+         * @param inLength the number of bytes.  Contents are not
+         *   initialized.
+         * @param inMinCapacity room to reserve for growing with setLength.
+         *   Defaults to inLength.
+         */
+        explicit ByteBuffer( int inLength, int inMinCapacity = -1 );
+
+
+        ByteBuffer( const ByteBuffer &inOther );
+
+        ByteBuffer &operator=( const ByteBuffer &inOther );
+
+        ~ByteBuffer();
+
+
+
+        /**
+         * Makes a pooled copy of some bytes.
+         *
+         * @param inData the bytes to copy.
+         *   Must be destroyed by caller.
+         * @param inLength the number of bytes.
+         */
+        static ByteBuffer copyOf( const unsigned char *inData,
+                                  int inLength );
+
+
+
+        // NULL for a null buffer
+        // valid as long as any handle to these bytes exists
+        unsigned char *getData() const;
+
+        int getLength() const;
+
+        // the most this buffer can grow to with setLength
+        int getCapacity() const;
+
+
+        /**
+         * Changes the length of this buffer, keeping its bytes.
+         *
+         * @param inLength the new length.  Must be between 0 and
+         *   getCapacity().
+         */
+        void setLength( int inLength );
+
+
+        /**
+         * Gets a handle to part of this buffer, sharing its bytes.
+         *
+         * @param inOffset the first byte of the slice.
+         * @param inLength the number of bytes, or -1 for the rest.
+         *   Clipped to the end of this buffer.
+         */
+        ByteBuffer slice( int inOffset, int inLength = -1 ) const;
+
+
+        /**
+         * Copies this buffer into a plain array, for APIs that take
+         * ownership of new[] arrays.
+         *
+         * @return the bytes, or NULL for a null buffer.
+         *   Must be destroyed by caller.
+         */
+        unsigned char *copyToArray() const;
+
+
+        char isNull() const;
+
+        // true if other handles share these bytes
+        char isShared() const;
+
+        // drops this handle's reference, making it null
+        void clear();
+
+
+    protected:
+
+        BufferPoolBlock *mBlock;
+
+        int mOffset;
+        int mLength;
+
+    };
+
+
+
+inline ByteBuffer::ByteBuffer()
+    : mBlock( NULL ), mOffset( 0 ), mLength( 0 ) {
+    }
+
+
+
+inline ByteBuffer::ByteBuffer( int inLength, int inMinCapacity )
+    : mOffset( 0 ), mLength( inLength ) {
+
+    if( inMinCapacity < inLength ) {
+        inMinCapacity = inLength;
+        }
+    mBlock = BufferPool::allocate( inMinCapacity );
+    }
+
+
+
+inline ByteBuffer::ByteBuffer( const ByteBuffer &inOther )
+    : mBlock( inOther.mBlock ),
+      mOffset( inOther.mOffset ), mLength( inOther.mLength ) {
+
+    if( mBlock != NULL ) {
+        __atomic_add_fetch( &( mBlock->refCount ), 1, __ATOMIC_RELAXED );
+        }
+    }
+
+
+
+inline ByteBuffer &ByteBuffer::operator=( const ByteBuffer &inOther ) {
+    // inOther might be this handle
+    BufferPoolBlock *block = inOther.mBlock;
+    int offset = inOther.mOffset;
+    int length = inOther.mLength;
+
+    if( block != NULL ) {
+        __atomic_add_fetch( &( block->refCount ), 1, __ATOMIC_RELAXED );
+        }
+
+    // after taking the new reference, in case both share a block
+    clear();
+
+    mBlock = block;
+    mOffset = offset;
+    mLength = length;
+
+    return *this;
+    }
+
+
+
+inline ByteBuffer::~ByteBuffer() {
+    clear();
+    }
+
+
+
+inline void ByteBuffer::clear() {
+    if( mBlock != NULL &&
+        __atomic_sub_fetch( &( mBlock->refCount ), 1,
+                            __ATOMIC_ACQ_REL ) == 0 ) {
+        BufferPool::release( mBlock );
+        }
+
+    mBlock = NULL;
+    mOffset = 0;
+    mLength = 0;
+    }
+
+
+
+inline ByteBuffer ByteBuffer::copyOf( const unsigned char *inData,
+                                      int inLength ) {
+    ByteBuffer buffer( inLength );
+
+    memcpy( buffer.getData(), inData, inLength );
+
+    return buffer;
+    }
+
+
+
+inline unsigned char *ByteBuffer::getData() const {
+    if( mBlock == NULL ) {
+        return NULL;
+        }
+    return &( BufferPool::getData( mBlock )[ mOffset ] );
+    }
+
+
+
+inline int ByteBuffer::getLength() const {
+    return mLength;
+    }
+
+
+
+inline int ByteBuffer::getCapacity() const {
+    if( mBlock == NULL ) {
+        return 0;
+        }
+    return mBlock->capacity - mOffset;
+    }
+
+
+
+inline void ByteBuffer::setLength( int inLength ) {
+    mLength = inLength;
+    }
+
+
+
+inline ByteBuffer ByteBuffer::slice( int inOffset, int inLength ) const {
+    ByteBuffer part( *this );
+
+    if( inOffset > mLength ) {
+        inOffset = mLength;
+        }
+    if( inLength < 0 || inLength > mLength - inOffset ) {
+        inLength = mLength - inOffset;
+        }
+
+    part.mOffset += inOffset;
+    part.mLength = inLength;
+
+    return part;
+    }
+
+
+
+inline unsigned char *ByteBuffer::copyToArray() const {
+    if( mBlock == NULL ) {
+        return NULL;
+        }
+
+    unsigned char *bytes = new unsigned char[ mLength > 0 ? mLength : 1 ];
+    memcpy( bytes, getData(), mLength );
+
+    return bytes;
+    }
+
+
+
+inline char ByteBuffer::isNull() const {
+    return ( mBlock == NULL );
+    }
+
+
+
+inline char ByteBuffer::isShared() const {
+    return ( mBlock != NULL &&
+             __atomic_load_n( &( mBlock->refCount ),
+                              __ATOMIC_ACQUIRE ) > 1 );
+    }
+
+
+
+#endif
@@ -0,0 +1,172 @@
+// Checks Arena alignment, growth, markers and reuse of chunks across
+// resets, then times per-frame scratch strings from an arena against
+// new[]/delete[].
+
+
+#include "Arena.h"
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+static void testAllocation() {
+    Arena arena( 1024 );
+
+    char *a = (char *)arena.allocate( 3, 1 );
+    double *b = arena.allocateArray<double>( 4 );
+    void *c = arena.allocate( 10, 64 );
+
+    check( ( (unsigned long)b & 7 ) == 0, "array alignment" );
+    check( ( (unsigned long)c & 63 ) == 0, "requested alignment" );
+    check( (char *)b >= a + 3, "no overlap" );
+
+    char *big = (char *)arena.allocate( 5000 );
+    memset( big, 1, 5000 );
+    check( arena.getNumHeapChunks() == 2, "oversized request" );
+
+    char *name = arena.duplicateString( "frame" );
+    check( strcmp( name, "frame" ) == 0, "duplicateString" );
+
+    char *formatted = arena.formatString( "%d-%s", 42, name );
+    check( strcmp( formatted, "42-frame" ) == 0, "formatString" );
+
+    int chunks = arena.getNumHeapChunks();
+    
+    for( int f=0; f<100; f++ ) {
+        arena.reset();
+        check( arena.getNumBytesUsed() == 0, "reset" );
+
+        arena.allocate( 800 );
+        arena.allocate( 5000 );
+        arena.allocate( 100 );
+        }
+    check( arena.getNumHeapChunks() <= chunks + 1, "chunks reused" );
+    }
+
+
+
+static void testMarkers() {
+    Arena arena( 256 );
+
+    arena.allocate( 100 );
+    size_t used = arena.getNumBytesUsed();
+
+    char *first;
+    {
+        ArenaScope scope( &arena );
+        first = (char *)arena.allocate( 50 );
+
+        {
+            ArenaScope inner( &arena );
+            // spills into another chunk
+            arena.allocate( 1000 );
+            }
+
+        check( (char *)arena.allocate( 10, 1 ) == first + 50, 
+               "inner scope restored" );
+        }
+
+    check( arena.getNumBytesUsed() == used, "outer scope restored" );
+    check( (char *)arena.allocate( 50 ) == first, "space handed back" );
+
+
+    // marker taken before any allocation
+    Arena empty;
+    ArenaMarker start = empty.getMarker();
+    empty.allocate( 10 );
+    empty.resetToMarker( start );
+    check( empty.getNumBytesUsed() == 0, "marker on empty arena" );
+    }
+
+
+
+static void testInitialBuffer() {
+    unsigned char storage[256];
+    
+    Arena arena( storage, sizeof( storage ), 1024 );
+
+    unsigned char *a = (unsigned char *)arena.allocate( 100, 1 );
+    check( a >= storage && a + 100 <= storage + sizeof( storage ),
+           "uses caller's buffer" );
+    check( arena.getNumHeapChunks() == 0, "no heap use" );
+
+    arena.allocate( 200 );
+    check( arena.getNumHeapChunks() == 1, "heap after buffer" );
+
+    arena.reset();
+    check( arena.allocate( 10, 1 ) == storage, "back to buffer" );
+    }
+
+
+
+static void testFrameArena() {
+    Arena *frame = Arena::getFrameArena();
+    check( frame == Arena::getFrameArena(), "same frame arena" );
+    
+    frame->reset();
+    frame->formatString( "%d", 5 );
+    check( frame->getNumBytesUsed() > 0, "frame arena in use" );
+    frame->reset();
+    }
+
+
+
+int main() {
+    testAllocation();
+    testMarkers();
+    testInitialBuffer();
+    testFrameArena();
+
+
+    // a frame's worth of short-lived label strings, many frames
+    int numFrames = 20000;
+    int numStrings = 200;
+
+    long sum = 0;
+
+    double startTime = Time::getCurrentTime();
+
+    for( int f=0; f<numFrames; f++ ) {
+        char *strings[200];
+
+        for( int i=0; i<numStrings; i++ ) {
+            int length = 16 + ( i * 13 ) % 64;
+            strings[i] = new char[ length ];
+            strings[i][0] = (char)i;
+            sum += strings[i][0];
+            }
+        for( int i=0; i<numStrings; i++ ) {
+            delete [] strings[i];
+            }
+        }
+
+    double newTime = Time::getCurrentTime() - startTime;
+
+    
+    Arena *frame = Arena::getFrameArena();
+    
+    startTime = Time::getCurrentTime();
+
+    for( int f=0; f<numFrames; f++ ) {
+        for( int i=0; i<numStrings; i++ ) {
+            int length = 16 + ( i * 13 ) % 64;
+            char *s = frame->allocateArray<char>( length );
+            s[0] = (char)i;
+            sum += s[0];
+            }
+        frame->reset();
+        }
+
+    double arenaTime = Time::getCurrentTime() - startTime;
+
+    printf( "%d frames x %d strings:  new[] %.1f ms, arena %.1f ms "
+            "(%d heap chunks, checksum %ld)\n",
+            numFrames, numStrings, newTime * 1000, arenaTime * 1000,
+            frame->getNumHeapChunks(), sum );
+
+    return reportChecks();
+    }
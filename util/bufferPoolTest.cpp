@@ -0,0 +1,264 @@
+// Checks ByteBuffer sharing and slicing, buffers released on other
+// threads, and the pooled I/O overloads, then times pooled buffers
+// against new[]/delete[] with several threads churning mixed sizes.
+
+
+#include "ByteBuffer.h"
+
+#include "minorGems/io/PipedStream.h"
+#include "minorGems/io/file/File.h"
+#include "minorGems/formats/encodingUtils.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+static void testHandles() {
+    check( sizeof( BufferPoolBlock ) == 32, "header size" );
+
+    ByteBuffer a( 1000 );
+    check( a.getLength() == 1000 && a.getCapacity() >= 1000, "allocate" );
+    check( ( (unsigned long)a.getData() & 15 ) == 0, "alignment" );
+
+    for( int i=0; i<1000; i++ ) {
+        a.getData()[i] = (unsigned char)i;
+        }
+
+    ByteBuffer b = a;
+    check( b.getData() == a.getData() && a.isShared(), "copy shares" );
+
+    ByteBuffer part = a.slice( 100, 50 );
+    check( part.getLength() == 50 && part.getData()[0] == 100, "slice" );
+
+    ByteBuffer rest = part.slice( 10 );
+    check( rest.getLength() == 40 && rest.getData()[0] == 110,
+           "slice of slice" );
+
+    check( a.slice( 2000 ).getLength() == 0, "slice past end" );
+
+    a.clear();
+    b.clear();
+    // slices keep the block alive
+    check( rest.getData()[39] == 149, "slice outlives buffer" );
+
+    ByteBuffer none;
+    check( none.isNull() && none.getData() == NULL, "null buffer" );
+
+    ByteBuffer huge( 5 << 20 );
+    check( huge.getLength() == 5 << 20, "oversized buffer" );
+
+    // self-assignment through a copy must not free the block
+    ByteBuffer c( 10 );
+    ByteBuffer &cRef = c;
+    c = cRef;
+    check( ! c.isNull() && ! c.isShared(), "self assignment" );
+    }
+
+
+
+class ReleaseThread : public Thread {
+
+    public:
+
+        ReleaseThread( SimpleVector<ByteBuffer> *inBuffers )
+            : mBuffers( inBuffers ) {
+            }
+
+        void run() {
+            mBuffers->deleteAll();
+            }
+
+        SimpleVector<ByteBuffer> *mBuffers;
+    };
+
+
+
+static void testCrossThread() {
+    BufferPoolStats before;
+    BufferPool::getStats( &before );
+
+    SimpleVector<ByteBuffer> buffers;
+
+    for( int i=0; i<200; i++ ) {
+        buffers.push_back( ByteBuffer( 4000 ) );
+        }
+
+    ReleaseThread releaser( &buffers );
+    releaser.start();
+    releaser.join();
+
+    // the other thread's cache flushed to the depot when it exited,
+    // so these come back without new allocations
+    for( int i=0; i<32; i++ ) {
+        buffers.push_back( ByteBuffer( 4000 ) );
+        }
+
+    BufferPoolStats after;
+    BufferPool::getStats( &after );
+
+    check( after.numReuses - before.numReuses >= 32,
+           "blocks freed on another thread are reused" );
+
+    buffers.deleteAll();
+    }
+
+
+
+static void testIO() {
+    // zip round trip
+    ByteBuffer raw( 100000 );
+    for( int i=0; i<raw.getLength(); i++ ) {
+        raw.getData()[i] = (unsigned char)( ( i / 100 ) % 7 );
+        }
+
+    ByteBuffer compressed = zipCompress( raw );
+    check( ! compressed.isNull() && compressed.getLength() < 10000,
+           "zipCompress" );
+
+    ByteBuffer decompressed = zipDecompress( compressed, raw.getLength() );
+    check( ! decompressed.isNull() &&
+           memcmp( decompressed.getData(), raw.getData(),
+                   raw.getLength() ) == 0, "zipDecompress" );
+
+
+    // file contents
+    File file( NULL, "bufferPoolTest.tmp" );
+    file.writeToFile( compressed.getData(), compressed.getLength() );
+
+    ByteBuffer contents;
+    check( file.readFileContents( &contents ) &&
+           contents.getLength() == compressed.getLength() &&
+           memcmp( contents.getData(), compressed.getData(),
+                   compressed.getLength() ) == 0, "readFileContents" );
+    file.remove();
+
+    File missing( NULL, "bufferPoolTest.missing" );
+    ByteBuffer untouched;
+    check( ! missing.readFileContents( &untouched ) && untouched.isNull(),
+           "readFileContents missing file" );
+
+
+    // pipe hands the same bytes through
+    PipedStream pipe;
+    pipe.write( (unsigned char *)"abc", 3 );
+    pipe.writeBuffer( contents );
+
+    ByteBuffer first = pipe.readBuffer( 100 );
+    check( first.getLength() == 3 && memcmp( first.getData(), "abc", 3 ) == 0,
+           "readBuffer of copied bytes" );
+
+    ByteBuffer second = pipe.readBuffer( 10 );
+    check( second.getData() == contents.getData() &&
+           second.getLength() == 10, "readBuffer shares written buffer" );
+
+    ByteBuffer third = pipe.readBuffer( 1 << 20 );
+    check( third.getData() == &( contents.getData()[10] ) &&
+           third.getLength() == contents.getLength() - 10,
+           "readBuffer takes the rest" );
+
+    check( pipe.readBuffer( 10 ).getLength() == 0, "empty pipe" );
+
+    pipe.close();
+    check( pipe.readBuffer( 10 ).isNull(), "closed pipe" );
+    }
+
+
+
+// churns through buffers of mixed sizes, keeping a few alive at a time
+class ChurnThread : public Thread {
+
+    public:
+
+        ChurnThread( char inPooled, int inNumOps )
+            : mPooled( inPooled ), mNumOps( inNumOps ), mSum( 0 ) {
+            }
+
+        void run() {
+            int sizes[5] = { 300, 1500, 5000, 16384, 70000 };
+
+            unsigned char *arrays[8];
+            ByteBuffer buffers[8];
+
+            for( int i=0; i<8; i++ ) {
+                arrays[i] = NULL;
+                }
+
+            for( int i=0; i<mNumOps; i++ ) {
+                int slot = i % 8;
+                int size = sizes[ ( i * 7 ) % 5 ];
+
+                if( mPooled ) {
+                    buffers[ slot ] = ByteBuffer( size );
+                    buffers[ slot ].getData()[0] = (unsigned char)i;
+                    mSum += buffers[ slot ].getData()[0];
+                    }
+                else {
+                    if( arrays[ slot ] != NULL ) {
+                        delete [] arrays[ slot ];
+                        }
+                    arrays[ slot ] = new unsigned char[ size ];
+                    arrays[ slot ][0] = (unsigned char)i;
+                    mSum += arrays[ slot ][0];
+                    }
+                }
+
+            for( int i=0; i<8; i++ ) {
+                if( arrays[i] != NULL ) {
+                    delete [] arrays[i];
+                    }
+                }
+            }
+
+        char mPooled;
+        int mNumOps;
+        long mSum;
+    };
+
+
+
+static double timeChurn( char inPooled, int inNumThreads, int inNumOps ) {
+    ChurnThread **threads = new ChurnThread*[ inNumThreads ];
+
+    double startTime = Time::getCurrentTime();
+
+    for( int t=0; t<inNumThreads; t++ ) {
+        threads[t] = new ChurnThread( inPooled, inNumOps );
+        threads[t]->start();
+        }
+    for( int t=0; t<inNumThreads; t++ ) {
+        threads[t]->join();
+        delete threads[t];
+        }
+
+    delete [] threads;
+
+    return Time::getCurrentTime() - startTime;
+    }
+
+
+
+int main() {
+    testHandles();
+    testCrossThread();
+    testIO();
+
+    int numThreads = 4;
+    int numOps = 2000000;
+
+    double newTime = timeChurn( false, numThreads, numOps );
+    double poolTime = timeChurn( true, numThreads, numOps );
+
+    BufferPoolStats stats;
+    BufferPool::getStats( &stats );
+
+    printf( "%d threads x %d buffers:  new[] %.1f ms, pool %.1f ms\n",
+            numThreads, numOps, newTime * 1000, poolTime * 1000 );
+    printf( "Pool:  %ld fresh, %ld reused, %ld discarded\n",
+            stats.numFreshAllocations, stats.numReuses, stats.numDiscards );
+
+    return reportChecks();
+    }
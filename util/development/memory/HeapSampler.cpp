@@ -0,0 +1,718 @@
+#include "minorGems/util/development/memory/HeapSampler.h"
+
+#include "minorGems/system/Time.h"
+
+
+#if defined( HEAP_SAMPLING ) && defined( DEBUG_MEMORY )
+#error "HEAP_SAMPLING and DEBUG_MEMORY both replace operator new"
+#endif
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+
+#if defined( __linux__ ) || defined( __APPLE__ )
+#include <execinfo.h>
+#define HEAP_SAMPLER_BACKTRACE
+#endif
+
+
+
+// put ahead of every block, so that frees can tell sampled blocks apart
+typedef union HeapSamplerHeader {
+        struct {
+                size_t size;
+
+                // NULL if this block was not sampled
+                HeapSamplerSite *site;
+            } info;
+
+        // keeps the block after the header aligned as malloc's are
+        unsigned char padding[16];
+    } HeapSamplerHeader;
+
+
+
+// plain data, so that thread_local access costs nothing extra
+typedef struct HeapSamplerThreadState {
+        long bytesUntilSample;
+        unsigned long long randomState;
+        char initialized;
+
+        // true while this thread is inside the sampler
+        char busy;
+    } HeapSamplerThreadState;
+
+
+
+// 0 when not sampling
+static long sampleInterval = 0;
+
+// interval the current totals were sampled at, kept after stop()
+static long reportInterval = 524288;
+
+static double startTime = 0;
+
+static HeapSamplerSite sites[ HEAP_SAMPLER_MAX_SITES ];
+
+// catches samples once the table is full
+static HeapSamplerSite overflowSite;
+
+static unsigned long long seedCounter = 0;
+
+// 0 to seed each thread from its own address
+static unsigned long long randomSeed = 0;
+
+// set once samples have been taken at reportInterval
+static char intervalFixed = false;
+
+static thread_local HeapSamplerThreadState threadState;
+
+
+
+// exponentially-distributed gap until the next sample, mean inInterval
+static long nextSampleGap( HeapSamplerThreadState *inState,
+                           long inInterval ) {
+    // xorshift64*
+    unsigned long long x = inState->randomState;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    inState->randomState = x;
+
+    x *= 0x2545F4914F6CDD1DULL;
+
+    // in (0,1]
+    double u = ( ( x >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+
+    double gap = -log( u ) * inInterval;
+
+    if( gap > 1e15 ) {
+        gap = 1e15;
+        }
+    return (long)gap + 1;
+    }
+
+
+
+static unsigned long hashFrames( void **inFrames, int inNumFrames ) {
+    // FNV-1a over the addresses
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for( int i=0; i<inNumFrames; i++ ) {
+        hash ^= (unsigned long long)(size_t)inFrames[i];
+        hash *= 1099511628211ULL;
+        }
+
+    unsigned long result = (unsigned long)( hash ^ ( hash >> 32 ) );
+
+    if( result == 0 ) {
+        // 0 marks free slots
+        result = 1;
+        }
+    return result;
+    }
+
+
+
+static HeapSamplerSite *findSite( void **inFrames, int inNumFrames ) {
+    unsigned long hash = hashFrames( inFrames, inNumFrames );
+
+    int index = hash % HEAP_SAMPLER_MAX_SITES;
+
+    for( int probe=0; probe<HEAP_SAMPLER_MAX_SITES; probe++ ) {
+        HeapSamplerSite *site = &( sites[ index ] );
+
+        unsigned long siteHash =
+            __atomic_load_n( &( site->hash ), __ATOMIC_ACQUIRE );
+
+        if( siteHash == 0 ) {
+            unsigned long expected = 0;
+
+            if( __atomic_compare_exchange_n( &( site->hash ), &expected,
+                                             hash, false,
+                                             __ATOMIC_ACQ_REL,
+                                             __ATOMIC_ACQUIRE ) ) {
+                // claimed it
+                site->numFrames = inNumFrames;
+                memcpy( site->frames, inFrames,
+                        inNumFrames * sizeof( void * ) );
+
+                __atomic_store_n( &( site->ready ), 1, __ATOMIC_RELEASE );
+                return site;
+                }
+
+            // another thread claimed it first
+            siteHash = expected;
+            }
+
+        if( siteHash == hash ) {
+            // the claiming thread is at most a memcpy away from done
+            while( ! __atomic_load_n( &( site->ready ), __ATOMIC_ACQUIRE ) ) {
+                }
+
+            if( site->numFrames == inNumFrames &&
+                memcmp( site->frames, inFrames,
+                        inNumFrames * sizeof( void * ) ) == 0 ) {
+                return site;
+                }
+            }
+
+        index = ( index + 1 ) % HEAP_SAMPLER_MAX_SITES;
+        }
+
+    return &overflowSite;
+    }
+
+
+
+// kept out of line so that the allocation fast path stays small,
+// and so that the number of frames to skip is fixed
+__attribute__((noinline))
+static void takeSample( HeapSamplerHeader *inHeader,
+                        HeapSamplerThreadState *inState,
+                        long inInterval ) {
+
+    inState->busy = true;
+
+    if( ! inState->initialized ) {
+        unsigned long long seed = randomSeed;
+        if( seed == 0 ) {
+            seed = (unsigned long long)(size_t)inState;
+            }
+
+        inState->randomState =
+            seed * 0x9E3779B97F4A7C15ULL ^
+            __atomic_add_fetch( &seedCounter, 0x2545F4914F6CDD1DULL,
+                                __ATOMIC_RELAXED );
+        if( inState->randomState == 0 ) {
+            inState->randomState = 1;
+            }
+        inState->initialized = true;
+
+        // first gap for this thread, instead of sampling its first
+        // allocation
+        inState->bytesUntilSample += nextSampleGap( inState, inInterval );
+
+        if( inState->bytesUntilSample >= 0 ) {
+            inState->busy = false;
+            return;
+            }
+        }
+
+    inState->bytesUntilSample = nextSampleGap( inState, inInterval );
+
+
+    // skip this function, allocate, and operator new
+    int numSkipped = 3;
+
+    void *frames[ HEAP_SAMPLER_MAX_FRAMES + 3 ];
+    int numFrames = 0;
+
+    #if defined( HEAP_SAMPLER_BACKTRACE )
+        numFrames = backtrace( frames, HEAP_SAMPLER_MAX_FRAMES + numSkipped );
+    #elif defined( WIN32 )
+        numFrames = CaptureStackBackTrace( 0,
+                                           HEAP_SAMPLER_MAX_FRAMES +
+                                           numSkipped,
+                                           frames, NULL );
+    #endif
+
+    if( numFrames > numSkipped ) {
+        numFrames -= numSkipped;
+        }
+    else {
+        numFrames = 0;
+        numSkipped = 0;
+        }
+
+    HeapSamplerSite *site = findSite( &( frames[ numSkipped ] ), numFrames );
+
+    long size = (long)( inHeader->info.size );
+
+    __atomic_add_fetch( &( site->allocCount ), 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &( site->allocBytes ), size, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &( site->liveCount ), 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &( site->liveBytes ), size, __ATOMIC_RELAXED );
+
+    inHeader->info.site = site;
+
+    inState->busy = false;
+    }
+
+
+
+__attribute__((noinline))
+void *HeapSampler::allocate( size_t inSize ) {
+    HeapSamplerHeader *header =
+        (HeapSamplerHeader *)malloc( sizeof( HeapSamplerHeader ) + inSize );
+
+    if( header == NULL ) {
+        return NULL;
+        }
+
+    header->info.size = inSize;
+    header->info.site = NULL;
+
+    long interval = __atomic_load_n( &sampleInterval, __ATOMIC_RELAXED );
+
+    if( interval > 0 ) {
+        HeapSamplerThreadState *state = &threadState;
+
+        state->bytesUntilSample -= (long)inSize;
+
+        if( state->bytesUntilSample < 0 && ! state->busy ) {
+            takeSample( header, state, interval );
+            }
+        }
+
+    return &( header[1] );
+    }
+
+
+
+void HeapSampler::release( void *inPointer ) {
+    if( inPointer == NULL ) {
+        return;
+        }
+
+    HeapSamplerHeader *header = &( ( (HeapSamplerHeader *)inPointer )[-1] );
+
+    HeapSamplerSite *site = header->info.site;
+
+    if( site != NULL ) {
+        __atomic_sub_fetch( &( site->liveCount ), 1, __ATOMIC_RELAXED );
+        __atomic_sub_fetch( &( site->liveBytes ), (long)header->info.size,
+                            __ATOMIC_RELAXED );
+        }
+
+    free( header );
+    }
+
+
+
+#ifndef WIN32
+
+static int dumpPipe[2] = { -1, -1 };
+
+
+static void dumpSignalHandler( int inSignal ) {
+    // only async-signal-safe calls here
+    char c = 'd';
+    ssize_t result = write( dumpPipe[1], &c, 1 );
+    (void)result;
+    }
+
+
+static void *dumpThreadFunction( void *inArg ) {
+    int dumpNumber = 0;
+    char c;
+
+    while( read( dumpPipe[0], &c, 1 ) == 1 ) {
+        char fileName[100];
+        snprintf( fileName, sizeof( fileName ), "heapProfile_%d_%d.heap",
+                  (int)getpid(), dumpNumber );
+        dumpNumber++;
+
+        if( HeapSampler::dumpPprofProfile( fileName ) ) {
+            printf( "Heap profile written to %s\n", fileName );
+            }
+        }
+    return NULL;
+    }
+
+#endif
+
+
+
+void HeapSampler::start( long inSampleInterval, int inDumpSignal ) {
+    if( inSampleInterval < 1 ) {
+        inSampleInterval = 1;
+        }
+
+    if( intervalFixed && inSampleInterval != reportInterval ) {
+        // the recorded sites can only be scaled up by the interval they
+        // were sampled at
+        fprintf( stderr,
+                 "HeapSampler:  cannot restart at 1 per %ld bytes after "
+                 "sampling at 1 per %ld, keeping %ld\n",
+                 inSampleInterval, reportInterval, reportInterval );
+        inSampleInterval = reportInterval;
+        }
+
+    reportInterval = inSampleInterval;
+    intervalFixed = true;
+    startTime = Time::getCurrentTime();
+
+    __atomic_store_n( &sampleInterval, inSampleInterval, __ATOMIC_RELAXED );
+
+    #ifndef WIN32
+        if( inDumpSignal != 0 && dumpPipe[0] == -1 ) {
+            if( pipe( dumpPipe ) == 0 ) {
+                pthread_t dumpThread;
+                pthread_create( &dumpThread, NULL, dumpThreadFunction, NULL );
+                pthread_detach( dumpThread );
+
+                struct sigaction action;
+                memset( &action, 0, sizeof( action ) );
+                action.sa_handler = dumpSignalHandler;
+                action.sa_flags = SA_RESTART;
+                sigemptyset( &action.sa_mask );
+
+                sigaction( inDumpSignal, &action, NULL );
+                }
+            }
+    #endif
+    }
+
+
+
+void HeapSampler::setRandomSeed( unsigned long long inSeed ) {
+    randomSeed = inSeed;
+    }
+
+
+
+void HeapSampler::stop() {
+    __atomic_store_n( &sampleInterval, 0, __ATOMIC_RELAXED );
+    }
+
+
+
+char HeapSampler::isSampling() {
+    return ( __atomic_load_n( &sampleInterval, __ATOMIC_RELAXED ) > 0 );
+    }
+
+
+
+// scales sampled totals up to estimated totals, the same way pprof does
+// for heap_v2 profiles
+static double unsample( long inCount, long inBytes ) {
+    if( inCount <= 0 || inBytes <= 0 ) {
+        return 0;
+        }
+    double averageSize = (double)inBytes / inCount;
+
+    double probability = 1 - exp( - averageSize / reportInterval );
+
+    return inBytes / probability;
+    }
+
+
+
+// fills outSites with ready sites, returns how many
+static int collectSites( HeapSamplerSite **outSites ) {
+    int numSites = 0;
+
+    for( int i=0; i<HEAP_SAMPLER_MAX_SITES; i++ ) {
+        if( __atomic_load_n( &( sites[i].ready ), __ATOMIC_ACQUIRE ) ) {
+            outSites[ numSites ] = &( sites[i] );
+            numSites++;
+            }
+        }
+
+    if( overflowSite.allocCount > 0 ) {
+        outSites[ numSites ] = &overflowSite;
+        numSites++;
+        }
+    return numSites;
+    }
+
+
+
+static int compareLiveBytes( const void *inA, const void *inB ) {
+    HeapSamplerSite *a = *(HeapSamplerSite **)inA;
+    HeapSamplerSite *b = *(HeapSamplerSite **)inB;
+
+    double liveA = unsample( a->liveCount, a->liveBytes );
+    double liveB = unsample( b->liveCount, b->liveBytes );
+
+    if( liveA > liveB ) {
+        return -1;
+        }
+    if( liveA < liveB ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+void HeapSampler::getTotals( double *outLiveBytes,
+                             double *outAllocatedBytes,
+                             long *outNumSamples ) {
+    HeapSamplerSite **siteList = (HeapSamplerSite **)
+        malloc( ( HEAP_SAMPLER_MAX_SITES + 1 ) * sizeof( HeapSamplerSite * ) );
+
+    int numSites = collectSites( siteList );
+
+    *outLiveBytes = 0;
+    *outAllocatedBytes = 0;
+    *outNumSamples = 0;
+
+    for( int i=0; i<numSites; i++ ) {
+        HeapSamplerSite *site = siteList[i];
+
+        *outLiveBytes += unsample( site->liveCount, site->liveBytes );
+        *outAllocatedBytes += unsample( site->allocCount, site->allocBytes );
+        *outNumSamples += site->allocCount;
+        }
+
+    free( siteList );
+    }
+
+
+
+void HeapSampler::writeReport( FILE *inFile, int inMaxSites ) {
+    HeapSamplerSite **siteList = (HeapSamplerSite **)
+        malloc( ( HEAP_SAMPLER_MAX_SITES + 1 ) * sizeof( HeapSamplerSite * ) );
+
+    int numSites = collectSites( siteList );
+
+    qsort( siteList, numSites, sizeof( HeapSamplerSite * ),
+           compareLiveBytes );
+
+
+    double liveBytes, allocatedBytes;
+    long numSamples;
+    getTotals( &liveBytes, &allocatedBytes, &numSamples );
+
+    double elapsed = Time::getCurrentTime() - startTime;
+    if( elapsed <= 0 ) {
+        elapsed = 1;
+        }
+
+    fprintf( inFile,
+             "Heap sampling:  %ld samples, 1 per %ld bytes, %d sites\n"
+             "Estimated live:  %.1f KiB,  allocated:  %.1f KiB "
+             "(%.1f KiB/s)\n\n",
+             numSamples, reportInterval, numSites,
+             liveBytes / 1024, allocatedBytes / 1024,
+             allocatedBytes / 1024 / elapsed );
+
+    fprintf( inFile, "  live KiB   live objs    alloc KiB/s\n" );
+
+
+    if( inMaxSites > numSites ) {
+        inMaxSites = numSites;
+        }
+
+    for( int i=0; i<inMaxSites; i++ ) {
+        HeapSamplerSite *site = siteList[i];
+
+        double siteLive = unsample( site->liveCount, site->liveBytes );
+        double siteAllocated = unsample( site->allocCount,
+                                         site->allocBytes );
+
+        double objectSize = 1;
+        if( site->liveCount > 0 ) {
+            objectSize = (double)site->liveBytes / site->liveCount;
+            }
+
+        fprintf( inFile, "%10.1f  %10.0f  %13.1f\n",
+                 siteLive / 1024, siteLive / objectSize,
+                 siteAllocated / 1024 / elapsed );
+
+        #ifdef HEAP_SAMPLER_BACKTRACE
+            char **symbols = backtrace_symbols( site->frames,
+                                                site->numFrames );
+            for( int f=0; f<site->numFrames; f++ ) {
+                if( symbols != NULL ) {
+                    fprintf( inFile, "        %s\n", symbols[f] );
+                    }
+                else {
+                    fprintf( inFile, "        %p\n", site->frames[f] );
+                    }
+                }
+            if( symbols != NULL ) {
+                free( symbols );
+                }
+        #else
+            for( int f=0; f<site->numFrames; f++ ) {
+                fprintf( inFile, "        %p\n", site->frames[f] );
+                }
+        #endif
+        }
+
+    free( siteList );
+    }
+
+
+
+void HeapSampler::writePprofProfile( FILE *inFile ) {
+    HeapSamplerSite **siteList = (HeapSamplerSite **)
+        malloc( ( HEAP_SAMPLER_MAX_SITES + 1 ) * sizeof( HeapSamplerSite * ) );
+
+    int numSites = collectSites( siteList );
+
+    long liveCount = 0;
+    long liveBytes = 0;
+    long allocCount = 0;
+    long allocBytes = 0;
+
+    for( int i=0; i<numSites; i++ ) {
+        liveCount += siteList[i]->liveCount;
+        liveBytes += siteList[i]->liveBytes;
+        allocCount += siteList[i]->allocCount;
+        allocBytes += siteList[i]->allocBytes;
+        }
+
+    // raw sampled totals, pprof does the unsampling for heap_v2
+    fprintf( inFile, "heap profile: %ld: %ld [ %ld: %ld] @ heap_v2/%ld\n",
+             liveCount, liveBytes, allocCount, allocBytes, reportInterval );
+
+    for( int i=0; i<numSites; i++ ) {
+        HeapSamplerSite *site = siteList[i];
+
+        fprintf( inFile, "%ld: %ld [%ld: %ld] @",
+                 site->liveCount, site->liveBytes,
+                 site->allocCount, site->allocBytes );
+
+        for( int f=0; f<site->numFrames; f++ ) {
+            fprintf( inFile, " %p", site->frames[f] );
+            }
+        fprintf( inFile, "\n" );
+        }
+
+    free( siteList );
+
+
+    // lets pprof map addresses back to symbols in each library
+    #ifdef __linux__
+        fprintf( inFile, "\nMAPPED_LIBRARIES:\n" );
+
+        FILE *maps = fopen( "/proc/self/maps", "r" );
+
+        if( maps != NULL ) {
+            char buffer[4096];
+            size_t numRead;
+            while( ( numRead = fread( buffer, 1, sizeof( buffer ), maps ) )
+                   > 0 ) {
+                fwrite( buffer, 1, numRead, inFile );
+                }
+            fclose( maps );
+            }
+    #endif
+    }
+
+
+
+char HeapSampler::dumpPprofProfile( const char *inFileName ) {
+    FILE *file = fopen( inFileName, "w" );
+
+    if( file == NULL ) {
+        return false;
+        }
+
+    writePprofProfile( file );
+
+    fclose( file );
+    return true;
+    }
+
+
+
+#ifdef HEAP_SAMPLING
+
+// replacements for the global operators
+// (the aligned forms are left to the standard library, which pairs its
+//  own aligned new and delete)
+
+
+#if __cplusplus >= 201103L
+#define HEAP_SAMPLER_NOTHROW noexcept
+#else
+#define HEAP_SAMPLER_NOTHROW throw()
+#endif
+
+
+void *operator new( size_t inSize ) {
+    void *pointer = HeapSampler::allocate( inSize );
+
+    if( pointer == NULL ) {
+        throw std::bad_alloc();
+        }
+    return pointer;
+    }
+
+
+
+void *operator new[]( size_t inSize ) {
+    void *pointer = HeapSampler::allocate( inSize );
+
+    if( pointer == NULL ) {
+        throw std::bad_alloc();
+        }
+    return pointer;
+    }
+
+
+
+void *operator new( size_t inSize, const std::nothrow_t & )
+    HEAP_SAMPLER_NOTHROW {
+    return HeapSampler::allocate( inSize );
+    }
+
+
+
+void *operator new[]( size_t inSize, const std::nothrow_t & )
+    HEAP_SAMPLER_NOTHROW {
+    return HeapSampler::allocate( inSize );
+    }
+
+
+
+void operator delete( void *inPointer ) HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+
+
+void operator delete[]( void *inPointer ) HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+
+
+void operator delete( void *inPointer, const std::nothrow_t & )
+    HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+
+
+void operator delete[]( void *inPointer, const std::nothrow_t & )
+    HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+
+
+#if __cpp_sized_deallocation
+
+void operator delete( void *inPointer, size_t inSize ) HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+
+
+void operator delete[]( void *inPointer, size_t inSize ) HEAP_SAMPLER_NOTHROW {
+    HeapSampler::release( inPointer );
+    }
+
+#endif
+
+
+#endif
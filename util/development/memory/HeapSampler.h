@@ -0,0 +1,167 @@
+#ifndef HEAP_SAMPLER_INCLUDED
+#define HEAP_SAMPLER_INCLUDED
+
+
+
+#include <stdio.h>
+#include <stddef.h>
+
+
+
+// deepest call stack recorded for a sample
+#define HEAP_SAMPLER_MAX_FRAMES  24
+
+// most distinct call sites tracked, samples past this are lumped together
+#define HEAP_SAMPLER_MAX_SITES  4096
+
+
+
+/**
+ * Totals for one allocating call stack.
+ *
+ * Counts are of sampled allocations only.  HeapSampler scales them up
+ * to estimates of all allocations when reporting.
+ *
+ * @author Jason Rohrer
+ */
+typedef struct HeapSamplerSite {
+        // 0 for an unused slot
+        unsigned long hash;
+
+        // set once frames are filled in
+        int ready;
+
+        int numFrames;
+        void *frames[ HEAP_SAMPLER_MAX_FRAMES ];
+
+        long allocCount;
+        long allocBytes;
+
+        long liveCount;
+        long liveBytes;
+    } HeapSamplerSite;
+
+
+
+/**
+ * A sampling heap profiler, cheap enough to leave running in a live
+ * server.
+ *
+ * Compiling HeapSampler.cpp with -DHEAP_SAMPLING replaces the global
+ * new and delete operators.  Every allocation then counts down a
+ * per-thread byte budget, and only when that runs out is a call stack
+ * recorded, so on average one stack is taken per inSampleInterval bytes
+ * allocated (Poisson sampling, like tcmalloc).  Sampled stacks are
+ * totalled per call site in a lock-free table, and frees of sampled
+ * blocks update the live totals of their sites from whatever thread
+ * frees them.
+ *
+ * Without -DHEAP_SAMPLING, or before start() is called, nothing is
+ * sampled.  Cannot be used together with DEBUG_MEMORY.
+ *
+ * Stacks are only captured where execinfo.h backtrace is available
+ * (Linux, Mac) or on Windows; elsewhere all samples share one site.
+ *
+ * @author Jason Rohrer
+ */
+class HeapSampler {
+
+    public:
+
+
+        /**
+         * Starts sampling.
+         *
+         * @param inSampleInterval the average number of bytes allocated
+         *   between samples.  Defaults to 512 KiB, which costs well
+         *   under 1% in allocation-heavy code.
+         * @param inDumpSignal a signal that dumps a pprof heap profile
+         *   to heapProfile_<pid>_<n>.heap in the working directory
+         *   when received, or 0 for none.  Ignored on Windows.
+         *   For example, SIGUSR2.
+         *
+         * Totals are kept across stop() and start(), so a restart keeps
+         * sampling at the first interval; a different inSampleInterval
+         * is ignored with a warning on stderr.
+         */
+        static void start( long inSampleInterval = 524288,
+                           int inDumpSignal = 0 );
+
+
+        /**
+         * Makes sampling reproducible from run to run.  Call before
+         * start(), since threads seed themselves at their first sample.
+         *
+         * @param inSeed the seed, or 0 to seed each thread from its own
+         *   address (the default).
+         */
+        static void setRandomSeed( unsigned long long inSeed );
+
+
+        // stops taking new samples, keeping totals so far
+        static void stop();
+
+
+        static char isSampling();
+
+
+
+        /**
+         * Writes a human-readable report of the call sites holding the
+         * most live memory, with their allocation rates, and symbol
+         * names where available.
+         *
+         * @param inFile the file to write to, for example stdout.
+         * @param inMaxSites the most sites to list.
+         */
+        static void writeReport( FILE *inFile, int inMaxSites = 20 );
+
+
+
+        /**
+         * Writes a heap profile in the legacy text format read by
+         * pprof, for example:
+         *   pprof --text ./server heapProfile_1234_0.heap
+         *
+         * @param inFile the file to write to.
+         */
+        static void writePprofProfile( FILE *inFile );
+
+
+        /**
+         * Writes a pprof heap profile to a new file.
+         *
+         * @param inFileName the file name.
+         *   Must be destroyed by caller.
+         *
+         * @return true on success.
+         */
+        static char dumpPprofProfile( const char *inFileName );
+
+
+
+        /**
+         * Gets estimated totals across all sites.
+         *
+         * @param outLiveBytes the estimated bytes currently allocated.
+         * @param outAllocatedBytes the estimated bytes allocated since
+         *   start().
+         * @param outNumSamples how many allocations were sampled.
+         */
+        static void getTotals( double *outLiveBytes,
+                               double *outAllocatedBytes,
+                               long *outNumSamples );
+
+
+
+        // for use by the new and delete operators in HeapSampler.cpp
+
+        static void *allocate( size_t inSize );
+
+        static void release( void *inPointer );
+
+    };
+
+
+
+#endif
@@ -0,0 +1,163 @@
+// Checks that sampled estimates of live and allocated bytes land near the
+// true totals for two call sites, that pprof output is written on a signal,
+// that a restart keeps the first interval, and times an allocation-heavy
+// loop with sampling off and on.
+
+
+#include "minorGems/util/development/memory/HeapSampler.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+
+
+// stops the compiler from eliding new/delete pairs
+static char * volatile lastBlock;
+
+
+
+// out of line so that each shows up as its own call site
+__attribute__((noinline))
+static char **keepLive( int inCount, int inSize ) {
+    char **blocks = new char*[ inCount ];
+
+    for( int i=0; i<inCount; i++ ) {
+        blocks[i] = new char[ inSize ];
+        blocks[i][0] = 1;
+        }
+    return blocks;
+    }
+
+
+
+__attribute__((noinline))
+static long churn( int inCount, int inSize ) {
+    long sum = 0;
+
+    for( int i=0; i<inCount; i++ ) {
+        char *block = new char[ inSize ];
+        block[0] = (char)i;
+        sum += block[0];
+        lastBlock = block;
+        delete [] block;
+        }
+    return sum;
+    }
+
+
+
+static char near( double inEstimate, double inTrue ) {
+    return inEstimate > inTrue * 0.8 && inEstimate < inTrue * 1.2;
+    }
+
+
+
+int main() {
+
+    // off:  baseline timing
+    double startTime = Time::getCurrentTime();
+    long sum = churn( 5000000, 64 );
+    double offTime = Time::getCurrentTime() - startTime;
+
+
+    // same samples every run
+    HeapSampler::setRandomSeed( 12345 );
+
+    HeapSampler::start( 65536, SIGUSR2 );
+    check( HeapSampler::isSampling(), "started" );
+
+
+    // 64 MB held, about 1000 samples, so the estimate's standard
+    // deviation is near 3%
+    char **held = keepLive( 64000, 1000 );
+
+    // 32 MB passed through
+    sum += churn( 320000, 100 );
+
+    double liveBytes, allocatedBytes;
+    long numSamples;
+    HeapSampler::getTotals( &liveBytes, &allocatedBytes, &numSamples );
+
+    printf( "Estimated live %.2f MB (true 64.51), "
+            "allocated %.2f MB (true 96.51), %ld samples\n",
+            liveBytes / 1e6, allocatedBytes / 1e6, numSamples );
+
+    check( near( liveBytes, 64512000 ), "live estimate" );
+    check( near( allocatedBytes, 96512000 ), "allocated estimate" );
+
+
+    HeapSampler::writeReport( stdout, 2 );
+
+
+    char fileName[100];
+    sprintf( fileName, "heapProfile_%d_0.heap", (int)getpid() );
+
+    raise( SIGUSR2 );
+
+    FILE *dump = NULL;
+    for( int i=0; i<100 && dump == NULL; i++ ) {
+        usleep( 10000 );
+        dump = fopen( fileName, "r" );
+        }
+    check( dump != NULL, "signal dump written" );
+
+    if( dump != NULL ) {
+        // give the dump thread time to finish writing
+        usleep( 100000 );
+
+        char line[200];
+        check( fgets( line, sizeof( line ), dump ) != NULL &&
+               strstr( line, "heap profile:" ) == line &&
+               strstr( line, "@ heap_v2/65536" ) != NULL,
+               "pprof header" );
+        fclose( dump );
+        remove( fileName );
+        }
+
+
+    for( int i=0; i<64000; i++ ) {
+        delete [] held[i];
+        }
+    delete [] held;
+
+    HeapSampler::getTotals( &liveBytes, &allocatedBytes, &numSamples );
+    check( liveBytes < 100000, "frees reduce live estimate" );
+
+
+    // a restart cannot change the interval the totals were sampled at
+    HeapSampler::stop();
+    HeapSampler::start();
+
+    FILE *profile = tmpfile();
+    check( profile != NULL, "temp file" );
+
+    if( profile != NULL ) {
+        HeapSampler::writePprofProfile( profile );
+        rewind( profile );
+
+        char line[200];
+        check( fgets( line, sizeof( line ), profile ) != NULL &&
+               strstr( line, "@ heap_v2/65536" ) != NULL,
+               "restart keeps interval" );
+        fclose( profile );
+        }
+
+
+    // on:  still 1 per 64 KiB
+
+    startTime = Time::getCurrentTime();
+    sum += churn( 5000000, 64 );
+    double onTime = Time::getCurrentTime() - startTime;
+
+    HeapSampler::stop();
+
+    printf( "5M new/delete pairs:  not sampling %.1f ms, "
+            "sampling %.1f ms (checksum %ld)\n",
+            offTime * 1000, onTime * 1000, sum );
+
+    return reportChecks();
+    }
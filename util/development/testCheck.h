@@ -0,0 +1,49 @@
+#ifndef TEST_CHECK_INCLUDED
+#define TEST_CHECK_INCLUDED
+
+
+
+#include <stdio.h>
+
+
+
+/**
+ * Pass/fail bookkeeping shared by the self-checking test programs.
+ *
+ * Include from the test's .cpp only (everything here is static).  Call
+ * check for each condition, and end main with
+ * return reportChecks();
+ *
+ * @author Jason Rohrer
+ */
+
+
+
+static int numFailed = 0;
+
+
+
+// prints inDescription and counts a failure if inCondition is false
+static inline void check( char inCondition, const char *inDescription ) {
+    if( ! inCondition ) {
+        printf( "FAILED:  %s\n", inDescription );
+        numFailed++;
+        }
+    }
+
+
+
+// prints a summary of all checks so far
+// returns an exit code for main:  0 if all passed, 1 otherwise
+static inline int reportChecks() {
+    if( numFailed > 0 ) {
+        printf( "%d checks FAILED\n", numFailed );
+        return 1;
+        }
+    printf( "All checks passed\n" );
+    return 0;
+    }
+
+
+
+#endif
@@ -0,0 +1,601 @@
+#include "minorGems/util/development/wallClockProfiler/SamplingProfiler.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
+
+
+#ifdef SAMPLING_PROFILER_LIBUNWIND
+#define UNW_LOCAL_ONLY
+#include <libunwind.h>
+#endif
+
+
+
+// samples a thread can hold before the collector drains them
+// (the collector wakes every 20 ms, so this covers over 5 kHz)
+#define RING_SIZE  128
+
+
+typedef struct ProfilerSample {
+        int numFrames;
+
+        // leaf first
+        void *frames[ SAMPLING_PROFILER_MAX_FRAMES ];
+    } ProfilerSample;
+
+
+
+// one per registered thread, reused after the thread unregisters
+typedef struct ProfilerSlot {
+        ProfilerSlot *next;
+
+        // true while claimed by a thread
+        int inUse;
+
+        pid_t tid;
+        pthread_t thread;
+
+        timer_t timer;
+        char hasTimer;
+
+        // bounds for frame pointer walking
+        char *stackLow;
+        char *stackHigh;
+
+        // written only by the thread's signal handler, read only by the
+        // collector
+        unsigned int writeIndex;
+        unsigned int readIndex;
+        long numDropped;
+
+        ProfilerSample ring[ RING_SIZE ];
+    } ProfilerSlot;
+
+
+
+// a distinct stack and how often it was sampled
+typedef struct ProfilerStack {
+        ProfilerStack *next;
+        unsigned long hash;
+        long count;
+
+        int numFrames;
+        void *frames[ SAMPLING_PROFILER_MAX_FRAMES ];
+    } ProfilerStack;
+
+
+#define STACK_TABLE_SIZE  16384
+
+
+
+// pushed with CAS, never removed
+static ProfilerSlot *slotList = NULL;
+
+static thread_local ProfilerSlot *currentSlot = NULL;
+
+
+// guards timers, the stack table, and start/stop
+static pthread_mutex_t profilerLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int running = false;
+static int samplesPerSecond = 1000;
+static SamplingProfilerMode mode = profileWallClock;
+
+static pthread_t collectorThread;
+
+static ProfilerStack *stackTable[ STACK_TABLE_SIZE ];
+static long numSamples = 0;
+
+
+
+static unsigned long hashFrames( void **inFrames, int inNumFrames ) {
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for( int i=0; i<inNumFrames; i++ ) {
+        hash ^= (unsigned long long)(size_t)inFrames[i];
+        hash *= 1099511628211ULL;
+        }
+    return (unsigned long)( hash ^ ( hash >> 32 ) );
+    }
+
+
+
+// walks the interrupted stack, returns number of frames
+static int unwindStack( ucontext_t *inContext, ProfilerSlot *inSlot,
+                        void **outFrames ) {
+
+    #ifdef SAMPLING_PROFILER_LIBUNWIND
+
+        unw_cursor_t cursor;
+        if( unw_init_local2( &cursor, (unw_context_t *)inContext,
+                             UNW_INIT_SIGNAL_FRAME ) != 0 ) {
+            return 0;
+            }
+
+        int numFrames = 0;
+        do {
+            unw_word_t pc;
+            unw_get_reg( &cursor, UNW_REG_IP, &pc );
+            if( pc == 0 ) {
+                break;
+                }
+            outFrames[ numFrames ] = (void *)pc;
+            numFrames++;
+            }
+        while( numFrames < SAMPLING_PROFILER_MAX_FRAMES &&
+               unw_step( &cursor ) > 0 );
+
+        return numFrames;
+
+    #else
+
+        char *pc;
+        char *fp;
+
+        #if defined( __x86_64__ )
+            pc = (char *)inContext->uc_mcontext.gregs[ REG_RIP ];
+            fp = (char *)inContext->uc_mcontext.gregs[ REG_RBP ];
+        #elif defined( __i386__ )
+            pc = (char *)inContext->uc_mcontext.gregs[ REG_EIP ];
+            fp = (char *)inContext->uc_mcontext.gregs[ REG_EBP ];
+        #elif defined( __aarch64__ )
+            pc = (char *)inContext->uc_mcontext.pc;
+            fp = (char *)inContext->uc_mcontext.regs[29];
+        #else
+            return 0;
+        #endif
+
+        outFrames[0] = pc;
+        int numFrames = 1;
+
+        // each frame starts with the caller's frame pointer, followed
+        // by the return address
+        while( numFrames < SAMPLING_PROFILER_MAX_FRAMES ) {
+
+            if( fp < inSlot->stackLow ||
+                fp + 2 * sizeof( void * ) > inSlot->stackHigh ||
+                ( (size_t)fp & ( sizeof( void * ) - 1 ) ) != 0 ) {
+                // not a frame pointer, code without frame pointers
+                break;
+                }
+
+            void **frame = (void **)fp;
+
+            void *returnAddress = frame[1];
+            if( returnAddress == NULL ) {
+                break;
+                }
+
+            outFrames[ numFrames ] = returnAddress;
+            numFrames++;
+
+            char *nextFP = (char *)frame[0];
+            if( nextFP <= fp ) {
+                // stacks grow down, so callers' frames are higher
+                break;
+                }
+            fp = nextFP;
+            }
+
+        return numFrames;
+
+    #endif
+    }
+
+
+
+static void profileSignalHandler( int inSignal, siginfo_t *inInfo,
+                                  void *inContext ) {
+    int savedErrno = errno;
+
+    ProfilerSlot *slot = currentSlot;
+
+    if( slot != NULL ) {
+        unsigned int writeIndex = slot->writeIndex;
+        unsigned int readIndex =
+            __atomic_load_n( &( slot->readIndex ), __ATOMIC_ACQUIRE );
+
+        if( writeIndex - readIndex >= RING_SIZE ) {
+            __atomic_add_fetch( &( slot->numDropped ), 1, __ATOMIC_RELAXED );
+            }
+        else {
+            ProfilerSample *sample = &( slot->ring[ writeIndex % RING_SIZE ] );
+
+            sample->numFrames =
+                unwindStack( (ucontext_t *)inContext, slot, sample->frames );
+
+            __atomic_store_n( &( slot->writeIndex ), writeIndex + 1,
+                              __ATOMIC_RELEASE );
+            }
+        }
+
+    errno = savedErrno;
+    }
+
+
+
+// profilerLock must be held
+static void armTimer( ProfilerSlot *inSlot ) {
+    if( inSlot->hasTimer ) {
+        return;
+        }
+
+    clockid_t clock = CLOCK_MONOTONIC;
+
+    if( mode == profileCPU ) {
+        if( pthread_getcpuclockid( inSlot->thread, &clock ) != 0 ) {
+            return;
+            }
+        }
+
+    struct sigevent event;
+    memset( &event, 0, sizeof( event ) );
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event._sigev_un._tid = inSlot->tid;
+
+    if( timer_create( clock, &event, &( inSlot->timer ) ) != 0 ) {
+        return;
+        }
+
+    long intervalNS = 1000000000L / samplesPerSecond;
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = intervalNS / 1000000000L;
+    spec.it_interval.tv_nsec = intervalNS % 1000000000L;
+    spec.it_value = spec.it_interval;
+
+    timer_settime( inSlot->timer, 0, &spec, NULL );
+
+    inSlot->hasTimer = true;
+    }
+
+
+
+// profilerLock must be held
+static void disarmTimer( ProfilerSlot *inSlot ) {
+    if( inSlot->hasTimer ) {
+        timer_delete( inSlot->timer );
+        inSlot->hasTimer = false;
+        }
+    }
+
+
+
+// moves samples from all rings into the stack table
+// profilerLock must be held
+static void drainRings() {
+    for( ProfilerSlot *slot = __atomic_load_n( &slotList, __ATOMIC_ACQUIRE );
+         slot != NULL; slot = slot->next ) {
+
+        unsigned int writeIndex =
+            __atomic_load_n( &( slot->writeIndex ), __ATOMIC_ACQUIRE );
+        unsigned int readIndex = slot->readIndex;
+
+        while( readIndex != writeIndex ) {
+            ProfilerSample *sample = &( slot->ring[ readIndex % RING_SIZE ] );
+
+            unsigned long hash = hashFrames( sample->frames,
+                                             sample->numFrames );
+
+            ProfilerStack **bucket =
+                &( stackTable[ hash % STACK_TABLE_SIZE ] );
+
+            ProfilerStack *stack = *bucket;
+
+            while( stack != NULL ) {
+                if( stack->hash == hash &&
+                    stack->numFrames == sample->numFrames &&
+                    memcmp( stack->frames, sample->frames,
+                            sample->numFrames * sizeof( void * ) ) == 0 ) {
+                    break;
+                    }
+                stack = stack->next;
+                }
+
+            if( stack == NULL ) {
+                stack = (ProfilerStack *)malloc( sizeof( ProfilerStack ) );
+                stack->hash = hash;
+                stack->count = 0;
+                stack->numFrames = sample->numFrames;
+                memcpy( stack->frames, sample->frames,
+                        sample->numFrames * sizeof( void * ) );
+
+                stack->next = *bucket;
+                *bucket = stack;
+                }
+
+            stack->count++;
+            numSamples++;
+
+            readIndex++;
+            }
+
+        __atomic_store_n( &( slot->readIndex ), readIndex,
+                          __ATOMIC_RELEASE );
+        }
+    }
+
+
+
+static void *collectorFunction( void *inArg ) {
+    while( __atomic_load_n( &running, __ATOMIC_ACQUIRE ) ) {
+        usleep( 20000 );
+
+        pthread_mutex_lock( &profilerLock );
+        drainRings();
+        pthread_mutex_unlock( &profilerLock );
+        }
+    return NULL;
+    }
+
+
+
+void SamplingProfiler::registerThread() {
+    if( currentSlot != NULL ) {
+        return;
+        }
+
+    ProfilerSlot *slot = NULL;
+
+    // reuse a slot left by a finished thread
+    for( ProfilerSlot *s = __atomic_load_n( &slotList, __ATOMIC_ACQUIRE );
+         s != NULL; s = s->next ) {
+
+        int expected = false;
+        if( __atomic_compare_exchange_n( &( s->inUse ), &expected, true,
+                                         false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE ) ) {
+            slot = s;
+            break;
+            }
+        }
+
+    if( slot == NULL ) {
+        slot = (ProfilerSlot *)calloc( 1, sizeof( ProfilerSlot ) );
+        slot->inUse = true;
+
+        ProfilerSlot *head = __atomic_load_n( &slotList, __ATOMIC_ACQUIRE );
+        do {
+            slot->next = head;
+            }
+        while( ! __atomic_compare_exchange_n( &slotList, &head, slot,
+                                              false, __ATOMIC_ACQ_REL,
+                                              __ATOMIC_ACQUIRE ) );
+        }
+
+    slot->tid = (pid_t)syscall( SYS_gettid );
+    slot->thread = pthread_self();
+
+    slot->stackLow = NULL;
+    slot->stackHigh = NULL;
+
+    pthread_attr_t attr;
+    if( pthread_getattr_np( pthread_self(), &attr ) == 0 ) {
+        void *stackAddress;
+        size_t stackSize;
+        if( pthread_attr_getstack( &attr, &stackAddress, &stackSize ) == 0 ) {
+            slot->stackLow = (char *)stackAddress;
+            slot->stackHigh = slot->stackLow + stackSize;
+            }
+        pthread_attr_destroy( &attr );
+        }
+
+    currentSlot = slot;
+
+    pthread_mutex_lock( &profilerLock );
+    if( running ) {
+        armTimer( slot );
+        }
+    pthread_mutex_unlock( &profilerLock );
+    }
+
+
+
+void SamplingProfiler::unregisterThread() {
+    ProfilerSlot *slot = currentSlot;
+
+    if( slot == NULL ) {
+        return;
+        }
+
+    pthread_mutex_lock( &profilerLock );
+    disarmTimer( slot );
+    pthread_mutex_unlock( &profilerLock );
+
+    // a signal still in flight finds no slot
+    currentSlot = NULL;
+
+    __atomic_store_n( &( slot->inUse ), false, __ATOMIC_RELEASE );
+    }
+
+
+
+char SamplingProfiler::start( int inSamplesPerSecond,
+                              SamplingProfilerMode inMode ) {
+    if( inSamplesPerSecond < 1 ) {
+        inSamplesPerSecond = 1;
+        }
+
+    pthread_mutex_lock( &profilerLock );
+
+    if( running ) {
+        pthread_mutex_unlock( &profilerLock );
+        return false;
+        }
+
+    samplesPerSecond = inSamplesPerSecond;
+    mode = inMode;
+
+    // clear totals from last time
+    for( int i=0; i<STACK_TABLE_SIZE; i++ ) {
+        while( stackTable[i] != NULL ) {
+            ProfilerStack *next = stackTable[i]->next;
+            free( stackTable[i] );
+            stackTable[i] = next;
+            }
+        }
+    numSamples = 0;
+
+    for( ProfilerSlot *slot = slotList; slot != NULL; slot = slot->next ) {
+        slot->readIndex = slot->writeIndex;
+        slot->numDropped = 0;
+        }
+
+
+    struct sigaction action;
+    memset( &action, 0, sizeof( action ) );
+    action.sa_sigaction = profileSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset( &action.sa_mask );
+
+    if( sigaction( SIGPROF, &action, NULL ) != 0 ) {
+        pthread_mutex_unlock( &profilerLock );
+        return false;
+        }
+
+    __atomic_store_n( &running, true, __ATOMIC_RELEASE );
+
+    if( pthread_create( &collectorThread, NULL,
+                        collectorFunction, NULL ) != 0 ) {
+        running = false;
+        pthread_mutex_unlock( &profilerLock );
+        return false;
+        }
+
+    // threads that registered before we started
+    for( ProfilerSlot *slot = slotList; slot != NULL; slot = slot->next ) {
+        if( __atomic_load_n( &( slot->inUse ), __ATOMIC_ACQUIRE ) ) {
+            armTimer( slot );
+            }
+        }
+
+    pthread_mutex_unlock( &profilerLock );
+
+    registerThread();
+
+    return true;
+    }
+
+
+
+void SamplingProfiler::stop() {
+    pthread_mutex_lock( &profilerLock );
+
+    if( ! running ) {
+        pthread_mutex_unlock( &profilerLock );
+        return;
+        }
+
+    for( ProfilerSlot *slot = slotList; slot != NULL; slot = slot->next ) {
+        disarmTimer( slot );
+        }
+
+    __atomic_store_n( &running, false, __ATOMIC_RELEASE );
+
+    pthread_mutex_unlock( &profilerLock );
+
+
+    pthread_join( collectorThread, NULL );
+
+    pthread_mutex_lock( &profilerLock );
+    drainRings();
+    pthread_mutex_unlock( &profilerLock );
+    }
+
+
+
+char SamplingProfiler::isRunning() {
+    return __atomic_load_n( &running, __ATOMIC_ACQUIRE );
+    }
+
+
+
+void SamplingProfiler::getCounts( long *outNumSamples,
+                                  long *outNumDropped ) {
+    pthread_mutex_lock( &profilerLock );
+
+    drainRings();
+
+    *outNumSamples = numSamples;
+    *outNumDropped = 0;
+
+    for( ProfilerSlot *slot = slotList; slot != NULL; slot = slot->next ) {
+        *outNumDropped += slot->numDropped;
+        }
+
+    pthread_mutex_unlock( &profilerLock );
+    }
+
+
+
+void SamplingProfiler::writeProfile( FILE *inFile ) {
+    long dropped;
+    long samples;
+    getCounts( &samples, &dropped );
+
+    pthread_mutex_lock( &profilerLock );
+
+    fprintf( inFile, "minorGems sampling profile\n" );
+    fprintf( inFile, "mode %s\n",
+             ( mode == profileCPU ) ? "cpu" : "wall" );
+    fprintf( inFile, "rate %d\n", samplesPerSecond );
+    fprintf( inFile, "samples %ld\n", samples );
+    fprintf( inFile, "dropped %ld\n", dropped );
+
+    // count, then addresses leaf first
+    fprintf( inFile, "stacks:\n" );
+
+    for( int i=0; i<STACK_TABLE_SIZE; i++ ) {
+        for( ProfilerStack *stack = stackTable[i]; stack != NULL;
+             stack = stack->next ) {
+
+            fprintf( inFile, "%ld", stack->count );
+
+            for( int f=0; f<stack->numFrames; f++ ) {
+                fprintf( inFile, " %p", stack->frames[f] );
+                }
+            fprintf( inFile, "\n" );
+            }
+        }
+
+    pthread_mutex_unlock( &profilerLock );
+
+
+    // for offline symbolization
+    fprintf( inFile, "maps:\n" );
+
+    FILE *maps = fopen( "/proc/self/maps", "r" );
+
+    if( maps != NULL ) {
+        char buffer[4096];
+        size_t numRead;
+        while( ( numRead = fread( buffer, 1, sizeof( buffer ), maps ) ) > 0 ) {
+            fwrite( buffer, 1, numRead, inFile );
+            }
+        fclose( maps );
+        }
+    }
+
+
+
+char SamplingProfiler::dumpProfile( const char *inFileName ) {
+    FILE *file = fopen( inFileName, "w" );
+
+    if( file == NULL ) {
+        return false;
+        }
+
+    writeProfile( file );
+
+    fclose( file );
+    return true;
+    }
@@ -0,0 +1,131 @@
+#ifndef SAMPLING_PROFILER_INCLUDED
+#define SAMPLING_PROFILER_INCLUDED
+
+
+
+#include <stdio.h>
+
+
+
+// deepest call stack recorded for a sample
+#define SAMPLING_PROFILER_MAX_FRAMES  64
+
+
+// what the per-thread timers count
+enum SamplingProfilerMode {
+    // elapsed time, including time spent blocked or sleeping
+    profileWallClock = 0,
+
+    // CPU time used by each thread
+    // (the kernel only checks CPU timers on scheduler ticks, so rates
+    //  above its HZ, often 250, are capped at it)
+    profileCPU
+    };
+
+
+
+/**
+ * An in-process sampling profiler, for profiling a live server without
+ * attaching a debugger.
+ *
+ * Each registered thread gets its own POSIX timer that sends it SIGPROF
+ * at the sample rate.  The signal handler walks the interrupted stack
+ * by frame pointers (or with libunwind, if compiled with
+ * -DSAMPLING_PROFILER_LIBUNWIND and linked with -lunwind) into a
+ * lock-free per-thread ring, and a collector thread totals the stacks
+ * in the background.  At 1000 samples per second this costs well under
+ * 2%.
+ *
+ * Profiles hold raw addresses and the process's memory map, and are
+ * symbolized offline into folded stacks for flamegraph.pl with the
+ * symbolizeProfile tool in this directory.
+ *
+ * Frame pointer unwinding needs code compiled with
+ * -fno-omit-frame-pointer; elsewhere stacks are cut short.
+ *
+ * Linux only (x86, x86-64, and ARM64).  Link with -lrt -lpthread.
+ *
+ * Threads started with minorGems' Thread register themselves when
+ * ThreadLinux.cpp is compiled with -DUSE_SAMPLING_PROFILER.  Other
+ * threads must call registerThread themselves.
+ *
+ * @author Jason Rohrer
+ */
+class SamplingProfiler {
+
+    public:
+
+
+        /**
+         * Starts profiling, and registers the calling thread.
+         *
+         * @param inSamplesPerSecond the per-thread sample rate.
+         * @param inMode profileWallClock or profileCPU.
+         *
+         * @return true on success.
+         */
+        static char start( int inSamplesPerSecond = 1000,
+                           SamplingProfilerMode inMode = profileWallClock );
+
+
+        /**
+         * Stops profiling, stopping all thread timers and collecting
+         * the last samples.  Totals are kept until the next start().
+         */
+        static void stop();
+
+
+        static char isRunning();
+
+
+
+        /**
+         * Starts sampling the calling thread.
+         *
+         * Safe to call before start(), in which case the thread is
+         * sampled once profiling starts.
+         */
+        static void registerThread();
+
+
+        // stops sampling the calling thread, must be called before a
+        // registered thread exits
+        static void unregisterThread();
+
+
+
+        /**
+         * Writes the samples collected so far as a raw profile, to be
+         * symbolized offline.
+         *
+         * @param inFile the file to write to.
+         */
+        static void writeProfile( FILE *inFile );
+
+
+        /**
+         * Writes a raw profile to a new file.
+         *
+         * @param inFileName the file name.
+         *   Must be destroyed by caller.
+         *
+         * @return true on success.
+         */
+        static char dumpProfile( const char *inFileName );
+
+
+
+        /**
+         * Gets sample counts.
+         *
+         * @param outNumSamples the number of samples collected.
+         * @param outNumDropped the number of samples lost because a
+         *   thread's ring was full.
+         */
+        static void getCounts( long *outNumSamples, long *outNumDropped );
+
+    };
+
+
+
+#endif
@@ -0,0 +1,422 @@
+// Turns a raw profile written by SamplingProfiler into folded stacks,
+// one line per distinct stack with its sample count:
+//
+//     main;serveRequest;readRequest 42
+//
+// which flamegraph.pl turns into a flame graph:
+//
+//     symbolizeProfile profile.txt > profile.folded
+//     flamegraph.pl profile.folded > profile.svg
+//
+// Symbols come from addr2line, run against each binary in the profile's
+// memory map, so this must run where those binaries (with symbols) are.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+
+static void usage() {
+    printf( "\nUsage:\n\n"
+            "    symbolizeProfile profile.txt [--lines]\n\n"
+            "Writes folded stacks for flamegraph.pl to stdout.\n"
+            "--lines adds file:line to each function name.\n\n" );
+    exit( 1 );
+    }
+
+
+
+typedef struct Mapping {
+        unsigned long start;
+        unsigned long end;
+        unsigned long offset;
+        char *path;
+
+        // true for non-PIE executables, which are not relocated
+        char absolute;
+    } Mapping;
+
+
+typedef struct SampledStack {
+        long count;
+        SimpleVector<unsigned long> addresses;
+    } SampledStack;
+
+
+typedef struct Symbol {
+        // for return addresses, one byte back into the call instruction
+        unsigned long address;
+        char *name;
+    } Symbol;
+
+
+typedef struct FoldedStack {
+        char *text;
+        long count;
+    } FoldedStack;
+
+
+
+static int compareSymbols( const void *inA, const void *inB ) {
+    unsigned long a = ( (Symbol *)inA )->address;
+    unsigned long b = ( (Symbol *)inB )->address;
+
+    if( a < b ) {
+        return -1;
+        }
+    if( a > b ) {
+        return 1;
+        }
+    return 0;
+    }
+
+
+
+static int compareFolded( const void *inA, const void *inB ) {
+    return strcmp( ( (FoldedStack *)inA )->text,
+                   ( (FoldedStack *)inB )->text );
+    }
+
+
+
+// reads ELF type from header, true if ET_EXEC
+static char isAbsoluteExecutable( const char *inPath ) {
+    FILE *file = fopen( inPath, "rb" );
+
+    if( file == NULL ) {
+        return false;
+        }
+
+    unsigned char header[18];
+    int numRead = fread( header, 1, 18, file );
+    fclose( file );
+
+    if( numRead != 18 || memcmp( header, "\x7f" "ELF", 4 ) != 0 ) {
+        return false;
+        }
+
+    // e_type, in the file's byte order (header[5] is 1 for little endian)
+    int type;
+    if( header[5] == 1 ) {
+        type = header[16] | ( header[17] << 8 );
+        }
+    else {
+        type = ( header[16] << 8 ) | header[17];
+        }
+
+    return ( type == 2 );
+    }
+
+
+
+static const char *baseName( const char *inPath ) {
+    const char *slash = strrchr( inPath, '/' );
+
+    if( slash != NULL ) {
+        return &( slash[1] );
+        }
+    return inPath;
+    }
+
+
+
+// names a batch of symbols from one binary with a single addr2line call
+static void runAddr2line( Mapping *inMapping, Symbol **inSymbols,
+                          int inNumSymbols, char inLines ) {
+
+    SimpleVector<char> command;
+
+    char *start = autoSprintf( "addr2line -f -C -e '%s'", inMapping->path );
+    command.appendElementString( start );
+    delete [] start;
+
+    for( int i=0; i<inNumSymbols; i++ ) {
+        unsigned long address = inSymbols[i]->address;
+
+        if( ! inMapping->absolute ) {
+            address = address - inMapping->start + inMapping->offset;
+            }
+
+        char *arg = autoSprintf( " 0x%lx", address );
+        command.appendElementString( arg );
+        delete [] arg;
+        }
+
+    char *commandString = command.getElementString();
+
+    FILE *pipe = popen( commandString, "r" );
+    delete [] commandString;
+
+    if( pipe == NULL ) {
+        return;
+        }
+
+    char functionName[4096];
+    char location[4096];
+
+    for( int i=0; i<inNumSymbols; i++ ) {
+        if( fgets( functionName, sizeof( functionName ), pipe ) == NULL ||
+            fgets( location, sizeof( location ), pipe ) == NULL ) {
+            break;
+            }
+
+        functionName[ strcspn( functionName, "\n" ) ] = '\0';
+        location[ strcspn( location, "\n" ) ] = '\0';
+
+        if( strcmp( functionName, "??" ) == 0 ) {
+            continue;
+            }
+
+        // ; separates frames in folded stacks
+        for( int c=0; functionName[c] != '\0'; c++ ) {
+            if( functionName[c] == ';' ) {
+                functionName[c] = ':';
+                }
+            }
+
+        delete [] inSymbols[i]->name;
+
+        if( inLines && strstr( location, "??" ) != location ) {
+            inSymbols[i]->name = autoSprintf( "%s [%s]", functionName,
+                                              baseName( location ) );
+            }
+        else {
+            inSymbols[i]->name = stringDuplicate( functionName );
+            }
+        }
+
+    pclose( pipe );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs != 2 && inNumArgs != 3 ) {
+        usage();
+        }
+
+    char showLines = false;
+    if( inNumArgs == 3 ) {
+        if( strcmp( inArgs[2], "--lines" ) != 0 ) {
+            usage();
+            }
+        showLines = true;
+        }
+
+
+    FILE *file = fopen( inArgs[1], "r" );
+
+    if( file == NULL ) {
+        printf( "Failed to open profile %s\n", inArgs[1] );
+        return 1;
+        }
+
+
+    SimpleVector<SampledStack*> stacks;
+    SimpleVector<Mapping> maps;
+
+    // header, then stacks, then maps
+    int section = 0;
+
+    char line[16384];
+
+    while( fgets( line, sizeof( line ), file ) != NULL ) {
+        line[ strcspn( line, "\n" ) ] = '\0';
+
+        if( strcmp( line, "stacks:" ) == 0 ) {
+            section = 1;
+            }
+        else if( strcmp( line, "maps:" ) == 0 ) {
+            section = 2;
+            }
+        else if( section == 0 ) {
+            // pass header through to stderr, so it doesn't end up in
+            // the folded stacks
+            fprintf( stderr, "%s\n", line );
+            }
+        else if( section == 1 ) {
+            int numParts;
+            char **parts = split( line, " ", &numParts );
+
+            if( numParts > 1 ) {
+                SampledStack *stack = new SampledStack;
+                sscanf( parts[0], "%ld", &( stack->count ) );
+
+                for( int i=1; i<numParts; i++ ) {
+                    unsigned long address = 0;
+                    sscanf( parts[i], "%lx", &address );
+
+                    if( i > 1 && address > 0 ) {
+                        // a return address, look up the call instead
+                        address --;
+                        }
+                    stack->addresses.push_back( address );
+                    }
+                stacks.push_back( stack );
+                }
+
+            for( int i=0; i<numParts; i++ ) {
+                delete [] parts[i];
+                }
+            delete [] parts;
+            }
+        else {
+            unsigned long start, end, offset;
+            char perms[5];
+            char path[4096];
+            path[0] = '\0';
+
+            int numRead = sscanf( line, "%lx-%lx %4s %lx %*s %*s %4095s",
+                                  &start, &end, perms, &offset, path );
+
+            if( numRead == 5 && path[0] == '/' && perms[2] == 'x' ) {
+                Mapping m;
+                m.start = start;
+                m.end = end;
+                m.offset = offset;
+                m.path = stringDuplicate( path );
+                m.absolute = isAbsoluteExecutable( path );
+                maps.push_back( m );
+                }
+            }
+        }
+
+    fclose( file );
+
+
+    // every distinct address, named by mapping until addr2line knows better
+    SimpleVector<Symbol> symbolList;
+
+    for( int s=0; s<stacks.size(); s++ ) {
+        SampledStack *stack = stacks.getElementDirect( s );
+
+        for( int a=0; a<stack->addresses.size(); a++ ) {
+            Symbol symbol;
+            symbol.address = stack->addresses.getElementDirect( a );
+            symbol.name = NULL;
+            symbolList.push_back( symbol );
+            }
+        }
+
+    int numSymbols = symbolList.size();
+    Symbol *symbols = symbolList.getElementArray();
+
+    qsort( symbols, numSymbols, sizeof( Symbol ), compareSymbols );
+
+    int numUnique = 0;
+    for( int i=0; i<numSymbols; i++ ) {
+        if( numUnique == 0 ||
+            symbols[i].address != symbols[ numUnique - 1 ].address ) {
+            symbols[ numUnique ] = symbols[i];
+            numUnique++;
+            }
+        }
+    numSymbols = numUnique;
+
+
+    for( int m=0; m<maps.size(); m++ ) {
+        Mapping *mapping = maps.getElement( m );
+
+        SimpleVector<Symbol*> batch;
+
+        for( int i=0; i<numSymbols; i++ ) {
+            if( symbols[i].address >= mapping->start &&
+                symbols[i].address < mapping->end ) {
+
+                symbols[i].name = autoSprintf(
+                    "[%s+0x%lx]", baseName( mapping->path ),
+                    symbols[i].address - mapping->start + mapping->offset );
+
+                batch.push_back( &( symbols[i] ) );
+                }
+            }
+
+        Symbol **batchArray = batch.getElementArray();
+
+        // keep command lines short
+        for( int b=0; b<batch.size(); b += 500 ) {
+            int batchSize = batch.size() - b;
+            if( batchSize > 500 ) {
+                batchSize = 500;
+                }
+            runAddr2line( mapping, &( batchArray[b] ), batchSize, showLines );
+            }
+
+        delete [] batchArray;
+        }
+
+    for( int i=0; i<numSymbols; i++ ) {
+        if( symbols[i].name == NULL ) {
+            symbols[i].name = stringDuplicate( "[unknown]" );
+            }
+        }
+
+
+    // fold, root first, merging stacks that symbolize the same
+    FoldedStack *folded = new FoldedStack[ stacks.size() ];
+    long totalCount = 0;
+
+    for( int s=0; s<stacks.size(); s++ ) {
+        SampledStack *stack = stacks.getElementDirect( s );
+
+        SimpleVector<char> text;
+
+        for( int a=stack->addresses.size() - 1; a>=0; a-- ) {
+            Symbol key;
+            key.address = stack->addresses.getElementDirect( a );
+
+            Symbol *symbol = (Symbol *)bsearch( &key, symbols, numSymbols,
+                                                sizeof( Symbol ),
+                                                compareSymbols );
+            text.appendElementString( symbol->name );
+
+            if( a > 0 ) {
+                text.push_back( ';' );
+                }
+            }
+
+        folded[s].text = text.getElementString();
+        folded[s].count = stack->count;
+        totalCount += stack->count;
+        }
+
+    qsort( folded, stacks.size(), sizeof( FoldedStack ), compareFolded );
+
+    for( int s=0; s<stacks.size(); s++ ) {
+        if( s + 1 < stacks.size() &&
+            strcmp( folded[s].text, folded[ s + 1 ].text ) == 0 ) {
+            folded[ s + 1 ].count += folded[s].count;
+            }
+        else {
+            printf( "%s %ld\n", folded[s].text, folded[s].count );
+            }
+        }
+
+    fprintf( stderr, "%d stacks, %ld samples, %d binaries\n",
+             stacks.size(), totalCount, maps.size() );
+
+
+    for( int s=0; s<stacks.size(); s++ ) {
+        delete [] folded[s].text;
+        delete stacks.getElementDirect( s );
+        }
+    delete [] folded;
+
+    for( int i=0; i<numSymbols; i++ ) {
+        delete [] symbols[i].name;
+        }
+    delete [] symbols;
+
+    for( int m=0; m<maps.size(); m++ ) {
+        delete [] maps.getElement( m )->path;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,139 @@
+// Profiles a busy thread and a sleeping one, checking that CPU mode only
+// counts the busy one, that wall clock mode counts both, and that
+// sampling at 1 kHz barely slows the busy work down.
+//
+// Writes testProfile.txt, for trying out symbolizeProfile:
+//     ./symbolizeProfile testProfile.txt
+
+
+#include "SamplingProfiler.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/Time.h"
+#include "minorGems/util/development/testCheck.h"
+
+#include <stdio.h>
+#include <math.h>
+
+
+
+static volatile double sink;
+
+
+__attribute__((noinline))
+static double fastWork( int inSteps ) {
+    double x = 0;
+    for( int i=0; i<inSteps; i++ ) {
+        x += sqrt( (double)i );
+        }
+    return x;
+    }
+
+
+
+__attribute__((noinline))
+static double slowWork( int inSteps ) {
+    // three times as long as fastWork, should get three times the samples
+    return fastWork( inSteps ) + fastWork( inSteps ) + fastWork( inSteps );
+    }
+
+
+
+__attribute__((noinline))
+static double busyWork( double inSeconds ) {
+    double startTime = Time::getCurrentTime();
+    double x = 0;
+
+    while( Time::getCurrentTime() - startTime < inSeconds ) {
+        x += slowWork( 100000 );
+        x += fastWork( 100000 );
+        }
+    return x;
+    }
+
+
+
+class SleepThread : public Thread {
+    public:
+        void run() {
+            sleep( 500 );
+            }
+    };
+
+
+
+// seconds to do a fixed amount of work
+static double timeWork() {
+    double startTime = Time::getCurrentTime();
+
+    for( int i=0; i<400; i++ ) {
+        sink = slowWork( 100000 );
+        }
+    return Time::getCurrentTime() - startTime;
+    }
+
+
+
+int main() {
+    long numSamples, numDropped;
+
+
+    // CPU:  500 ms busy here, sleeping thread contributes nothing
+    check( SamplingProfiler::start( 1000, profileCPU ), "start cpu" );
+
+    SleepThread sleeper;
+    sleeper.start();
+
+    sink = busyWork( 0.5 );
+
+    sleeper.join();
+    SamplingProfiler::stop();
+
+    SamplingProfiler::getCounts( &numSamples, &numDropped );
+    // CPU timers are capped at the kernel's tick rate, so anywhere
+    // from 100 Hz up
+    printf( "CPU mode:  %ld samples, %ld dropped (expected 50 to 500)\n",
+            numSamples, numDropped );
+
+    check( numSamples > 40 && numSamples < 600, "cpu sample count" );
+    check( numDropped == 0, "cpu none dropped" );
+
+    SamplingProfiler::dumpProfile( "testProfile.txt" );
+
+
+    // wall clock:  both threads sampled for 500 ms
+    check( SamplingProfiler::start( 1000, profileWallClock ), "start wall" );
+
+    SleepThread sleeper2;
+    sleeper2.start();
+
+    sink = busyWork( 0.5 );
+
+    sleeper2.join();
+    SamplingProfiler::stop();
+
+    SamplingProfiler::getCounts( &numSamples, &numDropped );
+    printf( "Wall clock mode:  %ld samples, %ld dropped "
+            "(expected about 1000)\n",
+            numSamples, numDropped );
+
+    check( numSamples > 800 && numSamples < 1200, "wall sample count" );
+
+
+    // overhead
+    double offTime = timeWork();
+
+    // wall clock, since CPU timers may not reach 1 kHz
+    SamplingProfiler::start( 1000, profileWallClock );
+    double onTime = timeWork();
+    SamplingProfiler::stop();
+
+    SamplingProfiler::getCounts( &numSamples, &numDropped );
+
+    printf( "Work unprofiled %.1f ms, profiled at 1 kHz %.1f ms "
+            "(%.2f%% overhead, %ld samples)\n",
+            offTime * 1000, onTime * 1000,
+            100 * ( onTime - offTime ) / offTime, numSamples );
+
+    return reportChecks();
+    }
@@ -20,6 +20,8 @@ static void usage() {
             "[detatch_sec]\n\n" );
     printf( "detatch_sec is the (optional) number of seconds before detatching and\n"
             "ending profiling (or -1 to stay attached forever, default)\n\n" );
+    printf( "For lower overhead and higher sample rates, link SamplingProfiler\n"
+            "into the program instead (see SamplingProfiler.h)\n\n" );
     
     exit( 1 );
     }